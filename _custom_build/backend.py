@@ -17,12 +17,17 @@ def build_wheel(wheel_dir, config_settings=None, metadata_dir=None):
           "Config settings:", config_settings)
     os.environ["MPI"] = str(_get_option(config_settings, 'MPI', '0'))
     os.environ["OPENMP"] = str(_get_option(config_settings, 'OPENMP', '0'))
+    os.environ["STATIC_PASSMETHODS"] = str(_get_option(config_settings,
+                                                       'STATIC_PASSMETHODS',
+                                                       '0'))
     omp_threshold = _get_option(config_settings,
                                 'OMP_PARTICLE_THRESHOLD', 'None')
     if omp_threshold is not None:
         os.environ["OMP_PARTICLE_THRESHOLD"] = str(omp_threshold)
     print("** MPI:", os.environ.get('MPI', 'None'))
     print("** OPENMP:", os.environ.get('OPENMP', 'None'))
+    print("** STATIC_PASSMETHODS:",
+          os.environ.get('STATIC_PASSMETHODS', 'None'))
     ret = _orig.build_wheel(wheel_dir, config_settings, metadata_dir)
     print("** Leaving build_wheel")
     return ret
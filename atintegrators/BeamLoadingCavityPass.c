@@ -18,6 +18,7 @@ struct elem
   double phasegain;
   double voltgain;
   double *turnhistory;
+  double *historyhead;
   double *z_cuts;
   double Length;
   double Voltage;
@@ -57,6 +58,7 @@ void BeamLoadingCavityPass(double *r_in,int num_particles,int nbunch,
     double rshunt = Elem->Rshunt;
     double beta = Elem->Beta;
     double *turnhistory = Elem->turnhistory;
+    double *historyhead = Elem->historyhead;
     double *z_cuts = Elem->z_cuts;
     double *vbunch = Elem->vbunch;
     double phasegain = Elem->phasegain;
@@ -67,7 +69,7 @@ void BeamLoadingCavityPass(double *r_in,int num_particles,int nbunch,
     double *vgenk = Elem->vgen;
 
     size_t sz = nslice*nbunch*sizeof(double) + num_particles*sizeof(int);
-    int c;
+    int c, head;
     int *pslice;
     double *kz;
     double freqres = rffreq/(1-tan(vgenk[1])/(2*qfactor));
@@ -83,22 +85,20 @@ void BeamLoadingCavityPass(double *r_in,int num_particles,int nbunch,
     pslice = iptr; iptr += num_particles;
 
     trackRFCavity(r_in,le,vgen/energy,rffreq,harmn,tlag,-psi,nturn,circumference/C0,num_particles);
-    rotate_table_history(nturnsw,nslice*nbunch,turnhistory,circumference);
-    slice_bunch(r_in,num_particles,nslice,nturnsw,nbunch,bunch_spos,bunch_currents,
+    head = advance_table_history(nturnsw,nslice*nbunch,turnhistory,historyhead);
+    slice_bunch(r_in,num_particles,nslice,nturnsw,head,nbunch,bunch_spos,bunch_currents,
                 turnhistory,pslice,z_cuts);
     if(mode==2){
-        compute_kicks_phasor(nslice,nbunch,nturnsw,turnhistory,normfact,kz,freqres,
+        compute_kicks_phasor(nslice,nbunch,nturnsw,head,turnhistory,normfact,kz,freqres,
                              qfactor,rshunt,vbeam_phasor,circumference,energy,beta,
                              vbeamk,vbunch);                        
     }else if(mode==1){
-        compute_kicks_longres(nslice,nbunch,nturnsw,turnhistory,normfact,kz,freqres,
+        compute_kicks_longres(nslice,nbunch,nturnsw,head,circumference,turnhistory,normfact,kz,freqres,
                               qfactor,rshunt,beta,vbeamk,energy,vbunch);
     }
     /*apply kicks and RF*/
-    /* OpenMP not efficient. Too much shared data ?
     #pragma omp parallel for if (num_particles > OMP_PARTICLE_THRESHOLD) default(none) \
     shared(r_in,num_particles,pslice,kz) private(c)
-    */   
     for (c=0; c<num_particles; c++) {
         double *r6 = r_in+c*6;
         int islice=pslice[c];
@@ -122,6 +122,7 @@ ExportMode struct elem *trackFunction(const atElem *ElemData,struct elem *Elem,
         double wakefact;
         double normfact, phasegain, voltgain;
         double *turnhistory;
+        double *historyhead;
         double *z_cuts;
         double Energy, Frequency, TimeLag, Length;
         double qfactor,rshunt,beta;
@@ -155,6 +156,7 @@ ExportMode struct elem *trackFunction(const atElem *ElemData,struct elem *Elem,
         vbeam_phasor=atGetDoubleArray(ElemData,"_vbeam_phasor"); check_error(); 
         /*optional attributes*/
         z_cuts=atGetOptionalDoubleArray(ElemData,"ZCuts"); check_error();
+        historyhead=atGetOptionalDoubleArray(ElemData,"_historyhead"); check_error();
        
         Elem = (struct elem*)atMalloc(sizeof(struct elem));
         
@@ -168,6 +170,7 @@ ExportMode struct elem *trackFunction(const atElem *ElemData,struct elem *Elem,
         Elem->nturnsw=nturns;
         Elem->normfact=normfact*wakefact;
         Elem->turnhistory=turnhistory;
+        Elem->historyhead=historyhead;
         Elem->Qfactor = qfactor;
         Elem->Rshunt = rshunt;
         Elem->Beta = beta;
@@ -195,6 +198,7 @@ ExportMode struct elem *trackFunction(const atElem *ElemData,struct elem *Elem,
     return Elem;
 }
 
+COLLECTIVE_PASSMETHOD
 MODULE_DEF(BeamLoadingCavityPass)       /* Dummy module initialisation */
 #endif /*defined(MATLAB_MEX_FILE) || defined(PYAT)*/
 
@@ -214,6 +218,7 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
       double wakefact;
       double normfact, phasegain, voltgain;
       double *turnhistory;
+      double *historyhead;
       double *z_cuts;
       double Energy, Frequency, TimeLag, Length;
       double qfactor,rshunt,beta;
@@ -246,6 +251,7 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
       vbeam_phasor=atGetDoubleArray(ElemData,"_vbeam_phasor"); check_error(); 
       /*optional attributes*/
       z_cuts=atGetOptionalDoubleArray(ElemData,"ZCuts"); check_error();
+      historyhead=atGetOptionalDoubleArray(ElemData,"_historyhead"); check_error();
       Elem = (struct elem*)atMalloc(sizeof(struct elem));
       Elem->Length=Length;
       Elem->mode=mode;
@@ -257,6 +263,7 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
       Elem->nturnsw=nturns;
       Elem->normfact=normfact*wakefact;
       Elem->turnhistory=turnhistory;
+      Elem->historyhead=historyhead;
       Elem->Qfactor = qfactor;
       Elem->Rshunt = rshunt;
       Elem->Beta = beta;
@@ -301,9 +308,10 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
       mxSetCell(plhs[0],18,mxCreateString("_vbeam_phasor"));
       if(nlhs>1) /* optional fields */
       {
-          plhs[1] = mxCreateCellMatrix(2,1);
+          plhs[1] = mxCreateCellMatrix(3,1);
           mxSetCell(plhs[1],0,mxCreateString("TimeLag"));
-          mxSetCell(plhs[0],1,mxCreateString("ZCuts"));
+          mxSetCell(plhs[1],1,mxCreateString("ZCuts"));
+          mxSetCell(plhs[1],2,mxCreateString("_historyhead"));
       }
   }
   else
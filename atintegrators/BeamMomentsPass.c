@@ -8,63 +8,169 @@
 #include <mpi4py/mpi4py.h>
 #endif
 /*
- * Beam moments pass method by Simon White.  
+ * Beam moments pass method by Simon White.
  *
+ * The moments of each bunch are accumulated with Welford's updates in
+ * thread-local partials, which are then merged with the pairwise formulas
+ * of Chan and Pébay. The partials of all the MPI ranks are combined by a
+ * single reduction with the same merge operator. MomentOrder selects the
+ * computed moments: 1 for the centroids only, 2 for the standard
+ * deviations (default), 3 and 4 for the skewness and excess kurtosis.
  */
 
 struct elem
 {
   int turn;
+  int order;
   double *stds;
   double *means;
+  double *skews;
+  double *kurts;
 };
 
+/* Partial statistics of a bunch: [n, mean[6], M2[6], M3[6], M4[6]],
+   truncated after the M<order> block */
+#define NSTAT(order) (1+6*(order))
+
+static void moments_add(double *stat, const double *r6, int order)
+/* Welford update with one particle */
+{
+    int ii;
+    double n1 = stat[0];
+    double n = n1 + 1.0;
+    double *mean = stat+1;
+    double *m2 = stat+7;
+    double *m3 = stat+13;
+    double *m4 = stat+19;
+    stat[0] = n;
+    for (ii=0; ii<6; ii++) {
+        double delta = r6[ii] - mean[ii];
+        double delta_n = delta/n;
+        double term1 = delta*delta_n*n1;
+        mean[ii] += delta_n;
+        if (order >= 4)
+            m4[ii] += term1*delta_n*delta_n*(n*n-3.0*n+3.0) +
+                      6.0*delta_n*delta_n*m2[ii] - 4.0*delta_n*m3[ii];
+        if (order >= 3)
+            m3[ii] += term1*delta_n*(n-2.0) - 3.0*delta_n*m2[ii];
+        if (order >= 2)
+            m2[ii] += term1;
+    }
+}
+
+static void moments_merge(double *a, const double *b, int order)
+/* Merge the partial statistics b into a */
+{
+    int ii;
+    double na = a[0];
+    double nb = b[0];
+    double n = na + nb;
+    if (nb == 0.0) return;
+    if (na == 0.0) {
+        memcpy(a, b, NSTAT(order)*sizeof(double));
+        return;
+    }
+    a[0] = n;
+    for (ii=0; ii<6; ii++) {
+        double delta = b[1+ii] - a[1+ii];
+        double delta_n = delta/n;
+        double m2a = a[7+ii], m2b = b[7+ii];
+        a[1+ii] += nb*delta_n;
+        if (order >= 2)
+            a[7+ii] = m2a + m2b + delta*delta_n*na*nb;
+        if (order >= 3) {
+            double m3a = a[13+ii], m3b = b[13+ii];
+            a[13+ii] = m3a + m3b + delta*delta_n*delta_n*na*nb*(na-nb) +
+                       3.0*delta_n*(na*m2b - nb*m2a);
+            if (order >= 4)
+                a[19+ii] += b[19+ii] +
+                    delta*delta_n*delta_n*delta_n*na*nb*(na*na-na*nb+nb*nb) +
+                    6.0*delta_n*delta_n*(na*na*m2b + nb*nb*m2a) +
+                    4.0*delta_n*(na*m3b - nb*m3a);
+        }
+    }
+}
+
+#ifdef MPI
+static void moments_reduce(void *in, void *inout, int *len, MPI_Datatype *dtype)
+/* MPI reduction operator: the datatype holds the statistics of one bunch */
+{
+    int size, ib, nstat, order;
+    MPI_Type_size(*dtype, &size);
+    nstat = size/sizeof(double);
+    order = (nstat-1)/6;
+    for (ib=0; ib<*len; ib++)
+        moments_merge((double *)inout+ib*nstat, (double *)in+ib*nstat, order);
+}
+#endif
 
 void BeamMomentsPass(double *r_in, int nbunch, int num_particles, struct elem *Elem) {
 
     int turn = Elem->turn;
-    double *stds = Elem->stds;
-    double *means = Elem->means;
-        
-    int i, ii, ib; 
-    void *buffer = atCalloc(2*nbunch*6+nbunch, sizeof(double));
-    double *dptr = (double *) buffer;
-    
-    double *meanp=dptr; dptr += nbunch*6;
-    double *stdp=dptr; dptr += nbunch*6;
-    double *nparts=dptr;
-    
-    for (i=0; i<num_particles; i++) {
-        double *r6 = r_in+i*6;
-        if(!atIsNaN(r6[0])){
-            ib = i%nbunch;
-            nparts[ib] += 1;
-            for(ii=0; ii<6; ii++) {
-                meanp[6*ib+ii] += r6[ii];
-                stdp[6*ib+ii] += r6[ii]*r6[ii];
+    int order = Elem->order;
+    int nstat = NSTAT(order);
+    int i, ii, ib;
+    double *stat = atCalloc(nstat*nbunch, sizeof(double));
+
+    #ifdef _OPENMP
+    #pragma omp parallel if (num_particles > OMP_PARTICLE_THRESHOLD) default(none) \
+    shared(r_in,nbunch,num_particles,order,nstat,stat) private(i,ib)
+    #endif /*_OPENMP*/
+    {
+        /* Thread-local partials, merged at the end */
+        double *lstat = calloc(nstat*nbunch, sizeof(double));
+        int i0;
+        /* Particle i belongs to bunch i%nbunch */
+        #ifdef _OPENMP
+        #pragma omp for
+        #endif /*_OPENMP*/
+        for (i0=0; i0<num_particles; i0+=nbunch) {
+            for (ib=0, i=i0; ib<nbunch && i<num_particles; ib++, i++) {
+                double *r6 = r_in+i*6;
+                if (!atIsNaN(r6[0]))
+                    moments_add(lstat+ib*nstat, r6, order);
             }
         }
-    }   
-    
-    #ifdef MPI     
-    MPI_Allreduce(MPI_IN_PLACE,stdp,6*nbunch,MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD);
-    MPI_Allreduce(MPI_IN_PLACE,meanp,6*nbunch,MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD);
-    MPI_Allreduce(MPI_IN_PLACE,nparts,nbunch,MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD);
-    MPI_Barrier(MPI_COMM_WORLD);
+        #ifdef _OPENMP
+        #pragma omp critical
+        #endif /*_OPENMP*/
+        {
+            for (ib=0; ib<nbunch; ib++)
+                moments_merge(stat+ib*nstat, lstat+ib*nstat, order);
+        }
+        free(lstat);
+    }
+
+    #ifdef MPI
+    {
+        /* All the partials in a single reduction */
+        MPI_Datatype stattype;
+        MPI_Op op;
+        MPI_Type_contiguous(nstat, MPI_DOUBLE, &stattype);
+        MPI_Type_commit(&stattype);
+        MPI_Op_create(moments_reduce, 1, &op);
+        MPI_Allreduce(MPI_IN_PLACE,stat,nbunch,stattype,op,MPI_COMM_WORLD);
+        MPI_Op_free(&op);
+        MPI_Type_free(&stattype);
+    }
     #endif
-    
-    for (i=0; i<nbunch; i++){       
-        for (ii=0; ii<6; ii++){
-            meanp[6*i+ii] = meanp[6*i+ii]/nparts[i];
-            stdp[6*i+ii] = sqrt(stdp[6*i+ii]/nparts[i]-meanp[6*i+ii]*meanp[6*i+ii]); 
+
+    for (ib=0; ib<nbunch; ib++) {
+        double *st = stat+ib*nstat;
+        double n = st[0];
+        int k = 6*nbunch*turn+6*ib;
+        for (ii=0; ii<6; ii++) {
+            double m2 = (order >= 2) ? st[7+ii] : 0.0;
+            Elem->means[k+ii] = (n > 0.0) ? st[1+ii] : NAN;
+            if (Elem->stds)
+                Elem->stds[k+ii] = (order >= 2) ? sqrt(m2/n) : 0.0;
+            if (Elem->skews)
+                Elem->skews[k+ii] = sqrt(n)*st[13+ii]/pow(m2, 1.5);
+            if (Elem->kurts)
+                Elem->kurts[k+ii] = n*st[19+ii]/(m2*m2) - 3.0;
         }
-    }    
-     
-    means += 6*nbunch*turn;
-    stds += 6*nbunch*turn;
-    memcpy(means, meanp, 6*nbunch*sizeof(double)); 
-    memcpy(stds, stdp, 6*nbunch*sizeof(double));
-    atFree(buffer);  
+    }
+    atFree(stat);
 }
 
 
@@ -73,13 +179,29 @@ ExportMode struct elem *trackFunction(const atElem *ElemData,struct elem *Elem,
                                       double *r_in, int num_particles, struct parameters *Param)
 {
     double *means;
-    double *stds;  
-    if (!Elem) {   
+    double *stds;
+    double *skews = NULL;
+    double *kurts = NULL;
+    int order;
+    if (!Elem) {
+        order=atGetOptionalLong(ElemData,"MomentOrder",2); check_error();
+        if (order < 1 || order > 4) {
+            atError("MomentOrder must be in 1..4"); check_error();
+        }
         means=atGetDoubleArray(ElemData,"_means"); check_error();
         stds=atGetDoubleArray(ElemData,"_stds"); check_error();
+        if (order >= 3) {
+            skews=atGetDoubleArray(ElemData,"_skews"); check_error();
+        }
+        if (order >= 4) {
+            kurts=atGetDoubleArray(ElemData,"_kurts"); check_error();
+        }
         Elem = (struct elem*)atMalloc(sizeof(struct elem));
+        Elem->order=order;
         Elem->stds=stds;
         Elem->means=means;
+        Elem->skews=skews;
+        Elem->kurts=kurts;
         Elem->turn = 0;
     }
     BeamMomentsPass(r_in, Param->nbunch, num_particles, Elem);
@@ -87,6 +209,7 @@ ExportMode struct elem *trackFunction(const atElem *ElemData,struct elem *Elem,
     return Elem;
 }
 
+COLLECTIVE_PASSMETHOD
 MODULE_DEF(BeamMomentsPass)        /* Dummy module initialisation */
 #endif
 
@@ -106,8 +229,11 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
         means=atGetDoubleArray(ElemData,"_means"); check_error();
         stds=atGetDoubleArray(ElemData,"_stds"); check_error();
         Elem = (struct elem*)atMalloc(sizeof(struct elem));
+        Elem->order=2;
         Elem->stds=stds;
         Elem->means=means;
+        Elem->skews=NULL;
+        Elem->kurts=NULL;
         Elem->turn = 0;
         if (mxGetM(prhs[1]) != 6) mexErrMsgIdAndTxt("AT:WrongArg","Second argument must be a 6 x N matrix: particle array");
         /* ALLOCATE memory for the output array of the same size as the input  */
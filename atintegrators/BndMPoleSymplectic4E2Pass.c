@@ -223,8 +223,7 @@ void BndMPoleSymplectic4E2Pass(double *r, double le, double irho, double *A, dou
             if(useT1) ATaddvv(r6,T1);
             if(useR1) ATmultmv(r6,R1);
             /* Check physical apertures at the entrance of the magnet */
-            if (RApertures) checkiflostRectangularAp(r6,RApertures);
-            if (EApertures) checkiflostEllipticalAp(r6,EApertures);
+            checkiflostAperture(r6,RApertures,EApertures);
             /* edge focus */
             if(useFringe1)
             {
@@ -256,8 +255,7 @@ void BndMPoleSymplectic4E2Pass(double *r, double le, double irho, double *A, dou
                 edge_fringe2B(r6, irho, exit_angle,0,0,h2,B[1]);
             }
             /* Check physical apertures at the exit of the magnet */
-            if (RApertures) checkiflostRectangularAp(r6,RApertures);
-            if (EApertures) checkiflostEllipticalAp(r6,EApertures);
+            checkiflostAperture(r6,RApertures,EApertures);
             /* Misalignment at exit */
             if(useR2) ATmultmv(r6,R2);
             if(useT2) ATaddvv(r6,T2);
@@ -1,6 +1,7 @@
 #include "atelem.c"
 #include "atlalib.c"
 #include "atphyslib.c"
+#include "driftkickrad.c"	/* radiation_constant, radiation_kick */
 
 struct elem 
 {
@@ -40,11 +41,6 @@ struct elem
 #define KICK1     1.351207191959657328
 #define KICK2    -1.702414383919314656
 
-#define SQR(X) ((X)*(X))
-
-#define TWOPI     6.28318530717959
-#define CGAMMA    8.846056192e-05
-
 void edge(double* r, double inv_rho, double edge_angle);
 void edge_fringe(double* r, double inv_rho, double edge_angle, double fint, double gap);
 void edge_fringe2A(double* r, double inv_rho, double edge_angle, double fint, double gap,double h1,double K1);
@@ -53,120 +49,7 @@ void ATmultmv(double *r, const double* A);
 void ATaddvv(double *r, const double *dr);
 void ATdrift6(double* r, double L);
 
-static double B2perp(double bx, double by, double irho, 
-                            double x, double xpr, double y, double ypr)
-/* Calculates sqr(|e x B|) , where e is a unit vector in the direction of velocity  */    
-{
-    double v_norm2;
-    v_norm2 = 1/(SQR(1+x*irho)+ SQR(xpr) + SQR(ypr));
-
-	/* components of the  velocity vector
-	   double ex, ey, ez;
-	    ex = xpr; 
-	    ey = ypr; 
-	    ez = (1+x*irho);
-	*/
-    return((SQR(by*(1+x*irho)) + SQR(bx*(1+x*irho)) + SQR(bx*ypr - by*xpr) )*v_norm2) ;
-}
- 
-
-
-static void bndthinkickrad0(double* r, double* A, double* B, double L, double irho, double E0, int max_order)
-
-/***************************************************************************** 
-Calculate multipole kick in a curved elemrnt (bending magnet)
-The reference coordinate system  has the curvature given by the inverse 
-(design) radius irho.
-IMPORTANT !!!
-The magnetic field Bo that provides this curvature MUST NOT be included in the dipole term
-PolynomB[1](MATLAB notation)(C: B[0] in this function) of the By field expansion
-HOWEVER!!! to calculate the effect of classical radiation the full field must be 
-used in the square of the |v x B|.
-When calling B2perp(Bx, By, ...), use the By = RESum + irho, where ImSum is the sum of
-the polynomial terms in PolynomB.
-
-The kick is given by
-
-           e L      L delta      L x
-theta  = - --- B  + -------  -  -----  , 
-     x     p    y     rho           2
-            0                    rho
-
-         e L
-theta  = --- B
-     y    p   x
-           0
-
-Note: in the US convention the transverse multipole field is written as:
-
-                         max_order+1
-                           ----
-                           \                       n-1
-	   (B + iB  )/ B rho  =  >   (ia  + b ) (x + iy)
-         y    x            /       n    n
-	                       ----
-                          n=1
-	is a polynomial in (x,y) with the highest order = MaxOrder
-	
-
-	Using different index notation 
-   
-                         max_order
-                           ----
-                           \                       n
-	   (B + iB  )/ B rho  =  >   (iA  + B ) (x + iy)
-         y    x            /       n    n
-	                       ----
-                          n=0
-
-	A,B: i=0 ... max_order
-   [0] - dipole, [1] - quadrupole, [2] - sextupole ...
-   units for A,B[i] = 1/[m]^(i+1)
-	Coeficients are stroed in the PolynomA, PolynomB field of the element
-	structure in MATLAB
-
-	A[i] (C++,C) =  PolynomA(i+1) (MATLAB) 
-	B[i] (C++,C) =  PolynomB(i+1) (MATLAB) 
-	i = 0 .. MaxOrder
-
-
-******************************************************************************/
-{
-    int i;
-    double ReSumTemp;
-    double ImSum = A[max_order];
-    double ReSum = B[max_order];
-    double x ,xpr, y, ypr, p_norm,dp_0, B2P;
-    
-    double CRAD = CGAMMA*E0*E0*E0/(TWOPI*1e27);	/* [m]/[GeV^3] M.Sands (4.1) */
-    
-    /* recursively calculate the local transvrese magnetic field
-     * Bx = ReSum, By = ImSum
-     */
-    for(i=max_order-1;i>=0;i--)
-    {	ReSumTemp = ReSum*r[0] - ImSum*r[2] + B[i];
-        ImSum = ImSum*r[0] +  ReSum*r[2] + A[i];
-        ReSum = ReSumTemp;
-    }
-    /* calculate angles from momentums 	*/
-    p_norm = 1/(1+r[4]);
-    x   = r[0];
-    xpr = r[1]*p_norm;
-    y   = r[2];
-    ypr = r[3]*p_norm;
-    B2P = B2perp(ImSum, ReSum +irho, irho, x , xpr, y ,ypr);
-    dp_0 = r[4];
-    r[4] = r[4] - CRAD*SQR(1+r[4])*B2P*(1 + x*irho + (SQR(xpr)+SQR(ypr))/2 )*L;
-    /* recalculate momentums from angles after losing energy for radiation 	*/
-    p_norm = 1/(1+r[4]);
-    r[1] = xpr/p_norm;
-    r[3] = ypr/p_norm;
-    r[1] -=  L*(ReSum-(dp_0-r[0]*irho)*irho);
-    r[3] +=  L*ImSum;
-    r[5] +=  L*irho*r[0]; /* pathlength */
-}
-
-static void bndthinkickrad(double* r, double* A, double* B, double L, double h, double E0,int max_order)
+static void bndthinkickrad(double* r, double* A, double* B, double L, double h, double crad,int max_order)
 /*****************************************************************************
 (1) PolynomA is neglected.
 (2) The vector potential is expanded up to 4th order of x and y. 
@@ -179,9 +62,8 @@ static void bndthinkickrad(double* r, double* A, double* B, double L, double h,
     
     double ReSumTemp;
     double K1,K2;
-    double x ,xpr, y, ypr, p_norm, B2P;
-    
-    double CRAD = CGAMMA*E0*E0*E0/(TWOPI*1e27);	/* [m]/[GeV^3] M.Sands (4.1) */
+    double x = r[0];
+    double y = r[2];
     
     K1 = B[1];
     K2 = (max_order>=2) ? B[2] : 0;
@@ -192,24 +74,12 @@ static void bndthinkickrad(double* r, double* A, double* B, double L, double h,
         ImSum = ImSum*r[0] +  ReSum*r[2] ;
         ReSum = ReSumTemp;
     }
-    /* calculate angles from momentums 	*/
-    p_norm = 1/(1+r[4]);
-    x   = r[0];
-    xpr = r[1]*p_norm;
-    y   = r[2];
-    ypr = r[3]*p_norm;
     /* see Iselin Part. Accel. 1985  */
     ImSum += h*(K1*h-K2)*y*y*y/6.0;
     ReSum += -K1*h*y*y/2.0 + h*(K1*h-K2)*x*y*y/2.0;
     
-    B2P = B2perp(ImSum, ReSum +h, h, x , xpr, y ,ypr);
-    
-    r[4] = r[4] - CRAD*SQR(1+r[4])*B2P*(1 + x*h + (SQR(xpr)+SQR(ypr))/2 )*L;
+    radiation_kick(r, ImSum, ReSum+h, h, L, crad);
     
-    /* recalculate momentums from angles after losing energy for radiation 	*/
-    p_norm = 1/(1+r[4]);
-    r[1] = xpr/p_norm;
-    r[3] = ypr/p_norm;
     r[1] -=  L*(-h*r[4] + ReSum + h*(h*r[0]+K1*(r[0]*r[0]-0.5*r[2]*r[2])+K2*(r[0]*r[0]*r[0]-4.0/3.0*r[0]*r[2]*r[2]))    );
     r[3] +=  L*(ImSum+h*(K1*r[0]*r[2]+4.0/3.0*K2*r[0]*r[0]*r[2]+(h/6.0*K1-K2/3.0)*r[2]*r[2]*r[2])) ;
     r[5] +=  L*h*r[0]; /* pathlength */
@@ -243,6 +113,7 @@ void BndMPoleSymplectic4E2RadPass(double *r, double le, double irho, double *A,
     int c,m;
     double *r6;
     double SL, L1, L2, K1, K2;
+    double crad = radiation_constant(E0);
     bool useT1, useT2, useR1, useR2, useFringe1, useFringe2;
     SL = le/num_int_steps;
     L1 = SL*DRIFT1;
@@ -288,8 +159,7 @@ void BndMPoleSymplectic4E2RadPass(double *r, double le, double irho, double *A,
             if (useR1)
                 ATmultmv(r6,R1);
             /* Check physical apertures at the entrance of the magnet */
-            if (RApertures) checkiflostRectangularAp(r6,RApertures);
-            if (EApertures) checkiflostEllipticalAp(r6,EApertures);
+            checkiflostAperture(r6,RApertures,EApertures);
             /* edge focus */
             if(useFringe1)
             {
@@ -307,13 +177,13 @@ void BndMPoleSymplectic4E2RadPass(double *r, double le, double irho, double *A,
                 r6 = r+c*6;
                 
                 ATbendhxdrift6(r6,L1,irho);
-                bndthinkickrad(r6, A, B, K1, irho, E0, max_order);
+                bndthinkickrad(r6, A, B, K1, irho, crad, max_order);
                 
                 ATbendhxdrift6(r6,L2,irho);
-                bndthinkickrad(r6, A, B, K2, irho, E0, max_order);
+                bndthinkickrad(r6, A, B, K2, irho, crad, max_order);
                 ATbendhxdrift6(r6,L2,irho);
                 
-                bndthinkickrad(r6, A, B,  K1, irho, E0, max_order);
+                bndthinkickrad(r6, A, B,  K1, irho, crad, max_order);
                 ATbendhxdrift6(r6,L1,irho);
             }
             /* edge focus */
@@ -328,8 +198,7 @@ void BndMPoleSymplectic4E2RadPass(double *r, double le, double irho, double *A,
                 edge_fringe2B(r6, irho, exit_angle,0,0,h2,B[1]);
             }
             /* Check physical apertures at the exit of the magnet */
-            if (RApertures) checkiflostRectangularAp(r6,RApertures);
-            if (EApertures) checkiflostEllipticalAp(r6,EApertures);
+            checkiflostAperture(r6,RApertures,EApertures);
             /* Misalignment at exit */
             if (useR2)
                 ATmultmv(r6,R2);
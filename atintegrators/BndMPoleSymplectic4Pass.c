@@ -3,12 +3,54 @@
 #include "atphyslib.c"
 #include "driftkick.c"		/* fastdrift and bndthinkick */
 #include "quadfringe.c"		/* QuadFringePassP, QuadFringePassN */
+#include "atdual.c"
 
 #define DRIFT1    0.6756035959798286638
 #define DRIFT2   -0.1756035959798286639
 #define KICK1     1.351207191959657328
 #define KICK2    -1.702414383919314656
 
+/* Slices of the integrator. When called with a constant max_order, the
+   kick kernel is specialised and its loop over the orders is unrolled.
+   pn is 1/(1+delta) taken at the entrance of the magnet, before the
+   misalignment, as in the original particle loop */
+AT_INLINE void BndMPoleSlices(double *r, int stride, int n, const double *A, const double *B,
+        double L1, double L2, double K1, double K2, double irho, const double *pn, int max_order, int num_int_steps)
+{
+    int m;
+    for (m=0; m < num_int_steps; m++) {  /*  Loop over slices */
+        fastdrift_soa_pn(r, stride, n, L1, pn);
+        bndthinkick_soa(r, stride, n, A, B, K1, irho, max_order);
+        fastdrift_soa_pn(r, stride, n, L2, pn);
+        bndthinkick_soa(r, stride, n, A, B, K2, irho, max_order);
+        fastdrift_soa_pn(r, stride, n, L2, pn);
+        bndthinkick_soa(r, stride, n, A, B, K1, irho, max_order);
+        fastdrift_soa_pn(r, stride, n, L1, pn);
+    }
+}
+
+AT_INLINE void BndMPoleIntegrator(double *r, int stride, int n, const double *A, const double *B,
+        double L1, double L2, double K1, double K2, double irho, const double *pn, int max_order, int num_int_steps)
+/* Specialised integrators for the orders up to octupoles */
+{
+    switch (max_order) {
+    case 0:
+        BndMPoleSlices(r, stride, n, A, B, L1, L2, K1, K2, irho, pn, 0, num_int_steps);
+        break;
+    case 1:
+        BndMPoleSlices(r, stride, n, A, B, L1, L2, K1, K2, irho, pn, 1, num_int_steps);
+        break;
+    case 2:
+        BndMPoleSlices(r, stride, n, A, B, L1, L2, K1, K2, irho, pn, 2, num_int_steps);
+        break;
+    case 3:
+        BndMPoleSlices(r, stride, n, A, B, L1, L2, K1, K2, irho, pn, 3, num_int_steps);
+        break;
+    default:
+        BndMPoleSlices(r, stride, n, A, B, L1, L2, K1, K2, irho, pn, max_order, num_int_steps);
+    }
+}
+
 
 #define SQR(X) ((X)*(X))
 
@@ -38,23 +80,27 @@ struct elem
     double *T2;
     double *RApertures;
     double *EApertures;
-    double *KickAngle;    
+    /* Derived constants */
+    double irho;
+    struct edge_fringe EntranceEdge;
+    struct edge_fringe ExitEdge;
 };
 
+AT_SIMD_DISPATCH
 void BndMPoleSymplectic4Pass(double *r, double le, double irho, double *A, double *B,
         int max_order, int num_int_steps,
-        double entrance_angle, 	double exit_angle,
-        int FringeBendEntrance, int FringeBendExit,
-        double fint1, double fint2, double gap,
+        const struct edge_fringe *entrance_edge, const struct edge_fringe *exit_edge,
         int FringeQuadEntrance, int FringeQuadExit,
         double *fringeIntM0,  /* I0m/K1, I1m/K1, I2m/K1, I3m/K1, Lambda2m/K1 */
         double *fringeIntP0,  /* I0p/K1, I1p/K1, I2p/K1, I3p/K1, Lambda2p/K1 */        
         double *T1, double *T2,
         double *R1, double *R2,
         double *RApertures, double *EApertures,
-        double *KickAngle, int num_particles)
-{	
-    int c;
+        int num_particles)
+/* The particles are processed in batches of AT_SIMD_WIDTH: the integrator
+   kernels are vectorized over the particles of a batch */
+{
+    int b;
     double SL = le/num_int_steps;
     double L1 = SL*DRIFT1;
     double L2 = SL*DRIFT2;
@@ -63,147 +109,321 @@ void BndMPoleSymplectic4Pass(double *r, double le, double irho, double *A, doubl
     bool useLinFrEleEntrance = (fringeIntM0 != NULL && fringeIntP0 != NULL  && FringeQuadEntrance==2);
     bool useLinFrEleExit = (fringeIntM0 != NULL && fringeIntP0 != NULL  && FringeQuadExit==2);
 
-    if (KickAngle) {   /* Convert corrector component to polynomial coefficients */
-        B[0] -= sin(KickAngle[0])/le; 
-        A[0] += sin(KickAngle[1])/le;
+    #pragma omp parallel for if (num_particles > OMP_PARTICLE_THRESHOLD) default(none) \
+    shared(r,num_particles,R1,T1,R2,T2,RApertures,EApertures,\
+    irho,A,B,L1,L2,K1,K2,max_order,num_int_steps,entrance_edge,exit_edge,\
+    FringeQuadEntrance,useLinFrEleEntrance,FringeQuadExit,useLinFrEleExit,fringeIntM0,fringeIntP0) \
+    private(b)
+    for (b = 0; b<num_particles; b+=AT_SIMD_WIDTH) {   /* Loop over batches of particles */
+        double *rb = r+b*6;
+        int nb = (num_particles-b < AT_SIMD_WIDTH) ? num_particles-b : AT_SIMD_WIDTH;
+        double rs[6*AT_SIMD_WIDTH];
+        double pn[AT_SIMD_WIDTH];   /* 1/(1+delta) before the misalignment */
+        int c;
+        for (c = 0; c<nb; c++) pn[c] = 1.0/(1.0+rb[c*6+4]);
+        for (c = 0; c<nb; c++) {
+            double *r6 = rb+c*6;
+            if (!atIsNaN(r6[0])) {
+                /*  misalignment at entrance  */
+                if (T1) ATaddvv(r6,T1);
+                if (R1) ATmultmv(r6,R1);
+                /* Check physical apertures at the entrance of the magnet */
+                checkiflostAperture(r6,RApertures,EApertures);
+                /* edge focus */
+                edge_fringe_apply(r6, entrance_edge, 0);
+                /* quadrupole gradient fringe entrance*/
+                if (FringeQuadEntrance && B[1]!=0) {
+                    if (useLinFrEleEntrance) /*Linear fringe fields from elegant*/
+                        linearQuadFringeElegantEntrance(r6, B[1], fringeIntM0, fringeIntP0);
+                    else
+                        QuadFringePassP(r6, B[1]);
+                }
+            }
+        }
+        /* integrator, vectorized over the batch */
+        aos_gather(rs, rb, nb);
+        BndMPoleIntegrator(rs, AT_SIMD_WIDTH, nb, A, B, L1, L2, K1, K2, irho, pn, max_order, num_int_steps);
+        aos_scatter(rb, rs, nb);
+        for (c = 0; c<nb; c++) {
+            double *r6 = rb+c*6;
+            if (!atIsNaN(r6[0])) {
+                /* quadrupole gradient fringe */
+                if (FringeQuadExit && B[1]!=0) {
+                    if (useLinFrEleExit) /*Linear fringe fields from elegant*/
+                        linearQuadFringeElegantExit(r6, B[1], fringeIntM0, fringeIntP0);
+                    else
+                        QuadFringePassN(r6, B[1]);
+                }
+                /* edge focus */
+                edge_fringe_apply(r6, exit_edge, 1);
+                /* Check physical apertures at the exit of the magnet */
+                checkiflostAperture(r6,RApertures,EApertures);
+                /* Misalignment at exit */
+                if (R2) ATmultmv(r6,R2);
+                if (T2) ATaddvv(r6,T2);
+            }
+        }
     }
+}
+
+
+AT_SIMD_DISPATCH
+void BndMPoleSymplectic4PassSoA(double *r, double le, double irho, double *A, double *B,
+        int max_order, int num_int_steps,
+        const struct edge_fringe *entrance_edge, const struct edge_fringe *exit_edge,
+        int FringeQuadEntrance, int FringeQuadExit,
+        double *fringeIntM0, double *fringeIntP0,
+        double *T1, double *T2,
+        double *R1, double *R2,
+        double *RApertures, double *EApertures,
+        int num_particles)
+/* Same as BndMPoleSymplectic4Pass, but r is a structure-of-arrays:
+   6 rows of num_particles coordinates. The integration is done on blocks
+   of SOA_BLOCK_SIZE particles with the vectorized kernels */
+{
+    int b;
+    double SL = le/num_int_steps;
+    double L1 = SL*DRIFT1;
+    double L2 = SL*DRIFT2;
+    double K1 = SL*KICK1;
+    double K2 = SL*KICK2;
+    bool useLinFrEleEntrance = (fringeIntM0 != NULL && fringeIntP0 != NULL  && FringeQuadEntrance==2);
+    bool useLinFrEleExit = (fringeIntM0 != NULL && fringeIntP0 != NULL  && FringeQuadExit==2);
+
+    #ifdef _OPENMP
     #pragma omp parallel for if (num_particles > OMP_PARTICLE_THRESHOLD) default(none) \
     shared(r,num_particles,R1,T1,R2,T2,RApertures,EApertures,\
-    irho,gap,A,B,L1,L2,K1,K2,max_order,num_int_steps,\
-    FringeBendEntrance,entrance_angle,fint1,FringeBendExit,exit_angle,fint2,\
+    irho,A,B,L1,L2,K1,K2,max_order,num_int_steps,entrance_edge,exit_edge,\
     FringeQuadEntrance,useLinFrEleEntrance,FringeQuadExit,useLinFrEleExit,fringeIntM0,fringeIntP0) \
-    private(c)
-    for(c = 0;c<num_particles;c++)	/* Loop over particles  */
-    {
-        double *r6 = r+c*6;
-        if (!atIsNaN(r6[0])) {
-            int m;
-            double p_norm = 1.0/(1.0+r6[4]);
-            double NormL1 = L1*p_norm;
-            double NormL2 = L2*p_norm;
-           /*  misalignment at entrance  */
-            if (T1) ATaddvv(r6,T1);
-            if (R1) ATmultmv(r6,R1);
+    private(b)
+    #endif /*_OPENMP*/
+    for (b = 0; b<num_particles; b+=SOA_BLOCK_SIZE) {   /* Loop over blocks of particles */
+        double *rb = r+b;
+        int nb = (num_particles-b < SOA_BLOCK_SIZE) ? num_particles-b : SOA_BLOCK_SIZE;
+        double pn[SOA_BLOCK_SIZE];  /* 1/(1+delta) before the misalignment */
+        int c;
+        pnorm_soa(pn, rb, num_particles, nb);
+        for (c = 0; c<nb; c++) {
+            double r6[6];
+            soa_load(r6, rb+c, num_particles);
+            if (!atIsNaN(r6[0])) {
+                /*  misalignment at entrance  */
+                if (T1) ATaddvv(r6,T1);
+                if (R1) ATmultmv(r6,R1);
+                /* Check physical apertures at the entrance of the magnet */
+                checkiflostAperture(r6,RApertures,EApertures);
+                /* edge focus */
+                edge_fringe_apply(r6, entrance_edge, 0);
+                /* quadrupole gradient fringe entrance*/
+                if (FringeQuadEntrance && B[1]!=0) {
+                    if (useLinFrEleEntrance) /*Linear fringe fields from elegant*/
+                        linearQuadFringeElegantEntrance(r6, B[1], fringeIntM0, fringeIntP0);
+                    else
+                        QuadFringePassP(r6, B[1]);
+                }
+                soa_store(rb+c, r6, num_particles);
+            }
+        }
+        /* integrator */
+        BndMPoleIntegrator(rb, num_particles, nb, A, B, L1, L2, K1, K2, irho, pn, max_order, num_int_steps);
+        for (c = 0; c<nb; c++) {
+            double r6[6];
+            soa_load(r6, rb+c, num_particles);
+            if (!atIsNaN(r6[0])) {
+                /* quadrupole gradient fringe */
+                if (FringeQuadExit && B[1]!=0) {
+                    if (useLinFrEleExit) /*Linear fringe fields from elegant*/
+                        linearQuadFringeElegantExit(r6, B[1], fringeIntM0, fringeIntP0);
+                    else
+                        QuadFringePassN(r6, B[1]);
+                }
+                /* edge focus */
+                edge_fringe_apply(r6, exit_edge, 1);
+                /* Check physical apertures at the exit of the magnet */
+                checkiflostAperture(r6,RApertures,EApertures);
+                /* Misalignment at exit */
+                if (R2) ATmultmv(r6,R2);
+                if (T2) ATaddvv(r6,T2);
+                soa_store(rb+c, r6, num_particles);
+            }
+        }
+    }
+}
+
+void BndMPoleSymplectic4PassTangent(atdual *r, double le, double irho, double *A, double *B,
+        int max_order, int num_int_steps,
+        double entrance_angle, 	double exit_angle,
+        int FringeBendEntrance, int FringeBendExit,
+        double fint1, double fint2, double gap,
+        double *T1, double *T2,
+        double *R1, double *R2,
+        double *RApertures, double *EApertures,
+        int num_particles)
+/* Same as BndMPoleSymplectic4Pass for tangent particles, without
+   quadrupole fringe fields */
+{
+    int c;
+    double SL = le/num_int_steps;
+    double L1 = SL*DRIFT1;
+    double L2 = SL*DRIFT2;
+    double K1 = SL*KICK1;
+    double K2 = SL*KICK2;
+
+    for (c = 0; c<num_particles; c++) {   /* Loop over particles */
+        atdual *r6 = r+c*6;
+        int m;
+        if (!atIsNaN(r6[0].v)) {
+            /*  misalignment at entrance  */
+            if (T1) dual_addvv(r6,T1);
+            if (R1) dual_multmv(r6,R1);
             /* Check physical apertures at the entrance of the magnet */
-            if (RApertures) checkiflostRectangularAp(r6,RApertures);
-            if (EApertures) checkiflostEllipticalAp(r6,EApertures);
+            dual_checkaperture(r6,RApertures,EApertures);
             /* edge focus */
-            edge_fringe_entrance(r6, irho, entrance_angle, fint1, gap, FringeBendEntrance);
-            /* quadrupole gradient fringe entrance*/
-            if (FringeQuadEntrance && B[1]!=0) {
-                if (useLinFrEleEntrance) /*Linear fringe fields from elegant*/
-                    linearQuadFringeElegantEntrance(r6, B[1], fringeIntM0, fringeIntP0);
-                else
-                    QuadFringePassP(r6, B[1]);
-            }    
+            dual_edge_fringe(r6, irho, entrance_angle, fint1, gap, FringeBendEntrance, 0);
             /* integrator */
-            for(m=0; m < num_int_steps; m++) /* Loop over slices*/
-            {
-                fastdrift(r6, NormL1);
-                bndthinkick(r6, A, B, K1, irho, max_order);
-                fastdrift(r6, NormL2);
-                bndthinkick(r6, A, B, K2, irho, max_order);
-                fastdrift(r6, NormL2);
-                bndthinkick(r6, A, B, K1, irho, max_order);
-                fastdrift(r6, NormL1);
-            }
-            /* quadrupole gradient fringe */
-            if (FringeQuadExit && B[1]!=0) {
-                if (useLinFrEleExit) /*Linear fringe fields from elegant*/
-                    linearQuadFringeElegantExit(r6, B[1], fringeIntM0, fringeIntP0);
-                else
-                    QuadFringePassN(r6, B[1]);
+            for (m=0; m < num_int_steps; m++) { /* Loop over slices*/
+                dual_drift6(r6, L1);
+                dual_bndthinkick(r6, A, B, K1, irho, max_order);
+                dual_drift6(r6, L2);
+                dual_bndthinkick(r6, A, B, K2, irho, max_order);
+                dual_drift6(r6, L2);
+                dual_bndthinkick(r6, A, B, K1, irho, max_order);
+                dual_drift6(r6, L1);
             }
             /* edge focus */
-            edge_fringe_exit(r6, irho, exit_angle, fint2, gap, FringeBendExit);
+            dual_edge_fringe(r6, irho, exit_angle, fint2, gap, FringeBendExit, 1);
             /* Check physical apertures at the exit of the magnet */
-            if (RApertures) checkiflostRectangularAp(r6,RApertures);
-            if (EApertures) checkiflostEllipticalAp(r6,EApertures);
+            dual_checkaperture(r6,RApertures,EApertures);
             /* Misalignment at exit */
-            if (R2) ATmultmv(r6,R2);
-            if (T2) ATaddvv(r6,T2);
+            if (R2) dual_multmv(r6,R2);
+            if (T2) dual_addvv(r6,T2);
         }
     }
-    if (KickAngle) {  /* Remove corrector component in polynomial coefficients */
-        B[0] += sin(KickAngle[0])/le;
-        A[0] -= sin(KickAngle[1])/le;
-    }
 }
 
-
 #if defined(MATLAB_MEX_FILE) || defined(PYAT)
+static struct elem *init_elem(const atElem *ElemData)
+{
+    struct elem *Elem;
+    double Length, BendingAngle, EntranceAngle, ExitAngle, FullGap,
+            FringeInt1, FringeInt2;
+    int MaxOrder, NumIntSteps,  FringeBendEntrance, FringeBendExit,
+            FringeQuadEntrance, FringeQuadExit;
+    double *PolynomA, *PolynomB, *R1, *R2, *T1, *T2, *EApertures, *RApertures, *fringeIntM0, *fringeIntP0, *KickAngle;
+    int msz, nsz, npoly;
+    Length=atGetDouble(ElemData,"Length"); check_error();
+    PolynomA=atGetDoubleArraySz(ElemData,"PolynomA",&msz,&nsz); check_error();
+    npoly=msz*nsz;
+    PolynomB=atGetDoubleArraySz(ElemData,"PolynomB",&msz,&nsz); check_error();
+    if (msz*nsz < npoly) npoly=msz*nsz;
+    MaxOrder=atGetLong(ElemData,"MaxOrder"); check_error();
+    NumIntSteps=atGetLong(ElemData,"NumIntSteps"); check_error();
+    BendingAngle=atGetDouble(ElemData,"BendingAngle"); check_error();
+    EntranceAngle=atGetDouble(ElemData,"EntranceAngle"); check_error();
+    ExitAngle=atGetDouble(ElemData,"ExitAngle"); check_error();
+    /*optional fields*/
+    FringeBendEntrance=atGetOptionalLong(ElemData,"FringeBendEntrance",1); check_error();
+    FringeBendExit=atGetOptionalLong(ElemData,"FringeBendExit",1); check_error();
+    FullGap=atGetOptionalDouble(ElemData,"FullGap",0); check_error();
+    FringeInt1=atGetOptionalDouble(ElemData,"FringeInt1",0); check_error();
+    FringeInt2=atGetOptionalDouble(ElemData,"FringeInt2",0); check_error();
+    FringeQuadEntrance=atGetOptionalLong(ElemData,"FringeQuadEntrance",0); check_error();
+    FringeQuadExit=atGetOptionalLong(ElemData,"FringeQuadExit",0); check_error();
+    fringeIntM0=atGetOptionalDoubleArray(ElemData,"fringeIntM0"); check_error();
+    fringeIntP0=atGetOptionalDoubleArray(ElemData,"fringeIntP0"); check_error();
+    R1=atGetOptionalDoubleArray(ElemData,"R1"); check_error();
+    R2=atGetOptionalDoubleArray(ElemData,"R2"); check_error();
+    T1=atGetOptionalDoubleArray(ElemData,"T1"); check_error();
+    T2=atGetOptionalDoubleArray(ElemData,"T2"); check_error();
+    EApertures=atGetOptionalDoubleArray(ElemData,"EApertures"); check_error();
+    RApertures=atGetOptionalDoubleArray(ElemData,"RApertures"); check_error();
+    KickAngle=atGetOptionalDoubleArray(ElemData,"KickAngle"); check_error();
+
+    if (KickAngle) {    /* Effective coefficients including the corrector kick */
+        Elem = (struct elem*)atMalloc(sizeof(struct elem)+2*npoly*sizeof(double));
+        atKickPolynom((double *)(Elem+1), (double *)(Elem+1)+npoly, PolynomA, PolynomB,
+                npoly, Length, KickAngle);
+        PolynomA = (double *)(Elem+1);
+        PolynomB = PolynomA+npoly;
+    }
+    else
+        Elem = (struct elem*)atMalloc(sizeof(struct elem));
+    Elem->Length=Length;
+    Elem->PolynomA=PolynomA;
+    Elem->PolynomB=PolynomB;
+    Elem->MaxOrder=MaxOrder;
+    Elem->NumIntSteps=NumIntSteps;
+    Elem->BendingAngle=BendingAngle;
+    Elem->EntranceAngle=EntranceAngle;
+    Elem->ExitAngle=ExitAngle;
+    /*optional fields*/
+    Elem->FringeBendEntrance=FringeBendEntrance;
+    Elem->FringeBendExit=FringeBendExit;
+    Elem->FullGap=FullGap;
+    Elem->FringeInt1=FringeInt1;
+    Elem->FringeInt2=FringeInt2;
+    Elem->FringeQuadEntrance=FringeQuadEntrance;
+    Elem->FringeQuadExit=FringeQuadExit;
+    Elem->fringeIntM0=fringeIntM0;
+    Elem->fringeIntP0=fringeIntP0;
+    Elem->R1=R1;
+    Elem->R2=R2;
+    Elem->T1=T1;
+    Elem->T2=T2;
+    Elem->EApertures=EApertures;
+    Elem->RApertures=RApertures;
+    /* Derived constants */
+    Elem->irho=BendingAngle/Length;
+    edge_fringe_prepare(&Elem->EntranceEdge, Elem->irho, EntranceAngle,
+            FringeInt1, FullGap, FringeBendEntrance);
+    edge_fringe_prepare(&Elem->ExitEdge, Elem->irho, ExitAngle,
+            FringeInt2, FullGap, FringeBendExit);
+    return Elem;
+}
+
 ExportMode struct elem *trackFunction(const atElem *ElemData,struct elem *Elem,
 			      double *r_in, int num_particles, struct parameters *Param)
 {
-    double irho;
-    if (!Elem) {
-        double Length, BendingAngle, EntranceAngle, ExitAngle, FullGap,
-                FringeInt1, FringeInt2;
-        int MaxOrder, NumIntSteps,  FringeBendEntrance, FringeBendExit,
-                FringeQuadEntrance, FringeQuadExit;
-        double *PolynomA, *PolynomB, *R1, *R2, *T1, *T2, *EApertures, *RApertures, *fringeIntM0, *fringeIntP0, *KickAngle;
-        Length=atGetDouble(ElemData,"Length"); check_error();
-        PolynomA=atGetDoubleArray(ElemData,"PolynomA"); check_error();
-        PolynomB=atGetDoubleArray(ElemData,"PolynomB"); check_error();
-        MaxOrder=atGetLong(ElemData,"MaxOrder"); check_error();
-        NumIntSteps=atGetLong(ElemData,"NumIntSteps"); check_error();
-        BendingAngle=atGetDouble(ElemData,"BendingAngle"); check_error();
-        EntranceAngle=atGetDouble(ElemData,"EntranceAngle"); check_error();
-        ExitAngle=atGetDouble(ElemData,"ExitAngle"); check_error();
-        /*optional fields*/
-        FringeBendEntrance=atGetOptionalLong(ElemData,"FringeBendEntrance",1); check_error();
-        FringeBendExit=atGetOptionalLong(ElemData,"FringeBendExit",1); check_error();
-        FullGap=atGetOptionalDouble(ElemData,"FullGap",0); check_error();
-        FringeInt1=atGetOptionalDouble(ElemData,"FringeInt1",0); check_error();
-        FringeInt2=atGetOptionalDouble(ElemData,"FringeInt2",0); check_error();
-        FringeQuadEntrance=atGetOptionalLong(ElemData,"FringeQuadEntrance",0); check_error();
-        FringeQuadExit=atGetOptionalLong(ElemData,"FringeQuadExit",0); check_error();
-        fringeIntM0=atGetOptionalDoubleArray(ElemData,"fringeIntM0"); check_error();
-        fringeIntP0=atGetOptionalDoubleArray(ElemData,"fringeIntP0"); check_error();
-        R1=atGetOptionalDoubleArray(ElemData,"R1"); check_error();
-        R2=atGetOptionalDoubleArray(ElemData,"R2"); check_error();
-        T1=atGetOptionalDoubleArray(ElemData,"T1"); check_error();
-        T2=atGetOptionalDoubleArray(ElemData,"T2"); check_error();
-        EApertures=atGetOptionalDoubleArray(ElemData,"EApertures"); check_error();
-        RApertures=atGetOptionalDoubleArray(ElemData,"RApertures"); check_error();
-        KickAngle=atGetOptionalDoubleArray(ElemData,"KickAngle"); check_error();
-        
-        Elem = (struct elem*)atMalloc(sizeof(struct elem));
-        Elem->Length=Length;
-        Elem->PolynomA=PolynomA;
-        Elem->PolynomB=PolynomB;
-        Elem->MaxOrder=MaxOrder;
-        Elem->NumIntSteps=NumIntSteps;
-        Elem->BendingAngle=BendingAngle;
-        Elem->EntranceAngle=EntranceAngle;
-        Elem->ExitAngle=ExitAngle;
-        /*optional fields*/
-        Elem->FringeBendEntrance=FringeBendEntrance;
-        Elem->FringeBendExit=FringeBendExit;
-        Elem->FullGap=FullGap;
-        Elem->FringeInt1=FringeInt1;
-        Elem->FringeInt2=FringeInt2;
-        Elem->FringeQuadEntrance=FringeQuadEntrance;
-        Elem->FringeQuadExit=FringeQuadExit;
-        Elem->fringeIntM0=fringeIntM0;
-        Elem->fringeIntP0=fringeIntP0;
-        Elem->R1=R1;
-        Elem->R2=R2;
-        Elem->T1=T1;
-        Elem->T2=T2;
-        Elem->EApertures=EApertures;
-        Elem->RApertures=RApertures;
-        Elem->KickAngle=KickAngle;
+    if (!Elem) Elem = init_elem(ElemData);
+    if (!Elem) return NULL;
+    BndMPoleSymplectic4Pass(r_in,Elem->Length,Elem->irho,Elem->PolynomA,Elem->PolynomB,
+            Elem->MaxOrder,Elem->NumIntSteps,&Elem->EntranceEdge,&Elem->ExitEdge,
+            Elem->FringeQuadEntrance,Elem->FringeQuadExit,
+            Elem->fringeIntM0,Elem->fringeIntP0,Elem->T1,Elem->T2,
+            Elem->R1,Elem->R2,Elem->RApertures,Elem->EApertures,
+            num_particles);
+    return Elem;
+}
+
+ExportMode struct elem *trackFunctionSoA(const atElem *ElemData,struct elem *Elem,
+			      double *r_in, int num_particles, struct parameters *Param)
+{
+    if (!Elem) Elem = init_elem(ElemData);
+    if (!Elem) return NULL;
+    BndMPoleSymplectic4PassSoA(r_in,Elem->Length,Elem->irho,Elem->PolynomA,Elem->PolynomB,
+            Elem->MaxOrder,Elem->NumIntSteps,&Elem->EntranceEdge,&Elem->ExitEdge,
+            Elem->FringeQuadEntrance,Elem->FringeQuadExit,
+            Elem->fringeIntM0,Elem->fringeIntP0,Elem->T1,Elem->T2,
+            Elem->R1,Elem->R2,Elem->RApertures,Elem->EApertures,
+            num_particles);
+    return Elem;
+}
+
+ExportMode struct elem *trackFunctionTangent(const atElem *ElemData,struct elem *Elem,
+			      double *r_in, int num_particles, struct parameters *Param)
+{
+    if (!Elem) Elem = init_elem(ElemData);
+    if (!Elem) return NULL;
+    if ((Elem->FringeQuadEntrance || Elem->FringeQuadExit) && Elem->PolynomB[1]!=0) {
+        atFree(Elem);   /* No tangent map for quadrupole fringe fields */
+        return NULL;
     }
-    irho = Elem->BendingAngle/Elem->Length;
-    BndMPoleSymplectic4Pass(r_in,Elem->Length,irho,Elem->PolynomA,Elem->PolynomB,
+    BndMPoleSymplectic4PassTangent((atdual *)r_in,Elem->Length,Elem->irho,Elem->PolynomA,Elem->PolynomB,
             Elem->MaxOrder,Elem->NumIntSteps,Elem->EntranceAngle,Elem->ExitAngle,
             Elem->FringeBendEntrance,Elem->FringeBendExit,
             Elem->FringeInt1,Elem->FringeInt2,Elem->FullGap,
-            Elem->FringeQuadEntrance,Elem->FringeQuadExit,
-            Elem->fringeIntM0,Elem->fringeIntP0,Elem->T1,Elem->T2,
-            Elem->R1,Elem->R2,Elem->RApertures,Elem->EApertures,
-            Elem->KickAngle,num_particles);
+            Elem->T1,Elem->T2,Elem->R1,Elem->R2,Elem->RApertures,Elem->EApertures,
+            num_particles);
     return Elem;
 }
 
@@ -220,13 +440,18 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
         int MaxOrder, NumIntSteps, FringeBendEntrance, FringeBendExit,
                 FringeQuadEntrance, FringeQuadExit;
         double *PolynomA, *PolynomB, *R1, *R2, *T1, *T2, *EApertures, *RApertures, *fringeIntM0, *fringeIntP0, *KickAngle;
+        double *PolynomAB = NULL;
+        int msz, nsz, npoly;
         double irho;
+        struct edge_fringe EntranceEdge, ExitEdge;
         double *r_in;
         const mxArray *ElemData = prhs[0];
         int num_particles = mxGetN(prhs[1]);
         Length=atGetDouble(ElemData,"Length"); check_error();
-        PolynomA=atGetDoubleArray(ElemData,"PolynomA"); check_error();
-        PolynomB=atGetDoubleArray(ElemData,"PolynomB"); check_error();
+        PolynomA=atGetDoubleArraySz(ElemData,"PolynomA",&msz,&nsz); check_error();
+        npoly=msz*nsz;
+        PolynomB=atGetDoubleArraySz(ElemData,"PolynomB",&msz,&nsz); check_error();
+        if (msz*nsz < npoly) npoly=msz*nsz;
         MaxOrder=atGetLong(ElemData,"MaxOrder"); check_error();
         NumIntSteps=atGetLong(ElemData,"NumIntSteps"); check_error();
         BendingAngle=atGetDouble(ElemData,"BendingAngle"); check_error();
@@ -250,15 +475,23 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
         RApertures=atGetOptionalDoubleArray(ElemData,"RApertures"); check_error();
         KickAngle=atGetOptionalDoubleArray(ElemData,"KickAngle"); check_error();        
         irho = BendingAngle/Length;
-        
+        edge_fringe_prepare(&EntranceEdge, irho, EntranceAngle, FringeInt1, FullGap, FringeBendEntrance);
+        edge_fringe_prepare(&ExitEdge, irho, ExitAngle, FringeInt2, FullGap, FringeBendExit);
+
+        if (KickAngle) {    /* Effective coefficients including the corrector kick */
+            PolynomAB = (double *)atMalloc(2*npoly*sizeof(double));
+            atKickPolynom(PolynomAB, PolynomAB+npoly, PolynomA, PolynomB, npoly, Length, KickAngle);
+            PolynomA = PolynomAB;
+            PolynomB = PolynomAB+npoly;
+        }
         /* ALLOCATE memory for the output array of the same size as the input  */
         plhs[0] = mxDuplicateArray(prhs[1]);
         r_in = mxGetDoubles(plhs[0]);
         BndMPoleSymplectic4Pass(r_in, Length, irho, PolynomA, PolynomB,
-                MaxOrder,NumIntSteps,EntranceAngle,ExitAngle,
-                FringeBendEntrance,FringeBendExit,FringeInt1,FringeInt2,
-                FullGap,FringeQuadEntrance,FringeQuadExit,fringeIntM0,fringeIntP0,
-                T1,T2,R1,R2,RApertures,EApertures,KickAngle,num_particles);
+                MaxOrder,NumIntSteps,&EntranceEdge,&ExitEdge,
+                FringeQuadEntrance,FringeQuadExit,fringeIntM0,fringeIntP0,
+                T1,T2,R1,R2,RApertures,EApertures,num_particles);
+        if (PolynomAB) atFree(PolynomAB);
     }
     else if (nrhs == 0) {
         /* list of required fields */
@@ -51,7 +51,7 @@ void BndMPoleSymplectic4QuantPass(double* r, double le, double irho, double* A,
     double* R1, double* R2,
     double* RApertures, double* EApertures,
     double E0,
-    pcg32_random_t* rng,
+    pcg32_random_t* rng_pool, int nrng,
     int num_particles)
 {
     double SL = le / num_int_steps;
@@ -69,22 +69,23 @@ void BndMPoleSymplectic4QuantPass(double* r, double le, double irho, double* A,
     double pi = 3.14159265358979;
     double alpha0 = qe * qe / (4 * pi * epsilon0 * hbar * clight);
 
+    atQuantInit();     /* photon energy table, built once */
     #pragma omp parallel for if (num_particles > OMP_PARTICLE_THRESHOLD) default(none)                      \
-    shared(r, num_particles, R1, T1, R2, T2, RApertures, EApertures,                                        \
+    shared(r, num_particles, rng_pool, nrng, R1, T1, R2, T2, RApertures, EApertures,                                        \
         irho, gap, A, B, L1, L2, K1, K2, max_order, num_int_steps,                                          \
         FringeBendEntrance, entrance_angle, fint1, FringeBendExit, exit_angle, fint2,                       \
         FringeQuadEntrance, useLinFrEleEntrance, FringeQuadExit, useLinFrEleExit, fringeIntM0, fringeIntP0, \
         emass, E0, hbar, clight, alpha0, qe, SL)
     for (int c = 0; c < num_particles; c++) { /* Loop over particles  */
         double* r6 = r + c * 6;
+        pcg32_random_t* rng = atrng_thread(rng_pool, nrng);
         if (!atIsNaN(r6[0])) {
             int m;
             /*  misalignment at entrance  */
             if (T1) ATaddvv(r6,T1);
             if (R1) ATmultmv(r6,R1);
             /* Check physical apertures at the entrance of the magnet */
-            if (RApertures) checkiflostRectangularAp(r6,RApertures);
-            if (EApertures) checkiflostEllipticalAp(r6,EApertures);
+            checkiflostAperture(r6,RApertures,EApertures);
             /* edge focus */
             edge_fringe_entrance(r6, irho, entrance_angle, fint1, gap, FringeBendEntrance);
             /* quadrupole gradient fringe */
@@ -96,10 +97,8 @@ void BndMPoleSymplectic4QuantPass(double* r, double le, double irho, double* A,
             }
             /* integrator */
             for (m = 0; m < num_int_steps; m++) { /* Loop over slices*/
-                int i;
                 double ng, ec, de, energy, gamma, cstec, cstng;
                 double ds, rho, dxp, dyp;
-                int nph;
                 double p_norm = 1 / (1 + r6[4]);
                 double NormL1 = L1 * p_norm;
                 double NormL2 = L2 * p_norm;
@@ -131,12 +130,7 @@ void BndMPoleSymplectic4QuantPass(double* r, double le, double irho, double* A,
                 ng = cstng / rho * (SL + ds);
                 ec = cstec / rho;
 
-                nph = atrandp_r(rng, ng);
-
-                de = 0.0;
-                for (i = 0; i < nph; i++) {
-                    de = de + getEnergy(rng, ec);
-                };
+                de = getEnergyLoss(rng, ng, ec);
                 r6[4] = r6[4] - de / E0;
                 r6[1] = r6[1] * p_norm * (1 + r6[4]);
                 r6[3] = r6[3] * p_norm * (1 + r6[4]);
@@ -152,8 +146,7 @@ void BndMPoleSymplectic4QuantPass(double* r, double le, double irho, double* A,
             edge_fringe_exit(r6, irho, exit_angle, fint2, gap, FringeBendExit);
 
             /* Check physical apertures at the exit of the magnet */
-            if (RApertures) checkiflostRectangularAp(r6,RApertures);
-            if (EApertures) checkiflostEllipticalAp(r6,EApertures);
+            checkiflostAperture(r6,RApertures,EApertures);
             /* Misalignment at exit */
             if(R2) ATmultmv(r6,R2);
             if(T2) ATaddvv(r6,T2);
@@ -172,10 +165,13 @@ ExportMode struct elem* trackFunction(const atElem* ElemData, struct elem* Elem,
         int MaxOrder, NumIntSteps, FringeBendEntrance, FringeBendExit,
             FringeQuadEntrance, FringeQuadExit;
         double *PolynomA, *PolynomB, *R1, *R2, *T1, *T2,
-                *EApertures, *RApertures, *fringeIntM0, *fringeIntP0;
+                *EApertures, *RApertures, *fringeIntM0, *fringeIntP0, *KickAngle;
+        int msz, nsz, npoly;
         Length=atGetDouble(ElemData,"Length"); check_error();
-        PolynomA=atGetDoubleArray(ElemData,"PolynomA"); check_error();
-        PolynomB=atGetDoubleArray(ElemData,"PolynomB"); check_error();
+        PolynomA=atGetDoubleArraySz(ElemData,"PolynomA",&msz,&nsz); check_error();
+        npoly=msz*nsz;
+        PolynomB=atGetDoubleArraySz(ElemData,"PolynomB",&msz,&nsz); check_error();
+        if (msz*nsz < npoly) npoly=msz*nsz;
         MaxOrder=atGetLong(ElemData,"MaxOrder"); check_error();
         NumIntSteps=atGetLong(ElemData,"NumIntSteps"); check_error();
         BendingAngle=atGetDouble(ElemData,"BendingAngle"); check_error();
@@ -198,7 +194,16 @@ ExportMode struct elem* trackFunction(const atElem* ElemData, struct elem* Elem,
         T2=atGetOptionalDoubleArray(ElemData,"T2"); check_error();
         EApertures=atGetOptionalDoubleArray(ElemData,"EApertures"); check_error();
         RApertures=atGetOptionalDoubleArray(ElemData,"RApertures"); check_error();
-        Elem = (struct elem*)atMalloc(sizeof(struct elem));
+        KickAngle=atGetOptionalDoubleArray(ElemData,"KickAngle"); check_error();
+        if (KickAngle) {    /* Effective coefficients including the corrector kick */
+            Elem = (struct elem*)atMalloc(sizeof(struct elem)+2*npoly*sizeof(double));
+            atKickPolynom((double *)(Elem+1), (double *)(Elem+1)+npoly, PolynomA, PolynomB,
+                    npoly, Length, KickAngle);
+            PolynomA = (double *)(Elem+1);
+            PolynomB = PolynomA+npoly;
+        }
+        else
+            Elem = (struct elem*)atMalloc(sizeof(struct elem));
         Elem->Length = Length;
         Elem->PolynomA = PolynomA;
         Elem->PolynomB = PolynomB;
@@ -233,7 +238,7 @@ ExportMode struct elem* trackFunction(const atElem* ElemData, struct elem* Elem,
         Elem->FringeQuadEntrance, Elem->FringeQuadExit,
         Elem->fringeIntM0, Elem->fringeIntP0, Elem->T1, Elem->T2,
         Elem->R1, Elem->R2, Elem->RApertures, Elem->EApertures, Elem->Energy,
-        Param->thread_rng,
+        Param->thread_rng, Param->nthread_rng,
         num_particles);
     return Elem;
 }
@@ -250,14 +255,18 @@ void mexFunction(int nlhs, mxArray* plhs[], int nrhs, const mxArray* prhs[])
             FringeInt1, FringeInt2, Energy;
         int MaxOrder, NumIntSteps, FringeBendEntrance, FringeBendExit,
             FringeQuadEntrance, FringeQuadExit;
-        double *PolynomA, *PolynomB, *R1, *R2, *T1, *T2, *EApertures, *RApertures, *fringeIntM0, *fringeIntP0;
+        double *PolynomA, *PolynomB, *R1, *R2, *T1, *T2, *EApertures, *RApertures, *fringeIntM0, *fringeIntP0, *KickAngle;
+        double *PolynomAB = NULL;
         double irho;
         double* r_in;
+        int msz, nsz, npoly;
         const mxArray* ElemData = prhs[0];
         int num_particles = mxGetN(prhs[1]);
         Length=atGetDouble(ElemData,"Length"); check_error();
-        PolynomA=atGetDoubleArray(ElemData,"PolynomA"); check_error();
-        PolynomB=atGetDoubleArray(ElemData,"PolynomB"); check_error();
+        PolynomA=atGetDoubleArraySz(ElemData,"PolynomA",&msz,&nsz); check_error();
+        npoly=msz*nsz;
+        PolynomB=atGetDoubleArraySz(ElemData,"PolynomB",&msz,&nsz); check_error();
+        if (msz*nsz < npoly) npoly=msz*nsz;
         MaxOrder=atGetLong(ElemData,"MaxOrder"); check_error();
         NumIntSteps=atGetLong(ElemData,"NumIntSteps"); check_error();
         BendingAngle=atGetDouble(ElemData,"BendingAngle"); check_error();
@@ -280,6 +289,13 @@ void mexFunction(int nlhs, mxArray* plhs[], int nrhs, const mxArray* prhs[])
         T2=atGetOptionalDoubleArray(ElemData,"T2"); check_error();
         EApertures=atGetOptionalDoubleArray(ElemData,"EApertures"); check_error();
         RApertures=atGetOptionalDoubleArray(ElemData,"RApertures"); check_error();
+        KickAngle=atGetOptionalDoubleArray(ElemData,"KickAngle"); check_error();
+        if (KickAngle) {    /* Effective coefficients including the corrector kick */
+            PolynomAB = (double *)atMalloc(2*npoly*sizeof(double));
+            atKickPolynom(PolynomAB, PolynomAB+npoly, PolynomA, PolynomB, npoly, Length, KickAngle);
+            PolynomA = PolynomAB;
+            PolynomB = PolynomAB+npoly;
+        }
         irho = BendingAngle/Length;
         /* ALLOCATE memory for the output array of the same size as the input  */
         plhs[0] = mxDuplicateArray(prhs[1]);
@@ -289,8 +305,9 @@ void mexFunction(int nlhs, mxArray* plhs[], int nrhs, const mxArray* prhs[])
             FringeBendEntrance, FringeBendExit, FringeInt1, FringeInt2,
             FullGap, FringeQuadEntrance, FringeQuadExit, fringeIntM0, fringeIntP0,
             T1, T2, R1, R2, RApertures, EApertures, Energy,
-            &pcg32_global,
+            &pcg32_global, 1,
             num_particles);
+        if (PolynomAB) atFree(PolynomAB);
     } else if (nrhs == 0) {
         /* list of required fields */
         plhs[0] = mxCreateCellMatrix(9, 1);
@@ -306,7 +323,7 @@ void mexFunction(int nlhs, mxArray* plhs[], int nrhs, const mxArray* prhs[])
 
         if (nlhs > 1) {
             /* list of optional fields */
-            plhs[1] = mxCreateCellMatrix(15, 1);
+            plhs[1] = mxCreateCellMatrix(16, 1);
             mxSetCell(plhs[1], 0, mxCreateString("FullGap"));
             mxSetCell(plhs[1], 1, mxCreateString("FringeInt1"));
             mxSetCell(plhs[1], 2, mxCreateString("FringeInt2"));
@@ -322,6 +339,7 @@ void mexFunction(int nlhs, mxArray* plhs[], int nrhs, const mxArray* prhs[])
             mxSetCell(plhs[1], 12, mxCreateString("R2"));
             mxSetCell(plhs[1], 13, mxCreateString("RApertures"));
             mxSetCell(plhs[1], 14, mxCreateString("EApertures"));
+            mxSetCell(plhs[1], 15, mxCreateString("KickAngle"));
         }
     } else {
         mexErrMsgIdAndTxt("AT:WrongArg", "Needs 0 or 2 arguments");
@@ -1,7 +1,7 @@
 #include "atelem.c"
 #include "atlalib.c"
 #include "atphyslib.c"
-#include "driftkickrad.c"	/* drift6.c, bndthinkickrad.c */
+#include "driftkickrad.c"	/* drift6.c, thinkickrad.c */
 #include "quadfringe.c"		/* QuadFringePassP, QuadFringePassN */
 
 #define DRIFT1    0.6756035959798286638
@@ -39,7 +39,6 @@ struct elem
     double *T2;
     double *RApertures;
     double *EApertures;
-    double *KickAngle;    
 };
 
 void BndMPoleSymplectic4RadPass(double *r, double le, double irho, double *A, double *B,
@@ -53,12 +52,13 @@ void BndMPoleSymplectic4RadPass(double *r, double le, double irho, double *A, do
         double *T1, double *T2,
         double *R1, double *R2,
         double *RApertures, double *EApertures,
-        double *KickAngle, double E0, int num_particles)
+        double E0, int num_particles)
         
 {	
     int c,m;
     double *r6;
     double SL, L1, L2, K1, K2;
+    double crad = radiation_constant(E0);
     bool useLinFrEleEntrance = (fringeIntM0 != NULL && fringeIntP0 != NULL  && FringeQuadEntrance==2);
     bool useLinFrEleExit = (fringeIntM0 != NULL && fringeIntP0 != NULL  && FringeQuadExit==2);
     SL = le/num_int_steps;
@@ -67,10 +67,6 @@ void BndMPoleSymplectic4RadPass(double *r, double le, double irho, double *A, do
     K1 = SL*KICK1;
     K2 = SL*KICK2;
     
-    if (KickAngle) {   /* Convert corrector component to polynomial coefficients */
-        B[0] -= sin(KickAngle[0])/le;
-        A[0] += sin(KickAngle[1])/le;
-    }
     #pragma omp parallel for if (num_particles > OMP_PARTICLE_THRESHOLD) default(shared) shared(r,num_particles) private(c,r6,m)
     for(c = 0;c<num_particles;c++)	/* Loop over particles */
     {
@@ -81,8 +77,7 @@ void BndMPoleSymplectic4RadPass(double *r, double le, double irho, double *A, do
             if (T1) ATaddvv(r6,T1);
             if (R1) ATmultmv(r6,R1);
             /* Check physical apertures at the entrance of the magnet */
-            if (RApertures) checkiflostRectangularAp(r6,RApertures);
-            if (EApertures) checkiflostEllipticalAp(r6,EApertures);
+            checkiflostAperture(r6,RApertures,EApertures);
             /* edge focus */
             edge_fringe_entrance(r6, irho, entrance_angle, fint1, gap, FringeBendEntrance);
             /* quadrupole gradient fringe */
@@ -96,11 +91,11 @@ void BndMPoleSymplectic4RadPass(double *r, double le, double irho, double *A, do
             for(m=0; m < num_int_steps; m++) /* Loop over slices */
             {
                 drift6(r6,L1);
-                bndthinkickrad(r6, A, B, K1, irho, E0, max_order);
+                thinkickrad(r6, A, B, K1, irho, crad, max_order);
                 drift6(r6,L2);
-                bndthinkickrad(r6, A, B, K2, irho, E0, max_order);
+                thinkickrad(r6, A, B, K2, irho, crad, max_order);
                 drift6(r6,L2);
-                bndthinkickrad(r6, A, B,  K1, irho, E0, max_order);
+                thinkickrad(r6, A, B, K1, irho, crad, max_order);
                 drift6(r6,L1);
             }
             /* quadrupole gradient fringe */
@@ -113,17 +108,12 @@ void BndMPoleSymplectic4RadPass(double *r, double le, double irho, double *A, do
             /* edge focus */
             edge_fringe_exit(r6, irho, exit_angle, fint2, gap, FringeBendExit);
             /* Check physical apertures at the exit of the magnet */
-            if (RApertures) checkiflostRectangularAp(r6,RApertures);
-            if (EApertures) checkiflostEllipticalAp(r6,EApertures);
+            checkiflostAperture(r6,RApertures,EApertures);
             /* Misalignment at exit */
             if (R2) ATmultmv(r6,R2);
             if (T2) ATaddvv(r6,T2);
         }
     }
-    if (KickAngle) {  /* Remove corrector component in polynomial coefficients */
-        B[0] += sin(KickAngle[0])/le;
-        A[0] -= sin(KickAngle[1])/le;
-    }
 }
 
 
@@ -139,9 +129,12 @@ ExportMode struct elem *trackFunction(const atElem *ElemData,struct elem *Elem,
         int MaxOrder, NumIntSteps,  FringeBendEntrance, FringeBendExit,
                 FringeQuadEntrance, FringeQuadExit;
         double *PolynomA, *PolynomB, *R1, *R2, *T1, *T2, *EApertures, *RApertures, *fringeIntM0, *fringeIntP0, *KickAngle;
+        int msz, nsz, npoly;
         Length=atGetDouble(ElemData,"Length"); check_error();
-        PolynomA=atGetDoubleArray(ElemData,"PolynomA"); check_error();
-        PolynomB=atGetDoubleArray(ElemData,"PolynomB"); check_error();
+        PolynomA=atGetDoubleArraySz(ElemData,"PolynomA",&msz,&nsz); check_error();
+        npoly=msz*nsz;
+        PolynomB=atGetDoubleArraySz(ElemData,"PolynomB",&msz,&nsz); check_error();
+        if (msz*nsz < npoly) npoly=msz*nsz;
         MaxOrder=atGetLong(ElemData,"MaxOrder"); check_error();
         NumIntSteps=atGetLong(ElemData,"NumIntSteps"); check_error();
         BendingAngle=atGetDouble(ElemData,"BendingAngle"); check_error();
@@ -166,7 +159,15 @@ ExportMode struct elem *trackFunction(const atElem *ElemData,struct elem *Elem,
         RApertures=atGetOptionalDoubleArray(ElemData,"RApertures"); check_error();
         KickAngle=atGetOptionalDoubleArray(ElemData,"KickAngle"); check_error();
 
-        Elem = (struct elem*)atMalloc(sizeof(struct elem));
+        if (KickAngle) {    /* Effective coefficients including the corrector kick */
+            Elem = (struct elem*)atMalloc(sizeof(struct elem)+2*npoly*sizeof(double));
+            atKickPolynom((double *)(Elem+1), (double *)(Elem+1)+npoly, PolynomA, PolynomB,
+                    npoly, Length, KickAngle);
+            PolynomA = (double *)(Elem+1);
+            PolynomB = PolynomA+npoly;
+        }
+        else
+            Elem = (struct elem*)atMalloc(sizeof(struct elem));
         Elem->Length=Length;
         Elem->PolynomA=PolynomA;
         Elem->PolynomB=PolynomB;
@@ -192,7 +193,6 @@ ExportMode struct elem *trackFunction(const atElem *ElemData,struct elem *Elem,
         Elem->T2=T2;
         Elem->EApertures=EApertures;
         Elem->RApertures=RApertures;
-        Elem->KickAngle=KickAngle;
     }
     irho = Elem->BendingAngle/Elem->Length;
     BndMPoleSymplectic4RadPass(r_in,Elem->Length,irho,Elem->PolynomA,Elem->PolynomB,
@@ -202,7 +202,7 @@ ExportMode struct elem *trackFunction(const atElem *ElemData,struct elem *Elem,
             Elem->FringeQuadEntrance,Elem->FringeQuadExit,
             Elem->fringeIntM0,Elem->fringeIntP0,Elem->T1,Elem->T2,
             Elem->R1,Elem->R2,Elem->RApertures,Elem->EApertures,
-            Elem->KickAngle,Elem->Energy,num_particles);
+            Elem->Energy,num_particles);
     return Elem;
 }
 
@@ -219,13 +219,17 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
         int MaxOrder, NumIntSteps, FringeBendEntrance, FringeBendExit,
                 FringeQuadEntrance, FringeQuadExit;
         double *PolynomA, *PolynomB, *R1, *R2, *T1, *T2, *EApertures, *RApertures, *fringeIntM0, *fringeIntP0, *KickAngle;
+        double *PolynomAB = NULL;
+        int msz, nsz, npoly;
         double irho;
         double *r_in;
         const mxArray *ElemData = prhs[0];
         int num_particles = mxGetN(prhs[1]);
         Length=atGetDouble(ElemData,"Length"); check_error();
-        PolynomA=atGetDoubleArray(ElemData,"PolynomA"); check_error();
-        PolynomB=atGetDoubleArray(ElemData,"PolynomB"); check_error();
+        PolynomA=atGetDoubleArraySz(ElemData,"PolynomA",&msz,&nsz); check_error();
+        npoly=msz*nsz;
+        PolynomB=atGetDoubleArraySz(ElemData,"PolynomB",&msz,&nsz); check_error();
+        if (msz*nsz < npoly) npoly=msz*nsz;
         MaxOrder=atGetLong(ElemData,"MaxOrder"); check_error();
         NumIntSteps=atGetLong(ElemData,"NumIntSteps"); check_error();
         BendingAngle=atGetDouble(ElemData,"BendingAngle"); check_error();
@@ -251,6 +255,12 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
         KickAngle=atGetOptionalDoubleArray(ElemData,"KickAngle"); check_error();        
         irho = BendingAngle/Length;
 
+        if (KickAngle) {    /* Effective coefficients including the corrector kick */
+            PolynomAB = (double *)atMalloc(2*npoly*sizeof(double));
+            atKickPolynom(PolynomAB, PolynomAB+npoly, PolynomA, PolynomB, npoly, Length, KickAngle);
+            PolynomA = PolynomAB;
+            PolynomB = PolynomAB+npoly;
+        }
         /* ALLOCATE memory for the output array of the same size as the input  */
         plhs[0] = mxDuplicateArray(prhs[1]);
         r_in = mxGetDoubles(plhs[0]);
@@ -258,8 +268,9 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
                 MaxOrder,NumIntSteps,EntranceAngle,ExitAngle,
                 FringeBendEntrance,FringeBendExit,FringeInt1,FringeInt2,
                 FullGap,FringeQuadEntrance,FringeQuadExit,fringeIntM0,
-                fringeIntP0,T1,T2,R1,R2,RApertures,EApertures,KickAngle,
+                fringeIntP0,T1,T2,R1,R2,RApertures,EApertures,
                 Energy,num_particles);
+        if (PolynomAB) atFree(PolynomAB);
     }
     else if (nrhs == 0) {
         /* list of required fields */
@@ -1,6 +1,9 @@
 
 #include "atelem.c"
 #include "atlalib.c"
+#include "driftkick.c"	/* soa_load, soa_store, drift6_soa */
+#include "driftkickfloat.c"	/* soaf_load, soaf_store, fastdrift_soaf */
+#include "atdual.c"
 
 struct elem 
 {
@@ -34,12 +37,10 @@ void DriftPass(double *r_in, double le,
       if (T1) ATaddvv(r6, T1);
       if (R1) ATmultmv(r6, R1);
       /* Check physical apertures at the entrance of the magnet */
-      if (RApertures) checkiflostRectangularAp(r6,RApertures);
-      if (EApertures) checkiflostEllipticalAp(r6,EApertures);
+      checkiflostAperture(r6,RApertures,EApertures);
       ATdrift6(r6, le);
       /* Check physical apertures at the exit of the magnet */
-      if (RApertures) checkiflostRectangularAp(r6,RApertures);
-      if (EApertures) checkiflostEllipticalAp(r6,EApertures);
+      checkiflostAperture(r6,RApertures,EApertures);
       /* Misalignment at exit */
       if (R2) ATmultmv(r6, R2);
       if (T2) ATaddvv(r6, T2);
@@ -47,40 +48,167 @@ void DriftPass(double *r_in, double le,
   }
 }
 
+void DriftPassSoA(double *r_in, double le,
+	       const double *T1, const double *T2,
+	       const double *R1, const double *R2,
+	       double *RApertures, double *EApertures,
+	       int num_particles)
+/* le - physical length
+   r_in - structure-of-arrays: 6 rows of num_particles coordinates
+*/
+{
+  int b;
+  bool transform = T1 || R1 || T2 || R2 || RApertures || EApertures;
+
+  #ifdef _OPENMP
+  #pragma omp parallel for if (num_particles > OMP_PARTICLE_THRESHOLD*10) default(shared) shared(r_in,num_particles) private(b)
+  #endif /*_OPENMP*/
+  for (b = 0; b<num_particles; b+=SOA_BLOCK_SIZE) { /* Loop over blocks of particles */
+    double *rb = r_in+b;
+    int nb = (num_particles-b < SOA_BLOCK_SIZE) ? num_particles-b : SOA_BLOCK_SIZE;
+    if (transform) {
+      int c;
+      for (c = 0; c<nb; c++) {
+        double r6[6];
+        soa_load(r6, rb+c, num_particles);
+        if(!atIsNaN(r6[0])) {
+          if (T1) ATaddvv(r6, T1);
+          if (R1) ATmultmv(r6, R1);
+          checkiflostAperture(r6,RApertures,EApertures);
+          ATdrift6(r6, le);
+          checkiflostAperture(r6,RApertures,EApertures);
+          if (R2) ATmultmv(r6, R2);
+          if (T2) ATaddvv(r6, T2);
+          soa_store(rb+c, r6, num_particles);
+        }
+      }
+    }
+    else {
+      drift6_soa(rb, num_particles, nb, le);
+    }
+  }
+}
+
+void DriftPassFloat(float *r_in, double le,
+	       const double *T1, const double *T2,
+	       const double *R1, const double *R2,
+	       double *RApertures, double *EApertures,
+	       int num_particles)
+/* Same as DriftPassSoA on the single-precision particle array */
+{
+  int b;
+  bool transform = T1 || R1 || T2 || R2 || RApertures || EApertures;
+
+  #ifdef _OPENMP
+  #pragma omp parallel for if (num_particles > OMP_PARTICLE_THRESHOLD*10) default(shared) shared(r_in,num_particles) private(b)
+  #endif /*_OPENMP*/
+  for (b = 0; b<num_particles; b+=SOA_BLOCK_SIZE) { /* Loop over blocks of particles */
+    float *rb = r_in+b;
+    int nb = (num_particles-b < SOA_BLOCK_SIZE) ? num_particles-b : SOA_BLOCK_SIZE;
+    if (transform) {
+      int c;
+      for (c = 0; c<nb; c++) {
+        double r6[6];
+        soaf_load(r6, rb+c, num_particles);
+        if(!atIsNaN(r6[0])) {
+          if (T1) ATaddvv(r6, T1);
+          if (R1) ATmultmv(r6, R1);
+          checkiflostAperture(r6,RApertures,EApertures);
+          ATdrift6(r6, le);
+          checkiflostAperture(r6,RApertures,EApertures);
+          if (R2) ATmultmv(r6, R2);
+          if (T2) ATaddvv(r6, T2);
+          soaf_store(rb+c, r6, num_particles);
+        }
+      }
+    }
+    else {
+      float pn[SOA_BLOCK_SIZE];
+      pnorm_soaf(pn, rb, num_particles, nb);
+      fastdrift_soaf(rb, num_particles, nb, (float)le, pn);
+    }
+  }
+}
+
+void DriftPassTangent(atdual *r_in, double le,
+	       const double *T1, const double *T2,
+	       const double *R1, const double *R2,
+	       double *RApertures, double *EApertures,
+	       int num_particles)
+/* Same as DriftPass for tangent particles */
+{
+  int c;
+  for (c = 0; c<num_particles; c++) {
+    atdual *r6 = r_in+c*6;
+    if(!atIsNaN(r6[0].v)) {
+      if (T1) dual_addvv(r6, T1);
+      if (R1) dual_multmv(r6, R1);
+      dual_checkaperture(r6, RApertures, EApertures);
+      dual_drift6(r6, le);
+      dual_checkaperture(r6, RApertures, EApertures);
+      if (R2) dual_multmv(r6, R2);
+      if (T2) dual_addvv(r6, T2);
+    }
+  }
+}
+
 #if defined(MATLAB_MEX_FILE) || defined(PYAT)
+static struct elem *init_elem(const atElem *ElemData)
+{
+    struct elem *Elem;
+    double Length;
+    double *R1, *R2, *T1, *T2, *EApertures, *RApertures;
+    Length=atGetDouble(ElemData,"Length"); check_error();
+    R1=atGetOptionalDoubleArray(ElemData,"R1"); check_error();
+    R2=atGetOptionalDoubleArray(ElemData,"R2"); check_error();
+    T1=atGetOptionalDoubleArray(ElemData,"T1"); check_error();
+    T2=atGetOptionalDoubleArray(ElemData,"T2"); check_error();
+    EApertures=atGetOptionalDoubleArray(ElemData,"EApertures"); check_error();
+    RApertures=atGetOptionalDoubleArray(ElemData,"RApertures"); check_error();
+    Elem = (struct elem*)atMalloc(sizeof(struct elem));
+    Elem->Length=Length;
+    Elem->R1=R1;
+    Elem->R2=R2;
+    Elem->T1=T1;
+    Elem->T2=T2;
+    Elem->EApertures=EApertures;
+    Elem->RApertures=RApertures;
+    return Elem;
+}
+
 ExportMode struct elem *trackFunction(const atElem *ElemData,struct elem *Elem,
                 double *r_in, int num_particles, struct parameters *Param)
 {
-/*  if (ElemData) {*/
-        if (!Elem) {
-            double Length;
-            double *R1, *R2, *T1, *T2, *EApertures, *RApertures;
-            Length=atGetDouble(ElemData,"Length"); check_error();
-            R1=atGetOptionalDoubleArray(ElemData,"R1"); check_error();
-            R2=atGetOptionalDoubleArray(ElemData,"R2"); check_error();
-            T1=atGetOptionalDoubleArray(ElemData,"T1"); check_error();
-            T2=atGetOptionalDoubleArray(ElemData,"T2"); check_error();
-            EApertures=atGetOptionalDoubleArray(ElemData,"EApertures"); check_error();
-            RApertures=atGetOptionalDoubleArray(ElemData,"RApertures"); check_error();
-            Elem = (struct elem*)atMalloc(sizeof(struct elem));
-            Elem->Length=Length;
-            Elem->R1=R1;
-            Elem->R2=R2;
-            Elem->T1=T1;
-            Elem->T2=T2;
-            Elem->EApertures=EApertures;
-            Elem->RApertures=RApertures;
-        }
-        DriftPass(r_in, Elem->Length, Elem->T1, Elem->T2, Elem->R1, Elem->R2, Elem->RApertures, Elem->EApertures, num_particles);
-/*  }
-    else {
-         atFree(Elem->T1);
-         atFree(Elem->T2);
-         atFree(Elem->R1);
-         atFree(Elem->R2);
-         atFree(Elem->EApertures);
-         atFree(Elem->RApertures);
-     }*/
+    if (!Elem) Elem = init_elem(ElemData);
+    if (!Elem) return NULL;
+    DriftPass(r_in, Elem->Length, Elem->T1, Elem->T2, Elem->R1, Elem->R2, Elem->RApertures, Elem->EApertures, num_particles);
+    return Elem;
+}
+
+ExportMode struct elem *trackFunctionSoA(const atElem *ElemData,struct elem *Elem,
+                double *r_in, int num_particles, struct parameters *Param)
+{
+    if (!Elem) Elem = init_elem(ElemData);
+    if (!Elem) return NULL;
+    DriftPassSoA(r_in, Elem->Length, Elem->T1, Elem->T2, Elem->R1, Elem->R2, Elem->RApertures, Elem->EApertures, num_particles);
+    return Elem;
+}
+
+ExportMode struct elem *trackFunctionFloat(const atElem *ElemData,struct elem *Elem,
+                float *r_in, int num_particles, struct parameters *Param)
+{
+    if (!Elem) Elem = init_elem(ElemData);
+    if (!Elem) return NULL;
+    DriftPassFloat(r_in, Elem->Length, Elem->T1, Elem->T2, Elem->R1, Elem->R2, Elem->RApertures, Elem->EApertures, num_particles);
+    return Elem;
+}
+
+ExportMode struct elem *trackFunctionTangent(const atElem *ElemData,struct elem *Elem,
+                double *r_in, int num_particles, struct parameters *Param)
+{
+    if (!Elem) Elem = init_elem(ElemData);
+    if (!Elem) return NULL;
+    DriftPassTangent((atdual *)r_in, Elem->Length, Elem->T1, Elem->T2, Elem->R1, Elem->R2, Elem->RApertures, Elem->EApertures, num_particles);
     return Elem;
 }
 
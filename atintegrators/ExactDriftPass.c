@@ -0,0 +1,198 @@
+
+#include "atelem.c"
+#include "atlalib.c"
+#include "driftkick.c"	/* soa_load, soa_store, aos_gather, aos_scatter */
+#include "exactdriftkick.c"	/* exactdrift, exactdrift_soa */
+
+struct elem 
+{
+  double Length;
+  double *R1;
+  double *R2;
+  double *T1;
+  double *T2;
+  double *EApertures;
+  double *RApertures;
+};
+
+AT_SIMD_DISPATCH
+void ExactDriftPass(double *r_in, double le,
+	       const double *T1, const double *T2,
+	       const double *R1, const double *R2,
+	       double *RApertures, double *EApertures,
+	       int num_particles)
+/* le - physical length
+   r_in - 6-by-N matrix of initial conditions reshaped into 
+   1-d array of 6*N elements 
+   The drift is computed with the exact Hamiltonian, without the
+   paraxial approximation of DriftPass. Without misalignments and
+   apertures, it is vectorized over batches of AT_SIMD_WIDTH particles
+*/
+{
+  int b;
+  bool transform = T1 || R1 || T2 || R2 || RApertures || EApertures;
+
+  #ifdef _OPENMP
+  #pragma omp parallel for if (num_particles > OMP_PARTICLE_THRESHOLD*10) default(shared) shared(r_in,num_particles) private(b)
+  #endif /*_OPENMP*/
+  for (b = 0; b<num_particles; b+=AT_SIMD_WIDTH) { /* Loop over batches of particles */
+    double *rb = r_in+b*6;
+    int nb = (num_particles-b < AT_SIMD_WIDTH) ? num_particles-b : AT_SIMD_WIDTH;
+    if (transform) {
+      int c;
+      for (c = 0; c<nb; c++) {
+        double *r6 = rb+c*6;
+        if(!atIsNaN(r6[0])) {
+          /*  misalignment at entrance  */
+          if (T1) ATaddvv(r6, T1);
+          if (R1) ATmultmv(r6, R1);
+          /* Check physical apertures at the entrance of the magnet */
+          checkiflostAperture(r6,RApertures,EApertures);
+          exactdrift(r6, le);
+          /* Check physical apertures at the exit of the magnet */
+          checkiflostAperture(r6,RApertures,EApertures);
+          /* Misalignment at exit */
+          if (R2) ATmultmv(r6, R2);
+          if (T2) ATaddvv(r6, T2);
+        }
+      }
+    }
+    else {
+      double rs[6*AT_SIMD_WIDTH];
+      aos_gather(rs, rb, nb);
+      exactdrift_soa(rs, AT_SIMD_WIDTH, nb, le);
+      aos_scatter(rb, rs, nb);
+    }
+  }
+}
+
+AT_SIMD_DISPATCH
+void ExactDriftPassSoA(double *r_in, double le,
+	       const double *T1, const double *T2,
+	       const double *R1, const double *R2,
+	       double *RApertures, double *EApertures,
+	       int num_particles)
+/* le - physical length
+   r_in - structure-of-arrays: 6 rows of num_particles coordinates
+*/
+{
+  int b;
+  bool transform = T1 || R1 || T2 || R2 || RApertures || EApertures;
+
+  #ifdef _OPENMP
+  #pragma omp parallel for if (num_particles > OMP_PARTICLE_THRESHOLD*10) default(shared) shared(r_in,num_particles) private(b)
+  #endif /*_OPENMP*/
+  for (b = 0; b<num_particles; b+=SOA_BLOCK_SIZE) { /* Loop over blocks of particles */
+    double *rb = r_in+b;
+    int nb = (num_particles-b < SOA_BLOCK_SIZE) ? num_particles-b : SOA_BLOCK_SIZE;
+    if (transform) {
+      int c;
+      for (c = 0; c<nb; c++) {
+        double r6[6];
+        soa_load(r6, rb+c, num_particles);
+        if(!atIsNaN(r6[0])) {
+          if (T1) ATaddvv(r6, T1);
+          if (R1) ATmultmv(r6, R1);
+          checkiflostAperture(r6,RApertures,EApertures);
+          exactdrift(r6, le);
+          checkiflostAperture(r6,RApertures,EApertures);
+          if (R2) ATmultmv(r6, R2);
+          if (T2) ATaddvv(r6, T2);
+          soa_store(rb+c, r6, num_particles);
+        }
+      }
+    }
+    else {
+      exactdrift_soa(rb, num_particles, nb, le);
+    }
+  }
+}
+
+#if defined(MATLAB_MEX_FILE) || defined(PYAT)
+static struct elem *init_elem(const atElem *ElemData)
+{
+    struct elem *Elem;
+    double Length;
+    double *R1, *R2, *T1, *T2, *EApertures, *RApertures;
+    Length=atGetDouble(ElemData,"Length"); check_error();
+    R1=atGetOptionalDoubleArray(ElemData,"R1"); check_error();
+    R2=atGetOptionalDoubleArray(ElemData,"R2"); check_error();
+    T1=atGetOptionalDoubleArray(ElemData,"T1"); check_error();
+    T2=atGetOptionalDoubleArray(ElemData,"T2"); check_error();
+    EApertures=atGetOptionalDoubleArray(ElemData,"EApertures"); check_error();
+    RApertures=atGetOptionalDoubleArray(ElemData,"RApertures"); check_error();
+    Elem = (struct elem*)atMalloc(sizeof(struct elem));
+    Elem->Length=Length;
+    Elem->R1=R1;
+    Elem->R2=R2;
+    Elem->T1=T1;
+    Elem->T2=T2;
+    Elem->EApertures=EApertures;
+    Elem->RApertures=RApertures;
+    return Elem;
+}
+
+ExportMode struct elem *trackFunction(const atElem *ElemData,struct elem *Elem,
+                double *r_in, int num_particles, struct parameters *Param)
+{
+    if (!Elem) Elem = init_elem(ElemData);
+    if (!Elem) return NULL;
+    ExactDriftPass(r_in, Elem->Length, Elem->T1, Elem->T2, Elem->R1, Elem->R2, Elem->RApertures, Elem->EApertures, num_particles);
+    return Elem;
+}
+
+ExportMode struct elem *trackFunctionSoA(const atElem *ElemData,struct elem *Elem,
+                double *r_in, int num_particles, struct parameters *Param)
+{
+    if (!Elem) Elem = init_elem(ElemData);
+    if (!Elem) return NULL;
+    ExactDriftPassSoA(r_in, Elem->Length, Elem->T1, Elem->T2, Elem->R1, Elem->R2, Elem->RApertures, Elem->EApertures, num_particles);
+    return Elem;
+}
+
+MODULE_DEF(ExactDriftPass)        /* Dummy module initialisation */
+
+#endif /*defined(MATLAB_MEX_FILE) || defined(PYAT)*/
+
+#if defined(MATLAB_MEX_FILE)
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    if (nrhs == 2) {
+        double *r_in;
+        const mxArray *ElemData = prhs[0];
+        int num_particles = mxGetN(prhs[1]);
+        double Length;
+        double *R1, *R2, *T1, *T2, *EApertures, *RApertures;
+        Length=atGetDouble(ElemData,"Length"); check_error();
+        R1=atGetOptionalDoubleArray(ElemData,"R1"); check_error();
+        R2=atGetOptionalDoubleArray(ElemData,"R2"); check_error();
+        T1=atGetOptionalDoubleArray(ElemData,"T1"); check_error();
+        T2=atGetOptionalDoubleArray(ElemData,"T2"); check_error();
+        EApertures=atGetOptionalDoubleArray(ElemData,"EApertures"); check_error();
+        RApertures=atGetOptionalDoubleArray(ElemData,"RApertures"); check_error();
+        if (mxGetM(prhs[1]) != 6) mexErrMsgIdAndTxt("AT:WrongArg","Second argument must be a 6 x N matrix");
+        /* ALLOCATE memory for the output array of the same size as the input  */
+        plhs[0] = mxDuplicateArray(prhs[1]);
+        r_in = mxGetDoubles(plhs[0]);
+        ExactDriftPass(r_in, Length, T1, T2, R1, R2, RApertures, EApertures, num_particles);
+    }
+    else if (nrhs == 0) {
+        /* list of required fields */
+        plhs[0] = mxCreateCellMatrix(1,1);
+        mxSetCell(plhs[0],0,mxCreateString("Length"));
+        if (nlhs>1) {
+            /* list of optional fields */
+            plhs[1] = mxCreateCellMatrix(6,1);
+            mxSetCell(plhs[1],0,mxCreateString("T1"));
+            mxSetCell(plhs[1],1,mxCreateString("T2"));
+            mxSetCell(plhs[1],2,mxCreateString("R1"));
+            mxSetCell(plhs[1],3,mxCreateString("R2"));
+            mxSetCell(plhs[1],4,mxCreateString("RApertures"));
+            mxSetCell(plhs[1],5,mxCreateString("EApertures"));
+        }
+    }
+    else {
+        mexErrMsgIdAndTxt("AT:WrongArg","Needs 0 or 2 arguments");
+    }
+}
+#endif /*defined(MATLAB_MEX_FILE)*/
@@ -0,0 +1,393 @@
+#include "atelem.c"
+#include "atlalib.c"
+#include "driftkick.c"		/* strthinkick_soa */
+#include "quadfringe.c"		/* QuadFringePassP, QuadFringePassN */
+#include "exactdriftkick.c"	/* exactdrift_soa */
+
+#define DRIFT1    0.6756035959798286638
+#define DRIFT2   -0.1756035959798286639
+#define KICK1     1.351207191959657328
+#define KICK2    -1.702414383919314656
+
+/* Slices of the integrator, with exact drifts. When called with a constant
+   max_order, the kick kernel is specialised and its loop over the orders
+   is unrolled */
+AT_INLINE void ExactMPoleSlices(double *r, int stride, int n, const double *A, const double *B,
+        double L1, double L2, double K1, double K2, int max_order, int num_int_steps)
+{
+    int m;
+    for (m=0; m < num_int_steps; m++) {  /*  Loop over slices */
+        exactdrift_soa(r, stride, n, L1);
+        strthinkick_soa(r, stride, n, A, B, K1, max_order);
+        exactdrift_soa(r, stride, n, L2);
+        strthinkick_soa(r, stride, n, A, B, K2, max_order);
+        exactdrift_soa(r, stride, n, L2);
+        strthinkick_soa(r, stride, n, A, B, K1, max_order);
+        exactdrift_soa(r, stride, n, L1);
+    }
+}
+
+AT_INLINE void ExactMPoleIntegrator(double *r, int stride, int n, const double *A, const double *B,
+        double L1, double L2, double K1, double K2, int max_order, int num_int_steps)
+/* Specialised integrators for the orders up to octupoles */
+{
+    switch (max_order) {
+    case 0:
+        ExactMPoleSlices(r, stride, n, A, B, L1, L2, K1, K2, 0, num_int_steps);
+        break;
+    case 1:
+        ExactMPoleSlices(r, stride, n, A, B, L1, L2, K1, K2, 1, num_int_steps);
+        break;
+    case 2:
+        ExactMPoleSlices(r, stride, n, A, B, L1, L2, K1, K2, 2, num_int_steps);
+        break;
+    case 3:
+        ExactMPoleSlices(r, stride, n, A, B, L1, L2, K1, K2, 3, num_int_steps);
+        break;
+    default:
+        ExactMPoleSlices(r, stride, n, A, B, L1, L2, K1, K2, max_order, num_int_steps);
+    }
+}
+
+struct elem
+{
+    double Length;
+    double *PolynomA;
+    double *PolynomB;
+    int MaxOrder;
+    int NumIntSteps;
+    /* Optional fields */
+    int FringeQuadEntrance;
+    int FringeQuadExit;
+    double *fringeIntM0;
+    double *fringeIntP0;
+    double *R1;
+    double *R2;
+    double *T1;
+    double *T2;
+    double *RApertures;
+    double *EApertures;
+};
+
+AT_SIMD_DISPATCH
+void ExactMultipolePass(double *r, double le, double *A, double *B,
+        int max_order, int num_int_steps,
+        int FringeQuadEntrance, int FringeQuadExit, /* 0 (no fringe), 1 (lee-whiting) or 2 (lee-whiting+elegant-like) */
+        double *fringeIntM0,  /* I0m/K1, I1m/K1, I2m/K1, I3m/K1, Lambda2m/K1 */
+        double *fringeIntP0,  /* I0p/K1, I1p/K1, I2p/K1, I3p/K1, Lambda2p/K1 */        
+        double *T1, double *T2,
+        double *R1, double *R2,
+        double *RApertures, double *EApertures, 
+        int num_particles)
+/* The particles are processed in batches of AT_SIMD_WIDTH: the integrator
+   kernels are vectorized over the particles of a batch */
+{
+    int b;
+    double SL = le/num_int_steps;
+    double L1 = SL*DRIFT1;
+    double L2 = SL*DRIFT2;
+    double K1 = SL*KICK1;
+    double K2 = SL*KICK2;
+    bool useLinFrEleEntrance = (fringeIntM0 != NULL && fringeIntP0 != NULL  && FringeQuadEntrance==2);
+    bool useLinFrEleExit = (fringeIntM0 != NULL && fringeIntP0 != NULL  && FringeQuadExit==2);
+    bool entrance = T1 || R1 || RApertures || EApertures || (FringeQuadEntrance && B[1]!=0);
+    bool exit = T2 || R2 || RApertures || EApertures || (FringeQuadExit && B[1]!=0);
+
+    #ifdef _OPENMP
+    #pragma omp parallel for if (num_particles > OMP_PARTICLE_THRESHOLD) default(none) \
+    shared(r,num_particles,R1,T1,R2,T2,RApertures,EApertures,entrance,exit,\
+    A,B,L1,L2,K1,K2,max_order,num_int_steps,\
+    FringeQuadEntrance,useLinFrEleEntrance,FringeQuadExit,useLinFrEleExit,fringeIntM0,fringeIntP0) \
+    private(b)
+    #endif /*_OPENMP*/
+    for (b = 0; b<num_particles; b+=AT_SIMD_WIDTH) {   /* Loop over batches of particles */
+        double *rb = r+b*6;
+        int nb = (num_particles-b < AT_SIMD_WIDTH) ? num_particles-b : AT_SIMD_WIDTH;
+        double rs[6*AT_SIMD_WIDTH];
+        int c;
+        if (entrance) {
+            for (c = 0; c<nb; c++) {
+                double *r6 = rb+c*6;
+                if (!atIsNaN(r6[0])) {
+                    /*  misalignment at entrance  */
+                    if (T1) ATaddvv(r6,T1);
+                    if (R1) ATmultmv(r6,R1);
+                    /* Check physical apertures at the entrance of the magnet */
+                    checkiflostAperture(r6,RApertures,EApertures);
+                    if (FringeQuadEntrance && B[1]!=0) {
+                        if (useLinFrEleEntrance) /*Linear fringe fields from elegant */
+                            linearQuadFringeElegantEntrance(r6, B[1], fringeIntM0, fringeIntP0);
+                        else
+                            QuadFringePassP(r6, B[1]);
+                    }
+                }
+            }
+        }
+        /*  integrator, vectorized over the batch  */
+        aos_gather(rs, rb, nb);
+        ExactMPoleIntegrator(rs, AT_SIMD_WIDTH, nb, A, B, L1, L2, K1, K2, max_order, num_int_steps);
+        aos_scatter(rb, rs, nb);
+        if (exit) {
+            for (c = 0; c<nb; c++) {
+                double *r6 = rb+c*6;
+                if (!atIsNaN(r6[0])) {
+                    if (FringeQuadExit && B[1]!=0) {
+                        if (useLinFrEleExit) /*Linear fringe fields from elegant*/
+                            linearQuadFringeElegantExit(r6, B[1], fringeIntM0, fringeIntP0);
+                        else
+                            QuadFringePassN(r6, B[1]);
+                    }
+                    /* Check physical apertures at the exit of the magnet */
+                    checkiflostAperture(r6,RApertures,EApertures);
+                    /* Misalignment at exit */
+                    if (R2) ATmultmv(r6,R2);
+                    if (T2) ATaddvv(r6,T2);
+                }
+            }
+        }
+    }
+}
+
+AT_SIMD_DISPATCH
+void ExactMultipolePassSoA(double *r, double le, double *A, double *B,
+        int max_order, int num_int_steps,
+        int FringeQuadEntrance, int FringeQuadExit,
+        double *fringeIntM0, double *fringeIntP0,
+        double *T1, double *T2,
+        double *R1, double *R2,
+        double *RApertures, double *EApertures,
+        int num_particles)
+/* Same as ExactMultipolePass, but r is a structure-of-arrays:
+   6 rows of num_particles coordinates. The integration is done on blocks
+   of SOA_BLOCK_SIZE particles with the vectorized kernels */
+{
+    int b;
+    double SL = le/num_int_steps;
+    double L1 = SL*DRIFT1;
+    double L2 = SL*DRIFT2;
+    double K1 = SL*KICK1;
+    double K2 = SL*KICK2;
+    bool useLinFrEleEntrance = (fringeIntM0 != NULL && fringeIntP0 != NULL  && FringeQuadEntrance==2);
+    bool useLinFrEleExit = (fringeIntM0 != NULL && fringeIntP0 != NULL  && FringeQuadExit==2);
+    bool entrance = T1 || R1 || RApertures || EApertures || (FringeQuadEntrance && B[1]!=0);
+    bool exit = T2 || R2 || RApertures || EApertures || (FringeQuadExit && B[1]!=0);
+
+    #ifdef _OPENMP
+    #pragma omp parallel for if (num_particles > OMP_PARTICLE_THRESHOLD) default(none) \
+    shared(r,num_particles,R1,T1,R2,T2,RApertures,EApertures,entrance,exit,\
+    A,B,L1,L2,K1,K2,max_order,num_int_steps,\
+    FringeQuadEntrance,useLinFrEleEntrance,FringeQuadExit,useLinFrEleExit,fringeIntM0,fringeIntP0) \
+    private(b)
+    #endif /*_OPENMP*/
+    for (b = 0; b<num_particles; b+=SOA_BLOCK_SIZE) {   /* Loop over blocks of particles */
+        double *rb = r+b;
+        int nb = (num_particles-b < SOA_BLOCK_SIZE) ? num_particles-b : SOA_BLOCK_SIZE;
+        int c;
+        if (entrance) {
+            for (c = 0; c<nb; c++) {
+                double r6[6];
+                soa_load(r6, rb+c, num_particles);
+                if (!atIsNaN(r6[0])) {
+                    /*  misalignment at entrance  */
+                    if (T1) ATaddvv(r6,T1);
+                    if (R1) ATmultmv(r6,R1);
+                    /* Check physical apertures at the entrance of the magnet */
+                    checkiflostAperture(r6,RApertures,EApertures);
+                    if (FringeQuadEntrance && B[1]!=0) {
+                        if (useLinFrEleEntrance) /*Linear fringe fields from elegant */
+                            linearQuadFringeElegantEntrance(r6, B[1], fringeIntM0, fringeIntP0);
+                        else
+                            QuadFringePassP(r6, B[1]);
+                    }
+                    soa_store(rb+c, r6, num_particles);
+                }
+            }
+        }
+        /*  integrator  */
+        ExactMPoleIntegrator(rb, num_particles, nb, A, B, L1, L2, K1, K2, max_order, num_int_steps);
+        if (exit) {
+            for (c = 0; c<nb; c++) {
+                double r6[6];
+                soa_load(r6, rb+c, num_particles);
+                if (!atIsNaN(r6[0])) {
+                    if (FringeQuadExit && B[1]!=0) {
+                        if (useLinFrEleExit) /*Linear fringe fields from elegant*/
+                            linearQuadFringeElegantExit(r6, B[1], fringeIntM0, fringeIntP0);
+                        else
+                            QuadFringePassN(r6, B[1]);
+                    }
+                    /* Check physical apertures at the exit of the magnet */
+                    checkiflostAperture(r6,RApertures,EApertures);
+                    /* Misalignment at exit */
+                    if (R2) ATmultmv(r6,R2);
+                    if (T2) ATaddvv(r6,T2);
+                    soa_store(rb+c, r6, num_particles);
+                }
+            }
+        }
+    }
+}
+
+#if defined(MATLAB_MEX_FILE) || defined(PYAT)
+static struct elem *init_elem(const atElem *ElemData)
+{
+    struct elem *Elem;
+    double Length;
+    int MaxOrder, NumIntSteps, FringeQuadEntrance, FringeQuadExit;
+    double *PolynomA, *PolynomB, *R1, *R2, *T1, *T2, *EApertures, *RApertures, *fringeIntM0, *fringeIntP0, *KickAngle;
+    int msz, nsz, npoly;
+    Length=atGetDouble(ElemData,"Length"); check_error();
+    PolynomA=atGetDoubleArraySz(ElemData,"PolynomA",&msz,&nsz); check_error();
+    npoly=msz*nsz;
+    PolynomB=atGetDoubleArraySz(ElemData,"PolynomB",&msz,&nsz); check_error();
+    if (msz*nsz < npoly) npoly=msz*nsz;
+    MaxOrder=atGetLong(ElemData,"MaxOrder"); check_error();
+    NumIntSteps=atGetLong(ElemData,"NumIntSteps"); check_error();
+    /*optional fields*/
+    FringeQuadEntrance=atGetOptionalLong(ElemData,"FringeQuadEntrance",0);
+    FringeQuadExit=atGetOptionalLong(ElemData,"FringeQuadExit",0);
+    fringeIntM0=atGetOptionalDoubleArray(ElemData,"fringeIntM0"); check_error();
+    fringeIntP0=atGetOptionalDoubleArray(ElemData,"fringeIntP0"); check_error();
+    R1=atGetOptionalDoubleArray(ElemData,"R1"); check_error();
+    R2=atGetOptionalDoubleArray(ElemData,"R2"); check_error();
+    T1=atGetOptionalDoubleArray(ElemData,"T1"); check_error();
+    T2=atGetOptionalDoubleArray(ElemData,"T2"); check_error();
+    EApertures=atGetOptionalDoubleArray(ElemData,"EApertures"); check_error();
+    RApertures=atGetOptionalDoubleArray(ElemData,"RApertures"); check_error();
+    KickAngle=atGetOptionalDoubleArray(ElemData,"KickAngle"); check_error();
+
+    if (KickAngle) {    /* Effective coefficients including the corrector kick */
+        Elem = (struct elem*)atMalloc(sizeof(struct elem)+2*npoly*sizeof(double));
+        atKickPolynom((double *)(Elem+1), (double *)(Elem+1)+npoly, PolynomA, PolynomB,
+                npoly, Length, KickAngle);
+        PolynomA = (double *)(Elem+1);
+        PolynomB = PolynomA+npoly;
+    }
+    else
+        Elem = (struct elem*)atMalloc(sizeof(struct elem));
+    Elem->Length=Length;
+    Elem->PolynomA=PolynomA;
+    Elem->PolynomB=PolynomB;
+    Elem->MaxOrder=MaxOrder;
+    Elem->NumIntSteps=NumIntSteps;
+    /*optional fields*/
+    Elem->FringeQuadEntrance=FringeQuadEntrance;
+    Elem->FringeQuadExit=FringeQuadExit;
+    Elem->fringeIntM0=fringeIntM0;
+    Elem->fringeIntP0=fringeIntP0;
+    Elem->R1=R1;
+    Elem->R2=R2;
+    Elem->T1=T1;
+    Elem->T2=T2;
+    Elem->EApertures=EApertures;
+    Elem->RApertures=RApertures;
+    return Elem;
+}
+
+ExportMode struct elem *trackFunction(const atElem *ElemData,struct elem *Elem,
+        double *r_in, int num_particles, struct parameters *Param)
+{
+    (void)Param;
+    if (!Elem) Elem = init_elem(ElemData);
+    if (!Elem) return NULL;
+    ExactMultipolePass(r_in,Elem->Length,Elem->PolynomA,Elem->PolynomB,
+            Elem->MaxOrder,Elem->NumIntSteps,Elem->FringeQuadEntrance,
+            Elem->FringeQuadExit,Elem->fringeIntM0,Elem->fringeIntP0,
+            Elem->T1,Elem->T2,Elem->R1,Elem->R2,
+            Elem->RApertures,Elem->EApertures,num_particles);
+    return Elem;
+}
+
+ExportMode struct elem *trackFunctionSoA(const atElem *ElemData,struct elem *Elem,
+        double *r_in, int num_particles, struct parameters *Param)
+{
+    (void)Param;
+    if (!Elem) Elem = init_elem(ElemData);
+    if (!Elem) return NULL;
+    ExactMultipolePassSoA(r_in,Elem->Length,Elem->PolynomA,Elem->PolynomB,
+            Elem->MaxOrder,Elem->NumIntSteps,Elem->FringeQuadEntrance,
+            Elem->FringeQuadExit,Elem->fringeIntM0,Elem->fringeIntP0,
+            Elem->T1,Elem->T2,Elem->R1,Elem->R2,
+            Elem->RApertures,Elem->EApertures,num_particles);
+    return Elem;
+}
+
+MODULE_DEF(ExactMultipolePass)        /* Dummy module initialisation */
+
+#endif /*defined(MATLAB_MEX_FILE) || defined(PYAT)*/
+
+#if defined(MATLAB_MEX_FILE)
+void mexFunction(	int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    if (nrhs == 2) {
+        double *r_in;
+        const mxArray *ElemData = prhs[0];
+        int num_particles = mxGetN(prhs[1]);
+        double Length;
+        int MaxOrder, NumIntSteps, FringeQuadEntrance, FringeQuadExit;
+        double *PolynomA, *PolynomB, *R1, *R2, *T1, *T2, *EApertures, *RApertures, *fringeIntM0, *fringeIntP0, *KickAngle;
+        double *PolynomAB = NULL;
+        int msz, nsz, npoly;
+        Length=atGetDouble(ElemData,"Length"); check_error();
+        PolynomA=atGetDoubleArraySz(ElemData,"PolynomA",&msz,&nsz); check_error();
+        npoly=msz*nsz;
+        PolynomB=atGetDoubleArraySz(ElemData,"PolynomB",&msz,&nsz); check_error();
+        if (msz*nsz < npoly) npoly=msz*nsz;
+        MaxOrder=atGetLong(ElemData,"MaxOrder"); check_error();
+        NumIntSteps=atGetLong(ElemData,"NumIntSteps"); check_error();
+        /*optional fields*/
+        FringeQuadEntrance=atGetOptionalLong(ElemData,"FringeQuadEntrance",0); check_error();
+        FringeQuadExit=atGetOptionalLong(ElemData,"FringeQuadExit",0); check_error();
+        fringeIntM0=atGetOptionalDoubleArray(ElemData,"fringeIntM0"); check_error();
+        fringeIntP0=atGetOptionalDoubleArray(ElemData,"fringeIntP0"); check_error();
+        R1=atGetOptionalDoubleArray(ElemData,"R1"); check_error();
+        R2=atGetOptionalDoubleArray(ElemData,"R2"); check_error();
+        T1=atGetOptionalDoubleArray(ElemData,"T1"); check_error();
+        T2=atGetOptionalDoubleArray(ElemData,"T2"); check_error();
+        EApertures=atGetOptionalDoubleArray(ElemData,"EApertures"); check_error();
+        RApertures=atGetOptionalDoubleArray(ElemData,"RApertures"); check_error();
+        KickAngle=atGetOptionalDoubleArray(ElemData,"KickAngle"); check_error();
+        
+        if (KickAngle) {    /* Effective coefficients including the corrector kick */
+            PolynomAB = (double *)atMalloc(2*npoly*sizeof(double));
+            atKickPolynom(PolynomAB, PolynomAB+npoly, PolynomA, PolynomB, npoly, Length, KickAngle);
+            PolynomA = PolynomAB;
+            PolynomB = PolynomAB+npoly;
+        }
+        /* ALLOCATE memory for the output array of the same size as the input  */
+        plhs[0] = mxDuplicateArray(prhs[1]);
+        r_in = mxGetDoubles(plhs[0]);
+        ExactMultipolePass(r_in,Length,PolynomA,PolynomB,MaxOrder,NumIntSteps,
+                FringeQuadEntrance,FringeQuadExit,fringeIntM0,fringeIntP0,
+                T1,T2,R1,R2,RApertures,EApertures,num_particles);
+        if (PolynomAB) atFree(PolynomAB);
+    }
+    else if (nrhs == 0) {
+        /* list of required fields */
+        plhs[0] = mxCreateCellMatrix(5,1);
+        mxSetCell(plhs[0],0,mxCreateString("Length"));
+        mxSetCell(plhs[0],1,mxCreateString("PolynomA"));
+        mxSetCell(plhs[0],2,mxCreateString("PolynomB"));
+        mxSetCell(plhs[0],3,mxCreateString("MaxOrder"));
+        mxSetCell(plhs[0],4,mxCreateString("NumIntSteps"));
+        if (nlhs>1) {
+            /* list of optional fields */
+            plhs[1] = mxCreateCellMatrix(11,1);
+            mxSetCell(plhs[1], 0,mxCreateString("FringeQuadEntrance"));
+            mxSetCell(plhs[1], 1,mxCreateString("FringeQuadExit")); 
+            mxSetCell(plhs[1], 2,mxCreateString("fringeIntM0"));
+            mxSetCell(plhs[1], 3,mxCreateString("fringeIntP0"));
+            mxSetCell(plhs[1], 4,mxCreateString("T1"));
+            mxSetCell(plhs[1], 5,mxCreateString("T2"));
+            mxSetCell(plhs[1], 6,mxCreateString("R1"));
+            mxSetCell(plhs[1], 7,mxCreateString("R2"));
+            mxSetCell(plhs[1], 8,mxCreateString("RApertures"));
+            mxSetCell(plhs[1], 9,mxCreateString("EApertures"));
+            mxSetCell(plhs[1],10,mxCreateString("KickAngle"));
+        }
+    }
+    else {
+        mexErrMsgIdAndTxt("AT:WrongArg","Needs 0 or 2 arguments");
+    }
+}
+#endif /*MATLAB_MEX_FILE*/
@@ -0,0 +1,412 @@
+#include "atelem.c"
+#include "atlalib.c"
+#include "atphyslib.c"		/* edge_fringe_prepare */
+#include "driftkick.c"		/* aos_gather, aos_scatter */
+#include "exactdriftkick.c"	/* exactbend_soa, bndexactkick_soa */
+
+#define DRIFT1    0.6756035959798286638
+#define DRIFT2   -0.1756035959798286639
+#define KICK1     1.351207191959657328
+#define KICK2    -1.702414383919314656
+
+/* Slices of the integrator: exact propagation in the reference dipole
+   field, and kicks of the field errors and multipoles. When called with a
+   constant max_order, the kick kernel is specialised */
+AT_INLINE void ExactBendSlices(double *r, int stride, int n, const double *A, const double *B,
+        double irho, const struct exactbend_step *step1, const struct exactbend_step *step2,
+        double K1, double K2, int max_order, int num_int_steps)
+{
+    int m;
+    for (m=0; m < num_int_steps; m++) {  /*  Loop over slices */
+        exactbend_soa(r, stride, n, step1);
+        bndexactkick_soa(r, stride, n, A, B, K1, irho, max_order);
+        exactbend_soa(r, stride, n, step2);
+        bndexactkick_soa(r, stride, n, A, B, K2, irho, max_order);
+        exactbend_soa(r, stride, n, step2);
+        bndexactkick_soa(r, stride, n, A, B, K1, irho, max_order);
+        exactbend_soa(r, stride, n, step1);
+    }
+}
+
+AT_INLINE void ExactBendIntegrator(double *r, int stride, int n, const double *A, const double *B,
+        double irho, const struct exactbend_step *step1, const struct exactbend_step *step2,
+        double K1, double K2, int max_order, int num_int_steps)
+/* Specialised integrators for the orders up to octupoles */
+{
+    switch (max_order) {
+    case 0:
+        ExactBendSlices(r, stride, n, A, B, irho, step1, step2, K1, K2, 0, num_int_steps);
+        break;
+    case 1:
+        ExactBendSlices(r, stride, n, A, B, irho, step1, step2, K1, K2, 1, num_int_steps);
+        break;
+    case 2:
+        ExactBendSlices(r, stride, n, A, B, irho, step1, step2, K1, K2, 2, num_int_steps);
+        break;
+    case 3:
+        ExactBendSlices(r, stride, n, A, B, irho, step1, step2, K1, K2, 3, num_int_steps);
+        break;
+    default:
+        ExactBendSlices(r, stride, n, A, B, irho, step1, step2, K1, K2, max_order, num_int_steps);
+    }
+}
+
+static void ExactBendEntrance(double *r6, const struct edge_fringe *edge)
+/* Pole face: rotation to the frame of the face, fringe field, and
+   propagation in the field back to the polar frame of the magnet */
+{
+    if (edge->inv_rho == 0.0) return;
+    if (edge->edge_angle != 0.0) exact_yrot(r6, edge->edge_angle);
+    exact_edge_fringe(r6, edge->inv_rho, edge->fringecorr, 0);
+    if (edge->edge_angle != 0.0) exact_wedge(r6, edge->inv_rho, -edge->edge_angle);
+}
+
+static void ExactBendExit(double *r6, const struct edge_fringe *edge)
+{
+    if (edge->inv_rho == 0.0) return;
+    if (edge->edge_angle != 0.0) exact_wedge(r6, edge->inv_rho, -edge->edge_angle);
+    exact_edge_fringe(r6, edge->inv_rho, edge->fringecorr, 1);
+    if (edge->edge_angle != 0.0) exact_yrot(r6, edge->edge_angle);
+}
+
+struct elem
+{
+    double Length;
+    double *PolynomA;
+    double *PolynomB;
+    int MaxOrder;
+    int NumIntSteps;
+    double BendingAngle;
+    double EntranceAngle;
+    double ExitAngle;
+    /* Optional fields */
+    int FringeBendEntrance;
+    int FringeBendExit;
+    double FringeInt1;
+    double FringeInt2;
+    double FullGap;
+    double *R1;
+    double *R2;
+    double *T1;
+    double *T2;
+    double *RApertures;
+    double *EApertures;
+    /* Derived constants */
+    double irho;
+    struct edge_fringe EntranceEdge;
+    struct edge_fringe ExitEdge;
+};
+
+AT_SIMD_DISPATCH
+void ExactSectorBendPass(double *r, double le, double irho, double *A, double *B,
+        int max_order, int num_int_steps,
+        const struct edge_fringe *entrance_edge, const struct edge_fringe *exit_edge,
+        double *T1, double *T2,
+        double *R1, double *R2,
+        double *RApertures, double *EApertures,
+        int num_particles)
+/* The particles are processed in batches of AT_SIMD_WIDTH: the integrator
+   kernels are vectorized over the particles of a batch */
+{
+    int b;
+    double SL = le/num_int_steps;
+    double K1 = SL*KICK1;
+    double K2 = SL*KICK2;
+    struct exactbend_step step1, step2;
+    exactbend_prepare(&step1, irho, SL*DRIFT1);
+    exactbend_prepare(&step2, irho, SL*DRIFT2);
+
+    #ifdef _OPENMP
+    #pragma omp parallel for if (num_particles > OMP_PARTICLE_THRESHOLD) default(none) \
+    shared(r,num_particles,R1,T1,R2,T2,RApertures,EApertures,\
+    irho,A,B,step1,step2,K1,K2,max_order,num_int_steps,entrance_edge,exit_edge) \
+    private(b)
+    #endif /*_OPENMP*/
+    for (b = 0; b<num_particles; b+=AT_SIMD_WIDTH) {   /* Loop over batches of particles */
+        double *rb = r+b*6;
+        int nb = (num_particles-b < AT_SIMD_WIDTH) ? num_particles-b : AT_SIMD_WIDTH;
+        double rs[6*AT_SIMD_WIDTH];
+        int c;
+        for (c = 0; c<nb; c++) {
+            double *r6 = rb+c*6;
+            if (!atIsNaN(r6[0])) {
+                /*  misalignment at entrance  */
+                if (T1) ATaddvv(r6,T1);
+                if (R1) ATmultmv(r6,R1);
+                /* Check physical apertures at the entrance of the magnet */
+                checkiflostAperture(r6,RApertures,EApertures);
+                ExactBendEntrance(r6, entrance_edge);
+            }
+        }
+        /*  integrator, vectorized over the batch  */
+        aos_gather(rs, rb, nb);
+        ExactBendIntegrator(rs, AT_SIMD_WIDTH, nb, A, B, irho, &step1, &step2,
+                K1, K2, max_order, num_int_steps);
+        aos_scatter(rb, rs, nb);
+        for (c = 0; c<nb; c++) {
+            double *r6 = rb+c*6;
+            if (!atIsNaN(r6[0])) {
+                ExactBendExit(r6, exit_edge);
+                /* Check physical apertures at the exit of the magnet */
+                checkiflostAperture(r6,RApertures,EApertures);
+                /* Misalignment at exit */
+                if (R2) ATmultmv(r6,R2);
+                if (T2) ATaddvv(r6,T2);
+            }
+        }
+    }
+}
+
+AT_SIMD_DISPATCH
+void ExactSectorBendPassSoA(double *r, double le, double irho, double *A, double *B,
+        int max_order, int num_int_steps,
+        const struct edge_fringe *entrance_edge, const struct edge_fringe *exit_edge,
+        double *T1, double *T2,
+        double *R1, double *R2,
+        double *RApertures, double *EApertures,
+        int num_particles)
+/* Same as ExactSectorBendPass, but r is a structure-of-arrays:
+   6 rows of num_particles coordinates. The integration is done on blocks
+   of SOA_BLOCK_SIZE particles with the vectorized kernels */
+{
+    int b;
+    double SL = le/num_int_steps;
+    double K1 = SL*KICK1;
+    double K2 = SL*KICK2;
+    struct exactbend_step step1, step2;
+    exactbend_prepare(&step1, irho, SL*DRIFT1);
+    exactbend_prepare(&step2, irho, SL*DRIFT2);
+
+    #ifdef _OPENMP
+    #pragma omp parallel for if (num_particles > OMP_PARTICLE_THRESHOLD) default(none) \
+    shared(r,num_particles,R1,T1,R2,T2,RApertures,EApertures,\
+    irho,A,B,step1,step2,K1,K2,max_order,num_int_steps,entrance_edge,exit_edge) \
+    private(b)
+    #endif /*_OPENMP*/
+    for (b = 0; b<num_particles; b+=SOA_BLOCK_SIZE) {   /* Loop over blocks of particles */
+        double *rb = r+b;
+        int nb = (num_particles-b < SOA_BLOCK_SIZE) ? num_particles-b : SOA_BLOCK_SIZE;
+        int c;
+        for (c = 0; c<nb; c++) {
+            double r6[6];
+            soa_load(r6, rb+c, num_particles);
+            if (!atIsNaN(r6[0])) {
+                /*  misalignment at entrance  */
+                if (T1) ATaddvv(r6,T1);
+                if (R1) ATmultmv(r6,R1);
+                /* Check physical apertures at the entrance of the magnet */
+                checkiflostAperture(r6,RApertures,EApertures);
+                ExactBendEntrance(r6, entrance_edge);
+                soa_store(rb+c, r6, num_particles);
+            }
+        }
+        /*  integrator  */
+        ExactBendIntegrator(rb, num_particles, nb, A, B, irho, &step1, &step2,
+                K1, K2, max_order, num_int_steps);
+        for (c = 0; c<nb; c++) {
+            double r6[6];
+            soa_load(r6, rb+c, num_particles);
+            if (!atIsNaN(r6[0])) {
+                ExactBendExit(r6, exit_edge);
+                /* Check physical apertures at the exit of the magnet */
+                checkiflostAperture(r6,RApertures,EApertures);
+                /* Misalignment at exit */
+                if (R2) ATmultmv(r6,R2);
+                if (T2) ATaddvv(r6,T2);
+                soa_store(rb+c, r6, num_particles);
+            }
+        }
+    }
+}
+
+#if defined(MATLAB_MEX_FILE) || defined(PYAT)
+static struct elem *init_elem(const atElem *ElemData)
+{
+    struct elem *Elem;
+    double Length, BendingAngle, EntranceAngle, ExitAngle, FullGap,
+            FringeInt1, FringeInt2;
+    int MaxOrder, NumIntSteps,  FringeBendEntrance, FringeBendExit;
+    double *PolynomA, *PolynomB, *R1, *R2, *T1, *T2, *EApertures, *RApertures, *KickAngle;
+    int msz, nsz, npoly;
+    Length=atGetDouble(ElemData,"Length"); check_error();
+    PolynomA=atGetDoubleArraySz(ElemData,"PolynomA",&msz,&nsz); check_error();
+    npoly=msz*nsz;
+    PolynomB=atGetDoubleArraySz(ElemData,"PolynomB",&msz,&nsz); check_error();
+    if (msz*nsz < npoly) npoly=msz*nsz;
+    MaxOrder=atGetLong(ElemData,"MaxOrder"); check_error();
+    NumIntSteps=atGetLong(ElemData,"NumIntSteps"); check_error();
+    BendingAngle=atGetDouble(ElemData,"BendingAngle"); check_error();
+    EntranceAngle=atGetDouble(ElemData,"EntranceAngle"); check_error();
+    ExitAngle=atGetDouble(ElemData,"ExitAngle"); check_error();
+    /*optional fields*/
+    FringeBendEntrance=atGetOptionalLong(ElemData,"FringeBendEntrance",1); check_error();
+    FringeBendExit=atGetOptionalLong(ElemData,"FringeBendExit",1); check_error();
+    FullGap=atGetOptionalDouble(ElemData,"FullGap",0); check_error();
+    FringeInt1=atGetOptionalDouble(ElemData,"FringeInt1",0); check_error();
+    FringeInt2=atGetOptionalDouble(ElemData,"FringeInt2",0); check_error();
+    R1=atGetOptionalDoubleArray(ElemData,"R1"); check_error();
+    R2=atGetOptionalDoubleArray(ElemData,"R2"); check_error();
+    T1=atGetOptionalDoubleArray(ElemData,"T1"); check_error();
+    T2=atGetOptionalDoubleArray(ElemData,"T2"); check_error();
+    EApertures=atGetOptionalDoubleArray(ElemData,"EApertures"); check_error();
+    RApertures=atGetOptionalDoubleArray(ElemData,"RApertures"); check_error();
+    KickAngle=atGetOptionalDoubleArray(ElemData,"KickAngle"); check_error();
+
+    if (KickAngle) {    /* Effective coefficients including the corrector kick */
+        Elem = (struct elem*)atMalloc(sizeof(struct elem)+2*npoly*sizeof(double));
+        atKickPolynom((double *)(Elem+1), (double *)(Elem+1)+npoly, PolynomA, PolynomB,
+                npoly, Length, KickAngle);
+        PolynomA = (double *)(Elem+1);
+        PolynomB = PolynomA+npoly;
+    }
+    else
+        Elem = (struct elem*)atMalloc(sizeof(struct elem));
+    Elem->Length=Length;
+    Elem->PolynomA=PolynomA;
+    Elem->PolynomB=PolynomB;
+    Elem->MaxOrder=MaxOrder;
+    Elem->NumIntSteps=NumIntSteps;
+    Elem->BendingAngle=BendingAngle;
+    Elem->EntranceAngle=EntranceAngle;
+    Elem->ExitAngle=ExitAngle;
+    /*optional fields*/
+    Elem->FringeBendEntrance=FringeBendEntrance;
+    Elem->FringeBendExit=FringeBendExit;
+    Elem->FullGap=FullGap;
+    Elem->FringeInt1=FringeInt1;
+    Elem->FringeInt2=FringeInt2;
+    Elem->R1=R1;
+    Elem->R2=R2;
+    Elem->T1=T1;
+    Elem->T2=T2;
+    Elem->EApertures=EApertures;
+    Elem->RApertures=RApertures;
+    /* Derived constants */
+    Elem->irho=BendingAngle/Length;
+    edge_fringe_prepare(&Elem->EntranceEdge, Elem->irho, EntranceAngle,
+            FringeInt1, FullGap, FringeBendEntrance);
+    edge_fringe_prepare(&Elem->ExitEdge, Elem->irho, ExitAngle,
+            FringeInt2, FullGap, FringeBendExit);
+    return Elem;
+}
+
+ExportMode struct elem *trackFunction(const atElem *ElemData,struct elem *Elem,
+        double *r_in, int num_particles, struct parameters *Param)
+{
+    (void)Param;
+    if (!Elem) Elem = init_elem(ElemData);
+    if (!Elem) return NULL;
+    ExactSectorBendPass(r_in,Elem->Length,Elem->irho,Elem->PolynomA,Elem->PolynomB,
+            Elem->MaxOrder,Elem->NumIntSteps,&Elem->EntranceEdge,&Elem->ExitEdge,
+            Elem->T1,Elem->T2,Elem->R1,Elem->R2,
+            Elem->RApertures,Elem->EApertures,num_particles);
+    return Elem;
+}
+
+ExportMode struct elem *trackFunctionSoA(const atElem *ElemData,struct elem *Elem,
+        double *r_in, int num_particles, struct parameters *Param)
+{
+    (void)Param;
+    if (!Elem) Elem = init_elem(ElemData);
+    if (!Elem) return NULL;
+    ExactSectorBendPassSoA(r_in,Elem->Length,Elem->irho,Elem->PolynomA,Elem->PolynomB,
+            Elem->MaxOrder,Elem->NumIntSteps,&Elem->EntranceEdge,&Elem->ExitEdge,
+            Elem->T1,Elem->T2,Elem->R1,Elem->R2,
+            Elem->RApertures,Elem->EApertures,num_particles);
+    return Elem;
+}
+
+MODULE_DEF(ExactSectorBendPass)        /* Dummy module initialisation */
+
+#endif /*defined(MATLAB_MEX_FILE) || defined(PYAT)*/
+
+#if defined(MATLAB_MEX_FILE)
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    if (nrhs == 2 ) {
+        double Length, BendingAngle, EntranceAngle, ExitAngle, FullGap,
+                FringeInt1, FringeInt2;
+        int MaxOrder, NumIntSteps, FringeBendEntrance, FringeBendExit;
+        double *PolynomA, *PolynomB, *R1, *R2, *T1, *T2, *EApertures, *RApertures, *KickAngle;
+        double *PolynomAB = NULL;
+        int msz, nsz, npoly;
+        double irho;
+        struct edge_fringe EntranceEdge, ExitEdge;
+        double *r_in;
+        const mxArray *ElemData = prhs[0];
+        int num_particles = mxGetN(prhs[1]);
+        Length=atGetDouble(ElemData,"Length"); check_error();
+        PolynomA=atGetDoubleArraySz(ElemData,"PolynomA",&msz,&nsz); check_error();
+        npoly=msz*nsz;
+        PolynomB=atGetDoubleArraySz(ElemData,"PolynomB",&msz,&nsz); check_error();
+        if (msz*nsz < npoly) npoly=msz*nsz;
+        MaxOrder=atGetLong(ElemData,"MaxOrder"); check_error();
+        NumIntSteps=atGetLong(ElemData,"NumIntSteps"); check_error();
+        BendingAngle=atGetDouble(ElemData,"BendingAngle"); check_error();
+        EntranceAngle=atGetDouble(ElemData,"EntranceAngle"); check_error();
+        ExitAngle=atGetDouble(ElemData,"ExitAngle"); check_error();
+        /*optional fields*/
+        FringeBendEntrance=atGetOptionalLong(ElemData,"FringeBendEntrance",1); check_error();
+        FringeBendExit=atGetOptionalLong(ElemData,"FringeBendExit",1); check_error();
+        FullGap=atGetOptionalDouble(ElemData,"FullGap",0); check_error();
+        FringeInt1=atGetOptionalDouble(ElemData,"FringeInt1",0); check_error();
+        FringeInt2=atGetOptionalDouble(ElemData,"FringeInt2",0); check_error();
+        R1=atGetOptionalDoubleArray(ElemData,"R1"); check_error();
+        R2=atGetOptionalDoubleArray(ElemData,"R2"); check_error();
+        T1=atGetOptionalDoubleArray(ElemData,"T1"); check_error();
+        T2=atGetOptionalDoubleArray(ElemData,"T2"); check_error();
+        EApertures=atGetOptionalDoubleArray(ElemData,"EApertures"); check_error();
+        RApertures=atGetOptionalDoubleArray(ElemData,"RApertures"); check_error();
+        KickAngle=atGetOptionalDoubleArray(ElemData,"KickAngle"); check_error();
+        irho = BendingAngle/Length;
+        edge_fringe_prepare(&EntranceEdge, irho, EntranceAngle, FringeInt1, FullGap, FringeBendEntrance);
+        edge_fringe_prepare(&ExitEdge, irho, ExitAngle, FringeInt2, FullGap, FringeBendExit);
+
+        if (KickAngle) {    /* Effective coefficients including the corrector kick */
+            PolynomAB = (double *)atMalloc(2*npoly*sizeof(double));
+            atKickPolynom(PolynomAB, PolynomAB+npoly, PolynomA, PolynomB, npoly, Length, KickAngle);
+            PolynomA = PolynomAB;
+            PolynomB = PolynomAB+npoly;
+        }
+        /* ALLOCATE memory for the output array of the same size as the input  */
+        plhs[0] = mxDuplicateArray(prhs[1]);
+        r_in = mxGetDoubles(plhs[0]);
+        ExactSectorBendPass(r_in, Length, irho, PolynomA, PolynomB,
+                MaxOrder,NumIntSteps,&EntranceEdge,&ExitEdge,
+                T1,T2,R1,R2,RApertures,EApertures,num_particles);
+        if (PolynomAB) atFree(PolynomAB);
+    }
+    else if (nrhs == 0) {
+        /* list of required fields */
+        plhs[0] = mxCreateCellMatrix(8,1);
+        mxSetCell(plhs[0],0,mxCreateString("Length"));
+        mxSetCell(plhs[0],1,mxCreateString("BendingAngle"));
+        mxSetCell(plhs[0],2,mxCreateString("EntranceAngle"));
+        mxSetCell(plhs[0],3,mxCreateString("ExitAngle"));
+        mxSetCell(plhs[0],4,mxCreateString("PolynomA"));
+        mxSetCell(plhs[0],5,mxCreateString("PolynomB"));
+        mxSetCell(plhs[0],6,mxCreateString("MaxOrder"));
+        mxSetCell(plhs[0],7,mxCreateString("NumIntSteps"));
+
+        if (nlhs>1) {
+            /* list of optional fields */
+            plhs[1] = mxCreateCellMatrix(12,1);
+            mxSetCell(plhs[1],0,mxCreateString("FullGap"));
+            mxSetCell(plhs[1],1,mxCreateString("FringeInt1"));
+            mxSetCell(plhs[1],2,mxCreateString("FringeInt2"));
+            mxSetCell(plhs[1],3,mxCreateString("FringeBendEntrance"));
+            mxSetCell(plhs[1],4,mxCreateString("FringeBendExit"));
+            mxSetCell(plhs[1],5,mxCreateString("T1"));
+            mxSetCell(plhs[1],6,mxCreateString("T2"));
+            mxSetCell(plhs[1],7,mxCreateString("R1"));
+            mxSetCell(plhs[1],8,mxCreateString("R2"));
+            mxSetCell(plhs[1],9,mxCreateString("RApertures"));
+            mxSetCell(plhs[1],10,mxCreateString("EApertures"));
+            mxSetCell(plhs[1],11,mxCreateString("KickAngle"));
+        }
+    }
+    else {
+        mexErrMsgIdAndTxt("AT:WrongArg","Needs 0 or 2 arguments");
+    }
+}
+#endif /* MATLAB_MEX_FILE */
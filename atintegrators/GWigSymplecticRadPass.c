@@ -18,6 +18,7 @@
 
 #include "atelem.c"
 #include "atlalib.c"
+#include "driftkick.c"		/* aos_gather, aos_scatter */
 #include "gwigR.c"
 
 struct elem {
@@ -36,12 +37,14 @@ struct elem {
     double *R2;
     double *T1;
     double *T2;
+    /* Wiggler parameters, and tables of sin(kz*z+tz), cos(kz*z+tz) stored after them */
+    struct gwigR Wig;
 };
 
 /*****************************************************************************/
 /* PHYSICS SECTION ***********************************************************/
 
-void GWigInit(struct gwigR *Wig,double design_energy, double Ltot, double Lw,
+static void GWigInit(struct gwigR *Wig,double design_energy, double Ltot, double Lw,
             double Bmax, int Nstep, int Nmeth, int NHharm, int NVharm,
             int HSplitPole, int VSplitPole, double *zEndPointH,
             double *zEndPointV, double *By, double *Bx, double *T1,
@@ -71,7 +74,6 @@ void GWigInit(struct gwigR *Wig,double design_energy, double Ltot, double Lw,
     /*----------------------------------------------------------*/
 
     kw = 2.0e0*PI/(Wig->Lw);
-    Wig->Zw = 0.0;
     Wig->Aw = 0.0;
     tmppr = By;
     for (i = 0; i < NHharm; i++) {
@@ -119,45 +121,53 @@ void GWigInit(struct gwigR *Wig,double design_energy, double Ltot, double Lw,
         Wig->Vkz[i] = 0.0;
         Wig->Vtz[i] = 0.0;
     }
+    GWigPrepare(Wig);
+    Wig->SinZ = NULL;
+    Wig->CosZ = NULL;
+}
+
+static int GWigTableSize(const struct gwigR *Wig)
+/* Number of doubles in the SinZ and CosZ tables */
+{
+    int nsz = Wig->NHharm + Wig->NVharm;
+    int nkick = Wig->PN*(Wig->Nw) + 1;
+    return (Wig->Nz + 2*nkick)*nsz;
+}
+
+static void GWigSetTables(struct gwigR *Wig, double *tables)
+{
+    Wig->SinZ = tables;
+    Wig->CosZ = tables + (Wig->Nz + Wig->PN*(Wig->Nw) + 1)*(Wig->NHharm + Wig->NVharm);
+    GWigFillZ(Wig, Wig->SinZ, Wig->CosZ);
 }
 
 #define second 2
 #define fourth 4
-void GWigSymplecticRadPass(double *r,double Energy, double Ltot, double Lw,
-            double Bmax, int Nstep, int Nmeth, int NHharm, int NVharm,
-            double *By, double *Bx, double *T1, double *T2,
-            double *R1, double *R2, int num_particles)
+void GWigSymplecticRadPass(double *r, const struct gwigR *Wig, int num_particles)
+/* The particles are processed in batches of AT_SIMD_WIDTH: the loops over
+   the particles of a batch are vectorized */
 {
-    int c;
-    double *r6;
-    double zEndPointH[2];
-    double zEndPointV[2];
-    struct gwigR Wig;
-    /* Energy is defined in the lattice in eV but GeV is used by the gwig code. */
-    Energy = Energy / 1e9;
+    int b;
 
-    zEndPointH[0] = 0;
-    zEndPointH[1] = Ltot;
-    zEndPointV[0] = 0;
-    zEndPointV[1] = Ltot;
-
-    GWigInit(&Wig, Energy, Ltot, Lw, Bmax, Nstep, Nmeth, NHharm, NVharm,0, 0, zEndPointH, zEndPointV, By, Bx, T1, T2, R1, R2);
+    if ((Wig->Pmethod != second) && (Wig->Pmethod != fourth)) {
+        printf("Invalid wiggler integration method %d.\n", Wig->Pmethod);
+        return;
+    }
 
-    for(c = 0;c<num_particles;c++) {
-        r6 = r+c*6;
-        if(!atIsNaN(r6[0])) {
-            switch (Nmeth) {
-                case second:
-                    GWigPass_2nd(&Wig, r6);
-                    break;
-                case fourth:
-                    GWigPass_4th(&Wig, r6);
-                    break;
-                default:
-                    printf("Invalid wiggler integration method %d.\n", Nmeth);
-                    break;
-            }
-        }
+    #ifdef _OPENMP
+    #pragma omp parallel for if (num_particles > OMP_PARTICLE_THRESHOLD) default(none) \
+    shared(r,num_particles,Wig) private(b)
+    #endif /*_OPENMP*/
+    for (b = 0; b<num_particles; b+=AT_SIMD_WIDTH) {   /* Loop over batches of particles */
+        double *rb = r+b*6;
+        int nb = (num_particles-b < AT_SIMD_WIDTH) ? num_particles-b : AT_SIMD_WIDTH;
+        double rs[6*AT_SIMD_WIDTH];
+        aos_gather(rs, rb, nb);
+        if (Wig->Pmethod == fourth)
+            GWigPass_4th(Wig, rs, AT_SIMD_WIDTH, nb);
+        else
+            GWigPass_2nd(Wig, rs, AT_SIMD_WIDTH, nb);
+        aos_scatter(rb, rs, nb);
     }
 }
 
@@ -175,6 +185,8 @@ ExportMode struct elem *trackFunction(const atElem *ElemData,struct elem *Elem,
         double Ltot, Lw, Bmax, Energy;
         int Nstep, Nmeth;
         int NHharm, NVharm;
+        double zEndPoint[2];
+        struct gwigR Wig;
 
         Energy = atGetDouble(ElemData, "Energy"); check_error();
         Ltot = atGetDouble(ElemData, "Length"); check_error();
@@ -192,7 +204,15 @@ ExportMode struct elem *trackFunction(const atElem *ElemData,struct elem *Elem,
         T1 = atGetOptionalDoubleArray(ElemData, "T1"); check_error();
         T2 = atGetOptionalDoubleArray(ElemData, "T2"); check_error();
 
-        Elem = (struct elem*)atMalloc(sizeof(struct elem));
+        /* Energy is defined in the lattice in eV but GeV is used by the gwig code. */
+        zEndPoint[0] = 0;
+        zEndPoint[1] = Ltot;
+        GWigInit(&Wig, Energy/1e9, Ltot, Lw, Bmax, Nstep, Nmeth, NHharm, NVharm,
+                0, 0, zEndPoint, zEndPoint, By, Bx, T1, T2, R1, R2);
+        Elem = (struct elem*)atMalloc(sizeof(struct elem) +
+                GWigTableSize(&Wig)*sizeof(double));
+        Elem->Wig = Wig;
+        GWigSetTables(&Elem->Wig, (double *)(Elem+1));
         Elem->Energy=Energy;
         Elem->Length=Ltot;
         Elem->Lw=Lw;
@@ -209,11 +229,8 @@ ExportMode struct elem *trackFunction(const atElem *ElemData,struct elem *Elem,
         Elem->T1=T1;
         Elem->T2=T2;
     }
-    GWigSymplecticRadPass(r_in, Elem->Energy, Elem->Length, Elem->Lw,
-            Elem->Bmax, Elem->Nstep, Elem->Nmeth, Elem->NHharm, Elem->NVharm,
-            Elem->By, Elem->Bx, Elem->T1, Elem->T2, Elem->R1, Elem->R2,
-            num_particles);
-  return Elem;
+    GWigSymplecticRadPass(r_in, &Elem->Wig, num_particles);
+    return Elem;
 }
 
 /********** END WINDOWS DLL GATEWAY SECTION **********************************/
@@ -236,6 +253,8 @@ void mexFunction(       int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs
         double Ltot, Lw, Bmax, Energy;
         int Nstep, Nmeth;
         int NHharm, NVharm;
+        double zEndPoint[2];
+        struct gwigR Wig;
 
         Energy = atGetDouble(ElemData, "Energy"); check_error();
         Ltot = atGetDouble(ElemData, "Length"); check_error();
@@ -252,12 +271,18 @@ void mexFunction(       int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs
         R2 = atGetOptionalDoubleArray(ElemData, "R2"); check_error();
         T1 = atGetOptionalDoubleArray(ElemData, "T1"); check_error();
         T2 = atGetOptionalDoubleArray(ElemData, "T2"); check_error();
+        /* Energy is defined in the lattice in eV but GeV is used by the gwig code. */
+        zEndPoint[0] = 0;
+        zEndPoint[1] = Ltot;
+        GWigInit(&Wig, Energy/1e9, Ltot, Lw, Bmax, Nstep, Nmeth, NHharm, NVharm,
+                0, 0, zEndPoint, zEndPoint, By, Bx, T1, T2, R1, R2);
         if (mxGetM(prhs[1]) != 6) mexErrMsgIdAndTxt("AT:WrongArg","Second argument must be a 6 x N matrix");
+        GWigSetTables(&Wig, (double *)atMalloc(GWigTableSize(&Wig)*sizeof(double)));
         /* ALLOCATE memory for the output array of the same size as the input  */
         plhs[0] = mxDuplicateArray(prhs[1]);
         r_in = mxGetDoubles(plhs[0]);
-        GWigSymplecticRadPass(r_in, Energy, Ltot, Lw, Bmax, Nstep, Nmeth,
-            NHharm, NVharm, By, Bx, T1, T2, R1, R2, num_particles);
+        GWigSymplecticRadPass(r_in, &Wig, num_particles);
+        atFree(Wig.SinZ);
     }
     else if (nrhs == 0) {
         /* list of required fields */
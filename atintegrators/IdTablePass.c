@@ -30,29 +30,80 @@ struct elem {
     double *R2;
     double *T1;
     double *T2;
+    int InterpolationOrder;
+    /* Equally spaced table coordinates */
+    int x_uniform;
+    int y_uniform;
+    /* Bicubic spline coefficients (InterpolationOrder 3) */
+    double *xkick_c;
+    double *ykick_c;
+    double *xkick1_c;
+    double *ykick1_c;
 };
 
-double *GLOBAL_x_map, *GLOBAL_y_map;
-int GLOBAL_nx_map,GLOBAL_ny_map;
-
-static double get_kick(double *r6, double *ktable)
+static double get_kick(double *ktable, double *kcoef, int ny_map, struct lincell *cell)
 {
-    double f;
-    /*cubic interpolation*/
-    /*splin2(GLOBAL_y_map,GLOBAL_x_map,GLOBAL_xkick,GLOBAL_xkick2,GLOBAL_n,GLOBAL_nx,y,x,&f);*/
-    
-    /*biliniar interpolation*/
     /* Transpose coordinates because the kick-table is FORTRAN-ordered */
-    linint(GLOBAL_y_map, GLOBAL_x_map, ktable, GLOBAL_ny_map, GLOBAL_nx_map, r6[2], r6[0], &f);
-    return f;
- }
+    if (kcoef)
+        return bicubic_eval(kcoef, ny_map, cell);   /*cubic interpolation*/
+    else
+        return linint_eval(ktable, ny_map, cell);   /*biliniar interpolation*/
+}
+
+static size_t spline_size(struct elem *Elem)
+/* Size of the spline coefficient tables */
+{
+    int ntables = 2 + (Elem->xkick1 ? 1 : 0) + (Elem->ykick1 ? 1 : 0);
+    if (Elem->InterpolationOrder != 3) return 0;
+    return ntables*16*(Elem->nx_map-1)*(Elem->ny_map-1)*sizeof(double);
+}
+
+static void init_splines(struct elem *Elem, double *buffer)
+/* Compute the spline coefficients in buffer, of size spline_size(Elem) */
+{
+    size_t ncoef = 16*(Elem->nx_map-1)*(Elem->ny_map-1);
+    double *tables[4];
+    double **coefs[4];
+    int i;
+    tables[0] = Elem->xkick; coefs[0] = &Elem->xkick_c;
+    tables[1] = Elem->ykick; coefs[1] = &Elem->ykick_c;
+    tables[2] = Elem->xkick1; coefs[2] = &Elem->xkick1_c;
+    tables[3] = Elem->ykick1; coefs[3] = &Elem->ykick1_c;
+    for (i=0; i<4; i++) {
+        if (buffer && tables[i]) {
+            bicubic_coefficients(Elem->y_map, Elem->x_map, tables[i], Elem->ny_map, Elem->nx_map, buffer);
+            *coefs[i] = buffer;
+            buffer += ncoef;
+        }
+        else
+            *coefs[i] = NULL;
+    }
+}
 
-void IdKickMapModelPass(double *r, double le, double *xkick1, double *ykick1,
-        double *xkick, double *ykick, double *x_map, double *y_map,int nx_map,int ny_map, int Nslice,
-        double *T1, double *T2, double *R1, double *R2, int num_particles)
+void IdKickMapModelPass(double *r, struct elem *Elem, int num_particles)
 {
-    double *r6, deltaxp, deltayp, limitsptr[4];
-    int c, ns;
+    double le = Elem->Length;
+    double *xkick = Elem->xkick;
+    double *ykick = Elem->ykick;
+    double *xkick1 = Elem->xkick1;
+    double *ykick1 = Elem->ykick1;
+    double *xkick_c = Elem->xkick_c;
+    double *ykick_c = Elem->ykick_c;
+    double *xkick1_c = Elem->xkick1_c;
+    double *ykick1_c = Elem->ykick1_c;
+    double *x_map = Elem->x_map;
+    double *y_map = Elem->y_map;
+    int nx_map = Elem->nx_map;
+    int ny_map = Elem->ny_map;
+    int Nslice = Elem->Nslice;
+    int x_uniform = Elem->x_uniform;
+    int y_uniform = Elem->y_uniform;
+    double *T1 = Elem->T1;
+    double *T2 = Elem->T2;
+    double *R1 = Elem->R1;
+    double *R2 = Elem->R2;
+    double limitsptr[4];
+    int c;
     double L1 = le/(2*Nslice);
     
     /*Act as AperturePass*/
@@ -61,15 +112,13 @@ void IdKickMapModelPass(double *r, double le, double *xkick1, double *ykick1,
     limitsptr[2]=y_map[0];
     limitsptr[3]=y_map[ny_map-1];
     
-    /*globalize*/    
-    GLOBAL_x_map=x_map;
-    GLOBAL_y_map=y_map;
-    GLOBAL_nx_map=nx_map;
-    GLOBAL_ny_map=ny_map;
-    
+    #ifdef _OPENMP
+    #pragma omp parallel for if (num_particles > OMP_PARTICLE_THRESHOLD) default(shared) shared(r,num_particles) private(c)
+    #endif /*_OPENMP*/
     for (c=0; c<num_particles; c++) {
-        r6 = r+c*6;
+        double *r6 = r+c*6;
         if (!atIsNaN(r6[0])) {
+            int ns;
             /* Misalignment at entrance */
             if (T1) ATaddvv(r6,T1);
             if (R1) ATmultmv(r6,R1);
@@ -79,11 +128,21 @@ void IdKickMapModelPass(double *r, double le, double *xkick1, double *ykick1,
             for (ns=0; ns<Nslice; ns++) { /* Loop over slices*/
                 ATdrift6(r6,L1);
                 if (!atIsNaN(r6[0])&&!atIsNaN(r6[2])) {
-                    /*The kick from IDs varies quadratically, not linearly, with energy.   */
-                    deltaxp = get_kick(r6, xkick)/(1.0+r6[4]);
-                    deltayp = get_kick(r6, ykick)/(1.0+r6[4]);
-                    if (xkick1)  deltaxp += get_kick(r6, xkick1);
-                    if (ykick1)  deltayp += get_kick(r6, ykick1);
+                    /* The same cell is used for all the kick tables */
+                    struct lincell cell;
+                    double deltaxp, deltayp;
+                    if (linint_locate(y_map, x_map, ny_map, nx_map, y_uniform, x_uniform,
+                                      r6[2], r6[0], &cell)) {
+                        /*The kick from IDs varies quadratically, not linearly, with energy.   */
+                        deltaxp = get_kick(xkick, xkick_c, ny_map, &cell)/(1.0+r6[4]);
+                        deltayp = get_kick(ykick, ykick_c, ny_map, &cell)/(1.0+r6[4]);
+                        if (xkick1)  deltaxp += get_kick(xkick1, xkick1_c, ny_map, &cell);
+                        if (ykick1)  deltayp += get_kick(ykick1, ykick1_c, ny_map, &cell);
+                    }
+                    else {
+                        deltaxp = atGetNaN();
+                        deltayp = atGetNaN();
+                    }
                     r6[1] = r6[1] + deltaxp / Nslice;
                     r6[3] = r6[3] + deltayp / Nslice;
                 }
@@ -101,10 +160,12 @@ ExportMode struct elem *trackFunction(const atElem *ElemData,struct elem *Elem,
         double *r_in, int num_particles, struct parameters *Param)
 {
     if (!Elem) {
-        int Nslice, ny_map,nx_map;
+        int Nslice, ny_map,nx_map,InterpolationOrder;
         double Length, *xkick, *ykick, *x_map, *y_map;
         double *xkick1, *ykick1;
         double *R1, *R2, *T1, *T2;
+        struct elem El;
+        size_t spsize;
         Length=atGetDouble(ElemData,"Length"); check_error();
         xkick=atGetDoubleArraySz(ElemData,"xkick", &ny_map, &nx_map); check_error();
         /* the third input of atGetDoubleArraySz is a pointer for the 
@@ -122,25 +183,36 @@ ExportMode struct elem *trackFunction(const atElem *ElemData,struct elem *Elem,
         R2=atGetOptionalDoubleArray(ElemData,"R2"); check_error();
         T1=atGetOptionalDoubleArray(ElemData,"T1"); check_error();
         T2=atGetOptionalDoubleArray(ElemData,"T2"); check_error();
-        Elem = (struct elem*)atMalloc(sizeof(struct elem));
-        Elem->Length=Length;
-        Elem->xkick=xkick;
-        Elem->ykick=ykick;
-        Elem->x_map=x_map;
-        Elem->y_map=y_map;
-        Elem->nx_map=nx_map;
-        Elem->ny_map=ny_map;
-        Elem->Nslice=Nslice;
-        Elem->xkick1=xkick1;
-        Elem->ykick1=ykick1;
-        Elem->R1=R1;
-        Elem->R2=R2;
-        Elem->T1=T1;
-        Elem->T2=T2;
+        InterpolationOrder=atGetOptionalLong(ElemData,"InterpolationOrder",1); check_error();
+        if (InterpolationOrder != 1 && InterpolationOrder != 3)
+            atError("IdTablePass: InterpolationOrder must be 1 (bilinear) or 3 (bicubic spline)");
+        if (nx_map < 2 || ny_map < 2)
+            atError("IdTablePass: the kick tables must have at least 2 points on each axis");
+        El.Length=Length;
+        El.xkick=xkick;
+        El.ykick=ykick;
+        El.x_map=x_map;
+        El.y_map=y_map;
+        El.nx_map=nx_map;
+        El.ny_map=ny_map;
+        El.Nslice=Nslice;
+        El.xkick1=xkick1;
+        El.ykick1=ykick1;
+        El.R1=R1;
+        El.R2=R2;
+        El.T1=T1;
+        El.T2=T2;
+        El.InterpolationOrder=InterpolationOrder;
+        El.x_uniform=grid_is_uniform(x_map, nx_map);
+        El.y_uniform=grid_is_uniform(y_map, ny_map);
+        /* The spline coefficients are stored after the element, so that
+           they are released with it */
+        spsize = spline_size(&El);
+        Elem = (struct elem*)atMalloc(sizeof(struct elem)+spsize);
+        *Elem = El;
+        init_splines(Elem, spsize ? (double *)(Elem+1) : NULL);
     }
-    IdKickMapModelPass(r_in, Elem->Length, Elem->xkick1, Elem->ykick1,
-            Elem->xkick, Elem->ykick, Elem->x_map, Elem->y_map, Elem->nx_map, Elem->ny_map,Elem->Nslice,
-            Elem->T1, Elem->T2, Elem->R1, Elem->R2, num_particles);
+    IdKickMapModelPass(r_in, Elem, num_particles);
     return Elem;
 }
 
@@ -154,10 +226,13 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
         double *r_in;
         const mxArray *ElemData = prhs[0];
         int num_particles = mxGetN(prhs[1]);
-        int Nslice, ny_map, nx_map;
+        int Nslice, ny_map, nx_map, InterpolationOrder;
         double Length, *xkick, *ykick, *x_map, *y_map;
         double *xkick1, *ykick1;
         double *R1, *R2, *T1, *T2;
+        double *splines = NULL;
+        size_t spsize;
+        struct elem El, *Elem=&El;
         Length=atGetDouble(ElemData,"Length"); check_error();
         xkick=atGetDoubleArraySz(ElemData,"xkick", &ny_map, &nx_map); check_error();
         /* the third input of atGetDoubleArraySz is a pointer for the 
@@ -175,11 +250,36 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
         R2=atGetOptionalDoubleArray(ElemData,"R2"); check_error();
         T1=atGetOptionalDoubleArray(ElemData,"T1"); check_error();
         T2=atGetOptionalDoubleArray(ElemData,"T2"); check_error();
+        InterpolationOrder=atGetOptionalLong(ElemData,"InterpolationOrder",1); check_error();
+        if (InterpolationOrder != 1 && InterpolationOrder != 3)
+            mexErrMsgIdAndTxt("AT:WrongArg","InterpolationOrder must be 1 (bilinear) or 3 (bicubic spline)");
+        if (nx_map < 2 || ny_map < 2)
+            mexErrMsgIdAndTxt("AT:WrongArg","The kick tables must have at least 2 points on each axis");
+        Elem->Length=Length;
+        Elem->xkick=xkick;
+        Elem->ykick=ykick;
+        Elem->x_map=x_map;
+        Elem->y_map=y_map;
+        Elem->nx_map=nx_map;
+        Elem->ny_map=ny_map;
+        Elem->Nslice=Nslice;
+        Elem->xkick1=xkick1;
+        Elem->ykick1=ykick1;
+        Elem->R1=R1;
+        Elem->R2=R2;
+        Elem->T1=T1;
+        Elem->T2=T2;
+        Elem->InterpolationOrder=InterpolationOrder;
+        Elem->x_uniform=grid_is_uniform(x_map, nx_map);
+        Elem->y_uniform=grid_is_uniform(y_map, ny_map);
+        spsize = spline_size(Elem);
+        if (spsize) splines = (double *)atMalloc(spsize);
+        init_splines(Elem, splines);
         /* ALLOCATE memory for the output array of the same size as the input  */
         plhs[0] = mxDuplicateArray(prhs[1]);
         r_in = mxGetDoubles(plhs[0]);
-        IdKickMapModelPass(r_in, Length, xkick1, ykick1, xkick, ykick, x_map, y_map,
-                nx_map, ny_map, Nslice, T1, T2, R1, R2, num_particles);
+        IdKickMapModelPass(r_in, Elem, num_particles);
+        if (splines) atFree(splines);
     }
     else if (nrhs == 0) {
         /* return list of required fields */
@@ -193,13 +293,14 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
         
         if (nlhs > 1) {
             /* Required and optional fields */
-            plhs[1] = mxCreateCellMatrix(6,1);
+            plhs[1] = mxCreateCellMatrix(7,1);
             mxSetCell(plhs[1],0,mxCreateString("xkick1"));
             mxSetCell(plhs[1],1,mxCreateString("ykick1"));
             mxSetCell(plhs[1],2,mxCreateString("T1"));
             mxSetCell(plhs[1],3,mxCreateString("T2"));
             mxSetCell(plhs[1],4,mxCreateString("R1"));
             mxSetCell(plhs[1],5,mxCreateString("R2"));
+            mxSetCell(plhs[1],6,mxCreateString("InterpolationOrder"));
         }
     }
     else {
@@ -6,6 +6,8 @@
 
 #include "atelem.c"
 #include "atlalib.c"
+#include "driftkick.c"	/* soa_load, soa_store */
+#include "atdual.c"
 
 struct elem 
 {
@@ -33,8 +35,7 @@ void IdentityPass(double *r_in,
             if (T1) ATaddvv(r6, T1);
             if (R1) ATmultmv(r6, R1);
 			/* Check physical apertures */
-			if (limits) checkiflostRectangularAp(r6,limits);
-			if (axesptr) checkiflostEllipticalAp(r6,axesptr);
+			checkiflostAperture(r6,limits,axesptr);
             /* Misalignment at exit */
             if (R2) ATmultmv(r6, R2);
             if (T2) ATaddvv(r6, T2);
@@ -42,31 +43,102 @@ void IdentityPass(double *r_in,
     }
 }
 
+void IdentityPassSoA(double *r_in,
+        const double *T1, const double *T2,
+        const double *R1, const double *R2,
+        const double *limits, const double *axesptr,
+        int num_particles)
+/* Same as IdentityPass for the structure-of-arrays layout */
+{
+    int c;
+
+    if (T1 || T2 || R1 || R2 || limits || axesptr) {
+        for (c = 0; c<num_particles; c++) {	/*Loop over particles  */
+            double r6[6];
+            soa_load(r6, r_in+c, num_particles);
+            if (!atIsNaN(r6[0])) {
+                if (T1) ATaddvv(r6, T1);
+                if (R1) ATmultmv(r6, R1);
+                checkiflostAperture(r6,limits,axesptr);
+                if (R2) ATmultmv(r6, R2);
+                if (T2) ATaddvv(r6, T2);
+                soa_store(r_in+c, r6, num_particles);
+            }
+        }
+    }
+}
+
+void IdentityPassTangent(atdual *r_in,
+        const double *T1, const double *T2,
+        const double *R1, const double *R2,
+        const double *limits, const double *axesptr,
+        int num_particles)
+/* Same as IdentityPass for tangent particles */
+{
+    int c;
+    for (c = 0; c<num_particles; c++) {
+        atdual *r6 = r_in+c*6;
+        if (!atIsNaN(r6[0].v)) {
+            if (T1) dual_addvv(r6, T1);
+            if (R1) dual_multmv(r6, R1);
+            dual_checkaperture(r6, limits, axesptr);
+            if (R2) dual_multmv(r6, R2);
+            if (T2) dual_addvv(r6, T2);
+        }
+    }
+}
+
 #if defined(MATLAB_MEX_FILE) || defined(PYAT)
+static struct elem *init_elem(const atElem *ElemData)
+{
+    struct elem *Elem;
+    double *R1, *R2, *T1, *T2, *EApertures, *RApertures;
+    R1=atGetOptionalDoubleArray(ElemData,"R1"); check_error();
+    R2=atGetOptionalDoubleArray(ElemData,"R2"); check_error();
+    T1=atGetOptionalDoubleArray(ElemData,"T1"); check_error();
+    T2=atGetOptionalDoubleArray(ElemData,"T2"); check_error();
+    EApertures=atGetOptionalDoubleArray(ElemData,"EApertures"); check_error();
+    RApertures=atGetOptionalDoubleArray(ElemData,"RApertures"); check_error();
+    Elem = (struct elem*)atMalloc(sizeof(struct elem));
+    Elem->R1=R1;
+    Elem->R2=R2;
+    Elem->T1=T1;
+    Elem->T2=T2;
+    Elem->EApertures=EApertures;
+    Elem->RApertures=RApertures;
+    return Elem;
+}
+
 ExportMode struct elem *trackFunction(const atElem *ElemData,struct elem *Elem,
         double *r_in, int num_particles, struct parameters *Param)
 {
-    if (!Elem) {
-        double *R1, *R2, *T1, *T2, *EApertures, *RApertures;
-        R1=atGetOptionalDoubleArray(ElemData,"R1"); check_error();
-        R2=atGetOptionalDoubleArray(ElemData,"R2"); check_error();
-        T1=atGetOptionalDoubleArray(ElemData,"T1"); check_error();
-        T2=atGetOptionalDoubleArray(ElemData,"T2"); check_error();
-        EApertures=atGetOptionalDoubleArray(ElemData,"EApertures"); check_error();
-        RApertures=atGetOptionalDoubleArray(ElemData,"RApertures"); check_error();
-        Elem = (struct elem*)atMalloc(sizeof(struct elem));
-        Elem->R1=R1;
-        Elem->R2=R2;
-        Elem->T1=T1;
-        Elem->T2=T2;
-        Elem->EApertures=EApertures;
-        Elem->RApertures=RApertures;
-    }
+    if (!Elem) Elem = init_elem(ElemData);
+    if (!Elem) return NULL;
     IdentityPass(r_in,Elem->T1,Elem->T2,Elem->R1,Elem->R2,
             Elem->RApertures,Elem->EApertures,num_particles);
     return Elem;
 }
 
+ExportMode struct elem *trackFunctionSoA(const atElem *ElemData,struct elem *Elem,
+        double *r_in, int num_particles, struct parameters *Param)
+{
+    if (!Elem) Elem = init_elem(ElemData);
+    if (!Elem) return NULL;
+    IdentityPassSoA(r_in,Elem->T1,Elem->T2,Elem->R1,Elem->R2,
+            Elem->RApertures,Elem->EApertures,num_particles);
+    return Elem;
+}
+
+ExportMode struct elem *trackFunctionTangent(const atElem *ElemData,struct elem *Elem,
+        double *r_in, int num_particles, struct parameters *Param)
+{
+    if (!Elem) Elem = init_elem(ElemData);
+    if (!Elem) return NULL;
+    IdentityPassTangent((atdual *)r_in,Elem->T1,Elem->T2,Elem->R1,Elem->R2,
+            Elem->RApertures,Elem->EApertures,num_particles);
+    return Elem;
+}
+
 MODULE_DEF(IdentityPass)        /* Dummy module initialisation */
 
 #endif /*defined(MATLAB_MEX_FILE) || defined(PYAT)*/
@@ -1,12 +1,27 @@
 #include "atelem.c"
+#include "atfft.c"
 #include <math.h>
 #include <float.h>
 
 /*
  * Impedance pass method by Simon White.  
  * 
+ * The kicks are computed from the wake tables WakeT, WakeDX... or, if the
+ * ImpedanceF frequency table is given, directly from the impedance tables
+ * ImpedanceDXRe, ImpedanceDXIm... In that case the slice moments are
+ * transformed by FFT, multiplied by the impedance interpolated on the FFT
+ * grid and transformed back. The wake kernels are computed on a grid
+ * ImpedancePadding times (default 8, rounded to a power of 2) longer than
+ * twice the bunch length: the wake must decay within this length.
+ *
+ * The impedances are related to the wakes, function of the delay
+ * t = ct/c behind the source, by
+ *      Z(w) = int(W(t) exp(-iwt) dt)        longitudinal, [Ohm]
+ *      Z(w) = i int(W(t) exp(-iwt) dt)      transverse, [Ohm/m]
  */
 
+#define C0  2.99792458e8
+
 struct elem
 {
   int nslice;
@@ -22,6 +37,14 @@ struct elem
   double *waketableQX;
   double *waketableQY;
   double *waketableZ;
+  int nfreq;
+  int padding;
+  double *freqtable;        /* NULL for the wake tables */
+  double *imptableDX[2];    /* real and imaginary parts */
+  double *imptableDY[2];
+  double *imptableQX[2];
+  double *imptableQY[2];
+  double *imptableZ[2];
 };
 
 
@@ -36,7 +59,7 @@ double getWake(double *waketable,double *waketableT,double distance,int index){
 };
 
 
-int binarySearch(double *array,double value,int upper,int lower,int nStep){
+static int binarySearch(double *array,double value,int upper,int lower,int nStep){
     int pivot = (int)(lower+upper)/2;
     if ((upper-lower)<=1){
         return lower;
@@ -55,6 +78,163 @@ int binarySearch(double *array,double value,int upper,int lower,int nStep){
 };
 
 
+static void impedance_kernel(double *kre, double *kim, unsigned int nfft, int nk, double dt,
+        double *freqtable, int nfreq, double **imptable, int transverse){
+    /*
+     * Real wake kernel at the delays n*dt, n=0..nk-1, computed from the
+     * impedance table: W(t) = 1/2pi int(Z(w) exp(iwt) dw) (longitudinal) or
+     * W(t) = -i/2pi int(Z(w) exp(iwt) dw) (transverse). The impedance is
+     * interpolated on the frequencies k/(nfft*dt) by walking along the table,
+     * it is 0 outside the table. The computed wake is periodic, of period
+     * nfft*dt, so nfft must be large enough for the wake to decay within a
+     * period. The kernel is 0 for n >= nk.
+     */
+    unsigned int k, n;
+    int index = 0;
+    double df = 1.0/(nfft*dt);
+    double fmin = freqtable[0];
+    double fmax = freqtable[nfreq-1];
+    for (k=0;k<=nfft/2;k++) {
+        double f = k*df;
+        double zr = 0.0, zi = 0.0;
+        if (f >= fmin && f <= fmax) {
+            double u;
+            while (index < nfreq-2 && freqtable[index+1] <= f) index++;
+            u = (f-freqtable[index])/(freqtable[index+1]-freqtable[index]);
+            if (imptable[0]) zr = imptable[0][index] + u*(imptable[0][index+1]-imptable[0][index]);
+            if (imptable[1]) zi = imptable[1][index] + u*(imptable[1][index+1]-imptable[1][index]);
+        }
+        if (transverse) {   /* -i*Z */
+            kre[k] = zi/dt;
+            kim[k] = -zr/dt;
+        }
+        else {
+            kre[k] = zr/dt;
+            kim[k] = zi/dt;
+        }
+    }
+    /* Hermitian spectrum of a real kernel */
+    kim[0] = 0.0;
+    kim[nfft/2] = 0.0;
+    for (k=1;k<nfft/2;k++) {
+        kre[nfft-k] = kre[k];
+        kim[nfft-k] = -kim[k];
+    }
+    atfft(kre,kim,nfft,1);
+    for (n=0;n<nfft;n++) {
+        if (n >= (unsigned int)nk) kre[n] = 0.0;
+        kim[n] = 0.0;
+    }
+}
+
+
+static void convolve_impedance(double *fre, double *fim, double *kre, double *kim,
+        unsigned int nfft, unsigned int nz, int nk, double dt, double *freqtable,
+        int nfreq, double **imptable, int transverse){
+    /* Convolution of the transformed source fre + i*fim with the kernel of
+       the impedance table, computed on nz >= nfft points. The result is
+       stored in kre + i*kim. Since the kernel is real, the real and imaginary
+       parts of the result are independent convolutions */
+    unsigned int n;
+    impedance_kernel(kre,kim,nz,nk,dt,freqtable,nfreq,imptable,transverse);
+    atfft(kre,kim,nfft,0);
+    for (n=0;n<nfft;n++) {
+        double ar = fre[n]*kre[n]-fim[n]*kim[n];
+        double ai = fre[n]*kim[n]+fim[n]*kre[n];
+        kre[n] = ar;
+        kim[n] = ai;
+    }
+    atfft(kre,kim,nfft,1);
+}
+
+
+static double interp_grid(double *c, unsigned int nfft, double u){
+    /* Linear interpolation of c at the fractional index u */
+    int m = (int)floor(u);
+    double f = u-m;
+    double v = 0.0;
+    if (m>=0 && m<(int)nfft) v += (1.0-f)*c[m];
+    if (m+1>=0 && m+1<(int)nfft) v += f*c[m+1];
+    return v;
+}
+
+
+static void impedance_kicks(int nslice, double smin, double hz, double *weight,
+        double *xpos, double *ypos, double *zpos, int *countslc, struct elem *Elem,
+        double *kx, double *ky, double *kx2, double *ky2, double *kz){
+    /*
+     * Kicks of the impedance tables. The slice moments are deposited by
+     * linear weighting on a grid of step hz, from smin. The kernels are
+     * needed for the delays 0 to ns-1 grid steps, and the transforms are
+     * padded to avoid the circular wrap-around. The kernels are computed
+     * on Elem->padding times more points, to limit their aliasing.
+     */
+    int i;
+    int ns = nslice+2;
+    unsigned int n, nfft = atfft_size(2*ns-1);
+    unsigned int nz = nfft*Elem->padding;
+    double dt = hz/C0;
+    double *buffer, *sre, *sim, *qre, *qim, *kre, *kim;
+
+    if (!(hz > 0.0)) return;    /* no slices: the kicks are 0 */
+    buffer = atMalloc((4*nfft+2*nz)*sizeof(double));
+    sre = buffer;           /* w*x + i w*y */
+    sim = sre + nfft;
+    qre = sim + nfft;       /* w */
+    qim = qre + nfft;
+    kre = qim + nfft;
+    kim = kre + nz;
+    for (n=0;n<nfft;n++) {
+        sre[n]=0.0;
+        sim[n]=0.0;
+        qre[n]=0.0;
+        qim[n]=0.0;
+    }
+    for (i=0;i<nslice;i++) {
+        if (countslc[i]>0) {
+            double u = (zpos[i]-smin)/hz;
+            int k = (int)floor(u);
+            double f = u-k;
+            sre[k] += (1.0-f)*weight[i]*xpos[i];
+            sre[k+1] += f*weight[i]*xpos[i];
+            sim[k] += (1.0-f)*weight[i]*ypos[i];
+            sim[k+1] += f*weight[i]*ypos[i];
+            qre[k] += (1.0-f)*weight[i];
+            qre[k+1] += f*weight[i];
+        }
+    }
+    atfft(sre,sim,nfft,0);
+    atfft(qre,qim,nfft,0);
+
+    if (Elem->imptableDX[0] || Elem->imptableDX[1]) {
+        convolve_impedance(sre,sim,kre,kim,nfft,nz,ns,dt,Elem->freqtable,Elem->nfreq,Elem->imptableDX,1);
+        for (i=0;i<nslice;i++)
+            if (countslc[i]>0) kx[i] = Elem->fx*interp_grid(kre,nfft,(zpos[i]-smin)/hz);
+    }
+    if (Elem->imptableDY[0] || Elem->imptableDY[1]) {
+        convolve_impedance(sre,sim,kre,kim,nfft,nz,ns,dt,Elem->freqtable,Elem->nfreq,Elem->imptableDY,1);
+        for (i=0;i<nslice;i++)
+            if (countslc[i]>0) ky[i] = Elem->fy*interp_grid(kim,nfft,(zpos[i]-smin)/hz);
+    }
+    if (Elem->imptableQX[0] || Elem->imptableQX[1]) {
+        convolve_impedance(qre,qim,kre,kim,nfft,nz,ns,dt,Elem->freqtable,Elem->nfreq,Elem->imptableQX,1);
+        for (i=0;i<nslice;i++)
+            if (countslc[i]>0) kx2[i] = Elem->fqx*interp_grid(kre,nfft,(zpos[i]-smin)/hz);
+    }
+    if (Elem->imptableQY[0] || Elem->imptableQY[1]) {
+        convolve_impedance(qre,qim,kre,kim,nfft,nz,ns,dt,Elem->freqtable,Elem->nfreq,Elem->imptableQY,1);
+        for (i=0;i<nslice;i++)
+            if (countslc[i]>0) ky2[i] = Elem->fqy*interp_grid(kre,nfft,(zpos[i]-smin)/hz);
+    }
+    if (Elem->imptableZ[0] || Elem->imptableZ[1]) {
+        convolve_impedance(qre,qim,kre,kim,nfft,nz,ns,dt,Elem->freqtable,Elem->nfreq,Elem->imptableZ,0);
+        for (i=0;i<nslice;i++)
+            if (countslc[i]>0) kz[i] = Elem->fz*interp_grid(kre,nfft,(zpos[i]-smin)/hz);
+    }
+    atFree(buffer);
+}
+
+
 void impedance_tablePass(double *r_in,int num_particles, struct elem *Elem){
     
     /*
@@ -199,7 +379,9 @@ void impedance_tablePass(double *r_in,int num_particles, struct elem *Elem){
     
     /*FILE *pFile = fopen ("./tmp","w");*/
     
-    for(i=0;i<nslice;i++){        
+    if (Elem->freqtable)
+        impedance_kicks(nslice,smin,hz,weight,xpos,ypos,zpos,countslc,Elem,kx,ky,kx2,ky2,kz);
+    else for(i=0;i<nslice;i++){        
         register double pos0 = zpos[i];
         if(countslc[i]>0.0){
           for (ii=0;ii<nslice;ii++){
@@ -243,57 +425,98 @@ void impedance_tablePass(double *r_in,int num_particles, struct elem *Elem){
 
 
 #if defined(MATLAB_MEX_FILE) || defined(PYAT)
-ExportMode struct elem *trackFunction(const atElem *ElemData,struct elem *Elem,
-        double *r_in, int num_particles, struct parameters *Param)
+static struct elem *init_elem(const atElem *ElemData, struct elem *Elem)
 {
-    if (!Elem) {
-        long nslice,nelem;
-        double on_x,on_y,on_qx,on_qy,on_z;
-        double intensity, wakefact, normfactx,normfacty;
-        double *waketableT;
-        double *waketableDX;
-        double *waketableDY;
-        double *waketableQX;
-        double *waketableQY;
-        double *waketableZ;
-        
-        nslice=atGetLong(ElemData,"Nslice"); check_error();
+    long nslice,nelem;
+    double on_x,on_y,on_qx,on_qy,on_z;
+    double intensity, wakefact, normfactx,normfacty;
+    double *waketableT;
+    double *waketableDX;
+    double *waketableDY;
+    double *waketableQX;
+    double *waketableQY;
+    double *waketableZ;
+    double *freqtable;
+    int msz, nsz, nfreq, padding;
+
+    nslice=atGetLong(ElemData,"Nslice"); check_error();
+    on_x=atGetDouble(ElemData,"On_x"); check_error();
+    on_y=atGetDouble(ElemData,"On_y"); check_error();
+    on_qx=atGetDouble(ElemData,"On_qx"); check_error();
+    on_qy=atGetDouble(ElemData,"On_qy"); check_error();
+    on_z=atGetDouble(ElemData,"On_z"); check_error();
+    intensity=atGetDouble(ElemData,"Intensity"); check_error();
+    wakefact=atGetDouble(ElemData,"Wakefact"); check_error();
+    normfactx=atGetDouble(ElemData,"Normfactx"); check_error();
+    normfacty=atGetDouble(ElemData,"Normfacty"); check_error();
+    freqtable=atGetOptionalDoubleArraySz(ElemData,"ImpedanceF",&msz,&nsz); check_error();
+    if (freqtable) {
+        /* impedance tables: the wake tables are ignored */
+        nfreq=msz*nsz;
+        if (nfreq < 2) {
+            atError("ImpedanceF must have at least 2 frequencies"); check_error();
+        }
+        padding=atGetOptionalLong(ElemData,"ImpedancePadding",8); check_error();
+        padding=atfft_size(padding > 1 ? padding : 1);
+        nelem=0;
+        waketableT=waketableDX=waketableDY=waketableQX=waketableQY=waketableZ=NULL;
+        Elem->imptableDX[0]=atGetOptionalDoubleArray(ElemData,"ImpedanceDXRe"); check_error();
+        Elem->imptableDX[1]=atGetOptionalDoubleArray(ElemData,"ImpedanceDXIm"); check_error();
+        Elem->imptableDY[0]=atGetOptionalDoubleArray(ElemData,"ImpedanceDYRe"); check_error();
+        Elem->imptableDY[1]=atGetOptionalDoubleArray(ElemData,"ImpedanceDYIm"); check_error();
+        Elem->imptableQX[0]=atGetOptionalDoubleArray(ElemData,"ImpedanceQXRe"); check_error();
+        Elem->imptableQX[1]=atGetOptionalDoubleArray(ElemData,"ImpedanceQXIm"); check_error();
+        Elem->imptableQY[0]=atGetOptionalDoubleArray(ElemData,"ImpedanceQYRe"); check_error();
+        Elem->imptableQY[1]=atGetOptionalDoubleArray(ElemData,"ImpedanceQYIm"); check_error();
+        Elem->imptableZ[0]=atGetOptionalDoubleArray(ElemData,"ImpedanceZRe"); check_error();
+        Elem->imptableZ[1]=atGetOptionalDoubleArray(ElemData,"ImpedanceZIm"); check_error();
+    }
+    else {
+        nfreq=0;
+        padding=1;
         nelem=atGetLong(ElemData,"Nelem"); check_error();
-        on_x=atGetDouble(ElemData,"On_x"); check_error();
-        on_y=atGetDouble(ElemData,"On_y"); check_error();
-        on_qx=atGetDouble(ElemData,"On_qx"); check_error();
-        on_qy=atGetDouble(ElemData,"On_qy"); check_error();
-        on_z=atGetDouble(ElemData,"On_z"); check_error();
-        intensity=atGetDouble(ElemData,"Intensity"); check_error();
-        wakefact=atGetDouble(ElemData,"Wakefact"); check_error();
-        normfactx=atGetDouble(ElemData,"Normfactx"); check_error();
-        normfacty=atGetDouble(ElemData,"Normfacty"); check_error();
         waketableT=atGetDoubleArray(ElemData,"WakeT"); check_error();
         waketableDX=atGetDoubleArray(ElemData,"WakeDX"); check_error();
         waketableDY=atGetDoubleArray(ElemData,"WakeDY"); check_error();
         waketableQX=atGetDoubleArray(ElemData,"WakeQX"); check_error();
         waketableQY=atGetDoubleArray(ElemData,"WakeQY"); check_error();
         waketableZ=atGetDoubleArray(ElemData,"WakeZ"); check_error();
-        
+    }
+
+    Elem->nslice=nslice;
+    Elem->nelem=nelem;
+    Elem->fx=intensity*wakefact*normfactx*on_x;
+    Elem->fy=intensity*wakefact*normfacty*on_y;
+    Elem->fqx=intensity*wakefact*normfactx*on_qx;
+    Elem->fqy=intensity*wakefact*normfacty*on_qy;
+    Elem->fz=intensity*wakefact*on_z;
+    Elem->waketableT=waketableT;
+    Elem->waketableDX=waketableDX;
+    Elem->waketableDY=waketableDY;
+    Elem->waketableQX=waketableQX;
+    Elem->waketableQY=waketableQY;
+    Elem->waketableZ=waketableZ;
+    Elem->nfreq=nfreq;
+    Elem->padding=padding;
+    Elem->freqtable=freqtable;
+    return Elem;
+}
+
+ExportMode struct elem *trackFunction(const atElem *ElemData,struct elem *Elem,
+        double *r_in, int num_particles, struct parameters *Param)
+{
+    if (!Elem) {
         Elem = (struct elem*)atMalloc(sizeof(struct elem));
-        Elem->nslice=nslice;
-        Elem->nelem=nelem;
-        Elem->fx=intensity*wakefact*normfactx*on_x;
-        Elem->fy=intensity*wakefact*normfacty*on_y;
-        Elem->fqx=intensity*wakefact*normfactx*on_qx;
-        Elem->fqy=intensity*wakefact*normfacty*on_qy;
-        Elem->fz=intensity*wakefact*on_z;
-        Elem->waketableT=waketableT;
-        Elem->waketableDX=waketableDX;
-        Elem->waketableDY=waketableDY;
-        Elem->waketableQX=waketableQX;
-        Elem->waketableQY=waketableQY;
-        Elem->waketableZ=waketableZ;
+        if (!init_elem(ElemData, Elem)) {
+            atFree(Elem);
+            return NULL;
+        }
     }
     impedance_tablePass(r_in,num_particles,Elem);
     return Elem;
 }
 
+COLLECTIVE_PASSMETHOD
 MODULE_DEF(ImpedanceTablePass)        /* Dummy module initialisation */
 
 #endif /*defined(MATLAB_MEX_FILE) || defined(PYAT)*/
@@ -308,48 +531,7 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
         int num_particles = mxGetN(prhs[1]);
         struct elem El, *Elem=&El;
 
-        long nslice,nelem;
-        double on_x,on_y,on_qx,on_qy,on_z;
-        double intensity, wakefact, normfactx,normfacty;
-        double *waketableT;
-        double *waketableDX;
-        double *waketableDY;
-        double *waketableQX;
-        double *waketableQY;
-        double *waketableZ;
-        
-        nslice=atGetLong(ElemData,"Nslice"); check_error();
-        nelem=atGetLong(ElemData,"Nelem"); check_error();
-        on_x=atGetDouble(ElemData,"On_x"); check_error();
-        on_y=atGetDouble(ElemData,"On_y"); check_error();
-        on_qx=atGetDouble(ElemData,"On_qx"); check_error();
-        on_qy=atGetDouble(ElemData,"On_qy"); check_error();
-        on_z=atGetDouble(ElemData,"On_z"); check_error();
-        intensity=atGetDouble(ElemData,"Intensity"); check_error();
-        wakefact=atGetDouble(ElemData,"Wakefact"); check_error();
-        normfactx=atGetDouble(ElemData,"Normfactx"); check_error();
-        normfacty=atGetDouble(ElemData,"Normfacty"); check_error();
-        waketableT=atGetDoubleArray(ElemData,"WakeT"); check_error();
-        waketableDX=atGetDoubleArray(ElemData,"WakeDX"); check_error();
-        waketableDY=atGetDoubleArray(ElemData,"WakeDY"); check_error();
-        waketableQX=atGetDoubleArray(ElemData,"WakeQX"); check_error();
-        waketableQY=atGetDoubleArray(ElemData,"WakeQY"); check_error();
-        waketableZ=atGetDoubleArray(ElemData,"WakeZ"); check_error();
-        
-        Elem->nslice=nslice;
-        Elem->nelem=nelem;
-        Elem->fx=intensity*wakefact*normfactx*on_x;
-        Elem->fy=intensity*wakefact*normfacty*on_y;
-        Elem->fqx=intensity*wakefact*normfactx*on_qx;
-        Elem->fqy=intensity*wakefact*normfacty*on_qy;
-        Elem->fz=intensity*wakefact*on_z;
-        Elem->waketableT=waketableT;
-        Elem->waketableDX=waketableDX;
-        Elem->waketableDY=waketableDY;
-        Elem->waketableQX=waketableQX;
-        Elem->waketableQY=waketableQY;
-        Elem->waketableZ=waketableZ;
-
+        init_elem(ElemData, Elem);
         if (mxGetM(prhs[1]) != 6) mexErrMsgIdAndTxt("AT:WrongArg","Second argument must be a 6 x N matrix: particle array");
         /* ALLOCATE memory for the output array of the same size as the input  */
         plhs[0] = mxDuplicateArray(prhs[1]);
@@ -379,7 +561,19 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
 
         if (nlhs>1) {
             /* list of optional fields */
-            plhs[1] = mxCreateCellMatrix(0,0); /* No optional fields */
+            plhs[1] = mxCreateCellMatrix(12,1);
+            mxSetCell(plhs[1],0,mxCreateString("ImpedanceF"));
+            mxSetCell(plhs[1],1,mxCreateString("ImpedanceDXRe"));
+            mxSetCell(plhs[1],2,mxCreateString("ImpedanceDXIm"));
+            mxSetCell(plhs[1],3,mxCreateString("ImpedanceDYRe"));
+            mxSetCell(plhs[1],4,mxCreateString("ImpedanceDYIm"));
+            mxSetCell(plhs[1],5,mxCreateString("ImpedanceQXRe"));
+            mxSetCell(plhs[1],6,mxCreateString("ImpedanceQXIm"));
+            mxSetCell(plhs[1],7,mxCreateString("ImpedanceQYRe"));
+            mxSetCell(plhs[1],8,mxCreateString("ImpedanceQYIm"));
+            mxSetCell(plhs[1],9,mxCreateString("ImpedanceZRe"));
+            mxSetCell(plhs[1],10,mxCreateString("ImpedanceZIm"));
+            mxSetCell(plhs[1],11,mxCreateString("ImpedancePadding"));
         }
     }else {
         mexErrMsgIdAndTxt("AT:WrongArg","Needs 2 or 0 arguments");
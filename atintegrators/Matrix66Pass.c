@@ -1,5 +1,6 @@
 #include "atelem.c"
 #include "atlalib.c"
+#include "atdual.c"
 
 struct elem
 {
@@ -29,30 +30,63 @@ void Matrix66Pass(double *r, const double *M,
     }
 }
 
+void Matrix66PassTangent(atdual *r, const double *M,
+        const double *T1, const double *T2,
+        const double *R1, const double *R2, int num_particles)
+/* Same as Matrix66Pass for tangent particles */
+{
+    int c;
+    for (c = 0; c<num_particles; c++) {
+        atdual *r6 = r+c*6;
+        if (!atIsNaN(r6[0].v)) {
+            if (T1 != NULL) dual_addvv(r6, T1);
+            if (R1 != NULL) dual_multmv(r6, R1);
+            dual_multmv(r6, M);
+            if (R2 != NULL) dual_multmv(r6, R2);
+            if (T2 != NULL) dual_addvv(r6, T2);
+        }
+    }
+}
+
 #if defined(MATLAB_MEX_FILE) || defined(PYAT)
+static struct elem *init_elem(const atElem *ElemData)
+{
+    struct elem *Elem;
+    double *M66;
+    double *R1, *R2, *T1, *T2;
+    M66=atGetDoubleArray(ElemData,"M66"); check_error();
+    /*optional fields*/
+    R1=atGetOptionalDoubleArray(ElemData,"R1"); check_error();
+    R2=atGetOptionalDoubleArray(ElemData,"R2"); check_error();
+    T1=atGetOptionalDoubleArray(ElemData,"T1"); check_error();
+    T2=atGetOptionalDoubleArray(ElemData,"T2"); check_error();
+    Elem = (struct elem*)atMalloc(sizeof(struct elem));
+    Elem->M66=M66;
+    /*optional fields*/
+    Elem->R1=R1;
+    Elem->R2=R2;
+    Elem->T1=T1;
+    Elem->T2=T2;
+    return Elem;
+}
+
 ExportMode struct elem *trackFunction(const atElem *ElemData,struct elem *Elem,
         double *r_in, int num_particles, struct parameters *Param)
 {
-    if (!Elem) {
-        double *M66;
-        double *R1, *R2, *T1, *T2;
-        M66=atGetDoubleArray(ElemData,"M66"); check_error();
-        /*optional fields*/
-        R1=atGetOptionalDoubleArray(ElemData,"R1"); check_error();
-        R2=atGetOptionalDoubleArray(ElemData,"R2"); check_error();
-        T1=atGetOptionalDoubleArray(ElemData,"T1"); check_error();
-        T2=atGetOptionalDoubleArray(ElemData,"T2"); check_error();
-        Elem = (struct elem*)atMalloc(sizeof(struct elem));
-        Elem->M66=M66;
-        /*optional fields*/
-        Elem->R1=R1;
-        Elem->R2=R2;
-        Elem->T1=T1;
-        Elem->T2=T2;
-        }   
+    if (!Elem) Elem = init_elem(ElemData);
+    if (!Elem) return NULL;
     Matrix66Pass(r_in, Elem->M66, Elem->T1, Elem->T2, Elem->R1, Elem->R2, num_particles);
     return Elem;
 }
+
+ExportMode struct elem *trackFunctionTangent(const atElem *ElemData,struct elem *Elem,
+        double *r_in, int num_particles, struct parameters *Param)
+{
+    if (!Elem) Elem = init_elem(ElemData);
+    if (!Elem) return NULL;
+    Matrix66PassTangent((atdual *)r_in, Elem->M66, Elem->T1, Elem->T2, Elem->R1, Elem->R2, num_particles);
+    return Elem;
+}
 MODULE_DEF(Matrix66Pass)        /* Dummy module initialisation */
 
 #endif /*defined(MATLAB_MEX_FILE) || defined(PYAT)*/
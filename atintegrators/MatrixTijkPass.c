@@ -5,6 +5,18 @@
 
 #include "atelem.c"
 #include "atlalib.c"
+#include "driftkick.c"	/* aos_gather, aos_scatter */
+
+#define TIJK_MAXTERMS 126   /* 6 x 21 independent (j<=k) coefficients */
+
+/* Non-zero coefficient of the tensor, symmetrized over j and k:
+   t = Tijk + Tikj for j < k, t = Tijj for j = k */
+struct tijk_term {
+    int i;
+    int j;
+    int k;
+    double t;
+};
 
 struct elem {
     double Length;
@@ -15,50 +27,107 @@ struct elem {
     double *R2;
     double *T1;
     double *T2;
+    /* Sparse form of Tijk */
+    int NTerms;
+    struct tijk_term Terms[TIJK_MAXTERMS];
 };
 
-static void ATmultTijk(double *r, const double* T)
-/*	multiplies 6-component column vector r by 6x6x6 tensor T:
- * as in r_i=Sum_j(Sum_k(Tijk*r_j*r_k)) 
-  The result is stored in the memory area of r !!!
+static int tijk_compress(struct tijk_term *terms, const double *T)
+/* Stores the non-zero coefficients of the 6x6x6 tensor T in terms,
+   using the j<->k symmetry. Returns the number of terms */
+{
+    int i, j, k;
+    int nterms = 0;
+    for (i=0; i<6; i++) {
+        for (j=0; j<6; j++) {
+            for (k=j; k<6; k++) {
+                double t = T[i+j*6+k*36];
+                if (k != j) t += T[i+k*6+j*36];
+                if (t != 0.0) {
+                    terms[nterms].i = i;
+                    terms[nterms].j = j;
+                    terms[nterms].k = k;
+                    terms[nterms].t = t;
+                    nterms++;
+                }
+            }
+        }
+    }
+    return nterms;
+}
+
+static void ATmultTijk_soa(double *r, int stride, int n,
+        const struct tijk_term *terms, int nterms)
+/*	multiplies the 6-component column vectors of a batch of n particles by
+ * the 6x6x6 tensor T: as in r_i=Sum_j(Sum_k(Tijk*r_j*r_k)), T being given by
+ * its non-zero symmetrized terms.
+ * The result is added to r !!!
 */
+{
+    int c, m, i;
+    double temp[6][AT_SIMD_WIDTH];
 
-{   int i,j,k;
-    double temp[6];
-    
-    for(i=0;i<6;i++)
-    {	temp[i]=0;
-        for(j=0;j<6;j++)
-        {
-            for(k=0;k<6;k++)
-                temp[i]+=T[i+j*6+k*36]*r[j]*r[k];
-        }
+    for (i=0; i<6; i++)
+        for (c=0; c<n; c++) temp[i][c] = 0.0;
+    for (m=0; m<nterms; m++) {
+        const double *rj = r + terms[m].j*stride;
+        const double *rk = r + terms[m].k*stride;
+        double *ti = temp[terms[m].i];
+        double t = terms[m].t;
+        AT_OMP_SIMD
+        for (c=0; c<n; c++)
+            ti[c] += t*rj[c]*rk[c];
+    }
+    for (i=0; i<6; i++) {
+        double *ri = r + i*stride;
+        AT_OMP_SIMD
+        for (c=0; c<n; c++)
+            if (!atIsNaN(r[c])) ri[c] += temp[i][c];
     }
-  	for(i=0;i<6;i++)
-	r[i]+=temp[i];
-} 
+}
 
-void MatrixTijkPass(double *r, const double *M66, const double *Tijk,
+AT_SIMD_DISPATCH
+void MatrixTijkPass(double *r, const double *M66,
+        const struct tijk_term *terms, int nterms,
         const double *T1, const double *T2,
         const double *R1, const double *R2, int num_particles)
-
+/* The second order term is evaluated on batches of AT_SIMD_WIDTH particles */
 {
-    double *r6;
-    int c;
-    
-    for (c = 0; c<num_particles; c++) {	/*Loop over particles  */
-        r6 = r+c*6;
-        if (!atIsNaN(r6[0])) {
-            /* Misalignment at entrance */
-            if (T1) ATaddvv(r6, T1);
-            if (R1) ATmultmv(r6, R1);
-            ATmultmv(r6, M66);
-            ATmultTijk(r6,Tijk);
-            /* Misalignment at exit */
-            if (R2) ATmultmv(r6, R2);
-            if (T2) ATaddvv(r6, T2);
+    int b;
+
+    #ifdef _OPENMP
+    #pragma omp parallel for if (num_particles > OMP_PARTICLE_THRESHOLD*10) default(shared) shared(r,num_particles) private(b)
+    #endif /*_OPENMP*/
+    for (b = 0; b<num_particles; b+=AT_SIMD_WIDTH) { /* Loop over batches of particles */
+        double *rb = r+b*6;
+        int nb = (num_particles-b < AT_SIMD_WIDTH) ? num_particles-b : AT_SIMD_WIDTH;
+        double rs[6*AT_SIMD_WIDTH];
+        int c;
+        for (c = 0; c<nb; c++) {
+            double *r6 = rb+c*6;
+            if (!atIsNaN(r6[0])) {
+                /* Misalignment at entrance */
+                if (T1) ATaddvv(r6, T1);
+                if (R1) ATmultmv(r6, R1);
+                ATmultmv(r6, M66);
+            }
         }
-	}
+        if (nterms > 0) {
+            aos_gather(rs, rb, nb);
+            ATmultTijk_soa(rs, AT_SIMD_WIDTH, nb, terms, nterms);
+            aos_scatter(rb, rs, nb);
+        }
+        if (R2 || T2) {
+            for (c = 0; c<nb; c++) {
+                double *r6 = rb+c*6;
+                if (!atIsNaN(r6[0])) {
+                    /* Misalignment at exit */
+                    if (R2) ATmultmv(r6, R2);
+                    if (T2) ATaddvv(r6, T2);
+                }
+            }
+        }
+    }
 }
 
 #if defined(MATLAB_MEX_FILE) || defined(PYAT)
@@ -85,8 +154,9 @@ ExportMode struct elem *trackFunction(const atElem *ElemData,struct elem *Elem,
         Elem->R2=R2;
         Elem->T1=T1;
         Elem->T2=T2;
+        Elem->NTerms=tijk_compress(Elem->Terms, Tijk);
     }
-    MatrixTijkPass(r_in, Elem->M66, Elem->Tijk, Elem->T1, Elem->T2, Elem->R1, Elem->R2, num_particles);
+    MatrixTijkPass(r_in, Elem->M66, Elem->Terms, Elem->NTerms, Elem->T1, Elem->T2, Elem->R1, Elem->R2, num_particles);
     return Elem;
 }
 
@@ -102,6 +172,8 @@ void mexFunction(	int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
         int num_particles = mxGetN(prhs[1]);
         double Length, *M66, *Tijk;
         double *R1, *R2, *T1, *T2;
+        struct tijk_term terms[TIJK_MAXTERMS];
+        int nterms;
 /*      Length=atGetDouble(ElemData,"Length"); check_error();*/
         M66=atGetDoubleArray(ElemData,"M66"); check_error();
         Tijk=atGetDoubleArray(ElemData,"Tijk"); check_error();
@@ -110,10 +182,11 @@ void mexFunction(	int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
         R2=atGetOptionalDoubleArray(ElemData,"R2"); check_error();
         T1=atGetOptionalDoubleArray(ElemData,"T1"); check_error();
         T2=atGetOptionalDoubleArray(ElemData,"T2"); check_error(); 		
+        nterms = tijk_compress(terms, Tijk);
         /* ALLOCATE memory for the output array of the same size as the input  */
         plhs[0] = mxDuplicateArray(prhs[1]);
         r_in = mxGetDoubles(plhs[0]);
-        MatrixTijkPass(r_in, M66, Tijk, T1, T2, R1, R2, num_particles);	
+        MatrixTijkPass(r_in, M66, terms, nterms, T1, T2, R1, R2, num_particles);	
 	}
     else if (nrhs == 0) {
         /* list of required fields */
@@ -21,7 +21,7 @@ struct elem {
 /******************************************************************************/
 /* PHYSICS SECTION ************************************************************/
 
-void quad6 (double *r, double L, double K)
+static void quad6 (double *r, double L, double K)
 {	/* K - is the quadrupole strength defined as
 	   (e/Eo)(dBz/dx) [1/m^2] 
 	   another notation: g0 [DESY paper]
@@ -6,7 +6,7 @@ struct elem {
 };
 
 void QuantDiffPass(double* r_in, double* Lmatp, int nturn,
-    pcg32_random_t* rng,
+    pcg32_random_t* rng_pool, int nrng,
     int num_particles)
     /* Lmatp 6x6 matrix
      * r_in - 6-by-N matrix of initial conditions reshaped into
@@ -14,16 +14,17 @@ void QuantDiffPass(double* r_in, double* Lmatp, int nturn,
      */
 {
     #pragma omp parallel for if (num_particles > OMP_PARTICLE_THRESHOLD) default(none) \
-    shared(r_in, num_particles, Lmatp)
+    shared(r_in, num_particles, Lmatp, rng_pool, nrng)
     for (int c = 0; c < num_particles; c++) {
         /*Loop over particles  */
         int i, j;
         double randnorm[6];
         double diffusion[6];
         double* r6 = r_in + c * 6;
+        pcg32_random_t* rng = atrng_thread(rng_pool, nrng);
+        atrandn_vec_r(rng, randnorm, 6, 0.0, 1.0);
         for (i = 0; i < 6; i++) {
             diffusion[i] = 0.0;
-            randnorm[i] = atrandn_r(rng, 0.0, 1.0);
         }
 
         for (i = 0; i < 6; i++) {
@@ -53,7 +54,7 @@ ExportMode struct elem* trackFunction(const atElem* ElemData, struct elem* Elem,
         Elem = (struct elem*)atMalloc(sizeof(struct elem));
         Elem->Lmatp = Lmatp;
     }
-    QuantDiffPass(r_in, Elem->Lmatp, nturn, Param->thread_rng, num_particles);
+    QuantDiffPass(r_in, Elem->Lmatp, nturn, Param->thread_rng, Param->nthread_rng, num_particles);
     return Elem;
 }
 
@@ -75,7 +76,7 @@ void mexFunction(int nlhs, mxArray* plhs[], int nrhs, const mxArray* prhs[])
         /* ALLOCATE memory for the output array of the same size as the input  */
         plhs[0] = mxDuplicateArray(prhs[1]);
         r_in = mxGetDoubles(plhs[0]);
-        QuantDiffPass(r_in, Lmatp, 0, &pcg32_global, num_particles);
+        QuantDiffPass(r_in, Lmatp, 0, &pcg32_global, 1, num_particles);
     } else if (nrhs == 0) {
         /* list of required fields */
         plhs[0] = mxCreateCellMatrix(1, 1);
@@ -6,6 +6,8 @@
  */
 
 #include "attrackfunc.c"
+#include "atlalib.c"
+#include "atdual.c"
 
 
 struct elem 
@@ -30,34 +32,71 @@ void RFCavityPass(double *r_in, double le, double nv, double freq, double h, dou
     trackRFCavity(r_in, le, nv, freq, h, lag, philag, nturn, T0, num_particles);
 }
 
+void RFCavityPassTangent(atdual *r_in, double le, double nv, double freq, double h, double lag, double philag,
+                  int nturn, double T0, int num_particles)
+/* Same as RFCavityPass for tangent particles */
+{
+    int c;
+    double phi0 = -TWOPI*freq*(lag/C0 + (h/freq-T0)*nturn) - philag;
+    for (c = 0; c<num_particles; c++) {
+        atdual *r6 = r_in+c*6;
+        if(!atIsNaN(r6[0].v)) {
+            atdual arg;
+            if (le != 0) dual_drift6(r6, le/2);
+            /* Longitudinal momentum kick */
+            arg = dual_addc(dual_scale(r6[5], TWOPI*freq/C0), phi0);
+            r6[4] = dual_sub(r6[4], dual_scale(dual_sin(arg), nv));
+            if (le != 0) dual_drift6(r6, le/2);
+        }
+    }
+}
+
 #if defined(MATLAB_MEX_FILE) || defined(PYAT)
+static struct elem *init_elem(const atElem *ElemData, double T0)
+{
+    struct elem *Elem;
+    double Length, Voltage, Energy, Frequency, TimeLag, PhaseLag;
+    Length=atGetDouble(ElemData,"Length"); check_error();
+    Voltage=atGetDouble(ElemData,"Voltage"); check_error();
+    Energy=atGetDouble(ElemData,"Energy"); check_error();
+    Frequency=atGetDouble(ElemData,"Frequency"); check_error();
+    TimeLag=atGetOptionalDouble(ElemData,"TimeLag",0); check_error();
+    PhaseLag=atGetOptionalDouble(ElemData,"PhaseLag",0); check_error();
+    Elem = (struct elem*)atMalloc(sizeof(struct elem));
+    Elem->Length=Length;
+    Elem->Voltage=Voltage;
+    Elem->Energy=Energy;
+    Elem->Frequency=Frequency;
+    Elem->HarmNumber=round(Frequency*T0);
+    Elem->TimeLag=TimeLag;
+    Elem->PhaseLag=PhaseLag;
+    return Elem;
+}
+
 ExportMode struct elem *trackFunction(const atElem *ElemData,struct elem *Elem,
 			      double *r_in, int num_particles, struct parameters *Param)
 {
     int nturn=Param->nturn;
     double T0=Param->T0;
-    if (!Elem) {
-        double Length, Voltage, Energy, Frequency, TimeLag, PhaseLag;
-        Length=atGetDouble(ElemData,"Length"); check_error();
-        Voltage=atGetDouble(ElemData,"Voltage"); check_error();
-        Energy=atGetDouble(ElemData,"Energy"); check_error();
-        Frequency=atGetDouble(ElemData,"Frequency"); check_error();
-        TimeLag=atGetOptionalDouble(ElemData,"TimeLag",0); check_error();
-        PhaseLag=atGetOptionalDouble(ElemData,"PhaseLag",0); check_error();
-        Elem = (struct elem*)atMalloc(sizeof(struct elem));
-        Elem->Length=Length;
-        Elem->Voltage=Voltage;
-        Elem->Energy=Energy;
-        Elem->Frequency=Frequency;
-        Elem->HarmNumber=round(Frequency*T0);
-        Elem->TimeLag=TimeLag;
-        Elem->PhaseLag=PhaseLag;
-    }
+    if (!Elem) Elem = init_elem(ElemData, T0);
+    if (!Elem) return NULL;
     RFCavityPass(r_in, Elem->Length, Elem->Voltage/Elem->Energy, Elem->Frequency, Elem->HarmNumber, Elem->TimeLag,
                  Elem->PhaseLag, nturn, T0, num_particles);
     return Elem;
 }
 
+ExportMode struct elem *trackFunctionTangent(const atElem *ElemData,struct elem *Elem,
+			      double *r_in, int num_particles, struct parameters *Param)
+{
+    int nturn=Param->nturn;
+    double T0=Param->T0;
+    if (!Elem) Elem = init_elem(ElemData, T0);
+    if (!Elem) return NULL;
+    RFCavityPassTangent((atdual *)r_in, Elem->Length, Elem->Voltage/Elem->Energy, Elem->Frequency, Elem->HarmNumber,
+                 Elem->TimeLag, Elem->PhaseLag, nturn, T0, num_particles);
+    return Elem;
+}
+
 MODULE_DEF(RFCavityPass)        /* Dummy module initialisation */
 
 #endif /*defined(MATLAB_MEX_FILE) || defined(PYAT)*/
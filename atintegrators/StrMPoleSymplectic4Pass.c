@@ -1,13 +1,93 @@
 #include "atelem.c"
 #include "atlalib.c"
 #include "driftkick.c"		/* fastdrift.c, strthinkick.c */
+#include "driftkickfloat.c"	/* fastdrift_soaf, strthinkick_soaf */
 #include "quadfringe.c"		/* QuadFringePassP, QuadFringePassN */
+#include "atdual.c"
+#include "symplectic.c"		/* IntegratorScheme */
 
 #define DRIFT1    0.6756035959798286638
 #define DRIFT2   -0.1756035959798286639
 #define KICK1     1.351207191959657328
 #define KICK2    -1.702414383919314656
 
+/* Slices of the integrator. When called with a constant max_order, the
+   kick kernel is specialised and its loop over the orders is unrolled.
+   pn is 1/(1+delta) taken at the entrance of the magnet, before the
+   misalignment, as in the original particle loop */
+AT_INLINE void StrMPoleSlices(double *r, int stride, int n, const double *A, const double *B,
+        double L1, double L2, double K1, double K2, const double *pn, int max_order, int num_int_steps)
+{
+    int m;
+    for (m=0; m < num_int_steps; m++) {  /*  Loop over slices */
+        fastdrift_soa_pn(r, stride, n, L1, pn);
+        strthinkick_soa(r, stride, n, A, B, K1, max_order);
+        fastdrift_soa_pn(r, stride, n, L2, pn);
+        strthinkick_soa(r, stride, n, A, B, K2, max_order);
+        fastdrift_soa_pn(r, stride, n, L2, pn);
+        strthinkick_soa(r, stride, n, A, B, K1, max_order);
+        fastdrift_soa_pn(r, stride, n, L1, pn);
+    }
+}
+
+/* Slices of the other schemes, with the scaled coefficients of a step.
+   The drifts ending a step and starting the next one are merged */
+AT_INLINE void StrMPoleSchemeSlices(double *r, int stride, int n, const double *A, const double *B,
+        const struct symplectic_scheme *steps, const double *pn, int max_order, int num_int_steps)
+{
+    int nk = steps->nkicks;
+    int m, k;
+    fastdrift_soa_pn(r, stride, n, steps->drift[0], pn);
+    for (m=0; m < num_int_steps; m++) {  /*  Loop over slices */
+        for (k=0; k < nk; k++) {
+            double L = steps->drift[k+1];
+            strthinkick_soa(r, stride, n, A, B, steps->kick[k], max_order);
+            if ((k == nk-1) && (m < num_int_steps-1)) L += steps->drift[0];
+            fastdrift_soa_pn(r, stride, n, L, pn);
+        }
+    }
+}
+
+AT_INLINE void StrMPoleSchemeIntegrator(double *r, int stride, int n, const double *A, const double *B,
+        const struct symplectic_scheme *steps, const double *pn, int max_order, int num_int_steps)
+{
+    switch (max_order) {
+    case 1:
+        StrMPoleSchemeSlices(r, stride, n, A, B, steps, pn, 1, num_int_steps);
+        break;
+    case 2:
+        StrMPoleSchemeSlices(r, stride, n, A, B, steps, pn, 2, num_int_steps);
+        break;
+    case 3:
+        StrMPoleSchemeSlices(r, stride, n, A, B, steps, pn, 3, num_int_steps);
+        break;
+    default:
+        StrMPoleSchemeSlices(r, stride, n, A, B, steps, pn, max_order, num_int_steps);
+    }
+}
+
+AT_INLINE void StrMPoleIntegrator(double *r, int stride, int n, const double *A, const double *B,
+        double L1, double L2, double K1, double K2, const double *pn, int max_order, int num_int_steps)
+/* Specialised integrators for the orders up to octupoles */
+{
+    switch (max_order) {
+    case 0:
+        StrMPoleSlices(r, stride, n, A, B, L1, L2, K1, K2, pn, 0, num_int_steps);
+        break;
+    case 1:
+        StrMPoleSlices(r, stride, n, A, B, L1, L2, K1, K2, pn, 1, num_int_steps);
+        break;
+    case 2:
+        StrMPoleSlices(r, stride, n, A, B, L1, L2, K1, K2, pn, 2, num_int_steps);
+        break;
+    case 3:
+        StrMPoleSlices(r, stride, n, A, B, L1, L2, K1, K2, pn, 3, num_int_steps);
+        break;
+    default:
+        StrMPoleSlices(r, stride, n, A, B, L1, L2, K1, K2, pn, max_order, num_int_steps);
+    }
+}
+
 struct elem
 {
     double Length;
@@ -16,146 +96,465 @@ struct elem
     int MaxOrder;
     int NumIntSteps;
     /* Optional fields */
+    int UseScheme;
+    struct symplectic_scheme Scheme;
     int FringeQuadEntrance;
     int FringeQuadExit;
-    double *fringeIntM0;
-    double *fringeIntP0;
+    bool LinearFringe;  /* fringe field integrals are given */
+    struct quadfringe_end FringeEntrance;
+    struct quadfringe_end FringeExit;
     double *R1;
     double *R2;
     double *T1;
     double *T2;
     double *RApertures;
     double *EApertures;
-    double *KickAngle;
 };
 
+AT_SIMD_DISPATCH
 void StrMPoleSymplectic4Pass(double *r, double le, double *A, double *B,
         int max_order, int num_int_steps,
+        const struct symplectic_scheme *scheme,   /* NULL for the default 4th order scheme */
         int FringeQuadEntrance, int FringeQuadExit, /* 0 (no fringe), 1 (lee-whiting) or 2 (lee-whiting+elegant-like) */
-        double *fringeIntM0,  /* I0m/K1, I1m/K1, I2m/K1, I3m/K1, Lambda2m/K1 */
-        double *fringeIntP0,  /* I0p/K1, I1p/K1, I2p/K1, I3p/K1, Lambda2p/K1 */        
+        const struct quadfringe_end *fringeEntrance,  /* Linear fringe field coefficients, */
+        const struct quadfringe_end *fringeExit,      /* or NULL (see quadFringeCoefs) */
         double *T1, double *T2,
         double *R1, double *R2,
         double *RApertures, double *EApertures, 
-        double *KickAngle, int num_particles)
+        int num_particles)
+/* The particles are processed in batches of AT_SIMD_WIDTH: the integrator
+   kernels are vectorized over the particles of a batch */
 {
-    int c;
+    int b;
     double SL = le/num_int_steps;
     double L1 = SL*DRIFT1;
     double L2 = SL*DRIFT2;
     double K1 = SL*KICK1;
     double K2 = SL*KICK2;
-    bool useLinFrEleEntrance = (fringeIntM0 != NULL && fringeIntP0 != NULL  && FringeQuadEntrance==2);
-    bool useLinFrEleExit = (fringeIntM0 != NULL && fringeIntP0 != NULL  && FringeQuadExit==2);
+    struct symplectic_scheme steps = {0};
+    bool useLinFrEleEntrance = (fringeEntrance != NULL && FringeQuadEntrance==2);
+    bool useLinFrEleExit = (fringeExit != NULL && FringeQuadExit==2);
+    bool entrance = T1 || R1 || RApertures || EApertures || (FringeQuadEntrance && B[1]!=0);
+    bool exit = T2 || R2 || RApertures || EApertures || (FringeQuadExit && B[1]!=0);
+    if (scheme) atScaleScheme(&steps, scheme, SL);
 
-    if (KickAngle) {   /* Convert corrector component to polynomial coefficients */
-        B[0] -= sin(KickAngle[0])/le; 
-        A[0] += sin(KickAngle[1])/le;
+    #pragma omp parallel for if (num_particles > OMP_PARTICLE_THRESHOLD) default(none) \
+    shared(r,num_particles,R1,T1,R2,T2,RApertures,EApertures,entrance,exit,\
+    A,B,L1,L2,K1,K2,max_order,num_int_steps,scheme,steps,\
+    FringeQuadEntrance,useLinFrEleEntrance,FringeQuadExit,useLinFrEleExit,fringeEntrance,fringeExit) \
+    private(b)
+    for (b = 0; b<num_particles; b+=AT_SIMD_WIDTH) {   /* Loop over batches of particles */
+        double *rb = r+b*6;
+        int nb = (num_particles-b < AT_SIMD_WIDTH) ? num_particles-b : AT_SIMD_WIDTH;
+        double rs[6*AT_SIMD_WIDTH];
+        double pn[AT_SIMD_WIDTH];   /* 1/(1+delta) before the misalignment */
+        int c;
+        for (c = 0; c<nb; c++) pn[c] = 1.0/(1.0+rb[c*6+4]);
+        if (entrance) {
+            for (c = 0; c<nb; c++) {
+                double *r6 = rb+c*6;
+                if (!atIsNaN(r6[0])) {
+                    /*  misalignment at entrance  */
+                    if (T1) ATaddvv(r6,T1);
+                    if (R1) ATmultmv(r6,R1);
+                    /* Check physical apertures at the entrance of the magnet */
+                    checkiflostAperture(r6,RApertures,EApertures);
+                    if (FringeQuadEntrance && B[1]!=0 && !useLinFrEleEntrance)
+                        QuadFringePassP(r6, B[1]);
+                }
+            }
+            if (useLinFrEleEntrance && B[1]!=0) /*Linear fringe fields from elegant, vectorized */
+                linearQuadFringeBatch(rb, 1, 6, nb, B[1], fringeEntrance, true);
+        }
+        /*  integrator, vectorized over the batch  */
+        aos_gather(rs, rb, nb);
+        if (scheme)
+            StrMPoleSchemeIntegrator(rs, AT_SIMD_WIDTH, nb, A, B, &steps, pn, max_order, num_int_steps);
+        else
+            StrMPoleIntegrator(rs, AT_SIMD_WIDTH, nb, A, B, L1, L2, K1, K2, pn, max_order, num_int_steps);
+        aos_scatter(rb, rs, nb);
+        if (exit) {
+            if (useLinFrEleExit && B[1]!=0) /*Linear fringe fields from elegant, vectorized */
+                linearQuadFringeBatch(rb, 1, 6, nb, B[1], fringeExit, false);
+            for (c = 0; c<nb; c++) {
+                double *r6 = rb+c*6;
+                if (!atIsNaN(r6[0])) {
+                    if (FringeQuadExit && B[1]!=0 && !useLinFrEleExit)
+                        QuadFringePassN(r6, B[1]);
+                    /* Check physical apertures at the exit of the magnet */
+                    checkiflostAperture(r6,RApertures,EApertures);
+                    /* Misalignment at exit */
+                    if (R2) ATmultmv(r6,R2);
+                    if (T2) ATaddvv(r6,T2);
+                }
+            }
+        }
     }
+}
+
+AT_SIMD_DISPATCH
+void StrMPoleSymplectic4PassSoA(double *r, double le, double *A, double *B,
+        int max_order, int num_int_steps,
+        const struct symplectic_scheme *scheme,
+        int FringeQuadEntrance, int FringeQuadExit,
+        const struct quadfringe_end *fringeEntrance,
+        const struct quadfringe_end *fringeExit,
+        double *T1, double *T2,
+        double *R1, double *R2,
+        double *RApertures, double *EApertures,
+        int num_particles)
+/* Same as StrMPoleSymplectic4Pass, but r is a structure-of-arrays:
+   6 rows of num_particles coordinates. The integration is done on blocks
+   of SOA_BLOCK_SIZE particles with the vectorized kernels */
+{
+    int b;
+    double SL = le/num_int_steps;
+    double L1 = SL*DRIFT1;
+    double L2 = SL*DRIFT2;
+    double K1 = SL*KICK1;
+    double K2 = SL*KICK2;
+    struct symplectic_scheme steps = {0};
+    bool useLinFrEleEntrance = (fringeEntrance != NULL && FringeQuadEntrance==2);
+    bool useLinFrEleExit = (fringeExit != NULL && FringeQuadExit==2);
+    bool entrance = T1 || R1 || RApertures || EApertures || (FringeQuadEntrance && B[1]!=0);
+    bool exit = T2 || R2 || RApertures || EApertures || (FringeQuadExit && B[1]!=0);
+    if (scheme) atScaleScheme(&steps, scheme, SL);
+
+    #ifdef _OPENMP
+    #pragma omp parallel for if (num_particles > OMP_PARTICLE_THRESHOLD) default(none) \
+    shared(r,num_particles,R1,T1,R2,T2,RApertures,EApertures,entrance,exit,\
+    A,B,L1,L2,K1,K2,max_order,num_int_steps,scheme,steps,\
+    FringeQuadEntrance,useLinFrEleEntrance,FringeQuadExit,useLinFrEleExit,fringeEntrance,fringeExit) \
+    private(b)
+    #endif /*_OPENMP*/
+    for (b = 0; b<num_particles; b+=SOA_BLOCK_SIZE) {   /* Loop over blocks of particles */
+        double *rb = r+b;
+        int nb = (num_particles-b < SOA_BLOCK_SIZE) ? num_particles-b : SOA_BLOCK_SIZE;
+        double pn[SOA_BLOCK_SIZE];  /* 1/(1+delta) before the misalignment */
+        int c;
+        pnorm_soa(pn, rb, num_particles, nb);
+        if (entrance) {
+            for (c = 0; c<nb; c++) {
+                double r6[6];
+                soa_load(r6, rb+c, num_particles);
+                if (!atIsNaN(r6[0])) {
+                    /*  misalignment at entrance  */
+                    if (T1) ATaddvv(r6,T1);
+                    if (R1) ATmultmv(r6,R1);
+                    /* Check physical apertures at the entrance of the magnet */
+                    checkiflostAperture(r6,RApertures,EApertures);
+                    if (FringeQuadEntrance && B[1]!=0 && !useLinFrEleEntrance)
+                        QuadFringePassP(r6, B[1]);
+                    soa_store(rb+c, r6, num_particles);
+                }
+            }
+            if (useLinFrEleEntrance && B[1]!=0) /*Linear fringe fields from elegant, vectorized */
+                linearQuadFringeBatch(rb, num_particles, 1, nb, B[1], fringeEntrance, true);
+        }
+        /*  integrator  */
+        if (scheme)
+            StrMPoleSchemeIntegrator(rb, num_particles, nb, A, B, &steps, pn, max_order, num_int_steps);
+        else
+            StrMPoleIntegrator(rb, num_particles, nb, A, B, L1, L2, K1, K2, pn, max_order, num_int_steps);
+        if (exit) {
+            if (useLinFrEleExit && B[1]!=0) /*Linear fringe fields from elegant, vectorized */
+                linearQuadFringeBatch(rb, num_particles, 1, nb, B[1], fringeExit, false);
+            for (c = 0; c<nb; c++) {
+                double r6[6];
+                soa_load(r6, rb+c, num_particles);
+                if (!atIsNaN(r6[0])) {
+                    if (FringeQuadExit && B[1]!=0 && !useLinFrEleExit)
+                        QuadFringePassN(r6, B[1]);
+                    /* Check physical apertures at the exit of the magnet */
+                    checkiflostAperture(r6,RApertures,EApertures);
+                    /* Misalignment at exit */
+                    if (R2) ATmultmv(r6,R2);
+                    if (T2) ATaddvv(r6,T2);
+                    soa_store(rb+c, r6, num_particles);
+                }
+            }
+        }
+    }
+}
+
+/* Slices of the single-precision integrator, with the scaled coefficients
+   of a step as in StrMPoleSchemeSlices */
+static void StrMPoleFloatSlices(float *r, int stride, int n, const double *A, const double *B,
+        const struct symplectic_scheme *steps, const float *pn, int max_order, int num_int_steps)
+{
+    int nk = steps->nkicks;
+    int m, k;
+    fastdrift_soaf(r, stride, n, (float)steps->drift[0], pn);
+    for (m=0; m < num_int_steps; m++) {  /*  Loop over slices */
+        for (k=0; k < nk; k++) {
+            double L = steps->drift[k+1];
+            strthinkick_soaf(r, stride, n, A, B, (float)steps->kick[k], max_order);
+            if ((k == nk-1) && (m < num_int_steps-1)) L += steps->drift[0];
+            fastdrift_soaf(r, stride, n, (float)L, pn);
+        }
+    }
+}
+
+void StrMPoleSymplectic4PassFloat(float *r, double le, double *A, double *B,
+        int max_order, int num_int_steps,
+        const struct symplectic_scheme *scheme,
+        int FringeQuadEntrance, int FringeQuadExit,
+        const struct quadfringe_end *fringeEntrance,
+        const struct quadfringe_end *fringeExit,
+        double *T1, double *T2,
+        double *R1, double *R2,
+        double *RApertures, double *EApertures,
+        int num_particles)
+/* Same as StrMPoleSymplectic4PassSoA on the single-precision particle
+   array. The misalignments, apertures and fringe fields are computed in
+   double precision */
+{
+    int b;
+    double SL = le/num_int_steps;
+    struct symplectic_scheme default_scheme, steps;
+    bool useLinFrEleEntrance = (fringeEntrance != NULL && FringeQuadEntrance==2);
+    bool useLinFrEleExit = (fringeExit != NULL && FringeQuadExit==2);
+    bool entrance = T1 || R1 || RApertures || EApertures || (FringeQuadEntrance && B[1]!=0);
+    bool exit = T2 || R2 || RApertures || EApertures || (FringeQuadExit && B[1]!=0);
+    if (!scheme) {
+        atSymplecticScheme(&default_scheme, 4);
+        scheme = &default_scheme;
+    }
+    atScaleScheme(&steps, scheme, SL);
+
+    #ifdef _OPENMP
     #pragma omp parallel for if (num_particles > OMP_PARTICLE_THRESHOLD) default(none) \
-    shared(r,num_particles,R1,T1,R2,T2,RApertures,EApertures,\
-    A,B,L1,L2,K1,K2,max_order,num_int_steps,\
-    FringeQuadEntrance,useLinFrEleEntrance,FringeQuadExit,useLinFrEleExit,fringeIntM0,fringeIntP0) \
-    private(c)
-    for (c = 0;c<num_particles;c++)	{   /*Loop over particles  */
-        double *r6 = r+c*6;
-        if(!atIsNaN(r6[0])) {
-            int m;
-            double norm = 1.0/(1.0+r6[4]);
-            double NormL1 = L1*norm;
-            double NormL2 = L2*norm;
+    shared(r,num_particles,R1,T1,R2,T2,RApertures,EApertures,entrance,exit,\
+    A,B,max_order,num_int_steps,steps,\
+    FringeQuadEntrance,useLinFrEleEntrance,FringeQuadExit,useLinFrEleExit,fringeEntrance,fringeExit) \
+    private(b)
+    #endif /*_OPENMP*/
+    for (b = 0; b<num_particles; b+=SOA_BLOCK_SIZE) {   /* Loop over blocks of particles */
+        float *rb = r+b;
+        int nb = (num_particles-b < SOA_BLOCK_SIZE) ? num_particles-b : SOA_BLOCK_SIZE;
+        float pn[SOA_BLOCK_SIZE];   /* 1/(1+delta) before the misalignment */
+        int c;
+        pnorm_soaf(pn, rb, num_particles, nb);
+        if (entrance) {
+            for (c = 0; c<nb; c++) {
+                double r6[6];
+                soaf_load(r6, rb+c, num_particles);
+                if (!atIsNaN(r6[0])) {
+                    if (T1) ATaddvv(r6,T1);
+                    if (R1) ATmultmv(r6,R1);
+                    checkiflostAperture(r6,RApertures,EApertures);
+                    if (FringeQuadEntrance && B[1]!=0) {
+                        if (useLinFrEleEntrance)
+                            linearQuadFringeEntrance(r6, B[1], fringeEntrance);
+                        else
+                            QuadFringePassP(r6, B[1]);
+                    }
+                    soaf_store(rb+c, r6, num_particles);
+                }
+            }
+        }
+        StrMPoleFloatSlices(rb, num_particles, nb, A, B, &steps, pn, max_order, num_int_steps);
+        if (exit) {
+            for (c = 0; c<nb; c++) {
+                double r6[6];
+                soaf_load(r6, rb+c, num_particles);
+                if (!atIsNaN(r6[0])) {
+                    if (FringeQuadExit && B[1]!=0) {
+                        if (useLinFrEleExit)
+                            linearQuadFringeExit(r6, B[1], fringeExit);
+                        else
+                            QuadFringePassN(r6, B[1]);
+                    }
+                    checkiflostAperture(r6,RApertures,EApertures);
+                    if (R2) ATmultmv(r6,R2);
+                    if (T2) ATaddvv(r6,T2);
+                    soaf_store(rb+c, r6, num_particles);
+                }
+            }
+        }
+    }
+}
+
+void StrMPoleSymplectic4PassTangent(atdual *r, double le, double *A, double *B,
+        int max_order, int num_int_steps,
+        const struct symplectic_scheme *scheme,
+        double *T1, double *T2,
+        double *R1, double *R2,
+        double *RApertures, double *EApertures,
+        int num_particles)
+/* Same as StrMPoleSymplectic4Pass for tangent particles, without
+   quadrupole fringe fields */
+{
+    int c;
+    double SL = le/num_int_steps;
+    double L1 = SL*DRIFT1;
+    double L2 = SL*DRIFT2;
+    double K1 = SL*KICK1;
+    double K2 = SL*KICK2;
+    struct symplectic_scheme steps = {0};
+    if (scheme) atScaleScheme(&steps, scheme, SL);
+
+    for (c = 0; c<num_particles; c++) {   /* Loop over particles */
+        atdual *r6 = r+c*6;
+        int m;
+        if (!atIsNaN(r6[0].v)) {
             /*  misalignment at entrance  */
-            if (T1) ATaddvv(r6,T1);
-            if (R1) ATmultmv(r6,R1);
+            if (T1) dual_addvv(r6,T1);
+            if (R1) dual_multmv(r6,R1);
             /* Check physical apertures at the entrance of the magnet */
-            if (RApertures) checkiflostRectangularAp(r6,RApertures);
-            if (EApertures) checkiflostEllipticalAp(r6,EApertures);
-            if (FringeQuadEntrance && B[1]!=0) {
-                if (useLinFrEleEntrance) /*Linear fringe fields from elegant */
-                    linearQuadFringeElegantEntrance(r6, B[1], fringeIntM0, fringeIntP0);
-                else
-                    QuadFringePassP(r6, B[1]);
-            }
+            dual_checkaperture(r6,RApertures,EApertures);
             /*  integrator  */
-            for (m=0; m < num_int_steps; m++) {  /*  Loop over slices */
-                fastdrift(r6, NormL1);
-                strthinkick(r6, A, B,  K1, max_order);
-                fastdrift(r6, NormL2);
-                strthinkick(r6, A, B, K2, max_order);
-                fastdrift(r6, NormL2);
-                strthinkick(r6, A, B,  K1, max_order);
-                fastdrift(r6, NormL1);
+            if (scheme) for (m=0; m < num_int_steps; m++) {  /*  Loop over slices */
+                int k;
+                for (k=0; k < steps.nkicks; k++) {
+                    dual_drift6(r6, steps.drift[k]);
+                    dual_strthinkick(r6, A, B, steps.kick[k], max_order);
+                }
+                dual_drift6(r6, steps.drift[steps.nkicks]);
             }
-            if (FringeQuadExit && B[1]!=0) {
-                if (useLinFrEleExit) /*Linear fringe fields from elegant*/
-                    linearQuadFringeElegantExit(r6, B[1], fringeIntM0, fringeIntP0);
-                else
-                    QuadFringePassN(r6, B[1]);
+            else for (m=0; m < num_int_steps; m++) {  /*  Loop over slices */
+                dual_drift6(r6, L1);
+                dual_strthinkick(r6, A, B, K1, max_order);
+                dual_drift6(r6, L2);
+                dual_strthinkick(r6, A, B, K2, max_order);
+                dual_drift6(r6, L2);
+                dual_strthinkick(r6, A, B, K1, max_order);
+                dual_drift6(r6, L1);
             }
             /* Check physical apertures at the exit of the magnet */
-            if (RApertures) checkiflostRectangularAp(r6,RApertures);
-            if (EApertures) checkiflostEllipticalAp(r6,EApertures);
+            dual_checkaperture(r6,RApertures,EApertures);
             /* Misalignment at exit */
-            if (R2) ATmultmv(r6,R2);
-            if (T2) ATaddvv(r6,T2);
+            if (R2) dual_multmv(r6,R2);
+            if (T2) dual_addvv(r6,T2);
         }
     }
-    if (KickAngle) {  /* Remove corrector component in polynomial coefficients */
-        B[0] += sin(KickAngle[0])/le; 
-        A[0] -= sin(KickAngle[1])/le;
-    }
 }
 
 #if defined(MATLAB_MEX_FILE) || defined(PYAT)
+static struct elem *init_elem(const atElem *ElemData)
+{
+    struct elem *Elem;
+    double Length;
+    int MaxOrder, NumIntSteps, FringeQuadEntrance, FringeQuadExit, IntegratorScheme;
+    double *PolynomA, *PolynomB, *R1, *R2, *T1, *T2, *EApertures, *RApertures, *fringeIntM0, *fringeIntP0, *KickAngle;
+    struct symplectic_scheme scheme;
+    int msz, nsz, npoly;
+    Length=atGetDouble(ElemData,"Length"); check_error();
+    PolynomA=atGetDoubleArraySz(ElemData,"PolynomA",&msz,&nsz); check_error();
+    npoly=msz*nsz;
+    PolynomB=atGetDoubleArraySz(ElemData,"PolynomB",&msz,&nsz); check_error();
+    if (msz*nsz < npoly) npoly=msz*nsz;
+    MaxOrder=atGetLong(ElemData,"MaxOrder"); check_error();
+    NumIntSteps=atGetLong(ElemData,"NumIntSteps"); check_error();
+    /*optional fields*/
+    IntegratorScheme=atGetOptionalLong(ElemData,"IntegratorScheme",0); check_error();
+    if (!atSymplecticScheme(&scheme, IntegratorScheme)) {
+        atError("Unknown IntegratorScheme: %d", IntegratorScheme); check_error();
+    }
+    FringeQuadEntrance=atGetOptionalLong(ElemData,"FringeQuadEntrance",0);
+    FringeQuadExit=atGetOptionalLong(ElemData,"FringeQuadExit",0);
+    fringeIntM0=atGetOptionalDoubleArray(ElemData,"fringeIntM0"); check_error();
+    fringeIntP0=atGetOptionalDoubleArray(ElemData,"fringeIntP0"); check_error();
+    R1=atGetOptionalDoubleArray(ElemData,"R1"); check_error();
+    R2=atGetOptionalDoubleArray(ElemData,"R2"); check_error();
+    T1=atGetOptionalDoubleArray(ElemData,"T1"); check_error();
+    T2=atGetOptionalDoubleArray(ElemData,"T2"); check_error();
+    EApertures=atGetOptionalDoubleArray(ElemData,"EApertures"); check_error();
+    RApertures=atGetOptionalDoubleArray(ElemData,"RApertures"); check_error();
+    KickAngle=atGetOptionalDoubleArray(ElemData,"KickAngle"); check_error();
+
+    if (KickAngle) {    /* Effective coefficients including the corrector kick */
+        Elem = (struct elem*)atMalloc(sizeof(struct elem)+2*npoly*sizeof(double));
+        atKickPolynom((double *)(Elem+1), (double *)(Elem+1)+npoly, PolynomA, PolynomB,
+                npoly, Length, KickAngle);
+        PolynomA = (double *)(Elem+1);
+        PolynomB = PolynomA+npoly;
+    }
+    else
+        Elem = (struct elem*)atMalloc(sizeof(struct elem));
+    Elem->Length=Length;
+    Elem->PolynomA=PolynomA;
+    Elem->PolynomB=PolynomB;
+    Elem->MaxOrder=MaxOrder;
+    Elem->NumIntSteps=NumIntSteps;
+    /*optional fields*/
+    Elem->UseScheme=(IntegratorScheme != 0 && IntegratorScheme != 4);
+    Elem->Scheme=scheme;
+    Elem->FringeQuadEntrance=FringeQuadEntrance;
+    Elem->FringeQuadExit=FringeQuadExit;
+    Elem->LinearFringe=(fringeIntM0 != NULL && fringeIntP0 != NULL);
+    if (Elem->LinearFringe)
+        quadFringeCoefs(&Elem->FringeEntrance, &Elem->FringeExit, fringeIntM0, fringeIntP0);
+    Elem->R1=R1;
+    Elem->R2=R2;
+    Elem->T1=T1;
+    Elem->T2=T2;
+    Elem->EApertures=EApertures;
+    Elem->RApertures=RApertures;
+    return Elem;
+}
+
 ExportMode struct elem *trackFunction(const atElem *ElemData,struct elem *Elem,
         double *r_in, int num_particles, struct parameters *Param)
 {
-    if (!Elem) {
-        double Length;
-        int MaxOrder, NumIntSteps, FringeQuadEntrance, FringeQuadExit;
-        double *PolynomA, *PolynomB, *R1, *R2, *T1, *T2, *EApertures, *RApertures, *fringeIntM0, *fringeIntP0, *KickAngle;
-        Length=atGetDouble(ElemData,"Length"); check_error();
-        PolynomA=atGetDoubleArray(ElemData,"PolynomA"); check_error();
-        PolynomB=atGetDoubleArray(ElemData,"PolynomB"); check_error();
-        MaxOrder=atGetLong(ElemData,"MaxOrder"); check_error();
-        NumIntSteps=atGetLong(ElemData,"NumIntSteps"); check_error();
-        /*optional fields*/
-        FringeQuadEntrance=atGetOptionalLong(ElemData,"FringeQuadEntrance",0);
-        FringeQuadExit=atGetOptionalLong(ElemData,"FringeQuadExit",0);
-        fringeIntM0=atGetOptionalDoubleArray(ElemData,"fringeIntM0"); check_error();
-        fringeIntP0=atGetOptionalDoubleArray(ElemData,"fringeIntP0"); check_error();
-        R1=atGetOptionalDoubleArray(ElemData,"R1"); check_error();
-        R2=atGetOptionalDoubleArray(ElemData,"R2"); check_error();
-        T1=atGetOptionalDoubleArray(ElemData,"T1"); check_error();
-        T2=atGetOptionalDoubleArray(ElemData,"T2"); check_error();
-        EApertures=atGetOptionalDoubleArray(ElemData,"EApertures"); check_error();
-        RApertures=atGetOptionalDoubleArray(ElemData,"RApertures"); check_error();
-        KickAngle=atGetOptionalDoubleArray(ElemData,"KickAngle"); check_error();
-        
-        Elem = (struct elem*)atMalloc(sizeof(struct elem));
-        Elem->Length=Length;
-        Elem->PolynomA=PolynomA;
-        Elem->PolynomB=PolynomB;
-        Elem->MaxOrder=MaxOrder;
-        Elem->NumIntSteps=NumIntSteps;
-        /*optional fields*/
-        Elem->FringeQuadEntrance=FringeQuadEntrance;
-        Elem->FringeQuadExit=FringeQuadExit;
-        Elem->fringeIntM0=fringeIntM0;
-        Elem->fringeIntP0=fringeIntP0;
-        Elem->R1=R1;
-        Elem->R2=R2;
-        Elem->T1=T1;
-        Elem->T2=T2;
-        Elem->EApertures=EApertures;
-        Elem->RApertures=RApertures;
-        Elem->KickAngle=KickAngle;
-    }
+    if (!Elem) Elem = init_elem(ElemData);
+    if (!Elem) return NULL;
     StrMPoleSymplectic4Pass(r_in,Elem->Length,Elem->PolynomA,Elem->PolynomB,
-            Elem->MaxOrder,Elem->NumIntSteps,Elem->FringeQuadEntrance,
-            Elem->FringeQuadExit,Elem->fringeIntM0,Elem->fringeIntP0,
+            Elem->MaxOrder,Elem->NumIntSteps,
+            Elem->UseScheme ? &Elem->Scheme : NULL,Elem->FringeQuadEntrance,
+            Elem->FringeQuadExit,
+            Elem->LinearFringe ? &Elem->FringeEntrance : NULL,
+            Elem->LinearFringe ? &Elem->FringeExit : NULL,
+            Elem->T1,Elem->T2,Elem->R1,Elem->R2,
+            Elem->RApertures,Elem->EApertures,num_particles);
+    return Elem;
+}
+
+ExportMode struct elem *trackFunctionSoA(const atElem *ElemData,struct elem *Elem,
+        double *r_in, int num_particles, struct parameters *Param)
+{
+    if (!Elem) Elem = init_elem(ElemData);
+    if (!Elem) return NULL;
+    StrMPoleSymplectic4PassSoA(r_in,Elem->Length,Elem->PolynomA,Elem->PolynomB,
+            Elem->MaxOrder,Elem->NumIntSteps,
+            Elem->UseScheme ? &Elem->Scheme : NULL,Elem->FringeQuadEntrance,
+            Elem->FringeQuadExit,
+            Elem->LinearFringe ? &Elem->FringeEntrance : NULL,
+            Elem->LinearFringe ? &Elem->FringeExit : NULL,
+            Elem->T1,Elem->T2,Elem->R1,Elem->R2,
+            Elem->RApertures,Elem->EApertures,num_particles);
+    return Elem;
+}
+
+ExportMode struct elem *trackFunctionFloat(const atElem *ElemData,struct elem *Elem,
+        float *r_in, int num_particles, struct parameters *Param)
+{
+    if (!Elem) Elem = init_elem(ElemData);
+    if (!Elem) return NULL;
+    StrMPoleSymplectic4PassFloat(r_in,Elem->Length,Elem->PolynomA,Elem->PolynomB,
+            Elem->MaxOrder,Elem->NumIntSteps,
+            Elem->UseScheme ? &Elem->Scheme : NULL,Elem->FringeQuadEntrance,
+            Elem->FringeQuadExit,
+            Elem->LinearFringe ? &Elem->FringeEntrance : NULL,
+            Elem->LinearFringe ? &Elem->FringeExit : NULL,
             Elem->T1,Elem->T2,Elem->R1,Elem->R2,
-            Elem->RApertures,Elem->EApertures,Elem->KickAngle,num_particles);
+            Elem->RApertures,Elem->EApertures,num_particles);
+    return Elem;
+}
+
+ExportMode struct elem *trackFunctionTangent(const atElem *ElemData,struct elem *Elem,
+        double *r_in, int num_particles, struct parameters *Param)
+{
+    if (!Elem) Elem = init_elem(ElemData);
+    if (!Elem) return NULL;
+    if ((Elem->FringeQuadEntrance || Elem->FringeQuadExit) && Elem->PolynomB[1]!=0) {
+        atFree(Elem);   /* No tangent map for quadrupole fringe fields */
+        return NULL;
+    }
+    StrMPoleSymplectic4PassTangent((atdual *)r_in,Elem->Length,Elem->PolynomA,Elem->PolynomB,
+            Elem->MaxOrder,Elem->NumIntSteps,Elem->UseScheme ? &Elem->Scheme : NULL,
+            Elem->T1,Elem->T2,Elem->R1,Elem->R2,
+            Elem->RApertures,Elem->EApertures,num_particles);
     return Elem;
 }
 
@@ -171,14 +570,23 @@ void mexFunction(	int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
         const mxArray *ElemData = prhs[0];
         int num_particles = mxGetN(prhs[1]);
         double Length;
-        int MaxOrder, NumIntSteps, FringeQuadEntrance, FringeQuadExit;
+        int MaxOrder, NumIntSteps, FringeQuadEntrance, FringeQuadExit, IntegratorScheme;
         double *PolynomA, *PolynomB, *R1, *R2, *T1, *T2, *EApertures, *RApertures, *fringeIntM0, *fringeIntP0, *KickAngle;
+        double *PolynomAB = NULL;
+        struct symplectic_scheme scheme;
+        struct quadfringe_end fringeEntrance, fringeExit;
+        int msz, nsz, npoly;
         Length=atGetDouble(ElemData,"Length"); check_error();
-        PolynomA=atGetDoubleArray(ElemData,"PolynomA"); check_error();
-        PolynomB=atGetDoubleArray(ElemData,"PolynomB"); check_error();
+        PolynomA=atGetDoubleArraySz(ElemData,"PolynomA",&msz,&nsz); check_error();
+        npoly=msz*nsz;
+        PolynomB=atGetDoubleArraySz(ElemData,"PolynomB",&msz,&nsz); check_error();
+        if (msz*nsz < npoly) npoly=msz*nsz;
         MaxOrder=atGetLong(ElemData,"MaxOrder"); check_error();
         NumIntSteps=atGetLong(ElemData,"NumIntSteps"); check_error();
         /*optional fields*/
+        IntegratorScheme=atGetOptionalLong(ElemData,"IntegratorScheme",0); check_error();
+        if (!atSymplecticScheme(&scheme, IntegratorScheme))
+            atError("Unknown IntegratorScheme: %d", IntegratorScheme);
         FringeQuadEntrance=atGetOptionalLong(ElemData,"FringeQuadEntrance",0); check_error();
         FringeQuadExit=atGetOptionalLong(ElemData,"FringeQuadExit",0); check_error();
         fringeIntM0=atGetOptionalDoubleArray(ElemData,"fringeIntM0"); check_error();
@@ -191,12 +599,24 @@ void mexFunction(	int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
         RApertures=atGetOptionalDoubleArray(ElemData,"RApertures"); check_error();
         KickAngle=atGetOptionalDoubleArray(ElemData,"KickAngle"); check_error();
         
+        if (KickAngle) {    /* Effective coefficients including the corrector kick */
+            PolynomAB = (double *)atMalloc(2*npoly*sizeof(double));
+            atKickPolynom(PolynomAB, PolynomAB+npoly, PolynomA, PolynomB, npoly, Length, KickAngle);
+            PolynomA = PolynomAB;
+            PolynomB = PolynomAB+npoly;
+        }
+        if (fringeIntM0 && fringeIntP0)
+            quadFringeCoefs(&fringeEntrance, &fringeExit, fringeIntM0, fringeIntP0);
         /* ALLOCATE memory for the output array of the same size as the input  */
         plhs[0] = mxDuplicateArray(prhs[1]);
         r_in = mxGetDoubles(plhs[0]);
         StrMPoleSymplectic4Pass(r_in,Length,PolynomA,PolynomB,MaxOrder,NumIntSteps,
-                FringeQuadEntrance,FringeQuadExit,fringeIntM0,fringeIntP0,
-                T1,T2,R1,R2,RApertures,EApertures,KickAngle,num_particles);
+                (IntegratorScheme != 0 && IntegratorScheme != 4) ? &scheme : NULL,
+                FringeQuadEntrance,FringeQuadExit,
+                (fringeIntM0 && fringeIntP0) ? &fringeEntrance : NULL,
+                (fringeIntM0 && fringeIntP0) ? &fringeExit : NULL,
+                T1,T2,R1,R2,RApertures,EApertures,num_particles);
+        if (PolynomAB) atFree(PolynomAB);
     }
     else if (nrhs == 0) {
         /* list of required fields */
@@ -208,7 +628,7 @@ void mexFunction(	int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
         mxSetCell(plhs[0],4,mxCreateString("NumIntSteps"));
         if (nlhs>1) {
             /* list of optional fields */
-            plhs[1] = mxCreateCellMatrix(11,1);
+            plhs[1] = mxCreateCellMatrix(12,1);
             mxSetCell(plhs[1], 0,mxCreateString("FringeQuadEntrance"));
             mxSetCell(plhs[1], 1,mxCreateString("FringeQuadExit")); 
             mxSetCell(plhs[1], 2,mxCreateString("fringeIntM0"));
@@ -220,6 +640,7 @@ void mexFunction(	int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
             mxSetCell(plhs[1], 8,mxCreateString("RApertures"));
             mxSetCell(plhs[1], 9,mxCreateString("EApertures"));
             mxSetCell(plhs[1],10,mxCreateString("KickAngle"));
+            mxSetCell(plhs[1],11,mxCreateString("IntegratorScheme"));
         }
     }
     else {
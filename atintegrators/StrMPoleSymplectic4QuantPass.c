@@ -27,7 +27,6 @@ struct elem {
     double* T2;
     double* RApertures;
     double* EApertures;
-    double* KickAngle;
 };
 
 void StrMPoleSymplectic4QuantPass(double* r, double le, double* A, double* B,
@@ -38,8 +37,8 @@ void StrMPoleSymplectic4QuantPass(double* r, double le, double* A, double* B,
     double* T1, double* T2,
     double* R1, double* R2,
     double* RApertures, double* EApertures,
-    double* KickAngle, double E0,
-    pcg32_random_t* rng,
+    double E0,
+    pcg32_random_t* rng_pool, int nrng,
     int num_particles)
 {
     double SL = le / num_int_steps;
@@ -57,25 +56,22 @@ void StrMPoleSymplectic4QuantPass(double* r, double le, double* A, double* B,
     bool useLinFrEleEntrance = (fringeIntM0 != NULL && fringeIntP0 != NULL && FringeQuadEntrance == 2);
     bool useLinFrEleExit = (fringeIntM0 != NULL && fringeIntP0 != NULL && FringeQuadExit == 2);
 
-    if (KickAngle) { /* Convert corrector component to polynomial coefficients */
-        B[0] -= sin(KickAngle[0]) / le;
-        A[0] += sin(KickAngle[1]) / le;
-    }
+    atQuantInit();     /* photon energy table, built once */
     #pragma omp parallel for if (num_particles > OMP_PARTICLE_THRESHOLD) default(none)                      \
-    shared(r, num_particles, R1, T1, R2, T2, RApertures, EApertures,                                        \
+    shared(r, num_particles, rng_pool, nrng, R1, T1, R2, T2, RApertures, EApertures,                                        \
         A, B, L1, L2, K1, K2, max_order, num_int_steps,                                                     \
         FringeQuadEntrance, useLinFrEleEntrance, FringeQuadExit, useLinFrEleExit, fringeIntM0, fringeIntP0, \
         emass, E0, hbar, clight, alpha0, qe, SL)
     for (int c = 0; c < num_particles; c++) { /* Loop over particles  */
         double* r6 = r + c * 6;
+        pcg32_random_t* rng = atrng_thread(rng_pool, nrng);
         if (!atIsNaN(r6[0])) {
             int m;
             /*  misalignment at entrance  */
             if (T1) ATaddvv(r6,T1);
             if (R1) ATmultmv(r6,R1);
             /* Check physical apertures at the entrance of the magnet */
-            if (RApertures) checkiflostRectangularAp(r6,RApertures);
-            if (EApertures) checkiflostEllipticalAp(r6,EApertures);
+            checkiflostAperture(r6,RApertures,EApertures);
             if (FringeQuadEntrance && B[1]!=0) {
                 if (useLinFrEleEntrance) /*Linear fringe fields from elegant*/
                     linearQuadFringeElegantEntrance(r6, B[1], fringeIntM0, fringeIntP0);
@@ -84,10 +80,8 @@ void StrMPoleSymplectic4QuantPass(double* r, double le, double* A, double* B,
             }
             /* integrator */
             for (m = 0; m < num_int_steps; m++) { /* Loop over slices */
-                int i;
                 double ng, ec, de, energy, gamma, cstec, cstng;
                 double ds, rho, dxp, dyp;
-                int nph;
                 double p_norm = 1.0 / (1.0 + r6[4]);
                 double NormL1 = L1 * p_norm;
                 double NormL2 = L2 * p_norm;
@@ -119,12 +113,7 @@ void StrMPoleSymplectic4QuantPass(double* r, double le, double* A, double* B,
                 ng = cstng / rho * (SL + ds);
                 ec = cstec / rho;
 
-                nph = atrandp_r(rng, ng);
-
-                de = 0.0;
-                for (i = 0; i < nph; i++) {
-                    de = de + getEnergy(rng, ec);
-                };
+                de = getEnergyLoss(rng, ng, ec);
                 r6[4] = r6[4] - de / E0;
                 r6[1] = r6[1] * p_norm * (1 + r6[4]);
                 r6[3] = r6[3] * p_norm * (1 + r6[4]);
@@ -136,17 +125,12 @@ void StrMPoleSymplectic4QuantPass(double* r, double le, double* A, double* B,
                     QuadFringePassN(r6, B[1]);
             }
             /* Check physical apertures at the exit of the magnet */
-            if (RApertures) checkiflostRectangularAp(r6,RApertures);
-            if (EApertures) checkiflostEllipticalAp(r6,EApertures);
+            checkiflostAperture(r6,RApertures,EApertures);
             /* Misalignment at exit */
             if (R2) ATmultmv(r6,R2);
             if (T2) ATaddvv(r6,T2);
         }
     }
-    if (KickAngle) { /* Remove corrector component in polynomial coefficients */
-        B[0] += sin(KickAngle[0]) / le;
-        A[0] -= sin(KickAngle[1]) / le;
-    }
 }
 
 #if defined(MATLAB_MEX_FILE) || defined(PYAT)
@@ -157,9 +141,12 @@ ExportMode struct elem* trackFunction(const atElem* ElemData, struct elem* Elem,
         double Length, Energy;
         int MaxOrder, NumIntSteps, FringeQuadEntrance, FringeQuadExit;
         double *PolynomA, *PolynomB, *R1, *R2, *T1, *T2, *EApertures, *RApertures, *fringeIntM0, *fringeIntP0, *KickAngle;
+        int msz, nsz, npoly;
         Length=atGetDouble(ElemData,"Length"); check_error();
-        PolynomA=atGetDoubleArray(ElemData,"PolynomA"); check_error();
-        PolynomB=atGetDoubleArray(ElemData,"PolynomB"); check_error();
+        PolynomA=atGetDoubleArraySz(ElemData,"PolynomA",&msz,&nsz); check_error();
+        npoly=msz*nsz;
+        PolynomB=atGetDoubleArraySz(ElemData,"PolynomB",&msz,&nsz); check_error();
+        if (msz*nsz < npoly) npoly=msz*nsz;
         MaxOrder=atGetLong(ElemData,"MaxOrder"); check_error();
         NumIntSteps=atGetLong(ElemData,"NumIntSteps"); check_error();
         Energy=atGetDouble(ElemData,"Energy"); check_error();
@@ -175,8 +162,16 @@ ExportMode struct elem* trackFunction(const atElem* ElemData, struct elem* Elem,
         EApertures=atGetOptionalDoubleArray(ElemData,"EApertures"); check_error();
         RApertures=atGetOptionalDoubleArray(ElemData,"RApertures"); check_error();
         KickAngle=atGetOptionalDoubleArray(ElemData,"KickAngle"); check_error();
-        
-        Elem = (struct elem*)atMalloc(sizeof(struct elem));
+
+        if (KickAngle) {    /* Effective coefficients including the corrector kick */
+            Elem = (struct elem*)atMalloc(sizeof(struct elem)+2*npoly*sizeof(double));
+            atKickPolynom((double *)(Elem+1), (double *)(Elem+1)+npoly, PolynomA, PolynomB,
+                    npoly, Length, KickAngle);
+            PolynomA = (double *)(Elem+1);
+            PolynomB = PolynomA+npoly;
+        }
+        else
+            Elem = (struct elem*)atMalloc(sizeof(struct elem));
         Elem->Length = Length;
         Elem->PolynomA = PolynomA;
         Elem->PolynomB = PolynomB;
@@ -194,14 +189,13 @@ ExportMode struct elem* trackFunction(const atElem* ElemData, struct elem* Elem,
         Elem->T2 = T2;
         Elem->EApertures = EApertures;
         Elem->RApertures = RApertures;
-        Elem->KickAngle = KickAngle;
     }
     StrMPoleSymplectic4QuantPass(r_in, Elem->Length, Elem->PolynomA, Elem->PolynomB,
         Elem->MaxOrder, Elem->NumIntSteps, Elem->FringeQuadEntrance,
         Elem->FringeQuadExit, Elem->fringeIntM0, Elem->fringeIntP0,
         Elem->T1, Elem->T2, Elem->R1, Elem->R2,
-        Elem->RApertures, Elem->EApertures, Elem->KickAngle, Elem->Energy,
-        Param->thread_rng,
+        Elem->RApertures, Elem->EApertures, Elem->Energy,
+        Param->thread_rng, Param->nthread_rng,
         num_particles);
     return Elem;
 }
@@ -220,9 +214,13 @@ void mexFunction(int nlhs, mxArray* plhs[], int nrhs, const mxArray* prhs[])
         double Length, Energy;
         int MaxOrder, NumIntSteps, FringeQuadEntrance, FringeQuadExit;
         double *PolynomA, *PolynomB, *R1, *R2, *T1, *T2, *EApertures, *RApertures, *fringeIntM0, *fringeIntP0, *KickAngle;
+        double *PolynomAB = NULL;
+        int msz, nsz, npoly;
         Length=atGetDouble(ElemData,"Length"); check_error();
-        PolynomA=atGetDoubleArray(ElemData,"PolynomA"); check_error();
-        PolynomB=atGetDoubleArray(ElemData,"PolynomB"); check_error();
+        PolynomA=atGetDoubleArraySz(ElemData,"PolynomA",&msz,&nsz); check_error();
+        npoly=msz*nsz;
+        PolynomB=atGetDoubleArraySz(ElemData,"PolynomB",&msz,&nsz); check_error();
+        if (msz*nsz < npoly) npoly=msz*nsz;
         MaxOrder=atGetLong(ElemData,"MaxOrder"); check_error();
         NumIntSteps=atGetLong(ElemData,"NumIntSteps"); check_error();
         Energy=atGetDouble(ElemData,"Energy"); check_error();
@@ -238,16 +236,23 @@ void mexFunction(int nlhs, mxArray* plhs[], int nrhs, const mxArray* prhs[])
         EApertures=atGetOptionalDoubleArray(ElemData,"EApertures"); check_error();
         RApertures=atGetOptionalDoubleArray(ElemData,"RApertures"); check_error();
         KickAngle=atGetOptionalDoubleArray(ElemData,"KickAngle"); check_error();
-        
+
+        if (KickAngle) {    /* Effective coefficients including the corrector kick */
+            PolynomAB = (double *)atMalloc(2*npoly*sizeof(double));
+            atKickPolynom(PolynomAB, PolynomAB+npoly, PolynomA, PolynomB, npoly, Length, KickAngle);
+            PolynomA = PolynomAB;
+            PolynomB = PolynomAB+npoly;
+        }
         /* ALLOCATE memory for the output array of the same size as the input  */
         plhs[0] = mxDuplicateArray(prhs[1]);
         r_in = mxGetDoubles(plhs[0]);
         StrMPoleSymplectic4QuantPass(r_in, Length, PolynomA, PolynomB,
             MaxOrder, NumIntSteps,
             FringeQuadEntrance, FringeQuadExit, fringeIntM0, fringeIntP0,
-            T1, T2, R1, R2, RApertures, EApertures, KickAngle, Energy,
-            &pcg32_global,
+            T1, T2, R1, R2, RApertures, EApertures, Energy,
+            &pcg32_global, 1,
             num_particles);
+        if (PolynomAB) atFree(PolynomAB);
     } else if (nrhs == 0) {
         /* list of required fields */
         plhs[0] = mxCreateCellMatrix(6, 1);
@@ -1,6 +1,6 @@
 #include "atelem.c"
 #include "atlalib.c"
-#include "driftkickrad.c"	/* drift6.c, strthinkickrad.c */
+#include "driftkickrad.c"	/* drift6.c, thinkickrad.c */
 #include "quadfringe.c"		/* QuadFringePassP, QuadFringePassN */
 
 #define DRIFT1    0.6756035959798286638
@@ -29,7 +29,6 @@ struct elem
     double *T2;
     double *RApertures;
     double *EApertures;
-    double *KickAngle;
 };
 
 void StrMPoleSymplectic4RadPass(double *r, double le, double *A, double *B,
@@ -40,11 +39,12 @@ void StrMPoleSymplectic4RadPass(double *r, double le, double *A, double *B,
         double *T1, double *T2,
         double *R1, double *R2,
         double *RApertures, double *EApertures,
-        double *KickAngle, double E0,
+        double E0,
         int num_particles)
 {	int c,m;
     double *r6;
     double SL, L1, L2, K1, K2;
+    double crad = radiation_constant(E0);
     bool useLinFrEleEntrance = (fringeIntM0 != NULL && fringeIntP0 != NULL  && FringeQuadEntrance==2);
     bool useLinFrEleExit = (fringeIntM0 != NULL && fringeIntP0 != NULL  && FringeQuadExit==2);
     SL = le/num_int_steps;
@@ -53,10 +53,6 @@ void StrMPoleSymplectic4RadPass(double *r, double le, double *A, double *B,
     K1 = SL*KICK1;
     K2 = SL*KICK2;
     
-    if (KickAngle) {  /* Convert corrector component to polynomial coefficients */
-        B[0] -= sin(KickAngle[0])/le;
-        A[0] += sin(KickAngle[1])/le;
-    }
     #pragma omp parallel for if (num_particles > OMP_PARTICLE_THRESHOLD) default(shared) shared(r,num_particles) private(c,r6,m)
     for (c = 0;c<num_particles;c++)	{   /* Loop over particles  */
         r6 = r+c*6;
@@ -65,8 +61,7 @@ void StrMPoleSymplectic4RadPass(double *r, double le, double *A, double *B,
             if (T1) ATaddvv(r6,T1);
             if (R1) ATmultmv(r6,R1);
             /* Check physical apertures at the entrance of the magnet */
-            if (RApertures) checkiflostRectangularAp(r6,RApertures);
-            if (EApertures) checkiflostEllipticalAp(r6,EApertures);
+            checkiflostAperture(r6,RApertures,EApertures);
             if (FringeQuadEntrance && B[1]!=0) {
                 if (useLinFrEleEntrance) /*Linear fringe fields from elegant*/
                     linearQuadFringeElegantEntrance(r6, B[1], fringeIntM0, fringeIntP0);
@@ -77,11 +72,11 @@ void StrMPoleSymplectic4RadPass(double *r, double le, double *A, double *B,
             for (m=0; m < num_int_steps; m++) { /* Loop over slices */
              		r6 = r+c*6;
                     ATdrift6(r6,L1);
-                    strthinkickrad(r6, A, B, K1, E0, max_order);
+                    thinkickrad(r6, A, B, K1, 0.0, crad, max_order);
                     ATdrift6(r6,L2);
-                    strthinkickrad(r6, A, B, K2, E0, max_order);
+                    thinkickrad(r6, A, B, K2, 0.0, crad, max_order);
                     ATdrift6(r6,L2);
-                    strthinkickrad(r6, A, B, K1, E0, max_order);
+                    thinkickrad(r6, A, B, K1, 0.0, crad, max_order);
                     ATdrift6(r6,L1);
             }
             if (FringeQuadExit && B[1]!=0) {
@@ -91,17 +86,12 @@ void StrMPoleSymplectic4RadPass(double *r, double le, double *A, double *B,
                     QuadFringePassN(r6, B[1]);
             }
             /* Check physical apertures at the exit of the magnet */
-            if (RApertures) checkiflostRectangularAp(r6,RApertures);
-            if (EApertures) checkiflostEllipticalAp(r6,EApertures);
+            checkiflostAperture(r6,RApertures,EApertures);
             /* Misalignment at exit */
             if (R2) ATmultmv(r6,R2);
             if (T2) ATaddvv(r6,T2); 
         }
     }
-    if (KickAngle) {  /* Remove corrector component in polynomial coefficients */
-        B[0] += sin(KickAngle[0])/le; 
-        A[0] -= sin(KickAngle[1])/le;
-    }
 }
 
 #if defined(MATLAB_MEX_FILE) || defined(PYAT)
@@ -112,9 +102,12 @@ ExportMode struct elem *trackFunction(const atElem *ElemData,struct elem *Elem,
         double Length, Energy;
         int MaxOrder, NumIntSteps, FringeQuadEntrance, FringeQuadExit;
         double *PolynomA, *PolynomB, *R1, *R2, *T1, *T2, *EApertures, *RApertures, *fringeIntM0, *fringeIntP0, *KickAngle;
+        int msz, nsz, npoly;
         Length=atGetDouble(ElemData,"Length"); check_error();
-        PolynomA=atGetDoubleArray(ElemData,"PolynomA"); check_error();
-        PolynomB=atGetDoubleArray(ElemData,"PolynomB"); check_error();
+        PolynomA=atGetDoubleArraySz(ElemData,"PolynomA",&msz,&nsz); check_error();
+        npoly=msz*nsz;
+        PolynomB=atGetDoubleArraySz(ElemData,"PolynomB",&msz,&nsz); check_error();
+        if (msz*nsz < npoly) npoly=msz*nsz;
         MaxOrder=atGetLong(ElemData,"MaxOrder"); check_error();
         NumIntSteps=atGetLong(ElemData,"NumIntSteps"); check_error();
         Energy=atGetDouble(ElemData,"Energy"); check_error();
@@ -131,7 +124,15 @@ ExportMode struct elem *trackFunction(const atElem *ElemData,struct elem *Elem,
         RApertures=atGetOptionalDoubleArray(ElemData,"RApertures"); check_error();
         KickAngle=atGetOptionalDoubleArray(ElemData,"KickAngle"); check_error();
 
-        Elem = (struct elem*)atMalloc(sizeof(struct elem));
+        if (KickAngle) {    /* Effective coefficients including the corrector kick */
+            Elem = (struct elem*)atMalloc(sizeof(struct elem)+2*npoly*sizeof(double));
+            atKickPolynom((double *)(Elem+1), (double *)(Elem+1)+npoly, PolynomA, PolynomB,
+                    npoly, Length, KickAngle);
+            PolynomA = (double *)(Elem+1);
+            PolynomB = PolynomA+npoly;
+        }
+        else
+            Elem = (struct elem*)atMalloc(sizeof(struct elem));
         Elem->Length=Length;
         Elem->PolynomA=PolynomA;
         Elem->PolynomB=PolynomB;
@@ -149,13 +150,12 @@ ExportMode struct elem *trackFunction(const atElem *ElemData,struct elem *Elem,
         Elem->T2=T2;
         Elem->EApertures=EApertures;
         Elem->RApertures=RApertures;
-        Elem->KickAngle=KickAngle;
     }
     StrMPoleSymplectic4RadPass(r_in,Elem->Length,Elem->PolynomA,Elem->PolynomB,
             Elem->MaxOrder,Elem->NumIntSteps,Elem->FringeQuadEntrance,
             Elem->FringeQuadExit,Elem->fringeIntM0,Elem->fringeIntP0,
             Elem->T1,Elem->T2,Elem->R1,Elem->R2,
-            Elem->RApertures,Elem->EApertures,Elem->KickAngle,Elem->Energy,num_particles);
+            Elem->RApertures,Elem->EApertures,Elem->Energy,num_particles);
     return Elem;
 }
 
@@ -173,9 +173,13 @@ void mexFunction(	int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
         double Length, Energy;
         int MaxOrder, NumIntSteps, FringeQuadEntrance, FringeQuadExit;
         double *PolynomA, *PolynomB, *R1, *R2, *T1, *T2, *EApertures, *RApertures, *fringeIntM0, *fringeIntP0, *KickAngle;
+        double *PolynomAB = NULL;
+        int msz, nsz, npoly;
         Length=atGetDouble(ElemData,"Length"); check_error();
-        PolynomA=atGetDoubleArray(ElemData,"PolynomA"); check_error();
-        PolynomB=atGetDoubleArray(ElemData,"PolynomB"); check_error();
+        PolynomA=atGetDoubleArraySz(ElemData,"PolynomA",&msz,&nsz); check_error();
+        npoly=msz*nsz;
+        PolynomB=atGetDoubleArraySz(ElemData,"PolynomB",&msz,&nsz); check_error();
+        if (msz*nsz < npoly) npoly=msz*nsz;
         MaxOrder=atGetLong(ElemData,"MaxOrder"); check_error();
         NumIntSteps=atGetLong(ElemData,"NumIntSteps"); check_error();
         Energy=atGetDouble(ElemData,"Energy"); check_error();
@@ -192,12 +196,19 @@ void mexFunction(	int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
         RApertures=atGetOptionalDoubleArray(ElemData,"RApertures"); check_error();
         KickAngle=atGetOptionalDoubleArray(ElemData,"KickAngle"); check_error();
 
+        if (KickAngle) {    /* Effective coefficients including the corrector kick */
+            PolynomAB = (double *)atMalloc(2*npoly*sizeof(double));
+            atKickPolynom(PolynomAB, PolynomAB+npoly, PolynomA, PolynomB, npoly, Length, KickAngle);
+            PolynomA = PolynomAB;
+            PolynomB = PolynomAB+npoly;
+        }
         /* ALLOCATE memory for the output array of the same size as the input  */
         plhs[0] = mxDuplicateArray(prhs[1]);
         r_in = mxGetDoubles(plhs[0]);
         StrMPoleSymplectic4RadPass(r_in,Length,PolynomA,PolynomB,MaxOrder,NumIntSteps,
                 FringeQuadEntrance,FringeQuadExit,fringeIntM0,fringeIntP0,
-                T1,T2,R1,R2,RApertures,EApertures,KickAngle,Energy,num_particles);
+                T1,T2,R1,R2,RApertures,EApertures,Energy,num_particles);
+        if (PolynomAB) atFree(PolynomAB);
     }
     else if (nrhs == 0) {
         /* list of required fields */
@@ -10,6 +10,7 @@
 
 #define TWOPI 6.28318530717959
 #define C0 2.99792458e8
+#define WAVE_BLOCK 256      /* turns of precomputed waveform */
 
 struct elemab {
     double* Amplitude;
@@ -17,109 +18,161 @@ struct elemab {
     double Phase;
     int NSamples;
     double* Func;
+    /* Waveform of the turns of the block, including the ramps:
+       WAVE_BLOCK x (MaxOrder+1) values */
+    double* Wave;
 };
 
 struct elem {
     double* PolynomA;
     double* PolynomB;
-    struct elemab* ElemA;
-    struct elemab* ElemB;
+    struct elemab ElemA;
+    struct elemab ElemB;
     int Seed;
     int Mode;
     int MaxOrder;
     double* Ramps;
     int Periodic;
+    int BlockStart;             /* first turn of the precomputed block, -1 if none */
 };
 
-double get_amp(double amp, double* ramps, double t)
+static double get_ramp(double* ramps, double t)
+/* Ramp factor of the amplitude */
 {
-    double ampt = amp;
     if (ramps) {
         if (t <= ramps[0]) {
-            ampt = 0.0;
+            return 0.0;
         } else if (t <= ramps[1]) {
-            ampt = amp * (t - ramps[0]) / (ramps[1] - ramps[0]);
+            return (t - ramps[0]) / (ramps[1] - ramps[0]);
         } else if (t <= ramps[2]) {
-            ampt = amp;
+            return 1.0;
         } else if (t <= ramps[3]) {
-            ampt = amp - amp * (t - ramps[2]) / (ramps[3] - ramps[2]);
+            return 1.0 - (t - ramps[2]) / (ramps[3] - ramps[2]);
         } else {
-            ampt = 0.0;
+            return 0.0;
         }
     }
-    return ampt;
+    return 1.0;
 }
 
-double get_pol(struct elemab* elem, double* ramps, int mode,
-    double t, int turn, int seed, int order, int periodic)
+static void fill_wave(struct elemab* elem, double* ramps, int mode, int turn0,
+    int periodic, int maxorder, pcg32_random_t* rng)
+/* Waveform of the turns turn0 to turn0+WAVE_BLOCK-1, for the random and
+   tabulated modes. The random values are independent for each order */
 {
-    int idx;
-    double ampt, freq, ph, val;
-    double* func;
-    double* amp = elem->Amplitude;
-    if (!amp) {
-        return 0.0;
-    }
-    ampt = get_amp(amp[order], ramps, turn);
-    switch (mode) {
-    case 0:
-        freq = elem->Frequency;
-        ph = elem->Phase;
-        ampt *= sin(TWOPI * freq * t + ph);
-        return ampt;
-    case 1:
-        val = atrandn(0.0, 1.0);
-        ampt *= val;
-        return ampt;
-    case 2:
-        if (periodic || turn < elem->NSamples) {
-            func = elem->Func;
-            idx = turn % elem->NSamples;
-            ampt *= func[idx];
-            return ampt;
-        } else {
-            return 0.0;
+    int k, i, norder = maxorder + 1;
+    double* wave = elem->Wave;
+    if (!elem->Amplitude) return;
+    if (mode == 1) {
+        atrandn_vec_r(rng, wave, WAVE_BLOCK * norder, 0.0, 1.0);
+    } else {
+        for (k = 0; k < WAVE_BLOCK; k++) {
+            int turn = turn0 + k;
+            double w = 0.0;
+            if (elem->Func && (periodic || turn < elem->NSamples))
+                w = elem->Func[turn % elem->NSamples];
+            for (i = 0; i < norder; i++) wave[k * norder + i] = w;
         }
-    default:
-        return 0.0;
+    }
+    for (k = 0; k < WAVE_BLOCK; k++) {
+        double ramp = get_ramp(ramps, turn0 + k);
+        for (i = 0; i < norder; i++) wave[k * norder + i] *= ramp;
+    }
+}
+
+static void set_pol(double* pol, const struct elemab* elem, const double* w,
+    double scale, int maxorder)
+/* pol = scale * w * Amplitude, w is NULL for a waveform common to all orders */
+{
+    int i;
+    for (i = 0; i < maxorder + 1; i++) {
+        double wi = w ? scale * w[i] : scale;
+        pol[i] = elem->Amplitude ? wi * elem->Amplitude[i] : 0.0;
     }
 }
 
-void VariableThinMPolePass(double* r, struct elem* Elem, double t0, int turn, int num_particles)
+static void sine_kick(double* r6, const double* ampa, const double* ampb,
+    double sa, double sb, int max_order)
+/* Multipole kick with PolynomA = sa*ampa and PolynomB = sb*ampb: the two
+   polynomials are summed separately, then scaled */
 {
+    int i;
+    double ReA = 0.0, ImA = 0.0, ReB = 0.0, ImB = 0.0, tmp;
+    double x = r6[0], y = r6[2];
+    for (i = max_order; i >= 0; i--) {
+        if (ampa) {
+            tmp = ReA * x - ImA * y + ampa[i];
+            ImA = ImA * x + ReA * y;
+            ReA = tmp;
+        }
+        if (ampb) {
+            tmp = ReB * x - ImB * y + ampb[i];
+            ImB = ImB * x + ReB * y;
+            ReB = tmp;
+        }
+    }
+    r6[1] -= sb * ReB - sa * ImA;
+    r6[3] += sb * ImB + sa * ReA;
+}
 
-    int i, c;
-    double* r6;
+void VariableThinMPolePass(double* r, struct elem* Elem, double t0, int turn,
+    int num_particles, pcg32_random_t* rng)
+{
+    int c;
     double t = t0 * turn;
 
     int maxorder = Elem->MaxOrder;
     int periodic = Elem->Periodic;
     double* pola = Elem->PolynomA;
     double* polb = Elem->PolynomB;
-    int seed = Elem->Seed;
     int mode = Elem->Mode;
-    struct elemab* ElemA = Elem->ElemA;
-    struct elemab* ElemB = Elem->ElemB;
+    struct elemab* ElemA = &Elem->ElemA;
+    struct elemab* ElemB = &Elem->ElemB;
     double* ramps = Elem->Ramps;
 
-    if (mode != 0) {
-        for (i = 0; i < maxorder + 1; i++) {
-            pola[i] = get_pol(ElemA, ramps, mode, t, turn, seed, i, periodic);
-            polb[i] = get_pol(ElemB, ramps, mode, t, turn, seed, i, periodic);
-        };
-    };
-
-    for (c = 0; c < num_particles; c++) {
-        r6 = r + c * 6;
-        if (!atIsNaN(r6[0])) {
-            if (mode == 0) {
-                double tpart = t + r6[5] / C0;
-                for (i = 0; i < maxorder + 1; i++) {
-                    pola[i] = get_pol(ElemA, ramps, mode, tpart, turn, seed, i, periodic);
-                    polb[i] = get_pol(ElemB, ramps, mode, tpart, turn, seed, i, periodic);
-                };
-            };
-            strthinkick(r6, pola, polb, 1.0, maxorder);
+    if (mode == 0) {
+        /* The time of flight of each particle changes the phase of the sine */
+        double ramp = get_ramp(ramps, turn);
+        double pha = TWOPI * ElemA->Frequency * t + ElemA->Phase;
+        double phb = TWOPI * ElemB->Frequency * t + ElemB->Phase;
+        double ka = TWOPI * ElemA->Frequency / C0;
+        double kb = TWOPI * ElemB->Frequency / C0;
+        double* ampa = ElemA->Amplitude;
+        double* ampb = ElemB->Amplitude;
+        /* Polynoms of the reference particle */
+        set_pol(pola, ElemA, NULL, ramp * sin(pha), maxorder);
+        set_pol(polb, ElemB, NULL, ramp * sin(phb), maxorder);
+        #ifdef _OPENMP
+        #pragma omp parallel for if (num_particles > OMP_PARTICLE_THRESHOLD) default(none) \
+        shared(r,num_particles,ramp,pha,phb,ka,kb,ampa,ampb,maxorder) private(c)
+        #endif /*_OPENMP*/
+        for (c = 0; c < num_particles; c++) {
+            double* r6 = r + c * 6;
+            if (!atIsNaN(r6[0])) {
+                double sa = ramp * sin(pha + ka * r6[5]);
+                double sb = ramp * sin(phb + kb * r6[5]);
+                sine_kick(r6, ampa, ampb, sa, sb, maxorder);
+            }
+        }
+    } else if (mode == 1 || mode == 2) {
+        /* The waveform is the same for all the particles */
+        int k = turn - Elem->BlockStart;
+        if (Elem->BlockStart < 0 || k < 0 || k >= WAVE_BLOCK) {
+            fill_wave(ElemA, ramps, mode, turn, periodic, maxorder, rng);
+            fill_wave(ElemB, ramps, mode, turn, periodic, maxorder, rng);
+            Elem->BlockStart = turn;
+            k = 0;
+        }
+        set_pol(pola, ElemA, ElemA->Wave + k * (maxorder + 1), 1.0, maxorder);
+        set_pol(polb, ElemB, ElemB->Wave + k * (maxorder + 1), 1.0, maxorder);
+        #ifdef _OPENMP
+        #pragma omp parallel for if (num_particles > OMP_PARTICLE_THRESHOLD) default(none) \
+        shared(r,num_particles,pola,polb,maxorder) private(c)
+        #endif /*_OPENMP*/
+        for (c = 0; c < num_particles; c++) {
+            double* r6 = r + c * 6;
+            if (!atIsNaN(r6[0]))
+                strthinkick(r6, pola, polb, 1.0, maxorder);
         }
     }
 }
@@ -129,12 +182,11 @@ ExportMode struct elem* trackFunction(const atElem* ElemData, struct elem* Elem,
     double* r_in, int num_particles, struct parameters* Param)
 {
     if (!Elem) {
-        int MaxOrder, Mode, Seed, NSamplesA, NSamplesB, Periodic;
+        int MaxOrder, Mode, Seed, NSamplesA, NSamplesB, Periodic, nwave;
         double *PolynomA, *PolynomB, *AmplitudeA, *AmplitudeB;
         double *Ramps, *FuncA, *FuncB;
         double FrequencyA, FrequencyB;
         double PhaseA, PhaseB;
-        struct elemab *ElemA, *ElemB;
         MaxOrder=atGetLong(ElemData,"MaxOrder"); check_error();
         Mode=atGetLong(ElemData,"Mode"); check_error();
         PolynomA=atGetDoubleArray(ElemData,"PolynomA"); check_error();
@@ -152,9 +204,11 @@ ExportMode struct elem* trackFunction(const atElem* ElemData, struct elem* Elem,
         FuncA=atGetOptionalDoubleArray(ElemData,"FuncA"); check_error();
         FuncB=atGetOptionalDoubleArray(ElemData,"FuncB"); check_error();
         Periodic=atGetOptionalLong(ElemData,"Periodic", 1); check_error();
-        Elem = (struct elem*)atMalloc(sizeof(struct elem));
-        ElemA = (struct elemab*)atMalloc(sizeof(struct elemab));
-        ElemB = (struct elemab*)atMalloc(sizeof(struct elemab));
+        /* The waveform buffers follow the element structure */
+        nwave = WAVE_BLOCK * (MaxOrder + 1);
+        Elem = (struct elem*)atMalloc(sizeof(struct elem) + 2 * nwave * sizeof(double));
+        Elem->ElemA.Wave = (double*)(Elem + 1);
+        Elem->ElemB.Wave = Elem->ElemA.Wave + nwave;
         Elem->PolynomA = PolynomA;
         Elem->PolynomB = PolynomB;
         Elem->Ramps = Ramps;
@@ -162,25 +216,26 @@ ExportMode struct elem* trackFunction(const atElem* ElemData, struct elem* Elem,
         Elem->Mode = Mode;
         Elem->MaxOrder = MaxOrder;
         Elem->Periodic = Periodic;
-        ElemA->Amplitude = AmplitudeA;
-        ElemB->Amplitude = AmplitudeB;
-        ElemA->Frequency = FrequencyA;
-        ElemB->Frequency = FrequencyB;
-        ElemA->Phase = PhaseA;
-        ElemB->Phase = PhaseB;
-        ElemA->NSamples = NSamplesA;
-        ElemB->NSamples = NSamplesB;
-        ElemA->Func = FuncA;
-        ElemB->Func = FuncB;
-        Elem->ElemA = ElemA;
-        Elem->ElemB = ElemB;
+        Elem->BlockStart = -1;
+        Elem->ElemA.Amplitude = AmplitudeA;
+        Elem->ElemB.Amplitude = AmplitudeB;
+        Elem->ElemA.Frequency = FrequencyA;
+        Elem->ElemB.Frequency = FrequencyB;
+        Elem->ElemA.Phase = PhaseA;
+        Elem->ElemB.Phase = PhaseB;
+        Elem->ElemA.NSamples = NSamplesA;
+        Elem->ElemB.NSamples = NSamplesB;
+        Elem->ElemA.Func = FuncA;
+        Elem->ElemB.Func = FuncB;
     }
     double t0 = Param->T0;
     int turn = Param->nturn;
-    VariableThinMPolePass(r_in, Elem, t0, turn, num_particles);
+    VariableThinMPolePass(r_in, Elem, t0, turn, num_particles,
+        atrng_thread(Param->thread_rng, Param->nthread_rng));
     return Elem;
 }
 
+COLLECTIVE_PASSMETHOD
 MODULE_DEF(VariableThinMPolePass) /* Dummy module initialisation */
 
 #endif /*defined(MATLAB_MEX_FILE) || defined(PYAT)*/
@@ -197,8 +252,6 @@ void mexFunction(int nlhs, mxArray* plhs[], int nrhs, const mxArray* prhs[])
         double *Ramps, *FuncA, *FuncB;
         double FrequencyA, FrequencyB;
         double PhaseA, PhaseB;
-        struct elemab ElA, *ElemA = &ElA;
-        struct elemab ElB, *ElemB = &ElB;
         struct elem El, *Elem = &El;
         MaxOrder=atGetLong(ElemData,"MaxOrder"); check_error();
         Mode=atGetLong(ElemData,"Mode"); check_error();
@@ -224,22 +277,24 @@ void mexFunction(int nlhs, mxArray* plhs[], int nrhs, const mxArray* prhs[])
         Elem->Mode = Mode;
         Elem->MaxOrder = MaxOrder;
         Elem->Periodic = Periodic;
-        ElemA->Amplitude = AmplitudeA;
-        ElemB->Amplitude = AmplitudeB;
-        ElemA->Frequency = FrequencyA;
-        ElemB->Frequency = FrequencyB;
-        ElemA->Phase = PhaseA;
-        ElemB->Phase = PhaseB;
-        ElemA->NSamples = NSamplesA;
-        ElemB->NSamples = NSamplesB;
-        ElemA->Func = FuncA;
-        ElemB->Func = FuncB;
-        Elem->ElemA = ElemA;
-        Elem->ElemB = ElemB;
+        Elem->BlockStart = -1;
+        Elem->ElemA.Amplitude = AmplitudeA;
+        Elem->ElemB.Amplitude = AmplitudeB;
+        Elem->ElemA.Frequency = FrequencyA;
+        Elem->ElemB.Frequency = FrequencyB;
+        Elem->ElemA.Phase = PhaseA;
+        Elem->ElemB.Phase = PhaseB;
+        Elem->ElemA.NSamples = NSamplesA;
+        Elem->ElemB.NSamples = NSamplesB;
+        Elem->ElemA.Func = FuncA;
+        Elem->ElemB.Func = FuncB;
+        Elem->ElemA.Wave = (double*)atMalloc(2 * WAVE_BLOCK * (MaxOrder + 1) * sizeof(double));
+        Elem->ElemB.Wave = Elem->ElemA.Wave + WAVE_BLOCK * (MaxOrder + 1);
         /* ALLOCATE memory for the output array of the same size as the input  */
         plhs[0] = mxDuplicateArray(prhs[1]);
         r_in = mxGetDoubles(plhs[0]);
-        VariableThinMPolePass(r_in, Elem, 0, 0, num_particles);
+        VariableThinMPolePass(r_in, Elem, 0, 0, num_particles, &pcg32_global);
+        atFree(Elem->ElemA.Wave);
     } else if (nrhs == 0) {
         /* list of required fields */
         plhs[0] = mxCreateCellMatrix(4, 1);
@@ -12,6 +12,9 @@ struct elem
   int nslice;
   int nelem;
   int nturns;
+  double wakestep;
+  int fftconv;
+  int bunchpc;
   double *normfact;
   double *waketableT;
   double *waketableDX;
@@ -20,6 +23,7 @@ struct elem
   double *waketableQY;
   double *waketableZ;
   double *turnhistory;
+  double *historyhead;
   double *z_cuts;
 };
 
@@ -33,6 +37,9 @@ void WakeFieldPass(double *r_in,int num_particles,double circumference,int nbunc
     long nslice = Elem->nslice;
     long nelem = Elem->nelem;
     long nturns = Elem->nturns;
+    double wakestep = Elem->wakestep;
+    int fftconv = Elem->fftconv;
+    int bunchpc = Elem->bunchpc;
     double *normfact = Elem->normfact;
     double *waketableT = Elem->waketableT;
     double *waketableDX = Elem->waketableDX;
@@ -41,10 +48,11 @@ void WakeFieldPass(double *r_in,int num_particles,double circumference,int nbunc
     double *waketableQY = Elem->waketableQY;
     double *waketableZ = Elem->waketableZ;
     double *turnhistory = Elem->turnhistory;
+    double *historyhead = Elem->historyhead;
     double *z_cuts = Elem->z_cuts;    
 
     size_t sz = 5*nslice*nbunch*sizeof(double) + num_particles*sizeof(int);
-    int c;
+    int c, head;
 
     int *pslice;
     double *kx;
@@ -67,12 +75,24 @@ void WakeFieldPass(double *r_in,int num_particles,double circumference,int nbunc
     pslice = iptr; iptr += num_particles;
 
     /*slices beam and compute kick*/
-    rotate_table_history(nturns,nslice*nbunch,turnhistory,circumference);
-    slice_bunch(r_in,num_particles,nslice,nturns,nbunch,bunch_spos,bunch_currents,
+    head = advance_table_history(nturns,nslice*nbunch,turnhistory,historyhead);
+    slice_bunch(r_in,num_particles,nslice,nturns,head,nbunch,bunch_spos,bunch_currents,
                 turnhistory,pslice,z_cuts);
-    compute_kicks(nslice*nbunch,nturns,nelem,turnhistory,waketableT,waketableDX,
-                  waketableDY,waketableQX,waketableQY,waketableZ,
-                  normfact,kx,ky,kx2,ky2,kz);
+    /* The other bunches and turns may be seen as point charges. The FFT
+       convolution falls back to the direct summation if the grid is too large */
+    if (bunchpc) {
+        compute_kicks_bunched(nslice,nbunch,nturns,head,circumference,nelem,wakestep,turnhistory,
+                              waketableT,waketableDX,waketableDY,waketableQX,waketableQY,
+                              waketableZ,normfact,kx,ky,kx2,ky2,kz);
+    }
+    else if (!fftconv || compute_kicks_fft(nslice*nbunch,nturns,head,circumference,nelem,
+                                           turnhistory,waketableT,
+                                           waketableDX,waketableDY,waketableQX,waketableQY,
+                                           waketableZ,normfact,kx,ky,kx2,ky2,kz) != 0) {
+        compute_kicks(nslice*nbunch,nturns,head,circumference,nelem,wakestep,turnhistory,
+                      waketableT,waketableDX,waketableDY,waketableQX,waketableQY,waketableZ,
+                      normfact,kx,ky,kx2,ky2,kz);
+    }
     
     /*apply kicks*/
     /* OpenMP not efficient. Too much shared data ?
@@ -98,7 +118,8 @@ ExportMode struct elem *trackFunction(const atElem *ElemData,struct elem *Elem,
 {
     if (!Elem) {
         long nslice,nelem,nturns;
-        double wakefact;
+        int fftconv, bunchpc;
+        double wakefact, wakestep;
         static double lnf[3];
         double *normfact;
         double *waketableT;
@@ -108,6 +129,7 @@ ExportMode struct elem *trackFunction(const atElem *ElemData,struct elem *Elem,
         double *waketableQY;
         double *waketableZ;
         double *turnhistory;
+        double *historyhead;
         double *z_cuts;
         int i;
 
@@ -125,12 +147,19 @@ ExportMode struct elem *trackFunction(const atElem *ElemData,struct elem *Elem,
         waketableQY=atGetOptionalDoubleArray(ElemData,"_wakeQY"); check_error();
         waketableZ=atGetOptionalDoubleArray(ElemData,"_wakeZ"); check_error();
         z_cuts=atGetOptionalDoubleArray(ElemData,"ZCuts"); check_error();
+        historyhead=atGetOptionalDoubleArray(ElemData,"_historyhead"); check_error();
+        fftconv=atGetOptionalLong(ElemData,"FFTConvolution",0); check_error();
+        wakestep=atGetOptionalDouble(ElemData,"_wakeStep",0.0); check_error();
+        bunchpc=atGetOptionalLong(ElemData,"BunchPointCharge",0); check_error();
 
         
         Elem = (struct elem*)atMalloc(sizeof(struct elem));
         Elem->nslice=nslice;
         Elem->nelem=nelem;
         Elem->nturns=nturns;
+        Elem->wakestep=wakestep;
+        Elem->fftconv=fftconv;
+        Elem->bunchpc=bunchpc;
         for(i=0;i<3;i++){
            lnf[i]=normfact[i]*wakefact;
         }
@@ -142,6 +171,7 @@ ExportMode struct elem *trackFunction(const atElem *ElemData,struct elem *Elem,
         Elem->waketableQY=waketableQY;
         Elem->waketableZ=waketableZ;
         Elem->turnhistory=turnhistory;
+        Elem->historyhead=historyhead;
         Elem->z_cuts=z_cuts;
     }
     if(num_particles<Param->nbunch){
@@ -154,6 +184,7 @@ ExportMode struct elem *trackFunction(const atElem *ElemData,struct elem *Elem,
     return Elem;
 }
 
+COLLECTIVE_PASSMETHOD
 MODULE_DEF(WakeFieldPass)        /* Dummy module initialisation */
 
 #endif /*defined(MATLAB_MEX_FILE) || defined(PYAT)*/
@@ -171,7 +202,8 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
         struct elem El, *Elem=&El;
 
         long nslice,nelem,nturns;
-        double wakefact;
+        int fftconv, bunchpc;
+        double wakefact, wakestep;
         static double lnf[3];
         double *normfact;
         double *waketableT;
@@ -181,6 +213,7 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
         double *waketableQY;
         double *waketableZ;
         double *turnhistory;
+        double *historyhead;
         double *z_cuts;
 
         nslice=atGetLong(ElemData,"_nslice"); check_error();
@@ -197,10 +230,17 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
         waketableQY=atGetOptionalDoubleArray(ElemData,"_wakeQY"); check_error();
         waketableZ=atGetOptionalDoubleArray(ElemData,"_wakeZ"); check_error();
         z_cuts=atGetOptionalDoubleArray(ElemData,"ZCuts"); check_error();
+        historyhead=atGetOptionalDoubleArray(ElemData,"_historyhead"); check_error();
+        fftconv=atGetOptionalLong(ElemData,"FFTConvolution",0); check_error();
+        wakestep=atGetOptionalDouble(ElemData,"_wakeStep",0.0); check_error();
+        bunchpc=atGetOptionalLong(ElemData,"BunchPointCharge",0); check_error();
         
         Elem->nslice=nslice;
         Elem->nelem=nelem;
         Elem->nturns=nturns;
+        Elem->wakestep=wakestep;
+        Elem->fftconv=fftconv;
+        Elem->bunchpc=bunchpc;
         for(i=0;i<3;i++){
            lnf[i]=normfact[i]*wakefact;
         }
@@ -212,6 +252,7 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
         Elem->waketableQY=waketableQY;
         Elem->waketableZ=waketableZ;
         Elem->turnhistory=turnhistory;
+        Elem->historyhead=historyhead;
         Elem->z_cuts=z_cuts;
 
         if (mxGetM(prhs[1]) != 6) mexErrMsgIdAndTxt("AT:WrongArg","Second argument must be a 6 x N matrix: particle array");
@@ -239,13 +280,15 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
 
         if (nlhs>1) {
             /* list of optional fields */
-            plhs[1] = mxCreateCellMatrix(6,1); /* No optional fields */
-            mxSetCell(plhs[0],0,mxCreateString("_wakeDX"));
-            mxSetCell(plhs[0],1,mxCreateString("_wakeDY"));
-            mxSetCell(plhs[0],2,mxCreateString("_wakeQX"));
-            mxSetCell(plhs[0],3,mxCreateString("_wakeQY"));
-            mxSetCell(plhs[0],4,mxCreateString("_wakeZ"));
-            mxSetCell(plhs[0],5,mxCreateString("ZCuts"));
+            plhs[1] = mxCreateCellMatrix(8,1);
+            mxSetCell(plhs[1],0,mxCreateString("_wakeDX"));
+            mxSetCell(plhs[1],1,mxCreateString("_wakeDY"));
+            mxSetCell(plhs[1],2,mxCreateString("_wakeQX"));
+            mxSetCell(plhs[1],3,mxCreateString("_wakeQY"));
+            mxSetCell(plhs[1],4,mxCreateString("_wakeZ"));
+            mxSetCell(plhs[1],5,mxCreateString("ZCuts"));
+            mxSetCell(plhs[1],6,mxCreateString("FFTConvolution"));
+            mxSetCell(plhs[1],7,mxCreateString("_historyhead"));
         }
     }
     else {
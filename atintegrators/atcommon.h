@@ -42,6 +42,33 @@
 #include <stdlib.h>
 #include <math.h>
 
+/* Runtime CPU dispatch of the vectorized kernels: GCC builds on x86_64 Linux
+   compile AVX-512, AVX2 and baseline versions of the tagged functions and
+   select the best one at load time */
+#if defined(__GNUC__) && !defined(__clang__) && (__GNUC__ >= 6) && \
+    defined(__x86_64__) && defined(__linux__) && !defined(AT_NO_SIMD_DISPATCH)
+#define AT_SIMD_DISPATCH __attribute__((target_clones("avx512f","avx2","default")))
+#else
+#define AT_SIMD_DISPATCH
+#endif
+
+/* Vectorization of the particle loops, hidden from non-OpenMP builds */
+#if defined(_OPENMP) && !defined(_MSC_VER)
+#define AT_OMP_SIMD _Pragma("omp simd")
+#else
+#define AT_OMP_SIMD
+#endif
+
+/* Small kernels inlined in their callers, so that constant arguments
+   (for instance the multipole order) are propagated into their loops */
+#if defined(__GNUC__)
+#define AT_INLINE static inline __attribute__((always_inline))
+#elif defined(_MSC_VER)
+#define AT_INLINE static __forceinline
+#else
+#define AT_INLINE static
+#endif
+
 /* All Windows builds */
 #if defined(PCWIN) || defined(_WIN32)
 #define ExportMode __declspec(dllexport)
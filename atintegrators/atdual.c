@@ -0,0 +1,217 @@
+/*   File: atdual.c
+     Dual numbers for tangent map tracking
+
+     An atdual holds a value and its derivatives with respect to the 6
+     initial coordinates of a particle. A tangent particle is made of 6
+     atdual (42 doubles): tracking it gives in a single pass the
+     coordinates and the 6x6 transfer matrix,
+     r[i].v = x_i and r[i].d[j] = dx_i/dx0_j.
+
+     The tangent kernels below follow the operations of the corresponding
+     kernels in atlalib.c, driftkick.c and atphyslib.c.
+*/
+
+#ifndef ATDUAL_C
+#define ATDUAL_C
+
+#include <math.h>
+
+#define ATDUAL_SIZE 7       /* doubles per coordinate */
+
+typedef struct {
+    double v;
+    double d[6];
+} atdual;
+
+static atdual dual_const(double v)
+{
+    atdual c = {v, {0.0, 0.0, 0.0, 0.0, 0.0, 0.0}};
+    return c;
+}
+
+static atdual dual_add(atdual a, atdual b)
+{
+    int j;
+    a.v += b.v;
+    for (j=0; j<6; j++) a.d[j] += b.d[j];
+    return a;
+}
+
+static atdual dual_sub(atdual a, atdual b)
+{
+    int j;
+    a.v -= b.v;
+    for (j=0; j<6; j++) a.d[j] -= b.d[j];
+    return a;
+}
+
+static atdual dual_addc(atdual a, double c)
+{
+    a.v += c;
+    return a;
+}
+
+static atdual dual_scale(atdual a, double c)
+{
+    int j;
+    a.v *= c;
+    for (j=0; j<6; j++) a.d[j] *= c;
+    return a;
+}
+
+static atdual dual_mul(atdual a, atdual b)
+{
+    int j;
+    atdual p;
+    p.v = a.v*b.v;
+    for (j=0; j<6; j++) p.d[j] = a.d[j]*b.v + a.v*b.d[j];
+    return p;
+}
+
+static atdual dual_div(atdual a, atdual b)
+{
+    int j;
+    atdual q;
+    q.v = a.v/b.v;
+    for (j=0; j<6; j++) q.d[j] = (a.d[j] - q.v*b.d[j])/b.v;
+    return q;
+}
+
+static atdual dual_func(atdual a, double fa, double dfa)
+/* f(a), given f and its derivative at a.v */
+{
+    int j;
+    atdual f;
+    f.v = fa;
+    for (j=0; j<6; j++) f.d[j] = dfa*a.d[j];
+    return f;
+}
+
+static atdual dual_sin(atdual a)
+{
+    return dual_func(a, sin(a.v), cos(a.v));
+}
+
+static atdual dual_tan(atdual a)
+{
+    double t = tan(a.v);
+    return dual_func(a, t, 1.0+t*t);
+}
+
+/* Tangent particle kernels */
+
+static void dual_init(atdual *r, const double *r6)
+/* Tangent particle starting at r6, with the identity matrix */
+{
+    int i;
+    for (i=0; i<6; i++) {
+        r[i] = dual_const(r6[i]);
+        r[i].d[i] = 1.0;
+    }
+}
+
+static void dual_addvv(atdual *r, const double *dr)
+{
+    int i;
+    for (i=0; i<6; i++) r[i].v += dr[i];
+}
+
+static void dual_multmv(atdual *r, const double *A)
+/* r = A*r, A stored column by column as in ATmultmv */
+{
+    int i, j;
+    atdual temp[6];
+    for (i=0; i<6; i++) {
+        temp[i] = dual_const(0.0);
+        for (j=0; j<6; j++)
+            temp[i] = dual_add(temp[i], dual_scale(r[j], A[i+j*6]));
+    }
+    for (i=0; i<6; i++) r[i] = temp[i];
+}
+
+static void dual_checkaperture(atdual *r, const double *RApertures, const double *EApertures)
+/* Apertures act on the coordinates only */
+{
+    int i;
+    double r6[6];
+    for (i=0; i<6; i++) r6[i] = r[i].v;
+    checkiflostAperture(r6,RApertures,EApertures);
+    r[5].v = r6[5];
+}
+
+static void dual_drift6(atdual *r, double L)
+/* Same as ATdrift6 and fastdrift: 1/(1+delta) normalization is done internally */
+{
+    atdual p_norm = dual_div(dual_const(1.0), dual_addc(r[4], 1.0));
+    atdual NormL = dual_scale(p_norm, L);
+    atdual p2 = dual_add(dual_mul(r[1], r[1]), dual_mul(r[3], r[3]));
+    r[0] = dual_add(r[0], dual_mul(NormL, r[1]));
+    r[2] = dual_add(r[2], dual_mul(NormL, r[3]));
+    r[5] = dual_add(r[5], dual_scale(dual_mul(dual_mul(NormL, p_norm), p2), 0.5));
+}
+
+static void dual_field(const atdual *r, const double *A, const double *B, int max_order,
+                       atdual *ReSum, atdual *ImSum)
+/* Horner evaluation of the multipole field, as in strthinkick */
+{
+    int i;
+    atdual re = dual_const(B[max_order]);
+    atdual im = dual_const(A[max_order]);
+    for (i=max_order-1; i>=0; i--) {
+        atdual retemp = dual_addc(dual_sub(dual_mul(re, r[0]), dual_mul(im, r[2])), B[i]);
+        im = dual_addc(dual_add(dual_mul(im, r[0]), dual_mul(re, r[2])), A[i]);
+        re = retemp;
+    }
+    *ReSum = re;
+    *ImSum = im;
+}
+
+static void dual_strthinkick(atdual *r, const double *A, const double *B, double L, int max_order)
+{
+    atdual ReSum, ImSum;
+    dual_field(r, A, B, max_order, &ReSum, &ImSum);
+    r[1] = dual_sub(r[1], dual_scale(ReSum, L));
+    r[3] = dual_add(r[3], dual_scale(ImSum, L));
+}
+
+static void dual_bndthinkick(atdual *r, const double *A, const double *B, double L, double irho, int max_order)
+{
+    atdual ReSum, ImSum;
+    dual_field(r, A, B, max_order, &ReSum, &ImSum);
+    /* r[1] -= L*(ReSum-(r[4]-r[0]*irho)*irho) */
+    ReSum = dual_sub(ReSum, dual_scale(dual_sub(r[4], dual_scale(r[0], irho)), irho));
+    r[1] = dual_sub(r[1], dual_scale(ReSum, L));
+    r[3] = dual_add(r[3], dual_scale(ImSum, L));
+    r[5] = dual_add(r[5], dual_scale(r[0], L*irho));
+}
+
+static void dual_edge_fringe(atdual *r, double inv_rho, double edge_angle,
+        double fint, double gap, int method, int exit)
+/* Same as edge_fringe_entrance (exit=0) and edge_fringe_exit (exit=1) */
+{
+    double fringecorr, fx;
+    atdual dp1 = dual_addc(r[4], 1.0);
+    atdual fy;
+    if ((fint==0.0) || (gap==0.0) || (method==0))
+        fringecorr = 0.0;
+    else {
+        double sedge = sin(edge_angle);
+        double cedge = cos(edge_angle);
+        fringecorr = inv_rho*gap*fint*(1+sedge*sedge)/cedge;
+    }
+    fx = inv_rho*tan(edge_angle);
+    if (method==3) {
+        atdual psi = dual_div(r[1], dp1);
+        if (exit) psi = dual_scale(psi, -1.0);
+        fy = dual_scale(dual_tan(dual_addc(psi, edge_angle-fringecorr)), inv_rho);
+    }
+    else {
+        atdual psi = dual_scale(dual_div(dual_const(fringecorr), dp1), -1.0);
+        fy = dual_scale(dual_tan(dual_addc(psi, edge_angle)), inv_rho);
+        if (method==2) fy = dual_div(fy, dp1);
+    }
+    r[1] = dual_add(r[1], dual_scale(r[0], fx));
+    r[3] = dual_sub(r[3], dual_mul(r[2], fy));
+}
+
+#endif /*ATDUAL_C*/
@@ -143,11 +143,93 @@ static double* atGetOptionalDoubleArray(const mxArray *ElemData, const char *fie
 
 typedef PyObject atElem;
 #define check_error() if (PyErr_Occurred()) return NULL
-#define atError(...) return (struct elem *) PyErr_Format(PyExc_ValueError, __VA_ARGS__)
-#define atWarning(...) if (PyErr_WarnFormat(PyExc_RuntimeWarning, 0, __VA_ARGS__) != 0) return NULL
+#define atError(...) return atPyError(__VA_ARGS__)
+#define atWarning(...) if (atPyWarning(__VA_ARGS__) != 0) return NULL
+
+/* atError and atWarning may be called while tracking with the GIL
+   released: acquire it before setting the Python exception */
+static struct elem *atPyError(const char *format, ...)
+{
+    va_list vargs;
+    PyGILState_STATE gstate = PyGILState_Ensure();
+    va_start(vargs, format);
+    PyErr_FormatV(PyExc_ValueError, format, vargs);
+    va_end(vargs);
+    PyGILState_Release(gstate);
+    return NULL;
+}
+
+static int atPyWarning(const char *format, ...)
+{
+    char message[256];
+    int status;
+    va_list vargs;
+    PyGILState_STATE gstate = PyGILState_Ensure();
+    va_start(vargs, format);
+    PyOS_vsnprintf(message, sizeof(message), format, vargs);
+    va_end(vargs);
+    status = PyErr_WarnEx(PyExc_RuntimeWarning, message, 0);
+    PyGILState_Release(gstate);
+    return status;
+}
 
 static int array_imported = 0;
 
+/* Attribute names are interned once per integrator. The names are C string
+   literals: they are first identified by their address */
+#define AT_NAME_CACHE_SIZE 64
+static struct {
+    const char *name;
+    PyObject *key;
+} atNameCache[AT_NAME_CACHE_SIZE];
+static int atNameCount = 0;
+
+static PyObject *atAttrName(const char *name)
+/* Return a new reference to the interned name */
+{
+    int i;
+    PyObject *key;
+    for (i=0; i<atNameCount; i++) {
+        if (atNameCache[i].name == name &&
+            strcmp(PyUnicode_AsUTF8(atNameCache[i].key), name) == 0) {
+            Py_INCREF(atNameCache[i].key);
+            return atNameCache[i].key;
+        }
+    }
+    key = PyUnicode_InternFromString(name);
+    if (key && atNameCount < AT_NAME_CACHE_SIZE) {
+        Py_INCREF(key);     /* reference kept by the cache */
+        atNameCache[atNameCount].name = name;
+        atNameCache[atNameCount].key = key;
+        atNameCount++;
+    }
+    return key;
+}
+
+static PyObject *atGetAttr(const PyObject *element, const char *name)
+/* Same as PyObject_GetAttrString, but the attribute is looked for directly
+   in the instance dictionary. The generic lookup is used only for attributes
+   which are not found there (class attributes, properties, missing ones) */
+{
+    PyObject *el = (PyObject *)element;
+    PyObject *key = atAttrName(name);
+    PyObject *dict, *attr = NULL;
+    if (!key) return NULL;
+    dict = PyObject_GenericGetDict(el, NULL);
+    if (dict) {
+        attr = PyDict_GetItemWithError(dict, key);
+        Py_XINCREF(attr);
+        Py_DECREF(dict);
+    }
+    else {
+        PyErr_Clear();
+    }
+    if (!attr && !PyErr_Occurred())
+        attr = PyObject_GetAttr(el, key);
+    Py_DECREF(key);
+    return attr;
+}
+
 static NUMPY_IMPORT_ARRAY_TYPE init_numpy(void)
 {
     import_array();
@@ -156,7 +238,7 @@ static NUMPY_IMPORT_ARRAY_TYPE init_numpy(void)
 
 static long atGetLong(const PyObject *element, const char *name)
 {
-    const PyObject *attr = PyObject_GetAttrString((PyObject *)element, name);
+    const PyObject *attr = atGetAttr(element, name);
     if (!attr) return 0L;
     Py_DECREF(attr);
     return PyLong_AsLong((PyObject *)attr);
@@ -164,7 +246,7 @@ static long atGetLong(const PyObject *element, const char *name)
 
 static double atGetDouble(const PyObject *element, const char *name)
 {
-    const PyObject *attr = PyObject_GetAttrString((PyObject *)element, name);
+    const PyObject *attr = atGetAttr(element, name);
     if (!attr) return 0.0;
     Py_DECREF(attr);
     return PyFloat_AsDouble((PyObject *)attr);
@@ -193,38 +275,33 @@ static double atGetOptionalDouble(const PyObject *element, const char *name, dou
 static double *atGetArrayData(PyArrayObject *array, char *name, int atype, int *msz, int *nsz)
 {
     char errmessage[60];
-    int ndims;
-    npy_intp *dims;
     if (!array_imported) {
         init_numpy();
         array_imported = 1;
     }
     Py_DECREF(array);
-    if (!PyArray_Check(array)) {
-        snprintf(errmessage, 60, "The attribute %s is not an array.", name);
-        PyErr_SetString(PyExc_RuntimeError, errmessage);
-        return NULL;
+    /* Fast path: type and layout tested together, diagnosed only if wrong */
+    if (PyArray_Check(array) && PyArray_TYPE(array) == atype &&
+        (PyArray_FLAGS(array) & NPY_ARRAY_FARRAY_RO) == NPY_ARRAY_FARRAY_RO) {
+        int ndims = PyArray_NDIM(array);
+        npy_intp *dims = PyArray_SHAPE(array);
+        *nsz = (ndims >= 2) ? dims[1] : 0;
+        *msz = (ndims >= 1) ? dims[0] : 0;
+        return (double *) PyArray_DATA(array);
     }
-    if (PyArray_TYPE(array) != atype) {
+    if (!PyArray_Check(array))
+        snprintf(errmessage, 60, "The attribute %s is not an array.", name);
+    else if (PyArray_TYPE(array) != atype)
         snprintf(errmessage, 60, "The attribute %s is not a double array.", name);
-        PyErr_SetString(PyExc_RuntimeError, errmessage);
-        return NULL;
-    }
-    if ((PyArray_FLAGS(array) & NPY_ARRAY_FARRAY_RO) != NPY_ARRAY_FARRAY_RO) {
+    else
         snprintf(errmessage, 60, "The attribute %s is not Fortran-aligned.", name);
-        PyErr_SetString(PyExc_RuntimeError, errmessage);
-        return NULL;
-    }
-    ndims = PyArray_NDIM(array);
-    dims = PyArray_SHAPE(array);
-    *nsz = (ndims >= 2) ? dims[1] : 0;
-    *msz = (ndims >= 1) ? dims[0] : 0;
-    return (double *) PyArray_DATA(array);
+    PyErr_SetString(PyExc_RuntimeError, errmessage);
+    return NULL;
 }
 
 static double *atGetDoubleArraySz(const PyObject *element, char *name, int *msz, int *nsz)
 {
-    PyArrayObject *array = (PyArrayObject *) PyObject_GetAttrString((PyObject *)element, name);
+    PyArrayObject *array = (PyArrayObject *) atGetAttr(element, name);
     if (array == NULL) {
         return NULL;
     }
@@ -239,7 +316,7 @@ static double *atGetDoubleArray(const PyObject *element, char *name)
 
 static double *atGetOptionalDoubleArraySz(const PyObject *element, char *name, int *msz, int *nsz)
 {
-    PyArrayObject *array = (PyArrayObject *) PyObject_GetAttrString((PyObject *)element, name);
+    PyArrayObject *array = (PyArrayObject *) atGetAttr(element, name);
     if (array == NULL) {
         PyErr_Clear();
         return NULL;
@@ -264,9 +341,53 @@ static double *atGetOptionalDoubleArray(const PyObject *element, char *name)
 #define C_LINK
 #endif
 
+/* Main entry point. Elem is NULL on the first call: the integrator then
+   builds its struct elem from ElemData, and the returned pointer is given
+   back on the following calls. Constants depending only on the element
+   attributes (edge fringe factors, effective coefficients...) should be
+   derived at that point and stored in struct elem: the cache is rebuilt
+   whenever the element is modified */
 C_LINK ExportMode struct elem *trackFunction(const atElem *ElemData, struct elem *Elem, double *r_in,
                                       int num_particles, struct parameters *Param);
 
+/* Optional entry point for integrators supporting the structure-of-arrays
+   particle layout: r_in is a 6 x num_particles array stored row by row */
+C_LINK ExportMode struct elem *trackFunctionSoA(const atElem *ElemData, struct elem *Elem, double *r_in,
+                                      int num_particles, struct parameters *Param);
+
+/* Optional entry point for integrators supporting the tangent map tracking:
+   r_in holds num_particles tangent particles of 6 atdual (see atdual.c).
+   Returning NULL without raising an error means that the element cannot
+   be tracked in tangent mode */
+C_LINK ExportMode struct elem *trackFunctionTangent(const atElem *ElemData, struct elem *Elem, double *r_in,
+                                      int num_particles, struct parameters *Param);
+
+/* Collective integrators must see all the particles at once (bunch slicing,
+   beam moments, random values common to all particles). They declare it with
+   COLLECTIVE_PASSMETHOD so that the tracking engine never splits the
+   particles between threads when calling them */
+#define COLLECTIVE_PASSMETHOD C_LINK ExportMode const int atCollective = 1;
+
 #endif /* defined(PYAT) || defined(MATLAB_MEX_FILE) */
 
+/*----------------------------------------------------*/
+/*            Precomputed element data                */
+/*----------------------------------------------------*/
+
+/* Effective polynomial coefficients of a magnet with a corrector kick:
+   copy n coefficients of A and B into Aeff and Beff, with KickAngle
+   converted into dipole components. The element arrays are not modified,
+   so that they are only read while tracking */
+static void atKickPolynom(double *Aeff, double *Beff, const double *A, const double *B,
+                          int n, double le, const double *KickAngle)
+{
+    int i;
+    for (i=0; i<n; i++) {
+        Aeff[i] = A[i];
+        Beff[i] = B[i];
+    }
+    Beff[0] -= sin(KickAngle[0])/le;
+    Aeff[0] += sin(KickAngle[1])/le;
+}
+
 #endif /*ATELEM_C*/
@@ -0,0 +1,158 @@
+/*   File: atfft.c
+     Fast Fourier transform for Accelerator Toolbox
+
+     In-place iterative radix-2 complex FFT, with real and imaginary
+     parts stored in separate arrays. The length must be a power of 2:
+     use atfft_size to get the smallest suitable length.
+
+     atfft_bluestein transforms arrays of any length n by expressing the
+     DFT as a convolution with a chirp (Bluestein's algorithm), computed
+     with power-of-2 transforms. Its work array, of atfft_bluestein_size(n)
+     doubles, is set up once by atfft_bluestein_init and may then be reused
+     for any number of transforms of length n.
+*/
+
+#ifndef ATFFT_C
+#define ATFFT_C
+
+#include <math.h>
+
+#ifndef TWOPI
+#define TWOPI  6.28318530717959
+#endif /*TWOPI*/
+
+static unsigned int atfft_size(unsigned int n)
+/* Smallest power of 2 larger than or equal to n */
+{
+    unsigned int nfft = 1;
+    while (nfft < n) nfft <<= 1;
+    return nfft;
+}
+
+static void atfft(double *re, double *im, unsigned int n, int inverse)
+/* Forward transform: X[k] = sum(x[j]*exp(-2i*pi*j*k/n))
+   Inverse transform (inverse != 0): x[j] = sum(X[k]*exp(2i*pi*j*k/n))/n */
+{
+    unsigned int i, j, k, len;
+    double sign = inverse ? 1.0 : -1.0;
+
+    /* bit-reversal permutation */
+    for (i=1, j=0; i<n; i++) {
+        unsigned int bit = n >> 1;
+        for (; j & bit; bit >>= 1) j ^= bit;
+        j ^= bit;
+        if (i < j) {
+            double t;
+            t = re[i]; re[i] = re[j]; re[j] = t;
+            t = im[i]; im[i] = im[j]; im[j] = t;
+        }
+    }
+    /* butterflies, with the twiddle factors computed by a stable recurrence.
+       Each block is processed in turn so that the memory is accessed
+       sequentially, the recurrence being restarted for each block */
+    for (len=2; len<=n; len<<=1) {
+        double theta = sign*TWOPI/len;
+        double wpr = -2.0*sin(0.5*theta)*sin(0.5*theta);
+        double wpi = sin(theta);
+        unsigned int half = len >> 1;
+        for (j=0; j<n; j+=len) {
+            double wr = 1.0, wi = 0.0;
+            for (k=0; k<half; k++) {
+                unsigned int m = j + k;
+                unsigned int l = m + half;
+                double tr = wr*re[l] - wi*im[l];
+                double ti = wr*im[l] + wi*re[l];
+                double wt = wr;
+                re[l] = re[m] - tr;
+                im[l] = im[m] - ti;
+                re[m] += tr;
+                im[m] += ti;
+                wr += wr*wpr - wi*wpi;
+                wi += wi*wpr + wt*wpi;
+            }
+        }
+    }
+    if (inverse) {
+        double scale = 1.0/n;
+        for (i=0; i<n; i++) {
+            re[i] *= scale;
+            im[i] *= scale;
+        }
+    }
+}
+
+static unsigned int atfft_bluestein_size(unsigned int n)
+/* Size in doubles of the work array of atfft_bluestein */
+{
+    return 2*n + 4*atfft_size(2*n-1);
+}
+
+static void atfft_bluestein_init(double *work, unsigned int n)
+/* Store the chirp w[k] = exp(-i*pi*k^2/n) and the transform of its
+   conjugate, wrapped around to the convolution length */
+{
+    unsigned int m = atfft_size(2*n-1);
+    double *wre = work, *wim = work + n;
+    double *bre = work + 2*n, *bim = bre + m;
+    unsigned int k;
+
+    for (k=0; k<n; k++) {
+        /* k^2 modulo 2n keeps the angle small */
+        unsigned long long k2 = ((unsigned long long)k*k) % (2ULL*n);
+        double theta = 0.5*TWOPI*(double)k2/n;
+        wre[k] = cos(theta);
+        wim[k] = -sin(theta);
+    }
+    for (k=0; k<m; k++) {
+        bre[k] = 0.0;
+        bim[k] = 0.0;
+    }
+    bre[0] = wre[0];
+    bim[0] = -wim[0];
+    for (k=1; k<n; k++) {
+        bre[k] = bre[m-k] = wre[k];
+        bim[k] = bim[m-k] = -wim[k];
+    }
+    atfft(bre, bim, m, 0);
+}
+
+static void atfft_bluestein(double *re, double *im, unsigned int n, int inverse, double *work)
+/* Same as atfft for any length n, work being initialised by atfft_bluestein_init */
+{
+    unsigned int m = atfft_size(2*n-1);
+    const double *wre = work, *wim = work + n;
+    const double *bre = work + 2*n, *bim = bre + m;
+    double *are = work + 2*n + 2*m, *aim = are + m;
+    double sign = inverse ? -1.0 : 1.0;   /* inverse transform by conjugation */
+    unsigned int k;
+
+    for (k=0; k<n; k++) {
+        double xim = sign*im[k];
+        are[k] = re[k]*wre[k] - xim*wim[k];
+        aim[k] = re[k]*wim[k] + xim*wre[k];
+    }
+    for (k=n; k<m; k++) {
+        are[k] = 0.0;
+        aim[k] = 0.0;
+    }
+    atfft(are, aim, m, 0);
+    for (k=0; k<m; k++) {
+        double t = are[k]*bre[k] - aim[k]*bim[k];
+        aim[k] = are[k]*bim[k] + aim[k]*bre[k];
+        are[k] = t;
+    }
+    atfft(are, aim, m, 1);
+    for (k=0; k<n; k++) {
+        re[k] = are[k]*wre[k] - aim[k]*wim[k];
+        im[k] = sign*(are[k]*wim[k] + aim[k]*wre[k]);
+    }
+    if (inverse) {
+        double scale = 1.0/n;
+        for (k=0; k<n; k++) {
+            re[k] *= scale;
+            im[k] *= scale;
+        }
+    }
+}
+
+#endif /*ATFFT_C*/
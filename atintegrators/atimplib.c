@@ -1,7 +1,12 @@
 #include "atelem.c"
 #include <math.h>
 #include <float.h>
+#include <string.h>
 #include <complex.h>
+#include "atfft.c"
+#ifdef _OPENMP
+#include <omp.h>
+#endif /*_OPENMP*/
 #ifdef MPI
 #include <mpi.h>
 #include <mpi4py/mpi4py.h>
@@ -11,8 +16,35 @@
 #define TWOPI  6.28318530717959
 #define C0     2.99792458e8 
 
+/* Maximum FFT length for the convolution of wakes */
+#ifndef WAKE_FFT_MAXSIZE
+#define WAKE_FFT_MAXSIZE (1<<22)
+#endif
+
+/* Upper bound of the number of threads of the next parallel region,
+   used to allocate one partial result per thread. The partial results
+   are merged in thread order, so that with a static schedule the sums
+   do not depend on the thread timing */
+static int max_threads(void)
+{
+#ifdef _OPENMP
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif /*_OPENMP*/
+}
+
+static int thread_num(void)
+{
+#ifdef _OPENMP
+    return omp_get_thread_num();
+#else
+    return 0;
+#endif /*_OPENMP*/
+}
 
-int binarySearch(double *array,double value,int upper,int lower,int nStep){
+
+static int binarySearch(double *array,double value,int upper,int lower,int nStep){
     int pivot = (int)(lower+upper)/2;
     if ((upper-lower)<=1){
         return lower;
@@ -31,7 +63,19 @@ int binarySearch(double *array,double value,int upper,int lower,int nStep){
 };
 
 
-double getTableWake(double *waketable,double *waketableT,double distance,int index){
+static int wakeTableIndex(double *waketableT,double distance,int nelem,double step){
+    /* Index of the table interval containing distance. On a uniform table
+       (step > 0), it is obtained directly instead of by a binary search */
+    if (step > 0.0) {
+        int index = (int)((distance-waketableT[0])/step);
+        if (index < 0) return 0;
+        return (index > nelem-2) ? nelem-2 : index;
+    }
+    return binarySearch(waketableT,distance,nelem,0,0);
+};
+
+
+static double getTableWake(double *waketable,double *waketableT,double distance,int index){
     double w = waketable[index] + (distance-waketableT[index])*(waketable[index+1]-waketable[index])/
           (waketableT[index+1]-waketableT[index]);
     if(atIsNaN(w)){
@@ -42,49 +86,56 @@ double getTableWake(double *waketable,double *waketableT,double distance,int ind
 };
 
 
-void rotate_table_history(long nturns,long nslice,double *turnhistory,double circumference){
-    double *xtmp,*xtmp0;
-    double *ytmp,*ytmp0;
-    double *ztmp,*ztmp0;
-    double *wtmp,*wtmp0;
-    int i, ii;    
-    /*First rotate array*/
-
-    for (i=0;i<nturns-1;i++){
-        xtmp0 = turnhistory + i*nslice;
-        xtmp = turnhistory + (i+1)*nslice;
-        ytmp0 = turnhistory + (i+nturns)*nslice;
-        ytmp = turnhistory + (i+nturns+1)*nslice;
-        ztmp0 = turnhistory + (i+2*nturns)*nslice;
-        ztmp = turnhistory + (i+2*nturns+1)*nslice;
-        wtmp0 = turnhistory + (i+3*nturns)*nslice;
-        wtmp = turnhistory + (i+3*nturns+1)*nslice;
-        for(ii=0;ii<nslice;ii++){
-            xtmp0[ii]=xtmp[ii];
-            ytmp0[ii]=ytmp[ii];
-            /*shift zpos by one turn*/
-            ztmp0[ii]=ztmp[ii]-circumference;
-            wtmp0[ii]=wtmp[ii];
+/*
+ * The turn history is kept as a ring buffer. Each of the x, y, z and weight
+ * columns holds nturns blocks of nslice slices. The block "head" holds the
+ * current turn, the previous turns precede it cyclically. The z positions
+ * are recorded relative to their own turn: the offset of the previous turns
+ * is applied when reading them (history_offset).
+ */
+
+static double history_offset(int slot, int head, int nturns, double circumference)
+/* Offset to be added to the z positions stored in block slot */
+{
+    return -circumference*((head-slot+nturns)%nturns);
+}
+
+
+static int advance_table_history(long nturns,long nslice,double *turnhistory,double *historyhead){
+    /* Select the block of the new turn and clear it. The head is stored in
+       historyhead[0]. If historyhead is NULL, the current turn is always the
+       last block and the history is shifted back by one turn instead */
+    double *x, *y, *z, *w;
+    int head, ii;
+
+    if (historyhead) {
+        head = ((int)historyhead[0]+1) % nturns;
+        historyhead[0] = head;
+    }
+    else {
+        size_t sz = (nturns-1)*nslice*sizeof(double);
+        head = nturns-1;
+        for (ii=0;ii<4;ii++) {
+            double *col = turnhistory + ii*nturns*nslice;
+            memmove(col, col+nslice, sz);
         }
     }
-    /*Now set last row to 0 (present slices)*/
-    
-    xtmp = turnhistory + (nturns-1)*nslice;
-    ytmp = turnhistory + (2*nturns-1)*nslice;
-    ztmp = turnhistory + (3*nturns-1)*nslice;
-    wtmp = turnhistory + (4*nturns-1)*nslice; 
+    x = turnhistory + head*nslice;
+    y = turnhistory + (head+nturns)*nslice;
+    z = turnhistory + (head+2*nturns)*nslice;
+    w = turnhistory + (head+3*nturns)*nslice;
     for(ii=0;ii<nslice;ii++){
-        xtmp[ii]=0.0;
-        ytmp[ii]=0.0;
-        ztmp[ii]=0.0;
-        wtmp[ii]=0.0;
-    }        
+        x[ii]=0.0;
+        y[ii]=0.0;
+        z[ii]=0.0;
+        w[ii]=0.0;
+    }
+    return head;
 };
 
 
-void getbounds(double *r_in, int nbunch, int num_particles, double *smin,
+static void getbounds(double *r_in, int nbunch, int num_particles, double *smin,
                double *smax, double *z_cuts){
-    double *rtmp;
     int i, ib;
     if(z_cuts){
         for(i=0;i<nbunch; i++){
@@ -92,25 +143,67 @@ void getbounds(double *r_in, int nbunch, int num_particles, double *smin,
             smax[i] = z_cuts[1];
         }
     }else{
-        for(i=0;i<nbunch; i++){
-            smin[i] = DBL_MAX;
-            smax[i] = -DBL_MAX;
+        int nthreads = max_threads();
+        int it;
+        /* Thread-local bounds, merged after the parallel region */
+        double *tbounds = malloc(2*nthreads*nbunch*sizeof(double));
+        for(i=0;i<nthreads*nbunch; i++){
+            tbounds[i] = DBL_MAX;
+            tbounds[nthreads*nbunch+i] = -DBL_MAX;
         }
         /*First find the min and the max of the distribution*/  
-        for (i=0;i<num_particles;i++) {
-            rtmp = r_in+i*6;
-            ib = i%nbunch;
-            if (!atIsNaN(rtmp[0])) {
-                register double ct = rtmp[5];
-                if (ct>smax[ib]) smax[ib] = ct;
-                if (ct<smin[ib]) smin[ib] = ct;
+        #ifdef _OPENMP
+        #pragma omp parallel if (num_particles > OMP_PARTICLE_THRESHOLD) default(none) \
+        shared(r_in,nbunch,num_particles,nthreads,tbounds) private(i,ib)
+        #endif /*_OPENMP*/
+        {
+            double *lmin = tbounds + thread_num()*nbunch;
+            double *lmax = lmin + nthreads*nbunch;
+            int i0;
+            /* Particle i belongs to bunch i%nbunch */
+            #ifdef _OPENMP
+            #pragma omp for schedule(static)
+            #endif /*_OPENMP*/
+            for (i0=0;i0<num_particles;i0+=nbunch) {
+                for (ib=0, i=i0; ib<nbunch && i<num_particles; ib++, i++) {
+                    double *rtmp = r_in+i*6;
+                    if (!atIsNaN(rtmp[0])) {
+                        double ct = rtmp[5];
+                        if (ct>lmax[ib]) lmax[ib] = ct;
+                        if (ct<lmin[ib]) lmin[ib] = ct;
+                    }
+                }
             }
         }
+        for(ib=0;ib<nbunch;ib++){
+            smin[ib] = tbounds[ib];
+            smax[ib] = tbounds[nthreads*nbunch+ib];
+        }
+        for(it=1;it<nthreads;it++){
+            double *lmin = tbounds + it*nbunch;
+            double *lmax = lmin + nthreads*nbunch;
+            for(ib=0;ib<nbunch;ib++){
+                if (lmin[ib]<smin[ib]) smin[ib] = lmin[ib];
+                if (lmax[ib]>smax[ib]) smax[ib] = lmax[ib];
+            }
+        }
+        free(tbounds);
 
         #ifdef MPI
-        MPI_Allreduce(MPI_IN_PLACE,smin,nbunch,MPI_DOUBLE,MPI_MIN,MPI_COMM_WORLD);
-        MPI_Allreduce(MPI_IN_PLACE,smax,nbunch,MPI_DOUBLE,MPI_MAX,MPI_COMM_WORLD); 
-        MPI_Barrier(MPI_COMM_WORLD);
+        {
+            /* min(smin) and max(smax) in a single reduction */
+            double *buf = malloc(2*nbunch*sizeof(double));
+            for(i=0;i<nbunch;i++){
+                buf[i] = smin[i];
+                buf[nbunch+i] = -smax[i];
+            }
+            MPI_Allreduce(MPI_IN_PLACE,buf,2*nbunch,MPI_DOUBLE,MPI_MIN,MPI_COMM_WORLD);
+            for(i=0;i<nbunch;i++){
+                smin[i] = buf[i];
+                smax[i] = -buf[nbunch+i];
+            }
+            free(buf);
+        }
         #endif
 
         for(i=0;i<nbunch;i++){
@@ -123,96 +216,128 @@ void getbounds(double *r_in, int nbunch, int num_particles, double *smin,
 }
 
 
-void slice_bunch(double *r_in,int num_particles,int nslice,int nturns,
+static void slice_bunch(double *r_in,int num_particles,int nslice,int nturns,int head,
                  int nbunch,double *bunch_spos,double *bunch_currents,
                  double *turnhistory,int *pslice,double *z_cuts){
     
-    int i,ii,ib;
-    double *rtmp;
+    int i,ib,it;
+    int ns = nslice*nbunch;
+    int nthreads = max_threads();
     
     double *smin = malloc(nbunch*sizeof(double));
     double *smax = malloc(nbunch*sizeof(double));
     double *hz = malloc(nbunch*sizeof(double));
-    double *np_bunch = malloc(nbunch*sizeof(double));
+    /* Packed sums of x, y, ct and number of particles in each slice,
+       followed by the number of particles in each bunch */
+    double *acc = calloc(4*ns+nbunch,sizeof(double));
+    double *np_bunch = acc+4*ns;
     getbounds(r_in,nbunch,num_particles,smin,smax,z_cuts);     
     
     for(i=0;i<nbunch;i++){
         hz[i] = (smax[i]-smin[i])/(nslice);
-        np_bunch[i] = 0.0;
+        np_bunch[i] = num_particles/nbunch + ((i < num_particles%nbunch) ? 1 : 0);
     }
 
-    double *xpos = turnhistory + (nturns-1)*nslice*nbunch;
-    double *ypos = turnhistory + (2*nturns-1)*nslice*nbunch;
-    double *zpos = turnhistory + (3*nturns-1)*nslice*nbunch;
-    double *weight = turnhistory + (4*nturns-1)*nslice*nbunch;
+    double *xpos = turnhistory + head*nslice*nbunch;
+    double *ypos = turnhistory + (head+nturns)*nslice*nbunch;
+    double *zpos = turnhistory + (head+2*nturns)*nslice*nbunch;
+    double *weight = turnhistory + (head+3*nturns)*nslice*nbunch;
+
 
+    /* Thread-local sums, merged after the parallel region */
+    double *tacc = calloc(4*ns*nthreads,sizeof(double));
 
     /*slices sorted from head to tail (increasing ct)*/
-    for (i=0;i<num_particles;i++) {
-        rtmp = r_in+i*6;
-        ib = i%nbunch;
-        np_bunch[ib] += 1.0;
-        if (!atIsNaN(rtmp[0])) {
-            register double x = rtmp[0];
-            register double y = rtmp[2];
-            register double ct = rtmp[5];
-            if (ct < smin[ib]) {
-                pslice[i] = ib*nslice;
-            }
-            else if (ct >smax[ib]){
-                pslice[i] = nslice-1 + ib*nslice;
-            }
-            else if (ct == smax[ib]){
-                ii = nslice-1 + ib*nslice;
-                weight[ii] += 1.0;
-                xpos[ii] += x;
-                ypos[ii] += y;
-                zpos[ii] += ct;
-                pslice[i] = ii; 
-            }
-            else {
-                ii = (int)(floor((ct-smin[ib])/hz[ib])) + ib*nslice;
-                weight[ii] += 1.0;
-                xpos[ii] += x;
-                ypos[ii] += y;
-                zpos[ii] += ct;
-                pslice[i] = ii;              
+    #ifdef _OPENMP
+    #pragma omp parallel if (num_particles > OMP_PARTICLE_THRESHOLD) default(none) \
+    shared(r_in,num_particles,nslice,nbunch,ns,smin,smax,hz,tacc,pslice) private(i,ib)
+    #endif /*_OPENMP*/
+    {
+        double *lacc = tacc + 4*ns*thread_num();
+        double *lx = lacc;
+        double *ly = lacc+ns;
+        double *lz = lacc+2*ns;
+        double *lw = lacc+3*ns;
+        int i0, ii;
+        /* Particle i belongs to bunch i%nbunch */
+        #ifdef _OPENMP
+        #pragma omp for schedule(static)
+        #endif /*_OPENMP*/
+        for (i0=0;i0<num_particles;i0+=nbunch) {
+            for (ib=0, i=i0; ib<nbunch && i<num_particles; ib++, i++) {
+                double *rtmp = r_in+i*6;
+                if (!atIsNaN(rtmp[0])) {
+                    double ct = rtmp[5];
+                    if (ct < smin[ib]) {
+                        pslice[i] = ib*nslice;
+                    }
+                    else if (ct >smax[ib]){
+                        pslice[i] = nslice-1 + ib*nslice;
+                    }
+                    else {
+                        if (ct == smax[ib])
+                            ii = nslice-1 + ib*nslice;
+                        else
+                            ii = (int)(floor((ct-smin[ib])/hz[ib])) + ib*nslice;
+                        lw[ii] += 1.0;
+                        lx[ii] += rtmp[0];
+                        ly[ii] += rtmp[2];
+                        lz[ii] += ct;
+                        pslice[i] = ii;              
+                    }
+                }
             }
         }
     }
+    for (it=0;it<nthreads;it++) {
+        double *lacc = tacc + 4*ns*it;
+        for (i=0;i<4*ns;i++) acc[i] += lacc[i];
+    }
+    free(tacc);
 
     #ifdef MPI
-    MPI_Allreduce(MPI_IN_PLACE,np_bunch,nbunch,MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD);      
-    MPI_Allreduce(MPI_IN_PLACE,xpos,nslice*nbunch,MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD);
-    MPI_Allreduce(MPI_IN_PLACE,ypos,nslice*nbunch,MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD);
-    MPI_Allreduce(MPI_IN_PLACE,zpos,nslice*nbunch,MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD);
-    MPI_Allreduce(MPI_IN_PLACE,weight,nslice*nbunch,MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD);
-    MPI_Barrier(MPI_COMM_WORLD);
+    MPI_Allreduce(MPI_IN_PLACE,acc,4*ns+nbunch,MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD);
     #endif
 
     /*Compute average x/y position and weight of each slice */
-    for (i=0;i<nslice*nbunch;i++) {
+    for (i=0;i<ns;i++) {
+        double w = acc[3*ns+i];
         ib = (int)(i/nslice);
-        zpos[i] =  (weight[i]>0.0) ? zpos[i]/weight[i] : smin[ib]+(i%nslice+0.5)*hz[ib];
+        zpos[i] =  (w>0.0) ? acc[2*ns+i]/w : smin[ib]+(i%nslice+0.5)*hz[ib];
         zpos[i] += bunch_spos[ib]-bunch_spos[nbunch-1];
-        xpos[i] =  (weight[i]>0.0) ? xpos[i]/weight[i] : 0.0;
-        ypos[i] =  (weight[i]>0.0) ? ypos[i]/weight[i] : 0.0;
-        weight[i] *= bunch_currents[ib]/np_bunch[ib];
+        xpos[i] =  (w>0.0) ? acc[i]/w : 0.0;
+        ypos[i] =  (w>0.0) ? acc[ns+i]/w : 0.0;
+        weight[i] = w*bunch_currents[ib]/np_bunch[ib];
     } 
-    free(np_bunch);
+    free(acc);
     free(smin);
     free(smax);
     free(hz);
 };
 
-void compute_kicks(int nslice,int nturns,int nelem,
-                   double *turnhistory,double *waketableT,double *waketableDX,
+#ifdef MPI
+static void reduce_kicks(int n, double *kx, double *ky, double *kx2, double *ky2, double *kz)
+/* Sum the kicks computed by each process, packed in a single reduction */
+{
+    double *kick[5] = {kx, ky, kx2, ky2, kz};
+    double *buf = atMalloc(5*n*sizeof(double));
+    int i;
+    for (i=0;i<5;i++) memcpy(buf+i*n, kick[i], n*sizeof(double));
+    MPI_Allreduce(MPI_IN_PLACE,buf,5*n,MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD);
+    for (i=0;i<5;i++) memcpy(kick[i], buf+i*n, n*sizeof(double));
+    atFree(buf);
+}
+#endif
+
+static void compute_kicks(int nslice,int nturns,int head,double circumference,int nelem,
+                   double step,double *turnhistory,double *waketableT,double *waketableDX,
                    double *waketableDY,double *waketableQX,double *waketableQY,
                    double *waketableZ,double *normfact, double *kx,double *ky,
                    double *kx2,double *ky2,double *kz){
     int rank=0;
     int size=1;
-    int i,ii,index;
+    int i,ii,it,index;
+    int first = head*nslice;
     double ds,wi,dx,dy;
     double *turnhistoryX = turnhistory;
     double *turnhistoryY = turnhistory+nslice*nturns;
@@ -231,41 +356,346 @@ void compute_kicks(int nslice,int nturns,int nelem,
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
     MPI_Comm_size(MPI_COMM_WORLD, &size);
     #endif
-    for(i=nslice*(nturns-1);i<nslice*nturns;i++){  
+    /* Each target slice is computed by a single rank and thread */
+    #ifdef _OPENMP
+    #pragma omp parallel for if (nslice*nturns > OMP_PARTICLE_THRESHOLD) schedule(dynamic) \
+    default(none) shared(first,nslice,nturns,head,circumference,nelem,step,rank,size, \
+    turnhistoryX,turnhistoryY,turnhistoryZ,turnhistoryW,waketableT,waketableDX, \
+    waketableDY,waketableQX,waketableQY,waketableZ,normfact,kx,ky,kx2,ky2,kz) \
+    private(ii,it,index,ds,wi,dx,dy)
+    #endif /*_OPENMP*/
+    for(i=first;i<first+nslice;i++){
         if(turnhistoryW[i]>0.0 && rank==(i+size)%size){
-            for (ii=0;ii<nslice*nturns;ii++){
-                ds = turnhistoryZ[i]-turnhistoryZ[ii];
-                wi = turnhistoryW[ii];
-                if(wi>0.0 && ds>=waketableT[0] && ds<waketableT[nelem-1]){
-                    dx = turnhistoryX[ii];
-                    dy = turnhistoryY[ii];
-                    index = binarySearch(waketableT,ds,nelem,0,0);          
-                    if(waketableDX)kx[i-nslice*(nturns-1)] += dx*normfact[0]*wi*getTableWake(waketableDX,waketableT,ds,index);
-                    if(waketableDY)ky[i-nslice*(nturns-1)] += dy*normfact[1]*wi*getTableWake(waketableDY,waketableT,ds,index);
-                    if(waketableQX)kx2[i-nslice*(nturns-1)] += normfact[0]*wi*getTableWake(waketableQX,waketableT,ds,index);
-                    if(waketableQY)ky2[i-nslice*(nturns-1)] += normfact[1]*wi*getTableWake(waketableQY,waketableT,ds,index);
-                    if(waketableZ) kz[i-nslice*(nturns-1)] += normfact[2]*wi*getTableWake(waketableZ,waketableT,ds,index);
-                }            
+            for (it=0;it<nturns;it++){
+                double zi = turnhistoryZ[i]-history_offset(it,head,nturns,circumference);
+                for (ii=it*nslice;ii<(it+1)*nslice;ii++){
+                    ds = zi-turnhistoryZ[ii];
+                    wi = turnhistoryW[ii];
+                    if(wi>0.0 && ds>=waketableT[0] && ds<waketableT[nelem-1]){
+                        dx = turnhistoryX[ii];
+                        dy = turnhistoryY[ii];
+                        index = wakeTableIndex(waketableT,ds,nelem,step);
+                        if(waketableDX)kx[i-first] += dx*normfact[0]*wi*getTableWake(waketableDX,waketableT,ds,index);
+                        if(waketableDY)ky[i-first] += dy*normfact[1]*wi*getTableWake(waketableDY,waketableT,ds,index);
+                        if(waketableQX)kx2[i-first] += normfact[0]*wi*getTableWake(waketableQX,waketableT,ds,index);
+                        if(waketableQY)ky2[i-first] += normfact[1]*wi*getTableWake(waketableQY,waketableT,ds,index);
+                        if(waketableZ) kz[i-first] += normfact[2]*wi*getTableWake(waketableZ,waketableT,ds,index);
+                    }            
+                }
+            }
+        }
+    }
+    #ifdef MPI
+    reduce_kicks(nslice,kx,ky,kx2,ky2,kz);
+    #endif
+};
+
+
+static void add_point_kick(double *k, double ds, double wi, double dx, double dy,
+                           int nelem, double step, double *waketableT, double *waketableDX,
+                           double *waketableDY, double *waketableQX, double *waketableQY,
+                           double *waketableZ, double *normfact){
+    /* Accumulate in k[0..4] the kicks of a source of weight wi at distance ds */
+    if(wi>0.0 && ds>=waketableT[0] && ds<waketableT[nelem-1]){
+        int index = wakeTableIndex(waketableT,ds,nelem,step);
+        if(waketableDX)k[0] += dx*normfact[0]*wi*getTableWake(waketableDX,waketableT,ds,index);
+        if(waketableDY)k[1] += dy*normfact[1]*wi*getTableWake(waketableDY,waketableT,ds,index);
+        if(waketableQX)k[2] += normfact[0]*wi*getTableWake(waketableQX,waketableT,ds,index);
+        if(waketableQY)k[3] += normfact[1]*wi*getTableWake(waketableQY,waketableT,ds,index);
+        if(waketableZ) k[4] += normfact[2]*wi*getTableWake(waketableZ,waketableT,ds,index);
+    }
+}
+
+static void compute_kicks_bunched(int nslice,int nbunch,int nturns,int head,double circumference,
+                           int nelem,double step,double *turnhistory,double *waketableT,
+                           double *waketableDX,double *waketableDY,double *waketableQX,
+                           double *waketableQY,double *waketableZ,double *normfact,
+                           double *kx,double *ky,double *kx2,double *ky2,double *kz){
+/* Two-level version of compute_kicks: the wake of the bunch on itself is
+   summed over the pairs of slices, while the other bunches and all the
+   previous turns are seen as point charges at their centroid, acting on the
+   centroid of the target bunch. The cost is nbunch*nslice^2 for the
+   short-range part and nbunch^2*nturns for the long-range part, instead of
+   (nbunch*nslice)^2*nturns. This is valid when the bunches are short
+   compared to the variation length of the wake at the bunch distance */
+    int rank=0;
+    int size=1;
+    int ns = nslice*nbunch;
+    int nb = nbunch*nturns;
+    int first = head*ns;
+    int i,ib;
+    double *turnhistoryX = turnhistory;
+    double *turnhistoryY = turnhistory+ns*nturns;
+    double *turnhistoryZ = turnhistory+ns*nturns*2;
+    double *turnhistoryW = turnhistory+ns*nturns*3;
+    /* Weight and centroid of each bunch in each turn */
+    double *bunchW = atMalloc(4*nb*sizeof(double));
+    double *bunchX = bunchW+nb;
+    double *bunchY = bunchW+2*nb;
+    double *bunchZ = bunchW+3*nb;
+
+    for (i=0;i<ns;i++) {
+        kx[i]=0.0;
+        ky[i]=0.0;
+        kx2[i]=0.0;
+        ky2[i]=0.0;
+        kz[i]=0.0;
+    }
+    for (ib=0;ib<nb;ib++) {
+        double w=0.0, x=0.0, y=0.0, z=0.0;
+        double offset = history_offset(ib/nbunch,head,nturns,circumference);
+        for (i=ib*nslice;i<(ib+1)*nslice;i++) {
+            double wi = turnhistoryW[i];
+            if (wi>0.0) {
+                w += wi;
+                x += wi*turnhistoryX[i];
+                y += wi*turnhistoryY[i];
+                z += wi*turnhistoryZ[i];
             }
         }
+        bunchW[ib] = w;
+        bunchX[ib] = (w>0.0) ? x/w : 0.0;
+        bunchY[ib] = (w>0.0) ? y/w : 0.0;
+        bunchZ[ib] = (w>0.0) ? z/w+offset : 0.0;
     }
+
+    #ifdef MPI
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    #endif
+    /* Each target bunch is computed by a single rank and thread */
+    #ifdef _OPENMP
+    #pragma omp parallel for if (ns*nturns > OMP_PARTICLE_THRESHOLD) schedule(dynamic) \
+    default(none) shared(first,nslice,nbunch,nb,head,nelem,step,rank,size, \
+    turnhistoryX,turnhistoryY,turnhistoryZ,turnhistoryW,bunchW,bunchX,bunchY,bunchZ, \
+    waketableT,waketableDX,waketableDY,waketableQX,waketableQY,waketableZ,normfact, \
+    kx,ky,kx2,ky2,kz) private(i)
+    #endif /*_OPENMP*/
+    for (ib=0;ib<nbunch;ib++) {
+        int target = head*nbunch+ib;
+        int start = first+ib*nslice;
+        int jb, ii;
+        double klong[5] = {0.0, 0.0, 0.0, 0.0, 0.0};
+        if (bunchW[target]<=0.0 || rank!=(ib+size)%size) continue;
+        /* Long range: point charges */
+        for (jb=0;jb<nb;jb++) {
+            if (jb != target)
+                add_point_kick(klong,bunchZ[target]-bunchZ[jb],bunchW[jb],bunchX[jb],bunchY[jb],
+                               nelem,step,waketableT,waketableDX,waketableDY,waketableQX,
+                               waketableQY,waketableZ,normfact);
+        }
+        /* Short range: pairs of slices in the target bunch */
+        for (i=start;i<start+nslice;i++) {
+            double k[5];
+            for (ii=0;ii<5;ii++) k[ii] = klong[ii];
+            if (turnhistoryW[i]>0.0) {
+                for (ii=start;ii<start+nslice;ii++) {
+                    add_point_kick(k,turnhistoryZ[i]-turnhistoryZ[ii],turnhistoryW[ii],
+                                   turnhistoryX[ii],turnhistoryY[ii],nelem,step,waketableT,
+                                   waketableDX,waketableDY,waketableQX,waketableQY,
+                                   waketableZ,normfact);
+                }
+            }
+            kx[i-first] = k[0];
+            ky[i-first] = k[1];
+            kx2[i-first] = k[2];
+            ky2[i-first] = k[3];
+            kz[i-first] = k[4];
+        }
+    }
+    atFree(bunchW);
     #ifdef MPI
-    MPI_Allreduce(MPI_IN_PLACE,kx,nslice,MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD);
-    MPI_Allreduce(MPI_IN_PLACE,ky,nslice,MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD);
-    MPI_Allreduce(MPI_IN_PLACE,kx2,nslice,MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD);
-    MPI_Allreduce(MPI_IN_PLACE,ky2,nslice,MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD);
-    MPI_Allreduce(MPI_IN_PLACE,kz,nslice,MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD);
-    MPI_Barrier(MPI_COMM_WORLD);
+    reduce_kicks(ns,kx,ky,kx2,ky2,kz);
     #endif
 };
 
 
-double *wakefunc_long_resonator(double ds, double freqres, double qfactor, double rshunt, double beta) {
+static void sample_wake(double *kernel, double *waketable, double *waketableT,
+                        int nelem, int dmin, int nk, double h){
+    /* Sample the wake table on the uniform grid (dmin+j)*h, j=0..nk-1
+       The grid is increasing: walk along the table instead of searching */
+    int j, index = 0;
+    for (j=0;j<nk;j++) {
+        double ds = (dmin+j)*h;
+        while (index < nelem-2 && waketableT[index+1] <= ds) index++;
+        kernel[j] = getTableWake(waketable,waketableT,ds,index);
+    }
+}
+
+
+static void convolve_wake(double *fre, double *fim, double *kre, double *kim,
+                          unsigned int nfft, double *wre, double *wim, double *waketableT,
+                          int nelem, int dmin, int nk, double h){
+    /* Convolution of the transformed source fre + i*fim with the wake
+       kernel wre + i*wim (either may be NULL). The result is stored in
+       kre + i*kim. Since wre and wim are real, the real and imaginary
+       parts of the result are independent convolutions */
+    unsigned int n;
+    for (n=0;n<nfft;n++) {
+        kre[n]=0.0;
+        kim[n]=0.0;
+    }
+    if (wre) sample_wake(kre,wre,waketableT,nelem,dmin,nk,h);
+    if (wim) sample_wake(kim,wim,waketableT,nelem,dmin,nk,h);
+    atfft(kre,kim,nfft,0);
+    for (n=0;n<nfft;n++) {
+        double ar = fre[n]*kre[n]-fim[n]*kim[n];
+        double ai = fre[n]*kim[n]+fim[n]*kre[n];
+        kre[n] = ar;
+        kim[n] = ai;
+    }
+    atfft(kre,kim,nfft,1);
+}
+
+
+static double interp_grid(double *c, unsigned int nfft, double u){
+    /* Linear interpolation of c at the fractional index u */
+    int m = (int)floor(u);
+    double f = u-m;
+    double v = 0.0;
+    if (m>=0 && m<(int)nfft) v += (1.0-f)*c[m];
+    if (m+1>=0 && m+1<(int)nfft) v += f*c[m+1];
+    return v;
+}
+
+
+static int compute_kicks_fft(int nslice,int nturns,int head,double circumference,int nelem,
+                      double *turnhistory,double *waketableT,double *waketableDX,
+                      double *waketableDY,double *waketableQX,double *waketableQY,
+                      double *waketableZ,double *normfact, double *kx,double *ky,
+                      double *kx2,double *ky2,double *kz){
+    /*
+     * Same kicks as compute_kicks, computed by FFT convolution. The wake
+     * tables are resampled on a uniform grid whose step is the smallest
+     * step of waketableT. The slice moments are deposited on the same grid
+     * by linear weighting and the kicks are interpolated back at the slice
+     * positions. Returns -1 if the grid would exceed WAKE_FFT_MAXSIZE
+     * points, in which case the direct summation must be used.
+     */
+    int i, j, dmin, dmax, nk, ns;
+    unsigned int n, nfft;
+    double h = DBL_MAX;
+    double zomin = DBL_MAX, zomax = -DBL_MAX;
+    double zsmin = DBL_MAX, zsmax = -DBL_MAX;
+    double *turnhistoryX = turnhistory;
+    double *turnhistoryY = turnhistory+nslice*nturns;
+    double *turnhistoryZ = turnhistory+nslice*nturns*2;
+    double *turnhistoryW = turnhistory+nslice*nturns*3;
+    int ifirst = head*nslice;
+    int ilast = ifirst+nslice;
+    int nsource = nslice*nturns;
+    double tmin = waketableT[0];
+    double tmax = waketableT[nelem-1];
+    double *buffer, *sre, *sim, *qre, *qim, *kre, *kim;
+
+    for (j=0;j<nelem-1;j++) {
+        double d = waketableT[j+1]-waketableT[j];
+        if (d>0.0 && d<h) h = d;
+    }
+    if (h == DBL_MAX) return -1;
+    dmin = (int)ceil(tmin/h);
+    dmax = (int)ceil(tmax/h)-1;     /* ds < tmax */
+    nk = dmax-dmin+1;
+    if (nk <= 0) return -1;
+
+    /* Range of the observation slices and of the sources within the wake range */
+    for (i=ifirst;i<ilast;i++) {
+        if (turnhistoryW[i]>0.0) {
+            if (turnhistoryZ[i]<zomin) zomin=turnhistoryZ[i];
+            if (turnhistoryZ[i]>zomax) zomax=turnhistoryZ[i];
+        }
+    }
+    for (i=0;i<nsource;i++) {
+        double z = turnhistoryZ[i]+history_offset(i/nslice,head,nturns,circumference);
+        if (turnhistoryW[i]>0.0 && z>zomin-tmax && z<=zomax-tmin) {
+            if (z<zsmin) zsmin=z;
+            if (z>zsmax) zsmax=z;
+        }
+    }
+    if ((zsmin <= zsmax) && ((zsmax-zsmin)/h + nk > WAKE_FFT_MAXSIZE)) return -1;
+
+    for (i=0;i<nslice;i++) {
+        kx[i]=0.0;
+        ky[i]=0.0;
+        kx2[i]=0.0;
+        ky2[i]=0.0;
+        kz[i]=0.0;
+    }
+    if (zsmin > zsmax) return 0;    /* no source in the wake range */
+
+    ns = (int)floor((zsmax-zsmin)/h)+2;
+    nfft = atfft_size(ns+nk-1);
+    buffer = atMalloc(6*nfft*sizeof(double));
+    sre = buffer;           /* w*x + i w*y */
+    sim = sre + nfft;
+    qre = sim + nfft;       /* w */
+    qim = qre + nfft;
+    kre = qim + nfft;
+    kim = kre + nfft;
+    for (n=0;n<nfft;n++) {
+        sre[n]=0.0;
+        sim[n]=0.0;
+        qre[n]=0.0;
+        qim[n]=0.0;
+    }
+
+    /* Deposit the slice moments on the grid */
+    for (i=0;i<nsource;i++) {
+        double z = turnhistoryZ[i]+history_offset(i/nslice,head,nturns,circumference);
+        double wi = turnhistoryW[i];
+        if (wi>0.0 && z>zomin-tmax && z<=zomax-tmin) {
+            double u = (z-zsmin)/h;
+            int k = (int)floor(u);
+            double f = u-k;
+            sre[k] += (1.0-f)*wi*turnhistoryX[i];
+            sre[k+1] += f*wi*turnhistoryX[i];
+            sim[k] += (1.0-f)*wi*turnhistoryY[i];
+            sim[k+1] += f*wi*turnhistoryY[i];
+            qre[k] += (1.0-f)*wi;
+            qre[k+1] += f*wi;
+        }
+    }
+    atfft(sre,sim,nfft,0);
+    atfft(qre,qim,nfft,0);
+
+    /* Convolve each wake component and interpolate at the slice positions.
+       The result at grid index m corresponds to z = zsmin + (m+dmin)*h */
+    if (waketableDX) {
+        convolve_wake(sre,sim,kre,kim,nfft,waketableDX,NULL,waketableT,nelem,dmin,nk,h);
+        for (i=ifirst;i<ilast;i++)
+            if (turnhistoryW[i]>0.0)
+                kx[i-ifirst] = normfact[0]*interp_grid(kre,nfft,(turnhistoryZ[i]-zsmin)/h-dmin);
+    }
+    if (waketableDY) {
+        convolve_wake(sre,sim,kre,kim,nfft,waketableDY,NULL,waketableT,nelem,dmin,nk,h);
+        for (i=ifirst;i<ilast;i++)
+            if (turnhistoryW[i]>0.0)
+                ky[i-ifirst] = normfact[1]*interp_grid(kim,nfft,(turnhistoryZ[i]-zsmin)/h-dmin);
+    }
+    if (waketableQX || waketableQY) {
+        convolve_wake(qre,qim,kre,kim,nfft,waketableQX,waketableQY,waketableT,nelem,dmin,nk,h);
+        for (i=ifirst;i<ilast;i++) {
+            if (turnhistoryW[i]>0.0) {
+                double u = (turnhistoryZ[i]-zsmin)/h-dmin;
+                if (waketableQX) kx2[i-ifirst] = normfact[0]*interp_grid(kre,nfft,u);
+                if (waketableQY) ky2[i-ifirst] = normfact[1]*interp_grid(kim,nfft,u);
+            }
+        }
+    }
+    if (waketableZ) {
+        convolve_wake(qre,qim,kre,kim,nfft,waketableZ,NULL,waketableT,nelem,dmin,nk,h);
+        for (i=ifirst;i<ilast;i++)
+            if (turnhistoryW[i]>0.0)
+                kz[i-ifirst] = normfact[2]*interp_grid(kre,nfft,(turnhistoryZ[i]-zsmin)/h-dmin);
+    }
+    atFree(buffer);
+    return 0;
+};
+
+static void wakefunc_long_resonator(double ds, double freqres, double qfactor, double rshunt,
+                             double beta, double *wake) {
 
     double omega, alpha, omegabar;
-    double *wake = malloc(2*sizeof(double));
-    wake[0] = 0.0;
-    wake[1] = 0.0;
     double dt;
     
     omega = TWOPI * freqres;
@@ -274,9 +704,10 @@ double *wakefunc_long_resonator(double ds, double freqres, double qfactor, doubl
     
     dt = -ds/(beta * C0);      
              
+    wake[0] = 0.0;
+    wake[1] = 0.0;
     if (dt==0) {
         wake[0] = rshunt * alpha;
-        wake[1] = 0.0;
     } else if (dt<0) {
         if (qfactor > 0.5) {
             wake[0] = 2 * rshunt * alpha * exp(alpha * dt) * (cos(omegabar * dt) + \
@@ -285,77 +716,146 @@ double *wakefunc_long_resonator(double ds, double freqres, double qfactor, doubl
                       alpha / omegabar * cos(omegabar*dt));
         } else if (qfactor == 0.5) {
             wake[0] = 2 * rshunt * alpha * exp(alpha * dt) * (1. + alpha * dt);
-            wake[1] = 0.0;
         } else if (qfactor < 0.5) {
             wake[0] = 2 * rshunt * alpha * exp(alpha * dt) * (cosh(omegabar * dt) + \
                       alpha / omegabar * sinh(omegabar * dt)); 
             wake[1] = 2 * rshunt * alpha * exp(alpha * dt) * (sinh(omegabar * dt) - \
                       alpha / omegabar * cosh(omegabar*dt));
         }       
-    } else {
-        wake[0] = 0.0;
-        wake[1] = 0.0;
-    }            
-    return wake;
+    }
 }
 
 
-void compute_kicks_longres(int nslice,int nbunch,int nturns, double *turnhistory,double normfact,
+struct zslice {
+    double z;
+    int index;
+};
+
+static int compare_zslice(const void *a, const void *b)
+{
+    double za = ((const struct zslice *)a)->z;
+    double zb = ((const struct zslice *)b)->z;
+    return (za > zb) - (za < zb);
+}
+
+static void resonator_decay(double a[2], double dt, double alpha, double omegabar,
+                            double qfactor)
+/* Propagate the accumulated resonator state over a time interval dt > 0.
+   The state a is a pair of exponentially decaying modes:
+   Q > 0.5:  a[0] + i*a[1] = sum(w*exp((alpha+i*omegabar)*tau))
+   Q == 0.5: a[0] = sum(w*exp(alpha*tau)), a[1] = sum(w*tau*exp(alpha*tau))
+   Q < 0.5:  a[0] = sum(w*exp((alpha+omegabar)*tau)),
+             a[1] = sum(w*exp((alpha-omegabar)*tau))
+   where tau <= 0 is the time from the observation point to each source */
+{
+    double a0 = a[0], a1 = a[1];
+    if (qfactor > 0.5) {
+        double damp = exp(-alpha*dt);
+        double c = damp*cos(omegabar*dt);
+        double s = damp*sin(omegabar*dt);
+        a[0] = a0*c + a1*s;
+        a[1] = a1*c - a0*s;
+    } else if (qfactor == 0.5) {
+        double damp = exp(-alpha*dt);
+        a[0] = a0*damp;
+        a[1] = (a1 - dt*a0)*damp;
+    } else {
+        a[0] = a0*exp(-(alpha+omegabar)*dt);
+        a[1] = a1*exp(-(alpha-omegabar)*dt);
+    }
+}
+
+static void compute_kicks_longres(int nslice,int nbunch,int nturns,int head,double circumference,
+                           double *turnhistory,double normfact,
                            double *kz,double freq, double qfactor, double rshunt,
                            double beta, double *vbeamk, double energy, double *vbunch) {
-
-    int rank=0;
-    int size=1;
-    int i,ii,ib;
-    double ds,wi;
-    double *turnhistoryZ = turnhistory+nslice*nbunch*nturns*2;
-    double *turnhistoryW = turnhistory+nslice*nbunch*nturns*3;
-    double *wake = malloc(2*sizeof(double));
+/* Since the resonator wake is a sum of exponentially decaying modes, the wake
+   sum is obtained by sweeping once over the slices sorted by position and
+   updating the mode amplitudes recursively, instead of summing over all
+   the pairs of slices. The cost is dominated by the sort of the history.
+   The sweep carries the mode amplitudes from one slice to the next and
+   stays serial: only the kick loop of the caller is multithreaded. */
+
+    int nslices_turn = nslice*nbunch;
+    int ntot = nslices_turn*nturns;
+    int first = nslices_turn*head;
+    int i, k, nsrc;
+    double *turnhistoryZ = turnhistory+ntot*2;
+    double *turnhistoryW = turnhistory+ntot*3;
+    struct zslice *sorted = atMalloc(ntot*sizeof(struct zslice));
+    double omega = TWOPI * freq;
+    double alpha = omega / (2 * qfactor);
+    double omegabar = sqrt(fabs(omega*omega - alpha*alpha));
+    double ratio = alpha / omegabar;
+    double w0 = rshunt * alpha;     /* wake at ds == 0 */
+    double state[2] = {0.0, 0.0};
     double vba, vbp;
     double *vbr = vbunch;
     double *vbi = vbunch+nbunch;
 
-    for (i=0;i<nslice*nbunch;i++) {
-        ib = (int)(i/nslice);
-        kz[i]=0.0;
-        vbr[ib] = 0.0;
-        vbi[ib] = 0.0;
+    for (i=0;i<nslices_turn;i++) kz[i]=0.0;
+    for (i=0;i<nbunch;i++) {
+        vbr[i] = 0.0;
+        vbi[i] = 0.0;
     }
-
     vbeamk[0] = 0.0;
     vbeamk[1] = 0.0;
-    wake[0] = 0.0;
-    wake[1] = 0.0;
 
+    /* The history is identical on all processes: no need to share the work */
+    for (i=0, nsrc=0; i<ntot; i++) {
+        if (turnhistoryW[i]>0.0) {
+            sorted[nsrc].z = turnhistoryZ[i]+history_offset(i/nslices_turn,head,nturns,circumference);
+            sorted[nsrc].index = i;
+            nsrc++;
+        }
+    }
+    qsort(sorted, nsrc, sizeof(struct zslice), compare_zslice);
 
-    #ifdef MPI
-    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
-    MPI_Comm_size(MPI_COMM_WORLD, &size);
-    #endif
-    for(i=nslice*nbunch*(nturns-1);i<nslice*nbunch*nturns;i++){  
-        ib = (int)((i-nslice*nbunch*(nturns-1))/nslice);
-        if(turnhistoryW[i]>0.0 && rank==(i+size)%size){
-            for (ii=0;ii<nslice*nbunch*nturns;ii++){
-                ds = turnhistoryZ[i]-turnhistoryZ[ii];
-                if(turnhistoryW[ii]>0.0 && ds>=0){
-                    wi = turnhistoryW[ii];
-                    wake = wakefunc_long_resonator(ds,freq,qfactor,rshunt,beta);       
-                    kz[i-nslice*nbunch*(nturns-1)] += normfact*wi*wake[0];
-                    vbeamk[0] += normfact*wi*wake[0]*energy/nbunch;
-                    vbeamk[1] -= normfact*wi*wake[1]*energy/nbunch;
-                    vbr[ib] += normfact*wi*wake[0]*energy;
-                    vbi[ib] -= normfact*wi*wake[1]*energy;
-                }            
+    for (k=0; k<nsrc;) {
+        double z = sorted[k].z;
+        double wsum = 0.0;
+        double sw0, sw1;
+        int kk, kend;
+
+        /* Sources at the same position, including the observation slice
+           itself, contribute wake(0) */
+        for (kend=k; kend<nsrc && sorted[kend].z==z; kend++)
+            wsum += turnhistoryW[sorted[kend].index];
+
+        /* Sources strictly ahead contribute through the mode amplitudes */
+        if (qfactor > 0.5) {
+            sw0 = 2*w0*(state[0] + ratio*state[1]);
+            sw1 = 2*w0*(state[1] - ratio*state[0]);
+        } else if (qfactor == 0.5) {
+            sw0 = 2*w0*(state[0] + alpha*state[1]);
+            sw1 = 0.0;
+        } else {
+            sw0 = w0*((1.0+ratio)*state[0] + (1.0-ratio)*state[1]);
+            sw1 = w0*((1.0-ratio)*state[0] - (1.0+ratio)*state[1]);
+        }
+        sw0 += w0*wsum;
+
+        for (kk=k; kk<kend; kk++) {
+            int is = sorted[kk].index;
+            if (is >= first && is < first+nslices_turn) {
+                int ib = (is-first)/nslice;
+                kz[is-first] = normfact*sw0;
+                vbeamk[0] += normfact*sw0*energy/nbunch;
+                vbeamk[1] -= normfact*sw1*energy/nbunch;
+                vbr[ib] += normfact*sw0*energy;
+                vbi[ib] -= normfact*sw1*energy;
             }
         }
+
+        /* Add the new sources and move to the next position */
+        state[0] += wsum;
+        if (qfactor < 0.5) state[1] += wsum;
+        if (kend < nsrc)
+            resonator_decay(state, (sorted[kend].z-z)/(beta*C0), alpha, omegabar, qfactor);
+        k = kend;
     }
-    #ifdef MPI
-    MPI_Allreduce(MPI_IN_PLACE,kz,nslice*nbunch,MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD);
-    MPI_Allreduce(MPI_IN_PLACE,vbeamk,2,MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD);
-    MPI_Allreduce(MPI_IN_PLACE,vbr,nbunch,MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD);
-    MPI_Allreduce(MPI_IN_PLACE,vbi,nbunch,MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD);
-    MPI_Barrier(MPI_COMM_WORLD);
-    #endif
+    atFree(sorted);
+
     vba = sqrt(vbeamk[0]*vbeamk[0]+vbeamk[1]*vbeamk[1]);   
     vbp = atan2(vbeamk[1],vbeamk[0]);
     vbeamk[0] = vba;
@@ -366,16 +866,17 @@ void compute_kicks_longres(int nslice,int nbunch,int nturns, double *turnhistory
         vbr[i] = sqrt(vr*vr+vi*vi); 
         vbi[i] = atan2(vi,vr);
     }
-    free(wake);
 };
 
 
-void compute_kicks_phasor(int nslice, int nbunch, int nturns, double *turnhistory,
+static void compute_kicks_phasor(int nslice, int nbunch, int nturns, int head, double *turnhistory,
                           double normfact, double *kz,double freq, double qfactor,
                           double rshunt, double *vbeam, double circumference,
                           double energy, double beta, double *vbeamk, double *vbunch){  
     #ifndef _MSC_VER  
     int i,ib;
+    int first = nslice*nbunch*head;
+    int last = first+nslice*nbunch-1;
     double wi;
     double dt =0.0;
     double *turnhistoryZ = turnhistory+nslice*nbunch*nturns*2;
@@ -395,10 +896,10 @@ void compute_kicks_phasor(int nslice, int nbunch, int nturns, double *turnhistor
         vbi[ib] = 0.0;
     }
     
-    for(i=nslice*nbunch*(nturns-1);i<nslice*nbunch*nturns;i++){
-        ib = (int)((i-nslice*nbunch*(nturns-1))/nslice);
+    for(i=first;i<=last;i++){
+        ib = (int)((i-first)/nslice);
         wi = turnhistoryW[i];
-        if(i==nslice*nbunch*(nturns-1)){
+        if(i==first){
             dt = (circumference+turnhistoryZ[i])/bc;
         }else{
             dt = (turnhistoryZ[i]-turnhistoryZ[i-1])/bc;
@@ -407,10 +908,10 @@ void compute_kicks_phasor(int nslice, int nbunch, int nturns, double *turnhistor
         vbeamkc += vbeamc+normfact*wi*kick*energy;
         vbr[ib] += creal(vbeamc+normfact*wi*kick*energy);
         vbi[ib] += cimag(vbeamc+normfact*wi*kick*energy);
-        kz[i-nslice*nbunch*(nturns-1)] = creal(vbeamc/energy+normfact*wi*kick);
+        kz[i-first] = creal(vbeamc/energy+normfact*wi*kick);
         vbeamc += 2*normfact*wi*kick*energy;    
     }
-    dt = -turnhistoryZ[nslice*nbunch*nturns-1]/bc;
+    dt = -turnhistoryZ[last]/bc;
     vbeamc = vbeamc*cexp((I*omr-omr/(2*qfactor))*dt);
     vbeam[0] = cabs(vbeamc);
     vbeam[1] = carg(vbeamc); 
@@ -428,7 +929,7 @@ void compute_kicks_phasor(int nslice, int nbunch, int nturns, double *turnhistor
 };
 
 
-void update_vgen(double *vbeam,double *vcav,double *vgen,double voltgain,double phasegain){
+static void update_vgen(double *vbeam,double *vcav,double *vgen,double voltgain,double phasegain){
     double vbeamr = vbeam[0]*cos(vbeam[1]);
     double vbeami = vbeam[0]*sin(vbeam[1]);
     double vcavr = vcav[0]*cos(vcav[1]);
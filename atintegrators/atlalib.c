@@ -175,3 +175,18 @@ static void checkiflostEllipticalAp(double *r6, const double *axesptr)
 	if ((xnorm*xnorm + znorm*znorm) >= 1) markaslost(r6,5);
 }
 
+static void checkiflostAperture(double *r6, const double *limits, const double *axesptr)
+{
+    /* Rectangular and elliptical apertures checked together: the conditions
+     * are combined without branching and the particle is marked once */
+    int lost = 0;
+    if (limits)
+        lost = (r6[0]<limits[0]) | (r6[0]>limits[1]) | (r6[2]<limits[2]) | (r6[2]>limits[3]);
+    if (axesptr) {
+        double xnorm = r6[0]/axesptr[0];
+        double znorm = r6[2]/axesptr[1];
+        lost |= ((xnorm*xnorm + znorm*znorm) >= 1);
+    }
+    if (lost) markaslost(r6,5);
+}
+
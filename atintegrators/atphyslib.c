@@ -79,6 +79,52 @@ static void edge_fringe_exit(double* r, double inv_rho, double edge_angle,
 }
 
 
+/* Edge focusing quantities depending only on the element, computed once
+   by edge_fringe_prepare when the element data is built */
+struct edge_fringe
+{
+    double inv_rho;
+    double edge_angle;
+    double fringecorr;
+    double fx;      /* horizontal focusing */
+    double fy;      /* vertical focusing without fringe field correction */
+    int method;
+};
+
+static void edge_fringe_prepare(struct edge_fringe *edge, double inv_rho, double edge_angle,
+        double fint, double gap, int method)
+{
+    edge->inv_rho = inv_rho;
+    edge->edge_angle = edge_angle;
+    edge->method = method;
+    if ((fint==0.0) || (gap==0.0) || (method==0))
+        edge->fringecorr = 0.0;
+    else {
+        double sedge = sin(edge_angle);
+        double cedge = cos(edge_angle);
+        edge->fringecorr = inv_rho*gap*fint*(1+sedge*sedge)/cedge;
+    }
+    edge->fx = inv_rho*tan(edge_angle);
+    edge->fy = edge->fx;
+}
+
+static void edge_fringe_apply(double* r, const struct edge_fringe *edge, int exit)
+/* Same as edge_fringe_entrance (exit=0) and edge_fringe_exit (exit=1):
+   only the terms depending on the particle are computed */
+{
+    double fy;
+    if (edge->method==3)
+        fy = edge->inv_rho*tan(edge->edge_angle-edge->fringecorr+(exit ? -r[1] : r[1])/(1+r[4]));
+    else if (edge->fringecorr==0.0)
+        fy = (edge->method==2) ? edge->fy/(1+r[4]) : edge->fy;
+    else if (edge->method==2)
+        fy = edge->inv_rho*tan(edge->edge_angle-edge->fringecorr/(1+r[4]))/(1+r[4]);
+    else
+        fy = edge->inv_rho*tan(edge->edge_angle-edge->fringecorr/(1+r[4]));
+    r[1]+=r[0]*edge->fx;
+    r[3]-=r[2]*fy;
+}
+
 static void edge_fringe2A(double* r, double inv_rho, double edge_angle, double fint, double gap,double h1,double K1)
 {   /* Entrance Fringe field transport map to second order in dipoles with fringe field */
     double fx = inv_rho*tan(edge_angle);
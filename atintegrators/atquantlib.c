@@ -428,29 +428,88 @@ static double interpolate(int ip, double p)
     return intp;
 }
 
+/* Inverse cumulative distribution of the photon energies on a uniform grid
+   of v = -log(1-ran), on which it is smooth up to the high energy tail.
+   The grid is built once from the interpolated table, so that drawing a
+   photon needs no search */
+
+#define QUANT_LB 0.21
+#define QUANT_UB 0.99999
+#define QUANT_NGRID 2048
+
+static double quant_grid[QUANT_NGRID+1];
+static double quant_v0, quant_scale;
+static int quant_grid_done = 0;
+
+/* The flag is read and written atomically: a thread seeing it set also
+   sees the filled grid, thanks to the flush preceding the write */
+static int quant_grid_ready(void)
+{
+    int done;
+    #ifdef _OPENMP
+    #pragma omp atomic read
+    #endif /*_OPENMP*/
+    done = quant_grid_done;
+    return done;
+}
+
+static void atQuantInit(void)
+{
+    if (!quant_grid_ready()) {
+        #ifdef _OPENMP
+        #pragma omp critical(atquant_init)
+        #endif /*_OPENMP*/
+        if (!quant_grid_ready()) {
+            double v1 = -log(1.0 - QUANT_UB);
+            int i;
+            quant_v0 = -log(1.0 - QUANT_LB);
+            quant_scale = QUANT_NGRID / (v1 - quant_v0);
+            for (i = 0; i <= QUANT_NGRID; i++) {
+                double v = quant_v0 + i / quant_scale;
+                double ran = -expm1(-v);
+                quant_grid[i] = interpolate(bs_table(ran), ran);
+            }
+            #ifdef _OPENMP
+            #pragma omp flush
+            #pragma omp atomic write
+            #endif /*_OPENMP*/
+            quant_grid_done = 1;
+        }
+    }
+}
+
 static double getEnergy(pcg32_random_t *rng, double ec)
 {
     double re;
-    double lb = 0.21;
-    double ub = 0.99999;
     double ran = atrandd_r(rng);
 
-    if (ran <= lb) {
+    if (ran <= QUANT_LB) {
         /* Low energy: 21% of cases, analytical approximation */
-        double cst0 = 1.23159;
-        re = pow((ran / cst0), 3);
-    } else if (ran > ub) {
+        double y = ran / 1.23159;
+        re = y * y * y;
+    } else if (ran > QUANT_UB) {
         //* High energy: 0.001 % of cases, inversion of the upbranch function */
         double mini = 0.0;
         double maxi = 100.0;
         double eps = maxi * 1.0e-4;
         re = bs_invfunc(ran, mini, maxi, eps);
     } else {
-        /* Intermediate energy: 79% of cases, table interpolation */
-        int ip = bs_table(ran);
-        re = interpolate(ip, ran);
-        /*printf("%d %lf %lf\n",ip,ran,re);*/
+        /* Intermediate energy: 79% of cases, grid interpolation */
+        double x = (-log1p(-ran) - quant_v0) * quant_scale;
+        int ip = (int)x;
+        if (ip >= QUANT_NGRID) ip = QUANT_NGRID-1;
+        re = quant_grid[ip] + (x - ip) * (quant_grid[ip+1] - quant_grid[ip]);
     };
 
     return re * ec;
 }
+
+/* Total energy of a Poisson-distributed number of photons */
+static double getEnergyLoss(pcg32_random_t *rng, double ng, double ec)
+{
+    int i, nph = atrandp_r(rng, ng);
+    double de = 0.0;
+    for (i = 0; i < nph; i++)
+        de += getEnergy(rng, ec);
+    return de;
+}
@@ -22,6 +22,9 @@
  */
 #include <math.h>
 #include <stdint.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif /*_OPENMP*/
 
 #ifndef TWOPI
 #define TWOPI  6.28318530717959
@@ -31,19 +34,21 @@
 #define AT_RNG_STATE 0x853c49e6748fea9bULL
 #define AT_RNG_INC 0xda3e39cb94b95bdbULL
 
-#define COMMON_PCG32_INITIALIZER   { AT_RNG_STATE, AT_RNG_INC }
-#define THREAD_PCG32_INITIALIZER   { AT_RNG_STATE, 1ULL }
+#define COMMON_PCG32_INITIALIZER   { AT_RNG_STATE, AT_RNG_INC, 0, 0.0 }
+#define THREAD_PCG32_INITIALIZER   { AT_RNG_STATE, 1ULL, 0, 0.0 }
 
 struct pcg_state_setseq_64 {    // Internals are *Private*.
     uint64_t state;             // RNG state.  All values are possible.
     uint64_t inc;               // Controls which RNG sequence (stream) is
                                 // selected. Must *always* be odd.
+    int has_spare;              // Spare gaussian value of the polar method
+    double spare;
 };
 typedef struct pcg_state_setseq_64 pcg32_random_t;
 
 // If you *must* statically initialize it, here's one.
 
-#define PCG32_INITIALIZER   { AT_RNG_STATE, AT_RNG_INC }
+#define PCG32_INITIALIZER   { AT_RNG_STATE, AT_RNG_INC, 0, 0.0 }
 
 static pcg32_random_t pcg32_global = PCG32_INITIALIZER;
 
@@ -79,6 +84,7 @@ static void pcg32_srandom_r(pcg32_random_t* rng, uint64_t initstate, uint64_t in
     if (!rng) rng = &pcg32_global;
     rng->state = 0U;
     rng->inc = (initseq << 1u) | 1u;
+    rng->has_spare = 0;
     pcg32_random_r(rng);
     rng->state += initstate;
     pcg32_random_r(rng);
@@ -102,17 +108,17 @@ static double atrandn_r(pcg32_random_t* rng, double mean, double stdDev)
 /* gaussian distribution */
 {
     /* Marsaglia polar method: https://en.wikipedia.org/wiki/Marsaglia_polar_method */
+    /* The spare value is kept in the generator state, so that independent
+       generators may be used concurrently */
 
-	static bool hasSpare = false;
-	static double spare;
 	double u, v, s;
 
-	if (hasSpare) {
-		hasSpare = false;
-		return mean + stdDev * spare;
+	if (!rng) rng = &pcg32_global;
+	if (rng->has_spare) {
+		rng->has_spare = 0;
+		return mean + stdDev * rng->spare;
 	}
 
-	hasSpare = true;	
 	do {
 		u = 2.0 * atrandd_r(rng) - 1.0;
 		v = 2.0 * atrandd_r(rng) - 1.0;
@@ -120,22 +126,44 @@ static double atrandn_r(pcg32_random_t* rng, double mean, double stdDev)
 	}
 	while ((s >= 1.0) || (s == 0.0));
 	s = sqrt(-2.0 * log(s) / s);
-	spare = v * s;
+	rng->spare = v * s;
+	rng->has_spare = 1;
 	return mean + stdDev * u * s;
 }
 
+static void atrandn_vec_r(pcg32_random_t* rng, double *x, int n, double mean, double stdDev)
+/* Fill x with n gaussian values */
+{
+    /* Box-Muller transform: no rejection, the transform loop vectorises */
+    int i;
+    for (i=0; i<n; i++)
+        x[i] = 1.0 - atrandd_r(rng);     /* (0, 1] */
+    #ifdef _OPENMP
+    #pragma omp simd
+    #endif /*_OPENMP*/
+    for (i=0; i < n-1; i+=2) {
+        double r = stdDev * sqrt(-2.0 * log(x[i]));
+        double theta = TWOPI * x[i+1];
+        x[i] = mean + r * cos(theta);
+        x[i+1] = mean + r * sin(theta);
+    }
+    if (n % 2)
+        x[n-1] = atrandn_r(rng, mean, stdDev);
+}
+
 static int atrandp_r(pcg32_random_t* rng, double lamb)
 /* poisson distribution */
 {
     int pk;
 
     if (lamb<11) {
-        double l = -lamb;
+        /* Product of uniform values: a single exponential per draw */
+        double l = exp(-lamb);
         int k = 0;
-        double p = 0;
+        double p = 1.0;
         do {
             k += 1;
-            p += log(atrandd_r(rng));
+            p *= atrandd_r(rng);
         } while (p>l);
         pk = k-1;
     }
@@ -146,6 +174,29 @@ static int atrandp_r(pcg32_random_t* rng, double lamb)
     return pk;
 }
 
+/* Selection of the generator of the running thread in a pool of
+   independent generators. With npool generators, thread i uses the
+   generator i % npool, so that the random sequences are reproducible for
+   a given seed and number of threads. Within nested parallel regions, the
+   thread number of the active level is used */
+
+static int atrng_thread_num(void)
+{
+#ifdef _OPENMP
+    int level;
+    for (level=omp_get_level(); level > 0; level--) {
+        if (omp_get_team_size(level) > 1)
+            return omp_get_ancestor_thread_num(level);
+    }
+#endif /*_OPENMP*/
+    return 0;
+}
+
+static inline pcg32_random_t *atrng_thread(pcg32_random_t *pool, int npool)
+{
+    return (npool > 1) ? pool + (atrng_thread_num() % npool) : pool;
+}
+
 /* Functions for uniform, normal and Poisson distributions with
    internal state variable */
 
@@ -5,7 +5,7 @@
 #define TWOPI  6.28318530717959
 #define C0  	2.99792458e8 
 
-void trackRFCavity(double *r_in, double le, double nv, double freq, double h, double lag, double philag,
+static void trackRFCavity(double *r_in, double le, double nv, double freq, double h, double lag, double philag,
                   int nturn, double T0, int num_particles)
 /* le - physical length
    nv - peak voltage (V) normalized to the design enegy (eV)
@@ -16,6 +16,10 @@ void trackRFCavity(double *r_in, double le, double nv, double freq, double h, do
     int c;
 
     if (le == 0) {
+        #ifdef _OPENMP
+        #pragma omp parallel for if (num_particles > OMP_PARTICLE_THRESHOLD) default(shared) \
+        shared(r_in,num_particles) private(c)
+        #endif /*_OPENMP*/
         for (c = 0; c<num_particles; c++) {
             double *r6 = r_in+c*6;
             if(!atIsNaN(r6[0]))
@@ -24,6 +28,10 @@ void trackRFCavity(double *r_in, double le, double nv, double freq, double h, do
     }
     else {
         double halflength = le/2;
+        #ifdef _OPENMP
+        #pragma omp parallel for if (num_particles > OMP_PARTICLE_THRESHOLD) default(shared) \
+        shared(r_in,num_particles) private(c)
+        #endif /*_OPENMP*/
         for (c = 0;c<num_particles;c++) {
             double *r6 = r_in+c*6;
             if(!atIsNaN(r6[0]))  {
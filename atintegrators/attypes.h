@@ -5,6 +5,13 @@
 #define OMP_PARTICLE_THRESHOLD (10)
 #endif
 
+#ifndef SOA_BLOCK_SIZE
+#define SOA_BLOCK_SIZE (64)
+#endif
+
+/* Rows of the single-precision particle arrays, see driftkickfloat.c */
+#define FLOAT_SOA_ROWS (8)
+
 struct elem;
 
 struct parameters
@@ -21,7 +28,8 @@ struct parameters
   double *bunch_spos;
   double *bunch_currents;
   struct pcg_state_setseq_64 *common_rng;
-  struct pcg_state_setseq_64 *thread_rng;
+  struct pcg_state_setseq_64 *thread_rng;   /* pool of nthread_rng generators, */
+  int nthread_rng;                          /* one per OpenMP thread */
 };
 
 #endif /*ATTYPES_H*/
@@ -113,3 +113,185 @@ static void strthinkick(double* r, const double* A, const double* B, double L, i
    r[1] -=  L*ReSum;
    r[3] +=  L*ImSum;
 }
+
+
+/***********************************************************************
+ Structure-of-arrays (SoA) variants of the kernels above.
+
+ The coordinates of a block of n particles are stored as 6 rows:
+      x[0..n-1], px[0..n-1], y[0..n-1], py[0..n-1], delta[0..n-1], ct[0..n-1]
+ r points to x[0] and consecutive rows are separated by stride doubles, so
+ that a block may be a sub-range of the full 6 x num_particles SoA array.
+ The loops have no dependency between particles and can be vectorized.
+ Lost particles (x = NaN) are left untouched, so that the results are
+ identical to the ones of the 6-doubles-per-particle kernels.
+
+ The same kernels are used by the 6-doubles-per-particle integrators on
+ batches of AT_SIMD_WIDTH particles gathered with aos_gather. The
+ operations are done in the same order as in the scalar kernels, so that
+ the results are bit-identical as long as the compiler does not contract
+ a*b+c into fused multiply-adds (the default for -std=c99). Otherwise
+ the AVX2/AVX-512 versions selected by AT_SIMD_DISPATCH may differ from
+ the scalar ones by 1 ulp per multiply-add of the Horner recursion.
+ ************************************************************************/
+
+#ifndef AT_SIMD_WIDTH
+#define AT_SIMD_WIDTH 8
+#endif
+
+static void soa_load(double *r6, const double *r, int stride)
+{
+   int i;
+   for (i=0; i<6; i++) r6[i] = r[i*stride];
+}
+
+static void soa_store(double *r, const double *r6, int stride)
+{
+   int i;
+   for (i=0; i<6; i++) r[i*stride] = r6[i];
+}
+
+static void aos_gather(double *rb, const double *r, int n)
+/* Copy n particles from the 6-doubles-per-particle array r into the
+ * SoA batch rb with stride AT_SIMD_WIDTH */
+{
+   int c, i;
+   for (c=0; c<n; c++)
+      for (i=0; i<6; i++) rb[i*AT_SIMD_WIDTH+c] = r[c*6+i];
+}
+
+static void aos_scatter(double *r, const double *rb, int n)
+{
+   int c, i;
+   for (c=0; c<n; c++)
+      for (i=0; i<6; i++) r[c*6+i] = rb[i*AT_SIMD_WIDTH+c];
+}
+
+static void fastdrift_soa(double *r, int stride, int n, double L)
+/* L is the physical length: the 1/(1+delta) normalisation is done
+ * internally for each particle, in the same way as NormL for fastdrift */
+{
+   int c;
+   double *x = r;
+   double *px = r + stride;
+   double *y = r + 2*stride;
+   double *py = r + 3*stride;
+   const double *dp = r + 4*stride;
+   double *ct = r + 5*stride;
+   AT_OMP_SIMD
+   for (c=0; c<n; c++) {
+      if (!atIsNaN(x[c])) {
+         double NormL = L*(1.0/(1.0+dp[c]));
+         x[c] += NormL*px[c];
+         y[c] += NormL*py[c];
+         ct[c] += NormL*(px[c]*px[c]+py[c]*py[c])/(2*(1+dp[c]));
+      }
+   }
+}
+
+static void pnorm_soa(double *pn, const double *r, int stride, int n)
+/* 1/(1+delta) of each particle, taken at the entrance of a magnet */
+{
+   int c;
+   const double *dp = r + 4*stride;
+   AT_OMP_SIMD
+   for (c=0; c<n; c++) pn[c] = 1.0/(1.0+dp[c]);
+}
+
+AT_INLINE void fastdrift_soa_pn(double *r, int stride, int n, double L, const double *pn)
+/* Same as fastdrift(r, L*pn), with 1/(1+delta) precomputed by pnorm_soa */
+{
+   int c;
+   double *x = r;
+   double *px = r + stride;
+   double *y = r + 2*stride;
+   double *py = r + 3*stride;
+   const double *dp = r + 4*stride;
+   double *ct = r + 5*stride;
+   AT_OMP_SIMD
+   for (c=0; c<n; c++) {
+      if (!atIsNaN(x[c])) {
+         double NormL = L*pn[c];
+         x[c] += NormL*px[c];
+         y[c] += NormL*py[c];
+         ct[c] += NormL*(px[c]*px[c]+py[c]*py[c])/(2*(1+dp[c]));
+      }
+   }
+}
+
+static void drift6_soa(double *r, int stride, int n, double L)
+/* Same as ATdrift6 in atlalib.c */
+{
+   int c;
+   double *x = r;
+   const double *px = r + stride;
+   double *y = r + 2*stride;
+   const double *py = r + 3*stride;
+   const double *dp = r + 4*stride;
+   double *ct = r + 5*stride;
+   AT_OMP_SIMD
+   for (c=0; c<n; c++) {
+      if (!atIsNaN(x[c])) {
+         double p_norm = 1/(1+dp[c]);
+         double NormL = L*p_norm;
+         x[c] += NormL*px[c];
+         y[c] += NormL*py[c];
+         ct[c] += NormL*p_norm*(px[c]*px[c]+py[c]*py[c])/2;
+      }
+   }
+}
+
+AT_INLINE void bndthinkick_soa(double *r, int stride, int n, const double* A, const double* B,
+        double L, double irho, int max_order)
+{
+   int c;
+   const double *x = r;
+   double *px = r + stride;
+   const double *y = r + 2*stride;
+   double *py = r + 3*stride;
+   const double *dp = r + 4*stride;
+   double *ct = r + 5*stride;
+   AT_OMP_SIMD
+   for (c=0; c<n; c++) {
+      if (!atIsNaN(x[c])) {
+         int i;
+         double ReSum = B[max_order];
+         double ImSum = A[max_order];
+         double ReSumTemp;
+         for (i=max_order-1; i>=0; i--) {
+            ReSumTemp = ReSum*x[c] - ImSum*y[c] + B[i];
+            ImSum = ImSum*x[c] +  ReSum*y[c] + A[i];
+            ReSum = ReSumTemp;
+         }
+         px[c] -=  L*(ReSum-(dp[c]-x[c]*irho)*irho);
+         py[c] +=  L*ImSum;
+         ct[c] +=  L*irho*x[c]; /* pathlength */
+      }
+   }
+}
+
+AT_INLINE void strthinkick_soa(double *r, int stride, int n, const double* A, const double* B,
+        double L, int max_order)
+{
+   int c;
+   const double *x = r;
+   double *px = r + stride;
+   const double *y = r + 2*stride;
+   double *py = r + 3*stride;
+   AT_OMP_SIMD
+   for (c=0; c<n; c++) {
+      if (!atIsNaN(x[c])) {
+         int i;
+         double ReSum = B[max_order];
+         double ImSum = A[max_order];
+         double ReSumTemp;
+         for (i=max_order-1; i>=0; i--) {
+            ReSumTemp = ReSum*x[c] - ImSum*y[c] + B[i];
+            ImSum = ImSum*x[c] +  ReSum*y[c] + A[i];
+            ReSum = ReSumTemp;
+         }
+         px[c] -=  L*ReSum;
+         py[c] +=  L*ImSum;
+      }
+   }
+}
@@ -0,0 +1,104 @@
+/***********************************************************************
+ Single-precision variants of the structure-of-arrays kernels of
+ driftkick.c, used by the float32 tracking mode of atpass.
+
+ The coordinates of the particles are stored as FLOAT_SOA_ROWS rows of
+ floats separated by stride:
+      x, px, y, py, delta, ct, delta_lo, ct_lo
+ The full values of delta and ct are the sums of the high and low parts,
+ so that the path lengthening accumulated over many elements and turns is
+ not lost in the float rounding. The kernels update ct with a compensated
+ (double-float) addition and never modify delta, changed only by the
+ elements tracked in double precision.
+ The transverse coordinates and the multipole kicks are computed in float.
+ ************************************************************************/
+
+#ifndef DRIFTKICKFLOAT_C
+#define DRIFTKICKFLOAT_C
+
+static void soaf_load(double *r6, const float *r, int stride)
+{
+   int i;
+   for (i=0; i<6; i++) r6[i] = r[i*stride];
+   r6[4] += r[6*stride];
+   r6[5] += r[7*stride];
+}
+
+static void soaf_store(float *r, const double *r6, int stride)
+{
+   int i;
+   for (i=0; i<6; i++) r[i*stride] = (float)r6[i];
+   r[6*stride] = (float)(r6[4] - r[4*stride]);
+   r[7*stride] = (float)(r6[5] - r[5*stride]);
+}
+
+AT_INLINE void compensated_add(float *hi, float *lo, float d)
+/* (hi, lo) += d, with the error-free two-sum of hi and d */
+{
+   float s = *hi + d;
+   float bp = s - *hi;
+   float err = (*hi - (s - bp)) + (d - bp);
+   float t = *lo + err;
+   *hi = s + t;
+   *lo = t - (*hi - s);
+}
+
+AT_INLINE void pnorm_soaf(float *pn, const float *r, int stride, int n)
+/* 1/(1+delta) of each particle */
+{
+   int c;
+   const float *dp = r + 4*stride;
+   const float *dplo = r + 6*stride;
+   AT_OMP_SIMD
+   for (c=0; c<n; c++) pn[c] = 1.0f/(1.0f+(dp[c]+dplo[c]));
+}
+
+AT_INLINE void fastdrift_soaf(float *r, int stride, int n, float L, const float *pn)
+/* Same as fastdrift_soa_pn */
+{
+   int c;
+   float *x = r;
+   const float *px = r + stride;
+   float *y = r + 2*stride;
+   const float *py = r + 3*stride;
+   float *ct = r + 5*stride;
+   float *ctlo = r + 7*stride;
+   AT_OMP_SIMD
+   for (c=0; c<n; c++) {
+      if (!atIsNaN(x[c])) {
+         float NormL = L*pn[c];
+         x[c] += NormL*px[c];
+         y[c] += NormL*py[c];
+         compensated_add(ct+c, ctlo+c, 0.5f*NormL*pn[c]*(px[c]*px[c]+py[c]*py[c]));
+      }
+   }
+}
+
+AT_INLINE void strthinkick_soaf(float *r, int stride, int n, const double* A, const double* B,
+        float L, int max_order)
+/* Same as strthinkick_soa */
+{
+   int c;
+   const float *x = r;
+   float *px = r + stride;
+   const float *y = r + 2*stride;
+   float *py = r + 3*stride;
+   AT_OMP_SIMD
+   for (c=0; c<n; c++) {
+      if (!atIsNaN(x[c])) {
+         int i;
+         float ReSum = (float)B[max_order];
+         float ImSum = (float)A[max_order];
+         float ReSumTemp;
+         for (i=max_order-1; i>=0; i--) {
+            ReSumTemp = ReSum*x[c] - ImSum*y[c] + (float)B[i];
+            ImSum = ImSum*x[c] +  ReSum*y[c] + (float)A[i];
+            ReSum = ReSumTemp;
+         }
+         px[c] -=  L*ReSum;
+         py[c] +=  L*ImSum;
+      }
+   }
+}
+
+#endif /* DRIFTKICKFLOAT_C */
@@ -33,6 +33,9 @@
  
 *************************************************************************/
 
+#ifndef DRIFTKICKRAD_C
+#define DRIFTKICKRAD_C
+
 static void drift6(double* r, double L)
 /*   Input parameter L is the physical length
      1/(1+delta) normalization is done internally
@@ -51,55 +54,51 @@ static void drift6(double* r, double L)
 
 #define SQR(X) ((X)*(X))
 
-double StrB2perp(double bx, double by, 
-                            double x, double xpr, double y, double ypr)
-/* Calculates sqr(|B x e|) , where e is a unit vector in the direction of velocity  */
-
-{	double v_norm2;
-	v_norm2 = 1/(1 + SQR(xpr) + SQR(ypr));
-
-	/* components of the normalized velocity vector
-	   double ex, ey, ez;
-	   ex = xpr; 
-	   ey = ypr; 
-	   ez = 1;
-	*/
-  	
-	return((SQR(by) + SQR(bx) + SQR(bx*ypr - by*xpr) )*v_norm2) ;
+AT_INLINE double radiation_constant(double E0)
+/* Classical radiation constant scaled by E0^3, computed once per element */
+{
+   return CGAMMA*E0*E0*E0/(TWOPI*1e27);	/* [m]/[GeV^3] M.Sands (4.1) */
+}
 
-} 
+AT_INLINE void radiation_kick(double *r, double bx, double by, double irho,
+        double L, double crad)
+/*****************************************************************************
+ Energy loss by classical radiation over a kick of length L, shared by the
+ radiating integrators. (bx, by) is the full field, including the field
+ providing the curvature irho of the reference trajectory (0 for straight
+ elements), and crad is given by radiation_constant(E0).
+ |e x B|^2, where e is the direction of the velocity (xpr, ypr, 1+x*irho),
+ is computed without square root. The angles xpr, ypr are conserved.
+ ******************************************************************************/
+{
+   double p_norm = 1.0/(1.0+r[4]);
+   double xpr = r[1]*p_norm;
+   double ypr = r[3]*p_norm;
+   double hx = 1.0 + r[0]*irho;
+   double xyp2 = SQR(xpr) + SQR(ypr);
+   double B2P = (SQR(by*hx) + SQR(bx*hx) + SQR(bx*ypr - by*xpr))/(SQR(hx) + xyp2);
+   double p1;
 
+   r[4] -= crad*SQR(1.0+r[4])*B2P*(hx + 0.5*xyp2)*L;
 
-static double B2perp(double bx, double by, double irho,
-        double x, double xpr, double y, double ypr)
-        /* Calculates sqr(|e x B|) , where e is a unit vector in the direction of velocity  */
-        
-{
-    double v_norm2 = 1/(SQR(1+x*irho)+ SQR(xpr) + SQR(ypr));
-    
-    /* components of the  velocity vector
-     * double ex, ey, ez;
-     * ex = xpr;
-     * ey = ypr;
-     * ez = (1+x*irho);
-     */
-    
-    return((SQR(by*(1+x*irho)) + SQR(bx*(1+x*irho)) + SQR(bx*ypr - by*xpr) )*v_norm2) ;
+   /* recalculate momentums from angles after losing energy for radiation 	*/
+   p1 = 1.0 + r[4];
+   r[1] = xpr*p1;
+   r[3] = ypr*p1;
 }
 
-static void bndthinkickrad(double* r, double* A, double* B, double L, double irho, double E0, int max_order)
-
+AT_INLINE void thinkickrad(double* r, const double* A, const double* B, double L,
+        double irho, double crad, int max_order)
 /*****************************************************************************
 Calculate multipole kick in a curved elemrnt (bending magnet)
 The reference coordinate system  has the curvature given by the inverse
-(design) radius irho.
+(design) radius irho, 0 in straight elements.
 IMPORTANT !!!
 The magnetic field Bo that provides this curvature MUST NOT be included in the dipole term
 PolynomB[1](MATLAB notation)(C: B[0] in this function) of the By field expansion
 HOWEVER!!! to calculate the effect of classical radiation the full field must be
-used in the square of the |v x B|.
-When calling B2perp(Bx, By, ...), use the By = RESum + irho, where ImSum is the sum of
-the polynomial terms in PolynomB.
+used in the square of the |v x B|: radiation_kick is called with
+By = ReSum + irho, where ReSum is the sum of the polynomial terms in PolynomB.
 
  The kick is given by
  
@@ -119,8 +118,8 @@ the polynomial terms in PolynomB.
    double ImSum = A[max_order];
    double ReSum = B[max_order];
    double ReSumTemp;
-   double x ,xpr, y, ypr, p_norm,dp_0, B2P;
-   double CRAD = CGAMMA*E0*E0*E0/(TWOPI*1e27);	/* [m]/[GeV^3] M.Sands (4.1) */
+   double x = r[0];
+   double dp_0 = r[4];
    
    /* recursively calculate the local transvrese magnetic field
     * Bx = ReSum, By = ImSum
@@ -131,73 +130,11 @@ the polynomial terms in PolynomB.
         ReSum = ReSumTemp;
    }
    
-   /* calculate angles from momentums 	*/
-   p_norm = 1/(1+r[4]);
-   x   = r[0];
-   xpr = r[1]*p_norm;
-   y   = r[2];
-   ypr = r[3]*p_norm;
-   
-   B2P = B2perp(ImSum, ReSum +irho, irho, x , xpr, y ,ypr);
+   radiation_kick(r, ImSum, ReSum+irho, irho, L, crad);
    
-   dp_0 = r[4];
-   r[4] = r[4] - CRAD*SQR(1+r[4])*B2P*(1 + x*irho + (SQR(xpr)+SQR(ypr))/2 )*L;
-   
-   /* recalculate momentums from angles after losing energy for radiation 	*/
-   p_norm = 1/(1+r[4]);
-   r[1] = xpr/p_norm;
-   r[3] = ypr/p_norm;
-   
-   r[1] -=  L*(ReSum-(dp_0-r[0]*irho)*irho);
+   r[1] -=  L*(ReSum-(dp_0-x*irho)*irho);
    r[3] +=  L*ImSum;
-   r[5] +=  L*irho*r[0]; /* pathlength */
+   r[5] +=  L*irho*x; /* pathlength */
 }
 
-static void strthinkickrad(double* r, const double* A, const double* B, double L, double E0,int max_order)
-/*****************************************************************************
- Calculate and apply a multipole kick to a 6-dimentional
- phase space vector in a straight element ( quadrupole)
- 
- IMPORTANT !!!
- he reference coordinate system is straight but the field expansion may still
- ontain dipole terms: PolynomA(1), PolynomB(1) - in MATLAB notation,
- [0], B[0] - C,C++ notation
- 
- ******************************************************************************/
-{
-   int i;
-   double ReSum = B[max_order];
-   double ImSum = A[max_order];
-   double ReSumTemp;
-   double irho=0;/*straight elements no curvature.*/
-   double x ,xpr, y, ypr, p_norm,dp_0, B2P;
-   double CRAD = CGAMMA*E0*E0*E0/(TWOPI*1e27);	/* [m]/[GeV^3] M.Sands (4.1) */
-   
-   for (i=max_order-1; i>=0; i--) {
-      ReSumTemp = ReSum*r[0] - ImSum*r[2] + B[i];
-      ImSum = ImSum*r[0] +  ReSum*r[2] + A[i];
-      ReSum = ReSumTemp;
-   }
-   
-   /* calculate angles from momentums 	*/
-   p_norm = 1/(1+r[4]);
-   x   = r[0];
-   xpr = r[1]*p_norm;
-   y   = r[2];
-   ypr = r[3]*p_norm;
-   
-   /*B2P = B2perp(ImSum, ReSum +irho, irho, x , xpr, y ,ypr);*/
-   B2P = StrB2perp(ImSum, ReSum , x , xpr, y ,ypr);
-   
-   dp_0 = r[4];
-   r[4] = r[4] - CRAD*SQR(1+r[4])*B2P*(1 + x*irho + (SQR(xpr)+SQR(ypr))/2 )*L;
-   
-   /* recalculate momentums from angles after losing energy for radiation 	*/
-   p_norm = 1/(1+r[4]);
-   r[1] = xpr/p_norm;
-   r[3] = ypr/p_norm;
-   
-   r[1] -=  L*(ReSum-(dp_0-r[0]*irho)*irho);
-   r[3] +=  L*ImSum;
-   r[5] +=  L*irho*r[0]; /* pathlength */
-}
+#endif /* DRIFTKICKRAD_C */
@@ -0,0 +1,204 @@
+/*   File: exactdriftkick.c
+     Kernels for the exact Hamiltonian integrators
+
+     The drifts keep the full square root of the Hamiltonian:
+
+         pz = sqrt((1+delta)^2 - px^2 - py^2)
+
+     instead of its paraxial expansion. In bending magnets, the reference
+     dipole field is integrated exactly in the curved frame (Forest,
+     "Beam Dynamics: A New Attitude and Framework", chap. 12), and the
+     other field components are applied as thin kicks. The polar frame
+     has its centre of curvature at x = -1/irho, as in bndthinkick.
+
+     The SoA kernels follow the conventions of driftkick.c: r points to
+     the x row of a block of n particles, rows separated by stride
+     doubles, and the lost particles are left untouched. A particle whose
+     transverse momentum exceeds its total momentum gets NaN coordinates
+     and is flagged as lost.
+*/
+
+#ifndef EXACTDRIFTKICK_C
+#define EXACTDRIFTKICK_C
+
+#include <math.h>
+
+static double exact_pz(const double *r6)
+{
+    double dp1 = 1.0 + r6[4];
+    return sqrt(dp1*dp1 - r6[1]*r6[1] - r6[3]*r6[3]);
+}
+
+static void exactdrift(double *r6, double L)
+/* Exact drift, Forest 10.23 */
+{
+    double u = L/exact_pz(r6);
+    r6[0] += r6[1]*u;
+    r6[2] += r6[3]*u;
+    r6[5] += u*(1.0+r6[4]) - L;
+}
+
+static void exact_yrot(double *r6, double phi)
+/* Rotation of the reference frame by phi around the vertical axis
+   through the reference point, in a field-free region (Forest 10.26) */
+{
+    double c = cos(phi);
+    double s = sin(phi);
+    double pz = exact_pz(r6);
+    double p = c*pz - s*r6[1];
+    double x = r6[0];
+    r6[0] = x*pz/p;
+    r6[1] = s*pz + c*r6[1];
+    r6[2] += x*r6[3]*s/p;
+    r6[5] += (1.0+r6[4])*x*s/p;
+}
+
+static void exact_wedge(double *r6, double irho, double phi)
+/* Rotation of the reference frame by phi around the vertical axis
+   through the reference point, inside the dipole field irho (Forest 12.41) */
+{
+    double c = cos(phi);
+    double s = sin(phi);
+    double dp1 = 1.0 + r6[4];
+    double x = r6[0];
+    double px = r6[1];
+    double pt = sqrt(dp1*dp1 - r6[3]*r6[3]);
+    double pz = exact_pz(r6);
+    double p = px*c + pz*s;
+    double b = irho*x*s;
+    double pxf = p - b;
+    double a = pz*c - px*s;
+    double d = sqrt(pt*pt - pxf*pxf);
+    double turn = phi + asin(px/pt) - asin(pxf/pt);
+    r6[0] = x*(c + s*(2.0*p - b)/(d + a));
+    r6[1] = pxf;
+    r6[2] += r6[3]*turn/irho;
+    r6[5] += dp1*turn/irho;
+}
+
+static void exact_edge_fringe(double *r6, double irho, double fringecorr, int exit)
+/* Vertical focusing of a hard-edge dipole fringe, in the frame of the pole
+   face: the edge angle is given by the exact slope of the particle.
+   fringecorr is the gap correction of edge_fringe_prepare */
+{
+    double dp1 = 1.0 + r6[4];
+    double psi = r6[1]/exact_pz(r6);
+    if (exit) psi = -psi;
+    r6[3] -= r6[2]*irho*tan(psi - fringecorr/dp1);
+}
+
+static void exactdrift_soa(double *r, int stride, int n, double L)
+/* Same as exactdrift */
+{
+    int c;
+    double *x = r;
+    const double *px = r + stride;
+    double *y = r + 2*stride;
+    const double *py = r + 3*stride;
+    const double *dp = r + 4*stride;
+    double *ct = r + 5*stride;
+    AT_OMP_SIMD
+    for (c=0; c<n; c++) {
+        if (!atIsNaN(x[c])) {
+            double dp1 = 1.0 + dp[c];
+            double u = L/sqrt(dp1*dp1 - px[c]*px[c] - py[c]*py[c]);
+            x[c] += px[c]*u;
+            y[c] += py[c]*u;
+            ct[c] += u*dp1 - L;
+        }
+    }
+}
+
+struct exactbend_step
+{
+    double irho;
+    double L;
+    double cs;      /* cos(irho*L) */
+    double sn;      /* sin(irho*L) */
+    double cm1;     /* cos(irho*L) - 1, without cancellation */
+};
+
+static void exactbend_prepare(struct exactbend_step *step, double irho, double L)
+{
+    double phi = irho*L;
+    step->irho = irho;
+    step->L = L;
+    step->cs = cos(phi);
+    step->sn = sin(phi);
+    step->cm1 = -2.0*sin(0.5*phi)*sin(0.5*phi);
+}
+
+AT_INLINE void exactbend_soa(double *r, int stride, int n, const struct exactbend_step *step)
+/* Exact propagation over the length L of the sector bend with curvature
+   irho, in the dipole field irho (Forest 12.18). Reduces to exactdrift_soa
+   for irho = 0 */
+{
+    int c;
+    double *x = r;
+    double *px = r + stride;
+    double *y = r + 2*stride;
+    const double *py = r + 3*stride;
+    const double *dp = r + 4*stride;
+    double *ct = r + 5*stride;
+    double irho = step->irho;
+    double L = step->L;
+    double cs = step->cs;
+    double sn = step->sn;
+    double cm1 = step->cm1;
+    if (irho == 0.0) {
+        exactdrift_soa(r, stride, n, L);
+        return;
+    }
+    AT_OMP_SIMD
+    for (c=0; c<n; c++) {
+        if (!atIsNaN(x[c])) {
+            double dp1 = 1.0 + dp[c];
+            double pt2 = dp1*dp1 - py[c]*py[c];
+            double pt = sqrt(pt2);
+            double pz = sqrt(pt2 - px[c]*px[c]);
+            double p = px[c]*cs + pz*sn;
+            double b = (1.0 + irho*x[c])*sn;
+            double pxf = p - b;
+            double a = pz*cs - px[c]*sn;
+            double d = sqrt(pt2 - pxf*pxf);
+            double f = sn*(2.0*p - b)/(d + a);
+            /* turn angle of the particle, minus phi */
+            double dturn = asin(px[c]/pt) - asin(pxf/pt);
+            x[c] = x[c]*(cs + f) + (cm1 + f)/irho;
+            px[c] = pxf;
+            y[c] += py[c]*(L + dturn/irho);
+            ct[c] += dp1*dturn/irho + (dp1 - 1.0)*L;
+        }
+    }
+}
+
+AT_INLINE void bndexactkick_soa(double *r, int stride, int n, const double* A, const double* B,
+        double L, double irho, int max_order)
+/* Multipole kick in the curved frame, the reference dipole field being
+   integrated by exactbend_soa: B[0] is only the field error */
+{
+    int c;
+    const double *x = r;
+    double *px = r + stride;
+    const double *y = r + 2*stride;
+    double *py = r + 3*stride;
+    AT_OMP_SIMD
+    for (c=0; c<n; c++) {
+        if (!atIsNaN(x[c])) {
+            int i;
+            double ReSum = B[max_order];
+            double ImSum = A[max_order];
+            double ReSumTemp;
+            double hx = 1.0 + irho*x[c];
+            for (i=max_order-1; i>=0; i--) {
+                ReSumTemp = ReSum*x[c] - ImSum*y[c] + B[i];
+                ImSum = ImSum*x[c] +  ReSum*y[c] + A[i];
+                ReSum = ReSumTemp;
+            }
+            px[c] -=  L*hx*ReSum;
+            py[c] +=  L*hx*ImSum;
+        }
+    }
+}
+
+#endif /*EXACTDRIFTKICK_C*/
@@ -28,271 +28,300 @@
 #include <math.h>
 #include <stdio.h>
 
-void GWigGauge(struct gwig *pWig, double *X, int flag);
-void GWigPass_2nd(struct gwig *pWig, double *X);
-void GWigPass_4th(struct gwig *pWig, double *X);
-void GWigMap_2nd(struct gwig *pWig, double *X, double dl);
-void GWigAx(struct gwig *pWig, double *Xvec, double *pax, double *paxpy);
-void GWigAy(struct gwig *pWig, double *Xvec, double *pay, double *paypx);
-double sinc(double x );
-
-/* This function appears to be unused. */
-void GWigGauge(struct gwig *pWig, double *X, int flag)
+/* The particles are tracked in batches of n <= AT_SIMD_WIDTH particles
+   stored as a structure-of-arrays (see driftkick.c): the loops over the
+   particles of a batch are vectorized. The coefficients of the harmonics
+   are computed once by GWigPrepare, and the longitudinal terms
+   sin(kz*z+tz), common to all particles, are tabulated by GWigFillZ */
+
+static double sinc(double x );
+
+static void GWigPrepare(struct gwig *pWig)
+/* Coefficients depending only on the wiggler parameters */
 {
-  double ax, ay, axpy, aypx;
+  int i;
+  double gamma0 = pWig->E0/XMC2;
+  double beta0 = sqrt(1e0 - 1e0/(gamma0*gamma0));
+  double kw = 2e0*PI/(pWig->Lw);
 
-  GWigAx(pWig, X, &ax, &axpy);
-  GWigAy(pWig, X, &ay, &aypx);
- 
-  if (flag == Elem_Entrance) {
-    /* At the entrance of the wiggler */
-    X[1] = X[1] + ax;
-    X[3] = X[3] + ay;
-  } else if (flag == Elem_Exit) {
-    /* At the exit of the wiggler */
-    X[1] = X[1] - ax;
-    X[3] = X[3] - ay;
-  } else {
-    printf("  GWigGauge: Unknown flag = %i\n", flag);
+  pWig->Kw = kw;
+  pWig->Aw = (q_e/m_e/clight)/(2e0*PI) * (pWig->Lw) * (pWig->PB0);
+  pWig->Nz = pWig->PN*(pWig->Nw)*((pWig->Pmethod == 4) ? 3 : 1);
+  for (i = 0; i < pWig->NHharm; i++) {
+    double kx = pWig->Hkx[i];
+    double ky = pWig->Hky[i];
+    double kz = pWig->Hkz[i];
+    pWig->HCw[i] = pWig->HCw_raw[i]*(pWig->Aw)/(gamma0*beta0);
+    pWig->HAx[i] = pWig->HCw[i]*(kw/kz);
+    pWig->HAxpy[i] = pWig->HAx[i]*ky;
+    pWig->HAy[i] = pWig->HAx[i]*(kx/ky);
+    pWig->HAypx[i] = pWig->HAx[i]*pow(kx/ky,2);
+  }
+  for (i = 0; i < pWig->NVharm; i++) {
+    double kx = pWig->Vkx[i];
+    double ky = pWig->Vky[i];
+    double kz = pWig->Vkz[i];
+    pWig->VCw[i] = pWig->VCw_raw[i]*(pWig->Aw)/(gamma0*beta0);
+    pWig->VAy[i] = pWig->VCw[i]*(kw/kz);
+    pWig->VAx[i] = pWig->VAy[i]*(ky/kx);
+    pWig->VAxpy[i] = pWig->VAy[i]*pow(ky/kx,2);
+    pWig->VAypx[i] = pWig->VAy[i]*kx;
   }
 }
 
-
-void GWigPass_2nd(struct gwig *pWig, double *X) 
+static void GWigFillZ(const struct gwig *pWig, double *sinz)
+/* sin(kz*z+tz) of the horizontal, then vertical harmonics at the middle
+   of each GWigMap_2nd step: Nz rows of NHharm+NVharm values */
 {
-  int    i, Nstep;
-  double dl;
-  
-  Nstep = pWig->PN*(pWig->Nw);
-  dl    = pWig->Lw/(pWig->PN);
-
-  for (i = 1; i <= Nstep; i++) {
-    GWigMap_2nd(pWig, X, dl);
+  const double x1 = 1.3512071919596576340476878089715e0;
+  const double x0 =-1.7024143839193152680953756179429e0;
+  int i, k, m;
+  int Nstep = pWig->PN*(pWig->Nw);
+  int nmap = (pWig->Pmethod == 4) ? 3 : 1;
+  double dl = pWig->Lw/(pWig->PN);
+  double z = 0.0;
+
+  for (k = 0; k < Nstep; k++) {
+    for (m = 0; m < nmap; m++) {
+      double dl2 = 0.5e0*((nmap == 1) ? dl : ((m == 1) ? x0*dl : x1*dl));
+      z = z + dl2;
+      for (i = 0; i < pWig->NHharm; i++)
+        *sinz++ = sin(pWig->Hkz[i] * z + pWig->Htz[i]);
+      for (i = 0; i < pWig->NVharm; i++)
+        *sinz++ = sin(pWig->Vkz[i] * z + pWig->Vtz[i]);
+      z = z + dl2;
+    }
   }
 }
 
 
-void GWigPass_4th(struct gwig *pWig, double *X)
+static void GWigAx(const struct gwig *pWig, const double *x, const double *y, int n,
+                   const double *sz, double *ax, double *axpy)
 {
+  int    i, c;
+  double kw = pWig->Kw;
 
-  const double x1 = 1.3512071919596576340476878089715e0;
-  const double x0 =-1.7024143839193152680953756179429e0;
-
-  int    i, Nstep;
-  double dl, dl1, dl0;
- 
-  Nstep = pWig->PN*(pWig->Nw);
-  dl = pWig->Lw/(pWig->PN);
+  for (c = 0; c < n; c++) {
+    ax[c] = 0e0;
+    axpy[c] = 0e0;
+  }
 
-  dl1 = x1*dl;
-  dl0 = x0*dl;
+  /* Horizontal Wiggler: note that one potentially could have: kx=0 */
+  for (i = 0; i < pWig->NHharm; i++) {
+    double kx = pWig->Hkx[i];
+    double ky = pWig->Hky[i];
+    double cax = pWig->HAx[i];
+    double caxpy = pWig->HAxpy[i];
+    double szi = sz[i];
+    if (fabs(kx/kw) > GWIG_EPS) {
+      AT_OMP_SIMD
+      for (c = 0; c < n; c++) {
+        ax[c] = ax[c] + cax*cos(kx*x[c])*cosh(ky*y[c])*szi;
+        axpy[c] = axpy[c] + caxpy*(sin(kx*x[c])/kx)*sinh(ky*y[c])*szi;
+      }
+    } else {
+      AT_OMP_SIMD
+      for (c = 0; c < n; c++) {
+        ax[c] = ax[c] + cax*cos(kx*x[c])*cosh(ky*y[c])*szi;
+        axpy[c] = axpy[c] + caxpy*(x[c]*sinc(kx*x[c]))*sinh(ky*y[c])*szi;
+      }
+    }
+  }
 
-  for (i = 1; i <= Nstep; i++ ) {
-    GWigMap_2nd(pWig, X, dl1);
-    GWigMap_2nd(pWig, X, dl0);
-    GWigMap_2nd(pWig, X, dl1);
+  /* Vertical Wiggler: note that one potentially could have: ky=0 */
+  sz += pWig->NHharm;
+  for (i = 0; i < pWig->NVharm; i++ ) {
+    double kx = pWig->Vkx[i];
+    double ky = pWig->Vky[i];
+    double cax = pWig->VAx[i];
+    double caxpy = pWig->VAxpy[i];
+    double szi = sz[i];
+    AT_OMP_SIMD
+    for (c = 0; c < n; c++) {
+      ax[c] = ax[c] + cax*sinh(kx*x[c])*sin(ky*y[c])*szi;
+      axpy[c] = axpy[c] + caxpy*cosh(kx*x[c])*cos(ky*y[c])*szi;
+    }
   }
 }
 
 
-void GWigMap_2nd(struct gwig *pWig, double *X, double dl) 
+static void GWigAy(const struct gwig *pWig, const double *x, const double *y, int n,
+                   const double *sz, double *ay, double *aypx)
 {
+  int    i, c;
+  double kw = pWig->Kw;
 
-  double dld, dl2, dl2d;
-  double ax, ay, axpy, aypx;
-  
-  dld  = dl/(1.0e0 + X[4]);
-  dl2  = 0.5e0 * dl;
-  dl2d = dl2/(1.0e0 + X[4]);
+  for (c = 0; c < n; c++) {
+    ay[c] = 0e0;
+    aypx[c] = 0e0;
+  }
+
+  /* Horizontal Wiggler: note that one potentially could have: kx=0 */
+  for (i = 0; i < pWig->NHharm; i++) {
+    double kx = pWig->Hkx[i];
+    double ky = pWig->Hky[i];
+    double cay = pWig->HAy[i];
+    double caypx = pWig->HAypx[i];
+    double szi = sz[i];
+    AT_OMP_SIMD
+    for (c = 0; c < n; c++) {
+      ay[c] = ay[c] + cay*sin(kx*x[c])*sinh(ky*y[c])*szi;
+      aypx[c] = aypx[c] + caypx*cos(kx*x[c])*cosh(ky*y[c])*szi;
+    }
+  }
 
-  /* Step1: increase a half step in z */
-  pWig->Zw = pWig->Zw + dl2;
+  /* Vertical Wiggler: note that one potentially could have: ky=0 */
+  sz += pWig->NHharm;
+  for (i = 0; i < pWig->NVharm; i++) {
+    double kx = pWig->Vkx[i];
+    double ky = pWig->Vky[i];
+    double cay = pWig->VAy[i];
+    double caypx = pWig->VAypx[i];
+    double szi = sz[i];
+    if (fabs(ky/kw) > GWIG_EPS) {
+      AT_OMP_SIMD
+      for (c = 0; c < n; c++) {
+        ay[c] = ay[c] + cay*cosh(kx*x[c])*cos(ky*y[c])*szi;
+        aypx[c] = aypx[c] + caypx*sinh(kx*x[c])*(sin(ky*y[c])/ky)*szi;
+      }
+    } else {
+      AT_OMP_SIMD
+      for (c = 0; c < n; c++) {
+        ay[c] = ay[c] + cay*cosh(kx*x[c])*cos(ky*y[c])*szi;
+        aypx[c] = aypx[c] + caypx*sinh(kx*x[c])*(y[c]*sinc(ky*y[c]))*szi;
+      }
+    }
+  }
+}
 
-  /* Step2: a half drift in y */
-  GWigAy(pWig, X, &ay, &aypx);
-  X[1] = X[1] - aypx;
-  X[3] = X[3] - ay;
 
-  X[2] = X[2] + dl2d*X[3];
-  X[5] = X[5] + 0.5e0*dl2d*(X[3]*X[3])/(1.0e0+X[4]);
-   
-  GWigAy(pWig, X, &ay, &aypx);
-  X[1] = X[1] + aypx;
-  X[3] = X[3] + ay;
+static void GWigMap_2nd(const struct gwig *pWig, double *r, int stride, int n,
+                        double dl, const double *sz)
+{
+  int c;
+  double *x = r;
+  double *px = r + stride;
+  double *y = r + 2*stride;
+  double *py = r + 3*stride;
+  const double *dp = r + 4*stride;
+  double *ct = r + 5*stride;
+  double a[AT_SIMD_WIDTH], ap[AT_SIMD_WIDTH];
+  double dl2 = 0.5e0 * dl;
+
+  /* Step1: increase a half step in z: sz is taken at the middle of the step */
+
+  /* Step2: a half drift in y */
+  GWigAy(pWig, x, y, n, sz, a, ap);
+  AT_OMP_SIMD
+  for (c = 0; c < n; c++) {
+    if (!atIsNaN(x[c])) {
+      double dl2d = dl2/(1.0e0 + dp[c]);
+      px[c] = px[c] - ap[c];
+      py[c] = py[c] - a[c];
+      y[c] = y[c] + dl2d*py[c];
+      ct[c] = ct[c] + 0.5e0*dl2d*(py[c]*py[c])/(1.0e0+dp[c]);
+    }
+  }
+  GWigAy(pWig, x, y, n, sz, a, ap);
+  AT_OMP_SIMD
+  for (c = 0; c < n; c++) {
+    if (!atIsNaN(x[c])) {
+      px[c] = px[c] + ap[c];
+      py[c] = py[c] + a[c];
+    }
+  }
 
   /* Step3: a full drift in x */
-  GWigAx(pWig, X, &ax, &axpy);
-  X[1] = X[1] - ax;
-  X[3] = X[3] - axpy;
-
-  X[0] = X[0] + dld*X[1];
-/* Full path length
-  X[5] = X[5] + dl + 0.5e0*dld*(X[1]*X[1])/(1.0e0+X[4]);
-*/
-  /* Differential path length only */
-  X[5] = X[5] + 0.5e0*dld*(X[1]*X[1])/(1.0e0+X[4]);
-   
-  GWigAx(pWig, X, &ax, &axpy);
-  X[1] = X[1] + ax;
-  X[3] = X[3] + axpy;
+  GWigAx(pWig, x, y, n, sz, a, ap);
+  AT_OMP_SIMD
+  for (c = 0; c < n; c++) {
+    if (!atIsNaN(x[c])) {
+      double dld = dl/(1.0e0 + dp[c]);
+      px[c] = px[c] - a[c];
+      py[c] = py[c] - ap[c];
+      x[c] = x[c] + dld*px[c];
+      /* Differential path length only */
+      ct[c] = ct[c] + 0.5e0*dld*(px[c]*px[c])/(1.0e0+dp[c]);
+    }
+  }
+  GWigAx(pWig, x, y, n, sz, a, ap);
+  AT_OMP_SIMD
+  for (c = 0; c < n; c++) {
+    if (!atIsNaN(x[c])) {
+      px[c] = px[c] + a[c];
+      py[c] = py[c] + ap[c];
+    }
+  }
 
   /* Step4: a half drift in y */
-  GWigAy(pWig, X, &ay, &aypx);
-  X[1] = X[1] - aypx;
-  X[3] = X[3] - ay;
-
-  X[2] = X[2] + dl2d*X[3];
-  X[5] = X[5] + 0.5e0*dl2d*(X[3]*X[3])/(1.0e0+X[4]);
-   
-  GWigAy(pWig, X, &ay, &aypx);
-  X[1] = X[1] + aypx;
-  X[3] = X[3] + ay;
+  GWigAy(pWig, x, y, n, sz, a, ap);
+  AT_OMP_SIMD
+  for (c = 0; c < n; c++) {
+    if (!atIsNaN(x[c])) {
+      double dl2d = dl2/(1.0e0 + dp[c]);
+      px[c] = px[c] - ap[c];
+      py[c] = py[c] - a[c];
+      y[c] = y[c] + dl2d*py[c];
+      ct[c] = ct[c] + 0.5e0*dl2d*(py[c]*py[c])/(1.0e0+dp[c]);
+    }
+  }
+  GWigAy(pWig, x, y, n, sz, a, ap);
+  AT_OMP_SIMD
+  for (c = 0; c < n; c++) {
+    if (!atIsNaN(x[c])) {
+      px[c] = px[c] + ap[c];
+      py[c] = py[c] + a[c];
+    }
+  }
 
   /* Step5: increase a half step in z */
-  pWig->Zw = pWig->Zw + dl2;
-  
 }
 
 
-void GWigAx(struct gwig *pWig, double *Xvec, double *pax, double *paxpy) 
+static void GWigPass_2nd(const struct gwig *pWig, double *r, int stride, int n)
 {
+  int    i, Nstep;
+  double dl;
+  int nsz = pWig->NHharm + pWig->NVharm;
+  const double *sz = pWig->SinZ;
 
-  int    i;
-  double x, y, z;
-  double kx, ky, kz, tz, kw;
-  double cx, sxkx, chx, shx;
-  double cy, sy, chy, shy, sz;
-  double gamma0, beta0;
-  double ax, axpy;
-
-  x = Xvec[0];
-  y = Xvec[2];
-  z = pWig->Zw;
-  
-  kw   = 2e0*PI/(pWig->Lw);
-  ax   = 0e0;
-  axpy = 0e0;
-
-  gamma0   = pWig->E0/XMC2;
-  beta0    = sqrt(1e0 - 1e0/(gamma0*gamma0));
-  pWig->Aw = (q_e/m_e/clight)/(2e0*PI) * (pWig->Lw) * (pWig->PB0);
-
-  /* Horizontal Wiggler: note that one potentially could have: kx=0 */
-  for (i = 0; i < pWig->NHharm; i++) {
-    pWig->HCw[i] = pWig->HCw_raw[i]*(pWig->Aw)/(gamma0*beta0);
-    kx = pWig->Hkx[i];
-    ky = pWig->Hky[i];
-    kz = pWig->Hkz[i];
-    tz = pWig->Htz[i];
-
-    cx  = cos(kx*x);
-    chy = cosh(ky * y);
-    sz  = sin(kz * z + tz);
-    ax  = ax + (pWig->HCw[i])*(kw/kz)*cx*chy*sz;
-
-    shy = sinh(ky * y);
-    if (fabs(kx/kw) > GWIG_EPS) {
-      sxkx = sin(kx * x)/kx;
-    } else {
-      sxkx = x*sinc(kx*x);
-    }
+  Nstep = pWig->PN*(pWig->Nw);
+  dl    = pWig->Lw/(pWig->PN);
 
-    axpy = axpy + pWig->HCw[i]*(kw/kz)*ky*sxkx*shy*sz;
+  for (i = 1; i <= Nstep; i++) {
+    GWigMap_2nd(pWig, r, stride, n, dl, sz);
+    sz += nsz;
   }
+}
 
 
-  /* Vertical Wiggler: note that one potentially could have: ky=0 */
-  for (i = 0; i < pWig->NVharm; i++ ) {
-    pWig->VCw[i] = pWig->VCw_raw[i]*(pWig->Aw)/(gamma0*beta0);
-    kx = pWig->Vkx[i];
-    ky = pWig->Vky[i];
-    kz = pWig->Vkz[i];
-    tz = pWig->Vtz[i];
-
-    shx = sinh(kx * x);
-    sy  = sin(ky * y);
-    sz  = sin(kz * z + tz);
-    ax  = ax + pWig->VCw[i]*(kw/kz)*(ky/kx)*shx*sy*sz;
-
-    chx = cosh(kx * x);
-    cy  = cos(ky * y);
-    axpy = axpy + pWig->VCw[i]*(kw/kz)* pow(ky/kx,2) *chx*cy*sz;      
-  }
+static void GWigPass_4th(const struct gwig *pWig, double *r, int stride, int n)
+{
 
-  *pax   = ax;
-  *paxpy = axpy;
-}
+  const double x1 = 1.3512071919596576340476878089715e0;
+  const double x0 =-1.7024143839193152680953756179429e0;
 
+  int    i, Nstep;
+  double dl, dl1, dl0;
+  int nsz = pWig->NHharm + pWig->NVharm;
+  const double *sz = pWig->SinZ;
+ 
+  Nstep = pWig->PN*(pWig->Nw);
+  dl = pWig->Lw/(pWig->PN);
 
-void GWigAy(struct gwig *pWig, double *Xvec, double *pay, double *paypx)
-{
-  int    i;
-  double x, y, z;
-  double kx, ky, kz, tz, kw;
-  double cx, sx, chx, shx;
-  double cy, syky, chy, shy, sz;
-  double gamma0, beta0;
-  double ay, aypx;
-
-  x = Xvec[0];
-  y = Xvec[2];
-  z = pWig->Zw;
-    
-  kw   = 2e0*PI/(pWig->Lw);
-  ay   = 0e0;
-  aypx = 0e0;
-
-  gamma0  = pWig->E0/XMC2;
-  beta0   = sqrt(1e0 - 1e0/(gamma0*gamma0));
-  pWig->Aw = (q_e/m_e/clight)/(2e0*PI) * (pWig->Lw) * (pWig->PB0);
-     
-  /* Horizontal Wiggler: note that one potentially could have: kx=0 */
-  for ( i = 0; i < pWig->NHharm; i++ ){
-    pWig->HCw[i] = (pWig->HCw_raw[i])*(pWig->Aw)/(gamma0*beta0);
-    kx = pWig->Hkx[i];
-    ky = pWig->Hky[i];
-    kz = pWig->Hkz[i];
-    tz = pWig->Htz[i];
-  
-    sx = sin(kx * x);
-    shy = sinh(ky * y);
-    sz  = sin(kz * z + tz);
-    ay  = ay + (pWig->HCw[i])*(kw/kz)*(kx/ky)*sx*shy*sz;
-  
-    cx  = cos(kx * x);
-    chy = cosh(ky * y);
-    
-    aypx = aypx + (pWig->HCw[i])*(kw/kz)*pow(kx/ky,2) * cx*chy*sz;
-  }
+  dl1 = x1*dl;
+  dl0 = x0*dl;
 
-  /* Vertical Wiggler: note that one potentially could have: ky=0 */
-  for (i = 0; i < pWig->NVharm; i++) {
-    pWig->VCw[i] = (pWig->VCw_raw[i])*(pWig->Aw)/(gamma0*beta0);       
-    kx = pWig->Vkx[i];
-    ky = pWig->Vky[i];
-    kz = pWig->Vkz[i];
-    tz = pWig->Vtz[i];
-
-    chx = cosh(kx * x);
-    cy  = cos(ky * y);
-    sz  = sin(kz * z + tz);
-    ay  = ay + (pWig->VCw[i])*(kw/kz)*chx*cy*sz;
-
-    shx = sinh(kx * x);
-    if (fabs(ky/kw) > GWIG_EPS) {
-      syky  = sin(ky * y)/ky;
-    } else {
-      syky = y * sinc(ky * y);
-    }
-    aypx = aypx + (pWig->VCw[i])*(kw/kz)* kx*shx*syky*sz;
+  for (i = 1; i <= Nstep; i++ ) {
+    GWigMap_2nd(pWig, r, stride, n, dl1, sz);
+    GWigMap_2nd(pWig, r, stride, n, dl0, sz+nsz);
+    GWigMap_2nd(pWig, r, stride, n, dl1, sz+2*nsz);
+    sz += 3*nsz;
   }
-
-  *pay = ay;
-  *paypx = aypx;
 }
 
 
-double sinc(double x)
+static double sinc(double x)
 {
   double x2, result;
 /* Expand sinc(x) = sin(x)/x to x^8 */
@@ -300,4 +329,3 @@ double sinc(double x)
   result = 1e0 - x2/6e0*(1e0 - x2/20e0 *(1e0 - x2/42e0*(1e0-x2/72e0) ) );
   return result;
 }
-
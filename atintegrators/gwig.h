@@ -41,7 +41,9 @@ struct gwig{
   int NHharm;       /* No. of horizontal harmonics */
   int NVharm;       /* No. of vertical harmonics */
   double Aw;        /* Wiggler parameter */
-  double Zw;        /* Longitudinal variable [m] */
+  double Kw;        /* Wiggler wave number [1/m] */
+  int Nz;           /* Number of evaluation points along the wiggler */
+  double *SinZ;     /* sin(kz*z+tz) of each harmonic at each point */
 
   double HCw[WHmax];
   double VCw[WHmax];
@@ -55,6 +57,15 @@ struct gwig{
   double Vky[WHmax];
   double Vkz[WHmax];
   double Vtz[WHmax];
+  /* Coefficients of the vector potential terms */
+  double HAx[WHmax];
+  double HAxpy[WHmax];
+  double HAy[WHmax];
+  double HAypx[WHmax];
+  double VAx[WHmax];
+  double VAxpy[WHmax];
+  double VAy[WHmax];
+  double VAypx[WHmax];
 };
 
 /* struct used for GWigSymplecticRadPass */
@@ -68,7 +79,10 @@ struct gwigR{
   int NHharm;       /* No. of horizontal harmonics */
   int NVharm;       /* No. of vertical harmonics */
   double Aw;        /* Wiggler parameter */
-  double Zw;        /* Longitudinal variable [m] */
+  double Kw;        /* Wiggler wave number [1/m] */
+  int Nz;           /* Number of evaluation points along the wiggler */
+  double *SinZ;     /* sin(kz*z+tz) of each harmonic at each point */
+  double *CosZ;     /* cos(kz*z+tz) at the radiation points, 0 outside the field */
   double zStartH;
   double zStartV;  /* Start and end z coordinates of the wiggler field, which are computed */
   double zEndH;
@@ -90,6 +104,20 @@ struct gwigR{
   double Vky[WHmax];
   double Vkz[WHmax];
   double Vtz[WHmax];
+  /* Coefficients of the vector potential terms */
+  double HAx[WHmax];
+  double HAxpy[WHmax];
+  double HAy[WHmax];
+  double HAypx[WHmax];
+  double VAx[WHmax];
+  double VAxpy[WHmax];
+  double VAy[WHmax];
+  double VAypx[WHmax];
+  /* Coefficients of the field terms */
+  double HB0[WHmax];
+  double HB1[WHmax];
+  double VB0[WHmax];
+  double VB1[WHmax];
 };
 
 #endif
@@ -30,450 +30,457 @@
 #include <stdio.h>
 #endif
 
-void GWigGauge(struct gwigR *pWig, double *X, int flag);
-void GWigPass_2nd(struct gwigR *pWig, double *X);
-void GWigPass_4th(struct gwigR *pWig, double *X);
-void GWigMap_2nd(struct gwigR *pWig, double *X, double dl);
-void GWigAx(struct gwigR *pWig, double *Xvec, double *pax, double *paxpy);
-void GWigAy(struct gwigR *pWig, double *Xvec, double *pay, double *paypx);
-void GWigRadiationKicks(struct gwigR *pWig, double *X, double *Bxyz, double dl);
-void GWigB(struct gwigR *pWig, double *Xvec, double *B);
-double sinc(double x );
-
-/* This function appears to be unused. */
-void GWigGauge(struct gwigR *pWig, double *X, int flag)
-{
-  double ax, ay, axpy, aypx;
-  GWigAx(pWig, X, &ax, &axpy);
-  GWigAy(pWig, X, &ay, &aypx);
- 
-  if (flag == Elem_Entrance) {
-    /* At the entrance of the wiggler */
-    X[1] = X[1] + ax;
-    X[3] = X[3] + ay;
-  } else if (flag == Elem_Exit) {
-    /* At the exit of the wiggler */
-    X[1] = X[1] - ax;
-    X[3] = X[3] - ay;
-  } else {
-    printf("  GWigGauge: Unknown flag = %i\n", flag);
-  }
-}
+/* The particles are tracked in batches of n <= AT_SIMD_WIDTH particles
+   stored as a structure-of-arrays (see driftkick.c): the loops over the
+   particles of a batch are vectorized. The coefficients of the harmonics
+   are computed once by GWigPrepare, and the longitudinal terms
+   sin(kz*z+tz), common to all particles, are tabulated by GWigFillZ */
 
+static double sinc(double x );
 
-void GWigPass_2nd(struct gwigR *pWig, double *X) 
+static void GWigPrepare(struct gwigR *pWig)
+/* Coefficients depending only on the wiggler parameters */
 {
-  int    i, Nstep;
-  double dl;
-  double B[2];
-  double ax, ay, axpy, aypx;
-  
-  Nstep = pWig->PN*(pWig->Nw);
-  dl    = pWig->Lw/(pWig->PN);
-  
-    GWigAx(pWig, X, &ax, &axpy);
-    GWigAy(pWig, X, &ay, &aypx);
-    GWigB(pWig, X, B);
-    X[1] -= ax;
-    X[3] -= ay;
-	GWigRadiationKicks(pWig, X, B, dl);
-    X[1] += ax;
-    X[3] += ay;	 
-  for (i = 1; i <= Nstep; i++) {
-    GWigMap_2nd(pWig, X, dl);
-    GWigAx(pWig, X, &ax, &axpy);
-    GWigAy(pWig, X, &ay, &aypx);
-    GWigB(pWig, X, B);
-    X[1] -= ax;
-    X[3] -= ay;
-	GWigRadiationKicks(pWig, X, B, dl);
-	X[1] += ax;
-    X[3] += ay;
+  int i;
+  double gamma0 = pWig->E0/XMC2;
+  double beta0 = sqrt(1e0 - 1e0/(gamma0*gamma0));
+  double kw = 2e0*PI/(pWig->Lw);
+
+  pWig->Kw = kw;
+  pWig->Aw = (q_e/m_e/clight)/(2e0*PI) * (pWig->Lw) * (pWig->PB0);
+  pWig->Nz = pWig->PN*(pWig->Nw)*((pWig->Pmethod == 4) ? 3 : 1);
+  for (i = 0; i < pWig->NHharm; i++) {
+    double kx = pWig->Hkx[i];
+    double ky = pWig->Hky[i];
+    double kz = pWig->Hkz[i];
+    pWig->HCw[i] = pWig->HCw_raw[i]*(pWig->Aw)/(gamma0*beta0);
+    pWig->HAx[i] = pWig->HCw[i]*(kw/kz);
+    pWig->HAxpy[i] = pWig->HAx[i]*ky;
+    pWig->HAy[i] = pWig->HAx[i]*(kx/ky);
+    pWig->HAypx[i] = pWig->HAx[i]*pow(kx/ky,2);
+    pWig->HB0[i] = pWig->PB0*pWig->HCw_raw[i];
+    pWig->HB1[i] = pWig->HB0[i]*kx/ky;
+  }
+  for (i = 0; i < pWig->NVharm; i++) {
+    double kx = pWig->Vkx[i];
+    double ky = pWig->Vky[i];
+    double kz = pWig->Vkz[i];
+    pWig->VCw[i] = pWig->VCw_raw[i]*(pWig->Aw)/(gamma0*beta0);
+    pWig->VAy[i] = pWig->VCw[i]*(kw/kz);
+    pWig->VAx[i] = pWig->VAy[i]*(ky/kx);
+    pWig->VAxpy[i] = pWig->VAy[i]*pow(ky/kx,2);
+    pWig->VAypx[i] = pWig->VAy[i]*kx;
+    pWig->VB0[i] = pWig->PB0*pWig->VCw_raw[i];
+    pWig->VB1[i] = pWig->VB0[i]*ky/kx;
   }
 }
 
-
-void GWigPass_4th(struct gwigR *pWig, double *X)
+static void GWigFillZ(const struct gwigR *pWig, double *sinz, double *cosz)
+/* sin(kz*z+tz) of the horizontal, then vertical harmonics at the middle
+   of each GWigMap_2nd step: Nz rows of NHharm+NVharm values, followed by
+   the Nstep+1 rows at the radiation kicks. cos(kz*z+tz) at the radiation
+   kicks is stored in cosz, set to 0 where z is outside the field */
 {
-
   const double x1 = 1.3512071919596576340476878089715e0;
   const double x0 =-1.7024143839193152680953756179429e0;
-
-  int    i, Nstep;
-  double dl, dl1, dl0;
-  double B[2];
-  double ax, ay, axpy, aypx;	
-	Nstep = pWig->PN*(pWig->Nw);
-	dl = pWig->Lw/(pWig->PN);
-
-	dl1 = x1*dl;
-	dl0 = x0*dl;
-
-    GWigAx(pWig, X, &ax, &axpy);
-    GWigAy(pWig, X, &ay, &aypx);
-    GWigB(pWig, X, B);
-    X[1] -= ax;
-    X[3] -= ay;
-    GWigRadiationKicks(pWig, X, B, dl);
-    X[1] += ax;
-    X[3] += ay;
-  for (i = 1; i <= Nstep; i++ ) {
-    GWigMap_2nd(pWig, X, dl1);
-    GWigMap_2nd(pWig, X, dl0);
-    GWigMap_2nd(pWig, X, dl1);
-    GWigAx(pWig, X, &ax, &axpy);
-    GWigAy(pWig, X, &ay, &aypx);
-    GWigB(pWig, X, B);
-    X[1] -= ax;
-    X[3] -= ay;
-    GWigRadiationKicks(pWig, X, B, dl);
-    X[1] += ax;
-    X[3] += ay;	
+  int i, k, m;
+  int Nstep = pWig->PN*(pWig->Nw);
+  int nmap = (pWig->Pmethod == 4) ? 3 : 1;
+  double dl = pWig->Lw/(pWig->PN);
+  double *sinkick = sinz + pWig->Nz*(pWig->NHharm + pWig->NVharm);
+  double z = 0.0;
+
+  for (k = 0; k <= Nstep; k++) {
+    int hfield = (z>=pWig->zStartH && z<=pWig->zEndH);
+    int vfield = (z>=pWig->zStartV && z<=pWig->zEndV);
+    for (i = 0; i < pWig->NHharm; i++) {
+      *sinkick++ = sin(pWig->Hkz[i] * z + pWig->Htz[i]);
+      *cosz++ = hfield ? cos(pWig->Hkz[i]*z+pWig->Htz[i]) : 0.0;
+    }
+    for (i = 0; i < pWig->NVharm; i++) {
+      *sinkick++ = sin(pWig->Vkz[i] * z + pWig->Vtz[i]);
+      *cosz++ = vfield ? cos(pWig->Vkz[i]*z + pWig->Vtz[i]) : 0.0;
+    }
+    if (k == Nstep) break;
+    for (m = 0; m < nmap; m++) {
+      double dl2 = 0.5e0*((nmap == 1) ? dl : ((m == 1) ? x0*dl : x1*dl));
+      z = z + dl2;
+      for (i = 0; i < pWig->NHharm; i++)
+        *sinz++ = sin(pWig->Hkz[i] * z + pWig->Htz[i]);
+      for (i = 0; i < pWig->NVharm; i++)
+        *sinz++ = sin(pWig->Vkz[i] * z + pWig->Vtz[i]);
+      z = z + dl2;
+    }
   }
 }
 
 
-void GWigMap_2nd(struct gwigR *pWig, double *X, double dl) 
+static void GWigAx(const struct gwigR *pWig, const double *x, const double *y, int n,
+                   const double *sz, double *ax, double *axpy)
 {
+  int    i, c;
+  double kw = pWig->Kw;
 
-  double dld, dl2, dl2d;
-  double ax, ay, axpy, aypx;
-  
-  dld  = dl/(1.0e0 + X[4]);
-  dl2  = 0.5e0 * dl;
-  dl2d = dl2/(1.0e0 + X[4]);
-
-  /* Step1: increase a half step in z */
-  pWig->Zw = pWig->Zw + dl2;
-
-  /* Step2: a half drift in y */
-  GWigAy(pWig, X, &ay, &aypx);
-  X[1] = X[1] - aypx;
-  X[3] = X[3] - ay;
-
-  X[2] = X[2] + dl2d*X[3];
-  X[5] = X[5] + 0.5e0*dl2d*(X[3]*X[3])/(1.0e0+X[4]);
-   
-  GWigAy(pWig, X, &ay, &aypx);
-  X[1] = X[1] + aypx;
-  X[3] = X[3] + ay;
-
-  /* Step3: a full drift in x */
-  GWigAx(pWig, X, &ax, &axpy);
-  X[1] = X[1] - ax;
-  X[3] = X[3] - axpy;
-
-  X[0] = X[0] + dld*X[1];
-/* Full path length
-  X[5] = X[5] + dl + 0.5e0*dld*(X[1]*X[1])/(1.0e0+X[4]);
-*/
-  /* Differential path length only */
-  X[5] = X[5] + 0.5e0*dld*(X[1]*X[1])/(1.0e0+X[4]);
-   
-  GWigAx(pWig, X, &ax, &axpy);
-  X[1] = X[1] + ax;
-  X[3] = X[3] + axpy;
-
-  /* Step4: a half drift in y */
-  GWigAy(pWig, X, &ay, &aypx);
-  X[1] = X[1] - aypx;
-  X[3] = X[3] - ay;
-
-  X[2] = X[2] + dl2d*X[3];
-  X[5] = X[5] + 0.5e0*dl2d*(X[3]*X[3])/(1.0e0+X[4]);
-   
-  GWigAy(pWig, X, &ay, &aypx);
-  X[1] = X[1] + aypx;
-  X[3] = X[3] + ay;
-
-  /* Step5: increase a half step in z */
-  pWig->Zw = pWig->Zw + dl2;
-}
-
-
-void GWigAx(struct gwigR *pWig, double *Xvec, double *pax, double *paxpy) 
-{
-
-  int    i;
-  double x, y, z;
-  double kx, ky, kz, tz, kw;
-  double cx, sxkx, chx, shx;
-  double cy, sy, chy, shy, sz;
-  double gamma0, beta0;
-  double ax, axpy;
-
-  x = Xvec[0];
-  y = Xvec[2];
-  z = pWig->Zw;
-  
-  kw   = 2e0*PI/(pWig->Lw);
-  ax   = 0e0;
-  axpy = 0e0;
-
-  gamma0   = pWig->E0/XMC2;
-  beta0    = sqrt(1e0 - 1e0/(gamma0*gamma0));
-  pWig->Aw = (q_e/m_e/clight)/(2e0*PI) * (pWig->Lw) * (pWig->PB0);
+  for (c = 0; c < n; c++) {
+    ax[c] = 0e0;
+    axpy[c] = 0e0;
+  }
 
   /* Horizontal Wiggler: note that one potentially could have: kx=0 */
   for (i = 0; i < pWig->NHharm; i++) {
-    pWig->HCw[i] = pWig->HCw_raw[i]*(pWig->Aw)/(gamma0*beta0);
-    kx = pWig->Hkx[i];
-    ky = pWig->Hky[i];
-    kz = pWig->Hkz[i];
-    tz = pWig->Htz[i];
-
-    cx  = cos(kx*x);
-    chy = cosh(ky * y);
-    sz  = sin(kz * z + tz);
-    ax  = ax + (pWig->HCw[i])*(kw/kz)*cx*chy*sz;
-
-    shy = sinh(ky * y);
+    double kx = pWig->Hkx[i];
+    double ky = pWig->Hky[i];
+    double cax = pWig->HAx[i];
+    double caxpy = pWig->HAxpy[i];
+    double szi = sz[i];
     if (fabs(kx/kw) > GWIG_EPS) {
-      sxkx = sin(kx * x)/kx;
+      AT_OMP_SIMD
+      for (c = 0; c < n; c++) {
+        ax[c] = ax[c] + cax*cos(kx*x[c])*cosh(ky*y[c])*szi;
+        axpy[c] = axpy[c] + caxpy*(sin(kx*x[c])/kx)*sinh(ky*y[c])*szi;
+      }
     } else {
-      sxkx = x*sinc(kx*x);
+      AT_OMP_SIMD
+      for (c = 0; c < n; c++) {
+        ax[c] = ax[c] + cax*cos(kx*x[c])*cosh(ky*y[c])*szi;
+        axpy[c] = axpy[c] + caxpy*(x[c]*sinc(kx*x[c]))*sinh(ky*y[c])*szi;
+      }
     }
-
-    axpy = axpy + pWig->HCw[i]*(kw/kz)*ky*sxkx*shy*sz;
   }
 
-
   /* Vertical Wiggler: note that one potentially could have: ky=0 */
+  sz += pWig->NHharm;
   for (i = 0; i < pWig->NVharm; i++ ) {
-    pWig->VCw[i] = pWig->VCw_raw[i]*(pWig->Aw)/(gamma0*beta0);
-    kx = pWig->Vkx[i];
-    ky = pWig->Vky[i];
-    kz = pWig->Vkz[i];
-    tz = pWig->Vtz[i];
-
-    shx = sinh(kx * x);
-    sy  = sin(ky * y);
-    sz  = sin(kz * z + tz);
-    ax  = ax + pWig->VCw[i]*(kw/kz)*(ky/kx)*shx*sy*sz;
-
-    chx = cosh(kx * x);
-    cy  = cos(ky * y);
-    axpy = axpy + pWig->VCw[i]*(kw/kz)* pow(ky/kx,2) *chx*cy*sz;      
+    double kx = pWig->Vkx[i];
+    double ky = pWig->Vky[i];
+    double cax = pWig->VAx[i];
+    double caxpy = pWig->VAxpy[i];
+    double szi = sz[i];
+    AT_OMP_SIMD
+    for (c = 0; c < n; c++) {
+      ax[c] = ax[c] + cax*sinh(kx*x[c])*sin(ky*y[c])*szi;
+      axpy[c] = axpy[c] + caxpy*cosh(kx*x[c])*cos(ky*y[c])*szi;
+    }
   }
-
-  *pax   = ax;
-  *paxpy = axpy;
 }
 
 
-void GWigAy(struct gwigR *pWig, double *Xvec, double *pay, double *paypx)
+static void GWigAy(const struct gwigR *pWig, const double *x, const double *y, int n,
+                   const double *sz, double *ay, double *aypx)
 {
-  int    i;
-  double x, y, z;
-  double kx, ky, kz, tz, kw;
-  double cx, sx, chx, shx;
-  double cy, syky, chy, shy, sz;
-  double gamma0, beta0;
-  double ay, aypx;
-
-  x = Xvec[0];
-  y = Xvec[2];
-  z = pWig->Zw;
-    
-  kw   = 2e0*PI/(pWig->Lw);
-  ay   = 0e0;
-  aypx = 0e0;
-
-  gamma0  = pWig->E0/XMC2;
-  beta0   = sqrt(1e0 - 1e0/(gamma0*gamma0));
-  pWig->Aw = (q_e/m_e/clight)/(2e0*PI) * (pWig->Lw) * (pWig->PB0);
-     
+  int    i, c;
+  double kw = pWig->Kw;
+
+  for (c = 0; c < n; c++) {
+    ay[c] = 0e0;
+    aypx[c] = 0e0;
+  }
+
   /* Horizontal Wiggler: note that one potentially could have: kx=0 */
-  for ( i = 0; i < pWig->NHharm; i++ ){
-    pWig->HCw[i] = (pWig->HCw_raw[i])*(pWig->Aw)/(gamma0*beta0);
-    kx = pWig->Hkx[i];
-    ky = pWig->Hky[i];
-    kz = pWig->Hkz[i];
-    tz = pWig->Htz[i];
-  
-    sx = sin(kx * x);
-    shy = sinh(ky * y);
-    sz  = sin(kz * z + tz);
-    ay  = ay + (pWig->HCw[i])*(kw/kz)*(kx/ky)*sx*shy*sz;
-  
-    cx  = cos(kx * x);
-    chy = cosh(ky * y);
-    
-    aypx = aypx + (pWig->HCw[i])*(kw/kz)*pow(kx/ky,2) * cx*chy*sz;
+  for (i = 0; i < pWig->NHharm; i++) {
+    double kx = pWig->Hkx[i];
+    double ky = pWig->Hky[i];
+    double cay = pWig->HAy[i];
+    double caypx = pWig->HAypx[i];
+    double szi = sz[i];
+    AT_OMP_SIMD
+    for (c = 0; c < n; c++) {
+      ay[c] = ay[c] + cay*sin(kx*x[c])*sinh(ky*y[c])*szi;
+      aypx[c] = aypx[c] + caypx*cos(kx*x[c])*cosh(ky*y[c])*szi;
+    }
   }
 
   /* Vertical Wiggler: note that one potentially could have: ky=0 */
+  sz += pWig->NHharm;
   for (i = 0; i < pWig->NVharm; i++) {
-    pWig->VCw[i] = (pWig->VCw_raw[i])*(pWig->Aw)/(gamma0*beta0);       
-    kx = pWig->Vkx[i];
-    ky = pWig->Vky[i];
-    kz = pWig->Vkz[i];
-    tz = pWig->Vtz[i];
-
-    chx = cosh(kx * x);
-    cy  = cos(ky * y);
-    sz  = sin(kz * z + tz);
-    ay  = ay + (pWig->VCw[i])*(kw/kz)*chx*cy*sz;
-
-    shx = sinh(kx * x);
+    double kx = pWig->Vkx[i];
+    double ky = pWig->Vky[i];
+    double cay = pWig->VAy[i];
+    double caypx = pWig->VAypx[i];
+    double szi = sz[i];
     if (fabs(ky/kw) > GWIG_EPS) {
-      syky  = sin(ky * y)/ky;
+      AT_OMP_SIMD
+      for (c = 0; c < n; c++) {
+        ay[c] = ay[c] + cay*cosh(kx*x[c])*cos(ky*y[c])*szi;
+        aypx[c] = aypx[c] + caypx*sinh(kx*x[c])*(sin(ky*y[c])/ky)*szi;
+      }
     } else {
-      syky = y * sinc(ky * y);
+      AT_OMP_SIMD
+      for (c = 0; c < n; c++) {
+        ay[c] = ay[c] + cay*cosh(kx*x[c])*cos(ky*y[c])*szi;
+        aypx[c] = aypx[c] + caypx*sinh(kx*x[c])*(y[c]*sinc(ky*y[c]))*szi;
+      }
     }
-    aypx = aypx + (pWig->VCw[i])*(kw/kz)* kx*shx*syky*sz;
-   }
-  
-  *pay = ay;
-  *paypx = aypx;
-}
-
-
-double sinc(double x)
-{
-  double x2, result;
-/* Expand sinc(x) = sin(x)/x to x^8 */
-  x2 = x*x;
-  result = 1e0 - x2/6e0*(1e0 - x2/20e0 *(1e0 - x2/42e0*(1e0-x2/72e0) ) );
-  return result;
+  }
 }
 
 
-
-void GWigB(struct gwigR *pWig, double *Xvec, double *B) 
+static void GWigB(const struct gwigR *pWig, const double *x, const double *y, int n,
+                  const double *cz, double *bx, double *by)
 /* Compute magnetic field at particle location.
  * Added by M. Borland, August 2007.
  */
 {
-  int    i;
-  double x, y, z;
-  double kx, ky, kz, tz, kw;
-  double cx, sx, chx, shx;
-  double cy, sy, chy, shy;
-  double cz;
-  /* B0 is a reserved symbol on MacOS, defined in termios.h */
-  double _B0;
-  
-  x = Xvec[0];
-  y = Xvec[2];
-  z = pWig->Zw;
-  
-  kw   = 2e0*PI/(pWig->Lw);
-
-  B[0] = 0;
-  B[1] = 0;
-
-  if (pWig->NHharm && z>=pWig->zStartH && z<=pWig->zEndH) {
-    _B0 = pWig->PB0;
-    if (!pWig->HSplitPole) {
-      /* Normal Horizontal Wiggler: note that one potentially could have: kx=0 */
-      for (i = 0; i < pWig->NHharm; i++) {
-        kx = pWig->Hkx[i];
-        ky = pWig->Hky[i];
-        kz = pWig->Hkz[i];
-        tz = pWig->Htz[i];
-
-        sx  = sin(kx*x);
-        cx  = cos(kx*x);
-        chy = cosh(ky * y);
-        shy = sinh(ky * y);
-        cz = cos(kz*z+tz);
-        
-        /* Accumulate field values in user-supplied array (Bx, By) */
-        B[0] += _B0*pWig->HCw_raw[i]*kx/ky*sx*shy*cz;
-        B[1] -= _B0*pWig->HCw_raw[i]*cx*chy*cz;
+  int    i, c;
+
+  for (c = 0; c < n; c++) {
+    bx[c] = 0e0;
+    by[c] = 0e0;
+  }
+
+  if (!pWig->HSplitPole) {
+    /* Normal Horizontal Wiggler: note that one potentially could have: kx=0 */
+    for (i = 0; i < pWig->NHharm; i++) {
+      double kx = pWig->Hkx[i];
+      double ky = pWig->Hky[i];
+      double cb0 = pWig->HB0[i];
+      double cb1 = pWig->HB1[i];
+      double czi = cz[i];
+      AT_OMP_SIMD
+      for (c = 0; c < n; c++) {
+        bx[c] += cb1*sin(kx*x[c])*sinh(ky*y[c])*czi;
+        by[c] -= cb0*cos(kx*x[c])*cosh(ky*y[c])*czi;
       }
-    } else {
-      /* Split-pole Horizontal Wiggler: note that one potentially could have: ky=0 (caught in main routine) */
-      for (i = 0; i < pWig->NHharm; i++) {
-        kx = pWig->Hkx[i];
-        ky = pWig->Hky[i];
-        kz = pWig->Hkz[i];
-        tz = pWig->Htz[i];
-
-        shx = sinh(kx*x);
-        chx = cosh(kx*x);
-        cy  = cos(ky * y);
-        sy  = sin(ky * y);
-        cz  = cos(kz*z+tz);
-        
-        B[0] -= _B0*pWig->HCw_raw[i]*kx/ky*shx*sy*cz;
-        B[1] -= _B0*pWig->HCw_raw[i]*chx*cy*cz;
+    }
+  } else {
+    /* Split-pole Horizontal Wiggler: note that one potentially could have: ky=0 (caught in main routine) */
+    for (i = 0; i < pWig->NHharm; i++) {
+      double kx = pWig->Hkx[i];
+      double ky = pWig->Hky[i];
+      double cb0 = pWig->HB0[i];
+      double cb1 = pWig->HB1[i];
+      double czi = cz[i];
+      AT_OMP_SIMD
+      for (c = 0; c < n; c++) {
+        bx[c] -= cb1*sinh(kx*x[c])*sin(ky*y[c])*czi;
+        by[c] -= cb0*cosh(kx*x[c])*cos(ky*y[c])*czi;
       }
     }
   }
-  
-  if (pWig->NVharm && z>=pWig->zStartV && z<=pWig->zEndV) {
-    _B0 = pWig->PB0;
-    if (!pWig->VSplitPole) {
-      /* Normal Vertical Wiggler: note that one potentially could have: ky=0 */
-      for (i = 0; i < pWig->NVharm; i++ ) {
-        kx = pWig->Vkx[i];
-        ky = pWig->Vky[i];
-        kz = pWig->Vkz[i];
-        tz = pWig->Vtz[i];
-
-        shx = sinh(kx * x);
-        chx = cosh(kx * x);
-        sy  = sin(ky * y);
-        cy  = cos(ky * y);
-        cz  = cos(kz*z + tz);
-
-        /* Accumulate field values in user-supplied array (Bx, By) */
-        B[0] += _B0*pWig->VCw_raw[i]*chx*cy*cz;
-        B[1] -= _B0*pWig->VCw_raw[i]*ky/kx*shx*sy*cz;
+
+  cz += pWig->NHharm;
+  if (!pWig->VSplitPole) {
+    /* Normal Vertical Wiggler: note that one potentially could have: ky=0 */
+    for (i = 0; i < pWig->NVharm; i++ ) {
+      double kx = pWig->Vkx[i];
+      double ky = pWig->Vky[i];
+      double cb0 = pWig->VB0[i];
+      double cb1 = pWig->VB1[i];
+      double czi = cz[i];
+      AT_OMP_SIMD
+      for (c = 0; c < n; c++) {
+        bx[c] += cb0*cosh(kx*x[c])*cos(ky*y[c])*czi;
+        by[c] -= cb1*sinh(kx*x[c])*sin(ky*y[c])*czi;
       }
-    } else {
-      /* Split-pole Vertical Wiggler: note that one potentially could have: kx=0 (caught in main routine) */
-      for (i = 0; i < pWig->NVharm; i++ ) {
-        kx = pWig->Vkx[i];
-        ky = pWig->Vky[i];
-        kz = pWig->Vkz[i];
-        tz = pWig->Vtz[i];
-
-        sx  = sin(kx * x);
-        cx  = cos(kx * x);
-        shy = sinh(ky * y);
-        chy = cosh(ky * y);
-        cz  = cos(kz*z + tz);
-
-        /* Accumulate field values in user-supplied array (Bx, By) */
-        B[0] += _B0*pWig->VCw_raw[i]*cx*chy*cz;
-        B[1] += _B0*pWig->VCw_raw[i]*ky/kx*sx*shy*cz;
+    }
+  } else {
+    /* Split-pole Vertical Wiggler: note that one potentially could have: kx=0 (caught in main routine) */
+    for (i = 0; i < pWig->NVharm; i++ ) {
+      double kx = pWig->Vkx[i];
+      double ky = pWig->Vky[i];
+      double cb0 = pWig->VB0[i];
+      double cb1 = pWig->VB1[i];
+      double czi = cz[i];
+      AT_OMP_SIMD
+      for (c = 0; c < n; c++) {
+        bx[c] += cb0*cos(kx*x[c])*cosh(ky*y[c])*czi;
+        by[c] += cb1*sin(kx*x[c])*sinh(ky*y[c])*czi;
       }
     }
   }
 }
 
 
-void GWigRadiationKicks(struct gwigR *pWig, double *X, double *Bxy, double dl)
+static void GWigRadiationKicks(const struct gwigR *pWig, double *r, int stride, int n,
+                               double dl, const double *sz, const double *cz)
 /* Apply kicks for synchrotron radiation.
  * Added by M. Borland, August 2007.
+ * The kick acts on the kinetic momenta: the vector potential is removed
+ * from px, py before the kick and restored after it.
  */
 {
-  double irho2, H, dFactor;
-  double B2;
-  double dDelta;
-
-  /* B^2 in T^2 */
-  B2 = (Bxy[0]*Bxy[0]) + (Bxy[1]*Bxy[1]);
-  if (B2==0)
-	  return;
-  
+  int c;
+  const double *x = r;
+  double *px = r + stride;
+  const double *y = r + 2*stride;
+  double *py = r + 3*stride;
+  double *dp = r + 4*stride;
+  double ax[AT_SIMD_WIDTH], ay[AT_SIMD_WIDTH], ap[AT_SIMD_WIDTH];
+  double bx[AT_SIMD_WIDTH], by[AT_SIMD_WIDTH];
   /* Beam rigidity in T*m */
-  H = (pWig->Po)/586.679074042074490;
-
-  /* 1/rho^2 */
-  irho2 = B2/(H*H);
-
-  /* (1+delta)^2 */
-  dFactor = ((1+X[4])*(1+X[4]));
-  
-  /* Classical radiation loss */
-    dDelta = -(pWig->srCoef)*dFactor*irho2*dl;
-    X[4] += dDelta;
-    X[1] *= (1+dDelta);
-    X[3] *= (1+dDelta);
- 
+  double H = (pWig->Po)/586.679074042074490;
+
+  GWigAx(pWig, x, y, n, sz, ax, ap);
+  GWigAy(pWig, x, y, n, sz, ay, ap);
+  GWigB(pWig, x, y, n, cz, bx, by);
+  AT_OMP_SIMD
+  for (c = 0; c < n; c++) {
+    if (!atIsNaN(x[c])) {
+      /* B^2 in T^2 */
+      double B2 = (bx[c]*bx[c]) + (by[c]*by[c]);
+      px[c] -= ax[c];
+      py[c] -= ay[c];
+      if (B2 != 0) {
+        /* 1/rho^2 */
+        double irho2 = B2/(H*H);
+        /* (1+delta)^2 */
+        double dFactor = ((1+dp[c])*(1+dp[c]));
+        /* Classical radiation loss */
+        double dDelta = -(pWig->srCoef)*dFactor*irho2*dl;
+        dp[c] += dDelta;
+        px[c] *= (1+dDelta);
+        py[c] *= (1+dDelta);
+      }
+      px[c] += ax[c];
+      py[c] += ay[c];
+    }
+  }
+}
+
+
+static void GWigMap_2nd(const struct gwigR *pWig, double *r, int stride, int n,
+                        double dl, const double *sz)
+{
+  int c;
+  double *x = r;
+  double *px = r + stride;
+  double *y = r + 2*stride;
+  double *py = r + 3*stride;
+  const double *dp = r + 4*stride;
+  double *ct = r + 5*stride;
+  double a[AT_SIMD_WIDTH], ap[AT_SIMD_WIDTH];
+  double dl2 = 0.5e0 * dl;
+
+  /* Step1: increase a half step in z: sz is taken at the middle of the step */
+
+  /* Step2: a half drift in y */
+  GWigAy(pWig, x, y, n, sz, a, ap);
+  AT_OMP_SIMD
+  for (c = 0; c < n; c++) {
+    if (!atIsNaN(x[c])) {
+      double dl2d = dl2/(1.0e0 + dp[c]);
+      px[c] = px[c] - ap[c];
+      py[c] = py[c] - a[c];
+      y[c] = y[c] + dl2d*py[c];
+      ct[c] = ct[c] + 0.5e0*dl2d*(py[c]*py[c])/(1.0e0+dp[c]);
+    }
+  }
+  GWigAy(pWig, x, y, n, sz, a, ap);
+  AT_OMP_SIMD
+  for (c = 0; c < n; c++) {
+    if (!atIsNaN(x[c])) {
+      px[c] = px[c] + ap[c];
+      py[c] = py[c] + a[c];
+    }
+  }
+
+  /* Step3: a full drift in x */
+  GWigAx(pWig, x, y, n, sz, a, ap);
+  AT_OMP_SIMD
+  for (c = 0; c < n; c++) {
+    if (!atIsNaN(x[c])) {
+      double dld = dl/(1.0e0 + dp[c]);
+      px[c] = px[c] - a[c];
+      py[c] = py[c] - ap[c];
+      x[c] = x[c] + dld*px[c];
+      /* Differential path length only */
+      ct[c] = ct[c] + 0.5e0*dld*(px[c]*px[c])/(1.0e0+dp[c]);
+    }
+  }
+  GWigAx(pWig, x, y, n, sz, a, ap);
+  AT_OMP_SIMD
+  for (c = 0; c < n; c++) {
+    if (!atIsNaN(x[c])) {
+      px[c] = px[c] + a[c];
+      py[c] = py[c] + ap[c];
+    }
+  }
+
+  /* Step4: a half drift in y */
+  GWigAy(pWig, x, y, n, sz, a, ap);
+  AT_OMP_SIMD
+  for (c = 0; c < n; c++) {
+    if (!atIsNaN(x[c])) {
+      double dl2d = dl2/(1.0e0 + dp[c]);
+      px[c] = px[c] - ap[c];
+      py[c] = py[c] - a[c];
+      y[c] = y[c] + dl2d*py[c];
+      ct[c] = ct[c] + 0.5e0*dl2d*(py[c]*py[c])/(1.0e0+dp[c]);
+    }
+  }
+  GWigAy(pWig, x, y, n, sz, a, ap);
+  AT_OMP_SIMD
+  for (c = 0; c < n; c++) {
+    if (!atIsNaN(x[c])) {
+      px[c] = px[c] + ap[c];
+      py[c] = py[c] + a[c];
+    }
+  }
+
+  /* Step5: increase a half step in z */
 }
 
+
+static void GWigPass_2nd(const struct gwigR *pWig, double *r, int stride, int n)
+{
+  int    i, Nstep;
+  double dl;
+  int nsz = pWig->NHharm + pWig->NVharm;
+  const double *sz = pWig->SinZ;
+  const double *szkick, *czkick = pWig->CosZ;
+
+  Nstep = pWig->PN*(pWig->Nw);
+  dl    = pWig->Lw/(pWig->PN);
+  szkick = sz + pWig->Nz*nsz;
+
+  GWigRadiationKicks(pWig, r, stride, n, dl, szkick, czkick);
+  for (i = 1; i <= Nstep; i++) {
+    GWigMap_2nd(pWig, r, stride, n, dl, sz);
+    sz += nsz;
+    szkick += nsz;
+    czkick += nsz;
+    GWigRadiationKicks(pWig, r, stride, n, dl, szkick, czkick);
+  }
+}
+
+
+static void GWigPass_4th(const struct gwigR *pWig, double *r, int stride, int n)
+{
+
+  const double x1 = 1.3512071919596576340476878089715e0;
+  const double x0 =-1.7024143839193152680953756179429e0;
+
+  int    i, Nstep;
+  double dl, dl1, dl0;
+  int nsz = pWig->NHharm + pWig->NVharm;
+  const double *sz = pWig->SinZ;
+  const double *szkick, *czkick = pWig->CosZ;
+
+  Nstep = pWig->PN*(pWig->Nw);
+  dl = pWig->Lw/(pWig->PN);
+  szkick = sz + pWig->Nz*nsz;
+
+  dl1 = x1*dl;
+  dl0 = x0*dl;
+
+  GWigRadiationKicks(pWig, r, stride, n, dl, szkick, czkick);
+  for (i = 1; i <= Nstep; i++ ) {
+    GWigMap_2nd(pWig, r, stride, n, dl1, sz);
+    GWigMap_2nd(pWig, r, stride, n, dl0, sz+nsz);
+    GWigMap_2nd(pWig, r, stride, n, dl1, sz+2*nsz);
+    sz += 3*nsz;
+    szkick += nsz;
+    czkick += nsz;
+    GWigRadiationKicks(pWig, r, stride, n, dl, szkick, czkick);
+  }
+}
+
+
+static double sinc(double x)
+{
+  double x2, result;
+/* Expand sinc(x) = sin(x)/x to x^8 */
+  x2 = x*x;
+  result = 1e0 - x2/6e0*(1e0 - x2/20e0 *(1e0 - x2/42e0*(1e0-x2/72e0) ) );
+  return result;
+}
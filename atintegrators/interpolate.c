@@ -16,48 +16,90 @@
 /*x1a is the direction of the colums: y and x1a the direction of the rows:x*/
 
 /****************************************************************************/
-/****************************Bilinear interpolation*****************************/
+/*******************************Cell lookup**********************************/
 /****************************************************************************/
 
-void linint(double *x1a, double *x2a, double *ya, int m, int n, double x1, double x2, double *y)
+static int grid_is_uniform(double *xa, int n)
+/* Check if the n points xa are equally spaced */
 {
-    int klo,khi,k,ilo,ihi,i;
-    double u,t,y1,y2,y3,y4,f;
-
-    if ((x1<=x1a[m-1])&&(x1>=x1a[0])&&(x2<=x2a[n-1])&&(x2>=x2a[0])) {
-        ilo=0;
-        ihi=m-1;	
-        klo=0;
-        khi=n-1;
-	
-        while (ihi-ilo > 1) {
-            i=(ihi+ilo) >> 1;
-            if (x1a[i] > x1) ihi=i;
-            else ilo=i;
-        }
-	
-        while (khi-klo > 1) {
-            k=(khi+klo) >> 1;
-            if (x2a[k] > x2) khi=k;
-            else klo=k;
-        }
-        y1=ya[ilo+klo*m];
-        y2=ya[ilo+khi*m];
-        y3=ya[ihi+khi*m];
-        y4=ya[ihi+klo*m];
-/*      Result will be NaN...
-        if (x1a[ihi]==x1a[ilo]||x2a[khi]==x2a[klo])
-            mexErrMsgTxt("Bad xa input to routine linint");
-*/
-        u=(x1-x1a[ilo])/(x1a[ihi]-x1a[ilo]);
-        t=(x2-x2a[klo])/(x2a[khi]-x2a[klo]);
-        f=(1-t)*(1-u)*y1+t*(1-u)*y2+t*u*y3+(1-t)*u*y4;
+    int i;
+    double h, tol;
+    if (n < 2) return 0;
+    h = (xa[n-1]-xa[0])/(n-1);
+    if (!(h > 0.0)) return 0;
+    tol = 1.0e-9*h;
+    for (i=1; i<n-1; i++)
+        if (fabs(xa[i]-(xa[0]+i*h)) > tol) return 0;
+    return 1;
+}
+
+static int grid_cell(double *xa, int n, int uniform, double x)
+/* Index lo such that xa[lo] <= x <= xa[lo+1], for xa[0] <= x <= xa[n-1] */
+{
+    int lo, hi, i;
+    if (uniform) {
+        /* direct computation, corrected for rounding */
+        lo = (int)((x-xa[0])/(xa[n-1]-xa[0])*(n-1));
+        if (lo > n-2) lo = n-2;
+        if (lo < 0) lo = 0;
+        if ((x < xa[lo]) && (lo > 0)) lo--;
+        else if ((x > xa[lo+1]) && (lo < n-2)) lo++;
+        return lo;
     }
-    else {  /*This is redundant...The limits have been taking as apertures previously*/
-        /*mexPrintf("Out of Id data range\n");*/
-        f=sqrt(-1);
+    lo=0;
+    hi=n-1;
+    while (hi-lo > 1) {
+        i=(hi+lo) >> 1;
+        if (xa[i] > x) hi=i;
+        else lo=i;
     }
-    *y=f; 
+    return lo;
+}
+
+/****************************************************************************/
+/****************************Bilinear interpolation*****************************/
+/****************************************************************************/
+
+struct lincell {
+    int ilo;        /* lower index along x1 */
+    int klo;        /* lower index along x2 */
+    double u;       /* reduced coordinate along x1 */
+    double t;       /* reduced coordinate along x2 */
+};
+
+static int linint_locate(double *x1a, double *x2a, int m, int n, int uniform1, int uniform2,
+                         double x1, double x2, struct lincell *cell)
+/* Locate the cell containing (x1, x2). The result may be used to interpolate
+   several tables sharing the same grid with linint_eval.
+   Returns 0 if the point is outside the grid */
+{
+    int ilo, klo;
+    if ((m < 2) || (n < 2)) return 0;
+    if (!((x1<=x1a[m-1])&&(x1>=x1a[0])&&(x2<=x2a[n-1])&&(x2>=x2a[0]))) return 0;
+    ilo = grid_cell(x1a, m, uniform1, x1);
+    klo = grid_cell(x2a, n, uniform2, x2);
+    cell->ilo = ilo;
+    cell->klo = klo;
+    cell->u = (x1-x1a[ilo])/(x1a[ilo+1]-x1a[ilo]);
+    cell->t = (x2-x2a[klo])/(x2a[klo+1]-x2a[klo]);
+    return 1;
+}
+
+static double linint_eval(double *ya, int m, struct lincell *cell)
+/* Bilinear interpolation of the m-by-n table ya in the located cell */
+{
+    double *y = ya + cell->ilo + cell->klo*m;
+    double u = cell->u, t = cell->t;
+    return (1-t)*(1-u)*y[0] + t*(1-u)*y[m] + t*u*y[m+1] + (1-t)*u*y[1];
+}
+
+void linint(double *x1a, double *x2a, double *ya, int m, int n, double x1, double x2, double *y)
+{
+    struct lincell cell;
+    if (linint_locate(x1a, x2a, m, n, 0, 0, x1, x2, &cell))
+        *y = linint_eval(ya, m, &cell);
+    else    /*This is redundant...The limits have been taking as apertures previously*/
+        *y = atGetNaN();
 }
 
 
@@ -190,3 +232,106 @@ void splint(double xa[], double ya[], double y2a[], int n, double x, double *y)
 	b=(x-xa[klo])/h;
 	*y=a*ya[klo]+b*ya[khi]+((a*a*a-a)*y2a[klo]+(b*b*b-b)*y2a[khi])*(h*h)/6.0;
 }
+
+
+/****************************************************************************/
+/**************************Bicubic spline interpolation***********************/
+/****************************************************************************/
+
+/* The bicubic spline is the tensor product of natural cubic splines. It is
+   stored as 16 polynomial coefficients per grid cell, computed once, so
+   that each evaluation costs a cell lookup (linint_locate) and a
+   polynomial evaluation */
+
+static void spline_slopes(double *x, double *y, int n, double *dy, double *y2)
+/* First derivatives at the nodes of the natural cubic spline through (x, y) */
+{
+    int i;
+    double h;
+    spline(x, y, n, 1.0e30, 1.0e30, y2);
+    for (i=0; i<n-1; i++) {
+        h = x[i+1]-x[i];
+        dy[i] = (y[i+1]-y[i])/h - h*(2.0*y2[i]+y2[i+1])/6.0;
+    }
+    h = x[n-1]-x[n-2];
+    dy[n-1] = (y[n-1]-y[n-2])/h + h*(y2[n-2]+2.0*y2[n-1])/6.0;
+}
+
+static void hermite_coefs(double p[4], double a[4])
+/* Cubic a[0]+a[1]*s+a[2]*s^2+a[3]*s^3 on [0, 1] from the values p[0], p[1]
+   and the slopes p[2], p[3] at both ends */
+{
+    a[0] = p[0];
+    a[1] = p[2];
+    a[2] = 3.0*(p[1]-p[0]) - 2.0*p[2] - p[3];
+    a[3] = 2.0*(p[0]-p[1]) + p[2] + p[3];
+}
+
+static void bicubic_coefficients(double *x1a, double *x2a, double *ya, int m, int n, double *coef)
+/* Coefficients of the bicubic spline through the m-by-n table ya, stored
+   as 16 values per cell: coef[16*(i+k*(m-1)) + 4*a + b] multiplies u^a*t^b,
+   u and t being the reduced coordinates along x1 and x2 in cell (i, k) */
+{
+    int i, k, a, b, nmax = (m > n) ? m : n;
+    double *d1 = (double*)atMalloc(3*m*n*sizeof(double));
+    double *d2 = d1 + m*n;
+    double *d12 = d2 + m*n;
+    double *work = (double*)atMalloc(4*nmax*sizeof(double));
+    double *yv = work, *dv = work+nmax, *y2 = work+2*nmax;
+
+    /* derivatives along x1, for each column */
+    for (k=0; k<n; k++)
+        spline_slopes(x1a, ya+k*m, m, d1+k*m, y2);
+    /* derivatives along x2 of the values and of d1, for each row */
+    for (i=0; i<m; i++) {
+        for (k=0; k<n; k++) yv[k] = ya[i+k*m];
+        spline_slopes(x2a, yv, n, dv, y2);
+        for (k=0; k<n; k++) d2[i+k*m] = dv[k];
+        for (k=0; k<n; k++) yv[k] = d1[i+k*m];
+        spline_slopes(x2a, yv, n, dv, y2);
+        for (k=0; k<n; k++) d12[i+k*m] = dv[k];
+    }
+    /* Hermite patch of each cell, in reduced coordinates */
+    for (k=0; k<n-1; k++) {
+        double h2 = x2a[k+1]-x2a[k];
+        for (i=0; i<m-1; i++) {
+            double h1 = x1a[i+1]-x1a[i];
+            double *c = coef + 16*(i+k*(m-1));
+            double f[4][4], g[4][4];
+            int i0 = i+k*m;
+            int idx[2][2] = {{i0, i0+m}, {i0+1, i0+1+m}};
+            /* f[a][b]: a = (value at u=0, at u=1, slope at u=0, at u=1), same for b and t */
+            for (a=0; a<2; a++) {
+                for (b=0; b<2; b++) {
+                    int j = idx[a][b];
+                    f[a][b] = ya[j];
+                    f[a][b+2] = h2*d2[j];
+                    f[a+2][b] = h1*d1[j];
+                    f[a+2][b+2] = h1*h2*d12[j];
+                }
+            }
+            /* transform along t, then along u */
+            for (a=0; a<4; a++) hermite_coefs(f[a], g[a]);
+            for (b=0; b<4; b++) {
+                double p[4], q[4];
+                for (a=0; a<4; a++) p[a] = g[a][b];
+                hermite_coefs(p, q);
+                for (a=0; a<4; a++) c[4*a+b] = q[a];
+            }
+        }
+    }
+    atFree(work);
+    atFree(d1);
+}
+
+static double bicubic_eval(double *coef, int m, struct lincell *cell)
+/* Bicubic spline interpolation in the located cell */
+{
+    double *c = coef + 16*(cell->ilo + cell->klo*(m-1));
+    double u = cell->u, t = cell->t;
+    double v = 0.0;
+    int a;
+    for (a=3; a>=0; a--)
+        v = v*u + ((c[4*a+3]*t + c[4*a+2])*t + c[4*a+1])*t + c[4*a];
+    return v;
+}
@@ -50,104 +50,140 @@ static void QuadFringePassN(double* r, const double b2)
    r[3]+=r3tmp;
 }
 
-/* from elegant code */
-static void quadPartialFringeMatrix(double R[6][6], double K1, double inFringe, double *fringeInt, int part)
-{
-  double J1x, J2x, J3x, J1y, J2y, J3y;
-  double K1sqr, expJ1x, expJ1y;
+/* from elegant code
+
+   The linear fringe field of one magnet end is the product of two partial
+   matrices. For a particle of momentum deviation delta, the entries of a
+   partial matrix are functions of K1 = b2/(1+delta) through
+
+        J1x = K1*j1x[0] + K1^2*j1x[1]       J1y = K1*j1y[0] + K1^2*j1y[1]
+        J2x = K1*j2x                        J2y = -J2x
+        J3x = K1^2*j3x                      J3y = J3x
+
+   The coefficients depend only on the fringe field integrals: they are
+   computed once per element, and the matrices are evaluated for each
+   particle from this closed form */
 
-  R[4][4] = R[5][5] = 1;
-  
-  K1sqr = K1*K1;
+struct quadfringe_part {
+    double j1x[2], j1y[2], j2x, j3x;
+};
 
+struct quadfringe_end {
+    struct quadfringe_part part[2];
+};
+
+static void quadPartialFringeCoefs(struct quadfringe_part *q, double inFringe, const double *fringeInt, int part)
+{
+  q->j2x = inFringe*fringeInt[2];
+  q->j1x[0] = inFringe*fringeInt[1];
+  q->j1y[0] = -inFringe*fringeInt[1];
   if (part==1) {
-    J1x = inFringe*(K1*fringeInt[1] - 2*K1sqr*fringeInt[3]/3.);
-    J2x = inFringe*(K1*fringeInt[2]);
-    J3x = inFringe*(K1sqr*(fringeInt[2] + fringeInt[4]));
-
-    K1 = -K1;
-    J1y = inFringe*(K1*fringeInt[1] - 2*K1sqr*fringeInt[3]/3.);
-    J2y = -J2x;
-    J3y = J3x;
+    q->j1x[1] = -inFringe*2*fringeInt[3]/3.;
+    q->j1y[1] = q->j1x[1];
+    q->j3x = inFringe*(fringeInt[2] + fringeInt[4]);
   } else {
-    J1x = inFringe*(K1*fringeInt[1] + K1sqr*fringeInt[0]*fringeInt[2]/2);
-    J2x = inFringe*(K1*fringeInt[2]);
-    J3x = inFringe*(K1sqr*(fringeInt[4]-fringeInt[0]*fringeInt[1]));
-
-    K1 = -K1;
-    J1y = inFringe*(K1*fringeInt[1] + K1sqr*fringeInt[0]*fringeInt[2]);
-    J2y = -J2x;
-    J3y = J3x;
+    q->j1x[1] = inFringe*fringeInt[0]*fringeInt[2]/2;
+    q->j1y[1] = inFringe*fringeInt[0]*fringeInt[2];
+    q->j3x = inFringe*(fringeInt[4]-fringeInt[0]*fringeInt[1]);
   }
+}
 
-  expJ1x = R[0][0] = exp(J1x);
-  R[0][1] = J2x/expJ1x;
-  R[1][0] = expJ1x*J3x;
-  R[1][1] = (1 + J2x*J3x)/expJ1x;
-  
-  expJ1y = R[2][2] = exp(J1y);
-  R[2][3] = J2y/expJ1y;
-  R[3][2] = expJ1y*J3y;
-  R[3][3] = (1 + J2y*J3y)/expJ1y;
-
-  return;
+/* Coefficients of the entrance and exit fringe fields */
+static void quadFringeCoefs(struct quadfringe_end *entrance, struct quadfringe_end *exit,
+        const double *fringeIntM0, const double *fringeIntP0)
+{
+  if (entrance) {
+    quadPartialFringeCoefs(&entrance->part[0], -1.0, fringeIntP0, 1);
+    quadPartialFringeCoefs(&entrance->part[1], -1.0, fringeIntM0, 2);
+  }
+  if (exit) {
+    quadPartialFringeCoefs(&exit->part[0], 1.0, fringeIntM0, 1);
+    quadPartialFringeCoefs(&exit->part[1], 1.0, fringeIntP0, 2);
+  }
 }
 
-static void linearQuadFringeElegantEntrance(double* r6, double b2, double *fringeIntM0, double *fringeIntP0)
+AT_INLINE void quadPartialFringe(double *x, double *px, double *y, double *py,
+        double K1, const struct quadfringe_part *q)
+{
+  double J1x = K1*(q->j1x[0] + K1*q->j1x[1]);
+  double J1y = K1*(q->j1y[0] + K1*q->j1y[1]);
+  double J2x = K1*q->j2x;
+  double J3x = K1*K1*q->j3x;
+  double expJ1x = exp(J1x);
+  double expJ1y = exp(J1y);
+  *x = expJ1x*(*x) + J2x/expJ1x*(*px);
+  *px = expJ1x*J3x*(*x) + (1 + J2x*J3x)/expJ1x*(*px);
+  *y = expJ1y*(*y) - J2x/expJ1y*(*py);
+  *py = expJ1y*J3x*(*y) + (1 - J2x*J3x)/expJ1y*(*py);
+}
+
+/* Partial matrix applied to n particles. The coordinate i of particle c
+   is r[i*rstride + c*pstride], so that the same code runs on particle
+   arrays (pstride=6, rstride=1) and on structures of arrays (pstride=1) */
+static void quadPartialFringeBatch(double *r, int rstride, int pstride, int n,
+        double b2, const struct quadfringe_part *q)
+{
+  int c;
+  AT_OMP_SIMD
+  for (c=0; c<n; c++) {
+    double *rc = r + c*pstride;
+    if (!atIsNaN(rc[0]))
+      quadPartialFringe(rc, rc+rstride, rc+2*rstride, rc+3*rstride,
+              b2/(1+rc[4*rstride]), q);
+  }
+}
+
+/* Complete linear and nonlinear fringe field of one end applied to n
+   particles, with the same layout as quadPartialFringeBatch */
+static void linearQuadFringeBatch(double *r, int rstride, int pstride, int n,
+        double b2, const struct quadfringe_end *q, bool entrance)
+{
+  int c;
+  quadPartialFringeBatch(r, rstride, pstride, n, b2, &q->part[0]);
+  for (c=0; c<n; c++) {
+    double *rc = r + c*pstride;
+    if (!atIsNaN(rc[0])) {
+      double r6[6];
+      int i;
+      for (i=0; i<6; i++) r6[i] = rc[i*rstride];
+      if (entrance)
+        QuadFringePassP(r6,b2);
+      else
+        QuadFringePassN(r6,b2);
+      for (i=0; i<6; i++) rc[i*rstride] = r6[i];
+    }
+  }
+  quadPartialFringeBatch(r, rstride, pstride, n, b2, &q->part[1]);
+}
+
+static void linearQuadFringeEntrance(double* r6, double b2, const struct quadfringe_end *q)
 {
-    double R[6][6];
-    double *fringeIntM, *fringeIntP;
-    double delta, inFringe;
-    /* quadrupole linear fringe field, from elegant code */
-    inFringe=-1.0;
-    fringeIntM = fringeIntP0;
-    fringeIntP = fringeIntM0;
-    delta = r6[4];
-    /* determine first linear matrix for this delta */
-    quadPartialFringeMatrix(R, b2/(1+delta), inFringe, fringeIntM, 1);
-    r6[0] = R[0][0]*r6[0] + R[0][1]*r6[1];
-    r6[1] = R[1][0]*r6[0] + R[1][1]*r6[1];
-    r6[2] = R[2][2]*r6[2] + R[2][3]*r6[3];
-    r6[3] = R[3][2]*r6[2] + R[3][3]*r6[3];
+    double K1 = b2/(1+r6[4]);
+    quadPartialFringe(r6, r6+1, r6+2, r6+3, K1, &q->part[0]);
     /* nonlinear fringe field */
     QuadFringePassP(r6,b2);   /*This is original AT code*/
-    /*Linear fringe fields from elegant*/
-    inFringe=-1.0;
-    /* determine and apply second linear matrix, from elegant code */
-    quadPartialFringeMatrix(R, b2/(1+delta), inFringe, fringeIntP, 2);
-    r6[0] = R[0][0]*r6[0] + R[0][1]*r6[1];
-    r6[1] = R[1][0]*r6[0] + R[1][1]*r6[1];
-    r6[2] = R[2][2]*r6[2] + R[2][3]*r6[3];
-    r6[3] = R[3][2]*r6[2] + R[3][3]*r6[3];
+    quadPartialFringe(r6, r6+1, r6+2, r6+3, K1, &q->part[1]);
 }
 
-
-static void linearQuadFringeElegantExit(double* r6, double b2, double *fringeIntM0, double *fringeIntP0)
+static void linearQuadFringeExit(double* r6, double b2, const struct quadfringe_end *q)
 {
-    double R[6][6];
-    double *fringeIntM, *fringeIntP;
-    double delta, inFringe;
-    /* quadrupole linear fringe field, from elegant code */
-    inFringe=1.0;
-    fringeIntM = fringeIntM0;
-    fringeIntP = fringeIntP0;
-    delta = r6[4];
-    /* determine first linear matrix for this delta */
-    quadPartialFringeMatrix(R, b2/(1+delta), inFringe, fringeIntM, 1);
-    r6[0] = R[0][0]*r6[0] + R[0][1]*r6[1];
-    r6[1] = R[1][0]*r6[0] + R[1][1]*r6[1];
-    r6[2] = R[2][2]*r6[2] + R[2][3]*r6[3];
-    r6[3] = R[3][2]*r6[2] + R[3][3]*r6[3];
+    double K1 = b2/(1+r6[4]);
+    quadPartialFringe(r6, r6+1, r6+2, r6+3, K1, &q->part[0]);
     /* nonlinear fringe field */
     QuadFringePassN(r6,b2);   /*This is original AT code*/
-    /*Linear fringe fields from elegant*/
-    inFringe=1.0;
-    /* determine and apply second linear matrix, from elegant code */
-    quadPartialFringeMatrix(R, b2/(1+delta), inFringe, fringeIntP, 2);
-    r6[0] = R[0][0]*r6[0] + R[0][1]*r6[1];
-    r6[1] = R[1][0]*r6[0] + R[1][1]*r6[1];
-    r6[2] = R[2][2]*r6[2] + R[2][3]*r6[3];
-    r6[3] = R[3][2]*r6[2] + R[3][3]*r6[3];
+    quadPartialFringe(r6, r6+1, r6+2, r6+3, K1, &q->part[1]);
 }
 
+static void linearQuadFringeElegantEntrance(double* r6, double b2, double *fringeIntM0, double *fringeIntP0)
+{
+    struct quadfringe_end q;
+    quadFringeCoefs(&q, NULL, fringeIntM0, fringeIntP0);
+    linearQuadFringeEntrance(r6, b2, &q);
+}
 
+static void linearQuadFringeElegantExit(double* r6, double b2, double *fringeIntM0, double *fringeIntP0)
+{
+    struct quadfringe_end q;
+    quadFringeCoefs(NULL, &q, fringeIntM0, fringeIntP0);
+    linearQuadFringeExit(r6, b2, &q);
+}
@@ -0,0 +1,136 @@
+/* Symmetric drift-kick splitting schemes of the thick element integrators.
+
+   One integration step of length SL is the sequence
+
+        drift[0] kick[0] drift[1] ... kick[nkicks-1] drift[nkicks]
+
+   of drifts of length SL*drift[i] and kicks of strength SL*kick[i].
+   The scheme is selected by the IntegratorScheme element attribute:
+
+   0, 4     4th order Forest-Ruth (Yoshida) scheme, 3 kicks (default)
+   6        6th order Yoshida scheme (solution A), 7 kicks
+   8        8th order Yoshida scheme (solution D), 15 kicks
+   12-14    Laskar-Robutel SABA_n scheme, n = 2-4 kicks: error
+            O(e*h^2n + e^2*h^2) for a kick of relative strength e. Accurate
+            with few kicks for weak multipoles (sextupoles, octupoles)
+
+   Yoshida, Phys. Lett. A 150 (1990) 262
+   Laskar and Robutel, Celest. Mech. Dyn. Astron. 80 (2001) 39
+*/
+
+#ifndef SYMPLECTIC_C
+#define SYMPLECTIC_C
+
+#include <math.h>
+
+#define SYMPLECTIC_MAX_KICKS 15
+
+struct symplectic_scheme {
+    int nkicks;
+    double drift[SYMPLECTIC_MAX_KICKS+1];
+    double kick[SYMPLECTIC_MAX_KICKS];
+};
+
+/* Symmetric composition of 2nd order leapfrog steps of weights
+   w[nw-1] ... w[1] w0 w[1] ... w[nw-1], with w0 = 1 - 2*sum(w) */
+static void yoshida_scheme(struct symplectic_scheme *s, const double *w, int nw)
+{
+    double weights[SYMPLECTIC_MAX_KICKS];
+    double w0 = 1.0;
+    int i, n = 2*nw-1;
+    for (i=1; i<nw; i++) w0 -= 2.0*w[i];
+    weights[nw-1] = w0;
+    for (i=1; i<nw; i++) {
+        weights[nw-1-i] = w[i];
+        weights[nw-1+i] = w[i];
+    }
+    s->nkicks = n;
+    s->drift[0] = 0.5*weights[0];
+    for (i=0; i<n; i++) {
+        s->kick[i] = weights[i];
+        s->drift[i+1] = 0.5*(weights[i] + ((i+1 < n) ? weights[i+1] : 0.0));
+    }
+}
+
+static void saba_scheme(struct symplectic_scheme *s, int n)
+{
+    double c[3], d[2];
+    int i;
+    switch (n) {
+    case 2:
+        c[0] = 0.5 - sqrt(3.0)/6.0;
+        c[1] = sqrt(3.0)/3.0;
+        d[0] = 0.5;
+        break;
+    case 3:
+        c[0] = 0.5 - sqrt(15.0)/10.0;
+        c[1] = sqrt(15.0)/10.0;
+        d[0] = 5.0/18.0;
+        d[1] = 4.0/9.0;
+        break;
+    default: {
+        double sp = sqrt(525.0 + 70.0*sqrt(30.0));
+        double sm = sqrt(525.0 - 70.0*sqrt(30.0));
+        c[0] = 0.5 - sp/70.0;
+        c[1] = (sp - sm)/70.0;
+        c[2] = sm/35.0;
+        d[0] = 0.25 - sqrt(30.0)/72.0;
+        d[1] = 0.25 + sqrt(30.0)/72.0;
+        n = 4;
+        }
+    }
+    s->nkicks = n;
+    for (i=0; i<n; i++) {
+        int j = (i < n-i-1) ? i : n-i-1;
+        s->kick[i] = d[j];
+    }
+    for (i=0; i<=n; i++) {
+        int j = (i < n-i) ? i : n-i;
+        s->drift[i] = c[j];
+    }
+}
+
+/* Fill the scheme selected by code. Returns 0 if the code is unknown */
+static int atSymplecticScheme(struct symplectic_scheme *s, int code)
+{
+    static const double yoshida4[] = {0.0, 1.351207191959657328};
+    static const double yoshida6[] = {0.0, -1.17767998417887, 0.235573213359357,
+                                      0.784513610477560};
+    static const double yoshida8[] = {0.0, 0.102799849391985, -1.96061023297549,
+                                      1.93813913762276, -0.158240635368243,
+                                      -1.44485223686048, 0.253693336566229,
+                                      0.914844246229740};
+    switch (code) {
+    case 0:
+    case 4:
+        yoshida_scheme(s, yoshida4, 2);
+        return 1;
+    case 6:
+        yoshida_scheme(s, yoshida6, 4);
+        return 1;
+    case 8:
+        yoshida_scheme(s, yoshida8, 8);
+        return 1;
+    case 12:
+    case 13:
+    case 14:
+        saba_scheme(s, code-10);
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+/* Coefficients of a step of length SL */
+static void atScaleScheme(struct symplectic_scheme *steps, const struct symplectic_scheme *s, double SL)
+{
+    int i;
+    steps->nkicks = s->nkicks;
+    for (i=0; i<s->nkicks; i++) {
+        steps->drift[i] = SL*s->drift[i];
+        steps->kick[i] = SL*s->kick[i];
+    }
+    steps->drift[s->nkicks] = SL*s->drift[s->nkicks];
+}
+
+#endif /* SYMPLECTIC_C */
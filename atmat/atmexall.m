@@ -104,11 +104,11 @@ compile([alloptions, {passinclude}], fullfile(cdir,'findmpoleraddiffmatrix.c'));
 
 % RDTs
 cdir=fullfile(atroot,'atphysics','NonLinearDynamics');
-compile(alloptions, fullfile(cdir,'RDTelegantAT.cpp'));
+compile([alloptions, ompoptions], fullfile(cdir,'RDTelegantAT.cpp'));
 
 % NAFF
 cdir=fullfile(atroot,'atphysics','nafflib');
-compile(alloptions, fullfile(cdir,'nafflib.c'),...
+compile([alloptions, {passinclude}, ompoptions], fullfile(cdir,'nafflib.c'),...
                     fullfile(cdir,'modnaff.c'),...
                     fullfile(cdir,'complexe.c'));
 
@@ -4,19 +4,35 @@
  *  using the function computeRDT()
  *  The formulas have not been changed
  *  
+ *  The same source builds the Matlab mex function RDTelegantAT and the
+ *  python extension at.physics.rdtelegant. computeDrivingTerms keeps no
+ *  state between calls, so that it may be called from several threads.
+ *  The second-order terms, quadratic in the sextupole strengths, are
+ *  summed over the sextupole pairs in parallel. Their sums can be kept
+ *  and updated when only a few sextupoles change, at a cost proportional
+ *  to the number of changed sextupoles.
  */
 
+#if defined(PYAT)
+#include "atcommon.h"
+#endif
+#if defined(MATLAB_MEX_FILE)
 #include "mex.h"
+#endif
 #include <complex>
 #include <cmath>
 #include <cstring>
+#include <cstdio>
+#include <cstdlib>
 
+#if defined(MATLAB_MEX_FILE)
 /* Get ready for R2018a C matrix API */
 #ifndef mxGetDoubles
 #define mxGetDoubles mxGetPr
 #define mxSetDoubles mxSetPr
 typedef double mxDouble;
 #endif
+#endif /*MATLAB_MEX_FILE*/
 
 typedef struct {
   double betax, betay;
@@ -52,24 +68,37 @@ typedef struct {
   
 } DRIVING_TERMS;
 
-void computeDrivingTerms(DRIVING_TERMS *d, int NumElem,
+typedef struct {
+  /* Sextupole contributions to the second-order terms, summed over the pairs */
+  std::complex <double> h22000, h11110, h00220, h31000, h40000;
+  std::complex <double> h20110, h11200, h20020, h20200, h00310, h00400;
+  double dnux_dJx, dnux_dJy, dnuy_dJy;
+} SEXTUPOLE_PAIRS;
+
+/* Number of doubles needed to store a SEXTUPOLE_PAIRS */
+#define NPAIRTERMS 25
+
+void computeDrivingTerms(DRIVING_TERMS *d, SEXTUPOLE_PAIRS *pairs, int NumElem,
 							double *s, double *betax, double *betay, double *phix, double *phiy, double *etax,
 							double *Lista2L, double *Listb2L, double *Listb3L, double *Listb4L, double *tune,
-							char Geometric1, char Geometric2, char Chromatic1, char Coupling1, char TuneShifts, long nPeriods);
+							char Chromatic1, char Coupling1, char Geometric1, char Geometric2, char TuneShifts,
+							long nPeriods, const double *Listb3Lref);
 
+#if defined(MATLAB_MEX_FILE)
 /* The gateway function */
 void mexFunction( int nlhs, mxArray *plhs[],
                   int nrhs, const mxArray *prhs[]);
+#endif
 
 /* square function */
-double sqr(double input)
+static double sqr(double input)
 {
 	double square=0;
 	square = input * input;
 	return square;
 }
 /* sign function */
-double SIGN(double number)
+static double SIGN(double number)
 {
 	if (number>0)
 		return 1;
@@ -80,12 +109,238 @@ double SIGN(double number)
 			return 0;
 }
 
+/* strength of a sextupole, zero below the threshold of the element loop */
+static double sext_strength(double b3L)
+{
+	return (fabs(b3L)>1e-6) ? b3L : 0.0;
+}
+
+static void clear_pairs(SEXTUPOLE_PAIRS *p)
+{
+  p->h22000 = p->h11110 = p->h00220 = p->h31000 = p->h40000 = std::complex<double>(0,0);
+  p->h20110 = p->h11200 = p->h20020 = p->h20200 = p->h00310 = p->h00400 = std::complex<double>(0,0);
+  p->dnux_dJx = p->dnux_dJy = p->dnuy_dJy = 0;
+}
+
+static void add_pairs(SEXTUPOLE_PAIRS *p, const SEXTUPOLE_PAIRS *q)
+{
+  p->h22000 += q->h22000; p->h11110 += q->h11110; p->h00220 += q->h00220;
+  p->h31000 += q->h31000; p->h40000 += q->h40000; p->h20110 += q->h20110;
+  p->h11200 += q->h11200; p->h20020 += q->h20020; p->h20200 += q->h20200;
+  p->h00310 += q->h00310; p->h00400 += q->h00400;
+  p->dnux_dJx += q->dnux_dJx; p->dnux_dJy += q->dnux_dJy; p->dnuy_dJy += q->dnuy_dJy;
+}
+
+/* Resonance factors of the tune shifts: cos(phi - PI*nu)/sin(PI*nu) is
+   the real part of exp(i*phi) times exp(-i*PI*nu)/sin(PI*nu) */
+typedef struct {
+  std::complex <double> nux1, nux3, nuxpy2, nuxmy2;
+} RESONANCE_FACTORS;
+
+static void resonance_factors(RESONANCE_FACTORS *rf, const double *tune)
+{
+  const double PI = 3.141592653589793;
+  const std::complex <double> ii(0,1);
+  double nux = tune[0], nuy = tune[1];
+
+  rf->nux1 = exp(-ii*(PI*nux))/sin(PI*nux);
+  rf->nux3 = exp(-ii*(3*PI*nux))/sin(3*PI*nux);
+  rf->nuxpy2 = exp(-ii*(PI*(nux+2*nuy)))/sin(PI*(nux+2*nuy));
+  rf->nuxmy2 = exp(-ii*(PI*(nux-2*nuy)))/sin(PI*(nux-2*nuy));
+}
+
+/* Contribution of the sextupole pair (ei, ej) with weight w = b3L_i*b3L_j */
+static void pair_terms(SEXTUPOLE_PAIRS *acc, const ELEMDATA *ei, const ELEMDATA *ej, double w,
+							const RESONANCE_FACTORS *rf, char Geometric2, char TuneShifts)
+{
+  const double PI = 3.141592653589793;
+  const double two=2, three=3, four=4;
+  const std::complex <double> ii(0,1);
+  std::complex <double> t1, t2;
+  double termSign;
+
+	  if(TuneShifts)
+	  {
+	    /* exp(i*|phix_i-phix_j|), exp(3i*|phix_i-phix_j|), exp(2i*|phiy_i-phiy_j|) */
+	    std::complex <double> ex1 = ei->px[1]*conj(ej->px[1]);
+	    std::complex <double> ex3 = ei->px[3]*conj(ej->px[3]);
+	    std::complex <double> ey2 = ei->py[2]*conj(ej->py[2]);
+	    double cx1, cx3, cxpy2, cxmy2;
+	    if (ei->phix < ej->phix) {
+	      ex1 = conj(ex1);
+	      ex3 = conj(ex3);
+	    }
+	    if (ei->phiy < ej->phiy)
+	      ey2 = conj(ey2);
+	    cx1 = (ex1*rf->nux1).real();
+	    cx3 = (ex3*rf->nux3).real();
+	    cxpy2 = (ex1*ey2*rf->nuxpy2).real();
+	    cxmy2 = (ex1*conj(ey2)*rf->nuxmy2).real();
+	    acc->dnux_dJx += w/(-16*PI)*ei->betax*ej->betax*ei->rbetax*ej->rbetax*
+	      (3*cx1 + cx3);
+	    acc->dnux_dJy += w/(8*PI)*ei->rbetax*ej->rbetax*ei->betay*
+	      (2*ej->betax*cx1 - ej->betay*cxpy2 + ej->betay*cxmy2);
+	    acc->dnuy_dJy += w/(-16*PI)*ei->rbetax*ej->rbetax*ei->betay*ej->betay*
+	      (4*cx1 + cxpy2 + cxmy2);
+	   }
+	   if (Geometric2)
+	   {
+	    termSign = SIGN(ei->s - ej->s);
+            if (termSign) {
+              /* geometric terms */
+              acc->h22000 += (1./64)*termSign*ii*w*
+                ei->rbetax*ej->rbetax*ei->betax*ej->betax*
+                (ei->px[3]*conj(ej->px[3]) + three*ei->px[1]*conj(ej->px[1]));
+              acc->h31000 += (1./32)*termSign*ii*w*
+                ei->rbetax*ej->rbetax*ei->betax*ej->betax*
+                ei->px[3]*conj(ej->px[1]);
+	      t1 = conj(ei->px[1])*ej->px[1];
+	      t2 = ei->px[1]*conj(ej->px[1]);
+              acc->h11110 += (1./16)*termSign*ii*w*
+                ei->rbetax*ej->rbetax*ei->betay*
+                (ej->betax*(t1 - conj(t1) )
+                 + 
+		 ej->betay*ei->py[2]*conj(ej->py[2])*(conj(t1) + t1)
+		 );
+	      t1 = conj(ei->px[1])*ej->px[1];   /* exp(-i*(phix_i-phix_j)) */
+	      t2 = conj(t1);
+              acc->h11200 += (1./32)*termSign*ii*w*
+                ei->rbetax*ej->rbetax*ei->betay*ei->py[2]*
+                (ej->betax*(t1 - t2)
+                 + 
+		 two*ej->betay*(t2 + t1)
+		 );
+              acc->h40000 += (1./64)*termSign*ii*w*
+                ei->rbetax*ej->rbetax*ei->betax*ej->betax*
+                ei->px[3]*ej->px[1];
+              acc->h20020 += (1./64)*termSign*ii*w*
+                ei->rbetax*ej->rbetax*ei->betay*
+                (ej->betax*conj(ei->px[1]*ei->py[2])*ej->px[3]
+                 -(ej->betax+four*ej->betay)*ei->px[1]*ej->px[1]*conj(ei->py[2])
+		 );
+              acc->h20110 += (1./32)*termSign*ii*w*
+                ei->rbetax*ej->rbetax*ei->betay*
+                (ej->betax*(
+			       conj(ei->px[1])*ej->px[3]
+			       - 
+			       ei->px[1]*ej->px[1]
+			       ) 
+                 + two*ej->betay*ei->px[1]*ej->px[1]*ei->py[2]*conj(ej->py[2])
+		 );
+              acc->h20200 += (1./64)*termSign*ii*w*
+                ei->rbetax*ej->rbetax*ei->betay*
+                (ej->betax*
+		 conj(ei->px[1])*ej->px[3]*ei->py[2]
+                 -(ej->betax-four*ej->betay)*
+		 ei->px[1]*ej->px[1]*ei->py[2]
+		 );
+              acc->h00220 += (1./64)*termSign*ii*w*
+                ei->rbetax*ej->rbetax*ei->betay*ej->betay*
+		(ei->px[1]*ei->py[2]*conj(ej->px[1]*ej->py[2])
+                 + four*ei->px[1]*conj(ej->px[1])
+		 - conj(ei->px[1]*ej->py[2])*ej->px[1]*ei->py[2]
+		 );
+              acc->h00310 += (1./32)*termSign*ii*w*
+                ei->rbetax*ej->rbetax*ei->betay*ej->betay*ei->py[2]*
+                (ei->px[1]*conj(ej->px[1])
+		 -conj(ei->px[1])*ej->px[1]
+		 );
+              acc->h00400 += (1./64)*termSign*ii*w*
+                ei->rbetax*ej->rbetax*ei->betay*ej->betay*
+		ei->px[1]*conj(ej->px[1])*ei->py[2]*ej->py[2];
+	    }
+	   }
+}
+
+/* Sum the pair terms of each row rows[r] over the columns cols[], with
+   weight newb3L_i*newb3L_j - oldb3L_i*oldb3L_j (oldb3L may be NULL for 0).
+   Each row is summed independently and the rows are added in order, so that
+   the result does not depend on the number of threads */
+static void pair_rows(SEXTUPOLE_PAIRS *sum, const ELEMDATA *ed,
+							const double *newb3L, const double *oldb3L,
+							const long *rows, long nrows, const long *cols, long ncols,
+							const RESONANCE_FACTORS *rf, char Geometric2, char TuneShifts)
+{
+  SEXTUPOLE_PAIRS *rowsum;
+  long r;
+
+  if (nrows<=0 || ncols<=0) return;
+  rowsum = (SEXTUPOLE_PAIRS*)malloc(nrows*sizeof(SEXTUPOLE_PAIRS));
+  #pragma omp parallel for schedule(dynamic,4) if ((double)nrows*ncols > 1.0e4)
+  for (r=0; r<nrows; r++) {
+    long iE = rows[r], c;
+    SEXTUPOLE_PAIRS acc;
+    clear_pairs(&acc);
+    for (c=0; c<ncols; c++) {
+      long jE = cols[c];
+      double w = newb3L[iE]*newb3L[jE];
+      if (oldb3L) w -= oldb3L[iE]*oldb3L[jE];
+      if (w != 0.0)
+        pair_terms(&acc, ed+iE, ed+jE, w, rf, Geometric2, TuneShifts);
+    }
+    rowsum[r] = acc;
+  }
+  for (r=0; r<nrows; r++)
+    add_pairs(sum, rowsum+r);
+  free(rowsum);
+}
+
+/* Sextupole contributions to the second-order terms. Without reference
+   strengths, the pairs are summed over all sextupoles. Otherwise, pairs
+   holds the sums for the strengths Listb3Lref and only the pairs including a
+   modified sextupole are updated */
+static void sextupole_pairs(SEXTUPOLE_PAIRS *pairs, const ELEMDATA *ed, int NumElem,
+							const double *Listb3Lref, double *tune, char Geometric2, char TuneShifts)
+{
+  double *newb3L = (double*)malloc(2*NumElem*sizeof(double));
+  double *oldb3L = Listb3Lref ? newb3L+NumElem : NULL;
+  long *active = (long*)malloc(3*NumElem*sizeof(long));
+  long *changed = active+NumElem;
+  long *unchanged = active+2*NumElem;
+  long nactive=0, nchanged=0, nunchanged=0, nE;
+  SEXTUPOLE_PAIRS delta;
+  RESONANCE_FACTORS rf;
+
+  resonance_factors(&rf, tune);
+  for (nE=0; nE<NumElem; nE++) {
+    newb3L[nE] = sext_strength(ed[nE].b3L);
+    if (oldb3L) oldb3L[nE] = sext_strength(Listb3Lref[nE]);
+    if (newb3L[nE]!=0.0 || (oldb3L && oldb3L[nE]!=0.0)) {
+      active[nactive++] = nE;
+      if (oldb3L && oldb3L[nE]!=newb3L[nE])
+        changed[nchanged++] = nE;
+      else
+        unchanged[nunchanged++] = nE;
+    }
+  }
+  clear_pairs(&delta);
+  if (oldb3L) {
+    /* The pairs of two unchanged sextupoles keep their weight */
+    pair_rows(&delta, ed, newb3L, oldb3L, changed, nchanged, active, nactive,
+							&rf, Geometric2, TuneShifts);
+    pair_rows(&delta, ed, newb3L, oldb3L, unchanged, nunchanged, changed, nchanged,
+							&rf, Geometric2, TuneShifts);
+  }
+  else {
+    clear_pairs(pairs);
+    pair_rows(&delta, ed, newb3L, NULL, active, nactive, active, nactive,
+							&rf, Geometric2, TuneShifts);
+  }
+  add_pairs(pairs, &delta);
+  free(active);
+  free(newb3L);
+}
+
 /* void computeDrivingTerms(DRIVING_TERMS *d, ELEMENT_LIST *elem, TWISS *twiss0, double *tune, long nPeriods)*/
-void computeDrivingTerms(DRIVING_TERMS *d, int NumElem,
+/* pairs, if not NULL, receives the sextupole pair sums of the second-order
+   terms. If Listb3Lref is not NULL, pairs must hold on input the sums for
+   the sextupole strengths Listb3Lref with the same optics and options, and
+   they are updated for the strengths Listb3L */
+void computeDrivingTerms(DRIVING_TERMS *d, SEXTUPOLE_PAIRS *pairs, int NumElem,
 							double *s, double *betax, double *betay, double *phix, double *phiy, double *etax,
 							double *Lista2L, double *Listb2L, double *Listb3L, double *Listb4L, double *tune, 
 							char Chromatic1, char Coupling1, char Geometric1, char Geometric2, char TuneShifts,
-							long nPeriods)
+							long nPeriods, const double *Listb3Lref)
 /* Based on J. Bengtsson, SLS Note 9/97, March 7, 1997, with corrections per W. Guo (NSLS) */
 /* Revised to follow C. X. Wang AOP-TN-2009-020 for second-order terms */
 {
@@ -93,22 +348,18 @@ void computeDrivingTerms(DRIVING_TERMS *d, int NumElem,
   std::complex <double> h21000, h30000, h10110, h10020, h10200;
   std::complex <double> h22000, h11110, h00220, h31000, h40000;
   std::complex <double> h20110, h11200, h20020, h20200, h00310, h00400;
-  std::complex <double> t1, t2, t3, t4;
   std::complex <double> ii;
   std::complex <double> periodicFactor[9][9];
 #define PF(i,j) (periodicFactor[4+i][4+j])
-  double betax1, betay1, phix1, phiy1, etax1, termSign;
-  double coef, b2L, a2L, b3L, b4L, nux, nuy;
+  double betax1, betay1, phix1, phiy1, etax1;
+  double b2L, a2L, b3L, b4L;
   double PIx2 = 6.283185307179586;
   double PI = 3.141592653589793;
 //  ELEMENT_LIST *eptr1;
-  double two=2, three=3, four=4;
   ELEMDATA *ed = NULL;
-  long nE=0, iE, jE, i, j;
-  double sqrt8, sqrt2, tilt;
+  SEXTUPOLE_PAIRS localpairs;
+  long nE=0, i, j;
 
-  sqrt8 = sqrt((double)8);
-  sqrt2 = sqrt((double)2);
   ii = std::complex<double>(0,1);
 
 //printf("leading_order_driving_terms_only=%d\n",leading_order_driving_terms_only);
@@ -303,97 +554,25 @@ ed = (ELEMDATA*)malloc(NumElem*sizeof(ELEMDATA));
 //      return 0;
 	}
 	//printf("entered in !leading_order_driving_terms_only\n");
-    nux = tune[0];
-    nuy = tune[1];
-
-    for (iE=0; iE<NumElem; iE++) {
-      if (fabs(ed[iE].b3L)>1e-6) {
-	for (jE=0; jE<NumElem; jE++) {
-	  if (fabs(ed[jE].b3L)>1e-6) {
-	  if(TuneShifts)
-	  {
-	    d->dnux_dJx += ed[iE].b3L*ed[jE].b3L/(-16*PI)*pow(ed[iE].betax*ed[jE].betax, 1.5)*
-	      (3*cos(fabs(ed[iE].phix-ed[jE].phix)-PI*nux)/sin(PI*nux) + cos(fabs(3*(ed[iE].phix-ed[jE].phix))-3*PI*nux)/sin(3*PI*nux));
-	    d->dnux_dJy += ed[iE].b3L*ed[jE].b3L/(8*PI)*sqrt(ed[iE].betax*ed[jE].betax)*ed[iE].betay*
-	      (2*ed[jE].betax*cos(fabs(ed[iE].phix-ed[jE].phix)-PI*nux)/sin(PI*nux) 
-	       - ed[jE].betay*cos(fabs(ed[iE].phix-ed[jE].phix)+2*fabs(ed[iE].phiy-ed[jE].phiy)-PI*(nux+2*nuy))/sin(PI*(nux+2*nuy))
-	       + ed[jE].betay*cos(fabs(ed[iE].phix-ed[jE].phix)-2*fabs(ed[iE].phiy-ed[jE].phiy)-PI*(nux-2*nuy))/sin(PI*(nux-2*nuy)));
-	    d->dnuy_dJy += ed[iE].b3L*ed[jE].b3L/(-16*PI)*sqrt(ed[iE].betax*ed[jE].betax)*ed[iE].betay*ed[jE].betay*
-	      (4*cos(fabs(ed[iE].phix-ed[jE].phix)-PI*nux)/sin(PI*nux) 
-	       + cos(fabs(ed[iE].phix-ed[jE].phix)+2*fabs(ed[iE].phiy-ed[jE].phiy)-PI*(nux+2*nuy))/sin(PI*(nux+2*nuy)) 
-	       + cos(fabs(ed[iE].phix-ed[jE].phix)-2*fabs(ed[iE].phiy-ed[jE].phiy)-PI*(nux-2*nuy))/sin(PI*(nux-2*nuy)));
-	   }
-	   if (Geometric2)
-	   {
-	    termSign = SIGN(ed[iE].s - ed[jE].s);
-            if (termSign) {
-              /* geometric terms */
-              h22000 += (1./64)*termSign*ii*ed[iE].b3L*ed[jE].b3L*
-                ed[iE].rbetax*ed[jE].rbetax*ed[iE].betax*ed[jE].betax*
-                (ed[iE].px[3]*conj(ed[jE].px[3]) + three*ed[iE].px[1]*conj(ed[jE].px[1]));
-              h31000 += (1./32)*termSign*ii*ed[iE].b3L*ed[jE].b3L*
-                ed[iE].rbetax*ed[jE].rbetax*ed[iE].betax*ed[jE].betax*
-                ed[iE].px[3]*conj(ed[jE].px[1]);
-	      t1 = conj(ed[iE].px[1])*ed[jE].px[1];
-	      t2 = ed[iE].px[1]*conj(ed[jE].px[1]);
-              h11110 += (1./16)*termSign*ii*ed[iE].b3L*ed[jE].b3L*
-                ed[iE].rbetax*ed[jE].rbetax*ed[iE].betay*
-                (ed[jE].betax*(t1 - conj(t1) )
-                 + 
-		 ed[jE].betay*ed[iE].py[2]*conj(ed[jE].py[2])*(conj(t1) + t1)
-		 );
-	      t1 = exp(-ii*(ed[iE].phix-ed[jE].phix));
-	      t2 = conj(t1);
-              h11200 += (1./32)*termSign*ii*ed[iE].b3L*ed[jE].b3L*
-                ed[iE].rbetax*ed[jE].rbetax*ed[iE].betay*exp(ii*(2*ed[iE].phiy))*
-                (ed[jE].betax*(t1 - t2)
-                 + 
-		 two*ed[jE].betay*(t2 + t1)
-		 );
-              h40000 += (1./64)*termSign*ii*ed[iE].b3L*ed[jE].b3L*
-                ed[iE].rbetax*ed[jE].rbetax*ed[iE].betax*ed[jE].betax*
-                ed[iE].px[3]*ed[jE].px[1];
-              h20020 += (1./64)*termSign*ii*ed[iE].b3L*ed[jE].b3L*
-                ed[iE].rbetax*ed[jE].rbetax*ed[iE].betay*
-                (ed[jE].betax*conj(ed[iE].px[1]*ed[iE].py[2])*ed[jE].px[3]
-                 -(ed[jE].betax+four*ed[jE].betay)*ed[iE].px[1]*ed[jE].px[1]*conj(ed[iE].py[2])
-		 );
-              h20110 += (1./32)*termSign*ii*ed[iE].b3L*ed[jE].b3L*
-                ed[iE].rbetax*ed[jE].rbetax*ed[iE].betay*
-                (ed[jE].betax*(
-			       conj(ed[iE].px[1])*ed[jE].px[3]
-			       - 
-			       ed[iE].px[1]*ed[jE].px[1]
-			       ) 
-                 + two*ed[jE].betay*ed[iE].px[1]*ed[jE].px[1]*ed[iE].py[2]*conj(ed[jE].py[2])
-		 );
-              h20200 += (1./64)*termSign*ii*ed[iE].b3L*ed[jE].b3L*
-                ed[iE].rbetax*ed[jE].rbetax*ed[iE].betay*
-                (ed[jE].betax*
-		 conj(ed[iE].px[1])*ed[jE].px[3]*ed[iE].py[2]
-                 -(ed[jE].betax-four*ed[jE].betay)*
-		 ed[iE].px[1]*ed[jE].px[1]*ed[iE].py[2]
-		 );
-              h00220 += (1./64)*termSign*ii*ed[iE].b3L*ed[jE].b3L*
-                ed[iE].rbetax*ed[jE].rbetax*ed[iE].betay*ed[jE].betay*
-		(ed[iE].px[1]*ed[iE].py[2]*conj(ed[jE].px[1]*ed[jE].py[2])
-                 + four*ed[iE].px[1]*conj(ed[jE].px[1])
-		 - conj(ed[iE].px[1]*ed[jE].py[2])*ed[jE].px[1]*ed[iE].py[2]
-		 );
-              h00310 += (1./32)*termSign*ii*ed[iE].b3L*ed[jE].b3L*
-                ed[iE].rbetax*ed[jE].rbetax*ed[iE].betay*ed[jE].betay*ed[iE].py[2]*
-                (ed[iE].px[1]*conj(ed[jE].px[1])
-		 -conj(ed[iE].px[1])*ed[jE].px[1]
-		 );
-              h00400 += (1./64)*termSign*ii*ed[iE].b3L*ed[jE].b3L*
-                ed[iE].rbetax*ed[jE].rbetax*ed[iE].betay*ed[jE].betay*
-		ed[iE].px[1]*conj(ed[jE].px[1])*ed[iE].py[2]*ed[jE].py[2];
-	    }
-	    }
-    }
-    }
-    }
+    if (!pairs) {
+      pairs = &localpairs;
+      Listb3Lref = NULL;
     }
+    sextupole_pairs(pairs, ed, NumElem, Listb3Lref, tune, Geometric2, TuneShifts);
+    h22000 += pairs->h22000;
+    h11110 += pairs->h11110;
+    h00220 += pairs->h00220;
+    h31000 += pairs->h31000;
+    h40000 += pairs->h40000;
+    h20110 += pairs->h20110;
+    h11200 += pairs->h11200;
+    h20020 += pairs->h20020;
+    h20200 += pairs->h20200;
+    h00310 += pairs->h00310;
+    h00400 += pairs->h00400;
+    d->dnux_dJx += pairs->dnux_dJx;
+    d->dnux_dJy += pairs->dnux_dJy;
+    d->dnuy_dJy += pairs->dnuy_dJy;
   }
 //	printf("d->dnux_dJx=%f, d->dnux_dJy=%f, d->dnuy_dJy=%f\n",d->dnux_dJx,d->dnux_dJy,d->dnuy_dJy);
   d->h22000[0] = std::abs<double>(h22000);
@@ -435,8 +614,7 @@ ed = (ELEMDATA*)malloc(NumElem*sizeof(ELEMDATA));
 }
 
 
-
-
+#if defined(MATLAB_MEX_FILE)
 
 void mexFunction( int nlhs, mxArray *plhs[],
                   int nrhs, const mxArray *prhs[] )
@@ -461,7 +639,7 @@ void mexFunction( int nlhs, mxArray *plhs[],
 	double tune[2];
 	int nPeriods = 1;
 	int NumElem, ncols;
-	char Geometric1, Geometric2, Chromatic1, Coupling1, TuneShifts;	/*boolean values, taken as input*/
+	char Chromatic1, Coupling1, Geometric1, Geometric2, TuneShifts;	/*boolean values, taken as input*/
 	
 	d = (DRIVING_TERMS*)malloc(sizeof(DRIVING_TERMS));
     /* check for proper number of arguments */
@@ -482,10 +660,10 @@ void mexFunction( int nlhs, mxArray *plhs[],
     Tuney = mxGetScalar(prhs[11]);
     NumElem = mxGetScalar(prhs[12]);
     //leading_order_driving_terms_only=mxGetScalar(prhs[13]);
-    Geometric1 = mxGetScalar(prhs[13]);
-    Geometric2 = mxGetScalar(prhs[14]);
-    Chromatic1 = mxGetScalar(prhs[15]);
-    Coupling1 = mxGetScalar(prhs[16]);
+    Chromatic1 = mxGetScalar(prhs[13]);
+    Coupling1 = mxGetScalar(prhs[14]);
+    Geometric1 = mxGetScalar(prhs[15]);
+    Geometric2 = mxGetScalar(prhs[16]);
     TuneShifts = mxGetScalar(prhs[17]);
     
 	tune[0]=Tunex;
@@ -512,14 +690,12 @@ void mexFunction( int nlhs, mxArray *plhs[],
     plhs[0] = mxCreateDoubleMatrix(1,(mwSize)23,mxREAL);
     plhs[1] = mxCreateDoubleMatrix(1,(mwSize)23,mxREAL);
     plhs[2] = mxCreateDoubleMatrix(1,(mwSize)3,mxREAL);
-	plhs[3] = mxCreateDoubleMatrix(1,(mwSize)15,mxREAL);
-    plhs[4] = mxCreateDoubleMatrix(1,(mwSize)15,mxREAL);
     
     /* call the computational routine */
-    computeDrivingTerms(d, NumElem,
+    computeDrivingTerms(d, NULL, NumElem,
 							s, betax, betay, phix, phiy, etax,
 							Lista2L, Listb2L, Listb3L, Listb4L, tune, 
-							Geometric1, Geometric2, Chromatic1, Coupling1, TuneShifts, nPeriods);
+							Chromatic1, Coupling1, Geometric1, Geometric2, TuneShifts, nPeriods, NULL);
 
 	outMatrixRe = mxGetDoubles(plhs[0]);
 	outMatrixIm = mxGetDoubles(plhs[1]);
@@ -664,5 +840,221 @@ void mexFunction( int nlhs, mxArray *plhs[],
 /*	outMatrix[69] = d->dnux_dJx;
 	outMatrix[70] = d->dnux_dJy;
 	outMatrix[71] = d->dnuy_dJy;*/
+	free(d);
+}
+
+#endif /*MATLAB_MEX_FILE*/
+
+#if defined(PYAT)
+
+#define MODULE_NAME rdtelegant
+#define MODULE_DESCR "Hamiltonian resonance driving terms, from elegant"
+
+static const char *term_names[] = {
+    "h21000", "h30000", "h10110", "h10020", "h10200",
+    "h11001", "h00111", "h20001", "h00201", "h10002",
+    "h10010", "h10100",
+    "h22000", "h11110", "h00220", "h31000", "h40000",
+    "h20110", "h11200", "h20020", "h20200", "h00310", "h00400"
+};
+
+static int set_term(PyObject *dict, const char *name, const double *h)
+{
+    PyObject *value = PyComplex_FromDoubles(h[1], h[2]);
+    int err;
+    if (value == NULL) return -1;
+    err = PyDict_SetItemString(dict, name, value);
+    Py_DECREF(value);
+    return err;
+}
+
+static int set_value(PyObject *dict, const char *name, double v)
+{
+    PyObject *value = PyFloat_FromDouble(v);
+    int err;
+    if (value == NULL) return -1;
+    err = PyDict_SetItemString(dict, name, value);
+    Py_DECREF(value);
+    return err;
+}
+
+static PyObject *drivingterms(PyObject *self, PyObject *args, PyObject *kwargs) {
+    static const char *kwlist[] = {"s", "betax", "betay", "etax", "phix", "phiy",
+                             "a2l", "b2l", "b3l", "b4l", "tunes",
+                             "chromatic", "coupling", "geometric1",
+                             "geometric2", "tuneshifts", "nperiods",
+                             "b3l_ref", "pairs_ref", NULL};
+    PyObject *pyin[10];
+    PyArrayObject *in[10] = {NULL};
+    PyObject *pyb3ref = Py_None, *pypairsref = Py_None;
+    PyArrayObject *b3ref = NULL, *pairsref = NULL;
+    PyObject *pypairs = NULL, *terms = NULL, *result = NULL;
+    DRIVING_TERMS *d = NULL;
+    const double *h[23];
+    double tune[2];
+    int chromatic = 1, coupling = 1, geometric1 = 1, geometric2 = 1, tuneshifts = 1;
+    long nperiods = 1;
+    npy_intp npairs = NPAIRTERMS;
+    int nelem = 0, i;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OOOOOOOOOO(dd)|pppppl$OO", (char **)kwlist,
+            &pyin[0], &pyin[1], &pyin[2], &pyin[3], &pyin[4],
+            &pyin[5], &pyin[6], &pyin[7], &pyin[8], &pyin[9], &tune[0], &tune[1],
+            &chromatic, &coupling, &geometric1, &geometric2, &tuneshifts,
+            &nperiods, &pyb3ref, &pypairsref)) {
+        return NULL;
+    }
+    if (nperiods < 1) {
+        PyErr_SetString(PyExc_ValueError, "nperiods must be positive");
+        return NULL;
+    }
+    if ((geometric2 || tuneshifts) && nperiods != 1) {
+        PyErr_SetString(PyExc_ValueError,
+            "second-order terms are not available when nperiods != 1");
+        return NULL;
+    }
+    for (i=0; i<10; i++) {
+        in[i] = (PyArrayObject *)PyArray_FROMANY(pyin[i], NPY_DOUBLE, 1, 1, NPY_ARRAY_IN_ARRAY);
+        if (in[i] == NULL) goto exit;
+        if (i == 0) nelem = (int)PyArray_DIM(in[0], 0);
+        else if (PyArray_DIM(in[i], 0) != nelem) {
+            PyErr_SetString(PyExc_ValueError, "all the element arrays must have the same length");
+            goto exit;
+        }
+    }
+    if ((pyb3ref == Py_None) != (pypairsref == Py_None)) {
+        PyErr_SetString(PyExc_ValueError, "b3l_ref and pairs_ref must be given together");
+        goto exit;
+    }
+    if (pyb3ref != Py_None) {
+        b3ref = (PyArrayObject *)PyArray_FROMANY(pyb3ref, NPY_DOUBLE, 1, 1, NPY_ARRAY_IN_ARRAY);
+        if (b3ref == NULL) goto exit;
+        pairsref = (PyArrayObject *)PyArray_FROMANY(pypairsref, NPY_DOUBLE, 1, 1, NPY_ARRAY_IN_ARRAY);
+        if (pairsref == NULL) goto exit;
+        if (PyArray_DIM(b3ref, 0) != nelem || PyArray_DIM(pairsref, 0) != NPAIRTERMS) {
+            PyErr_SetString(PyExc_ValueError, "b3l_ref or pairs_ref has a wrong length");
+            goto exit;
+        }
+    }
+
+    /* The pair sums are returned as an array of doubles */
+    pypairs = PyArray_ZEROS(1, &npairs, NPY_DOUBLE, 0);
+    if (pypairs == NULL) goto exit;
+    if (pairsref)
+        memcpy(PyArray_DATA((PyArrayObject *)pypairs), PyArray_DATA(pairsref),
+               NPAIRTERMS*sizeof(double));
+    d = (DRIVING_TERMS*)malloc(sizeof(DRIVING_TERMS));
+
+    Py_BEGIN_ALLOW_THREADS
+    computeDrivingTerms(d, (SEXTUPOLE_PAIRS *)PyArray_DATA((PyArrayObject *)pypairs), nelem,
+        (double *)PyArray_DATA(in[0]), (double *)PyArray_DATA(in[1]),
+        (double *)PyArray_DATA(in[2]), (double *)PyArray_DATA(in[4]),
+        (double *)PyArray_DATA(in[5]), (double *)PyArray_DATA(in[3]),
+        (double *)PyArray_DATA(in[6]), (double *)PyArray_DATA(in[7]),
+        (double *)PyArray_DATA(in[8]), (double *)PyArray_DATA(in[9]), tune,
+        (char)chromatic, (char)coupling, (char)geometric1, (char)geometric2,
+        (char)tuneshifts, nperiods,
+        b3ref ? (const double *)PyArray_DATA(b3ref) : NULL);
+    Py_END_ALLOW_THREADS
+
+    h[0] = d->h21000; h[1] = d->h30000; h[2] = d->h10110; h[3] = d->h10020; h[4] = d->h10200;
+    h[5] = d->h11001; h[6] = d->h00111; h[7] = d->h20001; h[8] = d->h00201; h[9] = d->h10002;
+    h[10] = d->h10010; h[11] = d->h10100;
+    h[12] = d->h22000; h[13] = d->h11110; h[14] = d->h00220; h[15] = d->h31000;
+    h[16] = d->h40000; h[17] = d->h20110; h[18] = d->h11200; h[19] = d->h20020;
+    h[20] = d->h20200; h[21] = d->h00310; h[22] = d->h00400;
+
+    /* Same selection of terms as computeRDT */
+    terms = PyDict_New();
+    if (terms == NULL) goto exit;
+    for (i=0; i<23; i++) {
+        int selected = (i<5) ? geometric1 : (i<10) ? chromatic : (i<12) ? coupling : geometric2;
+        if (selected && set_term(terms, term_names[i], h[i])) goto exit;
+    }
+    if (tuneshifts) {
+        if (set_value(terms, "dnux_dJx", d->dnux_dJx) ||
+            set_value(terms, "dnux_dJy", d->dnux_dJy) ||
+            set_value(terms, "dnuy_dJy", d->dnuy_dJy)) goto exit;
+    }
+    result = Py_BuildValue("OO", terms, pypairs);
+
+exit:
+    free(d);
+    Py_XDECREF(terms);
+    Py_XDECREF(pypairs);
+    Py_XDECREF(b3ref);
+    Py_XDECREF(pairsref);
+    for (i=0; i<10; i++) Py_XDECREF(in[i]);
+    return result;
+}
+
+static PyMethodDef AtMethods[] = {
+    {"drivingterms",
+    (PyCFunction)drivingterms, METH_VARARGS | METH_KEYWORDS,
+    PyDoc_STR(
+    "drivingterms(s, betax, betay, etax, phix, phiy, a2l, b2l, b3l, b4l, tunes,\n"
+    "             chromatic=True, coupling=True, geometric1=True,\n"
+    "             geometric2=True, tuneshifts=True, nperiods=1, *,\n"
+    "             b3l_ref=None, pairs_ref=None)\n\n"
+    "Hamiltonian resonance driving terms and tune shifts with amplitude\n\n"
+    "The element arrays describe the magnets, in order along the ring\n"
+    "starting from the observation point, as in computeRDT\n\n"
+    "Args:\n"
+    "    s:          (nelems,) positions of the magnets [m]\n"
+    "    betax:      (nelems,) horizontal beta functions [m]\n"
+    "    betay:      (nelems,) vertical beta functions [m]\n"
+    "    etax:       (nelems,) horizontal dispersion [m]\n"
+    "    phix:       (nelems,) horizontal phase advances [rad]\n"
+    "    phiy:       (nelems,) vertical phase advances [rad]\n"
+    "    a2l:        (nelems,) integrated skew quadrupole strengths\n"
+    "    b2l:        (nelems,) integrated quadrupole strengths\n"
+    "    b3l:        (nelems,) integrated sextupole strengths\n"
+    "    b4l:        (nelems,) integrated octupole strengths\n"
+    "    tunes:      (tunex, tuney) fractional tunes\n"
+    "    chromatic:  Compute the first-order chromatic terms\n"
+    "    coupling:   Compute the first-order coupling terms\n"
+    "    geometric1: Compute the first-order geometric terms\n"
+    "    geometric2: Compute the second-order geometric terms\n"
+    "    tuneshifts: Compute the tune shifts with amplitude\n"
+    "    nperiods:   Number of periods, only for first-order terms\n\n"
+    "Keyword Args:\n"
+    "    b3l_ref:    (nelems,) reference sextupole strengths\n"
+    "    pairs_ref:  Sextupole pair sums returned by a previous call with\n"
+    "                the strengths b3l_ref. If given, with the same optics\n"
+    "                and options, only the sextupoles with modified strengths\n"
+    "                are evaluated for the second-order terms\n\n"
+    "Returns:\n"
+    "    terms:      dict of the selected driving terms (complex) and tune\n"
+    "                shifts (real)\n"
+    "    pairs:      Sextupole pair sums of the second-order terms, for\n"
+    "                later incremental evaluations\n"
+	)},
+    {NULL, NULL, 0, NULL}        /* Sentinel */
+};
+
+PyMODINIT_FUNC MOD_INIT(MODULE_NAME)
+{
+
+#if PY_MAJOR_VERSION >= 3
+    static struct PyModuleDef moduledef = {
+    PyModuleDef_HEAD_INIT,
+    STR(MODULE_NAME), /* m_name */
+    PyDoc_STR(MODULE_DESCR),      /* m_doc */
+    -1,           /* m_size */
+    AtMethods,    /* m_methods */
+    NULL,         /* m_reload */
+    NULL,         /* m_traverse */
+    NULL,         /* m_clear */
+    NULL,         /* m_free */
+    };
+    PyObject *m = PyModule_Create(&moduledef);
+#else
+    PyObject *m = Py_InitModule3(STR(MODULE_NAME), AtMethods,
+        MODULE_DESCR);
+#endif
+    if (m == NULL) return MOD_ERROR_VAL;
+    import_array();
+    return MOD_SUCCESS_VAL(m);
+}
 
-}                                    
+#endif /*PYAT*/
@@ -433,47 +433,70 @@ static void FindElemB(double *orbit_in, double le, double irho, double *A, doubl
 }
 
 
-static double *diffmatrix(const atElem *ElemData, double *orb, double energy, double *bdiff)
-{
-    double Length, ba, irho, FringeInt1,  FringeInt2, FullGap, *PolynomA, *PolynomB;  
-
-	int MaxOrder, NumIntSteps;
-	double EntranceAngle, ExitAngle;
+struct diffelem {
+    int active;     /* 0 for elements without diffusion */
+    double Length, irho, EntranceAngle, ExitAngle;
+    double FringeInt1, FringeInt2, FullGap, energy;
+    double *PolynomA, *PolynomB;
     double *R1, *R2, *T1, *T2;
+    int MaxOrder, NumIntSteps;
+};
+
+static struct diffelem *diffelem_init(const atElem *ElemData, double energy, struct diffelem *p)
+/* Read the element attributes needed for the diffusion matrix */
+{
+    double ba;
 
+    p->active = 0;
     /* Required fields */
-    Length=atGetOptionalDouble(ElemData,"Length", 0.0);
+    p->Length=atGetOptionalDouble(ElemData,"Length", 0.0);
 	/* If ELEMENT has a zero length, return zeros matrix end exit */
-	if (Length == 0.0) return bdiff;
-    PolynomA=atGetOptionalDoubleArray(ElemData,"PolynomA");
-    PolynomB=atGetOptionalDoubleArray(ElemData,"PolynomB");
+	if (p->Length == 0.0) return p;
+    p->PolynomA=atGetOptionalDoubleArray(ElemData,"PolynomA");
+    p->PolynomB=atGetOptionalDoubleArray(ElemData,"PolynomB");
 	/* If the ELEMENT does not have PolynomA and PolynomB return zero matrix and  exit */
-	if (PolynomA == NULL ||  PolynomB == NULL) return bdiff;
+	if (p->PolynomA == NULL ||  p->PolynomB == NULL) return p;
 
-    MaxOrder=atGetLong(ElemData,"MaxOrder"); check_error();
-    NumIntSteps=atGetLong(ElemData,"NumIntSteps"); check_error();
+    p->MaxOrder=atGetLong(ElemData,"MaxOrder"); check_error();
+    p->NumIntSteps=atGetLong(ElemData,"NumIntSteps"); check_error();
     if (atIsNaN(energy)) {
         energy=atGetDouble(ElemData,"Energy"); check_error();
     }
+    p->energy=energy;
 
     /* Optional fields */
     ba=atGetOptionalDouble(ElemData,"BendingAngle",0.0);
-    irho = ba/Length;
-    EntranceAngle=atGetOptionalDouble(ElemData,"EntranceAngle",0.0);
-    ExitAngle=atGetOptionalDouble(ElemData,"ExitAngle",0.0);
-    FullGap=atGetOptionalDouble(ElemData,"FullGap",0); check_error();
-    FringeInt1=atGetOptionalDouble(ElemData,"FringeInt1",0); check_error();
-    FringeInt2=atGetOptionalDouble(ElemData,"FringeInt2",0); check_error();
-    R1=atGetOptionalDoubleArray(ElemData,"R1"); check_error();
-    R2=atGetOptionalDoubleArray(ElemData,"R2"); check_error();
-    T1=atGetOptionalDoubleArray(ElemData,"T1"); check_error();
-    T2=atGetOptionalDoubleArray(ElemData,"T2"); check_error();
-
-	FindElemB(orb, Length, irho, PolynomA, PolynomB, 
-            T1, T2, R1, R2,
-            EntranceAngle, 	ExitAngle,
-            FringeInt1, FringeInt2, FullGap,
-            MaxOrder, NumIntSteps, energy, bdiff);
+    p->irho = ba/p->Length;
+    p->EntranceAngle=atGetOptionalDouble(ElemData,"EntranceAngle",0.0);
+    p->ExitAngle=atGetOptionalDouble(ElemData,"ExitAngle",0.0);
+    p->FullGap=atGetOptionalDouble(ElemData,"FullGap",0); check_error();
+    p->FringeInt1=atGetOptionalDouble(ElemData,"FringeInt1",0); check_error();
+    p->FringeInt2=atGetOptionalDouble(ElemData,"FringeInt2",0); check_error();
+    p->R1=atGetOptionalDoubleArray(ElemData,"R1"); check_error();
+    p->R2=atGetOptionalDoubleArray(ElemData,"R2"); check_error();
+    p->T1=atGetOptionalDoubleArray(ElemData,"T1"); check_error();
+    p->T2=atGetOptionalDoubleArray(ElemData,"T2"); check_error();
+    p->active = 1;
+    return p;
+}
+
+static void diffelem_matrix(const struct diffelem *p, double *orb, double *bdiff)
+/* Accumulate in bdiff the diffusion matrix of the element. orb is modified */
+{
+    if (p->active)
+        FindElemB(orb, p->Length, p->irho, p->PolynomA, p->PolynomB,
+                p->T1, p->T2, p->R1, p->R2,
+                p->EntranceAngle, p->ExitAngle,
+                p->FringeInt1, p->FringeInt2, p->FullGap,
+                p->MaxOrder, p->NumIntSteps, p->energy, bdiff);
+}
+
+static double *diffmatrix(const atElem *ElemData, double *orb, double energy, double *bdiff)
+{
+    struct diffelem p;
+
+    if (!diffelem_init(ElemData, energy, &p)) return NULL;
+    diffelem_matrix(&p, orb, bdiff);
     return bdiff;
 }
 
@@ -573,6 +596,118 @@ static PyObject *compute_diffmatrix(PyObject *self, PyObject *args) {
     return pyMatrix;
 }
 
+static int is_radpass(PyObject *elem)
+{
+    PyObject *pypass = PyObject_GetAttrString(elem, "PassMethod");
+    const char *passmethod;
+    size_t len, lrad = strlen("RadPass");
+    int radpass = 0;
+    if (pypass == NULL) {
+        PyErr_Clear();
+        return 0;
+    }
+    passmethod = PyUnicode_AsUTF8(pypass);
+    if (passmethod) {
+        len = strlen(passmethod);
+        radpass = (len >= lrad) && (strcmp(passmethod+len-lrad, "RadPass") == 0);
+    }
+    else PyErr_Clear();
+    Py_DECREF(pypass);
+    return radpass;
+}
+
+static PyObject *cumul_diffmatrix(PyObject *self, PyObject *args) {
+    PyObject *pyLine, *pyOrbits, *pyM66, *pyCumul = NULL;
+    PyArrayObject *orbits = NULL, *m66 = NULL;
+    struct diffelem *elems = NULL;
+    double *bdiff = NULL, *cumul;
+    const double *orb, *m;
+    double energy;
+    npy_intp outdims[3];
+    long nelems, k;
+    int i, j, l;
+
+    if (!PyArg_ParseTuple(args, "O!OOd", &PyList_Type, &pyLine, &pyOrbits, &pyM66, &energy)) {
+        return NULL;
+    }
+    nelems = PyList_GET_SIZE(pyLine);
+    orbits = (PyArrayObject *)PyArray_FROMANY(pyOrbits, NPY_DOUBLE, 2, 2, NPY_ARRAY_IN_ARRAY);
+    if (orbits == NULL) goto exit;
+    m66 = (PyArrayObject *)PyArray_FROMANY(pyM66, NPY_DOUBLE, 3, 3, NPY_ARRAY_IN_ARRAY);
+    if (m66 == NULL) goto exit;
+    if (PyArray_DIM(orbits,0) < nelems || PyArray_DIM(orbits,1) != 6) {
+        PyErr_SetString(PyExc_ValueError, "Orbits is not a (nelems, 6) array");
+        goto exit;
+    }
+    if (PyArray_DIM(m66,0) != nelems || PyArray_DIM(m66,1) != 6 || PyArray_DIM(m66,2) != 6) {
+        PyErr_SetString(PyExc_ValueError, "M66 is not a (nelems, 6, 6) array");
+        goto exit;
+    }
+    orb = PyArray_DATA(orbits);
+    m = PyArray_DATA(m66);
+
+    /* Element attributes, with the GIL */
+    elems = (struct diffelem *)malloc(nelems*sizeof(struct diffelem));
+    for (k=0; k<nelems; k++) {
+        PyObject *elem = PyList_GET_ITEM(pyLine, k);
+        elems[k].active = 0;
+        if (is_radpass(elem) && !diffelem_init(elem, energy, elems+k)) goto exit;
+    }
+
+    outdims[0] = nelems+1;
+    outdims[1] = 6;
+    outdims[2] = 6;
+    pyCumul = PyArray_ZEROS(3, outdims, NPY_DOUBLE, 0);
+    if (pyCumul == NULL) goto exit;
+    cumul = PyArray_DATA((PyArrayObject *)pyCumul);
+    bdiff = (double *)calloc(36*nelems, sizeof(double));
+
+    Py_BEGIN_ALLOW_THREADS
+    /* Diffusion matrices of the elements, in parallel */
+    #pragma omp parallel for schedule(dynamic)
+    for (k=0; k<nelems; k++) {
+        double orbk[6];
+        int c;
+        for (c=0; c<6; c++) orbk[c] = orb[6*k+c];
+        diffelem_matrix(elems+k, orbk, bdiff+36*k);
+    }
+    /* Cumulated matrices: B[k+1] = M[k].B[k].M[k]' + b[k]. M and B are
+       row-major, b is column-major */
+    for (k=0; k<nelems; k++) {
+        const double *mk = m+36*k;
+        const double *bk = cumul+36*k;
+        const double *dk = bdiff+36*k;
+        double *bnext = cumul+36*(k+1);
+        double mb[36];
+        for (i=0; i<6; i++) {
+            for (j=0; j<6; j++) {
+                double v = 0.0;
+                for (l=0; l<6; l++) v += mk[6*i+l]*bk[6*l+j];
+                mb[6*i+j] = v;
+            }
+        }
+        for (i=0; i<6; i++) {
+            for (j=0; j<6; j++) {
+                double v = 0.0;
+                for (l=0; l<6; l++) v += mb[6*i+l]*mk[6*j+l];
+                bnext[6*i+j] = v + dk[i+6*j];
+            }
+        }
+    }
+    Py_END_ALLOW_THREADS
+
+exit:
+    free(bdiff);
+    free(elems);
+    Py_XDECREF(orbits);
+    Py_XDECREF(m66);
+    if (PyErr_Occurred()) {
+        Py_XDECREF(pyCumul);
+        return NULL;
+    }
+    return pyCumul;
+}
+
 static PyMethodDef AtMethods[] = {
     {"find_mpole_raddiff_matrix",
     (PyCFunction)compute_diffmatrix, METH_VARARGS,
@@ -591,6 +726,23 @@ static PyMethodDef AtMethods[] = {
     "    .. [2] Ohmi, Kirata, Oide, *From the beam-envelope matrix to synchrotron\n"
     "       radiation integrals*, Phys.Rev.E  Vol.49 p.751 (1994)\n"
 	)},
+    {"find_cumul_raddiff_matrices",
+    (PyCFunction)cumul_diffmatrix, METH_VARARGS,
+    PyDoc_STR(
+    "find_cumul_raddiff_matrices(line, orbits, m66, energy)\n\n"
+    "Computes the cumulative radiation diffusion matrices along a line\n\n"
+    "The diffusion matrices of the elements whose PassMethod ends with\n"
+    "'RadPass' are computed in parallel, then accumulated with\n"
+    "B[k+1] = M[k].B[k].M[k]' + b[k]\n\n"
+    "Args:\n"
+    "    line:       list of elements\n"
+    "    orbits:     (nelems, 6) orbit at the entrance of each element\n"
+    "    m66:        (nelems, 6, 6) transfer matrices of the elements\n"
+    "    energy:     particle energy\n\n"
+    "Returns:\n"
+    "    cumul:      (nelems+1, 6, 6) cumulative diffusion matrices at\n"
+    "                the entrance of each element and at the end of the line\n"
+	)},
     {NULL, NULL, 0, NULL}        /* Sentinel */
 };
 
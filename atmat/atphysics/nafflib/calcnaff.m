@@ -28,9 +28,8 @@ function [frequency,amplitude,phase] = calcnaff(Y, Yp, varargin)
 %
 %  NOTES
 %  1. Mimimum number of turns is 64 (66)
-%  2. Number of turn has to be a multiple of 6 for internal optimization
-%  reason and just above a power of 2. Example 1026 is divived by 6 and
-%  above 1024 = pow2(10)
+%  2. Any number of turns may be used: the analysis uses the largest
+%  number of turns of the form 6*k+1, so that at most 5 turns are ignored
 %
 %  Examples
 %  NT = 9996; % divided by 6
@@ -25,9 +25,7 @@
 #define FUNCINLINEEXTERN_MUSTBEINLIB
 #include "modnaff.h"
 #include "complexe.h"
-
-/*variable globale de naf */
-t_naf g_NAFVariable;
+#include "atfft.c"
 
 /*legere difference entre NAF_USE_OPTIMIZE=0 et NAF_USE_OPTIMIZE=1*/
 /* car division differente dans naf_gramsc */
@@ -169,8 +167,6 @@ t_naf g_NAFVariable;
 !  ZALP(NBTERM,NBTERM) : TABLEAU DE CHANGEMENT DE BASE
 !
 !-----------------------------------------------------------------------*/
-static double AF,BF;
-static double *TWIN=NULL;
 
 /*!-----------------------------------------------------------------------	  
 ! VARIABLES A INITIALISER PAR L'UTILISATEUR AVANT DE LANCER INITNAF
@@ -189,23 +185,23 @@ static double *TWIN=NULL;
           PUBLIC :: INITNAF,CLEANNAF,MFTNAF,PRTABS,SMOY,TESSOL
           PUBLIC :: INIFRE,CORRECTION*/
 /*v0.96 M. GASTINEAU 06/10/98 : ajout */
-void naf_initnaf_notab();
-void naf_cleannaf_notab();
+void naf_initnaf_notab(t_naf *naf);
+void naf_cleannaf_notab(t_naf *naf);
 /*v0.96 M. GASTINEAU 06/10/98 : fin ajout */
-void naf_initnaf();
-void naf_inifre();
-void naf_cleannaf();
-BOOL naf_mftnaf(int NBTERM, double EPS);
-void naf_prtabs(int KTABS, t_complexe *ZTABS, int IPAS);
-void naf_smoy(t_complexe *ZM);
-BOOL naf_tessol(double EPS, double *TFSR, t_complexe *ZAMPR);
-void naf_correction(double *FREQ);
+void naf_initnaf(t_naf *naf);
+void naf_inifre(t_naf *naf);
+void naf_cleannaf(t_naf *naf);
+BOOL naf_mftnaf(t_naf *naf, int NBTERM, double EPS);
+void naf_prtabs(t_naf *naf, int KTABS, t_complexe *ZTABS, int IPAS);
+void naf_smoy(t_naf *naf, t_complexe *ZM);
+BOOL naf_tessol(t_naf *naf, double EPS, double *TFSR, t_complexe *ZAMPR);
+void naf_correction(t_naf *naf, double *FREQ);
 void naf_four1(double *DATA /*tableau commencant a l'indice 1 */,
                int NN, int ISIGN);
 void naf_puiss2(int NT, int *N2);
 /*v0.96 M. GASTINEAU 18/12/98 : modification du prototype */
 /*void naf_iniwin();*//*remplacee par: */
-void naf_iniwin(double *p_pardTWIN);
+void naf_iniwin(t_naf *naf, double *p_pardTWIN);
 /*v0.96 M. GASTINEAU 18/12/98 : fin modification */
 void delete_list_fenetre_naf(t_list_fenetre_naf *p_pListFenNaf);
 t_list_fenetre_naf *concat_list_fenetre_naf(t_list_fenetre_naf *p_pListFenHead,
@@ -222,33 +218,39 @@ t_list_fenetre_naf *cree_list_fenetre_naf(const double p_dFreqMin,
           PRIVATE :: MODFRE, GRAMSC,PROSCA,SECANTES,MAXIQUA
           PRIVATE :: FUNC,FUNCP,PRODER,ZTDER,FREFIN,PROFRE
           PRIVATE :: ZTPOW2,ZARDYD,PROSCAA,ZTPOW2A,MODTAB*/
-static void naf_fretes(double FR, int *IFLAG, double TOL, int * NUMFR);
+static void naf_fretes(t_naf *naf, double FR, int *IFLAG, double TOL, int * NUMFR);
 static void naf_ztpow(int N, int N1, t_complexe *ZT, t_complexe ZA, t_complexe ZAST);
 /* v0.96 M. GASTINEAU 12/01/99 : optimisation */
 #if NAF_USE_OPTIMIZE==0
 static void naf_maxx(int N, double *T, int *INDX);
-static void naf_fftmax(double *FR);
+static void naf_fftmax(t_naf *naf, double *FR);
 #else /*remplacee par:*/
 static int naf_maxx(int N, double *T);
-static double naf_fftmax(int p_iFrMin, int p_iFrMax, double FREFO2, int KTABS2); 
+static double naf_fftmax(t_naf *naf, int p_iFrMin, int p_iFrMax, double FREFO2, int KTABS2); 
 #endif /*NAF_USE_OPTIMIZE*/
 /* v0.96 M. GASTINEAU 12/01/99 : fin optimisation */
 static void naf_modtab(int N, double *T);
-static void naf_modfre(int NUMFR, double *A, double *B);
-static BOOL naf_gramsc(double FS, double A, double B);
-static void naf_prosca(double F1, double F2, t_complexe* ZP);
-static void naf_proder(double FS, double *DER, double *A, double *B,double *RM);
-static double naf_funcp(double X);
+static void naf_modfre(t_naf *naf, int NUMFR, double *A, double *B);
+static BOOL naf_gramsc(t_naf *naf, double FS, double A, double B);
+static void naf_prosca(t_naf *naf, double F1, double F2, t_complexe* ZP);
+static void naf_proder(t_naf *naf, double FS, double *DER, double *A, double *B,double *RM);
+static double naf_funcp(t_naf *naf, double X);
 static void naf_ztder(int N, int N1, t_complexe *ZTF, t_complexe *ZTA, double *TW, t_complexe ZA, t_complexe ZAST, double T0, double XH);
-static void naf_secantes(double X, double PASS, double EPS, double *XM, int IPRT, FILE *NFPRT);
-static double naf_func(double X);
-static void naf_maxiqua(double X, double PASS, double EPS, double *XM, double *YM, int IPRT, FILE *NFPRT);
-static void naf_frefin(double *FR, double *A, double *B, double *RM, const double RPAS0, const double RPREC);
+static void naf_secantes(t_naf *naf, double X, double PASS, double EPS, double *XM, int IPRT, FILE *NFPRT);
+static double naf_func(t_naf *naf, double X);
+static void naf_maxiqua(t_naf *naf, double X, double PASS, double EPS, double *XM, double *YM, int IPRT, FILE *NFPRT);
+static void naf_frefin(t_naf *naf, double *FR, double *A, double *B, double *RM, const double RPAS0, const double RPREC);
 static void naf_ztpow2(int N, int N1, t_complexe *ZTF, t_complexe *ZTA, double *TW, t_complexe ZA, t_complexe ZAST);
-static BOOL naf_profre(double FS, double *A, double *B, double *RMD);
-static BOOL naf_proscaa(double F1, double F2, t_complexe *ZP);
+static BOOL naf_profre(t_naf *naf, double FS, double *A, double *B, double *RMD);
+static BOOL naf_proscaa(t_naf *naf, double F1, double F2, t_complexe *ZP);
 static BOOL naf_zardyd(t_complexe *ZT, int N, double H, t_complexe *ZOM);
 static void naf_ztpow2a(int N, int N1, t_complexe *ZTF, double *TW, t_complexe ZA, t_complexe ZAST);
+static void naf_initwork(t_naf *naf);
+static void naf_cleanwork(t_naf *naf);
+static void naf_fft(t_naf *naf, double *RE, double *IM);
+static void naf_hardywin(t_naf *naf);
+static BOOL naf_wprod(t_naf *naf, const t_complexe *ZTA, t_complexe ZA, t_complexe ZAST,
+                      t_complexe *ZP, t_complexe *ZDER);
           
 /*!------------------------------------------------------------------------          
           CONTAINS*/
@@ -268,38 +270,181 @@ static void naf_ztpow2a(int N, int N1, t_complexe *ZTF, double *TW, t_complexe Z
 !  - alloue les tableaux dynamiques TFS,ZAMP,ZALP,ZTABS,TWIN
 !  - appelle INIWIN
 !-----------------------------------------------------------------------*/
-void naf_initnaf()
+/*-----------------------------------------------------------------------*/
+/* Work arrays of naf_fftmax, naf_modfre, naf_gramsc, naf_profre,        */
+/* naf_proder and naf_proscaa: they are allocated once with the context  */
+/* and reused by all the analyses done with it.                          */
+/*-----------------------------------------------------------------------*/
+static void naf_initwork(t_naf *naf)
+{
+      /* the FFT of naf_fftmax uses all the KTABS+1 samples */
+      naf->m_iKTABS2 = naf->KTABS+1;
+      SYSCHECKMALLOCSIZE(naf->m_pdWorkTAB, double, 2*naf->m_iKTABS2);
+      SYSCHECKMALLOCSIZE(naf->m_pdWorkRTAB, double, naf->m_iKTABS2);
+      if (atfft_size(naf->m_iKTABS2) == (unsigned int)naf->m_iKTABS2)
+      {
+       naf->m_pdWorkFFT = NULL;
+      }
+      else
+      {
+       SYSCHECKMALLOCSIZE(naf->m_pdWorkFFT, double, atfft_bluestein_size(naf->m_iKTABS2));
+       atfft_bluestein_init(naf->m_pdWorkFFT, naf->m_iKTABS2);
+      }
+      SYSCHECKMALLOCSIZE(naf->m_pdWorkTWH, double, naf->KTABS+1);
+      naf_hardywin(naf);
+      SYSCHECKMALLOCSIZE(naf->m_pzWorkZT, t_complexe, naf->KTABS+1);
+#if NAF_USE_OPTIMIZE==0
+      SYSCHECKMALLOCSIZE(naf->m_pzWorkZTF, t_complexe, naf->KTABS+1);
+#else
+      naf->m_pzWorkZTF = NULL;
+#endif /*NAF_USE_OPTIMIZE==0*/
+      SYSCHECKMALLOCSIZE(naf->m_pzWorkZTEE, t_complexe, naf->NTERM+1);
+}
+
+static void naf_cleanwork(t_naf *naf)
+{
+      SYSFREE(naf->m_pdWorkTAB);
+      SYSFREE(naf->m_pdWorkRTAB);
+      SYSFREE(naf->m_pdWorkFFT);
+      SYSFREE(naf->m_pdWorkTWH);
+      SYSFREE(naf->m_pzWorkZT);
+      SYSFREE(naf->m_pzWorkZTF);
+      SYSFREE(naf->m_pzWorkZTEE);
+}
+
+static void naf_fft(t_naf *naf, double *RE, double *IM)
+{
+/* Direct transform, exp(-2*i*pi*j*k/n), of the m_iKTABS2 samples of RE+i*IM */
+      if (naf->m_pdWorkFFT==NULL)
+      {
+       atfft(RE, IM, naf->m_iKTABS2, 0);
+      }
+      else
+      {
+       atfft_bluestein(RE, IM, naf->m_iKTABS2, 0, naf->m_pdWorkFFT);
+      }
+}
+
+static void naf_hardywin(t_naf *naf)
+{
+/* m_pdWorkTWH(I) = TWIN(I) multiplied by the weight of the sample I in the
+   Hardy integration on [0,KTABS] (naf_zardyd), including the step H=1/KTABS */
+      static const double HARDY[6]={82.E0,216.E0,27.E0,272.E0,27.E0,216.E0};
+      const double H=6.E0/(840.E0*naf->KTABS);
+      int I;
+      for(I=0; I<=naf->KTABS; I++)
+      {
+         naf->m_pdWorkTWH[I]=naf->TWIN[I]*HARDY[I%6]*H;
+      }
+      naf->m_pdWorkTWH[0]=naf->TWIN[0]*41.E0*H;
+      naf->m_pdWorkTWH[naf->KTABS]=naf->TWIN[naf->KTABS]*41.E0*H;
+}
+
+#define NAF_NVECT 64
+static BOOL naf_wprod(t_naf *naf, const t_complexe *ZTA, t_complexe ZA, t_complexe ZAST,
+                      t_complexe *ZP, t_complexe *ZDER)
+{
+/*-----------------------------------------------------------------------
+!     WPROD     INTEGRALE PAR LA METHODE DE HARDY DE
+!                  ZTA(I)*TWIN(I)*ZAST*ZA**(I+1), I=0..KTABS
+!               SOIT ZTPOW2 SUIVI DE ZARDYD, EN UNE SEULE PASSE ET SANS
+!               TABLEAU DE TRAVAIL. ZTA=NULL EQUIVAUT A ZTA(I)=1 (ZTPOW2A).
+!     ZDER      SI NON NUL, RECOIT L'INTEGRALE DE LA MEME FONCTION
+!               MULTIPLIEE PAR (T0+I*XH) (ZTDER)
+!               Les puissances de ZA sont calculees par blocs de NAF_NVECT
+!               comme dans ZTPOW2 et la boucle interne est vectorisee.
+!-----------------------------------------------------------------------*/
+      double ZTR[NAF_NVECT], ZTI[NAF_NVECT];
+      const double *TWH=naf->m_pdWorkTWH;
+      const double *pdZTA=(const double *)ZTA;
+      const int N=naf->KTABS+1;
+      double ZPR=0.E0, ZPI=0.E0, DR=0.E0, DI=0.E0;
+      t_complexe ZT,ZT1,ZINC;
+      int I,INC;
+
+      if (naf->KTABS%6!=0)
+      {
+         Myyerror("naf_wprod - N N'EST PAS UN MULTIPLE DE 6\n");
+         return FALSE;
+      }
+      /* ZT(I) = ZAST*ZA**(I+1) */
+      ZT=i_compl_mul(ZAST,ZA);
+      for(I=0; I<NAF_NVECT; I++)
+      {
+         ZTR[I]=ZT.reel;
+         ZTI[I]=ZT.imag;
+         if (I<NAF_NVECT-1) ZT=i_compl_mul(ZT,ZA);
+      }
+      ZT1=i_compl_div(ZT,ZAST); /*ZT1 = ZT(N1-1)/ZAST*/
+      i_compl_cmplx(&ZINC,1.E0,0.E0);
+      for(INC=0; INC<N; INC+=NAF_NVECT)
+      {
+         const int NX=(N-INC<NAF_NVECT) ? N-INC : NAF_NVECT;
+         const double *TW=TWH+INC;
+         const double *ZX=pdZTA+2*INC;
+         double SR=0.E0, SI=0.E0, TR=0.E0, TI=0.E0, T;
+         #pragma omp simd reduction(+:SR,SI,TR,TI)
+         for(I=0; I<NX; I++)
+         {
+            double XR=(pdZTA!=NULL) ? TW[I]*ZX[2*I] : TW[I];
+            double XI=(pdZTA!=NULL) ? TW[I]*ZX[2*I+1] : 0.E0;
+            double FR=XR*ZTR[I]-XI*ZTI[I];
+            double FI=XR*ZTI[I]+XI*ZTR[I];
+            SR+=FR;
+            SI+=FI;
+            TR+=I*FR;
+            TI+=I*FI;
+         }
+         ZPR+=ZINC.reel*SR-ZINC.imag*SI;
+         ZPI+=ZINC.reel*SI+ZINC.imag*SR;
+         /* (T0+(INC+I)*XH) = (T0+INC*XH) + I*XH */
+         T=naf->T0+INC*naf->XH;
+         TR=T*SR+naf->XH*TR;
+         TI=T*SI+naf->XH*TI;
+         DR+=ZINC.reel*TR-ZINC.imag*TI;
+         DI+=ZINC.reel*TI+ZINC.imag*TR;
+         i_compl_pmul(&ZINC,&ZT1); /*ZINC = ZINC*ZT1*/
+      }
+      i_compl_cmplx(ZP,ZPR,ZPI);
+      if (ZDER!=NULL) i_compl_cmplx(ZDER,DR,DI);
+      return TRUE;
+}
+#undef NAF_NVECT
+
+void naf_initnaf(t_naf *naf)
 {  
 /*!----------------- PREMIERES INITIALISATIONS*/
-      g_NAFVariable.EPSM = DBL_EPSILON;
+      naf->EPSM = DBL_EPSILON;
       /*PI = ATAN2(1.D0,0.D0)*2*/
-      g_NAFVariable.UNIANG = g_NAFVariable.DTOUR/(2*M_PI) ;
-      g_NAFVariable.FREFON = g_NAFVariable.DTOUR/(g_NAFVariable.KTABS*g_NAFVariable.XH)	;      
-      SYSCHECKMALLOCSIZE(g_NAFVariable.TFS, double, g_NAFVariable.NTERM+1);/*allocate(TFS(1:NTERM),stat = NERROR)*/
-      SYSCHECKMALLOCSIZE(g_NAFVariable.ZAMP, t_complexe, g_NAFVariable.NTERM+1); /*allocate(ZAMP(1:NTERM),stat = NERROR)*/
-      DIM2(g_NAFVariable.ZALP, (g_NAFVariable.NTERM+1), (g_NAFVariable.NTERM+1), t_complexe,"ZALP"); /*allocate(ZALP(1:NTERM,1:NTERM),stat = NERROR)*/
-      SYSCHECKMALLOCSIZE(g_NAFVariable.ZTABS, t_complexe, g_NAFVariable.KTABS+1);/* allocate(ZTABS(0:KTABS),stat = NERROR)*/
-      SYSCHECKMALLOCSIZE(TWIN, double, g_NAFVariable.KTABS+1); /*allocate(TWIN(0:KTABS),stat = NERROR)*/
+      naf->UNIANG = naf->DTOUR/(2*M_PI) ;
+      naf->FREFON = naf->DTOUR/(naf->KTABS*naf->XH)	;      
+      SYSCHECKMALLOCSIZE(naf->TFS, double, naf->NTERM+1);/*allocate(TFS(1:NTERM),stat = NERROR)*/
+      SYSCHECKMALLOCSIZE(naf->ZAMP, t_complexe, naf->NTERM+1); /*allocate(ZAMP(1:NTERM),stat = NERROR)*/
+      DIM2(naf->ZALP, (naf->NTERM+1), (naf->NTERM+1), t_complexe,"ZALP"); /*allocate(ZALP(1:NTERM,1:NTERM),stat = NERROR)*/
+      SYSCHECKMALLOCSIZE(naf->ZTABS, t_complexe, naf->KTABS+1);/* allocate(ZTABS(0:KTABS),stat = NERROR)*/
+      SYSCHECKMALLOCSIZE(naf->TWIN, double, naf->KTABS+1); /*allocate(TWIN(0:KTABS),stat = NERROR)*/
       /*v0.96 M. GASTINEAU 18/12/98 : modification du prototype */
-      /*naf_iniwin();  */ naf_iniwin(TWIN);     
+      /*naf_iniwin();  */ naf_iniwin(naf, naf->TWIN);     
+      naf_initwork(naf);
 }/*      end SUBROUTINE INITNAF*/
 /*!-----------------------------------------------------------------------
       subroutine CLEANNAF*/
 /* v0.96 M. GASTINEAU 06/01/99 : ajout de la liberation de la liste des fenetres */
-void naf_cleannaf()
+void naf_cleannaf(t_naf *naf)
 {
 /*!-----------------------------------------------------------------------
 !     desalloue les tableaux dynamiques
 !-----------------------------------------------------------------------*/
  
-      SYSFREE(g_NAFVariable.TFS);
-      SYSFREE(g_NAFVariable.ZAMP);
-      HFREE2(g_NAFVariable.ZALP);
-      SYSFREE(g_NAFVariable.ZTABS);
-      SYSFREE(TWIN);
+      SYSFREE(naf->TFS);
+      SYSFREE(naf->ZAMP);
+      HFREE2(naf->ZALP);
+      SYSFREE(naf->ZTABS);
+      SYSFREE(naf->TWIN);
+      naf_cleanwork(naf);
       /* v0.96 M. GASTINEAU 06/01/99 : ajout */
-      delete_list_fenetre_naf(g_NAFVariable.m_pListFen);
-      g_NAFVariable.m_pListFen =NULL;
+      delete_list_fenetre_naf(naf->m_pListFen);
+      naf->m_pListFen =NULL;
       /* v0.96 M. GASTINEAU 06/01/99 : fin ajout */
 }/*      end  subroutine CLEANNAF  */
       
@@ -308,16 +453,17 @@ void naf_cleannaf()
 /*n'alloue pas de tableau pour ZTABS, TFS et ZAMP.                       */
 /*-----------------------------------------------------------------------*/
 /*v0.96 M. GASTINEAU 06/10/98 : ajout */
-void naf_initnaf_notab()
+void naf_initnaf_notab(t_naf *naf)
 {  
 /*!----------------- PREMIERES INITIALISATIONS*/
-      g_NAFVariable.EPSM = DBL_EPSILON;
-      g_NAFVariable.UNIANG = g_NAFVariable.DTOUR/(2*M_PI) ;
-      g_NAFVariable.FREFON = g_NAFVariable.DTOUR/(g_NAFVariable.KTABS*g_NAFVariable.XH)	;      
-      DIM2(g_NAFVariable.ZALP, (g_NAFVariable.NTERM+1), (g_NAFVariable.NTERM+1), t_complexe,"ZALP"); /*allocate(ZALP(1:NTERM,1:NTERM),stat = NERROR)*/
-      SYSCHECKMALLOCSIZE(TWIN, double, g_NAFVariable.KTABS+1); /*allocate(TWIN(0:KTABS),stat = NERROR)*/
+      naf->EPSM = DBL_EPSILON;
+      naf->UNIANG = naf->DTOUR/(2*M_PI) ;
+      naf->FREFON = naf->DTOUR/(naf->KTABS*naf->XH)	;      
+      DIM2(naf->ZALP, (naf->NTERM+1), (naf->NTERM+1), t_complexe,"ZALP"); /*allocate(ZALP(1:NTERM,1:NTERM),stat = NERROR)*/
+      SYSCHECKMALLOCSIZE(naf->TWIN, double, naf->KTABS+1); /*allocate(TWIN(0:KTABS),stat = NERROR)*/
       /*v0.96 M. GASTINEAU 18/12/98 : modification du prototype */
-      /*naf_iniwin();*/ naf_iniwin(TWIN);    
+      /*naf_iniwin();*/ naf_iniwin(naf, naf->TWIN);    
+      naf_initwork(naf);
 }/*      end SUBROUTINE naf_initnaf_notab*/
 
 /*-----------------------------------------------------------------------*/
@@ -326,17 +472,18 @@ void naf_initnaf_notab()
 /*-----------------------------------------------------------------------*/
 /*v0.96 M. GASTINEAU 06/10/98 : ajout */
 /* v0.96 M. GASTINEAU 06/01/99 : ajout de la liberation de la liste des fenetres */
-void naf_cleannaf_notab()
+void naf_cleannaf_notab(t_naf *naf)
 {
 /*!-----------------------------------------------------------------------
 !     desalloue les tableaux dynamiques
 !-----------------------------------------------------------------------*/
  
-      HFREE2(g_NAFVariable.ZALP);
-      SYSFREE(TWIN);
+      HFREE2(naf->ZALP);
+      SYSFREE(naf->TWIN);
+      naf_cleanwork(naf);
       /* v0.96 M. GASTINEAU 06/01/99 : ajout */
-      delete_list_fenetre_naf(g_NAFVariable.m_pListFen);
-      g_NAFVariable.m_pListFen =NULL;
+      delete_list_fenetre_naf(naf->m_pListFen);
+      naf->m_pListFen =NULL;
       /* v0.96 M. GASTINEAU 06/01/99 : fin ajout */
 }/*      end  subroutine naf_initnaf_notab  */
 
@@ -344,12 +491,12 @@ void naf_cleannaf_notab()
 /*!-----------------------------------------------------------------------
       SUBROUTINE MFTNAF(NBTERM,EPS)*/
 /*v0.97 M. GASTINEAU 26/05/99 : correction bug 0.97/99/05/26/A  pour pas<0 (XH<0) */
-BOOL naf_mftnaf(int NBTERM, double EPS)
+BOOL naf_mftnaf(t_naf *naf, int NBTERM, double EPS)
 {
 /*!-----------------------------------------------------------------------
 !     MFTNAF
 !                CALCULE UNE APPROXIMATION QUASI PERIODIQUE
-!                DE LA FONCTION TABULEE DANS g_NAFVariable.ZTABS(0:KTABS)
+!                DE LA FONCTION TABULEE DANS naf->ZTABS(0:KTABS)
 !
 !     NBTERM               : NOMBRE DE TERMES RECHERCHES (<= NTERM)
 !
@@ -378,21 +525,22 @@ BOOL naf_mftnaf(int NBTERM, double EPS)
 #endif /*NAF_USE_OPTIMIZE*/
 /*v0.96 M. GASTINEAU 14/01/99 : fin ajout*/
       
-      if (NBTERM >g_NAFVariable.NTERM)
+      if (NBTERM >naf->NTERM)
       {
        Myyerror("Nbre de termes cherches trop grand");
        return FALSE;
       }
       TOL = 1.E-4;
-      STAREP=fabs(g_NAFVariable.FREFON)/3;
-      naf_inifre();
+      STAREP=fabs(naf->FREFON)/3;
+      naf_inifre(naf);
 /*v0.96 M. GASTINEAU 14/01/99 : ajout support des fenetres*/
 #if NAF_USE_OPTIMIZE>0
-     naf_puiss2(g_NAFVariable.KTABS+1,&KTABS2);
-     FREFO2=(g_NAFVariable.FREFON*g_NAFVariable.KTABS)/KTABS2;
+     /*naf_puiss2(naf->KTABS+1,&KTABS2);*/ /*remplacee par:*/
+     KTABS2=naf->m_iKTABS2;
+     FREFO2=(naf->FREFON*naf->KTABS)/KTABS2;
      do
      {
-      if (g_NAFVariable.m_pListFen==NULL)
+      if (naf->m_pListFen==NULL)
       {/*pas de fenetre => on recherche dans toutes les frequences */
        iFrMin=KTABS2;
        iFrMax=KTABS2;
@@ -400,9 +548,9 @@ BOOL naf_mftnaf(int NBTERM, double EPS)
       else
       {
        const int iMaxValue=KTABS2/2-1;
-       NBTERM=g_NAFVariable.m_pListFen->iNbTerme;
-       iFrMin=g_NAFVariable.m_pListFen->dFreqMin/FREFO2;
-       iFrMax=g_NAFVariable.m_pListFen->dFreqMax/FREFO2;
+       NBTERM=naf->m_pListFen->iNbTerme;
+       iFrMin=naf->m_pListFen->dFreqMin/FREFO2;
+       iFrMax=naf->m_pListFen->dFreqMax/FREFO2;
        /*v0.97 M. GASTINEAU 26/05/99 : ajout - correction bug (cas pas <0) */
        if (iFrMin>iFrMax) 
        {/*swap*/
@@ -426,37 +574,37 @@ BOOL naf_mftnaf(int NBTERM, double EPS)
       {
 /*v0.96 M. GASTINEAU 14/01/99 : modification support des fenetres*/
 #if NAF_USE_OPTIMIZE==0
-         naf_fftmax(&FR);
+         naf_fftmax(naf, &FR);
 #else /*remplacee par:*/
-         FR=naf_fftmax(iFrMin,iFrMax,FREFO2,KTABS2);
+         FR=naf_fftmax(naf, iFrMin,iFrMax,FREFO2,KTABS2);
 #endif /*NAF_USE_OPTIMIZE*/
 /*v0.96 M. GASTINEAU 14/01/99 : fin modification*/
-         naf_frefin(&FR,&A,&B,&RM,STAREP,EPS);
-         naf_fretes(FR,&IFLAG,TOL,&NUMFR);
+         naf_frefin(naf, &FR,&A,&B,&RM,STAREP,EPS);
+         naf_fretes(naf, FR,&IFLAG,TOL,&NUMFR);
          if (IFLAG == 0) break; /*GOTO 999*/
          if (IFLAG == 1)
          {
-            if(naf_gramsc(FR,A,B)==FALSE)
+            if(naf_gramsc(naf, FR,A,B)==FALSE)
             {
              return FALSE;
             }
-            g_NAFVariable.NFS++; /*g_NAFVariable.NFS=g_NAFVariable.NFS+1;*/
+            naf->NFS++; /*naf->NFS=naf->NFS+1;*/
          }
          if (IFLAG==-1)
          {
-          naf_modfre(NUMFR,&A,&B);
+          naf_modfre(naf, NUMFR,&A,&B);
          }
       }
 /*v0.96 M. GASTINEAU 14/01/99 : ajout - support des fenetres*/
 #if NAF_USE_OPTIMIZE>0
       /*passage a la fenetre suivante */
-      if (g_NAFVariable.m_pListFen!=NULL)
+      if (naf->m_pListFen!=NULL)
       {
-       t_list_fenetre_naf *pListTemp=g_NAFVariable.m_pListFen;
-       g_NAFVariable.m_pListFen=pListTemp->suivant;
+       t_list_fenetre_naf *pListTemp=naf->m_pListFen;
+       naf->m_pListFen=pListTemp->suivant;
        SYSFREE(pListTemp);
       }
-     } while (g_NAFVariable.m_pListFen!=NULL);
+     } while (naf->m_pListFen!=NULL);
 #endif /*NAF_USE_OPTIMIZE*/
 /*v0.96 M. GASTINEAU 14/01/99 : fin ajout*/
 
@@ -464,29 +612,29 @@ BOOL naf_mftnaf(int NBTERM, double EPS)
  return TRUE;
 } /*      END SUBROUTINE MFTNAF */
 /*!
-      SUBROUTINE PRTABS(KTABS,g_NAFVariable.ZTABS,IPAS)*/
-void naf_prtabs(int KTABS, t_complexe *ZTABS, int IPAS)
+      SUBROUTINE PRTABS(KTABS,naf->ZTABS,IPAS)*/
+void naf_prtabs(t_naf *naf, int KTABS, t_complexe *ZTABS, int IPAS)
 {
 /*
 !-----------------------------------------------------------------------
-!     IMPRESSION DE g_NAFVariable.ZTABS
+!     IMPRESSION DE naf->ZTABS
 !-----------------------------------------------------------------------
   
       IMPLICIT NONE
-! (KTABS,g_NAFVariable.ZTABS,IPAS)
+! (KTABS,naf->ZTABS,IPAS)
       integer :: KTABS,IPAS
-      complex (8) :: g_NAFVariable.ZTABS(0:KTABS)
+      complex (8) :: naf->ZTABS(0:KTABS)
 !
       integer :: I         
 !*/
       int I;
       
-      if  (g_NAFVariable.IPRT==1)
+      if  (naf->IPRT==1)
       {
          for (I=0;I<=KTABS;I+=IPAS)
          {
-          fprintf(g_NAFVariable.NFPRT,"%6d  %-+20.15E %-+20.15E\n",I, ZTABS[I].reel, ZTABS[I].imag);
-          /* WRITE(g_NAFVariable.NFPRT,1000) I,DREAL(ZTABS(I)),DIMAG(ZTABS(I))*/
+          fprintf(naf->NFPRT,"%6d  %-+20.15E %-+20.15E\n",I, ZTABS[I].reel, ZTABS[I].imag);
+          /* WRITE(naf->NFPRT,1000) I,DREAL(ZTABS(I)),DIMAG(ZTABS(I))*/
          }
       }
 /*1000  FORMAT (1X,I6,2X,2D20.6)*/
@@ -494,11 +642,11 @@ void naf_prtabs(int KTABS, t_complexe *ZTABS, int IPAS)
 /*!
 !
       SUBROUTINE SMOY(ZM)*/
-void naf_smoy(t_complexe *ZM)
+void naf_smoy(t_naf *naf, t_complexe *ZM)
 {
 /*
 !-----------------------------------------------------------------------
-!    CALCUL DES MOYENNNES DE g_NAFVariable.ZTABS ET SOUSTRAIT DE CHACUNE
+!    CALCUL DES MOYENNNES DE naf->ZTABS ET SOUSTRAIT DE CHACUNE
 !    LA VALEUR MOYENNE
 !-----------------------------------------------------------------------
  
@@ -513,28 +661,28 @@ void naf_smoy(t_complexe *ZM)
 /* v0.96 M. GASTINEAU 01/12/98 : utilisation des fonctions  complexes inlines et optimisation */
 #if NAF_USE_OPTIMIZE==0
        *ZM=cmplx(0.E0,0.E0);
-      for (I=0; I<=g_NAFVariable.KTABS; I++)
+      for (I=0; I<=naf->KTABS; I++)
       {
-         *ZM = addcomplexe(*ZM,g_NAFVariable.ZTABS[I]);
+         *ZM = addcomplexe(*ZM,naf->ZTABS[I]);
       }
-      *ZM=muldoublcomplexe(1E0/((double)(g_NAFVariable.KTABS+1)), *ZM); /*ZM=ZM/(g_NAFVariable.KTABS+1)*/
-      for (I=0; I<=g_NAFVariable.KTABS; I++)
+      *ZM=muldoublcomplexe(1E0/((double)(naf->KTABS+1)), *ZM); /*ZM=ZM/(naf->KTABS+1)*/
+      for (I=0; I<=naf->KTABS; I++)
       {
-         g_NAFVariable.ZTABS[I]=subcomplexe(g_NAFVariable.ZTABS[I],*ZM);
+         naf->ZTABS[I]=subcomplexe(naf->ZTABS[I],*ZM);
       }
 #else /*remplacees par: */
       t_complexe *pzarTabs;
-      double dNbKTabs1=g_NAFVariable.KTABS+1;
+      double dNbKTabs1=naf->KTABS+1;
       i_compl_cmplx(ZM,0.E0,0.E0);
-      for (I=0, pzarTabs = g_NAFVariable.ZTABS; 
-           I<=g_NAFVariable.KTABS;
+      for (I=0, pzarTabs = naf->ZTABS; 
+           I<=naf->KTABS;
            I++, pzarTabs++)
       {
          i_compl_padd(ZM,pzarTabs);
       }
-      i_compl_pdivdoubl(ZM,&dNbKTabs1);/*ZM=ZM/(g_NAFVariable.KTABS+1)*/
-      for (I=0, pzarTabs = g_NAFVariable.ZTABS;
-           I<=g_NAFVariable.KTABS; 
+      i_compl_pdivdoubl(ZM,&dNbKTabs1);/*ZM=ZM/(naf->KTABS+1)*/
+      for (I=0, pzarTabs = naf->ZTABS;
+           I<=naf->KTABS; 
            I++, pzarTabs++)
       {
          i_compl_psub(pzarTabs,ZM);
@@ -545,11 +693,11 @@ void naf_smoy(t_complexe *ZM)
 /*!
 !
       SUBROUTINE FRETES (FR,IFLAG,TOL,NUMFR)*/
-void naf_fretes(double FR, int *IFLAG, double TOL, int * NUMFR)
+void naf_fretes(t_naf *naf, double FR, int *IFLAG, double TOL, int * NUMFR)
 {
 /*!**********************************************************************
 !     TEST DE LA NOUVELLE FREQUENCE TROUVEE PAR RAPPORT AUX ANCIENNES.
-!     LA DISTANCE ENTRE DEUX FREQ  DOIT ETRE DE g_NAFVariable.FREFON
+!     LA DISTANCE ENTRE DEUX FREQ  DOIT ETRE DE naf->FREFON
 !
 !     RENVOIE IFLAG =  1 SI LE TEST REUSSIT (ON PEUT CONTINUER)
 !             IFLAG =  0 SI LE TEST ECHOUE (IL VAUT MIEUX S'ARRETER)
@@ -572,29 +720,29 @@ void naf_fretes(double FR, int *IFLAG, double TOL, int * NUMFR)
       int I;
       double ECART, TEST;                
       *IFLAG = 1;
-      ECART = fabs(g_NAFVariable.FREFON) ; 
-      for (I = 1; I<=g_NAFVariable.NFS; I++)
+      ECART = fabs(naf->FREFON) ; 
+      for (I = 1; I<=naf->NFS; I++)
       {
-        TEST = fabs(g_NAFVariable.TFS[I] - FR);
+        TEST = fabs(naf->TFS[I] - FR);
         if (TEST<ECART)
         {
             if ((TEST/ECART)<TOL)
             {
                *IFLAG = -1;
                *NUMFR   = I;
-               if (g_NAFVariable.IPRT>=1)
+               if (naf->IPRT>=1)
                {
-                fprintf(g_NAFVariable.NFPRT, "TEST/ECART = %g   ON CONTINUE\n", TEST/ECART);
+                fprintf(naf->NFPRT, "TEST/ECART = %g   ON CONTINUE\n", TEST/ECART);
                }
                break; /*GOTO 999*/
             }
             else
             {
                *IFLAG = 0 ;
-               if (g_NAFVariable.IPRT>=0)
+               if (naf->IPRT>=0)
                {
-                fprintf(g_NAFVariable.NFPRT,"TEST = %g ECART = %g \n", TEST, ECART);
-                fprintf(g_NAFVariable.NFPRT,"FREQUENCE   FR = %g  TROP PROCHE  DE  %g\n", FR, g_NAFVariable.TFS[I]);
+                fprintf(naf->NFPRT,"TEST = %g ECART = %g \n", TEST, ECART);
+                fprintf(naf->NFPRT,"FREQUENCE   FR = %g  TROP PROCHE  DE  %g\n", FR, naf->TFS[I]);
                }
             }
          }
@@ -688,7 +836,7 @@ void naf_ztpow(int N, int N1, t_complexe *ZT, t_complexe ZA, t_complexe ZAST)
 }/*      END SUBROUTINE ZTPOW*/
 /*!
       SUBROUTINE TESSOL (EPS,TFSR,ZAMPR)*/
-BOOL naf_tessol(double EPS, double *TFSR, t_complexe *ZAMPR)
+BOOL naf_tessol(t_naf *naf, double EPS, double *TFSR, t_complexe *ZAMPR)
 {      
 /*!-----------------------------------------------------------------------
 !     TESSOL
@@ -702,8 +850,8 @@ BOOL naf_tessol(double EPS, double *TFSR, t_complexe *ZAMPR)
       
       IMPLICIT NONE
 ! (EPS,TFSR,ZAMPR)
-      REAL (8) :: EPS, TFSR(g_NAFVariable.NTERM)
-      complex (8) :: ZAMPR(g_NAFVariable.NTERM)
+      REAL (8) :: EPS, TFSR(naf->NTERM)
+      complex (8) :: ZAMPR(naf->NTERM)
 !          
       integer :: IT,IFR,JFR, NVTERM
       REAL (8) :: OFFSET
@@ -726,89 +874,89 @@ BOOL naf_tessol(double EPS, double *TFSR, t_complexe *ZAMPR)
 #if NAF_USE_OPTIMIZE>0
       t_complexe *pzarTab;
 #endif /**/      
-      SYSCHECKMALLOCSIZE(ZAMPT, t_complexe, g_NAFVariable.NTERM+1); /* allocate(ZAMPT(1:g_NAFVariable.NTERM),stat = NERROR)*/
-      DIM2(ZALPT, (g_NAFVariable.NTERM+1), (g_NAFVariable.NTERM+1), t_complexe, "ZALPT"); /*allocate(ZALPT(1:g_NAFVariable.NTERM,1:g_NAFVariable.NTERM),stat = NERROR)*/
-      SYSCHECKMALLOCSIZE(TFST, double, g_NAFVariable.NTERM+1);/* allocate(TFST(1:g_NAFVariable.NTERM),stat = NERROR)*/
-      SYSCHECKMALLOCSIZE(ZT, t_complexe, g_NAFVariable.KTABS+1);/* allocate (ZT (0:g_NAFVariable.KTABS),stat = NERROR)*/
+      SYSCHECKMALLOCSIZE(ZAMPT, t_complexe, naf->NTERM+1); /* allocate(ZAMPT(1:naf->NTERM),stat = NERROR)*/
+      DIM2(ZALPT, (naf->NTERM+1), (naf->NTERM+1), t_complexe, "ZALPT"); /*allocate(ZALPT(1:naf->NTERM,1:naf->NTERM),stat = NERROR)*/
+      SYSCHECKMALLOCSIZE(TFST, double, naf->NTERM+1);/* allocate(TFST(1:naf->NTERM),stat = NERROR)*/
+      SYSCHECKMALLOCSIZE(ZT, t_complexe, naf->KTABS+1);/* allocate (ZT (0:naf->KTABS),stat = NERROR)*/
 
 /*!*************************************************************/
-      OFFSET=g_NAFVariable.KTABS*g_NAFVariable.XH;
+      OFFSET=naf->KTABS*naf->XH;
 /* v0.96 M. GASTINEAU 01/12/98 : utilisation des fonctions  complexes inlines et optimisation */
 #if NAF_USE_OPTIMIZE==0
-/*!----------! INITIALISATION DE g_NAFVariable.ZTABS*/
-      for ( IT=0;IT<=g_NAFVariable.KTABS; IT++)
+/*!----------! INITIALISATION DE naf->ZTABS*/
+      for ( IT=0;IT<=naf->KTABS; IT++)
        {
-          g_NAFVariable.ZTABS[IT]=cmplx(0.E0,0.E0);
+          naf->ZTABS[IT]=cmplx(0.E0,0.E0);
        }
 /*!----------! CALCUL DE LA NOUVELLE SOLUTION*/
       ZI=cmplx(0.E0,1.E0);
-      for ( IFR = 1; IFR<=g_NAFVariable.NFS; IFR++)
+      for ( IFR = 1; IFR<=naf->NFS; IFR++)
       {
-         ZOM = muldoublcomplexe(g_NAFVariable.TFS[IFR]/g_NAFVariable.UNIANG,ZI); /* ZOM=g_NAFVariable.TFS(IFR)/g_NAFVariable.UNIANG*ZI */
-         ZA=g_NAFVariable.ZAMP[IFR];
+         ZOM = muldoublcomplexe(naf->TFS[IFR]/naf->UNIANG,ZI); /* ZOM=naf->TFS(IFR)/naf->UNIANG*ZI */
+         ZA=naf->ZAMP[IFR];
 /*!-----------! ATTENTION ICI (CAS REEL) ON AURA AUSSI LE TERME CONJUGUE
 !-----------! QU'ON NE CALCULE PAS. LE TERME TOTAL EST
-!-----------!       2*RE(g_NAFVariable.ZAMP(I)*EXP(ZI*g_NAFVariable.TFS(I)*T) )
-!-----------! ON RAJOUTE LA CONTRIBUTION TOTALE DU TERME g_NAFVariable.TFS(I) DANS TAB2*/
-         if (g_NAFVariable.ICPLX==1)
+!-----------!       2*RE(naf->ZAMP(I)*EXP(ZI*naf->TFS(I)*T) )
+!-----------! ON RAJOUTE LA CONTRIBUTION TOTALE DU TERME naf->TFS(I) DANS TAB2*/
+         if (naf->ICPLX==1)
          {
-            ZEX = mulcomplexe(ZA,expcomplexe(muldoublcomplexe(g_NAFVariable.T0+OFFSET-g_NAFVariable.XH,ZOM))); /*ZEX = ZA*EXP ((g_NAFVariable.T0+OFFSET-g_NAFVariable.XH)*ZOM)*/
-            ZINC= expcomplexe(muldoublcomplexe(g_NAFVariable.XH,ZOM)); /*ZINC= EXP (g_NAFVariable.XH*ZOM)*/
-            naf_ztpow(g_NAFVariable.KTABS,64,ZT,ZINC,ZEX); /*naf_ztpow(g_NAFVariable.KTABS+1,64,ZT,ZINC,ZEX);*/
-            for (IT=0; IT<=g_NAFVariable.KTABS; IT++)
+            ZEX = mulcomplexe(ZA,expcomplexe(muldoublcomplexe(naf->T0+OFFSET-naf->XH,ZOM))); /*ZEX = ZA*EXP ((naf->T0+OFFSET-naf->XH)*ZOM)*/
+            ZINC= expcomplexe(muldoublcomplexe(naf->XH,ZOM)); /*ZINC= EXP (naf->XH*ZOM)*/
+            naf_ztpow(naf->KTABS,64,ZT,ZINC,ZEX); /*naf_ztpow(naf->KTABS+1,64,ZT,ZINC,ZEX);*/
+            for (IT=0; IT<=naf->KTABS; IT++)
             {
-               g_NAFVariable.ZTABS[IT]=addcomplexe(g_NAFVariable.ZTABS[IT], ZT[IT]); /*g_NAFVariable.ZTABS(IT)=g_NAFVariable.ZTABS(IT)+ZT(IT)*/
+               naf->ZTABS[IT]=addcomplexe(naf->ZTABS[IT], ZT[IT]); /*naf->ZTABS(IT)=naf->ZTABS(IT)+ZT(IT)*/
             }
          }
          else
          {
-            ZEX = mulcomplexe(ZA,expcomplexe(muldoublcomplexe(g_NAFVariable.T0+OFFSET-g_NAFVariable.XH,ZOM))); /*ZEX = ZA*EXP ((g_NAFVariable.T0+OFFSET-g_NAFVariable.XH)*ZOM)*/
-            ZINC= expcomplexe(muldoublcomplexe(g_NAFVariable.XH,ZOM)); /*ZINC= EXP (g_NAFVariable.XH*ZOM)*/
-            naf_ztpow(g_NAFVariable.KTABS,64,ZT,ZINC,ZEX); /*naf_ztpow(g_NAFVariable.KTABS+1,64,ZT,ZINC,ZEX);*/
-            for (IT=0; IT<=g_NAFVariable.KTABS; IT++)
+            ZEX = mulcomplexe(ZA,expcomplexe(muldoublcomplexe(naf->T0+OFFSET-naf->XH,ZOM))); /*ZEX = ZA*EXP ((naf->T0+OFFSET-naf->XH)*ZOM)*/
+            ZINC= expcomplexe(muldoublcomplexe(naf->XH,ZOM)); /*ZINC= EXP (naf->XH*ZOM)*/
+            naf_ztpow(naf->KTABS,64,ZT,ZINC,ZEX); /*naf_ztpow(naf->KTABS+1,64,ZT,ZINC,ZEX);*/
+            for (IT=0; IT<=naf->KTABS; IT++)
             {
-               g_NAFVariable.ZTABS[IT].reel += ZT[IT].reel; /*g_NAFVariable.ZTABS(IT)=g_NAFVariable.ZTABS(IT)+DREAL(ZT(IT))*/
+               naf->ZTABS[IT].reel += ZT[IT].reel; /*naf->ZTABS(IT)=naf->ZTABS(IT)+DREAL(ZT(IT))*/
             }
          }
       }
 #else /*remplacee par:*/
-/*!----------! INITIALISATION DE g_NAFVariable.ZTABS*/
-      for ( IT=0, pzarTab=g_NAFVariable.ZTABS;
-            IT<=g_NAFVariable.KTABS;
+/*!----------! INITIALISATION DE naf->ZTABS*/
+      for ( IT=0, pzarTab=naf->ZTABS;
+            IT<=naf->KTABS;
             IT++, pzarTab++)
        {
           i_compl_cmplx(pzarTab, 0.E0, 0.E0);
        }
 /*!----------! CALCUL DE LA NOUVELLE SOLUTION*/
       i_compl_cmplx(&ZI,0.E0,1.E0);
-      for ( IFR = 1; IFR<=g_NAFVariable.NFS; IFR++)
+      for ( IFR = 1; IFR<=naf->NFS; IFR++)
       {
-         ZOM = i_compl_muldoubl(g_NAFVariable.TFS[IFR]/g_NAFVariable.UNIANG,ZI); /* ZOM=g_NAFVariable.TFS(IFR)/g_NAFVariable.UNIANG*ZI */
-         ZA=g_NAFVariable.ZAMP[IFR];
+         ZOM = i_compl_muldoubl(naf->TFS[IFR]/naf->UNIANG,ZI); /* ZOM=naf->TFS(IFR)/naf->UNIANG*ZI */
+         ZA=naf->ZAMP[IFR];
 /*!-----------! ATTENTION ICI (CAS REEL) ON AURA AUSSI LE TERME CONJUGUE
 !-----------! QU'ON NE CALCULE PAS. LE TERME TOTAL EST
-!-----------!       2*RE(g_NAFVariable.ZAMP(I)*EXP(ZI*g_NAFVariable.TFS(I)*T) )
-!-----------! ON RAJOUTE LA CONTRIBUTION TOTALE DU TERME g_NAFVariable.TFS(I) DANS TAB2*/
-         if (g_NAFVariable.ICPLX==1)
+!-----------!       2*RE(naf->ZAMP(I)*EXP(ZI*naf->TFS(I)*T) )
+!-----------! ON RAJOUTE LA CONTRIBUTION TOTALE DU TERME naf->TFS(I) DANS TAB2*/
+         if (naf->ICPLX==1)
          {
-            ZEX = i_compl_mul(ZA,i_compl_exp(i_compl_muldoubl(g_NAFVariable.T0+OFFSET-g_NAFVariable.XH,ZOM))); /*ZEX = ZA*EXP ((g_NAFVariable.T0+OFFSET-g_NAFVariable.XH)*ZOM)*/
-            ZINC= i_compl_exp(i_compl_muldoubl(g_NAFVariable.XH,ZOM)); /*ZINC= EXP (g_NAFVariable.XH*ZOM)*/
-            naf_ztpow(g_NAFVariable.KTABS,64,ZT,ZINC,ZEX); /*naf_ztpow(g_NAFVariable.KTABS+1,64,ZT,ZINC,ZEX);*/
-            for (IT=0, pzarTab=g_NAFVariable.ZTABS;
-                 IT<=g_NAFVariable.KTABS;
+            ZEX = i_compl_mul(ZA,i_compl_exp(i_compl_muldoubl(naf->T0+OFFSET-naf->XH,ZOM))); /*ZEX = ZA*EXP ((naf->T0+OFFSET-naf->XH)*ZOM)*/
+            ZINC= i_compl_exp(i_compl_muldoubl(naf->XH,ZOM)); /*ZINC= EXP (naf->XH*ZOM)*/
+            naf_ztpow(naf->KTABS,64,ZT,ZINC,ZEX); /*naf_ztpow(naf->KTABS+1,64,ZT,ZINC,ZEX);*/
+            for (IT=0, pzarTab=naf->ZTABS;
+                 IT<=naf->KTABS;
                  IT++, pzarTab++)
             {
-               i_compl_padd(pzarTab,ZT+IT); /*g_NAFVariable.ZTABS(IT)=g_NAFVariable.ZTABS(IT)+ZT(IT)*/
+               i_compl_padd(pzarTab,ZT+IT); /*naf->ZTABS(IT)=naf->ZTABS(IT)+ZT(IT)*/
             }
          }
          else
          {
-            ZEX = i_compl_mul(ZA,i_compl_exp(i_compl_muldoubl(g_NAFVariable.T0+OFFSET-g_NAFVariable.XH,ZOM))); /*ZEX = ZA*EXP ((g_NAFVariable.T0+OFFSET-g_NAFVariable.XH)*ZOM)*/
-            ZINC= i_compl_exp(i_compl_muldoubl(g_NAFVariable.XH,ZOM)); /*ZINC= EXP (g_NAFVariable.XH*ZOM)*/
-            naf_ztpow(g_NAFVariable.KTABS,64,ZT,ZINC,ZEX); /*naf_ztpow(g_NAFVariable.KTABS+1,64,ZT,ZINC,ZEX);*/
-            for (IT=0; IT<=g_NAFVariable.KTABS; IT++)
+            ZEX = i_compl_mul(ZA,i_compl_exp(i_compl_muldoubl(naf->T0+OFFSET-naf->XH,ZOM))); /*ZEX = ZA*EXP ((naf->T0+OFFSET-naf->XH)*ZOM)*/
+            ZINC= i_compl_exp(i_compl_muldoubl(naf->XH,ZOM)); /*ZINC= EXP (naf->XH*ZOM)*/
+            naf_ztpow(naf->KTABS,64,ZT,ZINC,ZEX); /*naf_ztpow(naf->KTABS+1,64,ZT,ZINC,ZEX);*/
+            for (IT=0; IT<=naf->KTABS; IT++)
             {
-               g_NAFVariable.ZTABS[IT].reel += ZT[IT].reel; /*g_NAFVariable.ZTABS(IT)=g_NAFVariable.ZTABS(IT)+DREAL(ZT(IT))*/
+               naf->ZTABS[IT].reel += ZT[IT].reel; /*naf->ZTABS(IT)=naf->ZTABS(IT)+DREAL(ZT(IT))*/
             }
          }
       }
@@ -817,19 +965,19 @@ BOOL naf_tessol(double EPS, double *TFSR, t_complexe *ZAMPR)
 /*!----------------------*/
       SYSFREE(ZT); /*deallocate(ZT)*/
 /*!-----------! SAUVEGARDE DANS DES TABLEAUX ANNEXES DE LA SOLUTION*/
-       for( IFR = 1; IFR<=g_NAFVariable.NFS; IFR++)
+       for( IFR = 1; IFR<=naf->NFS; IFR++)
        {
-         TFST[IFR] = g_NAFVariable.TFS[IFR];
-         ZAMPT[IFR] = g_NAFVariable.ZAMP[IFR];
-          for(JFR = 1;JFR <=g_NAFVariable.NFS; JFR++)
+         TFST[IFR] = naf->TFS[IFR];
+         ZAMPT[IFR] = naf->ZAMP[IFR];
+          for(JFR = 1;JFR <=naf->NFS; JFR++)
           {
-            ZALPT[IFR][JFR] = g_NAFVariable.ZALP[IFR][JFR];
+            ZALPT[IFR][JFR] = naf->ZALP[IFR][JFR];
           }
       }
 /*!-----------! NOUVEAU CALCUL DE LA SOLUTION*/
-      NVTERM=g_NAFVariable.NFS;
-/*!***DEBUG      CALL PRTABS(g_NAFVariable.KTABS,g_NAFVariable.ZTABS,g_NAFVariable.KTABS/10)*/
-      if (naf_mftnaf (NVTERM,EPS)==FALSE)
+      NVTERM=naf->NFS;
+/*!***DEBUG      CALL PRTABS(naf->KTABS,naf->ZTABS,naf->KTABS/10)*/
+      if (naf_mftnaf(naf, NVTERM,EPS)==FALSE)
       {
        HFREE2(ZALPT);
        SYSFREE(ZAMPT);
@@ -837,19 +985,19 @@ BOOL naf_tessol(double EPS, double *TFSR, t_complexe *ZAMPR)
        return FALSE;
       }
 /*!-----------! RESULTATS*/
-      for( IFR = 1; IFR<=g_NAFVariable.NFS; IFR++)
+      for( IFR = 1; IFR<=naf->NFS; IFR++)
       {
-         TFSR[IFR] = g_NAFVariable.TFS[IFR];
-         ZAMPR[IFR] = g_NAFVariable.ZAMP[IFR];
+         TFSR[IFR] = naf->TFS[IFR];
+         ZAMPR[IFR] = naf->ZAMP[IFR];
       }
 /*!-----------! RESTITUTION  DE LA SOLUTION*/
-      for( IFR = 1; IFR<=g_NAFVariable.NFS; IFR++)
+      for( IFR = 1; IFR<=naf->NFS; IFR++)
       {
-         g_NAFVariable.TFS[IFR] = TFST[IFR];
-         g_NAFVariable.ZAMP[IFR] = ZAMPT[IFR];
-         for(JFR = 1;JFR <=g_NAFVariable.NFS; JFR++)
+         naf->TFS[IFR] = TFST[IFR];
+         naf->ZAMP[IFR] = ZAMPT[IFR];
+         for(JFR = 1;JFR <=naf->NFS; JFR++)
          {
-             g_NAFVariable.ZALP[IFR][JFR] = ZALPT[IFR][JFR];
+             naf->ZALP[IFR][JFR] = ZALPT[IFR][JFR];
          }
       }
       HFREE2(ZALPT);
@@ -860,11 +1008,11 @@ BOOL naf_tessol(double EPS, double *TFSR, t_complexe *ZAMPR)
 /*!
 !
       SUBROUTINE INIFRE*/
-void  naf_inifre()
+void  naf_inifre(t_naf *naf)
 {
 /*
 !************************************************************************
-!     REMET A ZERO g_NAFVariable.TFS, g_NAFVariable.ZAMP,g_NAFVariable.ZALP et g_NAFVariable.NFS
+!     REMET A ZERO naf->TFS, naf->ZAMP,naf->ZALP et naf->NFS
 !     UTILE QUAND ON BOUCLE SUR PLUSIEURS CAS
 !
 !***********************************************************************
@@ -876,24 +1024,24 @@ void  naf_inifre()
 #if NAF_USE_OPTIMIZE==0
       t_complexe cZERO;
       cZERO=cmplx(0.E0,0.E0);
-      for(I = 1;I<= g_NAFVariable.NTERM; I++)
+      for(I = 1;I<= naf->NTERM; I++)
       {
-         g_NAFVariable.TFS[I] = 0.E0;
-         g_NAFVariable.ZAMP[I] = cZERO;
-         for(J = 1; J<= g_NAFVariable.NTERM; J++)
+         naf->TFS[I] = 0.E0;
+         naf->ZAMP[I] = cZERO;
+         for(J = 1; J<= naf->NTERM; J++)
          {
-            g_NAFVariable.ZALP[I][J] = cZERO;
+            naf->ZALP[I][J] = cZERO;
          }
       }
 #else /* remplace par: */
-      const int iNterm=g_NAFVariable.NTERM;
+      const int iNterm=naf->NTERM;
       const double dZero=0.E0;
-      double *pdTFS=g_NAFVariable.TFS+1;
-      double *pdZAMP=(double*)(g_NAFVariable.ZAMP+1);
+      double *pdTFS=naf->TFS+1;
+      double *pdZAMP=(double*)(naf->ZAMP+1);
       double *pdZALP;
       for(I = 1;I<= iNterm; I++)
       {
-         pdZALP=(double*)(g_NAFVariable.ZALP[I]);
+         pdZALP=(double*)(naf->ZALP[I]);
          *pdTFS++ = dZero;
          *pdZAMP++ = dZero;
          *pdZAMP++ = dZero;
@@ -906,7 +1054,7 @@ void  naf_inifre()
 
 #endif /*NAF_USE_OPTIMIZE*/
 /* v0.96 M. GASTINEAU 12/01/99 : fin optimisation */
-      g_NAFVariable.NFS = 0;
+      naf->NFS = 0;
 } /*  END SUBROUTINE INIFRE*/
 /*!
 !
@@ -926,7 +1074,7 @@ void  naf_inifre()
 !
 !     RTAB(NRTAB,2) EN 1 AMPLITUDE DE SFREQUENCES POSITIVES
 !                      2 AMPLITUDE DES FREQUENCES NEGATIVES
-!     DISTANCE ENTRE DEUX LIGNES  g_NAFVariable.FREFON
+!     DISTANCE ENTRE DEUX LIGNES  naf->FREFON
 !-----------------------------------------------------------------------
       
       IMPLICIT NONE
@@ -940,32 +1088,32 @@ void  naf_inifre()
 ! */
 /* v0.96 M. GASTINEAU 14/01/99 : support des fenetres */
 #if NAF_USE_OPTIMIZE==0
-void naf_fftmax(double *FR)
+void naf_fftmax(t_naf *naf, double *FR)
 {
       int   KTABS2,ISG,IPAS,I,IDV,INDX,IFR;
       double  FREFO2;
       double *pdTAB=NULL; /*=TAB*/
       double *RTAB=NULL;
 
-      naf_puiss2(g_NAFVariable.KTABS+1,&KTABS2);
+      naf_puiss2(naf->KTABS+1,&KTABS2);
 /*! */     
       SYSCHECKMALLOCSIZE(pdTAB,double,2*KTABS2); pdTAB--;/*  allocate(TAB(2*KTABS2),stat = NERROR)*/
       SYSCHECKMALLOCSIZE(RTAB,double,KTABS2);/*allocate(RTAB(0:KTABS2-1),stat = NERROR)*/
 /*!*/      
-      FREFO2=(g_NAFVariable.FREFON*g_NAFVariable.KTABS)/KTABS2;
+      FREFO2=(naf->FREFON*naf->KTABS)/KTABS2;
 /*!****************** */  
-      if (g_NAFVariable.IPRT==1)
+      if (naf->IPRT==1)
       {
-       fprintf(g_NAFVariable.NFPRT,"KTABS2= %d  FREFO2= %g\n",KTABS2, FREFO2);
+       fprintf(naf->NFPRT,"KTABS2= %d  FREFO2= %g\n",KTABS2, FREFO2);
       }
 /*!****************! CALCUL DES FREQUENCES */
-      ISG=-1;
+      /*ISG=-1;*/ /* transformee directe de naf_fft */
       IDV=KTABS2;
       IPAS=1;
       for(I=0;I<=KTABS2-1; I++)
       {
-         pdTAB[2*I+1]=g_NAFVariable.ZTABS[I].reel*TWIN[I];/*pdTAB(2*I+1)=DREAL(g_NAFVariable.ZTABS(I))*TWIN(I)*/
-         pdTAB[2*I+2]=g_NAFVariable.ZTABS[I].imag*TWIN[I]; /*pdTAB(2*I+2)=DIMAG(g_NAFVariable.ZTABS(I))*TWIN(I)*/          
+         pdTAB[2*I+1]=naf->ZTABS[I].reel*naf->TWIN[I];/*pdTAB(2*I+1)=DREAL(naf->ZTABS(I))*TWIN(I)*/
+         pdTAB[2*I+2]=naf->ZTABS[I].imag*naf->TWIN[I]; /*pdTAB(2*I+2)=DIMAG(naf->ZTABS(I))*TWIN(I)*/          
       }
       naf_four1(pdTAB,KTABS2,ISG);
       for(I=0;I<=KTABS2-1; I++)
@@ -984,59 +1132,64 @@ void naf_fftmax(double *FR)
       ENDIF*/
       
       *FR = IFR*FREFO2*IPAS;
-      if (g_NAFVariable.IPRT==1)
+      if (naf->IPRT==1)
       {
-       fprintf(g_NAFVariable.NFPRT,"IFR=%d FR=%g RTAB=%g INDX=%d KTABS2=%d\n",IFR,*FR, RTAB[INDX],INDX,KTABS2); 
+       fprintf(naf->NFPRT,"IFR=%d FR=%g RTAB=%g INDX=%d KTABS2=%d\n",IFR,*FR, RTAB[INDX],INDX,KTABS2); 
       }
       SYSFREE(RTAB);
 }
 #else /*remplacee par:*/
-double naf_fftmax(int p_iFrMin, int p_iFrMax, double FREFO2, int KTABS2) 
+double naf_fftmax(t_naf *naf, int p_iFrMin, int p_iFrMax, double FREFO2, int KTABS2) 
 {
 /* la fonction retourne la frequence FR dertminee */
 /* On suppose p_iFrMin < p_iFrMax */
       double FR;
-      int   ISG,IPAS,I,INDX,IFR;
+      int   IPAS,I,INDX,IFR;
       /*double  FREFO2;*/
       double *pdTAB=NULL; /*=TAB*/
       double *RTAB=NULL;
       int iKTABS2m1, iKTABS2;
       double dDIV;
       double *pdTABTemp1,*pdTABTemp2;
+      double *pdRE, *pdIM;
       
       
-      /*naf_puiss2(g_NAFVariable.KTABS+1,&KTABS2);*//*v0.96 M. GASTINEAU 14/01/99 */
+      /*naf_puiss2(naf->KTABS+1,&KTABS2);*//*v0.96 M. GASTINEAU 14/01/99 */
       iKTABS2 = KTABS2;
       iKTABS2m1 = iKTABS2-1;
 /*! */     
-      SYSCHECKMALLOCSIZE(pdTAB,double,2*iKTABS2); /*  allocate(TAB(2*KTABS2),stat = NERROR)*/
-      SYSCHECKMALLOCSIZE(RTAB,double,iKTABS2);/*allocate(RTAB(0:KTABS2-1),stat = NERROR)*/
+      /* work arrays allocated by naf_initnaf */
+      pdTAB=naf->m_pdWorkTAB;
+      RTAB=naf->m_pdWorkRTAB;
 /*!*/      
-     /* FREFO2=(g_NAFVariable.FREFON*g_NAFVariable.KTABS)/iKTABS2;*//*v0.96 M. GASTINEAU 14/01/99 */
+     /* FREFO2=(naf->FREFON*naf->KTABS)/iKTABS2;*//*v0.96 M. GASTINEAU 14/01/99 */
 /*!****************** */  
-      if (g_NAFVariable.IPRT==1)
+      if (naf->IPRT==1)
       {
-       fprintf(g_NAFVariable.NFPRT,"KTABS2= %d  FREFO2= %g\n",iKTABS2, FREFO2);
+       fprintf(naf->NFPRT,"KTABS2= %d  FREFO2= %g\n",iKTABS2, FREFO2);
       }
 /*!****************! CALCUL DES FREQUENCES */
-      ISG=-1;
+      /*ISG=-1;*/ /* transformee directe de naf_fft */
       dDIV=iKTABS2;
       IPAS=1;
-      for(I=0, pdTABTemp1=pdTAB, pdTABTemp2=(double*)(g_NAFVariable.ZTABS);
+      /* parties reelle et imaginaire dans deux tableaux separes */
+      pdRE=pdTAB;
+      pdIM=pdTAB+iKTABS2;
+      for(I=0, pdTABTemp2=(double*)(naf->ZTABS);
           I<=iKTABS2m1;
           I++)
       {
-         *pdTABTemp1++ = (*pdTABTemp2++) * TWIN[I];/*pdTAB(2*I+1)=DREAL(g_NAFVariable.ZTABS(I))*TWIN(I)*/
-         *pdTABTemp1++ = (*pdTABTemp2++) * TWIN[I]; /*pdTAB(2*I+2)=DIMAG(g_NAFVariable.ZTABS(I))*TWIN(I)*/          
+         pdRE[I] = (*pdTABTemp2++) * naf->TWIN[I];/*pdTAB(2*I+1)=DREAL(naf->ZTABS(I))*TWIN(I)*/
+         pdIM[I] = (*pdTABTemp2++) * naf->TWIN[I]; /*pdTAB(2*I+2)=DIMAG(naf->ZTABS(I))*TWIN(I)*/          
       }
-      naf_four1(pdTAB-1,iKTABS2,ISG);
-      for(I=0, pdTABTemp1=pdTAB, pdTABTemp2=pdTABTemp1+1;
+      /*naf_four1(pdTAB-1,iKTABS2,ISG);*/ /*remplacee par:*/
+      naf_fft(naf, pdRE, pdIM);
+      for(I=0, pdTABTemp1=pdRE, pdTABTemp2=pdIM;
           I<=iKTABS2m1;
-          I++, pdTABTemp1+=2, pdTABTemp2+=2)
+          I++, pdTABTemp1++, pdTABTemp2++)
       {
          RTAB[I]=sqrt((*pdTABTemp1)*(*pdTABTemp1)+(*pdTABTemp2)*(*pdTABTemp2))/dDIV;
       }
-      SYSFREE(pdTAB);
 /*!**********************        CALL MODTAB(KTABS2,RTAB)*/
       /*v0.96 M. GASTINEAU 14/01/99 : modification pour le support des fenetres */
       /*INDX=naf_maxx(iKTABS2m1, RTAB);*//*naf_maxx(KTABS2,RTAB,&INDX);*/
@@ -1046,9 +1199,9 @@ double naf_fftmax(int p_iFrMin, int p_iFrMax, double FREFO2, int KTABS2)
           IFR = INDX-1-KTABS2
       ENDIF*/
       /* *FR = IFR*FREFO2*IPAS; 
-      if (g_NAFVariable.IPRT==1)
+      if (naf->IPRT==1)
       {
-       fprintf(g_NAFVariable.NFPRT,"IFR=%d FR=%g RTAB=%g INDX=%d KTABS2=%d\n",IFR,*FR, RTAB[INDX],INDX,iKTABS2); 
+       fprintf(naf->NFPRT,"IFR=%d FR=%g RTAB=%g INDX=%d KTABS2=%d\n",IFR,*FR, RTAB[INDX],INDX,iKTABS2); 
       }
       SYSFREE(RTAB); */
       /*remplacee par:*/
@@ -1083,12 +1236,11 @@ double naf_fftmax(int p_iFrMin, int p_iFrMax, double FREFO2, int KTABS2)
        }
       }
       FR = IFR*FREFO2*IPAS; 
-      if (g_NAFVariable.IPRT==1)
+      if (naf->IPRT==1)
       {
-       fprintf(g_NAFVariable.NFPRT,"IFRMIN=%d IFRMAX=%d IFR=%d FR=%g RTAB=%g INDX=%d KTABS2=%d\n",p_iFrMin, p_iFrMax,
+       fprintf(naf->NFPRT,"IFRMIN=%d IFRMAX=%d IFR=%d FR=%g RTAB=%g INDX=%d KTABS2=%d\n",p_iFrMin, p_iFrMax,
                IFR,FR, RTAB[INDX],INDX,iKTABS2); 
       }
-      SYSFREE(RTAB);
       return FR;
       /* v0.96 M. GASTINEAU 14/01/99 : fin de modification */
 }/*      END SUBROUTINE FFTMAX*/
@@ -1275,7 +1427,7 @@ void naf_modtab(int N, double *T)
 /*      SUBROUTINE MODFRE(NUMFR,A,B)*/
 /*v0.96 M. GASTINEAU 12/01/99 : modification dans le cas ou ICPLX=0 */
 /*v0.97 M. GASTINEAU 27/05/99 : modification dans le cas ou ICPLX=0 et FS=0 */
-void naf_modfre(int NUMFR, double *A, double *B)
+void naf_modfre(t_naf *naf, int NUMFR, double *A, double *B)
 {
 /*!-----------------------------------------------------------------------
 !     PERMET DE MODIFIER UNE AMPLITUDE DEJA CALCULEE QUAND
@@ -1285,15 +1437,15 @@ void naf_modfre(int NUMFR, double *A, double *B)
 !     A,B       PARTIES REELLES ET IMAGINAIRES DE L'AMPLITUDE DE LA MODIF 
 !               A APPORTER A L'AMPLITUDE DE LA FREQUENCE NUMFR
 !
-!     AUTRES PARAMETRES TRANSMIS PAR LE COMMON/CGRAM/g_NAFVariable.ZAMP,g_NAFVariable.ZALP,g_NAFVariable.TFS,g_NAFVariable.NFS
+!     AUTRES PARAMETRES TRANSMIS PAR LE COMMON/CGRAM/naf->ZAMP,naf->ZALP,naf->TFS,naf->NFS
 !
 !     30/4/91
 !-----------------------------------------------------------------------
       
-!----------! g_NAFVariable.TFS EST LE TABLEAU FINAL DES FREQUENCES
-!----------! g_NAFVariable.ZAMP   TABLEAU DES AMPLITUDES COMPLEXES
-!----------! g_NAFVariable.ZALP   MATRICE DE PASSAGE DE LA BASE ORTHONORMALISEE
-!----------! g_NAFVariable.NFS    NOMBRE DE FREQ.DEJA DETERMINEES
+!----------! naf->TFS EST LE TABLEAU FINAL DES FREQUENCES
+!----------! naf->ZAMP   TABLEAU DES AMPLITUDES COMPLEXES
+!----------! naf->ZALP   MATRICE DE PASSAGE DE LA BASE ORTHONORMALISEE
+!----------! naf->NFS    NOMBRE DE FREQ.DEJA DETERMINEES
       IMPLICIT NONE
 ! (NUMFR,A,B)
       integer :: NUMFR
@@ -1309,91 +1461,90 @@ void naf_modfre(int NUMFR, double *A, double *B)
            
 /* v0.96 M. GASTINEAU 01/12/98 : utilisation des fonctions  complexes inlines et optimisation */
 #if NAF_USE_OPTIMIZE==0
-      SYSCHECKMALLOCSIZE(ZT,t_complexe, g_NAFVariable.KTABS+1); /*allocate(ZT(0:g_NAFVariable.KTABS),stat = NERROR)*/
+      ZT=naf->m_pzWorkZT; /* allocated by naf_initnaf */
       ZI = cmplx(0.E0,1.E0);
-      ZOM=muldoublcomplexe(g_NAFVariable.TFS[NUMFR]/g_NAFVariable.UNIANG,ZI); /*ZOM=g_NAFVariable.TFS[NUMFR]/g_NAFVariable.UNIANG*ZI*/
+      ZOM=muldoublcomplexe(naf->TFS[NUMFR]/naf->UNIANG,ZI); /*ZOM=naf->TFS[NUMFR]/naf->UNIANG*ZI*/
       ZA=cmplx(*A,*B);
-      fprintf(g_NAFVariable.NFPRT,"CORRECTION DE  IFR = %d AMPLITUDE  = %g",NUMFR, module(ZA));
+      fprintf(naf->NFPRT,"CORRECTION DE  IFR = %d AMPLITUDE  = %g",NUMFR, module(ZA));
 /*!-----------! L' AMPLITUDES DU TERMES EST CORRIGEES
 !-----------! ATTENTION ICI (CAS REEL) ON AURA AUSSI LE TERME CONJUGUE
 !-----------! QU'ON NE CALCULE PAS. LE TERME TOTAL EST
-!-----------!       2*RE(g_NAFVariable.ZAMP(I)*EXP(ZI*g_NAFVariable.TFS(I)*T) )*/
-      g_NAFVariable.ZAMP[NUMFR]=addcomplexe(g_NAFVariable.ZAMP[NUMFR],ZA);
-      if (g_NAFVariable.IPRT==1)
+!-----------!       2*RE(naf->ZAMP(I)*EXP(ZI*naf->TFS(I)*T) )*/
+      naf->ZAMP[NUMFR]=addcomplexe(naf->ZAMP[NUMFR],ZA);
+      if (naf->IPRT==1)
       { 
-       fprintf(g_NAFVariable.NFPRT," %+-20.15E %+-20.15E %+-20.15E %+-20.15E %+-20.15E\n",g_NAFVariable.TFS[NUMFR],
-                     module(g_NAFVariable.ZAMP[NUMFR]),g_NAFVariable.ZAMP[NUMFR].reel,
-                     g_NAFVariable.ZAMP[NUMFR].imag,atan2(g_NAFVariable.ZAMP[NUMFR].imag,g_NAFVariable.ZAMP[NUMFR].reel));
+       fprintf(naf->NFPRT," %+-20.15E %+-20.15E %+-20.15E %+-20.15E %+-20.15E\n",naf->TFS[NUMFR],
+                     module(naf->ZAMP[NUMFR]),naf->ZAMP[NUMFR].reel,
+                     naf->ZAMP[NUMFR].imag,atan2(naf->ZAMP[NUMFR].imag,naf->ZAMP[NUMFR].reel));
       }
-/*!-----------! ON RETIRE LA CONTRIBUTION DU TERME g_NAFVariable.TFS(NUMFR) DANS TABS*/
-      if (g_NAFVariable.ICPLX==1)
+/*!-----------! ON RETIRE LA CONTRIBUTION DU TERME naf->TFS(NUMFR) DANS TABS*/
+      if (naf->ICPLX==1)
       {
-         ZEX=mulcomplexe(ZA,expcomplexe(muldoublcomplexe(g_NAFVariable.T0-g_NAFVariable.XH,ZOM))); /*ZEX = ZA*EXP(ZOM*(g_NAFVariable.T0-g_NAFVariable.XH))*/
-         ZINC=expcomplexe(muldoublcomplexe(g_NAFVariable.XH,ZOM)); /*ZINC=EXP(ZOM*g_NAFVariable.XH)*/
-         naf_ztpow(g_NAFVariable.KTABS,64,ZT,ZINC,ZEX); /*CALL  ZTPOW (KTABS+1,64,ZT,ZINC,ZEX)*/
-         for(IT=0;IT<=g_NAFVariable.KTABS;IT++)
+         ZEX=mulcomplexe(ZA,expcomplexe(muldoublcomplexe(naf->T0-naf->XH,ZOM))); /*ZEX = ZA*EXP(ZOM*(naf->T0-naf->XH))*/
+         ZINC=expcomplexe(muldoublcomplexe(naf->XH,ZOM)); /*ZINC=EXP(ZOM*naf->XH)*/
+         naf_ztpow(naf->KTABS,64,ZT,ZINC,ZEX); /*CALL  ZTPOW (KTABS+1,64,ZT,ZINC,ZEX)*/
+         for(IT=0;IT<=naf->KTABS;IT++)
          {
-            g_NAFVariable.ZTABS[IT]=subcomplexe(g_NAFVariable.ZTABS[IT], ZT[IT]); 
+            naf->ZTABS[IT]=subcomplexe(naf->ZTABS[IT], ZT[IT]); 
          }
       }
       else
       {
-         ZEX=mulcomplexe(ZA,expcomplexe(muldoublcomplexe(g_NAFVariable.T0-g_NAFVariable.XH,ZOM))); /*ZEX = ZA*EXP(ZOM*(g_NAFVariable.T0-g_NAFVariable.XH))*/
-         ZINC=expcomplexe(muldoublcomplexe(g_NAFVariable.XH,ZOM)); /*ZINC=EXP(ZOM*XH)*/
-         naf_ztpow(g_NAFVariable.KTABS,64,ZT,ZINC,ZEX); /*CALL  ZTPOW (KTABS+1,64,ZT,ZINC,ZEX)*/
+         ZEX=mulcomplexe(ZA,expcomplexe(muldoublcomplexe(naf->T0-naf->XH,ZOM))); /*ZEX = ZA*EXP(ZOM*(naf->T0-naf->XH))*/
+         ZINC=expcomplexe(muldoublcomplexe(naf->XH,ZOM)); /*ZINC=EXP(ZOM*XH)*/
+         naf_ztpow(naf->KTABS,64,ZT,ZINC,ZEX); /*CALL  ZTPOW (KTABS+1,64,ZT,ZINC,ZEX)*/
          /*v0.97 M. GASTINEAU 27/05/99 : ajout - correction bug si FS==0 */
-         if (g_NAFVariable.TFS[NUMFR]==0.E0)
+         if (naf->TFS[NUMFR]==0.E0)
          {
-          for(IT=0;IT<=g_NAFVariable.KTABS;IT++)
+          for(IT=0;IT<=naf->KTABS;IT++)
           {
-           g_NAFVariable.ZTABS[IT].reel -= ZT[IT].reel; 
-           /*g_NAFVariable.ZTABS(IT+1)=g_NAFVariable.ZTABS(IT+1)- DREAL(ZT(IT+1)) */
+           naf->ZTABS[IT].reel -= ZT[IT].reel; 
+           /*naf->ZTABS(IT+1)=naf->ZTABS(IT+1)- DREAL(ZT(IT+1)) */
           }
          }
          else
          /*v0.97 M. GASTINEAU 27/05/99 : fin ajout */
-         for(IT=0;IT<=g_NAFVariable.KTABS;IT++)
+         for(IT=0;IT<=naf->KTABS;IT++)
          {
             /*v0.96 M. GASTINEAU 12/01/99 : modification */
-            /*g_NAFVariable.ZTABS[IT].reel -=ZT[IT].reel;*/
+            /*naf->ZTABS[IT].reel -=ZT[IT].reel;*/
             /*remplacee par:*/
-            g_NAFVariable.ZTABS[IT].reel -= 2*ZT[IT].reel;
+            naf->ZTABS[IT].reel -= 2*ZT[IT].reel;
             /*v0.96 M. GASTINEAU 12/01/99 : fin modification */
-            /* g_NAFVariable.ZTABS(IT)=g_NAFVariable.ZTABS(IT)- DREAL(ZT(IT)) */
+            /* naf->ZTABS(IT)=naf->ZTABS(IT)- DREAL(ZT(IT)) */
          }
       }
-      SYSFREE(ZT); /*deallocate(ZT)*/
 #else /*remplacee par:*/
       t_complexe *pzarTabs, *pzarZT;
-      const int ikTabs=g_NAFVariable.KTABS; /*v0.96 M. GASTINEAU 12/01/99 : optimisation*/
+      const int ikTabs=naf->KTABS; /*v0.96 M. GASTINEAU 12/01/99 : optimisation*/
       
-      SYSCHECKMALLOCSIZE(ZT,t_complexe, g_NAFVariable.KTABS+1); /*allocate(ZT(0:g_NAFVariable.KTABS),stat = NERROR)*/
+      ZT=naf->m_pzWorkZT; /* allocated by naf_initnaf */
       i_compl_cmplx(&ZI,0.E0,1.E0);
-      ZOM=i_compl_muldoubl(g_NAFVariable.TFS[NUMFR]/g_NAFVariable.UNIANG,ZI); /*ZOM=g_NAFVariable.TFS[NUMFR]/g_NAFVariable.UNIANG*ZI*/
+      ZOM=i_compl_muldoubl(naf->TFS[NUMFR]/naf->UNIANG,ZI); /*ZOM=naf->TFS[NUMFR]/naf->UNIANG*ZI*/
       i_compl_cmplx(&ZA,*A,*B);
-      fprintf(g_NAFVariable.NFPRT,"CORRECTION DE  IFR = %d AMPLITUDE  = %g",NUMFR, i_compl_module(ZA));
+      fprintf(naf->NFPRT,"CORRECTION DE  IFR = %d AMPLITUDE  = %g",NUMFR, i_compl_module(ZA));
 /*!-----------! L' AMPLITUDES DU TERMES EST CORRIGEES
 !-----------! ATTENTION ICI (CAS REEL) ON AURA AUSSI LE TERME CONJUGUE
 !-----------! QU'ON NE CALCULE PAS. LE TERME TOTAL EST
-!-----------!       2*RE(g_NAFVariable.ZAMP(I)*EXP(ZI*g_NAFVariable.TFS(I)*T) )*/
-      i_compl_padd(g_NAFVariable.ZAMP+NUMFR,&ZA);
-      if (g_NAFVariable.IPRT==1)
+!-----------!       2*RE(naf->ZAMP(I)*EXP(ZI*naf->TFS(I)*T) )*/
+      i_compl_padd(naf->ZAMP+NUMFR,&ZA);
+      if (naf->IPRT==1)
       { 
-       fprintf(g_NAFVariable.NFPRT," %+-20.15E %+-20.15E %+-20.15E %+-20.15E %+-20.15E\n",g_NAFVariable.TFS[NUMFR],
-                     i_compl_module(g_NAFVariable.ZAMP[NUMFR]),g_NAFVariable.ZAMP[NUMFR].reel,
-                     g_NAFVariable.ZAMP[NUMFR].imag,atan2(g_NAFVariable.ZAMP[NUMFR].imag,g_NAFVariable.ZAMP[NUMFR].reel));
+       fprintf(naf->NFPRT," %+-20.15E %+-20.15E %+-20.15E %+-20.15E %+-20.15E\n",naf->TFS[NUMFR],
+                     i_compl_module(naf->ZAMP[NUMFR]),naf->ZAMP[NUMFR].reel,
+                     naf->ZAMP[NUMFR].imag,atan2(naf->ZAMP[NUMFR].imag,naf->ZAMP[NUMFR].reel));
       }
-/*!-----------! ON RETIRE LA CONTRIBUTION DU TERME g_NAFVariable.TFS(NUMFR) DANS TABS*/
-      if (g_NAFVariable.ICPLX==1)
+/*!-----------! ON RETIRE LA CONTRIBUTION DU TERME naf->TFS(NUMFR) DANS TABS*/
+      if (naf->ICPLX==1)
       {
-         ZEX=i_compl_mul(ZA,i_compl_exp(i_compl_muldoubl(g_NAFVariable.T0-g_NAFVariable.XH,ZOM))); /*ZEX = ZA*EXP(ZOM*(g_NAFVariable.T0-g_NAFVariable.XH))*/
-         ZINC=i_compl_exp(i_compl_muldoubl(g_NAFVariable.XH,ZOM)); /*ZINC=EXP(ZOM*g_NAFVariable.XH)*/
-         naf_ztpow(g_NAFVariable.KTABS,64,ZT,ZINC,ZEX); /*CALL  ZTPOW (KTABS+1,64,ZT,ZINC,ZEX)*/
+         ZEX=i_compl_mul(ZA,i_compl_exp(i_compl_muldoubl(naf->T0-naf->XH,ZOM))); /*ZEX = ZA*EXP(ZOM*(naf->T0-naf->XH))*/
+         ZINC=i_compl_exp(i_compl_muldoubl(naf->XH,ZOM)); /*ZINC=EXP(ZOM*naf->XH)*/
+         naf_ztpow(naf->KTABS,64,ZT,ZINC,ZEX); /*CALL  ZTPOW (KTABS+1,64,ZT,ZINC,ZEX)*/
          /*v0.96 M. GASTINEAU 12/01/99 : optimisation*/
-         /*for(IT=0, pzarTabs=g_NAFVariable.ZTABS, pzarZT = ZT;
-             IT<=g_NAFVariable.KTABS;
+         /*for(IT=0, pzarTabs=naf->ZTABS, pzarZT = ZT;
+             IT<=naf->KTABS;
              IT++, pzarTabs++, pzarZT++)*//*remplacee par:*/
-         for(IT=0, pzarTabs=g_NAFVariable.ZTABS, pzarZT = ZT;
+         for(IT=0, pzarTabs=naf->ZTABS, pzarZT = ZT;
              IT<=ikTabs;
              IT++, pzarTabs++, pzarZT++)/*v0.96 M. GASTINEAU 12/01/99 : fin optimisation*/
          {
@@ -1402,18 +1553,18 @@ void naf_modfre(int NUMFR, double *A, double *B)
       }
       else
       {
-         ZEX=i_compl_mul(ZA,i_compl_exp(i_compl_muldoubl(g_NAFVariable.T0-g_NAFVariable.XH,ZOM))); /*ZEX = ZA*EXP(ZOM*(g_NAFVariable.T0-g_NAFVariable.XH))*/
-         ZINC=i_compl_exp(i_compl_muldoubl(g_NAFVariable.XH,ZOM)); /*ZINC=EXP(ZOM*XH)*/
-         naf_ztpow(g_NAFVariable.KTABS,64,ZT,ZINC,ZEX); /*CALL  ZTPOW (KTABS+1,64,ZT,ZINC,ZEX)*/
+         ZEX=i_compl_mul(ZA,i_compl_exp(i_compl_muldoubl(naf->T0-naf->XH,ZOM))); /*ZEX = ZA*EXP(ZOM*(naf->T0-naf->XH))*/
+         ZINC=i_compl_exp(i_compl_muldoubl(naf->XH,ZOM)); /*ZINC=EXP(ZOM*XH)*/
+         naf_ztpow(naf->KTABS,64,ZT,ZINC,ZEX); /*CALL  ZTPOW (KTABS+1,64,ZT,ZINC,ZEX)*/
          /*v0.96 M. GASTINEAU 12/01/99 : optimisation*/
-         /*for(IT=0;IT<=g_NAFVariable.KTABS;IT++)*/
+         /*for(IT=0;IT<=naf->KTABS;IT++)*/
          /*v0.97 M. GASTINEAU 27/05/99 : ajout - correction bug si FS==0 */
-         if (g_NAFVariable.TFS[NUMFR]==0.E0)
+         if (naf->TFS[NUMFR]==0.E0)
          {
           for(IT=0;IT<=ikTabs;IT++)
           {
-           g_NAFVariable.ZTABS[IT].reel -= ZT[IT].reel; 
-           /*g_NAFVariable.ZTABS(IT+1)=g_NAFVariable.ZTABS(IT+1)- DREAL(ZT(IT+1)) */
+           naf->ZTABS[IT].reel -= ZT[IT].reel; 
+           /*naf->ZTABS(IT+1)=naf->ZTABS(IT+1)- DREAL(ZT(IT+1)) */
           }
          }
          else
@@ -1421,13 +1572,12 @@ void naf_modfre(int NUMFR, double *A, double *B)
          for(IT=0;IT<=ikTabs;IT++)/*v0.96 M. GASTINEAU 12/01/99 : fin optimisation*/
          {
            /*v0.96 M. GASTINEAU 12/01/99 : modification */
-           /* g_NAFVariable.ZTABS[IT].reel -=ZT[IT].reel;*//* g_NAFVariable.ZTABS(IT)=g_NAFVariable.ZTABS(IT)- DREAL(ZT(IT)) */
+           /* naf->ZTABS[IT].reel -=ZT[IT].reel;*//* naf->ZTABS(IT)=naf->ZTABS(IT)- DREAL(ZT(IT)) */
            /*remplacee par:*/
-           g_NAFVariable.ZTABS[IT].reel -=2*ZT[IT].reel;/* g_NAFVariable.ZTABS(IT)=g_NAFVariable.ZTABS(IT)- DREAL(ZT(IT)) */
+           naf->ZTABS[IT].reel -=2*ZT[IT].reel;/* naf->ZTABS(IT)=naf->ZTABS(IT)- DREAL(ZT(IT)) */
            /*v0.96 M. GASTINEAU 12/01/99 : fin modification */        
          }
       }
-      SYSFREE(ZT); /*deallocate(ZT)*/
 #endif /*NAF_USE_OPTIMIZE==0*/
 /* v0.96 M. GASTINEAU 01/12/98 : fin optimisation */
 }/*      END SUBROUTINE MODFRE*/
@@ -1436,7 +1586,7 @@ void naf_modfre(int NUMFR, double *A, double *B)
 /*      SUBROUTINE GRAMSC(FS,A,B)*/
 /*v0.96 M. GASTINEAU 12/01/99 : modification dans le cas ou ICPLX=0 */
 /*v0.97 M. GASTINEAU 27/05/99 : modification dans le cas ou ICPLX=0 et FS=0 */
-BOOL naf_gramsc(double FS, double A, double B)
+BOOL naf_gramsc(t_naf *naf, double FS, double A, double B)
 {
 /*
 !-----------------------------------------------------------------------
@@ -1446,18 +1596,18 @@ BOOL naf_gramsc(double FS, double A, double B)
 !     FS        FREQUENCE EN "/AN
 !     A,B       PARTIES REELLES ET IMAGINAIRES DE L'AMPLITUDE
 !
-!     AUTRES PARAMETRES TRANSMIS PAR LE COMMON/CGRAM/g_NAFVariable.ZAMP,g_NAFVariable.ZALP,g_NAFVariable.TFS,g_NAFVariable.NFS
+!     AUTRES PARAMETRES TRANSMIS PAR LE COMMON/CGRAM/naf->ZAMP,naf->ZALP,naf->TFS,naf->NFS
 !
 !     MODIFIE LE 26 9 87 POUR LES FONCTIONS REELLES   J. LASKAR
 !-----------------------------------------------------------------------
       
-!----------! g_NAFVariable.TFS EST LE TABLEAU FINAL DES FREQUENCES
-!----------! g_NAFVariable.ZAMP   TABLEAU DES AMPLITUDES COMPLEXES
-!----------! g_NAFVariable.ZALP   MATRICE DE PASSAGE DE LA BASE ORTHONORMALISEE
+!----------! naf->TFS EST LE TABLEAU FINAL DES FREQUENCES
+!----------! naf->ZAMP   TABLEAU DES AMPLITUDES COMPLEXES
+!----------! naf->ZALP   MATRICE DE PASSAGE DE LA BASE ORTHONORMALISEE
 !----------! ZTEE   TABLEAU DE TRAVAIL
-!----------! g_NAFVariable.NFS    NOMBRE DE FREQ.DEJA DETERMINEES
+!----------! naf->NFS    NOMBRE DE FREQ.DEJA DETERMINEES
       IMPLICIT NONE
-! (g_NAFVariable.KTABS,FS,A,B)
+! (naf->KTABS,FS,A,B)
       REAL (8) :: FS,A,B     
 !
       integer :: I, J, K, NF, IT
@@ -1474,59 +1624,58 @@ BOOL naf_gramsc(double FS, double A, double B)
 /* v0.96 M. GASTINEAU 01/12/98 : utilisation des fonctions  complexes inlines et optimisation */
 #if NAF_USE_OPTIMIZE>0
       t_complexe *pzarTabs, *pzarZT;
-      const int ikTabs=g_NAFVariable.KTABS; /*v0.96 M. GASTINEAU 12/01/99 : optimisation*/
+      const int ikTabs=naf->KTABS; /*v0.96 M. GASTINEAU 12/01/99 : optimisation*/
 #endif /**/
-      SYSCHECKMALLOCSIZE(ZT, t_complexe, g_NAFVariable.KTABS+1); /*allocate(ZT(0:g_NAFVariable.KTABS),stat = NERROR)*/
-      SYSCHECKMALLOCSIZE(ZTEE, t_complexe, g_NAFVariable.NTERM+1); /*allocate(ZTEE(1:g_NAFVariable.NTERM),stat = NERROR)*/
+      /* work arrays allocated by naf_initnaf */
+      ZT=naf->m_pzWorkZT;
+      ZTEE=naf->m_pzWorkZTEE;
 
 /*!----------! CALCUL DE ZTEE(I)=<EN,EI>*/
-      for(I =1;I<=g_NAFVariable.NFS;I++)
+      for(I =1;I<=naf->NFS;I++)
       {
-        if(naf_proscaa(FS,g_NAFVariable.TFS[I],ZTEE+I)==FALSE)
+        if(naf_proscaa(naf, FS,naf->TFS[I],ZTEE+I)==FALSE)
         {
-         SYSFREE(ZT);
-         SYSFREE(ZTEE);
          return FALSE;
         }
       }
 /* v0.96 M. GASTINEAU 01/12/98 : utilisation des fonctions  complexes inlines et optimisation */
 #if NAF_USE_OPTIMIZE==0
 /*!----------! NF EST LE NUMERO DE LA NOUVELLE FREQUENCE*/
-      NF=g_NAFVariable.NFS+1;
+      NF=naf->NFS+1;
       ZTEE[NF]=cmplx(1.E0,0.E0);
 /*!----------! CALCUL DE FN = EN - SOM(<EN,FI>FI) QUI EST ORTHOGONAL AUX F*/
-      g_NAFVariable.TFS[NF]=FS;
-      for( K=1;K<=g_NAFVariable.NFS;K++)
+      naf->TFS[NF]=FS;
+      for( K=1;K<=naf->NFS;K++)
       {
-       for(I=K;I<=g_NAFVariable.NFS;I++)
+       for(I=K;I<=naf->NFS;I++)
        {
         for(J=1;J<=I;J++)
         {
-          /*g_NAFVariable.ZALP(NF,K)=g_NAFVariable.ZALP(NF,K)-DCONJG(g_NAFVariable.ZALP(I,J))*g_NAFVariable.ZALP(I,K)*ZTEE(J)*/
-          g_NAFVariable.ZALP[NF][K]=subcomplexe(g_NAFVariable.ZALP[NF][K],mulcomplexe(mulcomplexe(conjcomplexe(g_NAFVariable.ZALP[I][J]),g_NAFVariable.ZALP[I][K]),ZTEE[J]));
+          /*naf->ZALP(NF,K)=naf->ZALP(NF,K)-DCONJG(naf->ZALP(I,J))*naf->ZALP(I,K)*ZTEE(J)*/
+          naf->ZALP[NF][K]=subcomplexe(naf->ZALP[NF][K],mulcomplexe(mulcomplexe(conjcomplexe(naf->ZALP[I][J]),naf->ZALP[I][K]),ZTEE[J]));
         }
        }
       }
-      g_NAFVariable.ZALP[NF][NF]=cmplx(1.E0,0.E0);
+      naf->ZALP[NF][NF]=cmplx(1.E0,0.E0);
 /*!----------! ON REND LA NORME DE FN = 1*/
       DIV=1.E0;
       ZDIV=cmplx(0.E0,0.E0);
       for( I=1; I<=NF; I++)
       {
-         /*ZDIV=ZDIV+DCONJG(g_NAFVariable.ZALP(NF,I))*ZTEE(I)*/
-         ZDIV=addcomplexe(ZDIV, mulcomplexe(conjcomplexe(g_NAFVariable.ZALP[NF][I]),ZTEE[I]));
+         /*ZDIV=ZDIV+DCONJG(naf->ZALP(NF,I))*ZTEE(I)*/
+         ZDIV=addcomplexe(ZDIV, mulcomplexe(conjcomplexe(naf->ZALP[NF][I]),ZTEE[I]));
       }
       DIV=sqrt(module(ZDIV));
-      if (g_NAFVariable.IPRT==1)
+      if (naf->IPRT==1)
       {
        /*v0.96 M. GASTINEAU 19/11/98 : modification*/
-       /*fprintf(g_NAFVariable.NFPRT,"ZDIV= %g+i%g DIV=%g\n",ZDIV,DIV);*//*remplacee par:*/
-       fprintf(g_NAFVariable.NFPRT,"ZDIV= %g+i%g DIV=%g\n",ZDIV.reel,ZDIV.imag,DIV);
+       /*fprintf(naf->NFPRT,"ZDIV= %g+i%g DIV=%g\n",ZDIV,DIV);*//*remplacee par:*/
+       fprintf(naf->NFPRT,"ZDIV= %g+i%g DIV=%g\n",ZDIV.reel,ZDIV.imag,DIV);
        /*v0.96 M. GASTINEAU 19/11/98 : fin modification*/
       }
       for(I=1; I<=NF; I++)
       {
-         g_NAFVariable.ZALP[NF][I]=muldoublcomplexe(1.E0/DIV,g_NAFVariable.ZALP[NF][I]); /*g_NAFVariable.ZALP(NF,I) = g_NAFVariable.ZALP(NF,I)/DIV*/
+         naf->ZALP[NF][I]=muldoublcomplexe(1.E0/DIV,naf->ZALP[NF][I]); /*naf->ZALP(NF,I) = naf->ZALP(NF,I)/DIV*/
       }
 /*!-----------! F1,F2....., FN EST UNE BASE ORTHONORMEE
 !-----------! ON RETIRE MAINTENANT A F  <F,FN>FN  (<F,FN>=<F,EN>)*/
@@ -1534,96 +1683,96 @@ BOOL naf_gramsc(double FS, double A, double B)
       ZI=cmplx(0.E0,1.E0);
       for(I=1; I<=NF; I++)
       {
-         ZOM=muldoublcomplexe(g_NAFVariable.TFS[I]/g_NAFVariable.UNIANG,ZI); /*ZOM=g_NAFVariable.TFS(I)/g_NAFVariable.UNIANG*ZI*/
-         ZA=mulcomplexe(g_NAFVariable.ZALP[NF][I],ZMUL);
+         ZOM=muldoublcomplexe(naf->TFS[I]/naf->UNIANG,ZI); /*ZOM=naf->TFS(I)/naf->UNIANG*ZI*/
+         ZA=mulcomplexe(naf->ZALP[NF][I],ZMUL);
 /*!-----------! LES AMPLITUDES DES TERMES SONT CORRIGEES
 !-----------! ATTENTION ICI (CAS REEL) ON AURA AUSSI LE TERME CONJUGUE
 !-----------! QU'ON NE CALCULE PAS. LE TERME TOTAL EST
-!-----------!       2*RE(g_NAFVariable.ZAMP(I)*EXP(ZI*g_NAFVariable.TFS(I)*T) )*/
-         g_NAFVariable.ZAMP[I]=addcomplexe(g_NAFVariable.ZAMP[I],ZA);
-         if (g_NAFVariable.IPRT==1)
+!-----------!       2*RE(naf->ZAMP(I)*EXP(ZI*naf->TFS(I)*T) )*/
+         naf->ZAMP[I]=addcomplexe(naf->ZAMP[I],ZA);
+         if (naf->IPRT==1)
          {
-           fprintf(g_NAFVariable.NFPRT," %g %g %g %g %g\n", g_NAFVariable.TFS[I],module(g_NAFVariable.ZAMP[I]),g_NAFVariable.ZAMP[I].reel,
-                   g_NAFVariable.ZAMP[I].imag,atan2(g_NAFVariable.ZAMP[I].imag,g_NAFVariable.ZAMP[I].reel));
+           fprintf(naf->NFPRT," %g %g %g %g %g\n", naf->TFS[I],module(naf->ZAMP[I]),naf->ZAMP[I].reel,
+                   naf->ZAMP[I].imag,atan2(naf->ZAMP[I].imag,naf->ZAMP[I].reel));
          }
-/*!-----------! ON RETIRE LA CONTRIBUTION TOTALE DU TERME g_NAFVariable.TFS(I) DANS TABS*/
-       if (g_NAFVariable.ICPLX==1)
+/*!-----------! ON RETIRE LA CONTRIBUTION TOTALE DU TERME naf->TFS(I) DANS TABS*/
+       if (naf->ICPLX==1)
        {
-         ZEX=mulcomplexe(ZA, expcomplexe(muldoublcomplexe(g_NAFVariable.T0-g_NAFVariable.XH,ZOM))); /*ZEX = ZA*EXP(ZOM*(g_NAFVariable.T0-g_NAFVariable.XH))*/
-         ZINC=expcomplexe(muldoublcomplexe(g_NAFVariable.XH,ZOM)); /*ZINC=EXP(ZOM*g_NAFVariable.XH)*/
-         naf_ztpow(g_NAFVariable.KTABS,64,ZT,ZINC,ZEX); /*naf_ztpow(g_NAFVariable.KTABS+1,64,ZT,ZINC,ZEX);*/
-         for(IT=0;IT<=g_NAFVariable.KTABS;IT++)
+         ZEX=mulcomplexe(ZA, expcomplexe(muldoublcomplexe(naf->T0-naf->XH,ZOM))); /*ZEX = ZA*EXP(ZOM*(naf->T0-naf->XH))*/
+         ZINC=expcomplexe(muldoublcomplexe(naf->XH,ZOM)); /*ZINC=EXP(ZOM*naf->XH)*/
+         naf_ztpow(naf->KTABS,64,ZT,ZINC,ZEX); /*naf_ztpow(naf->KTABS+1,64,ZT,ZINC,ZEX);*/
+         for(IT=0;IT<=naf->KTABS;IT++)
          {
-            g_NAFVariable.ZTABS[IT]=subcomplexe(g_NAFVariable.ZTABS[IT],ZT[IT]); 
+            naf->ZTABS[IT]=subcomplexe(naf->ZTABS[IT],ZT[IT]); 
          }
        }
        else
        {
-         ZEX=mulcomplexe(ZA, expcomplexe(muldoublcomplexe(g_NAFVariable.T0-g_NAFVariable.XH,ZOM))); /*ZEX = ZA*EXP(ZOM*(g_NAFVariable.T0-g_NAFVariable.XH))*/
-         ZINC=expcomplexe(muldoublcomplexe(g_NAFVariable.XH,ZOM)); /*ZINC=EXP(ZOM*g_NAFVariable.XH)*/
-         naf_ztpow(g_NAFVariable.KTABS,64,ZT,ZINC,ZEX);/*naf_ztpow(g_NAFVariable.KTABS+1,64,ZT,ZINC,ZEX);*/
+         ZEX=mulcomplexe(ZA, expcomplexe(muldoublcomplexe(naf->T0-naf->XH,ZOM))); /*ZEX = ZA*EXP(ZOM*(naf->T0-naf->XH))*/
+         ZINC=expcomplexe(muldoublcomplexe(naf->XH,ZOM)); /*ZINC=EXP(ZOM*naf->XH)*/
+         naf_ztpow(naf->KTABS,64,ZT,ZINC,ZEX);/*naf_ztpow(naf->KTABS+1,64,ZT,ZINC,ZEX);*/
          /*v0.97 M. GASTINEAU 27/05/99 : ajout - correction bug si FS==0 */
          if (FS==0.E0)
          {
-         for(IT=0;IT<=g_NAFVariable.KTABS;IT++)
+         for(IT=0;IT<=naf->KTABS;IT++)
          {
-           g_NAFVariable.ZTABS[IT].reel -= ZT[IT].reel; 
-           /*g_NAFVariable.ZTABS(IT+1)=g_NAFVariable.ZTABS(IT+1)- DREAL(ZT(IT+1)) */
+           naf->ZTABS[IT].reel -= ZT[IT].reel; 
+           /*naf->ZTABS(IT+1)=naf->ZTABS(IT+1)- DREAL(ZT(IT+1)) */
          }
          }
          else
          /*v0.97 M. GASTINEAU 27/05/99 : fin ajout */
-         for(IT=0;IT<=g_NAFVariable.KTABS;IT++)
+         for(IT=0;IT<=naf->KTABS;IT++)
          {
            /*v0.96 M. GASTINEAU 12/01/99 : modification*/
-           /*g_NAFVariable.ZTABS[IT].reel -=ZT[IT].reel;*/ /*g_NAFVariable.ZTABS(IT+1)=g_NAFVariable.ZTABS(IT+1)- DREAL(ZT(IT+1)) */
+           /*naf->ZTABS[IT].reel -=ZT[IT].reel;*/ /*naf->ZTABS(IT+1)=naf->ZTABS(IT+1)- DREAL(ZT(IT+1)) */
            /*remplacee par: */
-           g_NAFVariable.ZTABS[IT].reel -= 2*ZT[IT].reel; /*g_NAFVariable.ZTABS(IT+1)=g_NAFVariable.ZTABS(IT+1)- DREAL(ZT(IT+1)) */
+           naf->ZTABS[IT].reel -= 2*ZT[IT].reel; /*naf->ZTABS(IT+1)=naf->ZTABS(IT+1)- DREAL(ZT(IT+1)) */
            /*v0.96 M. GASTINEAU 12/01/99 : fin modification*/
          }
        }
       }
 #else /*remplacee par:*/
 /*!----------! NF EST LE NUMERO DE LA NOUVELLE FREQUENCE*/
-      NF=g_NAFVariable.NFS+1;
+      NF=naf->NFS+1;
       i_compl_cmplx(ZTEE+NF,1.E0,0.E0);
 /*!----------! CALCUL DE FN = EN - SOM(<EN,FI>FI) QUI EST ORTHOGONAL AUX F*/
-      g_NAFVariable.TFS[NF]=FS;
-      for( K=1;K<=g_NAFVariable.NFS;K++)
+      naf->TFS[NF]=FS;
+      for( K=1;K<=naf->NFS;K++)
       {
-       for(I=K;I<=g_NAFVariable.NFS;I++)
+       for(I=K;I<=naf->NFS;I++)
        {
         for(J=1;J<=I;J++)
         {
-          /*g_NAFVariable.ZALP(NF,K)=g_NAFVariable.ZALP(NF,K)-DCONJG(g_NAFVariable.ZALP(I,J))*g_NAFVariable.ZALP(I,K)*ZTEE(J)*/
+          /*naf->ZALP(NF,K)=naf->ZALP(NF,K)-DCONJG(naf->ZALP(I,J))*naf->ZALP(I,K)*ZTEE(J)*/
           t_complexe zSubExp;
-          zSubExp=i_compl_mul(i_compl_mul(i_compl_conj(&(g_NAFVariable.ZALP[I][J])),g_NAFVariable.ZALP[I][K]),ZTEE[J]);
-          i_compl_psub(&(g_NAFVariable.ZALP[NF][K]),&zSubExp);
+          zSubExp=i_compl_mul(i_compl_mul(i_compl_conj(&(naf->ZALP[I][J])),naf->ZALP[I][K]),ZTEE[J]);
+          i_compl_psub(&(naf->ZALP[NF][K]),&zSubExp);
         }
        }
       }
-      i_compl_cmplx(&(g_NAFVariable.ZALP[NF][NF]),1.E0,0.E0);
+      i_compl_cmplx(&(naf->ZALP[NF][NF]),1.E0,0.E0);
 /*!----------! ON REND LA NORME DE FN = 1*/
       DIV=1.E0;
       i_compl_cmplx(&ZDIV,0.E0,0.E0);
       for( I=1; I<=NF; I++)
       {
-         /*ZDIV=ZDIV+DCONJG(g_NAFVariable.ZALP(NF,I))*ZTEE(I)*/
+         /*ZDIV=ZDIV+DCONJG(naf->ZALP(NF,I))*ZTEE(I)*/
          t_complexe zSubExp;
-         zSubExp = i_compl_mul(i_compl_conj(&(g_NAFVariable.ZALP[NF][I])),ZTEE[I]);
+         zSubExp = i_compl_mul(i_compl_conj(&(naf->ZALP[NF][I])),ZTEE[I]);
          i_compl_padd(&ZDIV,&zSubExp);
       }
       DIV=sqrt(i_compl_module(ZDIV));
-      if (g_NAFVariable.IPRT==1)
+      if (naf->IPRT==1)
       {
        /*v0.96 M. GASTINEAU 19/11/98 : modification*/
-       /*fprintf(g_NAFVariable.NFPRT,"ZDIV= %g+i%g DIV=%g\n",ZDIV,DIV);*//*remplacee par:*/
-       fprintf(g_NAFVariable.NFPRT,"ZDIV= %g+i%g DIV=%g\n",ZDIV.reel,ZDIV.imag,DIV);
+       /*fprintf(naf->NFPRT,"ZDIV= %g+i%g DIV=%g\n",ZDIV,DIV);*//*remplacee par:*/
+       fprintf(naf->NFPRT,"ZDIV= %g+i%g DIV=%g\n",ZDIV.reel,ZDIV.imag,DIV);
        /*v0.96 M. GASTINEAU 19/11/98 : fin modification*/
       }
       for(I=1; I<=NF; I++)
       {
-         i_compl_pdivdoubl(&(g_NAFVariable.ZALP[NF][I]),&DIV); /*g_NAFVariable.ZALP(NF,I) = g_NAFVariable.ZALP(NF,I)/DIV*/
+         i_compl_pdivdoubl(&(naf->ZALP[NF][I]),&DIV); /*naf->ZALP(NF,I) = naf->ZALP(NF,I)/DIV*/
       }
 /*!-----------! F1,F2....., FN EST UNE BASE ORTHONORMEE
 !-----------! ON RETIRE MAINTENANT A F  <F,FN>FN  (<F,FN>=<F,EN>)*/
@@ -1632,29 +1781,29 @@ BOOL naf_gramsc(double FS, double A, double B)
       i_compl_cmplx(&ZI,0.E0,1.E0);
       for(I=1; I<=NF; I++)
       {
-         ZOM=i_compl_muldoubl(g_NAFVariable.TFS[I]/g_NAFVariable.UNIANG,ZI); /*ZOM=g_NAFVariable.TFS(I)/g_NAFVariable.UNIANG*ZI*/
-         ZA=i_compl_mul(g_NAFVariable.ZALP[NF][I],ZMUL);
+         ZOM=i_compl_muldoubl(naf->TFS[I]/naf->UNIANG,ZI); /*ZOM=naf->TFS(I)/naf->UNIANG*ZI*/
+         ZA=i_compl_mul(naf->ZALP[NF][I],ZMUL);
 /*!-----------! LES AMPLITUDES DES TERMES SONT CORRIGEES
 !-----------! ATTENTION ICI (CAS REEL) ON AURA AUSSI LE TERME CONJUGUE
 !-----------! QU'ON NE CALCULE PAS. LE TERME TOTAL EST
-!-----------!       2*RE(g_NAFVariable.ZAMP(I)*EXP(ZI*g_NAFVariable.TFS(I)*T) )*/
-         i_compl_padd(g_NAFVariable.ZAMP+I,&ZA);
-         if (g_NAFVariable.IPRT==1)
+!-----------!       2*RE(naf->ZAMP(I)*EXP(ZI*naf->TFS(I)*T) )*/
+         i_compl_padd(naf->ZAMP+I,&ZA);
+         if (naf->IPRT==1)
          {
-           fprintf(g_NAFVariable.NFPRT," %g %g %g %g %g\n", g_NAFVariable.TFS[I],i_compl_module(g_NAFVariable.ZAMP[I]),g_NAFVariable.ZAMP[I].reel,
-                   g_NAFVariable.ZAMP[I].imag,atan2(g_NAFVariable.ZAMP[I].imag,g_NAFVariable.ZAMP[I].reel));
+           fprintf(naf->NFPRT," %g %g %g %g %g\n", naf->TFS[I],i_compl_module(naf->ZAMP[I]),naf->ZAMP[I].reel,
+                   naf->ZAMP[I].imag,atan2(naf->ZAMP[I].imag,naf->ZAMP[I].reel));
          }
-/*!-----------! ON RETIRE LA CONTRIBUTION TOTALE DU TERME g_NAFVariable.TFS(I) DANS TABS*/
-       if (g_NAFVariable.ICPLX==1)
+/*!-----------! ON RETIRE LA CONTRIBUTION TOTALE DU TERME naf->TFS(I) DANS TABS*/
+       if (naf->ICPLX==1)
        {
-         ZEX=i_compl_mul(ZA, i_compl_exp(i_compl_muldoubl(g_NAFVariable.T0-g_NAFVariable.XH,ZOM))); /*ZEX = ZA*EXP(ZOM*(g_NAFVariable.T0-g_NAFVariable.XH))*/
-         ZINC=i_compl_exp(i_compl_muldoubl(g_NAFVariable.XH,ZOM)); /*ZINC=EXP(ZOM*g_NAFVariable.XH)*/
-         naf_ztpow(g_NAFVariable.KTABS,64,ZT,ZINC,ZEX); /*naf_ztpow(g_NAFVariable.KTABS+1,64,ZT,ZINC,ZEX);*/
+         ZEX=i_compl_mul(ZA, i_compl_exp(i_compl_muldoubl(naf->T0-naf->XH,ZOM))); /*ZEX = ZA*EXP(ZOM*(naf->T0-naf->XH))*/
+         ZINC=i_compl_exp(i_compl_muldoubl(naf->XH,ZOM)); /*ZINC=EXP(ZOM*naf->XH)*/
+         naf_ztpow(naf->KTABS,64,ZT,ZINC,ZEX); /*naf_ztpow(naf->KTABS+1,64,ZT,ZINC,ZEX);*/
          /*v0.96 M. GASTINEAU 12/01/99 : optimisation*/
-         /*for(IT=0, pzarTabs=g_NAFVariable.ZTABS, pzarZT=ZT;
-             IT<=g_NAFVariable.KTABS;
+         /*for(IT=0, pzarTabs=naf->ZTABS, pzarZT=ZT;
+             IT<=naf->KTABS;
              IT++,pzarTabs++,pzarZT++)*//*remplacee par:*/
-         for(IT=0, pzarTabs=g_NAFVariable.ZTABS, pzarZT=ZT;
+         for(IT=0, pzarTabs=naf->ZTABS, pzarZT=ZT;
              IT<=ikTabs;
              IT++,pzarTabs++,pzarZT++) /*v0.96 M. GASTINEAU 12/01/99 : optimisation*/
          {
@@ -1663,18 +1812,18 @@ BOOL naf_gramsc(double FS, double A, double B)
        }
        else
        {
-         ZEX=i_compl_mul(ZA, i_compl_exp(i_compl_muldoubl(g_NAFVariable.T0-g_NAFVariable.XH,ZOM))); /*ZEX = ZA*EXP(ZOM*(g_NAFVariable.T0-g_NAFVariable.XH))*/
-         ZINC=i_compl_exp(i_compl_muldoubl(g_NAFVariable.XH,ZOM)); /*ZINC=EXP(ZOM*g_NAFVariable.XH)*/
-         naf_ztpow(g_NAFVariable.KTABS,64,ZT,ZINC,ZEX);/*naf_ztpow(g_NAFVariable.KTABS+1,64,ZT,ZINC,ZEX);*/
+         ZEX=i_compl_mul(ZA, i_compl_exp(i_compl_muldoubl(naf->T0-naf->XH,ZOM))); /*ZEX = ZA*EXP(ZOM*(naf->T0-naf->XH))*/
+         ZINC=i_compl_exp(i_compl_muldoubl(naf->XH,ZOM)); /*ZINC=EXP(ZOM*naf->XH)*/
+         naf_ztpow(naf->KTABS,64,ZT,ZINC,ZEX);/*naf_ztpow(naf->KTABS+1,64,ZT,ZINC,ZEX);*/
          /*v0.96 M. GASTINEAU 12/01/99 : optimisation*/
-         /*for(IT=0;IT<=g_NAFVariable.KTABS;IT++)*//*remplacee par:*/
+         /*for(IT=0;IT<=naf->KTABS;IT++)*//*remplacee par:*/
          /*v0.97 M. GASTINEAU 27/05/99 : ajout - correction bug si FS==0 */
          if (FS==0.E0)
          {
          for(IT=0;IT<=ikTabs;IT++)
          {
-           g_NAFVariable.ZTABS[IT].reel -= ZT[IT].reel; 
-           /*g_NAFVariable.ZTABS(IT+1)=g_NAFVariable.ZTABS(IT+1)- DREAL(ZT(IT+1)) */
+           naf->ZTABS[IT].reel -= ZT[IT].reel; 
+           /*naf->ZTABS(IT+1)=naf->ZTABS(IT+1)- DREAL(ZT(IT+1)) */
          }
          }
          else
@@ -1683,27 +1832,25 @@ BOOL naf_gramsc(double FS, double A, double B)
           /*v0.96 M. GASTINEAU 12/01/99 : fin optimisation*/
          {
            /*v0.96 M. GASTINEAU 12/01/99 : modification*/
-           /* g_NAFVariable.ZTABS[IT].reel -=ZT[IT].reel; *//*g_NAFVariable.ZTABS(IT+1)=g_NAFVariable.ZTABS(IT+1)- DREAL(ZT(IT+1)) */
+           /* naf->ZTABS[IT].reel -=ZT[IT].reel; *//*naf->ZTABS(IT+1)=naf->ZTABS(IT+1)- DREAL(ZT(IT+1)) */
            /*remplacee par:*/
-           g_NAFVariable.ZTABS[IT].reel -= 2*ZT[IT].reel; /*g_NAFVariable.ZTABS(IT+1)=g_NAFVariable.ZTABS(IT+1)- DREAL(ZT(IT+1)) */
+           naf->ZTABS[IT].reel -= 2*ZT[IT].reel; /*naf->ZTABS(IT+1)=naf->ZTABS(IT+1)- DREAL(ZT(IT+1)) */
            /*v0.96 M. GASTINEAU 12/01/99 : fin modification*/
          }
        }
       }
 #endif /*NAF_USE_OPTIMIZE==0*/
 /* v0.96 M. GASTINEAU 01/12/98 : fin optimisation */
-      SYSFREE(ZT);
-      SYSFREE(ZTEE);
       return TRUE;
 }/*      END SUBROUTINE GRAMSC*/
 
 
 /*      SUBROUTINE PROSCA(F1,F2,ZP)*/
-void naf_prosca(double F1, double F2, t_complexe* ZP)
+void naf_prosca(t_naf *naf, double F1, double F2, t_complexe* ZP)
 {
 /*!-----------------------------------------------------------------------
 !     PROSCA   CALCULE LE PRODUIT SCALAIRE  DE EXP(I*F1*T) PAR EXP (-I*F
-!               SUR L'INTERVALLE [0:g_NAFVariable.KTABS]  T=g_NAFVariable.T0+g_NAFVariable.XH*IT
+!               SUR L'INTERVALLE [0:naf->KTABS]  T=naf->T0+naf->XH*IT
 !              CALCUL ANALYTIQUE
 !     ZP        PRODUIT SCALAIRE COMPLEXE
 !     F1,F2     FREQUENCES EN "/AN
@@ -1711,7 +1858,7 @@ void naf_prosca(double F1, double F2, t_complexe* ZP)
 !-----------------------------------------------------------------------
       
       IMPLICIT NONE
-! (g_NAFVariable.KTABS,F1,F2,ZP)
+! (naf->KTABS,F1,F2,ZP)
       REAL (8) :: F1,F2
       complex (8) :: ZP
 !
@@ -1728,10 +1875,10 @@ void naf_prosca(double F1, double F2, t_complexe* ZP)
 #endif /*NAF_USE_OPTIMIZE==0*/
 /* v0.96 M. GASTINEAU 01/12/98 : fin modification*/
 /*!----------! FREQUENCES EN UNITE D'ANGLE PAR UNITE DE TEMPS*/
-      FR1=F1/g_NAFVariable.UNIANG;
-      FR2=F2/g_NAFVariable.UNIANG;
-      T1 =g_NAFVariable.T0;
-      T2 =g_NAFVariable.T0+g_NAFVariable.KTABS*g_NAFVariable.XH;
+      FR1=F1/naf->UNIANG;
+      FR2=F2/naf->UNIANG;
+      T1 =naf->T0;
+      T2 =naf->T0+naf->KTABS*naf->XH;
 /* v0.96 M. GASTINEAU 01/12/98 : utilisation des fonctions  complexes inlines et optimisation */
 #if NAF_USE_OPTIMIZE==0
       /*v0.96 M. GASTINEAU 01/12/98 : correction bug */
@@ -1756,11 +1903,11 @@ void naf_prosca(double F1, double F2, t_complexe* ZP)
       if(fabs(DIV)<1.E-10)
       {
          /*v0.96 M. GASTINEAU 19/11/98 : modification*/
-         /*fprintf(stdout, "g_NAFVariable.T0= %g, g_NAFVariable.XH=%g, g_NAFVariable.KTABS==%g\n",
-                   g_NAFVariable.T0,g_NAFVariable.XH,g_NAFVariable.KTABS);*/
+         /*fprintf(stdout, "naf->T0= %g, naf->XH=%g, naf->KTABS==%g\n",
+                   naf->T0,naf->XH,naf->KTABS);*/
          /*remplacee par:*/
-         fprintf(stdout, "g_NAFVariable.T0= %g, g_NAFVariable.XH=%g, g_NAFVariable.KTABS=%d\n",
-                 g_NAFVariable.T0, g_NAFVariable.XH, g_NAFVariable.KTABS);
+         fprintf(stdout, "naf->T0= %g, naf->XH=%g, naf->KTABS=%d\n",
+                 naf->T0, naf->XH, naf->KTABS);
          /*v0.96 M. GASTINEAU 19/11/98 : fin modification*/
          fprintf(stdout, "F1=%g ,F2=%g\n",F1,F2);
          fprintf(stdout, "T1= %g , T2= %g, T= %g\n",T1, T2, T);
@@ -1780,7 +1927,7 @@ void naf_prosca(double F1, double F2, t_complexe* ZP)
 }/*      END  SUBROUTINE PROSCA*/
       
 /*      FUNCTION FUNC(X)  */
-double naf_func(double X)
+double naf_func(t_naf *naf, double X)
 {
 /*      IMPLICIT NONE
 ! (X)
@@ -1789,12 +1936,12 @@ double naf_func(double X)
       REAL (8) ::RMD
 !            */
       double RMD;
-      naf_profre(X,&AF,&BF,&RMD);
+      naf_profre(naf, X,&naf->AF,&naf->BF,&RMD);
       return RMD;
 }/*      END FUNCTION FUNC*/
      
 /*      FUNCTION FUNCP(X)*/
-double naf_funcp(double X)
+double naf_funcp(t_naf *naf, double X)
 {
 /*      IMPLICIT NONE
 !  (X)
@@ -1803,12 +1950,12 @@ double naf_funcp(double X)
       REAL (8) :: DER, RMF
 ! */
       double DER, RMF;     
-      naf_proder(X,&DER,&AF,&BF,&RMF);
+      naf_proder(naf, X,&DER,&naf->AF,&naf->BF,&RMF);
       return DER;
 }/*      END FUNCTION FUNCP*/
 
 /*      SUBROUTINE PRODER(FS,DER,A,B,RM)*/
-void naf_proder(double FS, double *DER, double *A, double *B,double *RM)
+void naf_proder(t_naf *naf, double FS, double *DER, double *A, double *B,double *RM)
 {
 /*!***********************************************************************
 !  CE SOUS PROG. CALCULE LA DERIVEE DU CARRE DU MODULE DU PRODUIT 
@@ -1836,57 +1983,52 @@ void naf_proder(double FS, double *DER, double *A, double *B,double *RM)
       t_complexe ZI,ZAC,ZINC,ZEX,ZB,/*ZT,*/ZA;
       int LTF;
       t_complexe *ZTF=NULL;/*tableau de 1 a KTABS+1 */
-      SYSCHECKMALLOCSIZE(ZTF,t_complexe, g_NAFVariable.KTABS+1); /*allocate(ZTF(0:g_NAFVariable.KTABS),stat = NERROR)*/
+      ZTF=naf->m_pzWorkZTF; /* allocated by naf_initnaf */
 /* v0.96 M. GASTINEAU 01/12/98 : utilisation des fonctions  complexes inlines et optimisation */
 #if NAF_USE_OPTIMIZE==0
 /*!
 !------------------ CONVERSION DE FS EN RD/AN*/
-      OM=FS/g_NAFVariable.UNIANG;
+      OM=FS/naf->UNIANG;
       ZI=cmplx(0.E0,1.E0);
 /*!------------------ LONGUEUR DU TABLEAU A INTEGRER
 !------------------ DANS LE CAS REEL MEME CHOSE */
-      LTF=g_NAFVariable.KTABS;
-      ANG0=OM*g_NAFVariable.T0;
-      ANGI=OM*g_NAFVariable.XH;
+      LTF=naf->KTABS;
+      ANG0=OM*naf->T0;
+      ANGI=OM*naf->XH;
       ZAC = expcomplexe (muldoublcomplexe(-ANG0,ZI));
       ZINC=  expcomplexe (muldoublcomplexe(-ANGI,ZI));
       ZEX = divcomplexe(ZAC,ZINC); /*ZEX = ZAC/ZINC*/
-      naf_ztpow2(g_NAFVariable.KTABS,NVECT,ZTF,g_NAFVariable.ZTABS,TWIN,ZINC,ZEX); /*CALL  ZTPOW2(g_NAFVariable.KTABS+1,NVECT,ZTF,g_NAFVariable.ZTABS,TWIN,ZINC,ZEX)*/ 
+      naf_ztpow2(naf->KTABS,NVECT,ZTF,naf->ZTABS,naf->TWIN,ZINC,ZEX); /*CALL  ZTPOW2(naf->KTABS+1,NVECT,ZTF,naf->ZTABS,TWIN,ZINC,ZEX)*/ 
 /*!------------------ TAILLE DU PAS*/
       H=1.E0/((double)LTF);
       naf_zardyd(ZTF,LTF,H,&ZA);
       *A = ZA.reel;
       *B = ZA.imag;
       *RM=module(ZA);
-      naf_ztder(g_NAFVariable.KTABS,NVECT,ZTF,g_NAFVariable.ZTABS,TWIN,ZINC,ZEX,g_NAFVariable.T0,g_NAFVariable.XH); /*CALL ZTDER(g_NAFVariable.KTABS+1,NVECT,ZTF,g_NAFVariable.ZTABS,TWIN,ZINC,ZEX,g_NAFVariable.T0,g_NAFVariable.XH)*/
+      naf_ztder(naf->KTABS,NVECT,ZTF,naf->ZTABS,naf->TWIN,ZINC,ZEX,naf->T0,naf->XH); /*CALL ZTDER(naf->KTABS+1,NVECT,ZTF,naf->ZTABS,TWIN,ZINC,ZEX,naf->T0,naf->XH)*/
       naf_zardyd(ZTF,LTF,H,&ZB);
       *DER=(mulcomplexe(conjcomplexe(ZA),ZB)).imag*2.E0;
 #else /*remplacee par: */
 /*!
 !------------------ CONVERSION DE FS EN RD/AN*/
-      OM=FS/g_NAFVariable.UNIANG;
+      OM=FS/naf->UNIANG;
       i_compl_cmplx(&ZI,0.E0,1.E0);
 /*!------------------ LONGUEUR DU TABLEAU A INTEGRER
 !------------------ DANS LE CAS REEL MEME CHOSE */
-      LTF=g_NAFVariable.KTABS;
-      ANG0=OM*g_NAFVariable.T0;
-      ANGI=OM*g_NAFVariable.XH;
+      LTF=naf->KTABS;
+      ANG0=OM*naf->T0;
+      ANGI=OM*naf->XH;
       ZAC = i_compl_exp (i_compl_muldoubl(-ANG0,ZI));
       ZINC=  i_compl_exp (i_compl_muldoubl(-ANGI,ZI));
       ZEX = i_compl_div(ZAC,ZINC); /*ZEX = ZAC/ZINC*/
-      naf_ztpow2(g_NAFVariable.KTABS,NVECT,ZTF,g_NAFVariable.ZTABS,TWIN,ZINC,ZEX); /*CALL  ZTPOW2(g_NAFVariable.KTABS+1,NVECT,ZTF,g_NAFVariable.ZTABS,TWIN,ZINC,ZEX)*/ 
-/*!------------------ TAILLE DU PAS*/
-      H=1.E0/((double)LTF);
-      naf_zardyd(ZTF,LTF,H,&ZA);
+      /* ZTPOW2, ZTDER et les deux appels a ZARDYD en une seule passe */
+      naf_wprod(naf,naf->ZTABS,ZINC,ZEX,&ZA,&ZB);
       *A = ZA.reel;
       *B = ZA.imag;
       *RM=i_compl_module(ZA);
-      naf_ztder(g_NAFVariable.KTABS,NVECT,ZTF,g_NAFVariable.ZTABS,TWIN,ZINC,ZEX,g_NAFVariable.T0,g_NAFVariable.XH); /*CALL ZTDER(g_NAFVariable.KTABS+1,NVECT,ZTF,g_NAFVariable.ZTABS,TWIN,ZINC,ZEX,g_NAFVariable.T0,g_NAFVariable.XH)*/
-      naf_zardyd(ZTF,LTF,H,&ZB);
       *DER=(i_compl_mul(i_compl_conj(&ZA),ZB)).imag*2.E0;
 #endif /*NAF_USE_OPTIMIZE==0*/
 /* v0.96 M. GASTINEAU 01/12/98 : fin optimisation */
-      SYSFREE(ZTF);
 #undef NVECT
 }/*      END SUBROUTINE PRODER*/
 
@@ -1997,7 +2139,7 @@ void naf_ztder(int N, int N1, t_complexe *ZTF, t_complexe *ZTA, double *TW, t_co
 }/*      END SUBROUTINE ZTDER*/
       
 /*      SUBROUTINE SECANTES(X,PASS,EPS,XM,IPRT,NFPRT)*/
-void naf_secantes(double X, double PASS, double EPS, double *XM, int IPRT, FILE *NFPRT)
+void naf_secantes(t_naf *naf, double X, double PASS, double EPS, double *XM, int IPRT, FILE *NFPRT)
 {
 /*!      SUBROUTINE SECANTES(X,PASS,EPS,XM,FONC,IPRT,NFPRT)
 !***********************************************************
@@ -2008,9 +2150,9 @@ void naf_secantes(double X, double PASS, double EPS, double *XM, int IPRT, FILE
 !     EPS     : PRECISION AVEC LAQUELLE ON VA CALCULER
 !               LE MAXIMUM
 !     XM      : ABSCISSE DU  ZERO
-!    g_NAFVariable.IPRT     : -1 PAS D'IMPRESSION
+!    naf->IPRT     : -1 PAS D'IMPRESSION
 !               0: IMPRESSION D'UNE EVENTUELLE ERREUR FATALE
-!               1: IMPRESSION SUR LE FICHIER g_NAFVariable.NFPRT
+!               1: IMPRESSION SUR LE FICHIER naf->NFPRT
 !               2: IMPRESSION DES RESULTATS INTERMEDIAIRES
 !     
 !    FONC(X) :FONCTION DONNEE PAR L'UTILISATEUR
@@ -2048,8 +2190,8 @@ void naf_secantes(double X, double PASS, double EPS, double *XM, int IPRT, FILE
        int I;
        double EPSI,A,B,FA,FB,DELTA,COR;
        
-       g_NAFVariable.NERROR=0;
-       EPSI=MAX(g_NAFVariable.EPSM,EPS);
+       naf->NERROR=0;
+       EPSI=MAX(naf->EPSM,EPS);
        if (fabs(PASS)>EPSI)
        {
          if (IPRT>=1)
@@ -2060,14 +2202,14 @@ void naf_secantes(double X, double PASS, double EPS, double *XM, int IPRT, FILE
        I=0;
        A=X-PASS;
        B=X;
-       FB=naf_funcp(A);
+       FB=naf_funcp(naf, A);
 /*!      FB=FONC(A)*/
 /*10    CONTINUE*/
 SECANTES_10 :
        if (fabs(B-A)>EPSI)
        { 
           FA=FB;
-          FB=naf_funcp(B);
+          FB=naf_funcp(naf, B);
 /*! 	  FB=FONC(B)*/
           DELTA= FB-FA;
           if (IPRT>=2)
@@ -2075,9 +2217,9 @@ SECANTES_10 :
             fprintf(NFPRT,"SEC: A=%g, B=%g, abs(B-A)=%g \n", A, B,fabs(B-A));
             fprintf(NFPRT,"SEC: F(A)=%g, F(B)=%g\n", FA, FB);
           }
-          if (fabs(DELTA)<=g_NAFVariable.EPSM)
+          if (fabs(DELTA)<=naf->EPSM)
           {
-            g_NAFVariable.NERROR=2;
+            naf->NERROR=2;
             if (IPRT>=1)
             {
               fprintf(NFPRT,"ECHEC DE LA METHODE DES SECANTES\n");
@@ -2093,7 +2235,7 @@ SECANTES_10 :
           I++; /*I=I+1 */
           if (I>SECANTES_NMAX)
           {
-             g_NAFVariable.NERROR=3;
+             naf->NERROR=3;
              if (IPRT>=0)
              {
                fprintf(NFPRT,"ECHEC DE LA METHODE DES SECANTES\n");
@@ -2109,10 +2251,10 @@ SECANTES_10 :
        *XM=B;
        if (SECANTES_IENC==1)
        {
-            if (naf_funcp(B-EPSI)*naf_funcp(B+EPSI)>0.E0)
+            if (naf_funcp(naf, B-EPSI)*naf_funcp(naf, B+EPSI)>0.E0)
             {
 /*!           if (FONC(B-EPSI)*FONC(B+EPSI)>0.D0) {*/
-             g_NAFVariable.NERROR=1;
+             naf->NERROR=1;
            }
        }
        if (IPRT==1)
@@ -2124,11 +2266,11 @@ SECANTES_10 :
           /*v0.96 M. GASTINEAU 19/11/98 : fin modification*/
           if (SECANTES_IENC==1)
           {
-             if (g_NAFVariable.NERROR==1)
+             if (naf->NERROR==1)
              {
                 fprintf(NFPRT," SANS GARANTIE\n");
              }
-             if (g_NAFVariable.NERROR==0)
+             if (naf->NERROR==0)
              {
                 fprintf(NFPRT," AVEC GARANTIE\n");
              }
@@ -2144,7 +2286,7 @@ SECANTES_10 :
 }/*       END SUBROUTINE SECANTES*/
 
 /*      SUBROUTINE MAXIQUA(X,PASS,EPS,XM,YM,IPRT,NFPRT)*/
-void naf_maxiqua(double X, double PASS, double EPS, double *XM, double *YM, int IPRT, FILE *NFPRT)
+void naf_maxiqua(t_naf *naf, double X, double PASS, double EPS, double *XM, double *YM, int IPRT, FILE *NFPRT)
 {
 /*
 !      SUBROUTINE MAXIQUA(X,PASS,EPS,XM,YM,FONC,IPRT,NFPRT)
@@ -2169,7 +2311,7 @@ void naf_maxiqua(double X, double PASS, double EPS, double *XM, double *YM, int
 !  PARAMETRES
 !   NMAX     : NOMBRE MAXIMAL D'ITERATIONS
 !  VARIABLE (COMMON ASD)
-!   g_NAFVariable.NERROR:
+!   naf->NERROR:
 !        0 : OK
 !        1 : COURBURE BIEN FAIBLE !
 !        2 : LA FONCTION EST BIEN PLATE !
@@ -2212,7 +2354,7 @@ void naf_maxiqua(double X, double PASS, double EPS, double *XM, double *YM, int
 !* ENTRE 0 ET RABS LES ERREURS SONT ENVISAGEES DE FACON ABSOLUE
 !* APRES RABS, LES ERREURS SONT ENVISAGEES DE FACON RELATIVE.
 !*/
-      EPSLOC=MAX(EPS,sqrt(g_NAFVariable.EPSM));
+      EPSLOC=MAX(EPS,sqrt(naf->EPSM));
 /*!      
 !*  AU SOMMET D'UNE PARABOLE Y=Y0-A*(X-X0)**2, UN ECART DE X AUTOUR DE X0
 !*  INFERIEUR A EPSLOC DONNE UN ECART DE Y INFERIEUR A A*EPSLOC**2*/
@@ -2223,20 +2365,20 @@ void naf_maxiqua(double X, double PASS, double EPS, double *XM, double *YM, int
       PAS = PASS;
       NITER =0;
       NCALCUL=0;
-      g_NAFVariable.NERROR=0;
+      naf->NERROR=0;
       X2 = X;
-      Y2 = naf_func (X2);
+      Y2 = naf_func(naf, X2);
       X1 = X2 - PAS;
       X3 = X2 + PAS;
-      Y1 = naf_func (X1);
-      Y3 = naf_func (X3);
+      Y1 = naf_func(naf, X1);
+      Y3 = naf_func(naf, X3);
 /*!* DECALAGE POUR ENCADRER LE MAXIMUM*/
 MAXIQUA_10:
       if ((NITER>MAXIQUA_NMAX)||(NCALCUL>MAXIQUA_NFATAL))
       {
          if (NCALCUL>MAXIQUA_NFATAL)
          {
-            g_NAFVariable.NERROR =5;
+            naf->NERROR =5;
             if (IPRT>=0)
             {
                fprintf(NFPRT," ERREUR FATALE\n");
@@ -2246,7 +2388,7 @@ MAXIQUA_10:
          { 
            if (PAS>=PASS)
            {
-              g_NAFVariable.NERROR = 4;
+              naf->NERROR = 4;
               if (IPRT>=0)
               {
                 fprintf(NFPRT,"  PAS D''ENCADREMENT TROUVE\n");
@@ -2254,7 +2396,7 @@ MAXIQUA_10:
            } 
            else 
            {
-              g_NAFVariable.NERROR =3;
+              naf->NERROR =3;
               if (IPRT>=0)
               {
                 fprintf(NFPRT," OSCILLATION DE L''ENCADREMENT ?\n");
@@ -2279,8 +2421,8 @@ MAXIQUA_10:
             }
             X1 = X2 - PAS;
             X3 = X2 + PAS;
-            Y1 = naf_func (X1);
-            Y3 = naf_func (X3);
+            Y1 = naf_func(naf, X1);
+            Y3 = naf_func(naf, X3);
             goto MAXIQUA_10;
       }
       D1 = Y2-Y1;
@@ -2298,9 +2440,9 @@ MAXIQUA_10:
         }        
       }
 /*!* TEST POUR UN CALCUL SIGNifICATif DES VALEURS DE LA FONCTION*/
-      if ((fabs (D1-D2))<2.E0*g_NAFVariable.EPSM*MAX(MAXIQUA_RABS,fabs(Y2)))
+      if ((fabs (D1-D2))<2.E0*naf->EPSM*MAX(MAXIQUA_RABS,fabs(Y2)))
       {
-        g_NAFVariable.NERROR= 2;
+        naf->NERROR= 2;
         if (IPRT>=1)
         {
           fprintf(NFPRT," PLATEAU DE LA FONCTION\n");
@@ -2310,9 +2452,9 @@ MAXIQUA_10:
       }
 
 /*!* TEST SUR LA FORME DE LA COURBE */
-      if (A<g_NAFVariable.EPSM*MAX(MAXIQUA_RABS,fabs(Y2)))
+      if (A<naf->EPSM*MAX(MAXIQUA_RABS,fabs(Y2)))
       {
-         g_NAFVariable.NERROR= 1;
+         naf->NERROR= 1;
          if (IPRT>=1)
          {
           fprintf(NFPRT,"COURBE TROP PLATE\n");
@@ -2334,7 +2476,7 @@ MAXIQUA_10:
         } 
       DX= 0.5E0*PAS*(Y1-Y3)/(D2-D1);
 /*!* TEST POUR UN NOUVEAU PAS SIGNifICATif*/
-      if (fabs(DX)<g_NAFVariable.EPSM*MAX(MAXIQUA_RABS,fabs(X2)))
+      if (fabs(DX)<naf->EPSM*MAX(MAXIQUA_RABS,fabs(X2)))
       {
           if (IPRT>=1)
           {
@@ -2349,18 +2491,18 @@ MAXIQUA_10:
          X1 = X2;
          Y1 = Y2;
          X2 +=PAS; /*X2 = X2+PAS*/
-         Y2 = naf_func(X2);
+         Y2 = naf_func(naf, X2);
          X3 = X2 + PAS;
-         Y3 = naf_func(X3);
+         Y3 = naf_func(naf, X3);
       }
       else
       {
          X3 = X2;
          Y3 = Y2;
          X2 -=PAS; /*X2 = X2-PAS*/
-         Y2 = naf_func(X2);
+         Y2 = naf_func(naf, X2);
          X1 = X2 - PAS;
-         Y1 = naf_func(X1);
+         Y1 = naf_func(naf, X1);
       }
 /*!* A LA SORTIE DE CE CALCUL LE PAS DOIT ETRE DIVISE AU MOINS PAR 2 
 !! MAIS ON N'EST PAS ASSURE QUE LES VALEURS FINALES Y1,Y2,Y3 
@@ -2375,7 +2517,7 @@ MAXIQUA_EXIT :
          fprintf(NFPRT,"%12.8E %12.8E %12.8E\n", PAS,*XM,*YM);
          fprintf(NFPRT," POSITION TROUVEE A %g PRES\n",ERR); 
          TEMP =  fabs (Y3-Y2)+ fabs(Y2-Y1);
-         if (TEMP<2.E0*g_NAFVariable.EPSM*MAX(MAXIQUA_RABS,fabs(Y2)))
+         if (TEMP<2.E0*naf->EPSM*MAX(MAXIQUA_RABS,fabs(Y2)))
          {
             fprintf(NFPRT," TROUVEE SOUS UN PLATEAU DE LA FONCTION\n");
          } 
@@ -2387,7 +2529,7 @@ MAXIQUA_EXIT :
 
 /*      SUBROUTINE FREFIN (FR,A,B,RM, RPAS0,RPREC)*/
 /*v0.96 M. GASTINEAU 07/12/98 : modification car bug lors de l'optimisation sur Mac */
-void naf_frefin(double *FR, double *A, double *B, double *RM, const double RPAS0, const double RPREC)
+void naf_frefin(t_naf *naf, double *FR, double *A, double *B, double *RM, const double RPAS0, const double RPREC)
 {
 /*!-----------------------------------------------------------------------
 !     FREFIN            RECHERCHE FINE DE LA FREQUENCE
@@ -2418,27 +2560,27 @@ void naf_frefin(double *FR, double *A, double *B, double *RM, const double RPAS0
       EPS  = RPREC;
       X    = *FR;
    /*v0.96 M. GASTINEAU 07/12/98 : fin modification */
-      naf_maxiqua(X,PASS,EPS,&XM,&YM,g_NAFVariable.IPRT,g_NAFVariable.NFPRT);
-/*!     CALL MAXIQUA(X,PASS,EPS,XM,YM,FUNC,g_NAFVariable.IPRT,g_NAFVariable.NFPRT)
+      naf_maxiqua(naf, X,PASS,EPS,&XM,&YM,naf->IPRT,naf->NFPRT);
+/*!     CALL MAXIQUA(X,PASS,EPS,XM,YM,FUNC,naf->IPRT,naf->NFPRT)
 !************! AMELIORATION DE LA RECHERCHE PAR LE METHODE DES SECANTES
 !************!  APPLIQUEE A LA DERIVEE DU MODULE.*/
-      if (g_NAFVariable.ISEC==1)
+      if (naf->ISEC==1)
       {
          X=XM;
-         naf_secantes(X,PASS,EPS,&XM,g_NAFVariable.IPRT,g_NAFVariable.NFPRT);
-/*! 	 CALL SECANTES(X,PASS,EPS,XM,FUNCP,g_NAFVariable.IPRT,g_NAFVariable.NFPRT)*/
-         YM=naf_func(XM);
+         naf_secantes(naf, X,PASS,EPS,&XM,naf->IPRT,naf->NFPRT);
+/*! 	 CALL SECANTES(X,PASS,EPS,XM,FUNCP,naf->IPRT,naf->NFPRT)*/
+         YM=naf_func(naf, XM);
       }   
       *FR=XM;
       *RM=YM;
-      *A=AF;
-      *B=BF; 
-      if (g_NAFVariable.IPRT==1)
+      *A=naf->AF;
+      *B=naf->BF; 
+      if (naf->IPRT==1)
       {
        /*v0.96 M. GASTINEAU 19/11/98 : modification*/
-       /*fprintf(g_NAFVariable.NFPRT,"\n%10.6E %19.9E %19.9E %19.9E\n", FR,RM,AF,BF);*/
+       /*fprintf(naf->NFPRT,"\n%10.6E %19.9E %19.9E %19.9E\n", FR,RM,AF,BF);*/
        /*remplacee par:*/
-       fprintf(g_NAFVariable.NFPRT,"\n%10.6E %19.9E %19.9E %19.9E\n", *FR,*RM,AF,BF);
+       fprintf(naf->NFPRT,"\n%10.6E %19.9E %19.9E %19.9E\n", *FR,*RM,naf->AF,naf->BF);
        /*v0.96 M. GASTINEAU 19/11/98 : fin modification*/
       }
 /*1000  FORMAT (1X,F10.6,3D19.9)*/
@@ -2447,7 +2589,7 @@ void naf_frefin(double *FR, double *A, double *B, double *RM, const double RPAS0
 
 
 /*      SUBROUTINE PROFRE(FS,A,B,RMD)*/
-BOOL naf_profre(double FS, double *A, double *B, double *RMD)
+BOOL naf_profre(t_naf *naf, double FS, double *A, double *B, double *RMD)
 {
 /*!***********************************************************************
 !  CE SOUS PROG. CALCULE LE PRODUIT SCALAIRE DE EXP(-I*FS)*T PAR TAB(0:7
@@ -2458,7 +2600,7 @@ BOOL naf_profre(double FS, double *A, double *B, double *RMD)
 !***********************************************************************
       
       IMPLICIT NONE
-! (g_NAFVariable.KTABS,FS,A,B,RMD)
+! (naf->KTABS,FS,A,B,RMD)
       REAL (8) :: FS,A,B,RMD
 !
       integer :: LTF
@@ -2471,10 +2613,9 @@ BOOL naf_profre(double FS, double *A, double *B, double *RMD)
       t_complexe ZI,ZAC,ZINC,ZEX,ZA;
       t_complexe *ZTF=NULL;
 
-      SYSCHECKMALLOCSIZE(ZTF, t_complexe, g_NAFVariable.KTABS+1); /*allocate(ZTF(0:g_NAFVariable.KTABS),stat = g_NAFVariable.NERROR)*/
 /*!
 !------------------ CONVERSION DE FS EN RD/AN*/
-      OM=FS/g_NAFVariable.UNIANG ;
+      OM=FS/naf->UNIANG ;
 /* v0.96 M. GASTINEAU 01/12/98 : utilisation des fonctions  complexes inlines et optimisation */
 #if NAF_USE_OPTIMIZE==0
       ZI=cmplx(0.E0,1.E0);
@@ -2484,9 +2625,9 @@ BOOL naf_profre(double FS, double *A, double *B, double *RMD)
 /* v0.96 M. GASTINEAU 01/12/98 : fin optimisation */
 /*!------------------ LONGUEUR DU TABLEAU A INTEGRER
 !------------------ DANS LE CAS REEL MEME CHOSE */
-      LTF=g_NAFVariable.KTABS;
-      ANG0=OM*g_NAFVariable.T0;
-      ANGI=OM*g_NAFVariable.XH;
+      LTF=naf->KTABS;
+      ANG0=OM*naf->T0;
+      ANGI=OM*naf->XH;
 /* v0.96 M. GASTINEAU 01/12/98 : utilisation des fonctions  complexes inlines et optimisation */
 #if NAF_USE_OPTIMIZE==0
       ZAC = expcomplexe (muldoublcomplexe(-ANG0,ZI));
@@ -2498,14 +2639,21 @@ BOOL naf_profre(double FS, double *A, double *B, double *RMD)
       ZEX = i_compl_div(ZAC,ZINC);
 #endif /*NAF_USE_OPTIMIZE==0*/
 /* v0.96 M. GASTINEAU 01/12/98 : fin optimisation */
-      naf_ztpow2(g_NAFVariable.KTABS,64,ZTF,g_NAFVariable.ZTABS,TWIN,ZINC,ZEX); /*CALL  ZTPOW2(g_NAFVariable.KTABS+1,64,ZTF,g_NAFVariable.ZTABS,TWIN,ZINC,ZEX)*/
+#if NAF_USE_OPTIMIZE==0
+      ZTF=naf->m_pzWorkZTF; /* allocated by naf_initnaf */
+      naf_ztpow2(naf->KTABS,64,ZTF,naf->ZTABS,naf->TWIN,ZINC,ZEX); /*CALL  ZTPOW2(naf->KTABS+1,64,ZTF,naf->ZTABS,TWIN,ZINC,ZEX)*/
 /*!------------------ TAILLE DU PAS*/
       H=1.E0/((double)LTF);
       if (naf_zardyd(ZTF,LTF,H,&ZA)==FALSE)
       {
-       SYSFREE(ZTF);
        return FALSE;
       }
+#else /*remplacee par:*/
+      if (naf_wprod(naf,naf->ZTABS,ZINC,ZEX,&ZA,NULL)==FALSE)
+      {
+       return FALSE;
+      }
+#endif /*NAF_USE_OPTIMIZE==0*/
 /* v0.96 M. GASTINEAU 01/12/98 : utilisation des fonctions  complexes inlines et optimisation */
 #if NAF_USE_OPTIMIZE==0
       *RMD=module(ZA);
@@ -2515,7 +2663,6 @@ BOOL naf_profre(double FS, double *A, double *B, double *RMD)
 /* v0.96 M. GASTINEAU 01/12/98 : fin optimisation */
       *A = ZA.reel;
       *B = ZA.imag;
-      SYSFREE(ZTF);
       return TRUE;
 }/*      END SUBROUTINE PROFRE*/
 
@@ -2623,7 +2770,7 @@ void naf_ztpow2(int N, int N1, t_complexe *ZTF, t_complexe *ZTA, double *TW, t_c
 /*      SUBROUTINE INIWIN*/
 /*v0.96 M. GASTINEAU 18/12/98 : modification du prototype */
 /*void naf_iniwin()*//*remplacee par: */
-void naf_iniwin(double *p_pardTWIN)
+void naf_iniwin(t_naf *naf, double *p_pardTWIN)
 /*v0.96 M. GASTINEAU 18/12/98 : fin modification */
 {
 /*!******************************************************************
@@ -2643,7 +2790,7 @@ void naf_iniwin(double *p_pardTWIN)
 !     IW = -1  EXPONENTIAL WINDOW PHI(T) = 1/CE*EXP(-1/(1-T^2))
 !
 !     MODif LE 22/4/98 POUR CALCUL EN PLUS DE L'EPSILON MACHINE 
-!     g_NAFVariable.EPSM 
+!     naf->EPSM 
 !      26/5/98 CORRECTION DE L'ORIGINE DES TABLEAUX (*m/4)
 !******************************************************************
 !
@@ -2660,13 +2807,13 @@ void naf_iniwin(double *p_pardTWIN)
       CE= 0.22199690808403971891E0;
 /*!
 !      PI=ATAN2(1.D0,0.E0)*2.E0*/
-      T1=g_NAFVariable.T0;
-      T2=g_NAFVariable.T0+g_NAFVariable.KTABS*g_NAFVariable.XH;
+      T1=naf->T0;
+      T2=naf->T0+naf->KTABS*naf->XH;
       TM=(T2-T1)/2;
       PIST=M_PI/TM;
-      if (g_NAFVariable.IW==0)
+      if (naf->IW==0)
       {
-         for(IT=0;IT<=g_NAFVariable.KTABS;IT++)
+         for(IT=0;IT<=naf->KTABS;IT++)
          {
            /*v0.96 M. GASTINEAU 18/12/98 : modification */
            /* TWIN[IT]=1.E0; *//*remplacee par:*/
@@ -2674,35 +2821,35 @@ void naf_iniwin(double *p_pardTWIN)
            /*v0.96 M. GASTINEAU 18/12/98 : fin modification */
          }
       }
-      else if(g_NAFVariable.IW>=0)
+      else if(naf->IW>=0)
        {
          CN = 1.E0;
-         for(I = 1;I<=g_NAFVariable.IW;I++)
+         for(I = 1;I<=naf->IW;I++)
          {
-            CN *= I*(2.E0/((double)(g_NAFVariable.IW+I))); /*CN = CN*2.D0*I*1.D0/(g_NAFVariable.IW+I)*/
+            CN *= I*(2.E0/((double)(naf->IW+I))); /*CN = CN*2.D0*I*1.D0/(naf->IW+I)*/
          };       
-         for(IT=0;IT<=g_NAFVariable.KTABS;IT++)
+         for(IT=0;IT<=naf->KTABS;IT++)
          {
-            T=IT*g_NAFVariable.XH-TM;
+            T=IT*naf->XH-TM;
            /*v0.96 M. GASTINEAU 18/12/98 : modification */
-            /*TWIN[IT]=CN*pow((1.E0+cos(T*PIST)),g_NAFVariable.IW);*/
+            /*TWIN[IT]=CN*pow((1.E0+cos(T*PIST)),naf->IW);*/
             /*remplacee par:*/
-            p_pardTWIN[IT]=CN*pow((1.E0+cos(T*PIST)),g_NAFVariable.IW);
+            p_pardTWIN[IT]=CN*pow((1.E0+cos(T*PIST)),naf->IW);
            /*v0.96 M. GASTINEAU 18/12/98 : fin modification */
          }
       }
-      else if(g_NAFVariable.IW==-1)
+      else if(naf->IW==-1)
        {
          /*v0.96 M. GASTINEAU 18/12/98 : modification */
         /* TWIN[0] =0.E0;
-         TWIN[g_NAFVariable.KTABS] =0.E0;*/
+         TWIN[naf->KTABS] =0.E0;*/
          /*remplacee par:*/
          p_pardTWIN[0] =0.E0;
-         p_pardTWIN[g_NAFVariable.KTABS] =0.E0;
+         p_pardTWIN[naf->KTABS] =0.E0;
          /*v0.96 M. GASTINEAU 18/12/98 : fin modification */
-         for(IT=1; IT<=g_NAFVariable.KTABS-1; IT++)
+         for(IT=1; IT<=naf->KTABS-1; IT++)
          {
-            T=(IT*g_NAFVariable.XH-TM)/TM;
+            T=(IT*naf->XH-TM)/TM;
             /*v0.96 M. GASTINEAU 18/12/98 : modification */
             /* TWIN[IT]= exp(-1.E0/(1.E0-T*T))/CE;*/
             /*remplacee par:*/
@@ -2710,15 +2857,15 @@ void naf_iniwin(double *p_pardTWIN)
             /*v0.96 M. GASTINEAU 18/12/98 : fin modification */
          }
       }
-      if (g_NAFVariable.IPRT==1)
+      if (naf->IPRT==1)
       {
 /*!----------------   IMPRESSION TEMOIN*/
-         for(IT=0; IT<=g_NAFVariable.KTABS; (g_NAFVariable.KTABS>20?IT+=g_NAFVariable.KTABS/20:IT++))
+         for(IT=0; IT<=naf->KTABS; (naf->KTABS>20?IT+=naf->KTABS/20:IT++))
          {
             /*v0.96 M. GASTINEAU 18/12/98 : modification */
-            /*fprintf(g_NAFVariable.NFPRT,"%20.3E\n", TWIN[IT]*1.E6);*/
+            /*fprintf(naf->NFPRT,"%20.3E\n", TWIN[IT]*1.E6);*/
             /*remplacee par:*/
-            fprintf(g_NAFVariable.NFPRT,"%20.3E\n", p_pardTWIN[IT]*1.E6);
+            fprintf(naf->NFPRT,"%20.3E\n", p_pardTWIN[IT]*1.E6);
             /*v0.96 M. GASTINEAU 18/12/98 : fin modification */
          }
       }
@@ -2853,12 +3000,12 @@ BOOL naf_zardyd(t_complexe *ZT, int N, double H, t_complexe *ZOM)
 
 
 /*      SUBROUTINE PROSCAA(F1,F2,ZP)*/
-BOOL naf_proscaa(double F1, double F2, t_complexe *ZP)
+BOOL naf_proscaa(t_naf *naf, double F1, double F2, t_complexe *ZP)
 {
 /*!-----------------------------------------------------------------------
 !     PROSCAA   CALCULE LE PRODUIT SCALAIRE 
 !           < EXP(I*F1*T),  EXP(I*F2*T)>
-!               SUR L'INTERVALLE [0:g_NAFVariable.KTABS]  T=g_NAFVariable.T0+g_NAFVariable.XH*IT
+!               SUR L'INTERVALLE [0:naf->KTABS]  T=naf->T0+naf->XH*IT
 !              CALCUL NUMERIQUE
 !     ZP        PRODUIT SCALAIRE COMPLEXE
 !     F1,F2     FREQUENCES EN "/AN
@@ -2866,7 +3013,7 @@ BOOL naf_proscaa(double F1, double F2, t_complexe *ZP)
 !-----------------------------------------------------------------------
       
       IMPLICIT NONE
-! (g_NAFVariable.KTABS,F1,F2,ZP)
+! (naf->KTABS,F1,F2,ZP)
       REAL (8) :: F1,F2
       complex (8) :: ZP
 !
@@ -2881,43 +3028,45 @@ BOOL naf_proscaa(double F1, double F2, t_complexe *ZP)
       t_complexe ZI,ZAC,ZINC,ZEX;
       t_complexe *ZTF=NULL;
       
-      SYSCHECKMALLOCSIZE(ZTF, t_complexe, g_NAFVariable.KTABS+1); /*allocate(ZTF(0:g_NAFVariable.KTABS),stat = nerror)*/
+      ZTF=naf->m_pzWorkZTF; /* allocated by naf_initnaf */
 /* v0.96 M. GASTINEAU 01/12/98 : utilisation des fonctions  complexes inlines et optimisation */
 #if NAF_USE_OPTIMIZE==0
       ZI=cmplx(0.E0,1.E0);
 /*!----------! FREQUENCES EN UNITE D'ANGLE PAR UNITE DE TEMPS*/
-      OM = (F1-F2)/g_NAFVariable.UNIANG;
-      LTF=g_NAFVariable.KTABS;
-      ANG0=OM*g_NAFVariable.T0;
-      ANGI=OM*g_NAFVariable.XH;
+      OM = (F1-F2)/naf->UNIANG;
+      LTF=naf->KTABS;
+      ANG0=OM*naf->T0;
+      ANGI=OM*naf->XH;
       ZAC= expcomplexe(muldoublcomplexe(-ANG0, ZI)); /*ZAC = EXP (-ZI*ANG0)*/
       ZINC=expcomplexe(muldoublcomplexe(-ANGI, ZI)); /*ZINC= EXP (-ZI*ANGI)*/
       ZEX= divcomplexe(ZAC, ZINC); /*ZEX = ZAC/ZINC*/      
-      naf_ztpow2a(g_NAFVariable.KTABS,64,ZTF,TWIN,ZINC,ZEX);/*CALL  ZTPOW2A(g_NAFVariable.KTABS+1,64,ZTF,TWIN,ZINC,ZEX)*/
+      naf_ztpow2a(naf->KTABS,64,ZTF,naf->TWIN,ZINC,ZEX);/*CALL  ZTPOW2A(naf->KTABS+1,64,ZTF,TWIN,ZINC,ZEX)*/
 #else/*remplacee par:*/
       i_compl_cmplx(&ZI,0.E0,1.E0);
 /*!----------! FREQUENCES EN UNITE D'ANGLE PAR UNITE DE TEMPS*/
-      OM = (F1-F2)/g_NAFVariable.UNIANG;
-      LTF=g_NAFVariable.KTABS;
-      ANG0=OM*g_NAFVariable.T0;
-      ANGI=OM*g_NAFVariable.XH;
+      OM = (F1-F2)/naf->UNIANG;
+      LTF=naf->KTABS;
+      ANG0=OM*naf->T0;
+      ANGI=OM*naf->XH;
       ZAC= i_compl_exp(i_compl_muldoubl(-ANG0, ZI)); /*ZAC = EXP (-ZI*ANG0)*/
       ZINC=i_compl_exp(i_compl_muldoubl(-ANGI, ZI)); /*ZINC= EXP (-ZI*ANGI)*/
       ZEX= i_compl_div(ZAC, ZINC); /*ZEX = ZAC/ZINC*/      
-      naf_ztpow2a(g_NAFVariable.KTABS,64,ZTF,TWIN,ZINC,ZEX);/*CALL  ZTPOW2A(g_NAFVariable.KTABS+1,64,ZTF,TWIN,ZINC,ZEX)*/
+      /*naf_ztpow2a(naf->KTABS,64,ZTF,naf->TWIN,ZINC,ZEX);*//*CALL  ZTPOW2A(naf->KTABS+1,64,ZTF,TWIN,ZINC,ZEX)*/
+      /*remplacee par:*/
+      return naf_wprod(naf,NULL,ZINC,ZEX,ZP,NULL);
 #endif /*NAF_USE_OPTIMIZE==0*/
 /* v0.96 M. GASTINEAU 01/12/98 : fin optimisation */
 
+#if NAF_USE_OPTIMIZE==0
 /*!------------------ TAILLE DU PAS*/
       H=1.E0/LTF;
       /*CALL ZARDYD(ZTF,LTF+1,H,ZP)*/
       if (naf_zardyd(ZTF,LTF,H,ZP)==FALSE)
       { 
-       SYSFREE(ZTF);
        return FALSE;
       }
-      SYSFREE(ZTF);
       return TRUE; 
+#endif /*NAF_USE_OPTIMIZE==0*/
 }/*      END SUBROUTINE PROSCAA*/
 
 /*      SUBROUTINE ZTPOW2A (N,N1,ZTF,TW,ZA,ZAST)*/
@@ -3017,7 +3166,7 @@ void naf_ztpow2a(int N, int N1, t_complexe *ZTF, double *TW, t_complexe ZA, t_co
 }/*      END SUBROUTINE ZTPOW2A*/
 
 /*      SUBROUTINE CORRECTION(FREQ)*/
-void naf_correction(double *FREQ)
+void naf_correction(t_naf *naf, double *FREQ)
 {
 /*!------------------------------------------------------------------
 !   RETOURNE LA PREMIERE FREQUENCE (FREQ) CORRIGE PAR LES SUIVANTES
@@ -3039,56 +3188,56 @@ void naf_correction(double *FREQ)
       double TL,TM2,PICARRE,TM,FACTEUR,A,COR,OMEGA,DELTA;
       t_complexe ZI,ZALPHA;
       
-      TL=g_NAFVariable.KTABS*g_NAFVariable.XH*0.5E0;
+      TL=naf->KTABS*naf->XH*0.5E0;
       TM2=1.E0/(TL*TL);
       PICARRE=M_PI*M_PI;
-/*!  g_NAFVariable.IW >= 1*/
-      TM=g_NAFVariable.T0+TL;
+/*!  naf->IW >= 1*/
+      TM=naf->T0+TL;
       i_compl_cmplx(&ZI,0.E0,1.E0);
-      if (g_NAFVariable.IW>=0)
+      if (naf->IW>=0)
       {
          FACTEUR = -TM2;
          A=-1.E0/3.E0;
-         for(I=1;I<=g_NAFVariable.IW;I++)
+         for(I=1;I<=naf->IW;I++)
          {
             FACTEUR *= -PICARRE*TM2*(I*I);  /*FACTEUR=-FACTEUR*PICARRE*TM2*(I**2)*/
             A+=2.E0/(PICARRE*I*I); /*A=A+2.D0/(PICARRE*I**2) */
          }
          FACTEUR /=A; /*FACTEUR = FACTEUR/A*/
          COR=0.E0;
-         for(I=2;I<=g_NAFVariable.NFS;I++)
+         for(I=2;I<=naf->NFS;I++)
          {
-          OMEGA=(g_NAFVariable.TFS[I]-g_NAFVariable.TFS[1])/g_NAFVariable.UNIANG;
+          OMEGA=(naf->TFS[I]-naf->TFS[1])/naf->UNIANG;
 /* v0.96 M. GASTINEAU 01/12/98 : utilisation des fonctions  complexes inlines et optimisation */
 #if NAF_USE_OPTIMIZE==0
-          ZALPHA = mulcomplexe(divcomplexe(g_NAFVariable.ZAMP[I],g_NAFVariable.ZAMP[1]), expcomplexe(muldoublcomplexe(OMEGA*TM,ZI))); /*ZALPHA=g_NAFVariable.ZAMP[I]/g_NAFVariable.ZAMP[1]*EXP(ZI*OMEGA*TM)*/
+          ZALPHA = mulcomplexe(divcomplexe(naf->ZAMP[I],naf->ZAMP[1]), expcomplexe(muldoublcomplexe(OMEGA*TM,ZI))); /*ZALPHA=naf->ZAMP[I]/naf->ZAMP[1]*EXP(ZI*OMEGA*TM)*/
 #else /*remplacee par:*/
-          ZALPHA = i_compl_mul(i_compl_div(g_NAFVariable.ZAMP[I],g_NAFVariable.ZAMP[1]), 
+          ZALPHA = i_compl_mul(i_compl_div(naf->ZAMP[I],naf->ZAMP[1]), 
                                i_compl_exp(i_compl_muldoubl(OMEGA*TM,ZI))); 
-          /*ZALPHA=g_NAFVariable.ZAMP[I]/g_NAFVariable.ZAMP[1]*EXP(ZI*OMEGA*TM)*/
+          /*ZALPHA=naf->ZAMP[I]/naf->ZAMP[1]*EXP(ZI*OMEGA*TM)*/
 #endif /*NAF_USE_OPTIMIZE==0*/
 /* v0.96 M. GASTINEAU 01/12/98 : fin optimisation */
-          DELTA=FACTEUR*ZALPHA.reel/(pow(OMEGA,(2*g_NAFVariable.IW+1)))*cos(OMEGA*TL); /*DELTA=FACTEUR*DREAL(ZALPHA)/OMEGA**(2*g_NAFVariable.IW+1)*COS(OMEGA*TL)*/
+          DELTA=FACTEUR*ZALPHA.reel/(pow(OMEGA,(2*naf->IW+1)))*cos(OMEGA*TL); /*DELTA=FACTEUR*DREAL(ZALPHA)/OMEGA**(2*naf->IW+1)*COS(OMEGA*TL)*/
           COR += DELTA; /*COR=COR+DELTA*/
-          if (g_NAFVariable.IPRT>=2)
+          if (naf->IPRT>=2)
           {
-             fprintf(g_NAFVariable.NFPRT,"OMEGA=%g, DELTA=%g ,COR=%g\n",OMEGA,DELTA,COR);
+             fprintf(naf->NFPRT,"OMEGA=%g, DELTA=%g ,COR=%g\n",OMEGA,DELTA,COR);
           }
          }
-         COR *= g_NAFVariable.UNIANG; /*COR=COR*g_NAFVariable.UNIANG*/
-         *FREQ=g_NAFVariable.TFS[1]+COR;
-         if (g_NAFVariable.IPRT>=1)
+         COR *= naf->UNIANG; /*COR=COR*naf->UNIANG*/
+         *FREQ=naf->TFS[1]+COR;
+         if (naf->IPRT>=1)
          {
-           fprintf(g_NAFVariable.NFPRT,"CORRECTION DE LA 1ERE FREQUENCE\n");  
-           fprintf(g_NAFVariable.NFPRT, "FREQ. DE DEPART=%20.15E, CORRECTION=%20.15E\n",g_NAFVariable.TFS[1],COR);
-           fprintf(g_NAFVariable.NFPRT, "FREQUENCE CORRIGEE:%20.15E\n", *FREQ);
+           fprintf(naf->NFPRT,"CORRECTION DE LA 1ERE FREQUENCE\n");  
+           fprintf(naf->NFPRT, "FREQ. DE DEPART=%20.15E, CORRECTION=%20.15E\n",naf->TFS[1],COR);
+           fprintf(naf->NFPRT, "FREQUENCE CORRIGEE:%20.15E\n", *FREQ);
          }
       } 
       else 
       {
-          if (g_NAFVariable.IPRT>=0) 
+          if (naf->IPRT>=0) 
           {
-             fprintf(g_NAFVariable.NFPRT, "PAS DE CALCUL\n");
+             fprintf(naf->NFPRT, "PAS DE CALCUL\n");
           }
       }
 }/*      END SUBROUTINE CORRECTION*/
@@ -3,6 +3,9 @@
 #define _USE_MATH_DEFINES	/* For Visual Studio */
 #include <math.h>
 #include <float.h>
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
 
 /*--------*/
 /* define */
@@ -95,25 +98,33 @@ struct stnaf
  /* v0.96 M. GASTINEAU 06/01/99 : ajout */
  t_list_fenetre_naf *m_pListFen; /*liste des fenetres */
  /* v0.96 M. GASTINEAU 06/01/99 : fin ajout */
+
+ /* private state, formerly static variables of modnaff.c */
+ double AF,BF;
+ double *TWIN;
+ /* work arrays allocated by naf_initnaf */
+ int m_iKTABS2;           /* number of samples transformed by naf_fftmax */
+ double *m_pdWorkTAB;
+ double *m_pdWorkRTAB;
+ double *m_pdWorkFFT;     /* chirp tables for a non power of 2 FFT length */
+ double *m_pdWorkTWH;     /* window times Hardy integration weights */
+ t_complexe *m_pzWorkZT;
+ t_complexe *m_pzWorkZTF;
+ t_complexe *m_pzWorkZTEE;
 };
 
 typedef struct stnaf t_naf;
 /*v0.96 M. GASTINEAU 04/09/98 : fin ajout */
 
 
-/*-----------------*/
-/*variable globale */
-/*-----------------*/
-extern t_naf g_NAFVariable;
-extern double pi;
-
-
 /*-----------------*/
 /* public functions*/
 /*-----------------*/
-void naf_initnaf_notab();
-void naf_cleannaf_notab();
-void naf_initnaf();
-void naf_cleannaf();
-BOOL naf_mftnaf(int NBTERM, double EPS);
-void naf_prtabs(int KTABS, t_complexe *ZTABS, int IPAS);
+/* All the state of an analysis is kept in the t_naf context given to  */
+/* each function: independent contexts may be used in parallel threads */
+void naf_initnaf_notab(t_naf *naf);
+void naf_cleannaf_notab(t_naf *naf);
+void naf_initnaf(t_naf *naf);
+void naf_cleannaf(t_naf *naf);
+BOOL naf_mftnaf(t_naf *naf, int NBTERM, double EPS);
+void naf_prtabs(t_naf *naf, int KTABS, t_complexe *ZTABS, int IPAS);
@@ -6,20 +6,30 @@
  * 3 - optional outputs: amplitude and phase
  *
  * known NAFF bugs: data length has to be at least 64
+ *
+ * The analysis context is allocated once and reused for all the signals
+ * of a call. Several signals given as the columns of a matrix are analysed
+ * in parallel, each thread using its own context.
  */
 
+#if defined(PYAT)
+#include "atcommon.h"
+#endif
 #include <stdio.h>
 #include <string.h>
 #include <math.h>
+#if defined(MATLAB_MEX_FILE)
 #include "mex.h"
 #ifndef OCTAVE
 #include "matrix.h"
 #endif
+#endif
 /* #include "gpfunc.h" */
 #include "modnaff.h"
 #include "complexe.h"
 /* #include <sys/ddi.h> */
 
+#if defined(MATLAB_MEX_FILE)
 /* Get ready for R2018a C matrix API */
 #ifndef mxGetDoubles
 #define mxGetDoubles mxGetPr
@@ -38,76 +48,70 @@ typedef double mxDouble;
 #define	NU_OUT plhs[0]
 #define	AMPLITUDE_OUT plhs[1]
 #define	PHASE_OUT plhs[2]
+#endif /*MATLAB_MEX_FILE*/
 
-unsigned int call_naff(double *ydata, double *ypdata, int ndata, double  *nu_out,
-double *amplitude_out, double *phase_out, int win, int nfreq, int debug)
+static void naff_init(t_naf *naf, int ndata, int win, int nfreq)
+/* Set the parameters of the analysis and allocate the context */
 {
-    int i, iCpt;
-    unsigned int numfreq;
-    double *d_in, *d_out;
-    t_complexe *c_in;
+    /* The Hardy integration needs KTABS+1 samples, KTABS being a multiple of 6:
+       at most 5 samples are ignored */
+    int ktabs = 6*((ndata-1)/6);
     
-    /* ndata is truncated to be a multiple of 6 if is not yet) */
-    ndata = 6*(int )(ndata/6.0);
-    
-    g_NAFVariable.DTOUR=2*M_PI; /* size of a "cadran" */
-    g_NAFVariable.XH=1;         /* step */
-    g_NAFVariable.T0=0;         /* time t0 */
-    g_NAFVariable.NTERM=nfreq;     /* max term to find */
-    g_NAFVariable.KTABS=ndata;  /* number of data : must be a multiple of 6 */
-    g_NAFVariable.m_pListFen=NULL; /*no window*/
-    g_NAFVariable.TFS=NULL;    /* will contain frequency */
-    g_NAFVariable.ZAMP=NULL;   /* will contain amplitude */
-    g_NAFVariable.ZTABS=NULL;  /* will contain data to analyze */
+    naf->DTOUR=2*M_PI; /* size of a "cadran" */
+    naf->XH=1;         /* step */
+    naf->T0=0;         /* time t0 */
+    naf->NTERM=nfreq;     /* max term to find */
+    naf->KTABS=ktabs;  /* number of intervals : must be a multiple of 6 */
+    naf->m_pListFen=NULL; /*no window*/
+    naf->TFS=NULL;    /* will contain frequency */
+    naf->ZAMP=NULL;   /* will contain amplitude */
+    naf->ZTABS=NULL;  /* will contain data to analyze */
     
  /*internal use in naf */
-    g_NAFVariable.NERROR=0;
-    g_NAFVariable.ICPLX=1;
-    g_NAFVariable.IPRT=-1; /*0*/
-    g_NAFVariable.NFPRT=stdout; /*NULL;*/
-    g_NAFVariable.NFS=0;
-    g_NAFVariable.IW=win;
-    g_NAFVariable.ISEC=1;
-    g_NAFVariable.EPSM=2.2204e-16;
-    g_NAFVariable.UNIANG=0;
-    g_NAFVariable.FREFON=0;
-    g_NAFVariable.ZALP=NULL;
-    g_NAFVariable.m_iNbLineToIgnore=1; /*unused*/
-    g_NAFVariable.m_dneps=1.E100;
-    g_NAFVariable.m_bFSTAB=FALSE; /*unused*/
+    naf->NERROR=0;
+    naf->ICPLX=1;
+    naf->IPRT=-1; /*0*/
+    naf->NFPRT=stdout; /*NULL;*/
+    naf->NFS=0;
+    naf->IW=win;
+    naf->ISEC=1;
+    naf->EPSM=2.2204e-16;
+    naf->UNIANG=0;
+    naf->FREFON=0;
+    naf->ZALP=NULL;
+    naf->m_iNbLineToIgnore=1; /*unused*/
+    naf->m_dneps=1.E100;
+    naf->m_bFSTAB=FALSE; /*unused*/
  /*end of internal use in naf */
     
-    naf_initnaf();
+    naf_initnaf(naf);
+}
+
+static unsigned int naff_analyze(t_naf *naf, const double *ydata, const double *ypdata,
+        double *nu_out, double *amplitude_out, double *phase_out)
+/* Analysis of one signal in an initialised context. The context may be
+   reused for any number of signals */
+{
+    int i, iCpt;
+    unsigned int numfreq;
+    double *d_in;
+    t_complexe *c_in;
     
  /*Transform initial data to complex data since algorithm is optimized for cx data*/
-    for (i=0;i<ndata;i++) {
-        g_NAFVariable.ZTABS[i].reel = ydata[i];
-        g_NAFVariable.ZTABS[i].imag = ypdata[i];
+    for (i=0;i<=naf->KTABS;i++) {
+        naf->ZTABS[i].reel = ydata[i];
+        naf->ZTABS[i].imag = ypdata[i];
     }
     
     /*Frequency map analysis*/
     /* look for at most nfreq first fundamental frequencies */
-    naf_mftnaf(nfreq,fabs(g_NAFVariable.FREFON)/g_NAFVariable.m_dneps);
+    naf_mftnaf(naf, naf->NTERM, fabs(naf->FREFON)/naf->m_dneps);
 
     /* number of identified fondamental frequencies */
-    numfreq = (unsigned int) g_NAFVariable.NFS;
+    numfreq = (unsigned int) naf->NFS;
     
-	/* print out results */
-    if (debug == 1) {
-        mexPrintf("*** NAFF results ***\n");
-        mexPrintf("NFS = %d\n",numfreq);
-        
-        d_in=g_NAFVariable.TFS+1;
-        c_in=g_NAFVariable.ZAMP+1;
-        for (iCpt=1;iCpt<=numfreq; iCpt++) {
-            mexPrintf("AMPL=% 9.6e+i*% 9.6e abs(AMPL)=% 9.6e arg(AMPL)=% 9.6e FREQ=% 9.6e\n",
-            c_in->reel,c_in->imag,i_compl_module(*c_in),i_compl_angle(*c_in),*d_in++);
-            c_in++;
-        }
-    }
-    
-    d_in=g_NAFVariable.TFS+1;
-    c_in=g_NAFVariable.ZAMP+1;
+    d_in=naf->TFS+1;
+    c_in=naf->ZAMP+1;
     for (iCpt=1;iCpt<=numfreq; iCpt++) {
         *nu_out++ = *d_in++;
         *amplitude_out++ = i_compl_module(*c_in);
@@ -115,23 +119,52 @@ double *amplitude_out, double *phase_out, int win, int nfreq, int debug)
         c_in++;
     }
     
-    
-    /*free memory*/
-    naf_cleannaf();
-    
     /* return number of fundamental frequencies */
     return numfreq;
 }
 
+static void naff_batch(const double *ydata, const double *ypdata, int ndata, int nsignals,
+        double *nu_out, double *amplitude_out, double *phase_out, unsigned int *numfreq,
+        int win, int nfreq)
+/* Analysis of nsignals signals of ndata samples stored one after the other.
+   The results for signal i start at index i*nfreq of the output arrays,
+   padded with NaN when less than nfreq frequencies are found */
+{
+    #pragma omp parallel if (nsignals > 1) default(shared)
+    {
+        t_naf naf;
+        int i;
+        naff_init(&naf, ndata, win, nfreq);
+        #pragma omp for schedule(dynamic)
+        for (i=0; i<nsignals; i++) {
+            size_t offset = (size_t)i*nfreq;
+            unsigned int k, nf;
+            nf = naff_analyze(&naf, ydata+(size_t)i*ndata, ypdata+(size_t)i*ndata,
+                    nu_out+offset, amplitude_out+offset, phase_out+offset);
+            for (k=nf; k<nfreq; k++) {
+                nu_out[offset+k] = NAN;
+                amplitude_out[offset+k] = NAN;
+                phase_out[offset+k] = NAN;
+            }
+            if (numfreq) numfreq[i] = nf;
+        }
+        /*free memory*/
+        naf_cleannaf(&naf);
+    }
+}
+
 #define min(a, b)       ((a) < (b) ? (a) : (b))
 #define max(a, b)       ((a) < (b) ? (b) : (a))
 #define NFREQMAX 10 /* maximum number of frequencies to look for */
 
+#if defined(MATLAB_MEX_FILE)
+
 /*  MATLAB TO C-CALL LINKING FUNCTION  */
 void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
 {
     double   *nu, *amplitude, *phase;
-    unsigned int  i, m, n, m2, n2, numfreq;
+    unsigned int  i, m, n, m2, n2, ndata, nsignals, *numfreq;
+    unsigned int iSig, iCpt;
     int win = 0;
     int debug = 0;          /* No debug */
     int nfreq = NFREQMAX;	/* maximum number of frequencies value per default */
@@ -180,15 +213,26 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
         
     }
         
-  /* Check the dimensions of Y.  Y can be >6 X 1 or 1 X >6. */
+  /* Check the dimensions of Y.  Y can be >= 66 X 1 or 1 X >= 66,
+     or a >= 66 X N matrix with one signal per column */
     
     m = mxGetM(Y_IN);
     n = mxGetN(Y_IN);
     
     if (!mxIsNumeric(Y_IN) || mxIsComplex(Y_IN) ||
-    mxIsSparse(Y_IN)  || !mxIsDouble(Y_IN) ||
-    (max(m,n) < 66) || (min(m,n) != 1)) {
-        mexErrMsgTxt("CALCNAFF requires that Y be a >= 66 x 1 vector.");
+    mxIsSparse(Y_IN)  || !mxIsDouble(Y_IN)) {
+        mexErrMsgTxt("CALCNAFF requires that Y be a real double array.");
+    }
+    if (min(m,n) == 1) {
+        ndata = max(m,n);
+        nsignals = 1;
+    }
+    else {
+        ndata = m;
+        nsignals = n;
+    }
+    if (ndata < 66) {
+        mexErrMsgTxt("CALCNAFF requires that Y be a >= 66 x 1 vector or a >= 66 x N matrix.");
     }
     
     /* Check the dimensions of YP.  YP must have same size as Y */    
@@ -202,31 +246,170 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
     }
     
     /* Dynamic memory allocation */
-    nu = (double *) mxMalloc(nfreq*sizeof(double));
-    amplitude = (double *) mxMalloc(nfreq*sizeof(double));
-    phase = (double *) mxMalloc(nfreq*sizeof(double));
+    nu = (double *) mxMalloc(nfreq*nsignals*sizeof(double));
+    amplitude = (double *) mxMalloc(nfreq*nsignals*sizeof(double));
+    phase = (double *) mxMalloc(nfreq*nsignals*sizeof(double));
+    numfreq = (unsigned int *) mxMalloc(nsignals*sizeof(unsigned int));
     
     /* call subroutine that calls routine for all NAFF computation */
-    numfreq = call_naff(mxGetDoubles(Y_IN),mxGetDoubles(YP_IN),(int )max(m,n),
-            nu, amplitude, phase,  win, nfreq, debug);
+    naff_batch(mxGetDoubles(Y_IN), mxGetDoubles(YP_IN), (int )ndata, (int )nsignals,
+            nu, amplitude, phase, numfreq, win, nfreq);
+    
+	/* print out results */
+    if (debug == 1) {
+        for (iSig=0; iSig<nsignals; iSig++) {
+            double *nu_sig = nu + iSig*nfreq;
+            double *amp_sig = amplitude + iSig*nfreq;
+            double *phase_sig = phase + iSig*nfreq;
+            mexPrintf("*** NAFF results ***\n");
+            mexPrintf("NFS = %d\n",numfreq[iSig]);
+            for (iCpt=0;iCpt<numfreq[iSig]; iCpt++) {
+                mexPrintf("AMPL=% 9.6e+i*% 9.6e abs(AMPL)=% 9.6e arg(AMPL)=% 9.6e FREQ=% 9.6e\n",
+                amp_sig[iCpt]*cos(phase_sig[iCpt]),amp_sig[iCpt]*sin(phase_sig[iCpt]),
+                amp_sig[iCpt],phase_sig[iCpt],nu_sig[iCpt]);
+            }
+        }
+    }
     
-    NU_OUT = mxCreateDoubleMatrix(numfreq, 1, mxREAL);
-    memcpy(mxGetDoubles(NU_OUT), nu, numfreq*sizeof(double));
+    /* A single signal gives the identified frequencies only, several
+       signals give nfreq x N arrays padded with NaN */
+    m = (nsignals == 1) ? numfreq[0] : nfreq;
+    
+    NU_OUT = mxCreateDoubleMatrix(m, nsignals, mxREAL);
+    memcpy(mxGetDoubles(NU_OUT), nu, m*nsignals*sizeof(double));
     
     if (nlhs >= 2){ /* amplitudes */
-        AMPLITUDE_OUT = mxCreateDoubleMatrix(numfreq, 1, mxREAL);
-        memcpy(mxGetDoubles(AMPLITUDE_OUT), amplitude, numfreq*sizeof(double));
+        AMPLITUDE_OUT = mxCreateDoubleMatrix(m, nsignals, mxREAL);
+        memcpy(mxGetDoubles(AMPLITUDE_OUT), amplitude, m*nsignals*sizeof(double));
     }
     
     if (nlhs >= 3){ /* phases */
-        PHASE_OUT = mxCreateDoubleMatrix(numfreq, 1, mxREAL);
-        memcpy(mxGetDoubles(PHASE_OUT), phase, numfreq*sizeof(double));
+        PHASE_OUT = mxCreateDoubleMatrix(m, nsignals, mxREAL);
+        memcpy(mxGetDoubles(PHASE_OUT), phase, m*nsignals*sizeof(double));
     }
     
     /* free dynamically memory allocation */
     mxFree(nu);
     mxFree(amplitude);
     mxFree(phase);
+    mxFree(numfreq);
     
     return;
 } /* end of mexFunction */
+
+#endif /*MATLAB_MEX_FILE*/
+
+#if defined(PYAT)
+
+#define MODULE_NAME nafflib
+#define MODULE_DESCR "Numerical Analysis of Fundamental Frequencies"
+
+static PyObject *naff(PyObject *self, PyObject *args, PyObject *kwargs) {
+    static char *kwlist[] = {"y", "yp", "window", "nfreq", NULL};
+    PyObject *pyY, *pyYp;
+    PyArrayObject *y, *yp;
+    PyObject *pyNu, *pyAmp, *pyPhase;
+    npy_intp outdims[NPY_MAXDIMS];
+    int win = 0;
+    int nfreq = NFREQMAX;
+    int ndim, ndata, nsignals, i;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OO|ii", kwlist,
+                                     &pyY, &pyYp, &win, &nfreq)) {
+        return NULL;
+    }
+    if (nfreq < 1) {
+        PyErr_SetString(PyExc_ValueError, "nfreq must be positive");
+        return NULL;
+    }
+    /* Each signal must be contiguous: convert to a C-ordered double array */
+    y = (PyArrayObject *)PyArray_FROMANY(pyY, NPY_DOUBLE, 1, NPY_MAXDIMS, NPY_ARRAY_IN_ARRAY);
+    if (y == NULL) return NULL;
+    yp = (PyArrayObject *)PyArray_FROMANY(pyYp, NPY_DOUBLE, 1, NPY_MAXDIMS, NPY_ARRAY_IN_ARRAY);
+    if (yp == NULL) {
+        Py_DECREF(y);
+        return NULL;
+    }
+    ndim = PyArray_NDIM(y);
+    if (!PyArray_SAMESHAPE(y, yp)) {
+        PyErr_SetString(PyExc_ValueError, "y and yp must have the same shape");
+        Py_DECREF(y);
+        Py_DECREF(yp);
+        return NULL;
+    }
+    ndata = (int)PyArray_DIM(y, ndim-1);
+    if (ndata < 66) {
+        PyErr_SetString(PyExc_ValueError, "NAFF requires at least 66 samples");
+        Py_DECREF(y);
+        Py_DECREF(yp);
+        return NULL;
+    }
+    nsignals = (int)(PyArray_SIZE(y) / ndata);
+    for (i=0; i<ndim-1; i++) outdims[i] = PyArray_DIM(y, i);
+    outdims[ndim-1] = nfreq;
+
+    pyNu = PyArray_EMPTY(ndim, outdims, NPY_DOUBLE, 0);
+    pyAmp = PyArray_EMPTY(ndim, outdims, NPY_DOUBLE, 0);
+    pyPhase = PyArray_EMPTY(ndim, outdims, NPY_DOUBLE, 0);
+
+    Py_BEGIN_ALLOW_THREADS
+    naff_batch(PyArray_DATA(y), PyArray_DATA(yp), ndata, nsignals,
+        PyArray_DATA((PyArrayObject *)pyNu), PyArray_DATA((PyArrayObject *)pyAmp),
+        PyArray_DATA((PyArrayObject *)pyPhase), NULL, win, nfreq);
+    Py_END_ALLOW_THREADS
+
+    Py_DECREF(y);
+    Py_DECREF(yp);
+    return Py_BuildValue("NNN", pyNu, pyAmp, pyPhase);
+}
+
+static PyMethodDef AtMethods[] = {
+    {"naff",
+    (PyCFunction)naff, METH_VARARGS | METH_KEYWORDS,
+    PyDoc_STR(
+    "naff(y, yp, window=0, nfreq=10)\n\n"
+    "Numerical Analysis of Fundamental Frequencies of the signal y + i*yp\n\n"
+    "The signals are given along the last axis: a (nparticles, nturns)\n"
+    "array is analysed in parallel, one particle per thread\n\n"
+    "Args:\n"
+    "    y:          (..., nturns) real part of the signal, nturns >= 66\n"
+    "    yp:         (..., nturns) imaginary part of the signal\n"
+    "    window:     Window type: 0 for no window, 1 for Hann window\n"
+    "    nfreq:      Maximum number of fundamental frequencies\n\n"
+    "Returns:\n"
+    "    frequency:  (..., nfreq) angular frequencies [rad/turn], divide by\n"
+    "                :math:`2\\pi` to get the tunes\n"
+    "    amplitude:  (..., nfreq) amplitudes\n"
+    "    phase:      (..., nfreq) phases [rad]\n\n"
+    "    The frequencies are sorted by decreasing amplitude and padded\n"
+    "    with NaN when less than nfreq frequencies are found\n"
+	)},
+    {NULL, NULL, 0, NULL}        /* Sentinel */
+};
+
+PyMODINIT_FUNC MOD_INIT(MODULE_NAME)
+{
+
+#if PY_MAJOR_VERSION >= 3
+    static struct PyModuleDef moduledef = {
+    PyModuleDef_HEAD_INIT,
+    STR(MODULE_NAME), /* m_name */
+    PyDoc_STR(MODULE_DESCR),      /* m_doc */
+    -1,           /* m_size */
+    AtMethods,    /* m_methods */
+    NULL,         /* m_reload */
+    NULL,         /* m_traverse */
+    NULL,         /* m_clear */
+    NULL,         /* m_free */
+    };
+    PyObject *m = PyModule_Create(&moduledef);
+#else
+    PyObject *m = Py_InitModule3(STR(MODULE_NAME), AtMethods,
+        MODULE_DESCR);
+#endif
+    if (m == NULL) return MOD_ERROR_VAL;
+    import_array();
+    return MOD_SUCCESS_VAL(m);
+}
+
+#endif /*PYAT*/
@@ -1,8 +1,8 @@
 % NAFFLIB MATLAB to NAFF library
 %
 %  INPUTS
-%  1. Real part
-%  2. Imaginary part
+%  1. Real part: vector, or matrix with one signal per column
+%  2. Imaginary part, same size as the real part
 %  3. Window type
 %  4. Number of frequencies
 %  5. Debug 0 or 1
@@ -12,6 +12,9 @@
 %  2. Amplitude vector
 %  3. Phase vector
 %
+%  For a matrix input, the signals are analysed in parallel and the outputs
+%  are nfreq x N matrices padded with NaN
+%
 %  EXAMPLE
 %  1. [frequency amplitude phase] = nafflib(Y, Yp, WindowType,nfreq,DebugFlag);
 
@@ -67,6 +67,7 @@ static double *elemlength_list = NULL;
 static track_function *integrator_list = NULL;
 static pass_function *pass_list = NULL;
 static int **field_numbers_ptr = NULL;
+static unsigned long long *fingerprint_list = NULL;
 
 /* state buffers for RNGs */
 static pcg32_random_t common_state = COMMON_PCG32_INITIALIZER;
@@ -145,6 +146,42 @@ static struct LibraryListElement* pass_method(mxArray *mxPassMethod, int nelem)
     return LibraryListPtr;
 }
 
+static unsigned long long fnv1a(unsigned long long h, const void *data, size_t nbytes)
+{
+    const unsigned char *p = (const unsigned char *)data;
+    while (nbytes--) {
+        h ^= *p++;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+/* Fingerprint of an element, built from its field names, data location and
+ * values. The data cached by the integrators may point into the field data,
+ * so an element is unchanged only if both its data location and its values
+ * are identical */
+static unsigned long long element_fingerprint(const mxArray *mxElem)
+{
+    unsigned long long h = 14695981039346656037ULL;
+    int ifield, nfields = mxGetNumberOfFields(mxElem);
+    for (ifield=0; ifield<nfields; ifield++) {
+        const char *name = mxGetFieldNameByNumber(mxElem, ifield);
+        const mxArray *field = mxGetFieldByNumber(mxElem, 0, ifield);
+        h = fnv1a(h, name, strlen(name)+1);
+        if (field) {
+            mxClassID id = mxGetClassID(field);
+            mwSize ndims = mxGetNumberOfDimensions(field);
+            void *data = mxGetData(field);
+            h = fnv1a(h, &id, sizeof(id));
+            h = fnv1a(h, mxGetDimensions(field), ndims*sizeof(mwSize));
+            h = fnv1a(h, &data, sizeof(data));
+            if (data && (mxIsNumeric(field) || mxIsChar(field) || mxIsLogical(field)))
+                h = fnv1a(h, data, mxGetNumberOfElements(field)*mxGetElementSize(field));
+        }
+    }
+    return h;
+}
+
 static void cleanup(void)
 {
     struct LibraryListElement *LibraryListPtr=LibraryList;
@@ -155,6 +192,7 @@ static void cleanup(void)
     }
     mxFree(field_numbers_ptr);
     mxFree(elemdata_list);
+    mxFree(fingerprint_list);
     mxFree(element_list);
     mxFree(pass_list);
     mxFree(integrator_list);
@@ -304,6 +342,7 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
     mxArray *mxPassArg1[5], *mxPre, *mxPost;
     mwSize outsize;
     int pass_mode;
+    char *fresh;    /* Elements whose data must be built during the first turn */
 
     mxDouble *drout ,*datain, *drin;
     
@@ -334,6 +373,7 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
 
     param.common_rng = &common_state;
     param.thread_rng = &thread_state;
+    param.nthread_rng = 1;
     param.energy = 0.0;
     param.rest_energy = 0.0;
     param.charge = -1.0;
@@ -367,46 +407,59 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
     
     mexAtExit(cleanup);
 
+    fresh = (char *)mxCalloc(numel, sizeof(char));
+
     if (new_lattice || !valid) {
         mxArray **element;
         double *elem_length;
         pass_function *oldintegrator;
         track_function *integrator;
-        for (elem_index=0; elem_index<num_elements; elem_index++) { /* free memory from previously used lattice */
-            mxFree(field_numbers_ptr[elem_index]);
-            mxFree(elemdata_list[elem_index]);
-        }        
-        num_elements = numel;
+        unsigned long long *fingerprint;
+        /* The data of unchanged elements is kept if the previous tracking succeeded */
+        int keep = valid && (numel == num_elements);
+        if (!keep) {
+            for (elem_index=0; elem_index<num_elements; elem_index++) { /* free memory from previously used lattice */
+                mxFree(field_numbers_ptr[elem_index]);
+                mxFree(elemdata_list[elem_index]);
+            }        
+            num_elements = numel;
         
-        /* Pointer to integer maps of Element data fields used by the tracking function */
-        mxFree(field_numbers_ptr);	/* Use calloc to ensure uninitialized values are NULL */
-        field_numbers_ptr = (int**)mxCalloc(num_elements,sizeof(int*));
-        mexMakeMemoryPersistent(field_numbers_ptr);
+            /* Pointer to integer maps of Element data fields used by the tracking function */
+            mxFree(field_numbers_ptr);	/* Use calloc to ensure uninitialized values are NULL */
+            field_numbers_ptr = (int**)mxCalloc(num_elements,sizeof(int*));
+            mexMakeMemoryPersistent(field_numbers_ptr);
         
-        /* Pointer to Element structures used by the tracking function */
-        mxFree(elemdata_list);	/* Use calloc to ensure uninitialized values are NULL */
-        elemdata_list = (struct elem**)mxCalloc(num_elements,sizeof(struct elem*));
-        mexMakeMemoryPersistent(elemdata_list);
-
-        /* Pointer to Element lengths */
-        free(elemlength_list);
-        elemlength_list = (double *)calloc(num_elements, sizeof(double));
+            /* Pointer to Element structures used by the tracking function */
+            mxFree(elemdata_list);	/* Use calloc to ensure uninitialized values are NULL */
+            elemdata_list = (struct elem**)mxCalloc(num_elements,sizeof(struct elem*));
+            mexMakeMemoryPersistent(elemdata_list);
+
+            /* Pointer to Element lengths */
+            free(elemlength_list);
+            elemlength_list = (double *)calloc(num_elements, sizeof(double));
         
-        /* Pointer to Element list */
-        element_list = (mxArray **)mxRealloc(element_list, num_elements*sizeof(mxArray *));
-        mexMakeMemoryPersistent(element_list);
+            /* Pointer to Element list */
+            element_list = (mxArray **)mxRealloc(element_list, num_elements*sizeof(mxArray *));
+            mexMakeMemoryPersistent(element_list);
         
-        /* pointer to the list of integrators */
-		pass_list = (pass_function*)mxRealloc(pass_list, num_elements*sizeof(pass_function));
-		integrator_list = (track_function*)mxRealloc(integrator_list, num_elements*sizeof(track_function));
-		mexMakeMemoryPersistent(pass_list);
-        mexMakeMemoryPersistent(integrator_list);
+            /* pointer to the list of integrators */
+			pass_list = (pass_function*)mxRealloc(pass_list, num_elements*sizeof(pass_function));
+			integrator_list = (track_function*)mxRealloc(integrator_list, num_elements*sizeof(track_function));
+			mexMakeMemoryPersistent(pass_list);
+            mexMakeMemoryPersistent(integrator_list);
+
+            /* Element fingerprints */
+            mxFree(fingerprint_list);
+            fingerprint_list = (unsigned long long *)mxCalloc(num_elements,sizeof(unsigned long long));
+            mexMakeMemoryPersistent(fingerprint_list);
+        }
         
         lattice_length = 0.0;
         element = element_list;
         elem_length = elemlength_list;
         oldintegrator = pass_list;
         integrator = integrator_list;
+        fingerprint = fingerprint_list;
         for (elem_index=0; elem_index<num_elements; elem_index++) {
             mxArray *mxElem = mxGetCell(LATTICE,elem_index);
             mxArray *mxPassMethod = mxGetField(mxElem,0,"PassMethod");
@@ -419,10 +472,22 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
             if (mxLength) length=mxGetScalar(mxLength); else length = 0.0;
             lattice_length += length;
             LibraryListPtr = pass_method(mxPassMethod, elem_index);
+            {
+                unsigned long long fp = element_fingerprint(mxElem);
+                if (!(keep && (fp == *fingerprint))) {  /* New or modified element */
+                    mxFree(field_numbers_ptr[elem_index]);
+                    mxFree(elemdata_list[elem_index]);
+                    field_numbers_ptr[elem_index] = NULL;
+                    elemdata_list[elem_index] = NULL;
+                    *fingerprint = fp;
+                    fresh[elem_index] = 1;
+                }
+            }
             *oldintegrator++ = LibraryListPtr->PassHandle;
             *integrator++ = LibraryListPtr->TrackHandle;
             *element++ = mxElem;
             *elem_length++ = length;
+            fingerprint++;
         }
         pass_mode = MAKE_LOCAL_COPY;
         valid = 0;
@@ -546,7 +611,8 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
 				*elemdata = (*integrator)(*element,*elemdata,drin,num_particles,&param);
 			}
             else if (*oldintegrator) {                 /* Pointer to a passFunction */
-                *field_numbers = (*oldintegrator)(*element,*field_numbers,drin,num_particles,pass_mode);
+                *field_numbers = (*oldintegrator)(*element,*field_numbers,drin,num_particles,
+                        fresh[elem_index] ? pass_mode : USE_LOCAL_COPY);
             }
             else {                                  /* M-File */
                 drin=passmfile(mxPassArg1+1, *element);
@@ -570,6 +636,7 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
         }
         if (pass_mode == MAKE_LOCAL_COPY) {             /* First turn */
             for (elem_index=0; elem_index<num_elements; elem_index++) {
+                if (!fresh[elem_index]) continue;
                 if (field_numbers_ptr[elem_index]) mexMakeMemoryPersistent(field_numbers_ptr[elem_index]);
                 if (elemdata_list[elem_index]) mexMakeMemoryPersistent(elemdata_list[elem_index]);
             }
@@ -593,6 +660,7 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
 
 
     mxFree(refpts);
+    mxFree(fresh);
     if (lhist > 0) mxFree(histbuf);
     
     if (nlhs >= 2) plhs[1]=mxLoss;
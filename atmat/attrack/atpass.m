@@ -5,7 +5,8 @@ function varargout=atpass(varargin) %#ok<STOUT>
 %   LATTICE     AT lattice
 %   RIN         6xN matrix: input coordinates of N particles
 %   MODE        0 - reuse lattice
-%               1 - new lattice
+%               1 - new lattice: the data of unchanged elements is kept,
+%                   only new or modified elements are initialised again
 %   NTURNS      number of turns
 %   REFPTS      Indexes of elements where the trajectory is observed
 %               May run from 1 to length(LATTICE)+1
@@ -73,7 +73,7 @@ compile([alloptions, {passinclude}], fullfile(cdir,'findmpoleraddiffmatrix.c'));
 
 % RDTs
 cdir=fullfile(atroot,'atphysics','NonLinearDynamics');
-compile(alloptions, fullfile(cdir,'RDTelegantAT.cpp'));
+compile([alloptions, ompoptions], fullfile(cdir,'RDTelegantAT.cpp'));
 
 % NAFF
 cdir=fullfile(atroot,'atphysics','nafflib');
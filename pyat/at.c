@@ -1,7 +1,8 @@
 /*
  * This file contains the Python interface to AT, compatible with
- * Python 3 only. It provides a module 'atpass' containing 4 python functions:
- * atpass, elempass, isopenmp, ismpi
+ * Python 3 only. It provides a module 'atpass' containing the python functions:
+ * atpass, elempass, tangentpass, closedorbit, variantpass, new_context,
+ * free_context, reset_rng, common_rng, thread_rng
  */
 #define PY_SSIZE_T_CLEAN
 #include <Python.h>
@@ -24,6 +25,10 @@
 typedef PyObject atElem;
 
 #define ATPY_PASS "trackFunction"
+#define ATPY_PASS_SOA "trackFunctionSoA"
+#define ATPY_PASS_TANGENT "trackFunctionTangent"
+#define ATPY_PASS_FLOAT "trackFunctionFloat"
+#define ATPY_COLLECTIVE "atCollective"
 
 #if defined(PCWIN) || defined(PCWIN64) || defined(_WIN32)
 #include <windows.h>
@@ -31,6 +36,10 @@ typedef PyObject atElem;
 #define FREELIBFCN(libfilename) FreeLibrary((libfilename))
 #define LOADLIBFCN(libfilename) LoadLibrary((libfilename))
 #define GETTRACKFCN(libfilename) GetProcAddress((libfilename),ATPY_PASS)
+#define GETSOAFCN(libfilename) GetProcAddress((libfilename),ATPY_PASS_SOA)
+#define GETTANGENTFCN(libfilename) GetProcAddress((libfilename),ATPY_PASS_TANGENT)
+#define GETFLOATFCN(libfilename) GetProcAddress((libfilename),ATPY_PASS_FLOAT)
+#define GETCOLLECTIVE(libfilename) GetProcAddress((libfilename),ATPY_COLLECTIVE)
 #define SEPARATOR "\\"
 #define OBJECTEXT ".pyd"
 #else
@@ -39,13 +48,25 @@ typedef PyObject atElem;
 #define FREELIBFCN(libfilename) dlclose(libfilename)
 #define LOADLIBFCN(libfilename) dlopen((libfilename),RTLD_LAZY)
 #define GETTRACKFCN(libfilename) dlsym((libfilename),ATPY_PASS)
+#define GETSOAFCN(libfilename) dlsym((libfilename),ATPY_PASS_SOA)
+#define GETTANGENTFCN(libfilename) dlsym((libfilename),ATPY_PASS_TANGENT)
+#define GETFLOATFCN(libfilename) dlsym((libfilename),ATPY_PASS_FLOAT)
+#define GETCOLLECTIVE(libfilename) dlsym((libfilename),ATPY_COLLECTIVE)
 #define SEPARATOR "/"
 #define OBJECTEXT ".so"
 #endif
 
+#define RESTORE_GIL(tstate) if (tstate) {PyEval_RestoreThread(tstate); tstate = NULL;}
+
+#if !(defined(PCWIN) || defined(PCWIN64) || defined(_WIN32))
+#include <time.h>
+#endif
+
 #define SYSCONFIG "sysconfig"
 #define LIMIT_AMPLITUDE		1
 #define C0  	2.99792458e8
+#define TANGENT_SIZE	42      /* doubles per tangent particle: 6 x (value, 6 derivatives) */
+#define FLOAT_BLOCK_SIZE	256     /* particles converted to double at once in float32 mode */
 
 /* define the general signature of a pass function */
 typedef struct elem *(*track_function)(const PyObject *element,
@@ -54,37 +75,250 @@ typedef struct elem *(*track_function)(const PyObject *element,
                                       int num_particles,
                                       struct parameters *param);
 
-static npy_uint32 num_elements = 0;
-static struct elem **elemdata_list = NULL;
-static PyObject **element_list = NULL;
-static double *elemlength_list = NULL;
-static track_function *integrator_list = NULL;
-static PyObject **pyintegrator_list = NULL;
-static PyObject **kwargs_list = NULL;
+/* signature of the single-precision pass functions (see driftkickfloat.c) */
+typedef struct elem *(*float_track_function)(const PyObject *element,
+                                      struct elem *elemptr,
+                                      float *r_in,
+                                      int num_particles,
+                                      struct parameters *param);
+
+/*
+ * Tracking context: cached description of a lattice, kept between calls
+ * to atpass for the reuse=True fast path. The module owns a default
+ * context, others may be created with new_context() so that several
+ * lattices can be tracked independently. The modification stamp of each
+ * element (Element._version) is recorded so that with update=True, only
+ * the modified or replaced elements are initialised again.
+ * An element object present several times in the lattice, like the
+ * identical slices of a sliced magnet, is initialised once: elemslot_list
+ * points to the element data of its first occurrence.
+ * Each context has its own random generators, so that contexts tracked
+ * concurrently do not share a generator state.
+ */
+struct atpass_context {
+    npy_uint32 num_elements;
+    struct elem **elemdata_list;
+    struct elem ***elemslot_list;
+    PyObject **element_list;
+    double *elemlength_list;
+    track_function *integrator_list;
+    track_function *soa_integrator_list;
+    float_track_function *float_integrator_list;
+    bool *collective_list;
+    PyObject **pyintegrator_list;
+    PyObject **kwargs_list;
+    long long *version_list;
+    double lattice_length;
+    int last_turn;
+    int valid;
+    int busy;       /* set while a tracking is running in this context */
+    unsigned long owner;    /* thread running the tracking */
+    pcg32_random_t *rng_state;  /* common generator followed by the thread generators */
+};
+
+#define CONTEXT_CAPSULE_NAME "atpass.context"
+
+static struct atpass_context default_context;   /* zero-initialised */
+/* Serialises the threads tracking with the default context */
+static PyThread_type_lock default_lock = NULL;
 static char integrator_path[300];
 static PyObject *particle_type;
 static PyObject *element_type;
-
-/* state buffers for RNGs */
-static pcg32_random_t common_state = COMMON_PCG32_INITIALIZER;
-static pcg32_random_t thread_state = THREAD_PCG32_INITIALIZER;
+/* Interned names of the attributes read for each element */
+static PyObject *str_passmethod;
+static PyObject *str_length;
+static PyObject *str_version;
+static PyObject *str_double_precision;
+
+/* Number of thread generators of a context: one independent generator per
+   OpenMP thread. The generators of the default context are the module
+   generators, used by reset_rng, common_rng, thread_rng and elempass */
+static int nthread_state = 0;
+static uint64_t rng_rank = 0;       /* rank given to reset_rng */
 
 /* Directly copied from atpass.c */
 static struct LibraryListElement {
     const char *MethodName;
     LIBRARYHANDLETYPE LibraryHandle;
     track_function FunctionHandle;
+    track_function SoAFunctionHandle;
+    track_function TangentFunctionHandle;
+    float_track_function FloatFunctionHandle;
+    bool Collective;
     PyObject *PyFunctionHandle;
     struct LibraryListElement *Next;
 } *LibraryList = NULL;
 
+#ifdef AT_STATIC_PASSMETHODS
+/* Built-in passmethods linked into this extension. The table, sorted by
+   name, is generated by setup.py in static_passmethods.h */
+struct static_passmethod {
+    const char *name;
+    track_function function;
+    track_function soa_function;
+    track_function tangent_function;
+    float_track_function float_function;
+    bool collective;
+};
+
+#include "static_passmethods.h"
+
+static int compare_passmethod(const void *key, const void *item)
+{
+    return strcmp((const char *)key, ((const struct static_passmethod *)item)->name);
+}
+
+static const struct static_passmethod *search_static_passmethod(const char *method_name)
+{
+    return bsearch(method_name, static_passmethods,
+        sizeof(static_passmethods)/sizeof(static_passmethods[0]),
+        sizeof(static_passmethods[0]), compare_passmethod);
+}
+#endif /* AT_STATIC_PASSMETHODS */
+
+
+/*
+ * The default context is shared by all the callers: a thread finding it in
+ * use by another thread waits for it, without holding the GIL. A context
+ * already used by the calling thread (re-entrant call from a Python
+ * integrator), or an explicit context used by another thread, is an error.
+ */
+static bool context_in_use(struct atpass_context *ctx)
+{
+    return ctx->busy && ((ctx != &default_context) || (ctx->owner == PyThread_get_thread_ident()));
+}
+
+static void wait_default_lock(void)
+{
+    if (!PyThread_acquire_lock(default_lock, NOWAIT_LOCK)) {
+        Py_BEGIN_ALLOW_THREADS
+        PyThread_acquire_lock(default_lock, WAIT_LOCK);
+        Py_END_ALLOW_THREADS
+    }
+}
+
+static int acquire_context(struct atpass_context *ctx)
+{
+    if (context_in_use(ctx)) {
+        PyErr_SetString(PyExc_RuntimeError, "the tracking context is already in use");
+        return -1;
+    }
+    if (ctx == &default_context) wait_default_lock();
+    ctx->busy = 1;
+    ctx->owner = PyThread_get_thread_ident();
+    return 0;
+}
+
+static void release_context(struct atpass_context *ctx)
+{
+    ctx->busy = 0;
+    if (ctx == &default_context) PyThread_release_lock(default_lock);
+}
+
+/*
+ * The module generators are used outside atpass: wait for the default
+ * context if another thread is tracking with it. Returns false, without
+ * locking, for a call from a Python integrator of the tracking thread.
+ */
+static bool lock_default_rngs(void)
+{
+    if (default_context.busy && (default_context.owner == PyThread_get_thread_ident()))
+        return false;
+    wait_default_lock();
+    return true;
+}
+
+static void unlock_default_rngs(bool locked)
+{
+    if (locked) PyThread_release_lock(default_lock);
+}
+
+/* Thread generator i uses the stream (i << 32) + rank: the generator of
+   thread 0 is independent of the number of threads */
+static void seed_rngs(pcg32_random_t *rngs, int nthreads, uint64_t seed, uint64_t rank)
+{
+    int i;
+    pcg32_srandom_r(rngs, seed, AT_RNG_INC);
+    for (i=0; i<nthreads; i++)
+        pcg32_srandom_r(rngs+1+i, seed, ((uint64_t)i << 32) + rank);
+}
+
+/* Seed drawn from the common module generator, so that the generators
+   of the contexts and variants are reproducible after reset_rng */
+static uint64_t draw_seed(void)
+{
+    bool locked = lock_default_rngs();
+    uint64_t seed = ((uint64_t)pcg32_random_r(default_context.rng_state) << 32) |
+                    pcg32_random_r(default_context.rng_state);
+    unlock_default_rngs(locked);
+    return seed;
+}
 
-static PyObject *print_error(int elem_number, PyObject *rout)
+static PyObject *print_error(struct atpass_context *ctx, int elem_number, PyObject *rout)
 {
+    release_context(ctx);
     Py_XDECREF(rout);
     return NULL;
 }
 
+/*
+ * The GIL may be released during tracking if all the integrators are C
+ * functions and their element data is already cached, so that no Python
+ * object is accessed in the element loop.
+ */
+static bool can_release_gil(struct atpass_context *ctx)
+{
+    npy_uint32 elem_index;
+    for (elem_index=0; elem_index < ctx->num_elements; elem_index++) {
+        if (ctx->pyintegrator_list[elem_index] || !*ctx->elemslot_list[elem_index])
+            return false;
+    }
+    return true;
+}
+
+/* Release the elements stored in a context */
+static void release_elements(struct atpass_context *ctx)
+{
+    npy_uint32 elem_index;
+    for (elem_index=0; elem_index < ctx->num_elements; elem_index++) {
+        free(ctx->elemdata_list[elem_index]);
+        Py_XDECREF(ctx->element_list[elem_index]);  /* may be NULL if a previous */
+    }                                               /* call was interrupted by an error */
+    ctx->num_elements = 0;
+    ctx->valid = 0;
+}
+
+/* Release all the resources of a context, leaving it empty */
+static void clear_context(struct atpass_context *ctx)
+{
+    pcg32_random_t *rng_state;
+    release_elements(ctx);
+    free(ctx->elemdata_list);
+    free(ctx->elemslot_list);
+    free(ctx->elemlength_list);
+    free(ctx->element_list);
+    free(ctx->integrator_list);
+    free(ctx->soa_integrator_list);
+    free(ctx->float_integrator_list);
+    free(ctx->collective_list);
+    free(ctx->pyintegrator_list);
+    free(ctx->kwargs_list);
+    free(ctx->version_list);
+    rng_state = ctx->rng_state;     /* The generators are kept */
+    memset(ctx, 0, sizeof(struct atpass_context));
+    ctx->rng_state = rng_state;
+}
+
+static void context_destructor(PyObject *capsule)
+{
+    struct atpass_context *ctx = PyCapsule_GetPointer(capsule, CONTEXT_CAPSULE_NAME);
+    if (ctx) {
+        clear_context(ctx);
+        free(ctx->rng_state);
+        free(ctx);
+    }
+}
+
 static const char *pyprint(PyObject* pyobj) {
     PyObject *pystr = PyObject_Str(pyobj);
     const char* str = PyUnicode_AsUTF8(pystr);
@@ -107,12 +341,57 @@ static struct LibraryListElement* SearchLibraryList(struct LibraryListElement *h
 }
 
 
-static void checkiflost(double *drin, npy_uint32 np, int num_elem, int num_turn, 
+/*
+ * Loss bookkeeping
+ *
+ * count_lost is a branch-free scan giving the number of particles with
+ * non-finite or excessive coordinates, including the ones already lost.
+ * The bookkeeping functions checkiflost and setlost return the number of
+ * lost particles once processed, so that they need to be called only when
+ * count_lost returns a different value. The scan still reads all the
+ * coordinates after each element: it only replaces the branchy bookkeeping
+ * pass when there is no new loss, and the loss handling is not O(losses).
+ * Removing the scan needs the integrators to report the particles they
+ * mark as lost (apertures, invalid square roots) through struct parameters,
+ * and another detection of the numerical blow-ups beyond LIMIT_AMPLITUDE,
+ * which only the scan catches today.
+ */
+static npy_uint32 count_lost(const double *drin, npy_uint32 np)
+{
+    npy_uint32 c, nlost = 0;
+    for (c=0; c<np; c++) {
+        const double *r6 = drin+c*6;
+        int ok = (fabs(r6[0])<=LIMIT_AMPLITUDE) & (fabs(r6[1])<=LIMIT_AMPLITUDE) &
+                 (fabs(r6[2])<=LIMIT_AMPLITUDE) & (fabs(r6[3])<=LIMIT_AMPLITUDE) &
+                 (fabs(r6[4])<=LIMIT_AMPLITUDE) & (fabs(r6[5])<INFINITY);
+        nlost += !ok;
+    }
+    return nlost;
+}
+
+
+static npy_uint32 count_lost_soa(const double *drin, npy_uint32 np)
+/* Same as count_lost for the structure-of-arrays layout */
+{
+    npy_uint32 c, nlost = 0;
+    for (c=0; c<np; c++) {
+        int ok = (fabs(drin[c])<=LIMIT_AMPLITUDE) & (fabs(drin[np+c])<=LIMIT_AMPLITUDE) &
+                 (fabs(drin[2*np+c])<=LIMIT_AMPLITUDE) & (fabs(drin[3*np+c])<=LIMIT_AMPLITUDE) &
+                 (fabs(drin[4*np+c])<=LIMIT_AMPLITUDE) & (fabs(drin[5*np+c])<INFINITY);
+        nlost += !ok;
+    }
+    return nlost;
+}
+
+
+static npy_uint32 checkiflost(double *drin, npy_uint32 np, int num_elem, int num_turn,
         int *xnturn, int *xnelem, bool *xlost, double *xlostcoord)
 {
     unsigned int n, c;
+    npy_uint32 nlost = 0;
     for (c=0; c<np; c++) {/* Loop over particles */
-        if (!xlost[c]) {  /* No change if already marked */
+        if (xlost[c]) nlost++;
+        else {  /* No change if already marked */
            double *r6 = drin+c*6;
            for (n=0; n<6; n++) {
                 if (!isfinite(r6[n]) || ((fabs(r6[n])>LIMIT_AMPLITUDE)&&n<5)) {
@@ -126,20 +405,198 @@ static void checkiflost(double *drin, npy_uint32 np, int num_elem, int num_turn,
                     r6[3] = 0;
                     r6[4] = 0;
                     r6[5] = 0;
+                    nlost++;
+                    break;
+                }
+            }
+        }
+    }
+    return nlost;
+}
+
+
+static npy_uint32 checkiflost_soa(double *drin, npy_uint32 np, int num_elem, int num_turn,
+        int *xnturn, int *xnelem, bool *xlost, double *xlostcoord)
+/* Same as checkiflost for the structure-of-arrays layout */
+{
+    unsigned int n, c;
+    npy_uint32 nlost = 0;
+    for (c=0; c<np; c++) {/* Loop over particles */
+        if (xlost[c]) nlost++;
+        else {  /* No change if already marked */
+           for (n=0; n<6; n++) {
+                double rn = drin[n*np+c];
+                if (!isfinite(rn) || ((fabs(rn)>LIMIT_AMPLITUDE)&&n<5)) {
+                    unsigned int m;
+                    xlost[c] = 1;
+                    xnturn[c] = num_turn;
+                    xnelem[c] = num_elem;
+                    for (m=0; m<6; m++) {
+                        xlostcoord[6*c+m] = drin[m*np+c];
+                        drin[m*np+c] = 0;
+                    }
+                    drin[c] = NAN;
+                    nlost++;
+                    break;
+                }
+            }
+        }
+    }
+    return nlost;
+}
+
+
+static npy_uint32 setlost_soa(double *drin, npy_uint32 np)
+/* Same as setlost for the structure-of-arrays layout */
+{
+    unsigned int n, c;
+    npy_uint32 nlost = 0;
+    for (c=0; c<np; c++) {/* Loop over particles */
+        if (!isfinite(drin[c])) nlost++;
+        else {  /* No change if already marked */
+           for (n=0; n<6; n++) {
+                double rn = drin[n*np+c];
+                if (!isfinite(rn) || ((fabs(rn)>LIMIT_AMPLITUDE)&&n<5)) {
+                    unsigned int m;
+                    for (m=1; m<6; m++) drin[m*np+c] = 0;
+                    drin[c] = NAN;
+                    nlost++;
+                    break;
+                }
+            }
+        }
+    }
+    return nlost;
+}
+
+
+/* Same as count_lost for the single-precision array of FLOAT_SOA_ROWS rows */
+static npy_uint32 count_lost_float(const float *fsoa, npy_uint32 np)
+{
+    npy_uint32 c, nlost = 0;
+    for (c=0; c<np; c++) {
+        int ok = (fabsf(fsoa[c])<=LIMIT_AMPLITUDE) & (fabsf(fsoa[np+c])<=LIMIT_AMPLITUDE) &
+                 (fabsf(fsoa[2*np+c])<=LIMIT_AMPLITUDE) & (fabsf(fsoa[3*np+c])<=LIMIT_AMPLITUDE) &
+                 (fabsf(fsoa[4*np+c])<=LIMIT_AMPLITUDE) & (fabsf(fsoa[5*np+c])<INFINITY);
+        nlost += !ok;
+    }
+    return nlost;
+}
+
+
+static npy_uint32 checkiflost_float(float *fsoa, npy_uint32 np, int num_elem, int num_turn,
+        int *xnturn, int *xnelem, bool *xlost, double *xlostcoord)
+/* Same as checkiflost for the single-precision array, or as setlost if
+   xlost is NULL */
+{
+    unsigned int n, c;
+    npy_uint32 nlost = 0;
+    for (c=0; c<np; c++) {/* Loop over particles */
+        if (xlost ? xlost[c] : !isfinite(fsoa[c])) nlost++;
+        else {  /* No change if already marked */
+           for (n=0; n<6; n++) {
+                float rn = fsoa[n*np+c];
+                if (!isfinite(rn) || ((fabsf(rn)>LIMIT_AMPLITUDE)&&n<5)) {
+                    unsigned int m;
+                    if (xlost) {
+                        xlost[c] = 1;
+                        xnturn[c] = num_turn;
+                        xnelem[c] = num_elem;
+                        for (m=0; m<6; m++) xlostcoord[6*c+m] = fsoa[m*np+c];
+                        xlostcoord[6*c+4] += fsoa[6*np+c];
+                        xlostcoord[6*c+5] += fsoa[7*np+c];
+                    }
+                    for (m=1; m<FLOAT_SOA_ROWS; m++) fsoa[m*np+c] = 0;
+                    fsoa[c] = NAN;
+                    nlost++;
                     break;
                 }
             }
         }
     }
+    return nlost;
 }
 
 
-static void setlost(double *drin, npy_uint32 np)
+/* Conversions between 6 values per particle and the single-precision
+   array, where delta and ct are split in high and low parts */
+static void aos_to_float(float *fsoa, const float *frin, npy_uint32 np)
 {
     unsigned int n, c;
+    for (c=0; c<np; c++) {
+        for (n=0; n<6; n++)
+            fsoa[n*np+c] = frin[6*c+n];
+        fsoa[6*np+c] = 0.0f;
+        fsoa[7*np+c] = 0.0f;
+    }
+}
+
+static void float_to_aos(float *frin, const float *fsoa, npy_uint32 np)
+{
+    unsigned int n, c;
+    for (c=0; c<np; c++) {
+        for (n=0; n<4; n++)
+            frin[6*c+n] = fsoa[n*np+c];
+        frin[6*c+4] = fsoa[4*np+c] + fsoa[6*np+c];
+        frin[6*c+5] = fsoa[5*np+c] + fsoa[7*np+c];
+    }
+}
+
+static void float_to_double(double *drin, const float *fsoa, npy_uint32 np,
+        npy_uint32 first, npy_uint32 num)
+/* Particles first to first+num-1, as 6 doubles per particle */
+{
+    unsigned int n, c;
+    for (c=0; c<num; c++) {
+        const float *rf = fsoa+first+c;
+        double *r6 = drin+6*c;
+        for (n=0; n<6; n++) r6[n] = rf[n*np];
+        r6[4] += rf[6*np];
+        r6[5] += rf[7*np];
+    }
+}
+
+static void double_to_float(float *fsoa, const double *drin, npy_uint32 np,
+        npy_uint32 first, npy_uint32 num)
+{
+    unsigned int n, c;
+    for (c=0; c<num; c++) {
+        float *rf = fsoa+first+c;
+        const double *r6 = drin+6*c;
+        for (n=0; n<6; n++) rf[n*np] = (float)r6[n];
+        rf[6*np] = (float)(r6[4] - rf[4*np]);
+        rf[7*np] = (float)(r6[5] - rf[5*np]);
+    }
+}
+
+
+/* Transposition between the 6-doubles-per-particle and
+   the structure-of-arrays layouts */
+static void aos_to_soa(double *dsoa, const double *drin, npy_uint32 np)
+{
+    unsigned int n, c;
+    for (c=0; c<np; c++)
+        for (n=0; n<6; n++)
+            dsoa[n*np+c] = drin[6*c+n];
+}
+
+static void soa_to_aos(double *drin, const double *dsoa, npy_uint32 np)
+{
+    unsigned int n, c;
+    for (c=0; c<np; c++)
+        for (n=0; n<6; n++)
+            drin[6*c+n] = dsoa[n*np+c];
+}
+
+
+static npy_uint32 setlost(double *drin, npy_uint32 np)
+{
+    unsigned int n, c;
+    npy_uint32 nlost = 0;
     for (c=0; c<np; c++) {/* Loop over particles */
         double *r6 = drin+c*6;
-        if (isfinite(r6[0])) {  /* No change if already marked */
+        if (!isfinite(r6[0])) nlost++;
+        else {  /* No change if already marked */
            for (n=0; n<6; n++) {
                 if (!isfinite(r6[n]) || ((fabs(r6[n])>LIMIT_AMPLITUDE)&&n<5)) {
                     r6[0] = NAN;
@@ -148,14 +605,377 @@ static void setlost(double *drin, npy_uint32 np)
                     r6[3] = 0;
                     r6[4] = 0;
                     r6[5] = 0;
+                    nlost++;
                     break;
                 }
             }
         }
     }
+    return nlost;
+}
+
+
+/*
+ * Compaction of the surviving particles
+ *
+ * The lost particles are moved after the active ones, so that the
+ * integrators only loop over the first num_active particles. perm gives
+ * the original index of each particle, and the loss data are permuted
+ * in the same way.
+ */
+static void swap_particles(double *drin, npy_uint32 i, npy_uint32 k, npy_uint32 *perm,
+        int *xnturn, int *xnelem, bool *xlost, double *xlostcoord)
+{
+    double t6[6];
+    npy_uint32 ip = perm[i];
+    memcpy(t6, drin+6*i, 6*sizeof(double));
+    memcpy(drin+6*i, drin+6*k, 6*sizeof(double));
+    memcpy(drin+6*k, t6, 6*sizeof(double));
+    perm[i] = perm[k];
+    perm[k] = ip;
+    if (xlost) {
+        int it;
+        bool bt;
+        it = xnturn[i]; xnturn[i] = xnturn[k]; xnturn[k] = it;
+        it = xnelem[i]; xnelem[i] = xnelem[k]; xnelem[k] = it;
+        bt = xlost[i]; xlost[i] = xlost[k]; xlost[k] = bt;
+        memcpy(t6, xlostcoord+6*i, 6*sizeof(double));
+        memcpy(xlostcoord+6*i, xlostcoord+6*k, 6*sizeof(double));
+        memcpy(xlostcoord+6*k, t6, 6*sizeof(double));
+    }
+}
+
+static npy_uint32 compact_particles(double *drin, npy_uint32 num_active, npy_uint32 *perm,
+        int *xnturn, int *xnelem, bool *xlost, double *xlostcoord)
+/* Returns the new number of active particles */
+{
+    npy_uint32 i = 0, k = num_active;
+    for (;;) {
+        while ((i < k) && isfinite(drin[6*i])) i++;
+        while ((k > i) && !isfinite(drin[6*(k-1)])) k--;
+        if (i == k) break;
+        swap_particles(drin, i++, --k, perm, xnturn, xnelem, xlost, xlostcoord);
+    }
+    return k;
+}
+
+static void output_particles(double *drout, const double *drin, npy_uint32 np, const npy_uint32 *perm)
+/* Copy the particles to the output array in their original order */
+{
+    if (perm) {
+        npy_uint32 c;
+        for (c=0; c<np; c++)
+            memcpy(drout+6*perm[c], drin+6*c, 6*sizeof(double));
+    }
+    else {
+        memcpy(drout, drin, 6*np*sizeof(double));
+    }
+}
+
+static void restore_order(double *drin, npy_uint32 np, npy_uint32 *perm,
+        int *xnturn, int *xnelem, bool *xlost, double *xlostcoord)
+/* Put back the particles and the loss data in their original order */
+{
+    npy_uint32 c;
+    double *dtmp = (double *)malloc(6*np*sizeof(double));
+    output_particles(dtmp, drin, np, perm);
+    memcpy(drin, dtmp, 6*np*sizeof(double));
+    if (xlost) {
+        int *itmp = (int *)malloc(np*sizeof(int));
+        bool *btmp = (bool *)malloc(np*sizeof(bool));
+        output_particles(dtmp, xlostcoord, np, perm);
+        memcpy(xlostcoord, dtmp, 6*np*sizeof(double));
+        for (c=0; c<np; c++) itmp[perm[c]] = xnturn[c];
+        memcpy(xnturn, itmp, np*sizeof(int));
+        for (c=0; c<np; c++) itmp[perm[c]] = xnelem[c];
+        memcpy(xnelem, itmp, np*sizeof(int));
+        for (c=0; c<np; c++) btmp[perm[c]] = xlost[c];
+        memcpy(xlost, btmp, np*sizeof(bool));
+        free(btmp);
+        free(itmp);
+    }
+    free(dtmp);
+}
+
+static void release_order(double *drin, npy_uint32 np, npy_uint32 *perm,
+        int *xnturn, int *xnelem, bool *xlost, double *xlostcoord)
+/* Restore the original order, also on error exits, and free perm */
+{
+    if (perm) {
+        restore_order(drin, np, perm, xnturn, xnelem, xlost, xlostcoord);
+        free(perm);
+    }
+}
+
+/* Turns recorded at the reference points: one turn every stride turns,
+ * counted backwards from the last one, within the last window turns
+ * (window == 0: all turns) */
+struct record_schedule {
+    int num_turns;
+    int stride;
+    int window;
+};
+
+static int record_turn(const struct record_schedule *sched, int turn)
+{
+    int k = sched->num_turns - 1 - turn;
+    return (k % sched->stride == 0) && ((sched->window == 0) || (k < sched->window));
+}
+
+static int record_count(const struct record_schedule *sched)
+{
+    int turn, count = 0;
+    for (turn = 0; turn < sched->num_turns; turn++)
+        if (record_turn(sched, turn)) count++;
+    return count;
+}
+
+/* Check if any recorded coordinate at this turn exceeds the trigger limits */
+static int record_triggered(const double *drout, npy_intp nvals, const double *limits)
+{
+    npy_intp i;
+    for (i = 0; i < nvals; i++) {
+        if (fabs(drout[i]) > limits[i % 6]) return 1;
+    }
+    return 0;
+}
+
+#ifdef _OPENMP
+/*
+ * Track the turns from first_turn in a single parallel region. Each thread keeps a
+ * fixed chunk of particles and calls the integrators on its own chunk.
+ * The threads are synchronised only around collective elements, which are
+ * tracked by the master thread with all the particles. The element data
+ * must be cached and all the integrators must be C functions.
+ * Returns the index of the failing element, or -1 on success.
+ */
+static int track_persistent(struct atpass_context *ctx, double *drin, double *drout,
+        npy_uint32 num_particles, int first_turn, const struct record_schedule *sched,
+        npy_uint32 *refpts, unsigned int num_refpts,
+        int losses, int *ixnturn, int *ixnelem, bool *bxlost, double *dxlostcoord,
+        struct parameters *param)
+{
+    int failed = -1;
+    npy_uint32 np6 = num_particles*6;
+    npy_uint32 nlost_all = 0;       /* lost particles in the beam, updated at collective elements */
+
+    #pragma omp parallel default(none) \
+    shared(ctx,drin,drout,num_particles,first_turn,sched,refpts,num_refpts,losses, \
+           ixnturn,ixnelem,bxlost,dxlostcoord,param,failed,np6,nlost_all)
+    {
+        int nthreads = omp_get_num_threads();
+        int ithread = omp_get_thread_num();
+        npy_uint32 first = (npy_uint32)(((npy_uint64)num_particles*ithread)/nthreads);
+        npy_uint32 last = (npy_uint32)(((npy_uint64)num_particles*(ithread+1))/nthreads);
+        npy_uint32 nchunk = last - first;
+        double *rchunk = drin + 6*first;
+        struct parameters tparam = *param;      /* s_coord and nturn are thread-private */
+        double *rout = drout;
+        npy_uint32 nlost = 0;                   /* lost particles in the chunk */
+        int turn;
+
+        for (turn = first_turn; turn < sched->num_turns; turn++) {
+            double s_coord = 0.0;
+            unsigned int nextrefindex = 0;
+            npy_uint32 nextref = (nextrefindex<num_refpts) ? refpts[nextrefindex++] : INT_MAX;
+            npy_uint32 elem_index;
+            int record = record_turn(sched, turn);
+            for (elem_index = 0; elem_index < ctx->num_elements; elem_index++) {
+                int fail;
+                tparam.s_coord = s_coord;
+                if (elem_index == nextref) {
+                    if (record) {
+                        memcpy(rout+6*first, rchunk, 6*nchunk*sizeof(double));
+                        rout += np6;
+                    }
+                    nextref = (nextrefindex<num_refpts) ? refpts[nextrefindex++] : INT_MAX;
+                }
+                #pragma omp atomic read
+                fail = failed;
+                if (ctx->collective_list[elem_index]) {
+                    #pragma omp barrier
+                    #pragma omp master
+                    if (fail < 0) {
+                        if (!ctx->integrator_list[elem_index](ctx->element_list[elem_index],
+                                *ctx->elemslot_list[elem_index], drin, num_particles, &tparam)) {
+                            #pragma omp atomic write
+                            failed = elem_index;
+                        }
+                        else if (count_lost(drin, num_particles) != nlost_all) {
+                            if (losses)
+                                nlost_all = checkiflost(drin, num_particles, elem_index, tparam.nturn,
+                                                        ixnturn, ixnelem, bxlost, dxlostcoord);
+                            else
+                                nlost_all = setlost(drin, num_particles);
+                        }
+                    }
+                    #pragma omp barrier
+                }
+                else if ((fail < 0) && (nchunk > 0)) {
+                    if (!ctx->integrator_list[elem_index](ctx->element_list[elem_index],
+                            *ctx->elemslot_list[elem_index], rchunk, nchunk, &tparam)) {
+                        #pragma omp atomic write
+                        failed = elem_index;
+                    }
+                    else if (count_lost(rchunk, nchunk) != nlost) {
+                        if (losses)
+                            nlost = checkiflost(rchunk, nchunk, elem_index, tparam.nturn, ixnturn+first,
+                                                ixnelem+first, bxlost+first, dxlostcoord+6*first);
+                        else
+                            nlost = setlost(rchunk, nchunk);
+                    }
+                }
+                s_coord += ctx->elemlength_list[elem_index];
+            }
+            /* the last element in the ring */
+            if ((ctx->num_elements == nextref) && record) {
+                memcpy(rout+6*first, rchunk, 6*nchunk*sizeof(double));
+                rout += np6;
+            }
+            tparam.nturn++;
+        }
+    }
+    param->nturn += sched->num_turns - first_turn;
+    return failed;
+}
+#endif /*_OPENMP*/
+
+
+/*
+ * Track the single-precision particles through a double-precision
+ * integrator, by blocks of FLOAT_BLOCK_SIZE particles converted to 6
+ * doubles per particle. The first block initialises the element data if
+ * needed, the other blocks are tracked in parallel. Returns the element
+ * data, or NULL if the integrator failed.
+ */
+static struct elem *track_double_blocks(track_function integrator, PyObject *element,
+        struct elem *elemdata, float *fsoa, npy_uint32 num_particles, struct parameters *param)
+{
+    npy_uint32 first = 0;
+    int failed = 0;
+    int b;
+    if (!elemdata) {
+        double dblock[6*FLOAT_BLOCK_SIZE];
+        npy_uint32 nb = (num_particles < FLOAT_BLOCK_SIZE) ? num_particles : FLOAT_BLOCK_SIZE;
+        float_to_double(dblock, fsoa, num_particles, 0, nb);
+        elemdata = integrator(element, NULL, dblock, nb, param);
+        if (!elemdata) return NULL;
+        double_to_float(fsoa, dblock, num_particles, 0, nb);
+        first = nb;
+    }
+    #ifdef _OPENMP
+    #pragma omp parallel for if (num_particles-first > OMP_PARTICLE_THRESHOLD*10) default(shared) private(b)
+    #endif /*_OPENMP*/
+    for (b = first; b < (int)num_particles; b += FLOAT_BLOCK_SIZE) {
+        double dblock[6*FLOAT_BLOCK_SIZE];
+        npy_uint32 nb = (num_particles-b < FLOAT_BLOCK_SIZE) ? num_particles-b : FLOAT_BLOCK_SIZE;
+        float_to_double(dblock, fsoa, num_particles, b, nb);
+        if (!integrator(element, elemdata, dblock, nb, param)) {
+            #ifdef _OPENMP
+            #pragma omp atomic write
+            #endif /*_OPENMP*/
+            failed = 1;
+        }
+        double_to_float(fsoa, dblock, num_particles, b, nb);
+    }
+    return failed ? NULL : elemdata;
+}
+
+/*
+ * Track the turns in single precision. The particles are stored in a float
+ * array of FLOAT_SOA_ROWS rows, see driftkickfloat.c. The elements without
+ * single-precision integrator or with DoublePrecision=True are tracked in
+ * double precision: by blocks of particles, or with all the particles for
+ * the collective elements. The coordinates at the reference points are
+ * stored as floats in frout.
+ * Returns the index of the failing element, or -1 on success.
+ */
+static int track_float(struct atpass_context *ctx, float *fsoa, float *frout,
+        npy_uint32 num_particles, const struct record_schedule *sched,
+        npy_uint32 *refpts, unsigned int num_refpts,
+        int losses, int *ixnturn, int *ixnelem, bool *bxlost, double *dxlostcoord,
+        struct parameters *param, PyThreadState **tstate)
+{
+    double *dfull = NULL;           /* all the particles, for collective elements */
+    npy_uint32 nlost = 0;
+    int turn;
+
+    for (turn = 0; turn < sched->num_turns; turn++) {
+        double s_coord = 0.0;
+        unsigned int nextrefindex = 0;
+        npy_uint32 nextref = (nextrefindex<num_refpts) ? refpts[nextrefindex++] : INT_MAX;
+        npy_uint32 elem_index;
+        int record = record_turn(sched, turn);
+
+        /* Elements are cached after the first turn */
+        if (!*tstate && can_release_gil(ctx)) *tstate = PyEval_SaveThread();
+        for (elem_index = 0; elem_index < ctx->num_elements; elem_index++) {
+            PyObject *element = ctx->element_list[elem_index];
+            struct elem **elemdata = ctx->elemslot_list[elem_index];
+            param->s_coord = s_coord;
+            if (elem_index == nextref) {
+                if (record) {
+                    float_to_aos(frout, fsoa, num_particles);
+                    frout += 6*num_particles;
+                }
+                nextref = (nextrefindex<num_refpts) ? refpts[nextrefindex++] : INT_MAX;
+            }
+            if (ctx->float_integrator_list[elem_index]) {
+                *elemdata = ctx->float_integrator_list[elem_index](element, *elemdata,
+                        fsoa, num_particles, param);
+            }
+            else if (ctx->collective_list[elem_index]) {
+                if (!dfull) dfull = (double *)malloc(6*num_particles*sizeof(double));
+                float_to_double(dfull, fsoa, num_particles, 0, num_particles);
+                *elemdata = ctx->integrator_list[elem_index](element, *elemdata,
+                        dfull, num_particles, param);
+                double_to_float(fsoa, dfull, num_particles, 0, num_particles);
+            }
+            else {
+                *elemdata = track_double_blocks(ctx->integrator_list[elem_index], element,
+                        *elemdata, fsoa, num_particles, param);
+            }
+            if (!*elemdata) {       /* trackFunction failed */
+                free(dfull);
+                return elem_index;
+            }
+            if (count_lost_float(fsoa, num_particles) != nlost) {
+                if (losses)
+                    nlost = checkiflost_float(fsoa, num_particles, elem_index, param->nturn,
+                                              ixnturn, ixnelem, bxlost, dxlostcoord);
+                else
+                    nlost = checkiflost_float(fsoa, num_particles, elem_index, param->nturn,
+                                              NULL, NULL, NULL, NULL);
+            }
+            s_coord += ctx->elemlength_list[elem_index];
+        }
+        /* the last element in the ring */
+        if ((ctx->num_elements == nextref) && record) {
+            float_to_aos(frout, fsoa, num_particles);
+            frout += 6*num_particles;
+        }
+        param->nturn++;
+    }
+    free(dfull);
+    return -1;
 }
 
 
+/* Wall-clock time in seconds, for profiling */
+static double wall_time(void)
+{
+#if defined(PCWIN) || defined(PCWIN64) || defined(_WIN32)
+    LARGE_INTEGER count, freq;
+    QueryPerformanceCounter(&count);
+    QueryPerformanceFrequency(&freq);
+    return (double)count.QuadPart / (double)freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + 1.0e-9*(double)ts.tv_nsec;
+#endif
+}
+
 /* Get a reference to a python object in a module
    Equivalent to "from module_name import object" */
 static PyObject *get_pyobj(const char *module_name, const char *object)
@@ -199,9 +1019,12 @@ static PyObject *get_ext_suffix(void) {
 
 /*
  * Import the python module for python integrators
- * and return the function object
+ * and return the function object. If the module provides the address of
+ * a compiled function with the track_function signature in
+ * "trackFunctionAddress" (an integer or an object with an "address"
+ * attribute, as numba cfuncs), store it in *address and return NULL.
  */
-static PyObject *GetpyFunction(const char *fn_name)
+static PyObject *GetpyFunction(const char *fn_name, track_function *address)
 {
   char dest[300];
   strcpy(dest,"at.integrators.");
@@ -215,6 +1038,21 @@ static PyObject *GetpyFunction(const char *fn_name)
   if(!pModule){
       return NULL;
   }
+  PyObject *pyaddress = PyObject_GetAttrString(pModule, "trackFunctionAddress");
+  if (pyaddress) {
+      void *ptr;
+      if (!PyLong_Check(pyaddress)) {
+          PyObject *pyobj = pyaddress;
+          pyaddress = PyObject_GetAttrString(pyobj, "address");
+          Py_DECREF(pyobj);
+      }
+      ptr = pyaddress ? PyLong_AsVoidPtr(pyaddress) : NULL;
+      Py_XDECREF(pyaddress);
+      Py_DECREF(pModule);
+      *address = (track_function)ptr;
+      return NULL;
+  }
+  PyErr_Clear();
   PyObject *pyfunction = PyObject_GetAttrString(pModule, "trackFunction");
   if ((!pyfunction) || !PyCallable_Check(pyfunction)) {
       Py_DECREF(pModule);
@@ -226,7 +1064,9 @@ static PyObject *GetpyFunction(const char *fn_name)
 }
 
 /*
- * Find the correct track function by name.
+ * Find the correct track function by name. In builds with
+ * AT_STATIC_PASSMETHODS, the built-in passmethods are taken from the
+ * static table, other ones are loaded dynamically.
  */
 static struct LibraryListElement* get_track_function(const char *fn_name) {
 
@@ -235,16 +1075,38 @@ static struct LibraryListElement* get_track_function(const char *fn_name) {
     if (!LibraryListPtr) {
         LIBRARYHANDLETYPE dl_handle=NULL;
         track_function fn_handle = NULL;
+        track_function soa_handle = NULL;
+        track_function tangent_handle = NULL;
+        float_track_function float_handle = NULL;
+        bool collective = false;
+        PyObject *pyfunction = NULL;
+#ifdef AT_STATIC_PASSMETHODS
+        const struct static_passmethod *builtin = search_static_passmethod(fn_name);
+
+        if (builtin) {
+            fn_handle = builtin->function;
+            soa_handle = builtin->soa_function;
+            tangent_handle = builtin->tangent_function;
+            float_handle = builtin->float_function;
+            collective = builtin->collective;
+        }
+        else
+#endif /* AT_STATIC_PASSMETHODS */
+        {
+            pyfunction = GetpyFunction(fn_name, &fn_handle);
+            PyErr_Clear();      /* Clear any import error if there is no python integrator */
+        }
 
-        PyObject *pyfunction = GetpyFunction(fn_name);
-        PyErr_Clear();      /* Clear any import error if there is no python integrator */
-
-        if (!pyfunction){
+        if (!(pyfunction || fn_handle)){
             char lib_file[300];
             snprintf(lib_file, sizeof(lib_file), integrator_path, fn_name);
             dl_handle = LOADLIBFCN(lib_file);
             if (dl_handle) {
                 fn_handle = (track_function) GETTRACKFCN(dl_handle);
+                soa_handle = (track_function) GETSOAFCN(dl_handle);
+                tangent_handle = (track_function) GETTANGENTFCN(dl_handle);
+                float_handle = (float_track_function) GETFLOATFCN(dl_handle);
+                collective = (GETCOLLECTIVE(dl_handle) != NULL);
             }
         }
         
@@ -260,6 +1122,10 @@ static struct LibraryListElement* get_track_function(const char *fn_name) {
         LibraryListPtr->MethodName = strcpy(malloc(strlen(fn_name)+1), fn_name);
         LibraryListPtr->LibraryHandle = dl_handle;
         LibraryListPtr->FunctionHandle = fn_handle;
+        LibraryListPtr->SoAFunctionHandle = soa_handle;
+        LibraryListPtr->TangentFunctionHandle = tangent_handle;
+        LibraryListPtr->FloatFunctionHandle = float_handle;
+        LibraryListPtr->Collective = collective;
         LibraryListPtr->PyFunctionHandle = pyfunction;
         LibraryListPtr->Next = LibraryList;
         LibraryList = LibraryListPtr;
@@ -319,6 +1185,139 @@ void set_current_fillpattern(PyArrayObject *bspos, PyArrayObject *bcurrents,
     }   
 }
 
+/* Modification stamp of an element, 0 if not available */
+static long long element_version(PyObject *el)
+{
+    long long version = 0;
+    PyObject *pyversion = PyObject_GetAttr(el, str_version);
+    if (pyversion) {
+        version = PyLong_AsLongLong(pyversion);
+        Py_DECREF(pyversion);
+    }
+    if (PyErr_Occurred()) {
+        version = 0;
+        PyErr_Clear();
+    }
+    return version;
+}
+
+/*
+ * Store the description of an element in a context, discarding the cached
+ * element data. Returns 0, or -1 with an exception set.
+ */
+static int set_element(struct atpass_context *ctx, npy_uint32 elem_index, PyObject *el)
+{
+    struct LibraryListElement *LibraryListPtr;
+    PyObject *pylength;
+    PyObject *PyPassMethod = PyObject_GetAttr(el, str_passmethod);
+    double length;
+    if (!PyPassMethod) return -1;       /* No PassMethod: AttributeError */
+    LibraryListPtr = get_track_function(PyUnicode_AsUTF8(PyPassMethod));
+    Py_DECREF(PyPassMethod);
+    if (!LibraryListPtr) return -1;     /* No trackFunction for the given PassMethod: RuntimeError */
+    pylength = PyObject_GetAttr(el, str_length);
+    length = PyFloat_AsDouble(pylength);
+    Py_XDECREF(pylength);
+    if (PyErr_Occurred()) {
+        length = 0.0;
+        PyErr_Clear();
+    }
+    ctx->integrator_list[elem_index] = LibraryListPtr->FunctionHandle;
+    ctx->soa_integrator_list[elem_index] = LibraryListPtr->SoAFunctionHandle;
+    ctx->float_integrator_list[elem_index] = LibraryListPtr->FloatFunctionHandle;
+    if (LibraryListPtr->FloatFunctionHandle) {
+        /* DoublePrecision=True forces the double-precision integrator */
+        PyObject *pydouble = PyObject_GetAttr(el, str_double_precision);
+        if (pydouble) {
+            int force_double = PyObject_IsTrue(pydouble);
+            Py_DECREF(pydouble);
+            if (force_double < 0) return -1;
+            if (force_double) ctx->float_integrator_list[elem_index] = NULL;
+        }
+        else PyErr_Clear();
+    }
+    ctx->collective_list[elem_index] = LibraryListPtr->Collective;
+    ctx->pyintegrator_list[elem_index] = LibraryListPtr->PyFunctionHandle;
+    ctx->elemlength_list[elem_index] = length;
+    ctx->version_list[elem_index] = element_version(el);
+    free(ctx->elemdata_list[elem_index]);
+    ctx->elemdata_list[elem_index] = NULL;
+    Py_INCREF(el);                      /* Keep a reference to each element in case of reuse */
+    Py_XDECREF(ctx->element_list[elem_index]);
+    ctx->element_list[elem_index] = el;
+    return 0;
+}
+
+/*
+ * Point the repeated occurrences of an element object to the data of its
+ * first occurrence, so that it is initialised once. The data already built
+ * for a repeated occurrence is moved to the first one, or released.
+ * Collective and Python elements are not shared. Returns 0, or -1 with an
+ * exception set.
+ */
+static int share_elements(struct atpass_context *ctx)
+{
+    npy_uint32 elem_index;
+    PyObject *first_index = PyDict_New();
+    if (!first_index) return -1;
+    for (elem_index = 0; elem_index < ctx->num_elements; elem_index++) {
+        PyObject *key, *pos;
+        ctx->elemslot_list[elem_index] = ctx->elemdata_list + elem_index;
+        if (ctx->collective_list[elem_index] || ctx->pyintegrator_list[elem_index])
+            continue;
+        key = PyLong_FromVoidPtr(ctx->element_list[elem_index]);
+        if (!key) break;
+        pos = PyDict_GetItem(first_index, key);
+        if (pos) {
+            npy_uint32 k0 = PyLong_AsUnsignedLong(pos);
+            if (!ctx->elemdata_list[k0])
+                ctx->elemdata_list[k0] = ctx->elemdata_list[elem_index];
+            else
+                free(ctx->elemdata_list[elem_index]);
+            ctx->elemdata_list[elem_index] = NULL;
+            ctx->elemslot_list[elem_index] = ctx->elemdata_list + k0;
+        }
+        else {
+            PyObject *value = PyLong_FromUnsignedLong(elem_index);
+            int err = value ? PyDict_SetItem(first_index, key, value) : -1;
+            Py_XDECREF(value);
+            if (err) {
+                Py_DECREF(key);
+                break;
+            }
+        }
+        Py_DECREF(key);
+    }
+    Py_DECREF(first_index);
+    return PyErr_Occurred() ? -1 : 0;
+}
+
+/*
+ * Initialise again the elements which were modified or replaced since
+ * they were stored in the context. Returns -1, or the index of the failing
+ * element with an exception set.
+ */
+static int refresh_elements(struct atpass_context *ctx, PyObject *lattice)
+{
+    npy_uint32 elem_index;
+    bool changed = false;
+    for (elem_index = 0; elem_index < ctx->num_elements; elem_index++) {
+        PyObject *el = PyList_GET_ITEM(lattice, elem_index);
+        if ((el != ctx->element_list[elem_index]) ||
+            (element_version(el) != ctx->version_list[elem_index])) {
+            if (set_element(ctx, elem_index, el) != 0) return elem_index;
+            changed = true;
+        }
+    }
+    if (changed) {
+        ctx->lattice_length = 0.0;
+        for (elem_index = 0; elem_index < ctx->num_elements; elem_index++)
+            ctx->lattice_length += ctx->elemlength_list[elem_index];
+        if (share_elements(ctx) != 0) return 0;
+    }
+    return -1;
+}
+
 /*
  * Parse the arguments to atpass, set things up, and execute.
  * Arguments:
@@ -327,16 +1326,22 @@ void set_current_fillpattern(PyArrayObject *bspos, PyArrayObject *bcurrents,
  *  - nturns: int number of turns to simulate
  *  - refpts: numpy uint32 array denoting elements at which to return state
  *  - reuse: whether to reuse the cached state of the ring
+ *  - update: with reuse, initialise again the modified elements
+ *  - record_stride, record_window: record one turn every record_stride
+ *    turns, within the last record_window turns
+ *  - record_trigger: keep only the recorded turns where a coordinate
+ *    exceeds its limit in this 6-vector. The turn numbers are returned
+ *  - float32: rin is a float array, tracked in single precision
  */
 static PyObject *at_atpass(PyObject *self, PyObject *args, PyObject *kwargs) {
     static char *kwlist[] = {"line","rin","nturns","refpts","turn",
                              "energy", "particle", "keep_counter",
                              "reuse","omp_num_threads","losses",
-                             "bunch_spos", "bunch_currents", NULL};
-    static double lattice_length = 0.0;
-    static int last_turn = 0;
-    static int valid = 0;
-
+                             "bunch_spos", "bunch_currents", "soa", "context",
+                             "omp_persistent", "compact_turns", "update", "profile",
+                             "record_stride", "record_window", "record_trigger", "float32", NULL};
+    struct atpass_context *ctx = &default_context;
+    PyObject *capsule = NULL;
     PyObject *lattice;
     PyObject *particle;
     PyObject *energy;
@@ -344,6 +1349,7 @@ static PyObject *at_atpass(PyObject *self, PyObject *args, PyObject *kwargs) {
     PyArrayObject *refs;
     PyObject *rout;
     double *drin, *drout;
+    double *dsoa = NULL;
     PyObject *xnturn = NULL;
     PyObject *xnelem = NULL;
     PyObject *xlost = NULL;
@@ -352,12 +1358,29 @@ static PyObject *at_atpass(PyObject *self, PyObject *args, PyObject *kwargs) {
     int *ixnelem = NULL;
     bool *bxlost = NULL;
     double *dxlostcoord = NULL;
+    PyObject *xtime = NULL;
+    PyObject *xcalls = NULL;
+    PyObject *xparticles = NULL;
+    PyObject *xelemlost = NULL;
+    double *dtime = NULL;
+    npy_int64 *icalls = NULL;
+    npy_int64 *iparticles = NULL;
+    npy_int64 *ielemlost = NULL;
     PyArrayObject *bcurrents;
     PyArrayObject *bspos;
+    PyArrayObject *trigger = NULL;
+    PyObject *xturns = NULL;
+    npy_uint32 *irecturns = NULL;
+    double *trigger_limits = NULL;
+    struct record_schedule sched;
+    int num_records;
+    int num_kept = 0;
     int num_turns;
     npy_uint32 omp_num_threads=0;
     npy_uint32 num_particles, np6;
+    npy_uint32 nlost = 0;           /* lost particles after the last bookkeeping */
     npy_uint32 elem_index;
+    int err_elem = 0;               /* element index reported on errors */
     npy_uint32 *refpts = NULL;
     npy_uint32 nextref;
     unsigned int nextrefindex;
@@ -366,15 +1389,24 @@ static PyObject *at_atpass(PyObject *self, PyObject *args, PyObject *kwargs) {
     int keep_counter=0;
     int counter=0;
     int losses=0;
+    int soa=0;
+    int omp_persistent=0;
+    int compact_turns=0;
+    int update=0;
+    int profile=0;
+    int float32=0;
+    bool rebuild;
+    npy_uint32 *perm = NULL;        /* original index of the tracked particles */
+    npy_uint32 num_active;          /* number of tracked particles */
     npy_intp outdims[4];
     npy_intp pdims[1];
     npy_intp lxdims[2];
-    int turn;
+    int turn = 0;                   /* first turn of the element loop below */
     #ifdef _OPENMP
     int maxthreads;
     #endif /*_OPENMP*/
     struct parameters param;
-    struct LibraryListElement *LibraryListPtr;
+    PyThreadState *tstate = NULL;
 
     particle=NULL;
     energy=NULL;
@@ -382,16 +1414,1024 @@ static PyObject *at_atpass(PyObject *self, PyObject *args, PyObject *kwargs) {
     bspos=NULL;
     bcurrents=NULL;
     
-    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O!O!i|O!$iO!O!ppIpO!O!", kwlist,
+    sched.stride = 1;
+    sched.window = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O!O!i|O!$iO!O!ppIpO!O!pO!pippiiO!p", kwlist,
         &PyList_Type, &lattice, &PyArray_Type, &rin, &num_turns,
         &PyArray_Type, &refs, &counter,
-        &PyFloat_Type ,&energy, particle_type, &particle,
-        &keep_counter, &keep_lattice, &omp_num_threads, &losses,
-        &PyArray_Type, &bspos, &PyArray_Type, &bcurrents)) {
+        &PyFloat_Type ,&energy, particle_type, &particle,
+        &keep_counter, &keep_lattice, &omp_num_threads, &losses,
+        &PyArray_Type, &bspos, &PyArray_Type, &bcurrents, &soa,
+        &PyCapsule_Type, &capsule, &omp_persistent, &compact_turns, &update, &profile,
+        &sched.stride, &sched.window, &PyArray_Type, &trigger, &float32)) {
+        return NULL;
+    }
+    if (capsule) {
+        ctx = PyCapsule_GetPointer(capsule, CONTEXT_CAPSULE_NAME);
+        if (!ctx) return NULL;
+    }
+    if (context_in_use(ctx)) {
+        return PyErr_Format(PyExc_RuntimeError, "the tracking context is already in use");
+    }
+    if (PyArray_DIM(rin,0) != 6) {
+        return PyErr_Format(PyExc_ValueError, "rin is not 6D");
+    }
+    if (PyArray_TYPE(rin) != (float32 ? NPY_FLOAT : NPY_DOUBLE)) {
+        return PyErr_Format(PyExc_ValueError, "rin is not a %s array", float32 ? "float" : "double");
+    }
+    if ((PyArray_FLAGS(rin) & NPY_ARRAY_FARRAY_RO) != NPY_ARRAY_FARRAY_RO) {
+        return PyErr_Format(PyExc_ValueError, "rin is not Fortran-aligned");
+    }
+    if (float32 && (trigger || profile)) {
+        return PyErr_Format(PyExc_ValueError, "record_trigger and profile are not available with float32");
+    }
+    if ((sched.stride < 1) || (sched.window < 0)) {
+        return PyErr_Format(PyExc_ValueError, "record_stride must be positive and record_window non-negative");
+    }
+    if (trigger) {
+        if ((PyArray_TYPE(trigger) != NPY_DOUBLE) || (PyArray_SIZE(trigger) != 6) ||
+            !PyArray_ISCARRAY_RO(trigger)) {
+            return PyErr_Format(PyExc_ValueError, "record_trigger is not a contiguous double 6-vector");
+        }
+        trigger_limits = PyArray_DATA(trigger);
+    }
+    sched.num_turns = num_turns;
+    num_records = record_count(&sched);
+
+    param.common_rng=ctx->rng_state;
+    param.thread_rng=ctx->rng_state+1;
+    param.nthread_rng=nthread_state;
+    param.energy=0.0;
+    param.rest_energy=0.0;
+    param.charge=-1.0;       
+    
+    if (keep_counter)
+        param.nturn = ctx->last_turn;
+    else
+        param.nturn = counter;
+
+    set_energy_particle(lattice, energy, particle, &param);   
+    set_current_fillpattern(bspos, bcurrents, &param);
+
+    num_particles = (PyArray_SIZE(rin)/6);
+    np6 = num_particles*6;
+    drin = PyArray_DATA(rin);
+
+    if (refs) {
+        if (PyArray_TYPE(refs) != NPY_UINT32) {
+            return PyErr_Format(PyExc_ValueError, "refpts is not a uint32 array");
+        }
+        refpts = PyArray_DATA(refs);
+        num_refpts = PyArray_SIZE(refs);
+    }
+    else {
+        refpts = NULL;
+        num_refpts = 0;
+    }
+    outdims[0] = 6;
+    outdims[1] = num_particles;
+    outdims[2] = num_refpts;
+    outdims[3] = num_records;
+    rout = PyArray_EMPTY(4, outdims, float32 ? NPY_FLOAT : NPY_DOUBLE, 1);
+    drout = PyArray_DATA((PyArrayObject *)rout);
+    if (trigger) {
+        pdims[0] = num_records;
+        xturns = PyArray_EMPTY(1, pdims, NPY_UINT32, 0);
+        irecturns = PyArray_DATA((PyArrayObject *)xturns);
+    }
+
+    if(losses){
+        pdims[0]= num_particles;
+        lxdims[0]= 6;
+        lxdims[1]= num_particles;
+        xnturn = PyArray_EMPTY(1, pdims, NPY_UINT32, 1);
+        xnelem = PyArray_EMPTY(1, pdims, NPY_UINT32, 1);
+        xlost = PyArray_EMPTY(1, pdims, NPY_BOOL, 1);
+        xlostcoord = PyArray_EMPTY(2, lxdims, NPY_DOUBLE, 1);
+        ixnturn = PyArray_DATA((PyArrayObject *)xnturn);
+        ixnelem = PyArray_DATA((PyArrayObject *)xnelem);
+        bxlost = PyArray_DATA((PyArrayObject *)xlost);
+        dxlostcoord = PyArray_DATA((PyArrayObject *)xlostcoord);
+        unsigned int i;
+        static double r0[6];
+        for(i=0;i<num_particles;i++){
+            bxlost[i]=0;
+            ixnturn[i]=0;
+            ixnelem[i]=0;
+            memcpy(dxlostcoord+6*i,r0,6*sizeof(double));
+        }
+    }
+
+    /* Wait for the default context if another thread is tracking with it */
+    if (acquire_context(ctx) != 0) {
+        Py_XDECREF(xnturn);
+        Py_XDECREF(xnelem);
+        Py_XDECREF(xlost);
+        Py_XDECREF(xlostcoord);
+        Py_XDECREF(xturns);
+        Py_XDECREF(rout);
+        return NULL;
+    }
+
+    /* Profiling and triggers are done in the element loop of the main thread */
+    if (profile || trigger) omp_persistent = 0;
+    /* The single-precision tracking has its own layout and element loop */
+    if (float32) {
+        soa = 0;
+        omp_persistent = 0;
+        compact_turns = 0;
+    }
+
+    #ifdef _OPENMP
+    if (num_particles <= OMP_PARTICLE_THRESHOLD) omp_persistent = 0;
+    if ((omp_num_threads > 0) && (num_particles > OMP_PARTICLE_THRESHOLD)) {
+        unsigned int nthreads = omp_get_num_procs();
+        maxthreads = omp_get_max_threads();
+        if (omp_num_threads < nthreads) nthreads = omp_num_threads;
+        if (num_particles < nthreads) nthreads = num_particles;
+        omp_set_num_threads(nthreads);
+    }
+    #endif /*_OPENMP*/
+
+    rebuild = !(keep_lattice && ctx->valid);
+    if (!rebuild && update && ((npy_uint32)PyList_Size(lattice) != ctx->num_elements))
+        rebuild = true;     /* Lattice structure changed */
+    if (rebuild) {
+        npy_uint32 num_elements;
+        /* Release the stored elements */
+        release_elements(ctx);
+        num_elements = PyList_Size(lattice);
+
+        /* Pointer to Element structures used by the tracking function */
+        free(ctx->elemdata_list);
+        ctx->elemdata_list = (struct elem **)calloc(num_elements, sizeof(struct elem *));
+        free(ctx->elemslot_list);
+        ctx->elemslot_list = (struct elem ***)calloc(num_elements, sizeof(struct elem **));
+
+        /* Pointer to Element lengths */
+        free(ctx->elemlength_list);
+        ctx->elemlength_list = (double *)calloc(num_elements, sizeof(double));
+
+        /* Pointer to Element list, make sure all pointers are initially NULL */
+        free(ctx->element_list);
+        ctx->element_list = (PyObject **)calloc(num_elements, sizeof(PyObject *));
+
+        /* pointer to the list of C integrators */
+        ctx->integrator_list = (track_function *)realloc(ctx->integrator_list, num_elements*sizeof(track_function));
+
+        /* pointer to the list of structure-of-arrays C integrators */
+        ctx->soa_integrator_list = (track_function *)realloc(ctx->soa_integrator_list, num_elements*sizeof(track_function));
+
+        /* pointer to the list of single-precision C integrators */
+        ctx->float_integrator_list = (float_track_function *)realloc(ctx->float_integrator_list, num_elements*sizeof(float_track_function));
+
+        /* flags for the collective integrators */
+        ctx->collective_list = (bool *)realloc(ctx->collective_list, num_elements*sizeof(bool));
+
+        /* pointer to the list of python integrators, make sure all pointers are initially NULL */
+        free(ctx->pyintegrator_list);
+        ctx->pyintegrator_list = (PyObject **)calloc(num_elements, sizeof(PyObject *));
+
+        /* pointer to the list of python integrators kwargs, make sure all pointers are initially NULL */
+        free(ctx->kwargs_list);
+        ctx->kwargs_list = (PyObject **)calloc(num_elements, sizeof(PyObject *));
+
+        /* modification stamps of the elements */
+        ctx->version_list = (long long *)realloc(ctx->version_list, num_elements*sizeof(long long));
+
+        ctx->num_elements = num_elements;
+        ctx->lattice_length = 0.0;
+        for (elem_index = 0; elem_index < num_elements; elem_index++) {
+            if (set_element(ctx, elem_index, PyList_GET_ITEM(lattice, elem_index)) != 0) {
+                err_elem = elem_index;
+                goto error;
+            }
+            ctx->lattice_length += ctx->elemlength_list[elem_index];
+        }
+        if (share_elements(ctx) != 0) {
+            err_elem = 0;
+            goto error;
+        }
+        ctx->valid = 0;
+    }
+    else if (update) {
+        int failed = refresh_elements(ctx, lattice);
+        if (failed >= 0) {
+            ctx->valid = 0;
+            err_elem = failed;
+            goto error;
+        }
+    }
+
+    param.RingLength = ctx->lattice_length;
+    if (param.rest_energy == 0.0) {
+        param.T0 = param.RingLength/C0;
+    }
+    else {
+        double gamma0 = param.energy/param.rest_energy;
+        double betagamma0 = sqrt(gamma0*gamma0 - 1.0);
+        double beta0 = betagamma0/gamma0;
+        param.T0 = param.RingLength/beta0/C0;
+    }
+
+    if (profile) {
+        npy_intp edims[1] = {ctx->num_elements};
+        xtime = PyArray_ZEROS(1, edims, NPY_DOUBLE, 0);
+        xcalls = PyArray_ZEROS(1, edims, NPY_INT64, 0);
+        xparticles = PyArray_ZEROS(1, edims, NPY_INT64, 0);
+        xelemlost = PyArray_ZEROS(1, edims, NPY_INT64, 0);
+        dtime = PyArray_DATA((PyArrayObject *)xtime);
+        icalls = PyArray_DATA((PyArrayObject *)xcalls);
+        iparticles = PyArray_DATA((PyArrayObject *)xparticles);
+        ielemlost = PyArray_DATA((PyArrayObject *)xelemlost);
+    }
+
+    /* The structure-of-arrays layout is used only if all the elements support it */
+    if (soa) {
+        for (elem_index = 0; elem_index < ctx->num_elements; elem_index++) {
+            if (!ctx->soa_integrator_list[elem_index]) {
+                soa = 0;
+                break;
+            }
+        }
+    }
+    if (soa) {
+        dsoa = (double *)malloc(np6*sizeof(double));
+        aos_to_soa(dsoa, drin, num_particles);
+    }
+
+    /* The compaction is incompatible with elements using all the particles */
+    if (soa || omp_persistent || float32 || (param.nbunch > 1)) compact_turns = 0;
+    for (elem_index = 0; (compact_turns > 0) && (elem_index < ctx->num_elements); elem_index++) {
+        if (ctx->collective_list[elem_index] || ctx->pyintegrator_list[elem_index])
+            compact_turns = 0;
+    }
+    if (compact_turns > 0) {
+        perm = (npy_uint32 *)malloc(num_particles*sizeof(npy_uint32));
+        for (elem_index = 0; elem_index < num_particles; elem_index++)
+            perm[elem_index] = elem_index;
+    }
+    num_active = num_particles;
+
+    if (float32) {
+        float *fsoa;
+        int failed;
+        for (elem_index = 0; elem_index < ctx->num_elements; elem_index++) {
+            if (ctx->pyintegrator_list[elem_index]) {
+                PyErr_Format(PyExc_ValueError, "float32 is not available with Python PassMethods");
+                err_elem = elem_index;
+                goto error;
+            }
+        }
+        fsoa = (float *)malloc(FLOAT_SOA_ROWS*num_particles*sizeof(float));
+        aos_to_float(fsoa, PyArray_DATA(rin), num_particles);
+        failed = track_float(ctx, fsoa, PyArray_DATA((PyArrayObject *)rout), num_particles, &sched,
+                refpts, num_refpts, losses, ixnturn, ixnelem, bxlost, dxlostcoord, &param, &tstate);
+        float_to_aos(PyArray_DATA(rin), fsoa, num_particles);
+        free(fsoa);
+        if (failed >= 0) {
+            RESTORE_GIL(tstate);
+            if (!PyErr_Occurred())
+                PyErr_Format(PyExc_RuntimeError, "trackFunction failed at element %d", failed);
+            err_elem = failed;
+            goto error;
+        }
+        turn = num_turns;
+    }
+
+    for (; turn < num_turns; turn++) {
+        PyObject **element = ctx->element_list;
+        double *elem_length = ctx->elemlength_list;
+        track_function *integrator = soa ? ctx->soa_integrator_list : ctx->integrator_list;
+        PyObject **pyintegrator = ctx->pyintegrator_list;
+        PyObject **kwargs = ctx->kwargs_list;
+        struct elem ***elemslot = ctx->elemslot_list;
+        double s_coord = 0.0;
+        double *drout_turn = drout;
+        int record = record_turn(&sched, turn);
+
+        /* Elements are cached after the first turn */
+        if (!tstate && can_release_gil(ctx)) tstate = PyEval_SaveThread();
+        #ifdef _OPENMP
+        /* Once the GIL is released, continue in a single parallel region */
+        if (omp_persistent && tstate && !soa) break;
+        #endif /*_OPENMP*/
+        if (perm && (turn > 0) && (turn % compact_turns == 0) && (nlost > 0)) {
+            num_active = compact_particles(drin, num_active, perm, ixnturn, ixnelem, bxlost, dxlostcoord);
+            nlost = 0;
+        }
+      /*PySys_WriteStdout("turn: %i\n", param.nturn);*/
+        nextrefindex = 0;
+        nextref= (nextrefindex<num_refpts) ? refpts[nextrefindex++] : INT_MAX;
+        for (elem_index = 0; elem_index < ctx->num_elements; elem_index++) {
+            struct elem **elemdata = *elemslot;
+            double tstart = 0.0;
+            npy_uint32 nlost_in = nlost;
+            param.s_coord = s_coord;
+            if (elem_index == nextref) {
+                if (record) {
+                    if (soa) soa_to_aos(drout, dsoa, num_particles);
+                    else output_particles(drout, drin, num_particles, perm);
+                    drout += np6; /*  shift the location to write to in the output array */
+                }
+                nextref = (nextrefindex<num_refpts) ? refpts[nextrefindex++] : INT_MAX;
+            }
+            if (profile) tstart = wall_time();
+            /* the actual integrator call */
+            if (soa) {
+                *elemdata = (*integrator)(*element, *elemdata, dsoa, num_particles, &param);
+                if (!*elemdata) {       /* trackFunction failed */
+                    RESTORE_GIL(tstate);
+                    err_elem = elem_index;
+                    goto error;
+                }
+                if (count_lost_soa(dsoa, num_particles) != nlost) {
+                    if (losses)
+                        nlost = checkiflost_soa(dsoa, num_particles, elem_index, param.nturn, ixnturn, ixnelem, bxlost, dxlostcoord);
+                    else
+                        nlost = setlost_soa(dsoa, num_particles);
+                }
+            } else {
+                if (*pyintegrator) {
+                    PyObject *res = PyObject_CallFunctionObjArgs(*pyintegrator, rin, *element, NULL);
+                    if (!res) {         /* trackFunction failed */
+                        release_order(drin, num_particles, perm, ixnturn, ixnelem, bxlost, dxlostcoord);
+                        err_elem = elem_index;
+                        goto error;
+                    }
+                    Py_DECREF(res);
+                } else {
+                    *elemdata = (*integrator)(*element, *elemdata, drin, num_active, &param);
+                    if (!*elemdata) {   /* trackFunction failed */
+                        RESTORE_GIL(tstate);
+                        release_order(drin, num_particles, perm, ixnturn, ixnelem, bxlost, dxlostcoord);
+                        err_elem = elem_index;
+                        goto error;
+                    }
+                }
+                if (count_lost(drin, num_active) != nlost) {
+                    if (losses)
+                        nlost = checkiflost(drin, num_active, elem_index, param.nturn, ixnturn, ixnelem, bxlost, dxlostcoord);
+                    else
+                        nlost = setlost(drin, num_active);
+                }
+            }
+            if (profile) {
+                dtime[elem_index] += wall_time() - tstart;
+                icalls[elem_index]++;
+                iparticles[elem_index] += (soa ? num_particles : num_active) - nlost_in;
+                ielemlost[elem_index] += nlost - nlost_in;
+            }
+            s_coord += *elem_length++;
+            element++;
+            integrator++;
+            pyintegrator++;
+            elemslot++;
+            kwargs++;
+        }
+        /* the last element in the ring */
+        if ((ctx->num_elements == nextref) && record) {
+            if (soa) soa_to_aos(drout, dsoa, num_particles);
+            else output_particles(drout, drin, num_particles, perm);
+            drout += np6; /*  shift the location to write to in the output array */
+        }
+        if (record && trigger) {
+            /* Keep the turn only if triggered, otherwise overwrite it */
+            if (record_triggered(drout_turn, drout - drout_turn, trigger_limits))
+                irecturns[num_kept++] = param.nturn;
+            else
+                drout = drout_turn;
+        }
+        param.nturn++;
+    }
+    #ifdef _OPENMP
+    if (turn < num_turns) {
+        int failed = track_persistent(ctx, drin, drout, num_particles, turn, &sched,
+                refpts, num_refpts, losses, ixnturn, ixnelem, bxlost, dxlostcoord, &param);
+        if (failed >= 0) {
+            RESTORE_GIL(tstate);
+            if (!PyErr_Occurred())
+                PyErr_Format(PyExc_RuntimeError, "trackFunction failed at element %d", failed);
+            err_elem = failed;
+            goto error;
+        }
+    }
+    #endif /*_OPENMP*/
+    RESTORE_GIL(tstate);
+    if (dsoa) {
+        soa_to_aos(drin, dsoa, num_particles);
+        free(dsoa);
+        dsoa = NULL;
+    }
+    release_order(drin, num_particles, perm, ixnturn, ixnelem, bxlost, dxlostcoord);
+
+    if (trigger) {
+        /* Shrink the output to the triggered turns */
+        npy_intp tdims[1] = {num_kept};
+        PyArray_Dims newshape = {outdims, 4};
+        PyArray_Dims tshape = {tdims, 1};
+        PyObject *res;
+        outdims[3] = num_kept;
+        res = PyArray_Resize((PyArrayObject *)rout, &newshape, 0, NPY_FORTRANORDER);
+        if (!res) goto error;
+        Py_DECREF(res);
+        res = PyArray_Resize((PyArrayObject *)xturns, &tshape, 0, NPY_CORDER);
+        if (!res) goto error;
+        Py_DECREF(res);
+    }
+    ctx->valid = 1;      /* Tracking successful: the lattice can be reused */
+    ctx->last_turn = param.nturn;  /* Store turn number in the context */
+    release_context(ctx);
+
+    #ifdef _OPENMP
+    if ((omp_num_threads > 0) && (num_particles > OMP_PARTICLE_THRESHOLD)) {
+        omp_set_num_threads(maxthreads);
+    }
+    #endif /*_OPENMP*/
+
+    if (losses || profile || trigger) {
+        PyObject *tout = PyTuple_New(1 + losses + profile + (trigger != NULL));
+        PyTuple_SetItem(tout, 0, rout);
+        if (losses) {
+            PyObject *dict = PyDict_New();
+            PyDict_SetItemString(dict,(char *)"islost",(PyObject *)xlost);
+            PyDict_SetItemString(dict,(char *)"turn",(PyObject *)xnturn); 
+            PyDict_SetItemString(dict,(char *)"elem",(PyObject *)xnelem);
+            PyDict_SetItemString(dict,(char *)"coord",(PyObject *)xlostcoord);
+            PyTuple_SetItem(tout, 1, dict);
+            Py_DECREF(xlost);
+            Py_DECREF(xnturn);
+            Py_DECREF(xnelem);
+            Py_DECREF(xlostcoord);
+        }
+        if (profile) {
+            PyObject *dict = PyDict_New();
+            PyDict_SetItemString(dict,(char *)"time",xtime);
+            PyDict_SetItemString(dict,(char *)"calls",xcalls);
+            PyDict_SetItemString(dict,(char *)"particles",xparticles);
+            PyDict_SetItemString(dict,(char *)"lost",xelemlost);
+            PyTuple_SetItem(tout, 1 + losses, dict);
+            Py_DECREF(xtime);
+            Py_DECREF(xcalls);
+            Py_DECREF(xparticles);
+            Py_DECREF(xelemlost);
+        }
+        if (trigger) PyTuple_SetItem(tout, 1 + losses + profile, xturns);
+        return tout;
+    } else {
+        return rout;
+    }
+
+error:
+    /* Update the input coordinates, as with the array-of-structures layout */
+    if (dsoa) {
+        soa_to_aos(drin, dsoa, num_particles);
+        free(dsoa);
+    }
+    #ifdef _OPENMP
+    if ((omp_num_threads > 0) && (num_particles > OMP_PARTICLE_THRESHOLD)) {
+        omp_set_num_threads(maxthreads);
+    }
+    #endif /*_OPENMP*/
+    /* Release all the output arrays */
+    Py_XDECREF(xturns);
+    Py_XDECREF(xnturn);
+    Py_XDECREF(xnelem);
+    Py_XDECREF(xlost);
+    Py_XDECREF(xlostcoord);
+    Py_XDECREF(xtime);
+    Py_XDECREF(xcalls);
+    Py_XDECREF(xparticles);
+    Py_XDECREF(xelemlost);
+    return print_error(ctx, err_elem, rout);
+}
+
+static PyObject *at_elempass(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    static char *kwlist[] = {"element", "rin",
+                             "energy", "particle", NULL};
+    PyObject *element;
+    PyObject *energy;
+    PyObject *particle;
+    PyArrayObject *rin;
+    PyObject *PyPassMethod;
+    npy_uint32 num_particles;
+    track_function integrator;
+    PyObject *pyintegrator;
+    double *drin;
+    struct parameters param;
+    struct LibraryListElement *LibraryListPtr;
+
+    param.nturn = 0;
+    param.energy=0.0;
+    param.rest_energy=0.0;
+    param.charge=-1.0;
+    param.common_rng=default_context.rng_state;
+    param.thread_rng=default_context.rng_state+1;
+    param.nthread_rng=nthread_state;
+    particle=NULL;
+    energy=NULL;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O!O!|$O!O!", kwlist,
+        element_type, &element,  &PyArray_Type, &rin,
+        &PyFloat_Type ,&energy, particle_type, &particle)) {
+        return NULL;
+    }
+    if (PyArray_DIM(rin,0) != 6) {
+        return PyErr_Format(PyExc_ValueError, "rin is not 6D");
+    }
+    if (PyArray_TYPE(rin) != NPY_DOUBLE) {
+        return PyErr_Format(PyExc_ValueError, "rin is not a double array");
+    }
+    if ((PyArray_FLAGS(rin) & NPY_ARRAY_FARRAY_RO) != NPY_ARRAY_FARRAY_RO) {
+        return PyErr_Format(PyExc_ValueError, "rin is not Fortran-aligned");
+    }
+
+    set_energy_particle(NULL, energy, particle, &param);
+
+    num_particles = (PyArray_SIZE(rin)/6);
+    drin = PyArray_DATA(rin);
+
+    param.RingLength = 0.0;
+    param.T0 = 0.0;
+    param.beam_current=0.0;
+    param.nbunch=1;
+    param.bunch_spos = (double[1]){0.0};
+    param.bunch_currents = (double[1]){0.0};
+
+    PyPassMethod = PyObject_GetAttr(element, str_passmethod);
+    if (!PyPassMethod) return NULL;
+    LibraryListPtr = get_track_function(PyUnicode_AsUTF8(PyPassMethod));
+    Py_DECREF(PyPassMethod);
+    if (!LibraryListPtr) return NULL;
+    integrator = LibraryListPtr->FunctionHandle;
+    pyintegrator = LibraryListPtr->PyFunctionHandle;
+    if (pyintegrator) {
+        PyObject *res = PyObject_CallFunctionObjArgs(pyintegrator, rin, element, NULL);
+        if (!res) return NULL;
+        Py_DECREF(res);
+    } else {
+        bool locked = lock_default_rngs();
+        struct elem *elem_data = integrator(element, NULL, drin, num_particles, &param);
+        unlock_default_rngs(locked);
+        if (!elem_data) return NULL;
+        free(elem_data);
+    }
+    Py_INCREF(rin);
+    return (PyObject *) rin;
+}
+
+/*
+ * Track tangent particles along a line. Each coordinate carries its
+ * derivatives with respect to the initial coordinates, so that a single
+ * pass gives the orbit and the transfer matrices at the reference points.
+ * Only the PassMethods providing a trackFunctionTangent are supported.
+ */
+static void tangent_setlost(double *dtan, npy_uint32 np)
+{
+    npy_uint32 c, n, k;
+    for (c=0; c<np; c++) {
+        double *rt = dtan+c*TANGENT_SIZE;
+        if (!isnan(rt[0])) {
+            for (n=0; n<6; n++) {
+                double rn = rt[7*n];
+                if (!isfinite(rn) || ((fabs(rn)>LIMIT_AMPLITUDE)&&n<5)) {
+                    for (k=0; k<TANGENT_SIZE; k++) rt[k] = NAN;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+/* Initial tangent particles: identity matrix */
+static void tangent_init(double *dtan, const double *drin, npy_uint32 np)
+{
+    npy_uint32 c, i;
+    memset(dtan, 0, np*TANGENT_SIZE*sizeof(double));
+    for (c=0; c<np; c++) {
+        for (i=0; i<6; i++) {
+            dtan[c*TANGENT_SIZE+7*i] = drin[c*6+i];
+            dtan[c*TANGENT_SIZE+7*i+1+i] = 1.0;
+        }
+    }
+    tangent_setlost(dtan, np);
+}
+
+/*
+ * Look for the tangent integrators of all the elements before tracking
+ * anything, and set the ring length and revolution period in param
+ */
+static track_function *get_tangent_functions(PyObject *lattice, npy_uint32 num_elements,
+                                             struct parameters *param)
+{
+    track_function *tangent_list = (track_function *)malloc(num_elements*sizeof(track_function));
+    npy_uint32 elem_index;
+    param->RingLength = 0.0;
+    for (elem_index = 0; elem_index < num_elements; elem_index++) {
+        PyObject *el = PyList_GET_ITEM(lattice, elem_index);
+        PyObject *PyPassMethod = PyObject_GetAttr(el, str_passmethod);
+        PyObject *pylength;
+        struct LibraryListElement *LibraryListPtr;
+        double length;
+        if (!PyPassMethod) {
+            free(tangent_list);
+            return NULL;
+        }
+        LibraryListPtr = get_track_function(PyUnicode_AsUTF8(PyPassMethod));
+        if (LibraryListPtr && !LibraryListPtr->TangentFunctionHandle) {
+            PyErr_Format(PyExc_NotImplementedError,
+                "PassMethod %s: no tangent map", PyUnicode_AsUTF8(PyPassMethod));
+            LibraryListPtr = NULL;
+        }
+        Py_DECREF(PyPassMethod);
+        if (!LibraryListPtr) {
+            free(tangent_list);
+            return NULL;
+        }
+        tangent_list[elem_index] = LibraryListPtr->TangentFunctionHandle;
+        pylength = PyObject_GetAttr(el, str_length);
+        length = PyFloat_AsDouble(pylength);
+        Py_XDECREF(pylength);
+        if (PyErr_Occurred()) {
+            length = 0.0;
+            PyErr_Clear();
+        }
+        param->RingLength += length;
+    }
+    if (param->rest_energy == 0.0) {
+        param->T0 = param->RingLength/C0;
+    }
+    else {
+        double gamma0 = param->energy/param->rest_energy;
+        double betagamma0 = sqrt(gamma0*gamma0 - 1.0);
+        double beta0 = betagamma0/gamma0;
+        param->T0 = param->RingLength/beta0/C0;
+    }
+    return tangent_list;
+}
+
+/*
+ * One pass of tangent particles. The element data is kept in elemdata
+ * so that it is initialised only once for repeated passes.
+ * Returns 0, or -1 with an exception set.
+ */
+static int tangent_track(PyObject *lattice, track_function *tangent_list, struct elem **elemdata,
+                         npy_uint32 num_elements, double *dtan, npy_uint32 np,
+                         struct parameters *param, const npy_uint32 *refpts,
+                         unsigned int num_refpts, double *drout)
+{
+    npy_uint32 elem_index;
+    unsigned int nextrefindex = 0;
+    for (elem_index = 0; elem_index < num_elements; elem_index++) {
+        PyObject *el = PyList_GET_ITEM(lattice, elem_index);
+        struct elem *elem_data;
+        if ((nextrefindex < num_refpts) && (elem_index == refpts[nextrefindex])) {
+            memcpy(drout, dtan, np*TANGENT_SIZE*sizeof(double));
+            drout += np*TANGENT_SIZE;
+            nextrefindex++;
+        }
+        elem_data = tangent_list[elem_index](el, elemdata[elem_index], dtan, np, param);
+        if (!elem_data) {
+            if (!PyErr_Occurred()) {
+                PyObject *PyPassMethod = PyObject_GetAttr(el, str_passmethod);
+                PyErr_Format(PyExc_NotImplementedError,
+                    "PassMethod %s: no tangent map for this element", pyprint(PyPassMethod));
+                Py_XDECREF(PyPassMethod);
+            }
+            elemdata[elem_index] = NULL;
+            return -1;
+        }
+        elemdata[elem_index] = elem_data;
+        tangent_setlost(dtan, np);
+    }
+    if ((nextrefindex < num_refpts) && (num_elements == refpts[nextrefindex])) {
+        memcpy(drout, dtan, np*TANGENT_SIZE*sizeof(double));
+    }
+    return 0;
+}
+
+static void free_elemdata(struct elem **elemdata, npy_uint32 num_elements)
+{
+    npy_uint32 elem_index;
+    for (elem_index = 0; elem_index < num_elements; elem_index++)
+        free(elemdata[elem_index]);
+    free(elemdata);
+}
+
+static double tangent_zero[1] = {0.0};
+
+static void tangent_parameters(struct parameters *param, int counter)
+{
+    param->nturn = counter;
+    param->energy=0.0;
+    param->rest_energy=0.0;
+    param->charge=-1.0;
+    param->common_rng=default_context.rng_state;
+    param->thread_rng=default_context.rng_state+1;
+    param->nthread_rng=nthread_state;
+    param->beam_current=0.0;
+    param->nbunch=1;
+    param->bunch_spos = tangent_zero;
+    param->bunch_currents = tangent_zero;
+}
+
+static PyObject *at_tangentpass(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    static char *kwlist[] = {"line", "rin", "refpts", "turn",
+                             "energy", "particle", NULL};
+    PyObject *lattice;
+    PyObject *energy;
+    PyObject *particle;
+    PyArrayObject *rin;
+    PyArrayObject *refs;
+    PyObject *rout;
+    double *drin, *dtan;
+    track_function *tangent_list;
+    struct elem **elemdata;
+    npy_uint32 num_particles, num_elements, c, i;
+    npy_uint32 *refpts = NULL;
+    unsigned int num_refpts;
+    npy_intp outdims[4];
+    int counter = 0;
+    int status;
+    struct parameters param;
+
+    particle=NULL;
+    energy=NULL;
+    refs=NULL;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O!O!|O!$iO!O!", kwlist,
+        &PyList_Type, &lattice, &PyArray_Type, &rin, &PyArray_Type, &refs,
+        &counter, &PyFloat_Type ,&energy, particle_type, &particle)) {
+        return NULL;
+    }
+    if (PyArray_DIM(rin,0) != 6) {
+        return PyErr_Format(PyExc_ValueError, "rin is not 6D");
+    }
+    if (PyArray_TYPE(rin) != NPY_DOUBLE) {
+        return PyErr_Format(PyExc_ValueError, "rin is not a double array");
+    }
+    if ((PyArray_FLAGS(rin) & NPY_ARRAY_FARRAY_RO) != NPY_ARRAY_FARRAY_RO) {
+        return PyErr_Format(PyExc_ValueError, "rin is not Fortran-aligned");
+    }
+    if (refs) {
+        if (PyArray_TYPE(refs) != NPY_UINT32) {
+            return PyErr_Format(PyExc_ValueError, "refpts is not a uint32 array");
+        }
+        refpts = PyArray_DATA(refs);
+        num_refpts = PyArray_SIZE(refs);
+    }
+    else {
+        num_refpts = 0;
+    }
+
+    tangent_parameters(&param, counter);
+    set_energy_particle(lattice, energy, particle, &param);
+
+    num_elements = PyList_Size(lattice);
+    tangent_list = get_tangent_functions(lattice, num_elements, &param);
+    if (!tangent_list) return NULL;
+
+    num_particles = (PyArray_SIZE(rin)/6);
+    drin = PyArray_DATA(rin);
+    outdims[0] = 7;
+    outdims[1] = 6;
+    outdims[2] = num_particles;
+    outdims[3] = num_refpts;
+    rout = PyArray_EMPTY(4, outdims, NPY_DOUBLE, 1);
+
+    dtan = (double *)malloc(num_particles*TANGENT_SIZE*sizeof(double));
+    elemdata = (struct elem **)calloc(num_elements, sizeof(struct elem *));
+    tangent_init(dtan, drin, num_particles);
+    status = tangent_track(lattice, tangent_list, elemdata, num_elements, dtan, num_particles,
+                           &param, refpts, num_refpts, PyArray_DATA((PyArrayObject *)rout));
+    if (status == 0) {
+        /* Final coordinates */
+        for (c=0; c<num_particles; c++) {
+            for (i=0; i<6; i++) drin[c*6+i] = dtan[c*TANGENT_SIZE+7*i];
+        }
+    }
+    else {
+        Py_DECREF(rout);
+        rout = NULL;
+    }
+    free_elemdata(elemdata, num_elements);
+    free(dtan);
+    free(tangent_list);
+    return rout;
+}
+
+/* Solve a*x = b by Gaussian elimination with partial pivoting. a and b are
+   overwritten, x is returned in b. Returns -1 if a is singular */
+static int solve_linear(double *a, double *b, int n)
+{
+    int i, j, k;
+    for (k=0; k<n; k++) {
+        int p = k;
+        double amax = fabs(a[k*n+k]);
+        for (i=k+1; i<n; i++) {
+            if (fabs(a[i*n+k]) > amax) {
+                amax = fabs(a[i*n+k]);
+                p = i;
+            }
+        }
+        if (amax == 0.0) return -1;
+        if (p != k) {
+            double t;
+            for (j=0; j<n; j++) {
+                t = a[k*n+j]; a[k*n+j] = a[p*n+j]; a[p*n+j] = t;
+            }
+            t = b[k]; b[k] = b[p]; b[p] = t;
+        }
+        for (i=k+1; i<n; i++) {
+            double f = a[i*n+k]/a[k*n+k];
+            for (j=k; j<n; j++) a[i*n+j] -= f*a[k*n+j];
+            b[i] -= f*b[k];
+        }
+    }
+    for (k=n-1; k>=0; k--) {
+        for (j=k+1; j<n; j++) b[k] -= a[k*n+j]*b[j];
+        b[k] /= a[k*n+k];
+    }
+    return 0;
+}
+
+/*
+ * Newton search of the closed orbit, with the exact one-turn Jacobian from
+ * one tangent particle. The unknowns are the coordinates listed in cols,
+ * the equations are the coordinates listed in rows:
+ *     out[rows] - in[rows] = theta[rows]
+ * where in[rows] is 0 for coordinates which are not unknowns.
+ */
+static PyObject *at_closedorbit(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    static char *kwlist[] = {"line", "rin", "rows", "cols", "theta",
+                             "convergence", "max_iterations", "turn",
+                             "energy", "particle", NULL};
+    PyObject *lattice;
+    PyObject *energy;
+    PyObject *particle;
+    PyArrayObject *rin, *rows, *cols, *theta;
+    PyObject *orbit;
+    double *x, *dtheta;
+    double dtan[TANGENT_SIZE];
+    npy_uint32 *irows, *icols;
+    track_function *tangent_list;
+    struct elem **elemdata;
+    npy_uint32 num_elements;
+    npy_intp dims[1] = {6};
+    double convergence = 1.0e-12;
+    int max_iterations = 20;
+    int counter = 0;
+    int itercount = 0;
+    int n, i, j;
+    int status = 0;
+    struct parameters param;
+
+    particle=NULL;
+    energy=NULL;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O!O!O!O!O!|$diiO!O!", kwlist,
+        &PyList_Type, &lattice, &PyArray_Type, &rin, &PyArray_Type, &rows,
+        &PyArray_Type, &cols, &PyArray_Type, &theta,
+        &convergence, &max_iterations, &counter,
+        &PyFloat_Type ,&energy, particle_type, &particle)) {
+        return NULL;
+    }
+    if ((PyArray_SIZE(rin) != 6) || (PyArray_SIZE(theta) != 6)) {
+        return PyErr_Format(PyExc_ValueError, "rin and theta must have 6 elements");
+    }
+    if ((PyArray_TYPE(rin) != NPY_DOUBLE) || (PyArray_TYPE(theta) != NPY_DOUBLE)) {
+        return PyErr_Format(PyExc_ValueError, "rin and theta must be double arrays");
+    }
+    if ((PyArray_TYPE(rows) != NPY_UINT32) || (PyArray_TYPE(cols) != NPY_UINT32)) {
+        return PyErr_Format(PyExc_ValueError, "rows and cols must be uint32 arrays");
+    }
+    n = PyArray_SIZE(cols);
+    if ((PyArray_SIZE(rows) != n) || (n > 6)) {
+        return PyErr_Format(PyExc_ValueError, "rows and cols must have the same length, at most 6");
+    }
+    irows = PyArray_DATA(rows);
+    icols = PyArray_DATA(cols);
+    for (i=0; i<n; i++) {
+        if ((irows[i] > 5) || (icols[i] > 5))
+            return PyErr_Format(PyExc_ValueError, "rows and cols must be in [0, 5]");
+    }
+    dtheta = PyArray_DATA(theta);
+
+    tangent_parameters(&param, counter);
+    set_energy_particle(lattice, energy, particle, &param);
+
+    num_elements = PyList_Size(lattice);
+    tangent_list = get_tangent_functions(lattice, num_elements, &param);
+    if (!tangent_list) return NULL;
+
+    orbit = PyArray_EMPTY(1, dims, NPY_DOUBLE, 0);
+    x = PyArray_DATA((PyArrayObject *)orbit);
+    memcpy(x, PyArray_DATA(rin), 6*sizeof(double));
+    elemdata = (struct elem **)calloc(num_elements, sizeof(struct elem *));
+
+    while (itercount < max_iterations) {
+        double a[36], b[6];
+        double change = 0.0;
+        tangent_init(dtan, x, 1);
+        status = tangent_track(lattice, tangent_list, elemdata, num_elements, dtan, 1,
+                               &param, NULL, 0, NULL);
+        if (status != 0) break;
+        if (isnan(dtan[0])) {
+            status = -1;
+            PyErr_SetString(PyExc_ValueError, "the particle is lost during the closed orbit search");
+            break;
+        }
+        /* a = J - 1, b = out - in - theta restricted to the selection */
+        for (i=0; i<n; i++) {
+            npy_uint32 r = irows[i];
+            b[i] = dtan[7*r] - dtheta[r];
+            for (j=0; j<n; j++) {
+                npy_uint32 col = icols[j];
+                a[i*n+j] = dtan[7*r+1+col];
+                if (col == r) {
+                    a[i*n+j] -= 1.0;
+                    b[i] -= x[r];
+                }
+            }
+        }
+        if (solve_linear(a, b, n) != 0) {
+            status = -1;
+            PyErr_SetString(PyExc_ValueError, "singular Jacobian in the closed orbit search");
+            break;
+        }
+        for (j=0; j<n; j++) {
+            x[icols[j]] -= b[j];
+            change += b[j]*b[j];
+        }
+        itercount++;
+        if (sqrt(change) <= convergence) break;
+    }
+    free_elemdata(elemdata, num_elements);
+    free(tangent_list);
+    if (status != 0) {
+        Py_DECREF(orbit);
+        return NULL;
+    }
+    return Py_BuildValue("Ni", orbit, itercount);
+}
+
+/*
+ * Batched tracking of lattice variants, for instance error seeds or the
+ * rotations of a ring. All the lines have the same number of elements. An
+ * element object also present in the first line, at any position, is
+ * initialised once and its element data is shared, so that only the
+ * modified elements of each variant are parsed. The variants are then
+ * tracked in parallel, without the GIL.
+ */
+static PyObject *at_variantpass(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    static char *kwlist[] = {"lines", "rin", "nturns", "refpts", "turn",
+                             "energy", "particle", "omp_num_threads", NULL};
+    PyObject *lines;
+    PyObject *line0;
+    PyObject *index0 = NULL;
+    PyObject *energy;
+    PyObject *particle;
+    PyArrayObject *rin;
+    PyArrayObject *refs;
+    PyObject *rout;
+    double *drin, *drout;
+    npy_uint32 *refpts = NULL;
+    unsigned int num_refpts;
+    npy_uint32 num_variants, num_elements, num_particles, np6;
+    npy_uint32 omp_num_threads = 0;
+    npy_intp outdims[5];
+    int num_turns;
+    int counter = 0;
+    int failed = -1;
+    long variant;
+    npy_uint32 v, elem_index;
+    track_function *integrator_list;
+    struct elem **elemdata_list;
+    double *elemlength_list;
+    bool *shared_list;
+    struct parameters *param_list;
+    struct parameters param;
+    pcg32_random_t *rng_list;
+    int nthread_rng = nthread_state;
+    PyThreadState *tstate;
+
+    particle=NULL;
+    energy=NULL;
+    refs=NULL;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O!O!i|O!$iO!O!I", kwlist,
+        &PyList_Type, &lines, &PyArray_Type, &rin, &num_turns,
+        &PyArray_Type, &refs, &counter,
+        &PyFloat_Type ,&energy, particle_type, &particle, &omp_num_threads)) {
         return NULL;
     }
-    if (PyArray_DIM(rin,0) != 6) {
-        return PyErr_Format(PyExc_ValueError, "rin is not 6D");
+    num_variants = PyList_Size(lines);
+    if (num_variants == 0) {
+        return PyErr_Format(PyExc_ValueError, "no lattice variant");
+    }
+    if ((PyArray_NDIM(rin) != 3) || (PyArray_DIM(rin,0) != 6) ||
+        ((npy_uint32)PyArray_DIM(rin,2) != num_variants)) {
+        return PyErr_Format(PyExc_ValueError, "rin is not a 6 x n_particles x n_variants array");
     }
     if (PyArray_TYPE(rin) != NPY_DOUBLE) {
         return PyErr_Format(PyExc_ValueError, "rin is not a double array");
@@ -399,25 +2439,6 @@ static PyObject *at_atpass(PyObject *self, PyObject *args, PyObject *kwargs) {
     if ((PyArray_FLAGS(rin) & NPY_ARRAY_FARRAY_RO) != NPY_ARRAY_FARRAY_RO) {
         return PyErr_Format(PyExc_ValueError, "rin is not Fortran-aligned");
     }
-
-    param.common_rng=&common_state;
-    param.thread_rng=&thread_state;
-    param.energy=0.0;
-    param.rest_energy=0.0;
-    param.charge=-1.0;       
-    
-    if (keep_counter)
-        param.nturn = last_turn;
-    else
-        param.nturn = counter;
-
-    set_energy_particle(lattice, energy, particle, &param);   
-    set_current_fillpattern(bspos, bcurrents, &param);
-
-    num_particles = (PyArray_SIZE(rin)/6);
-    np6 = num_particles*6;
-    drin = PyArray_DATA(rin);
-
     if (refs) {
         if (PyArray_TYPE(refs) != NPY_UINT32) {
             return PyErr_Format(PyExc_ValueError, "refpts is not a uint32 array");
@@ -426,268 +2447,286 @@ static PyObject *at_atpass(PyObject *self, PyObject *args, PyObject *kwargs) {
         num_refpts = PyArray_SIZE(refs);
     }
     else {
-        refpts = NULL;
         num_refpts = 0;
     }
-    outdims[0] = 6;
-    outdims[1] = num_particles;
-    outdims[2] = num_refpts;
-    outdims[3] = num_turns;
-    rout = PyArray_EMPTY(4, outdims, NPY_DOUBLE, 1);
-    drout = PyArray_DATA((PyArrayObject *)rout);
-
-    if(losses){
-        pdims[0]= num_particles;
-        lxdims[0]= 6;
-        lxdims[1]= num_particles;
-        xnturn = PyArray_EMPTY(1, pdims, NPY_UINT32, 1);
-        xnelem = PyArray_EMPTY(1, pdims, NPY_UINT32, 1);
-        xlost = PyArray_EMPTY(1, pdims, NPY_BOOL, 1);
-        xlostcoord = PyArray_EMPTY(2, lxdims, NPY_DOUBLE, 1);
-        ixnturn = PyArray_DATA((PyArrayObject *)xnturn);
-        ixnelem = PyArray_DATA((PyArrayObject *)xnelem);
-        bxlost = PyArray_DATA((PyArrayObject *)xlost);
-        dxlostcoord = PyArray_DATA((PyArrayObject *)xlostcoord);
-        unsigned int i;
-        static double r0[6];
-        for(i=0;i<num_particles;i++){
-            bxlost[i]=0;
-            ixnturn[i]=0;
-            ixnelem[i]=0;
-            memcpy(dxlostcoord+6*i,r0,6*sizeof(double));
+    line0 = PyList_GET_ITEM(lines, 0);
+    if (!PyList_Check(line0)) {
+        return PyErr_Format(PyExc_TypeError, "a lattice variant is not a list");
+    }
+    num_elements = PyList_GET_SIZE(line0);
+    for (v = 1; v < num_variants; v++) {
+        PyObject *line = PyList_GET_ITEM(lines, v);
+        if (!PyList_Check(line)) {
+            return PyErr_Format(PyExc_TypeError, "a lattice variant is not a list");
+        }
+        if ((npy_uint32)PyList_GET_SIZE(line) != num_elements) {
+            return PyErr_Format(PyExc_ValueError, "the lattice variants have different lengths");
         }
     }
 
+    tangent_parameters(&param, counter);
+    set_energy_particle(line0, energy, particle, &param);
+
+    num_particles = PyArray_DIM(rin,1);
+    np6 = num_particles*6;
+    drin = PyArray_DATA(rin);
+    outdims[0] = 6;
+    outdims[1] = num_particles;
+    outdims[2] = num_variants;
+    outdims[3] = num_refpts;
+    outdims[4] = num_turns;
+    rout = PyArray_EMPTY(5, outdims, NPY_DOUBLE, 1);
+    if (!rout) return NULL;
+    drout = PyArray_DATA((PyArrayObject *)rout);
 
+    integrator_list = (track_function *)malloc(num_variants*num_elements*sizeof(track_function));
+    elemdata_list = (struct elem **)calloc(num_variants*num_elements, sizeof(struct elem *));
+    elemlength_list = (double *)malloc(num_variants*num_elements*sizeof(double));
+    shared_list = (bool *)calloc(num_variants*num_elements, sizeof(bool));
+    param_list = (struct parameters *)malloc(num_variants*sizeof(struct parameters));
+    rng_list = (pcg32_random_t *)malloc(num_variants*(1+nthread_state)*sizeof(pcg32_random_t));
+
+    /* Each variant has its own generators, seeded in turn from the common
+       generator. When the variants run in parallel, the integrators are
+       serial and a variant always draws from its first thread generator,
+       so that the results do not depend on the thread scheduling */
     #ifdef _OPENMP
-    if ((omp_num_threads > 0) && (num_particles > OMP_PARTICLE_THRESHOLD)) {
-        unsigned int nthreads = omp_get_num_procs();
-        maxthreads = omp_get_max_threads();
-        if (omp_num_threads < nthreads) nthreads = omp_num_threads;
-        if (num_particles < nthreads) nthreads = num_particles;
-        omp_set_num_threads(nthreads);
-    }
+    if ((num_variants > 1) &&
+        (((omp_num_threads > 0) ? (int)omp_num_threads : omp_get_max_threads()) > 1))
+        nthread_rng = 1;
     #endif /*_OPENMP*/
 
-    if (!(keep_lattice && valid)) {
-        PyObject **element;
-        double *elem_length;
-        track_function *integrator;
-        PyObject **pyintegrator;
-        /* Release the stored elements */
-        for (elem_index=0; elem_index < num_elements; elem_index++) {
-            free(elemdata_list[elem_index]);
-            Py_XDECREF(element_list[elem_index]);   /* Release the stored elements, may be NULL if */
-        }                                           /* a previous call was interrupted by an error */
-        num_elements = PyList_Size(lattice);
-
-        /* Pointer to Element structures used by the tracking function */
-        free(elemdata_list);
-        elemdata_list = (struct elem **)calloc(num_elements, sizeof(struct elem *));
-
-        /* Pointer to Element lengths */
-        free(elemlength_list);
-        elemlength_list = (double *)calloc(num_elements, sizeof(double));
-
-        /* Pointer to Element list, make sure all pointers are initially NULL */
-        free(element_list);
-        element_list = (PyObject **)calloc(num_elements, sizeof(PyObject *));
-
-        /* pointer to the list of C integrators */
-        integrator_list = (track_function *)realloc(integrator_list, num_elements*sizeof(track_function));
-
-        /* pointer to the list of python integrators, make sure all pointers are initially NULL */
-        free(pyintegrator_list);
-        pyintegrator_list = (PyObject **)calloc(num_elements, sizeof(PyObject *));
+    /* Positions of the elements of the first line, by object identity */
+    if (num_variants > 1) {
+        index0 = PyDict_New();
+        for (elem_index = 0; (failed < 0) && (elem_index < num_elements); elem_index++) {
+            PyObject *key = PyLong_FromVoidPtr(PyList_GET_ITEM(line0, elem_index));
+            PyObject *pos = PyLong_FromUnsignedLong(elem_index);
+            if (!index0 || !key || !pos || (PyDict_SetItem(index0, key, pos) != 0))
+                failed = elem_index;
+            Py_XDECREF(key);
+            Py_XDECREF(pos);
+        }
+    }
 
-        /* pointer to the list of python integrators kwargs, make sure all pointers are initially NULL */
-        free(kwargs_list);
-        kwargs_list = (PyObject **)calloc(num_elements, sizeof(PyObject *));
-
-        lattice_length = 0.0;
-        element = element_list;
-        elem_length = elemlength_list;
-        integrator = integrator_list;
-        pyintegrator = pyintegrator_list;
+    /* Element setup, with the GIL */
+    for (v = 0; (failed < 0) && (v < num_variants); v++) {
+        PyObject *line = PyList_GET_ITEM(lines, v);
+        npy_uint32 offset = v*num_elements;
+        struct parameters *vparam = param_list+v;
+        pcg32_random_t *vrng = rng_list + v*(1+nthread_state);
+        *vparam = param;
+        seed_rngs(vrng, nthread_state, draw_seed(), rng_rank);
+        vparam->common_rng = vrng;
+        vparam->thread_rng = vrng+1;
+        vparam->nthread_rng = nthread_rng;
+        vparam->RingLength = 0.0;
         for (elem_index = 0; elem_index < num_elements; elem_index++) {
+            PyObject *el = PyList_GET_ITEM(line, elem_index);
+            struct LibraryListElement *LibraryListPtr;
+            PyObject *PyPassMethod;
             PyObject *pylength;
-            PyObject *el = PyList_GET_ITEM(lattice, elem_index);
-            PyObject *PyPassMethod = PyObject_GetAttrString(el, "PassMethod");
             double length;
-            if (!PyPassMethod) return print_error(elem_index, rout);    /* No PassMethod: AttributeError */
+            if (v > 0) {
+                npy_uint32 k0 = elem_index;
+                bool found = (el == PyList_GET_ITEM(line0, elem_index));
+                if (!found) {
+                    PyObject *key = PyLong_FromVoidPtr(el);
+                    PyObject *pos = key ? PyDict_GetItem(index0, key) : NULL;
+                    Py_XDECREF(key);
+                    if (pos) {
+                        k0 = PyLong_AsUnsignedLong(pos);
+                        found = true;
+                    }
+                }
+                if (found) {
+                    integrator_list[offset+elem_index] = integrator_list[k0];
+                    elemlength_list[offset+elem_index] = elemlength_list[k0];
+                    elemdata_list[offset+elem_index] = elemdata_list[k0];
+                    shared_list[offset+elem_index] = true;
+                    vparam->RingLength += elemlength_list[k0];
+                    continue;
+                }
+            }
+            PyPassMethod = PyObject_GetAttr(el, str_passmethod);
+            if (!PyPassMethod) {                /* No PassMethod: AttributeError */
+                failed = elem_index;
+                break;
+            }
             LibraryListPtr = get_track_function(PyUnicode_AsUTF8(PyPassMethod));
+            if (LibraryListPtr && (LibraryListPtr->Collective || LibraryListPtr->PyFunctionHandle)) {
+                PyErr_Format(PyExc_ValueError,
+                    "PassMethod %s: collective and python integrators are not supported",
+                    PyUnicode_AsUTF8(PyPassMethod));
+                LibraryListPtr = NULL;
+            }
             Py_DECREF(PyPassMethod);
-            if (!LibraryListPtr) return print_error(elem_index, rout);  /* No trackFunction for the given PassMethod: RuntimeError */
-            pylength = PyObject_GetAttrString(el, "Length");
+            if (!LibraryListPtr) {              /* No trackFunction or not supported */
+                failed = elem_index;
+                break;
+            }
+            pylength = PyObject_GetAttr(el, str_length);
             length = PyFloat_AsDouble(pylength);
             Py_XDECREF(pylength);
             if (PyErr_Occurred()) {
                 length = 0.0;
                 PyErr_Clear();
             }
-            lattice_length += length;
-            *integrator++ = LibraryListPtr->FunctionHandle;
-            *pyintegrator++ = LibraryListPtr->PyFunctionHandle;
-            *element++ = el;
-            *elem_length++ = length;
-            Py_INCREF(el);                          /* Keep a reference to each element in case of reuse */
+            integrator_list[offset+elem_index] = LibraryListPtr->FunctionHandle;
+            elemlength_list[offset+elem_index] = length;
+            vparam->RingLength += length;
         }
-        valid = 0;
-    }
-
-    param.RingLength = lattice_length;
-    if (param.rest_energy == 0.0) {
-        param.T0 = param.RingLength/C0;
-    }
-    else {
-        double gamma0 = param.energy/param.rest_energy;
-        double betagamma0 = sqrt(gamma0*gamma0 - 1.0);
-        double beta0 = betagamma0/gamma0;
-        param.T0 = param.RingLength/beta0/C0;
-    }
-
-    for (turn = 0; turn < num_turns; turn++) {
-        PyObject **element = element_list;
-        double *elem_length = elemlength_list;
-        track_function *integrator = integrator_list;
-        PyObject **pyintegrator = pyintegrator_list;
-        PyObject **kwargs = kwargs_list;
-        struct elem **elemdata = elemdata_list;
-        double s_coord = 0.0;
-
-      /*PySys_WriteStdout("turn: %i\n", param.nturn);*/
-        nextrefindex = 0;
-        nextref= (nextrefindex<num_refpts) ? refpts[nextrefindex++] : INT_MAX;
+        if (failed >= 0) break;
+        if (param.rest_energy == 0.0) {
+            vparam->T0 = vparam->RingLength/C0;
+        }
+        else {
+            double gamma0 = param.energy/param.rest_energy;
+            double betagamma0 = sqrt(gamma0*gamma0 - 1.0);
+            double beta0 = betagamma0/gamma0;
+            vparam->T0 = vparam->RingLength/beta0/C0;
+        }
+        /* Element data depending on the revolution period cannot be shared.
+           The lengths are summed in a different order in rotated lines */
+        if ((v > 0) && (fabs(vparam->RingLength - param_list[0].RingLength) >
+                        1.0e-12*param_list[0].RingLength)) {
+            for (elem_index = 0; elem_index < num_elements; elem_index++)
+                shared_list[offset+elem_index] = false;
+        }
+        /* Initialise the element data by tracking no particle */
         for (elem_index = 0; elem_index < num_elements; elem_index++) {
-            param.s_coord = s_coord;
-            if (elem_index == nextref) {
-                memcpy(drout, drin, np6*sizeof(double));
-                drout += np6; /*  shift the location to write to in the output array */
-                nextref = (nextrefindex<num_refpts) ? refpts[nextrefindex++] : INT_MAX;
+            npy_uint32 k = offset+elem_index;
+            if (!shared_list[k]) {
+                elemdata_list[k] = integrator_list[k](PyList_GET_ITEM(line, elem_index),
+                                                      NULL, drin, 0, vparam);
+                if (!elemdata_list[k]) {
+                    failed = elem_index;
+                    break;
+                }
             }
-            /* the actual integrator call */
-            if (*pyintegrator) {
-                PyObject *res = PyObject_CallFunctionObjArgs(*pyintegrator, rin, *element, NULL);
-                if (!res) return print_error(elem_index, rout);       /* trackFunction failed */
-                Py_DECREF(res);
-            } else {
-                *elemdata = (*integrator)(*element, *elemdata, drin, num_particles, &param);
-                if (!*elemdata) return print_error(elem_index, rout);       /* trackFunction failed */
+        }
+    }
+
+    /* Tracking of the variants, without the GIL */
+    if (failed < 0) {
+        tstate = PyEval_SaveThread();
+        #ifdef _OPENMP
+        #pragma omp parallel for schedule(dynamic) if (num_variants > 1) \
+            num_threads((omp_num_threads > 0) ? omp_num_threads : omp_get_max_threads())
+        #endif /*_OPENMP*/
+        for (variant = 0; variant < (long)num_variants; variant++) {
+            npy_uint32 offset = variant*num_elements;
+            PyObject *line = PyList_GET_ITEM(lines, variant);
+            struct parameters *vparam = param_list+variant;
+            double *r = drin + np6*variant;
+            npy_uint32 nlost = count_lost(r, num_particles);
+            int fail = -1;
+            int turn;
+            for (turn = 0; (fail < 0) && (turn < num_turns); turn++) {
+                double s_coord = 0.0;
+                unsigned int nextrefindex = 0;
+                npy_uint32 k;
+                for (k = 0; k < num_elements; k++) {
+                    vparam->s_coord = s_coord;
+                    if ((nextrefindex < num_refpts) && (k == refpts[nextrefindex])) {
+                        memcpy(drout + np6*(variant + num_variants*(nextrefindex + num_refpts*turn)),
+                               r, np6*sizeof(double));
+                        nextrefindex++;
+                    }
+                    if (!integrator_list[offset+k](PyList_GET_ITEM(line, k),
+                            elemdata_list[offset+k], r, num_particles, vparam)) {
+                        fail = k;
+                        break;
+                    }
+                    if (count_lost(r, num_particles) != nlost)
+                        nlost = setlost(r, num_particles);
+                    s_coord += elemlength_list[offset+k];
+                }
+                /* the last element in the ring */
+                if ((nextrefindex < num_refpts) && (num_elements == refpts[nextrefindex])) {
+                    memcpy(drout + np6*(variant + num_variants*(nextrefindex + num_refpts*turn)),
+                           r, np6*sizeof(double));
+                }
+                vparam->nturn++;
             }
-            if (losses) {
-                checkiflost(drin, num_particles, elem_index, param.nturn, ixnturn, ixnelem, bxlost, dxlostcoord);
-            } else {
-                setlost(drin, num_particles);
+            if (fail >= 0) {
+                #ifdef _OPENMP
+                #pragma omp atomic write
+                #endif /*_OPENMP*/
+                failed = fail;
             }
-            s_coord += *elem_length++;
-            element++;
-            integrator++;
-            pyintegrator++;
-            elemdata++;
-            kwargs++;
-        }
-        /* the last element in the ring */
-        if (num_elements == nextref) {
-            memcpy(drout, drin, np6*sizeof(double));
-            drout += np6; /*  shift the location to write to in the output array */
         }
-        param.nturn++;
+        PyEval_RestoreThread(tstate);
+        if ((failed >= 0) && !PyErr_Occurred())
+            PyErr_Format(PyExc_RuntimeError, "trackFunction failed at element %d", failed);
     }
-    valid = 1;      /* Tracking successful: the lattice can be reused */
-    last_turn = param.nturn;  /* Store turn number in a static variable */
 
-    #ifdef _OPENMP
-    if ((omp_num_threads > 0) && (num_particles > OMP_PARTICLE_THRESHOLD)) {
-        omp_set_num_threads(maxthreads);
+    for (elem_index = 0; elem_index < num_variants*num_elements; elem_index++) {
+        if (!shared_list[elem_index]) free(elemdata_list[elem_index]);
     }
-    #endif /*_OPENMP*/
-
-    if (losses) {
-        PyObject *tout = PyTuple_New(2);
-        PyObject *dict = PyDict_New();
-        PyDict_SetItemString(dict,(char *)"islost",(PyObject *)xlost);
-        PyDict_SetItemString(dict,(char *)"turn",(PyObject *)xnturn); 
-        PyDict_SetItemString(dict,(char *)"elem",(PyObject *)xnelem);
-        PyDict_SetItemString(dict,(char *)"coord",(PyObject *)xlostcoord);
-        PyTuple_SetItem(tout, 0, rout);  
-        PyTuple_SetItem(tout, 1, dict);
-        Py_DECREF(xlost);
-        Py_DECREF(xnturn);
-        Py_DECREF(xnelem);
-        Py_DECREF(xlostcoord);
-        return tout;          
-    } else {
-        return rout;
+    Py_XDECREF(index0);
+    free(rng_list);
+    free(param_list);
+    free(shared_list);
+    free(elemlength_list);
+    free(elemdata_list);
+    free(integrator_list);
+    if (failed >= 0) {
+        Py_DECREF(rout);
+        return NULL;
     }
+    return rout;
 }
 
-static PyObject *at_elempass(PyObject *self, PyObject *args, PyObject *kwargs)
+static PyObject *new_context(PyObject *self, PyObject *args, PyObject *kwargs)
 {
-    static char *kwlist[] = {"element", "rin",
-                             "energy", "particle", NULL};
-    PyObject *element;
-    PyObject *energy;
-    PyObject *particle;
-    PyArrayObject *rin;
-    PyObject *PyPassMethod;
-    npy_uint32 num_particles;
-    track_function integrator;
-    PyObject *pyintegrator;
-    double *drin;
-    struct parameters param;
-    struct LibraryListElement *LibraryListPtr;
+    static char *kwlist[] = {"seed", NULL};
+    PyObject *pyseed = Py_None;
+    uint64_t seed;
+    struct atpass_context *ctx;
+    PyObject *capsule;
 
-    param.nturn = 0;
-    param.energy=0.0;
-    param.rest_energy=0.0;
-    param.charge=-1.0;
-    particle=NULL;
-    energy=NULL;
-    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O!O!|$O!O!", kwlist,
-        element_type, &element,  &PyArray_Type, &rin,
-        &PyFloat_Type ,&energy, particle_type, &particle)) {
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|$O", kwlist, &pyseed)) {
         return NULL;
     }
-    if (PyArray_DIM(rin,0) != 6) {
-        return PyErr_Format(PyExc_ValueError, "rin is not 6D");
+    if (pyseed == Py_None) {
+        seed = draw_seed();
     }
-    if (PyArray_TYPE(rin) != NPY_DOUBLE) {
-        return PyErr_Format(PyExc_ValueError, "rin is not a double array");
+    else {
+        seed = PyLong_AsUnsignedLongLong(pyseed);
+        if (PyErr_Occurred()) return NULL;
     }
-    if ((PyArray_FLAGS(rin) & NPY_ARRAY_FARRAY_RO) != NPY_ARRAY_FARRAY_RO) {
-        return PyErr_Format(PyExc_ValueError, "rin is not Fortran-aligned");
+    ctx = (struct atpass_context *)calloc(1, sizeof(struct atpass_context));
+    if (!ctx) return PyErr_NoMemory();
+    ctx->rng_state = (pcg32_random_t *)malloc((1+nthread_state)*sizeof(pcg32_random_t));
+    if (!ctx->rng_state) {
+        free(ctx);
+        return PyErr_NoMemory();
     }
+    seed_rngs(ctx->rng_state, nthread_state, seed, rng_rank);
+    capsule = PyCapsule_New(ctx, CONTEXT_CAPSULE_NAME, context_destructor);
+    if (!capsule) {
+        free(ctx->rng_state);
+        free(ctx);
+    }
+    return capsule;
+}
 
-    set_energy_particle(NULL, energy, particle, &param);
-
-    num_particles = (PyArray_SIZE(rin)/6);
-    drin = PyArray_DATA(rin);
-
-    param.RingLength = 0.0;
-    param.T0 = 0.0;
-    param.beam_current=0.0;
-    param.nbunch=1;
-    param.bunch_spos = (double[1]){0.0};
-    param.bunch_currents = (double[1]){0.0};
+static PyObject *free_context(PyObject *self, PyObject *args)
+{
+    PyObject *capsule;
+    struct atpass_context *ctx;
 
-    PyPassMethod = PyObject_GetAttrString(element, "PassMethod");
-    if (!PyPassMethod) return NULL;
-    LibraryListPtr = get_track_function(PyUnicode_AsUTF8(PyPassMethod));
-    Py_DECREF(PyPassMethod);
-    if (!LibraryListPtr) return NULL;
-    integrator = LibraryListPtr->FunctionHandle;
-    pyintegrator = LibraryListPtr->PyFunctionHandle;
-    if (pyintegrator) {
-        PyObject *res = PyObject_CallFunctionObjArgs(pyintegrator, rin, element, NULL);
-        if (!res) return NULL;
-        Py_DECREF(res);
-    } else {
-        struct elem *elem_data = integrator(element, NULL, drin, num_particles, &param);
-        if (!elem_data) return NULL;
-        free(elem_data);
+    if (!PyArg_ParseTuple(args, "O!", &PyCapsule_Type, &capsule)) {
+        return NULL;
     }
-    Py_INCREF(rin);
-    return (PyObject *) rin;
+    ctx = PyCapsule_GetPointer(capsule, CONTEXT_CAPSULE_NAME);
+    if (!ctx) return NULL;
+    if (ctx->busy) {
+        return PyErr_Format(PyExc_RuntimeError, "the tracking context is already in use");
+    }
+    clear_context(ctx);
+    Py_RETURN_NONE;
 }
 
 static PyObject *reset_rng(PyObject *self, PyObject *args, PyObject *kwargs)
@@ -695,28 +2734,94 @@ static PyObject *reset_rng(PyObject *self, PyObject *args, PyObject *kwargs)
     static char *kwlist[] = {"rank", "seed", NULL};
     uint64_t rank = 0;
     uint64_t seed = AT_RNG_STATE;
+    bool locked;
 
     if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|K$K", kwlist,
         &rank, &seed)) {
         return NULL;
     }
-    pcg32_srandom_r(&common_state, seed, AT_RNG_INC);
-    pcg32_srandom_r(&thread_state, seed, rank);
+    locked = lock_default_rngs();
+    rng_rank = rank;
+    seed_rngs(default_context.rng_state, nthread_state, seed, rank);
+    unlock_default_rngs(locked);
     Py_RETURN_NONE;
 }
 
 static PyObject *common_rng(PyObject *self)
 {
-    double drand = atrandd_r(&common_state);
+    bool locked = lock_default_rngs();
+    double drand = atrandd_r(default_context.rng_state);
+    unlock_default_rngs(locked);
     return Py_BuildValue("d", drand);
 }
 
 static PyObject *thread_rng(PyObject *self)
 {
-    double drand = atrandd_r(&thread_state);
+    bool locked = lock_default_rngs();
+    double drand = atrandd_r(default_context.rng_state+1);
+    unlock_default_rngs(locked);
     return Py_BuildValue("d", drand);
 }
 
+/* Generators of the given context, or the module generators */
+static struct atpass_context *rng_context(PyObject *capsule)
+{
+    if (capsule == Py_None) return &default_context;
+    return PyCapsule_GetPointer(capsule, CONTEXT_CAPSULE_NAME);
+}
+
+/* The state of the generators is the raw content of the common generator
+   followed by the thread generators: it may be restored only by the same
+   build, with the same number of thread generators */
+static PyObject *get_rng_state(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    static char *kwlist[] = {"context", NULL};
+    size_t sz = sizeof(pcg32_random_t);
+    PyObject *capsule = Py_None;
+    struct atpass_context *ctx;
+    PyObject *state;
+    bool locked;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|$O", kwlist, &capsule)) {
+        return NULL;
+    }
+    ctx = rng_context(capsule);
+    if (!ctx) return NULL;
+    state = PyBytes_FromStringAndSize(NULL, (1+nthread_state)*sz);
+    if (state) {
+        locked = (ctx == &default_context) && lock_default_rngs();
+        memcpy(PyBytes_AS_STRING(state), ctx->rng_state, (1+nthread_state)*sz);
+        unlock_default_rngs(locked);
+    }
+    return state;
+}
+
+static PyObject *set_rng_state(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    static char *kwlist[] = {"state", "context", NULL};
+    size_t sz = sizeof(pcg32_random_t);
+    PyObject *capsule = Py_None;
+    struct atpass_context *ctx;
+    const char *buf;
+    Py_ssize_t len;
+    bool locked;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "y#|$O", kwlist, &buf, &len, &capsule)) {
+        return NULL;
+    }
+    ctx = rng_context(capsule);
+    if (!ctx) return NULL;
+    if ((size_t)len != (1+nthread_state)*sz)
+        return PyErr_Format(PyExc_ValueError,
+            "the random state does not match the %d thread generators", nthread_state);
+    if (context_in_use(ctx))
+        return PyErr_Format(PyExc_RuntimeError, "the tracking context is already in use");
+    locked = (ctx == &default_context) && lock_default_rngs();
+    memcpy(ctx->rng_state, buf, (1+nthread_state)*sz);
+    unlock_default_rngs(locked);
+    Py_RETURN_NONE;
+}
+
 /* Method table */
 
 static PyMethodDef AtMethods[] = {
@@ -736,8 +2841,18 @@ static PyMethodDef AtMethods[] = {
               "    energy:  nominal energy [eV]\n"
               "    particle (Optional[Particle]):  circulating particle\n"
               "    reuse:   if True, use previously cached description of the lattice.\n"
+              "    update:  with reuse, initialise again the elements modified or\n"
+              "       replaced since the previous call\n"
               "    omp_num_threads: number of OpenMP threads (default 0: automatic)\n"
-              "    losses:  if True, process losses\n\n"
+              "    losses:  if True, process losses\n"
+              "    soa:     if True, track in the structure-of-arrays layout when all\n"
+              "       the elements support it\n"
+              "    omp_persistent: if True, track all the turns in a single OpenMP\n"
+              "       parallel region, each thread tracking a fixed chunk of particles\n"
+              "    profile: if True, record the time, number of calls, tracked particles\n"
+              "       and new losses of each element\n"
+              "    context: tracking context created by new_context(). Default: the\n"
+              "       module context. reuse refers to the lattice cached in the context\n\n"
               "Returns:\n"
               "    rout:    6 x n_particles x n_refpts x n_turns Fortran-ordered numpy array\n"
               "         of particle coordinates\n\n"
@@ -754,9 +2869,100 @@ static PyMethodDef AtMethods[] = {
               "    particle (Optional[Particle]):  circulating particle\n\n"
               ":meta private:"
             )},
+    {"tangentpass",  (PyCFunction)at_tangentpass, METH_VARARGS | METH_KEYWORDS,
+    PyDoc_STR("tangentpass(line: Sequence[Element], r_in, refpts: Uint32_refs = [], turn: int = 0)\n\n"
+              "Track input particles r_in along line, with their derivatives with\n"
+              "respect to the initial coordinates.\n\n"
+              "Parameters:\n"
+              "    line:    list of elements\n"
+              "    rin:     6 x n_particles Fortran-ordered numpy array.\n"
+              "      On return, rin contains the final coordinates of the particles\n"
+              "    refpts:  numpy array of indices of elements where output is desired\n"
+              "       0 means entrance of the first element\n"
+              "       len(line) means end of the last element\n"
+              "    turn:    turn number used by time-dependent elements\n"
+              "    energy:  nominal energy [eV]\n"
+              "    particle (Optional[Particle]):  circulating particle\n\n"
+              "Returns:\n"
+              "    rout:    7 x 6 x n_particles x n_refpts Fortran-ordered numpy array.\n"
+              "       rout[0] is the particle coordinates, rout[1+j, i] is the derivative\n"
+              "       of coordinate i with respect to the initial coordinate j\n\n"
+              "Raises:\n"
+              "    NotImplementedError: if an element has no tangent map\n\n"
+              ":meta private:"
+            )},
+    {"closedorbit",  (PyCFunction)at_closedorbit, METH_VARARGS | METH_KEYWORDS,
+    PyDoc_STR("closedorbit(line: Sequence[Element], rin, rows, cols, theta, "
+              "convergence: float = 1.e-12, max_iterations: int = 20)\n\n"
+              "Newton search of a closed orbit, using the exact one-turn Jacobian\n"
+              "given by tangent tracking.\n\n"
+              "Parameters:\n"
+              "    line:    list of elements\n"
+              "    rin:     (6,) initial guess\n"
+              "    rows:    uint32 array of the coordinates giving the equations\n"
+              "    cols:    uint32 array of the unknown coordinates\n"
+              "    theta:   (6,) change of the coordinates after one turn. The\n"
+              "       equations are out[rows] - in[rows] = theta[rows], where\n"
+              "       in[rows] is taken as 0 for coordinates which are not unknowns\n"
+              "    convergence: convergence criterion on the norm of the step\n"
+              "    max_iterations: maximum number of iterations\n"
+              "    turn:    turn number used by time-dependent elements\n"
+              "    energy:  nominal energy [eV]\n"
+              "    particle (Optional[Particle]):  circulating particle\n\n"
+              "Returns:\n"
+              "    orbit:   (6,) closed orbit\n"
+              "    niter:   number of iterations\n\n"
+              "Raises:\n"
+              "    NotImplementedError: if an element has no tangent map\n\n"
+              ":meta private:"
+            )},
+    {"variantpass",  (PyCFunction)at_variantpass, METH_VARARGS | METH_KEYWORDS,
+    PyDoc_STR("variantpass(lines: Sequence[Sequence[Element]], r_in, n_turns: int, "
+              "refpts: Uint32_refs = [], omp_num_threads: int = 0)\n\n"
+              "Track particles through several variants of a lattice. Element objects\n"
+              "shared with the first line are initialised only once, and the variants\n"
+              "are tracked in parallel.\n\n"
+              "Parameters:\n"
+              "    lines:   list of n_variants lines with the same number of elements\n"
+              "    rin:     6 x n_particles x n_variants Fortran-ordered numpy array.\n"
+              "      On return, rin contains the final coordinates of the particles\n"
+              "    n_turns: number of turns to be tracked\n"
+              "    refpts:  numpy array of indices of elements where output is desired\n"
+              "       0 means entrance of the first element\n"
+              "       len(line) means end of the last element\n"
+              "    turn:    initial turn number\n"
+              "    energy:  nominal energy [eV]\n"
+              "    particle (Optional[Particle]):  circulating particle\n"
+              "    omp_num_threads: number of OpenMP threads (default 0: automatic)\n\n"
+              "Returns:\n"
+              "    rout:    6 x n_particles x n_variants x n_refpts x n_turns\n"
+              "       Fortran-ordered numpy array of particle coordinates\n\n"
+              "Raises:\n"
+              "    ValueError: if a line contains collective or python integrators\n\n"
+              ":meta private:"
+            )},
+    {"new_context",  (PyCFunction)new_context, METH_VARARGS | METH_KEYWORDS,
+    PyDoc_STR("new_context(*, seed=None)\n\n"
+              "Create an independent tracking context.\n\n"
+              "A context keeps the cached description of a lattice used by\n"
+              "atpass(..., reuse=True). Separate contexts allow several lattices\n"
+              "to be tracked in turn or concurrently without re-parsing the\n"
+              "elements. The context is released when garbage-collected.\n"
+              "Each context has its own random generators, seeded with *seed*\n"
+              "or, by default, from the common generator. This keeps the\n"
+              "results reproducible after reset_rng when contexts are tracked\n"
+              "concurrently.\n\n"
+              ":meta private:"
+             )},
+    {"free_context",  (PyCFunction)free_context, METH_VARARGS,
+    PyDoc_STR("free_context(context)\n\n"
+              "Release the lattice cached in a tracking context.\n\n"
+              ":meta private:"
+             )},
     {"reset_rng",  (PyCFunction)reset_rng, METH_VARARGS | METH_KEYWORDS,
     PyDoc_STR("reset_rng(rank=0, seed=None)\n\n"
-              "Reset the *common* and *thread* random generators.\n\n"
+              "Reset the *common* and *thread* random generators.\n"
+              "There is one independent *thread* generator per OpenMP thread.\n\n"
               "Parameters:\n"
               "    rank (int):    thread identifier (for MPI and python multiprocessing)\n"
               "    seed (int):    single seed for both generators\n"
@@ -769,6 +2975,20 @@ static PyMethodDef AtMethods[] = {
     PyDoc_STR("thread_rng()\n\n"
               "Return a double from the *thread* generator .\n"
              )},
+    {"get_rng_state",  (PyCFunction)get_rng_state, METH_VARARGS | METH_KEYWORDS,
+    PyDoc_STR("get_rng_state(*, context=None)\n\n"
+              "Return the state of the *common* and *thread* generators as bytes.\n\n"
+              "Parameters:\n"
+              "    context:       tracking context. Default: the module generators\n"
+             )},
+    {"set_rng_state",  (PyCFunction)set_rng_state, METH_VARARGS | METH_KEYWORDS,
+    PyDoc_STR("set_rng_state(state, *, context=None)\n\n"
+              "Restore the state of the *common* and *thread* generators.\n\n"
+              "Parameters:\n"
+              "    state (bytes): state returned by get_rng_state() in the same\n"
+              "       installation\n"
+              "    context:       tracking context. Default: the module generators\n"
+             )},
    {NULL, NULL, 0, NULL}        /* Sentinel */
 };
 
@@ -792,6 +3012,20 @@ PyMODINIT_FUNC PyInit_atpass(void)
     if (m == NULL) return NULL;
     import_array();
 
+    default_lock = PyThread_allocate_lock();
+    if (default_lock == NULL) return PyErr_NoMemory();
+
+    /* Allocate the thread generators */
+    #ifdef _OPENMP
+    nthread_state = omp_get_num_procs();
+    if (omp_get_max_threads() > nthread_state) nthread_state = omp_get_max_threads();
+    #else
+    nthread_state = 1;
+    #endif /*_OPENMP*/
+    default_context.rng_state = (pcg32_random_t *)malloc((1+nthread_state)*sizeof(pcg32_random_t));
+    if (default_context.rng_state == NULL) return PyErr_NoMemory();
+    seed_rngs(default_context.rng_state, nthread_state, AT_RNG_STATE, 0);
+
     /* Build path for loading Python integrators */
     integ_path_obj = get_integrators();
     if (integ_path_obj) {
@@ -811,6 +3045,12 @@ PyMODINIT_FUNC PyInit_atpass(void)
         return NULL;
     }
 
+    str_passmethod = PyUnicode_InternFromString("PassMethod");
+    str_length = PyUnicode_InternFromString("Length");
+    str_version = PyUnicode_InternFromString("_version");
+    str_double_precision = PyUnicode_InternFromString("DoublePrecision");
+    if (!(str_passmethod && str_length && str_version && str_double_precision)) return NULL;
+
     /* get Particle type */
     particle_type = get_pyobj("at.lattice", "Particle");
     if (particle_type == NULL) return NULL;
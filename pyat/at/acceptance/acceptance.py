@@ -2,7 +2,7 @@
 import numpy
 from .boundary import GridMode
 # noinspection PyProtectedMember
-from .boundary import boundary_search
+from .boundary import boundary_search, batched_boundary_search
 from typing import Optional, Sequence
 import multiprocessing
 from ..lattice import Lattice, Refpts, frequency_control
@@ -25,6 +25,7 @@ def get_acceptance(
         divider: Optional[int] = 2,
         shift_zero: Optional[float] = 1.0e-9,
         start_method: Optional[str] = None,
+        comm=None,
 ):
     # noinspection PyUnresolvedReferences
     r"""Computes the acceptance at ``repfts`` observation points
@@ -41,6 +42,7 @@ def get_acceptance(
           * :py:attr:`GridMode.CARTESIAN/RADIAL <.GridMode.RADIAL>`:
             max. amplitude
           * :py:attr:`.GridMode.RECURSIVE`: initial step
+          * :py:attr:`.GridMode.BISECTION`: initial amplitude
         nturns:         Number of turns for the tracking
         refpts:         Observation points. Default: start of the machine
         dp:             static momentum offset
@@ -56,6 +58,8 @@ def get_acceptance(
           * :py:attr:`.GridMode.CARTESIAN`: full [:math:`\:x, y\:`] grid
           * :py:attr:`.GridMode.RADIAL`: full [:math:`\:r, \theta\:`] grid
           * :py:attr:`.GridMode.RECURSIVE`: radial recursive search
+          * :py:attr:`.GridMode.BISECTION`: radial bisection search, all
+            the directions being tracked together
         use_mp:         Use python multiprocessing (:py:func:`.patpass`,
           default use :py:func:`.lattice_pass`).
         verbose:        Print out some information
@@ -69,6 +73,9 @@ def get_acceptance(
           Windows is ``'spawn'``. ``'fork'`` may used for MacOS to speed-up
           the calculation or to solve runtime errors, however  it is
           considered unsafe.
+        comm:           MPI communicator (:py:mod:`mpi4py`) sharing the
+          observation points between the ranks, used with
+          :py:attr:`.GridMode.BISECTION`. Default: :py:obj:`None`
 
     Returns:
         boundary:   (2,n) array: 2D acceptance
@@ -76,7 +83,10 @@ def get_acceptance(
         tracked:    (2,n) array: Coordinates of tracked particles
 
     In case of multiple refpts, return values are lists of arrays, with one
-    array per ref. point.
+    array per ref. point. With :py:attr:`.GridMode.BISECTION` and
+    ``use_mp=False``, the searches at all the ref. points are tracked
+    together in parallel threads, unless the lattice contains collective
+    elements or PassMethods implemented in Python.
 
     Examples:
 
@@ -120,7 +130,7 @@ def get_acceptance(
             cond = (grid_mode is GridMode.RADIAL or
                     grid_mode is GridMode.CARTESIAN)
         else:
-            cond = grid_mode is GridMode.RECURSIVE
+            cond = grid_mode in (GridMode.RECURSIVE, GridMode.BISECTION)
         if rpp > mpp and not cond:
             print('The estimated load for grid mode is {0}'.format(mpp))
             print('The estimated load for recursive mode is {0}'.format(rpp))
@@ -138,10 +148,25 @@ def get_acceptance(
         rp = ring.uint32_refpts(refpts)
     else:
         rp = numpy.atleast_1d(refpts)
-    for r in rp:
+    if offset is None and len(rp) > 1:
+        # one closed orbit search for all the observation points
+        _, offsets = ring.find_orbit(refpts=rp, dp=dp)
+    else:
+        offsets = [offset] * len(rp)
+    if grid_mode is GridMode.BISECTION and len(rp) > 1 and not use_mp:
+        try:
+            return batched_boundary_search(ring, planes, npoints, amplitudes,
+                                           rp, nturns=nturns, dp=dp,
+                                           offsets=offsets, bounds=bounds,
+                                           verbose=verbose,
+                                           shift_zero=shift_zero, comm=comm)
+        except ValueError:
+            # collective or python integrators: one search per point
+            pass
+    for r, off in zip(rp, offsets):
         b, s, g = boundary_search(ring, planes, npoints, amplitudes,
                                   nturns=nturns, obspt=r, dp=dp,
-                                  offset=offset, bounds=bounds,
+                                  offset=off, bounds=bounds,
                                   grid_mode=grid_mode, use_mp=use_mp,
                                   verbose=verbose, divider=divider,
                                   shift_zero=shift_zero, **kwargs)
@@ -165,7 +190,7 @@ def get_1d_acceptance(
         divider: Optional[int] = 2,
         shift_zero: Optional[float] = 1.0e-9,
         start_method: Optional[str] = None,
-
+        comm=None,
 ):
     r"""Computes the 1D acceptance at ``refpts`` observation points
 
@@ -182,6 +207,7 @@ def get_1d_acceptance(
           * :py:attr:`GridMode.CARTESIAN/RADIAL <.GridMode.RADIAL>`:
             max. amplitude
           * :py:attr:`.GridMode.RECURSIVE`: initial step
+          * :py:attr:`.GridMode.BISECTION`: initial amplitude
         nturns:         Number of turns for the tracking
         refpts:         Observation points. Default: start of the machine
         dp:             static momentum offset
@@ -190,10 +216,13 @@ def get_1d_acceptance(
           * :py:attr:`.GridMode.CARTESIAN`: full [:math:`\:x, y\:`] grid
           * :py:attr:`.GridMode.RADIAL`: full [:math:`\:r, \theta\:`] grid
           * :py:attr:`.GridMode.RECURSIVE`: radial recursive search
+          * :py:attr:`.GridMode.BISECTION`: radial bisection search, all
+            the directions being tracked together
         use_mp:         Use python multiprocessing (:py:func:`.patpass`,
           default use :py:func:`.lattice_pass`). In case multi-processing
           is not enabled, ``grid_mode`` is forced to
-          :py:attr:`.GridMode.RECURSIVE` (most efficient in single core)
+          :py:attr:`.GridMode.RECURSIVE` (most efficient in single core),
+          unless :py:attr:`.GridMode.BISECTION` is selected
         verbose:        Print out some information
         divider:        Value of the divider used in
           :py:attr:`.GridMode.RECURSIVE` boundary search
@@ -205,6 +234,9 @@ def get_1d_acceptance(
           Windows is ``'spawn'``. ``'fork'`` may used for MacOS to speed-up
           the calculation or to solve runtime errors, however  it is considered
           unsafe.
+        comm:           MPI communicator (:py:mod:`mpi4py`) sharing the
+          observation points between the ranks, used with
+          :py:attr:`.GridMode.BISECTION`. Default: :py:obj:`None`
 
     Returns:
         boundary:   (len(refpts),2) array: 1D acceptance
@@ -220,21 +252,22 @@ def get_1d_acceptance(
          This behavior can be changed by setting
          ``at.DConstant.patpass_poolsize`` to the desired value
     """
-    if not use_mp:
+    if not use_mp and grid_mode is not GridMode.BISECTION:
         grid_mode = GridMode.RECURSIVE
     assert len(numpy.atleast_1d(plane)) == 1, \
         '1D acceptance: single plane required'
     assert numpy.isscalar(resolution), '1D acceptance: scalar args required'
     assert numpy.isscalar(amplitude), '1D acceptance: scalar args required'
     npoint = numpy.ceil(amplitude/resolution)
-    if grid_mode is not GridMode.RECURSIVE:
+    if grid_mode not in (GridMode.RECURSIVE, GridMode.BISECTION):
         assert npoint > 1, \
             'Grid has only one point: increase amplitude or reduce resolution'
     b, s, g = get_acceptance(ring, plane, npoint, amplitude,
                              nturns=nturns, dp=dp, refpts=refpts,
                              grid_mode=grid_mode, use_mp=use_mp,
                              verbose=verbose, start_method=start_method,
-                             divider=divider, shift_zero=shift_zero)
+                             divider=divider, shift_zero=shift_zero,
+                             comm=comm)
     return numpy.squeeze(b), s, g
 
 
@@ -253,6 +286,7 @@ def get_horizontal_acceptance(ring: Lattice,
           * :py:attr:`GridMode.CARTESIAN/RADIAL <.GridMode.RADIAL>`:
             max. amplitude
           * :py:attr:`.GridMode.RECURSIVE`: initial step
+          * :py:attr:`.GridMode.BISECTION`: initial amplitude
 
     Keyword Args:
         nturns:         Number of turns for the tracking
@@ -263,10 +297,13 @@ def get_horizontal_acceptance(ring: Lattice,
           * :py:attr:`.GridMode.CARTESIAN`: full [:math:`\:x, y\:`] grid
           * :py:attr:`.GridMode.RADIAL`: full [:math:`\:r, \theta\:`] grid
           * :py:attr:`.GridMode.RECURSIVE`: radial recursive search
+          * :py:attr:`.GridMode.BISECTION`: radial bisection search, all
+            the directions being tracked together
         use_mp:         Use python multiprocessing (:py:func:`.patpass`,
           default use :py:func:`.lattice_pass`). In case multi-processing
           is not enabled, ``grid_mode`` is forced to
-          :py:attr:`.GridMode.RECURSIVE` (most efficient in single core)
+          :py:attr:`.GridMode.RECURSIVE` (most efficient in single core),
+          unless :py:attr:`.GridMode.BISECTION` is selected
         verbose:        Print out some information
         divider:        Value of the divider used in
           :py:attr:`.GridMode.RECURSIVE` boundary search
@@ -311,6 +348,7 @@ def get_vertical_acceptance(ring: Lattice,
           * :py:attr:`GridMode.CARTESIAN/RADIAL <.GridMode.RADIAL>`:
             max. amplitude
           * :py:attr:`.GridMode.RECURSIVE`: initial step
+          * :py:attr:`.GridMode.BISECTION`: initial amplitude
 
     Keyword Args:
         nturns:         Number of turns for the tracking
@@ -321,10 +359,13 @@ def get_vertical_acceptance(ring: Lattice,
           * :py:attr:`.GridMode.CARTESIAN`: full [:math:`\:x, y\:`] grid
           * :py:attr:`.GridMode.RADIAL`: full [:math:`\:r, \theta\:`] grid
           * :py:attr:`.GridMode.RECURSIVE`: radial recursive search
+          * :py:attr:`.GridMode.BISECTION`: radial bisection search, all
+            the directions being tracked together
         use_mp:         Use python multiprocessing (:py:func:`.patpass`,
           default use :py:func:`.lattice_pass`). In case multi-processing
           is not enabled, ``grid_mode`` is forced to
-          :py:attr:`.GridMode.RECURSIVE` (most efficient in single core)
+          :py:attr:`.GridMode.RECURSIVE` (most efficient in single core),
+          unless :py:attr:`.GridMode.BISECTION` is selected
         verbose:        Print out some information
         divider:        Value of the divider used in
           :py:attr:`.GridMode.RECURSIVE` boundary search
@@ -369,6 +410,7 @@ def get_momentum_acceptance(ring: Lattice,
           * :py:attr:`GridMode.CARTESIAN/RADIAL <.GridMode.RADIAL>`:
             max. amplitude
           * :py:attr:`.GridMode.RECURSIVE`: initial step
+          * :py:attr:`.GridMode.BISECTION`: initial amplitude
 
     Keyword Args:
         nturns:         Number of turns for the tracking
@@ -379,10 +421,13 @@ def get_momentum_acceptance(ring: Lattice,
           * :py:attr:`.GridMode.CARTESIAN`: full [:math:`\:x, y\:`] grid
           * :py:attr:`.GridMode.RADIAL`: full [:math:`\:r, \theta\:`] grid
           * :py:attr:`.GridMode.RECURSIVE`: radial recursive search
+          * :py:attr:`.GridMode.BISECTION`: radial bisection search, all
+            the directions being tracked together
         use_mp:         Use python multiprocessing (:py:func:`.patpass`,
           default use :py:func:`.lattice_pass`). In case multi-processing is
           not enabled, ``grid_mode`` is forced to
-          :py:attr:`.GridMode.RECURSIVE` (most efficient in single core)
+          :py:attr:`.GridMode.RECURSIVE` (most efficient in single core),
+          unless :py:attr:`.GridMode.BISECTION` is selected
         verbose:        Print out some information
         divider:        Value of the divider used in
           :py:attr:`.GridMode.RECURSIVE` boundary search
@@ -394,6 +439,9 @@ def get_momentum_acceptance(ring: Lattice,
           Windows is ``'spawn'``. ``'fork'`` may used for MacOS to speed-up
           the calculation or to solve runtime errors, however  it is considered
           unsafe.
+        comm:           MPI communicator (:py:mod:`mpi4py`) sharing the
+          observation points between the ranks, used with
+          :py:attr:`.GridMode.BISECTION`. Default: :py:obj:`None`
 
     Returns:
         boundary:   (len(refpts),2) array: 1D acceptance
@@ -6,6 +6,8 @@ grid definitions
 
 from at.lattice import Lattice, AtError
 from at.tracking import lattice_pass, patpass
+# noinspection PyUnresolvedReferences
+from at.tracking.atpass import variantpass
 from typing import Optional, Sequence
 from enum import Enum
 import numpy
@@ -27,6 +29,7 @@ class GridMode(Enum):
     RADIAL = 0      #: full [:math:`\:r, \theta\:`] grid
     CARTESIAN = 1   #: full [:math:`\:x, y\:`] grid
     RECURSIVE = 2   #: radial recursive search
+    BISECTION = 3   #: radial bisection search, all rays tracked together
 
 
 def grid_config(planes, amplitudes, npoints, bounds, grid_mode,
@@ -108,7 +111,8 @@ def grid_configuration(planes, npoints, amplitudes, grid_mode, bounds=None,
        and bounds is not None):
         raise AtError('bounds shape should be (len(planes),2)')
 
-    if grid_mode is GridMode.RADIAL or grid_mode is GridMode.RECURSIVE:
+    if grid_mode in (GridMode.RADIAL, GridMode.RECURSIVE,
+                     GridMode.BISECTION):
         if bounds is None:
             bounds = numpy.array([[0, 1], [numpy.pi, 0]])
         bounds[0][bounds[0] == 0] = 1.0e-6
@@ -167,6 +171,8 @@ def get_survived(parts, ring, nturns, use_mp, **kwargs):
     """
     Track a grid through the ring and extract survived particles
     """
+    # Most particles are lost early: track only the survivors
+    kwargs.setdefault('compact_turns', 8)
     if use_mp:
         _ = patpass(ring, parts, nturns=nturns, **kwargs)
     else:
@@ -318,6 +324,21 @@ def grid_boundary_search(ring, planes, npoints, amplitudes, nturns=1024,
     return boundary, survived, grid.grid
 
 
+def get_rays(config):
+    """
+    Returns the angles of the rays, the resolution and the initial step
+    of the radial searches
+    """
+    rtol = min(numpy.atleast_1d(config.amplitudes/config.shape))
+    rstep = config.amplitudes
+    if len(numpy.atleast_1d(config.shape)) == 2:
+        angles = numpy.linspace(*config.bounds[1], config.shape[1])
+    else:
+        angles = numpy.linspace(*config.bounds[1], 2)
+    angles = numpy.atleast_1d(angles)
+    return angles, rtol, rstep
+
+
 def recursive_boundary_search(ring, planes, npoints, amplitudes, nturns=1024,
                               obspt=None, dp=None, offset=None, bounds=None,
                               use_mp=False, divider=2, verbose=True,
@@ -379,13 +400,7 @@ def recursive_boundary_search(ring, planes, npoints, amplitudes, nturns=1024,
     config = grid_configuration(planes, npoints, amplitudes,
                                 GridMode.RECURSIVE, bounds=bounds,
                                 shift_zero=shift_zero)
-    rtol = min(numpy.atleast_1d(config.amplitudes/config.shape))
-    rstep = config.amplitudes
-    if len(numpy.atleast_1d(config.shape)) == 2:
-        angles = numpy.linspace(*config.bounds[1], config.shape[1])
-    else:
-        angles = numpy.linspace(*config.bounds[1], 2)
-    angles = numpy.atleast_1d(angles)
+    angles, rtol, rstep = get_rays(config)
 
     if verbose:
         print('\nRunning recursive boundary search:')
@@ -410,6 +425,218 @@ def recursive_boundary_search(ring, planes, npoints, amplitudes, nturns=1024,
     return result
 
 
+def bisection_boundary_search(ring, planes, npoints, amplitudes,
+                              nturns=1024, obspt=None, dp=None, offset=None,
+                              bounds=None, use_mp=False, verbose=True,
+                              shift_zero=1.0e-9, chunk_turns=64, **kwargs):
+    """
+    Search for the boundary along all directions (angles) at once, by
+    bisection of the amplitude of each direction.
+
+    The candidate particles of all the directions are tracked together by
+    chunks of *chunk_turns* turns. After each chunk, the directions whose
+    candidate is lost or has survived *nturns* update their amplitude
+    bracket and start a new candidate, while the other ones resume from the
+    coordinates reached at the end of the chunk. Directions whose bracket
+    is narrower than the resolution are no longer tracked.
+    """
+    def search_boundary(planesi, angles, rtol, rsteps, nturns,
+                        offset, use_mp, **kwargs):
+
+        def start(idx):
+            part[:, idx] = offset[:, numpy.newaxis]
+            part[planesi, idx] += dirs[:, idx]*amp[idx]
+            turn[idx] = 0
+
+        ftol = min(rtol/rsteps)
+        cs = numpy.squeeze([numpy.cos(angles), numpy.sin(angles)])
+        cs = numpy.around(cs, decimals=9)
+        dirs = numpy.reshape(cs, (2, -1))[:len(planesi)] * \
+            numpy.reshape(rsteps, (-1, 1))
+        nrays = len(angles)
+        lo = numpy.zeros(nrays)
+        hi = numpy.full(nrays, numpy.inf)
+        amp = numpy.ones(nrays)
+        turn = numpy.zeros(nrays, dtype=int)
+        active = numpy.full(nrays, True)
+        part = numpy.zeros((6, nrays), order='F')
+        grid = []
+        mask = []
+        start(numpy.arange(nrays))
+
+        kwargs.setdefault('compact_turns', 8)
+        track = patpass if use_mp else lattice_pass
+        keep_lattice = False
+        while numpy.any(active):
+            sel = numpy.flatnonzero(active)
+            nt = min(chunk_turns, nturns - numpy.amin(turn[sel]))
+            pt = numpy.asfortranarray(part[:, sel])
+            _, ld = track(newring, pt, nturns=nt, refpts=None, losses=True,
+                          keep_lattice=keep_lattice, **kwargs)
+            keep_lattice = True
+            part[:, sel] = pt
+            # losses after nturns do not count
+            lost = numpy.logical_and(ld['islost'],
+                                     turn[sel] + ld['turn'] < nturns)
+            turn[sel] += nt
+            done = numpy.logical_or(lost, turn[sel] >= nturns)
+            idx = sel[done]
+            sv = sel[numpy.logical_and(done, ~lost)]
+            grid.append(dirs[:, idx]*amp[idx])
+            mask.append(dirs[:, sv]*amp[sv])
+            lo[sv] = amp[sv]
+            hi[sel[lost]] = amp[sel[lost]]
+            # expand until a particle is lost, then bisect
+            amp[idx] = numpy.where(numpy.isinf(hi[idx]), 2.0*lo[idx],
+                                   0.5*(lo[idx]+hi[idx]))
+            converged = hi[idx]-lo[idx] <= ftol
+            active[idx[converged]] = False
+            start(idx[~converged])
+
+        p = numpy.squeeze(dirs*lo)
+        return p, numpy.hstack(mask), numpy.hstack(grid)
+
+    offset, newring = set_ring_orbit(ring, dp, obspt, offset)
+    config = grid_configuration(planes, npoints, amplitudes,
+                                GridMode.BISECTION, bounds=bounds,
+                                shift_zero=shift_zero)
+    angles, rtol, rstep = get_rays(config)
+
+    if verbose:
+        print('\nRunning bisection boundary search:')
+        if obspt is None:
+            print('Element {0}, obspt={1}'.format(ring[0].FamName, 0))
+        else:
+            print('Element {0}, obspt={1}'.format(ring[obspt].FamName,
+                                                  obspt))
+        print('The grid mode is {0}'.format(config.mode))
+        print('The planes are {0}'.format(config.planes))
+        print('Number of angles is {0} from {1} to {2} rad'.format(len(angles),
+              angles[0], angles[-1]))
+        print('The resolution of the search is {0}'.format(rtol))
+        print('The initial amplitude is {0}'.format(rstep))
+        print('The initial offset is {0} with dp={1}'.format(offset, dp))
+
+    t0 = time.time()
+    result = search_boundary(config.planesi, angles, rtol, rstep,
+                             nturns, numpy.asarray(offset), use_mp, **kwargs)
+    if verbose:
+        print('Calculation took {0}'.format(time.time()-t0))
+    return result
+
+
+def batched_boundary_search(ring, planes, npoints, amplitudes, refpts,
+                            nturns=1024, dp=None, offsets=None, bounds=None,
+                            verbose=True, shift_zero=1.0e-9, chunk_turns=64,
+                            comm=None, **kwargs):
+    """
+    Bisection boundary search at several observation points in a single
+    tracking job.
+
+    The rings starting at each observation point share the element data of
+    *ring* and are tracked together by :py:func:`.variantpass`, in parallel
+    and without the GIL. Within each ring, the directions are searched as in
+    :py:func:`bisection_boundary_search`. With an MPI communicator *comm*,
+    the observation points are distributed over the ranks and the results
+    are available on all the ranks.
+
+    Raises:
+        ValueError: if the ring contains collective elements or PassMethods
+          implemented in Python
+    """
+    def start(sel):
+        base = numpy.broadcast_to(offs[:, numpy.newaxis, :], part.shape)
+        p = base[:, sel]
+        p[planesi] += dirs3[:, sel]*amp[sel]
+        part[:, sel] = p
+        turn[sel] = 0
+
+    config = grid_configuration(planes, npoints, amplitudes,
+                                GridMode.BISECTION, bounds=bounds,
+                                shift_zero=shift_zero)
+    angles, rtol, rstep = get_rays(config)
+    planesi = config.planesi
+    refpts = numpy.atleast_1d(refpts)
+    if offsets is None:
+        _, offsets = ring.find_orbit(refpts=refpts, dp=dp)
+    if comm is None:
+        mine = numpy.arange(len(refpts))
+    else:
+        mine = numpy.arange(comm.Get_rank(), len(refpts), comm.Get_size())
+
+    if verbose:
+        print('\nRunning batched bisection boundary search:')
+        print('Number of observation points is {0}'.format(len(refpts)))
+        print('The planes are {0}'.format(config.planes))
+        print('Number of angles is {0} from {1} to {2} rad'.format(len(angles),
+              angles[0], angles[-1]))
+        print('The resolution of the search is {0}'.format(rtol))
+        print('The initial amplitude is {0}'.format(rstep))
+
+    t0 = time.time()
+    ftol = min(rtol/rstep)
+    cs = numpy.squeeze([numpy.cos(angles), numpy.sin(angles)])
+    cs = numpy.around(cs, decimals=9)
+    dirs = numpy.reshape(cs, (2, -1))[:len(planesi)] * \
+        numpy.reshape(rstep, (-1, 1))
+    lines = [list(ring.rotate(r)) for r in refpts[mine]]
+    nrays, nvar = len(angles), len(lines)
+    dirs3 = numpy.repeat(dirs[:, :, numpy.newaxis], nvar, axis=2)
+    offs = numpy.asarray(offsets)[mine].T
+    # [ray, observation point]
+    lo = numpy.zeros((nrays, nvar))
+    hi = numpy.full((nrays, nvar), numpy.inf)
+    amp = numpy.ones((nrays, nvar))
+    turn = numpy.zeros((nrays, nvar), dtype=int)
+    active = numpy.full((nrays, nvar), nvar > 0)
+    part = numpy.zeros((6, nrays, nvar), order='F')
+    grid = [[] for _ in range(nvar)]
+    mask = [[] for _ in range(nvar)]
+    start(active)
+
+    kwargs.setdefault('energy', ring.energy)
+    kwargs.setdefault('particle', ring.particle)
+    while numpy.any(active):
+        var = numpy.flatnonzero(numpy.any(active, axis=0))
+        act = active[:, var]
+        nt = min(chunk_turns, numpy.amin(nturns - turn[active]))
+        pt = numpy.asfortranarray(part[:, :, var])
+        # the candidates of converged directions are parked as lost
+        pt[:, ~act] = numpy.nan
+        variantpass([lines[v] for v in var], pt, nt, **kwargs)
+        part[:, :, var] = numpy.where(act, pt, part[:, :, var])
+        turn[:, var] += nt*act
+        lost = numpy.zeros((nrays, nvar), dtype=bool)
+        lost[:, var] = numpy.logical_and(act, numpy.isnan(pt[0]))
+        done = numpy.logical_or(lost, numpy.logical_and(active,
+                                                        turn >= nturns))
+        sv = numpy.logical_and(done, ~lost)
+        for v in var:
+            grid[v].append(dirs[:, done[:, v]]*amp[done[:, v], v])
+            mask[v].append(dirs[:, sv[:, v]]*amp[sv[:, v], v])
+        lo[sv] = amp[sv]
+        hi[lost] = amp[lost]
+        # expand until a particle is lost, then bisect
+        amp[done] = numpy.where(numpy.isinf(hi[done]), 2.0*lo[done],
+                                0.5*(lo[done]+hi[done]))
+        converged = numpy.logical_and(done, hi-lo <= ftol)
+        active[converged] = False
+        start(numpy.logical_and(done, ~converged))
+
+    results = [(numpy.squeeze(dirs*lo[:, v]), numpy.hstack(mask[v]),
+                numpy.hstack(grid[v])) for v in range(nvar)]
+    if comm is not None:
+        gathered = comm.allgather((mine, results))
+        results = [None] * len(refpts)
+        for idx, res in gathered:
+            for i, r in zip(idx, res):
+                results[i] = r
+    if verbose:
+        print('Calculation took {0}'.format(time.time()-t0))
+    boundary, survived, tracked = (list(r) for r in zip(*results))
+    return boundary, survived, tracked
+
+
 def boundary_search(ring: Lattice, planes, npoints, amplitudes,
                     nturns: Optional[int] = 1024,
                     obspt: Optional[int] = None, dp: Optional[float] = None,
@@ -431,6 +658,13 @@ def boundary_search(ring: Lattice, planes, npoints, amplitudes,
                                            divider=divider,
                                            shift_zero=shift_zero,
                                            **kwargs)
+    elif grid_mode is GridMode.BISECTION:
+        result = bisection_boundary_search(ring, planes, npoints, amplitudes,
+                                           nturns=nturns, obspt=obspt, dp=dp,
+                                           offset=offset, bounds=bounds,
+                                           use_mp=use_mp, verbose=verbose,
+                                           shift_zero=shift_zero,
+                                           **kwargs)
     else:
         result = grid_boundary_search(ring, planes, npoints, amplitudes,
                                       nturns=nturns, obspt=obspt, dp=dp,
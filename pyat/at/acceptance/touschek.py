@@ -6,7 +6,7 @@ import at
 import numpy
 from ..lattice import Lattice, AtError, AtWarning
 import warnings
-from scipy.special import iv
+from scipy.special import ive
 from scipy import integrate
 from scipy.optimize import fsolve
 from ..constants import qe, clight, _e_radius
@@ -79,19 +79,34 @@ def get_beam_sizes(ring, bunch_curr, zn=None, emitx=None,
 def int_piwinski(k, km, B1, B2):
     """
     Integrand of the piwinski formula
+
+    The arguments may be arrays broadcast together. The exponentially
+    scaled Bessel function avoids the overflow of :math:`I_0(B_2 t)`.
     """
     t = numpy.tan(k)**2
     tm = numpy.tan(km)**2
     fact = ((2*t+1)**2*(t/tm/(1+t)-1)/t + t - numpy.sqrt(t*tm*(1+t)) -
             (2+1/(2*t))*numpy.log(t/tm/(1+t)))
-    if B2*t < 500:
-        intp = fact * numpy.exp(-B1*t)*iv(0, B2*t)*numpy.sqrt(1+t)
-    else:
-        intp = fact * numpy.exp(B2*t-B1*t) / \
-             numpy.sqrt(2*numpy.pi*B2*t)*numpy.sqrt(1+t)
+    intp = fact * numpy.exp((B2-B1)*t)*ive(0, B2*t)*numpy.sqrt(1+t)
     return intp
 
 
+def _int_piwinski_refpts(km, B1, B2, epsabs, epsrel):
+    """
+    Integral of the piwinski formula for all the refpts at once: the
+    interval [km, pi/2] is mapped on [0, 1] and the vector of integrands
+    is integrated adaptively
+    """
+    width = numpy.pi/2 - km
+
+    def integrand(u):
+        return width*int_piwinski(km + u*width, km, B1, B2)
+
+    val, _ = integrate.quad_vec(integrand, 0.0, 1.0, epsabs=epsabs,
+                                epsrel=epsrel, norm='max')
+    return val
+
+
 def get_lifetime(ring, emity, bunch_curr, emitx=None, sigs=None, sigp=None,
                  zn=None, momap=None, refpts=None, **kwargs):
     """Touschek lifetime calculation
@@ -121,6 +136,8 @@ def get_lifetime(ring, emity, bunch_curr, emitx=None, sigs=None, sigp=None,
         dp=None:         static momentum offset
         grid_mode:       ``at.GridMode.CARTESIAN/RADIAL`` track full vector
                          (default). ``at.GridMode.RECURSIVE``: recursive search
+                         ``at.GridMode.BISECTION``: bisection search, all
+                         the ``refpts`` being tracked together
         use_mp=False:    Use python multiprocessing (``patpass``, default use
                          ``lattice_pass``). In case multi-processing is not
                          enabled ``GridMode`` is forced to
@@ -148,7 +165,8 @@ def get_lifetime(ring, emity, bunch_curr, emitx=None, sigs=None, sigp=None,
         assert len(momap) == len(refpts), \
             'Input momap and refpts have different lengths'
 
-    mask = [ring[r].Length > 0.0 for r in refpts]
+    lengths = ring.columns.get('Length', 0.0)
+    mask = lengths[refpts] > 0.0
     if not numpy.all(mask):
         zerolength_warning = ('zero-length elements removed '
                               'from lifetime calculation')
@@ -165,9 +183,8 @@ def get_lifetime(ring, emity, bunch_curr, emitx=None, sigs=None, sigp=None,
         momap = momap[mask]
 
     if interpolate:
-        refpts_all = numpy.array([i for i in range(refpts[0],
-                                                   refpts[-1]+1)
-                                  if ring[i].Length > 0])
+        refpts_all = numpy.arange(refpts[0], refpts[-1]+1)
+        refpts_all = refpts_all[lengths[refpts_all] > 0]
         spos = numpy.squeeze(ring.get_s_pos(refpts))
         spos_all = numpy.squeeze(ring.get_s_pos(refpts_all))
         momp = numpy.interp(spos_all, spos, momap[:, 0])
@@ -177,7 +194,7 @@ def get_lifetime(ring, emity, bunch_curr, emitx=None, sigs=None, sigp=None,
     else:
         ma, rp = momap, refpts
 
-    length_all = numpy.array([e.Length for e in ring[rp]])
+    length_all = lengths[rp]
 
     nc = bunch_curr/ring.revolution_frequency/qe
     beta2 = ring.beta*ring.beta
@@ -214,12 +231,7 @@ def get_lifetime(ring, emity, bunch_curr, emitx=None, sigs=None, sigp=None,
         um = beta2*dpp*dpp
         km = numpy.arctan(numpy.sqrt(um))
 
-        val = numpy.zeros(len(rp))
-        for ii in range(len(rp)):
-            args = (km[ii], B1[ii], B2[ii])
-            val[ii], _ = integrate.quad(int_piwinski, args[0], numpy.pi/2,
-                                        args=args, epsabs=epsabs,
-                                        epsrel=epsrel)
+        val = _int_piwinski_refpts(km, B1, B2, epsabs, epsrel)
 
         val *= (_e_radius**2*clight*nc /
                 (8*numpy.pi*(gamma2)*sigs *
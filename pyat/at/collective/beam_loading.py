@@ -113,6 +113,7 @@ class BeamLoadingElement(RFCavity, Collective):
                         ZCuts=lambda v: _array(v),
                         _nturns=int, _phis=float,
                         _turnhistory=lambda v: _array(v),
+                        _historyhead=lambda v: _array(v, shape=(1,)),
                         _vbunch=lambda v: _array(v),
                         _vbeam_phasor=lambda v: _array(v, shape=(2,)),
                         _vbeam=lambda v: _array(v, shape=(2,)),
@@ -163,6 +164,7 @@ class BeamLoadingElement(RFCavity, Collective):
         self._nslice = kwargs.pop('Nslice', 101)
         self._nturns = kwargs.pop('Nturns', 1)
         self._turnhistory = None    # Defined here to avoid warning
+        self._historyhead = None
         self._vbunch = None
         if zcuts is not None:
             self.ZCuts = zcuts
@@ -191,6 +193,7 @@ class BeamLoadingElement(RFCavity, Collective):
             nbunch = ring.nbunch
         tl = self._nturns*self._nslice*nbunch
         self._turnhistory = numpy.zeros((tl, 4), order='F')
+        self._historyhead = numpy.zeros(1)
         self._vbunch = numpy.zeros((nbunch, 2), order='F')
         self._init_bl_params(current)
 
@@ -2,7 +2,6 @@ import numpy
 from at import radiation_parameters
 from at.constants import clight, qe
 from scipy.interpolate import interp1d
-import time
 from at.collective import Wake
 from at.lattice import Lattice
 
@@ -85,7 +84,6 @@ class Haissinski(object):
 
         self.q_array = -self.kmax + numpy.arange(self.npoints)*self.dq
         self.set_weights()
-        self.dtFlag = False
 
         self.set_I(current)
         self.initial_phi()
@@ -115,18 +113,16 @@ class Haissinski(object):
         sr = numpy.arange(2*numpy.amin(self.q_array),
                           numpy.abs(2*numpy.amin(self.q_array))
                           + self.ds, self.ds)
-        res = numpy.zeros(len(sr))
 
         topend = numpy.trapz(self.wtot_fun(numpy.arange(numpy.amax(sr),
                              numpy.amax(self.s), self.ds)),
                              x=numpy.arange(numpy.amax(sr),
                              numpy.amax(self.s), self.ds))
-        for p, low in enumerate(sr):
-            if p % 10000 == 0:
-                print(p, ' out of ', len(sr))
-            rr = numpy.arange(low, numpy.amax(sr), self.ds)
-            val = numpy.trapz(self.wtot_fun(rr), x=rr) + topend
-            res[p] = val
+        #  integral from each point to the end of sr, by a reversed
+        #  cumulative sum of the trapezoids
+        wsr = self.wtot_fun(sr)
+        trapz = 0.5*(wsr[1:] + wsr[:-1])*numpy.diff(sr)
+        res = numpy.append(numpy.cumsum(trapz[::-1])[::-1], 0.0) + topend
         #  Not used except for plotting
         self.Sfun_range = sr
         self.Sfun = interp1d(sr, res)
@@ -137,10 +133,8 @@ class Haissinski(object):
         is only made at certain places. So all possibilities
         are loaded into a matrix for speed.
         '''
-        self.Smat = numpy.zeros((self.npoints, self.npoints))
-        for iq1, q1 in enumerate(self.q_array):
-            for iq2, q2 in enumerate(self.q_array):
-                self.Smat[iq1, iq2] = self.Sfun(q1-q2)
+        self.Smat = self.Sfun(self.q_array[:, numpy.newaxis] -
+                              self.q_array[numpy.newaxis, :])
 
     def set_I(self, current):
         '''
@@ -160,71 +154,45 @@ class Haissinski(object):
         self.phi = numpy.exp(-self.q_array**2/2)*self.Ic/numpy.sqrt(2*numpy.pi)
         self.phi_0 = self.phi.copy()
 
+    def _exponent(self):
+        '''
+        exp(-q_j**2/2 + sum_k w_k S_jk phi_k): the only matrix-vector
+        product of an iteration, shared by Fi and dFi_dphij
+        '''
+        wsum = self.Smat @ (self.weights * self.phi)
+        self.expo = numpy.exp(-self.q_array**2/2 + wsum)
+        self.A = numpy.sum(self.weights * self.expo)
+
     def Fi(self):
         '''
         Equation 28
         '''
-        self.allFi = numpy.zeros(self.npoints)
-        for i in numpy.arange(self.npoints):
-            sum1 = 0
-            for j in numpy.arange(self.npoints):
-                sum1b = 0
-                for k in numpy.arange(self.npoints):
-                    sum1b += self.weights[k] * self.Smat[j, k] * self.phi[k]
-                sum1 += self.weights[j] * \
-                    numpy.exp(-self.q_array[j]**2/2 + sum1b)
-            sum2 = 0
-            for j in numpy.arange(self.npoints):
-                sum2 += self.weights[j] * self.Smat[i, j] * self.phi[j]
-            self.allFi[i] = self.phi[i] * sum1 - self.Ic * \
-                numpy.exp(-self.q_array[i]**2/2 + sum2)
+        self._exponent()
+        self.allFi = self.phi * self.A - self.Ic * self.expo
 
     def dFi_ij(self, i, j):
-
-        sum1 = 0
-        for k in numpy.arange(self.npoints):
-
-            sum1b = 0
-            for li in numpy.arange(self.npoints):
-
-                sum1b += self.weights[li] * self.Smat[k, li] * self.phi[li]
-
-            #  in paper i starts from 1, but kron(0,0) is 0 in python.
-            #  No good for python, so i need this to be able to loop from 0
-            kron = 0 if i != j else 1
-
-            sum1 += self.weights[k] * \
-                (kron + self.phi[i] * self.weights[j] * self.Smat[k, j]) * \
-                numpy.exp(-self.q_array[k]**2/2 + sum1b)
-
-        sum2 = 0
-        for k in numpy.arange(self.npoints):
-            sum2 += self.weights[k] * self.Smat[i, k] * self.phi[k]
-
-        val = sum1 - self.Ic*self.weights[j] * self.Smat[i, j] \
-            * numpy.exp(-self.q_array[i]**2/2 + sum2)
-
-        return val
+        '''
+        Element (i, j) of the Jacobian, equation 30
+        '''
+        self.dFi_dphij()
+        return self.alldFi_dphij[i, j]
 
     def dFi_dphij(self):
         '''
-        Equation 30
+        Equation 30, with the sums over k of the paper evaluated once:
+
+        dFi/dphij = A delta_ij + phi_i w_j sum_k w_k S_kj e_k
+        - Ic w_j S_ij e_i
         '''
-        if not self.dtFlag:
-            t0 = time.time()
-            self.dFi_ij(0, 0)
-            dt = time.time() - t0
-            print('Computing dFi/dphij, will take approximately ',
-                  numpy.round(dt*self.npoints**2/60, 3),
-                  ' minutes per iteration')
-            self.dtFlag = True
-        allDat = [self.dFi_ij(i, j) for i in numpy.arange(self.npoints)
-                  for j in numpy.arange(self.npoints)]
-        self.alldFi_dphij = numpy.reshape(allDat, (self.npoints, self.npoints))
+        self._exponent()
+        w = self.weights
+        v = (w * self.expo) @ self.Smat
+        self.alldFi_dphij = self.A * numpy.identity(self.npoints) + \
+            numpy.outer(self.phi, w * v) - \
+            self.Ic * self.expo[:, numpy.newaxis] * self.Smat * w
 
     def compute_new_phi(self):
-        ainv = numpy.linalg.inv(self.alldFi_dphij)
-        self.pseudo_inv = numpy.dot(ainv, -self.allFi)
+        self.pseudo_inv = numpy.linalg.solve(self.alldFi_dphij, -self.allFi)
         self.phi_1 = self.pseudo_inv + self.phi
 
     def update(self):
@@ -272,6 +240,12 @@ class Haissinski(object):
                 self.set_I(1e-5)
             else:
                 self.set_I(Ib)
+            if ii == 0:
+                self.initial_phi()
+            else:
+                #  warm start from the previous solution, scaled to the
+                #  new current
+                self.phi = self.phi_1 * self.Ic / self.I_steps[ii-1]
             self.I_steps[ii] = self.Ic
             self.solve()
             self.res_steps[ii, :] = self.res
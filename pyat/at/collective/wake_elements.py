@@ -13,7 +13,8 @@ class WakeElement(Collective, Element):
     _BUILD_ATTRIBUTES = Element._BUILD_ATTRIBUTES
     default_pass = {False: 'IdentityPass', True: 'WakeFieldPass'}
     _conversions = dict(Element._conversions, _nslice=int, _nturns=int,
-                        _nelem=int, _wakeFact=float,
+                        _nelem=int, _wakeFact=float, FFTConvolution=bool,
+                        BunchPointCharge=bool,
                         NormFact=lambda v: _array(v, (3,)),
                         ZCuts=lambda v: _array(v),
                         _wakeDX=lambda v: _array(v),
@@ -21,7 +22,8 @@ class WakeElement(Collective, Element):
                         _wakeQX=lambda v: _array(v),
                         _wakeQY=lambda v: _array(v),
                         _wakeZ=lambda v: _array(v),
-                        _wakeT=lambda v: _array(v))
+                        _wakeT=lambda v: _array(v), _wakeStep=float,
+                        _historyhead=lambda v: _array(v, (1,)))
 
     def __init__(self, family_name: str, ring: Lattice, wake: Wake, **kwargs):
         """
@@ -37,6 +39,18 @@ class WakeElement(Collective, Element):
             NormFact (Tuple[float,...]):    Normalization for the 3 planes,
               to account for beta function at the observation point for
               example. Default: (1,1,1)
+            FFTConvolution (bool):  Compute the kicks by FFT convolution
+              on a uniform grid with the smallest step of the wake table,
+              instead of the direct summation over slice pairs. Faster
+              for large numbers of slices, at the cost of an interpolation
+              error. The direct summation is used if the grid is too
+              large. Default: :py:obj:`False`
+            BunchPointCharge (bool):  Sum the wake of each bunch on itself
+              over the pairs of slices, but represent the other bunches and
+              the previous turns by point charges at their centroid. The
+              cost of the slice sums then grows linearly with the number of
+              bunches. Valid for bunches short compared to the variation of
+              the wake at the bunch distance. Default: :py:obj:`False`
 """
         kwargs.setdefault('PassMethod', self.default_pass[True])
         zcuts = kwargs.pop('ZCuts', None)
@@ -45,6 +59,7 @@ class WakeElement(Collective, Element):
         self._nslice = kwargs.pop('Nslice', 101)
         self._nturns = kwargs.pop('Nturns', 1)
         self._turnhistory = None    # Defined here to avoid warning
+        self._historyhead = None
         self.clear_history()
         self.NormFact = kwargs.pop('NormFact', numpy.ones(3, order='F'))
         self._build(wake)
@@ -55,6 +70,10 @@ class WakeElement(Collective, Element):
     def _build(self, wake):
         self._wakeT = wake.srange
         self._nelem = len(self._wakeT)
+        if wake.step is not None:
+            self._wakeStep = wake.step
+        elif hasattr(self, '_wakeStep'):
+            del self._wakeStep
         if wake.Z is not None:
             self._wakeZ = wake.Z
         if wake.DX is not None:
@@ -75,6 +94,7 @@ class WakeElement(Collective, Element):
         else:
             tl = self._nturns*self._nslice*ring.nbunch
         self._turnhistory = numpy.zeros((tl, 4), order='F')
+        self._historyhead = numpy.zeros(1)
 
     def set_normfactxy(self, ring):
         l0, _, _ = ring.get_optics(ring)
@@ -132,8 +152,16 @@ class WakeElement(Collective, Element):
 
     @property
     def TurnHistory(self):
-        """Turn histroy of the slices center of mass"""
-        return self._turnhistory
+        """Turn history of the slices center of mass, from the oldest to
+        the current turn. The longitudinal positions are relative to the
+        turn where they were recorded"""
+        head = getattr(self, '_historyhead', None)
+        if head is None:
+            # Without head, the history is already shifted at each turn
+            return self._turnhistory
+        nslice = self._turnhistory.shape[0] // self._nturns
+        shift = (int(head[0]) + 1) * nslice
+        return numpy.roll(self._turnhistory, -shift, axis=0)
 
     def __repr__(self):
         """Simplified __repr__ to avoid errors due to arguments
@@ -3,7 +3,7 @@ Analytical wake functions
 """
 import numpy
 from at.constants import clight
-from scipy.interpolate import interp1d
+from scipy.signal import fftconvolve
 
 
 def convolve_wakefun(srange, w, sigs, gauss_sigma=10):
@@ -20,12 +20,11 @@ def convolve_wakefun(srange, w, sigs, gauss_sigma=10):
     s_gauss = numpy.arange(-gauss_sigma*sigs, gauss_sigma*sigs+1e-15, ds)
     gauss = _gauss(s_gauss)
 
-    conv = numpy.convolve(gauss, w, mode='full') * ds
+    conv = fftconvolve(gauss, w, mode='full') * ds
     s_offset = gauss_sigma * sigs - numpy.amin(srange)
     s_conv = numpy.arange(len(conv)) * ds - s_offset
 
-    ifun = interp1d(s_conv, conv, bounds_error=False, fill_value=0)
-    conv_wf = ifun(srange)
+    conv_wf = numpy.interp(srange, s_conv, conv, left=0.0, right=0.0)
     return conv_wf
 
 
@@ -4,12 +4,41 @@ Wake object creation
 import numpy
 import warnings
 from enum import Enum
-from scipy.interpolate import interp1d
+from functools import lru_cache
 from ..lattice import AtWarning, AtError
 from .wake_functions import long_resonator_wf, transverse_resonator_wf
 from .wake_functions import transverse_reswall_wf
 
 
+@lru_cache(maxsize=32)
+def _cached_table(func, sbytes, *args):
+    table = func(numpy.frombuffer(sbytes), *args)
+    table.flags.writeable = False
+    return table
+
+
+def _tabulate(func, srange, *args):
+    """Evaluate a wake function on srange, caching the recent tables so that
+    rebuilding a wake with the same parameters does not recompute it"""
+    srange = numpy.ascontiguousarray(srange, dtype=float)
+    try:
+        return _cached_table(func, srange.tobytes(), *args).copy()
+    except TypeError:   # Unhashable parameters
+        return func(srange, *args)
+
+
+def _uniform_step(srange):
+    """Step of a uniformly sampled srange, or :py:obj:`None`"""
+    srange = numpy.asarray(srange, dtype=float)
+    if len(srange) < 2:
+        return None
+    step = (srange[-1] - srange[0]) / (len(srange) - 1)
+    sref = srange[0] + step * numpy.arange(len(srange))
+    if step > 0 and numpy.allclose(srange, sref, rtol=0, atol=1.e-9*step):
+        return step
+    return None
+
+
 class WakeType(Enum):
     """Enum class for wake type"""
     FILE = 1        #: Import from file
@@ -40,6 +69,12 @@ class Wake(object):
     once initialized, all added component are resampled to the
     ``srange``.
 
+    If ``srange`` is uniformly sampled (see
+    :py:meth:`Wake.build_uniform_srange`), it is kept uniform and its
+    :py:attr:`step` is passed to the tracking, which then locates the
+    distances in the table without searching. The step must then resolve
+    the discontinuity of the wake functions at s=0.
+
     Parameters:
         srange:         vector of s position where to sample the wake
 
@@ -65,6 +100,7 @@ class Wake(object):
         assert len(srange) == len(numpy.unique(srange)), \
             "srange must contain unique values"            
         self._srange = srange
+        self._step = _uniform_step(srange)
         self.components = {WakeComponent.DX: None,
                            WakeComponent.DY: None,
                            WakeComponent.QX: None,
@@ -75,6 +111,11 @@ class Wake(object):
     def srange(self):
         return self._srange
 
+    @property
+    def step(self):
+        """Step of the uniform srange, :py:obj:`None` if not uniform"""
+        return self._step
+
     @property
     def DX(self):
         """Dipole X component"""
@@ -129,9 +170,7 @@ class Wake(object):
             warnings.warn(AtWarning('Input wake is smaller '
                                     'than desired Wake() range. '
                                     'Filling with zeros.\n'))
-        fint = interp1d(s, w, bounds_error=False, fill_value=0)
-        wint = fint(self._srange)
-        return wint
+        return numpy.interp(self._srange, s, w, left=0.0, right=0.0)
 
     def _readwakefile(self, filename, scol=0, wcol=1, sfact=1, wfact=1,
                       delimiter=None, skiprows=0):
@@ -141,6 +180,12 @@ class Wake(object):
         w *= wfact
         return self._resample(s, w)
 
+    def _add_origin(self):
+        # A uniform srange is kept as is, to preserve its step
+        if self._step is None:
+            self._srange = numpy.unique(numpy.concatenate(([0.0, 1e-24],
+                                                           self._srange)))
+
     def _resonator(self, wcomp, frequency, qfactor, rshunt, beta,
                    yokoya_factor=1):
         
@@ -153,17 +198,14 @@ class Wake(object):
 
         # It is needed to have a point at 0 and 1e-24 to sample properly
         # the discontinuity in the longitudinal plane
-
-        self._srange = numpy.unique(numpy.concatenate(([0.0, 1e-24],
-                                                        self._srange)))
+        self._add_origin()
 
         if wcomp is WakeComponent.Z:
-            return long_resonator_wf(self._srange, frequency,
-                                     qfactor, rshunt, beta)
+            return _tabulate(long_resonator_wf, self._srange, frequency,
+                             qfactor, rshunt, beta)
         elif isinstance(wcomp, WakeComponent):
-            return transverse_resonator_wf(self._srange, frequency,
-                                           qfactor, rshunt, yokoya_factor,
-                                           beta)
+            return _tabulate(transverse_resonator_wf, self._srange,
+                             frequency, qfactor, rshunt, yokoya_factor, beta)
         else:
             raise AtError('Invalid WakeComponent: {}'.format(wcomp))
 
@@ -179,15 +221,14 @@ class Wake(object):
         # It is needed to have a point at 0 and 1e-24 to sample properly
         # the discontinuity in the longitudinal plane (if combining with
         # longres)
-        self._srange = numpy.unique(numpy.concatenate(([0.0, 1e-24],
-                                                       self._srange)))
+        self._add_origin()
 
         if wcomp is WakeComponent.Z:
             raise AtError('Resitive wall not available '
                           'for WakeComponent: {}'.format(wcomp))
         elif isinstance(wcomp, WakeComponent):
-            return transverse_reswall_wf(self._srange, yokoya_factor,
-                                         length, rvac, conduct, beta)
+            return _tabulate(transverse_reswall_wf, self._srange,
+                             yokoya_factor, length, rvac, conduct, beta)
         else:
             raise AtError('Invalid WakeComponent: {}'.format(wcomp))
 
@@ -288,6 +329,25 @@ class Wake(object):
             wake.add(WakeType.RESWALL, wc, le, rv, co, beta, yokoya_factor=yk)
         return wake
 
+    @staticmethod
+    def build_uniform_srange(start: float, stop: float, step: float):
+        """Function to build a uniformly sampled wake table s column
+
+        The wake tables sampled on a uniform srange are interpolated
+        without searching the table during tracking.
+
+        Parameters:
+            start:          starting s-coordinate of the table
+            stop:           end of the table. The last point is the
+              first multiple of ``step`` reaching ``stop``
+            step:           step size
+
+        Returns:
+            srange:         vector of s position where to sample the wake
+        """
+        npts = int(numpy.ceil((stop - start) / step - 1.e-9)) + 1
+        return start + step * numpy.arange(npts)
+
     @staticmethod
     def build_srange(start: float, bunch_ext: float, short_step: float,
                      long_step: float,
@@ -14,12 +14,34 @@ drift = elements.Drift('drift', 1.0, PassMethod='pyDriftPass')
 
 To be noted:
 The particles are described by a 2 dimensional vector
-(6,num_particles)
+(6,num_particles). trackFunction is called once per element and per
+turn with all the particles, so it should operate on whole coordinate
+rows rather than loop on particles.
 In case a python passmethod and a c passmethod with the same name
 are found, the c passmethod is used
+
+Instead of trackFunction, the module may define trackFunctionAddress,
+the address of a compiled function with the C integrator signature:
+
+struct elem *trackFunction(const PyObject *ElemData, struct elem *Elem,
+                           double *r_in, int num_particles,
+                           struct parameters *Param)
+
+given as an integer (cffi, ctypes) or as an object with an "address"
+attribute (numba cfunc). The function is then called directly by the
+tracking engine, as a C integrator. As for C integrators, the returned
+pointer must be allocated by malloc, or be the input Elem.
 '''
 
 
+def _rotate(r, rot):
+    # Same summation order as the C integrators
+    out = rot[:, 0, numpy.newaxis] * r[0]
+    for j in range(1, 6):
+        out += rot[:, j, numpy.newaxis] * r[j]
+    r[:] = out
+
+
 def drift6(r, L):
     p_norm = 1/(1+r[4])
     NormL = L*p_norm
@@ -30,13 +52,17 @@ def drift6(r, L):
 
 def trackFunction(rin, elem=None):
     le = elem.Length
-    for rtmp in numpy.atleast_2d(rin.T):
-        if hasattr(elem, 'T1'):
-            rtmp += elem.T1
-        if hasattr(elem, 'R1'):
-            rtmp[:] = numpy.dot(elem.R1, rtmp)
-        drift6(rtmp, le)
-        if hasattr(elem, 'R2'):
-            rtmp[:] = numpy.dot(elem.R2, rtmp)
-        if hasattr(elem, 'T2'):
-            rtmp += elem.T2
+    r = rin.reshape((6, -1), order='F')
+    t1 = getattr(elem, 'T1', None)
+    r1 = getattr(elem, 'R1', None)
+    r2 = getattr(elem, 'R2', None)
+    t2 = getattr(elem, 'T2', None)
+    if t1 is not None:
+        r += t1[:, numpy.newaxis]
+    if r1 is not None:
+        _rotate(r, r1)
+    drift6(r, le)
+    if r2 is not None:
+        _rotate(r, r2)
+    if t2 is not None:
+        r += t2[:, numpy.newaxis]
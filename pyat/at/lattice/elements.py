@@ -7,6 +7,7 @@ responsibility to ensure that the appropriate attributes are present.
 """
 import abc
 import re
+import itertools
 import numpy
 from copy import copy, deepcopy
 from abc import ABC
@@ -27,6 +28,10 @@ def _nop(value):
     return value
 
 
+# Source of the modification stamps of elements
+_version_counter = itertools.count(1)
+
+
 class LongtMotion(ABC):
     """Abstract Base class for all Element classes whose instances may modify
     the particle momentum
@@ -237,6 +242,11 @@ class Collective(_DictLongtMotion):
 class Element(object):
     """Base class for AT elements"""
 
+    # _version is a modification stamp, kept out of the attribute dictionary.
+    # It changes each time an attribute is set or deleted, so that the
+    # tracking engine can detect the modified elements (atpass(update=True))
+    __slots__ = ('__dict__', '__weakref__', '_version')
+
     _BUILD_ATTRIBUTES = ['FamName']
     _conversions = dict(FamName=str, PassMethod=str, Length=float,
                         R1=_array66, R2=_array66,
@@ -276,6 +286,21 @@ class Element(object):
             exc.args = ('In element {0}, parameter {1}: {2}'.format(
                 self.FamName, key, exc),)
             raise
+        self.touch()
+
+    def __delattr__(self, key):
+        super(Element, self).__delattr__(key)
+        self.touch()
+
+    def touch(self) -> None:
+        """Mark the element as modified
+
+        Setting or deleting an attribute marks the element automatically.
+        :py:meth:`touch` is needed after modifying an array attribute in
+        place, so that tracking with ``keep_lattice=True, update=True``
+        initialises the element again.
+        """
+        object.__setattr__(self, '_version', next(_version_counter))
 
     def __str__(self):
         first3 = ['FamName', 'Length', 'PassMethod']
@@ -470,24 +495,53 @@ class Monitor(Element):
 
 class BeamMoments(Element):
     """Element to compute bunches mean and std"""
+    _conversions = dict(Element._conversions, MomentOrder=int)
 
     def __init__(self, family_name: str, **kwargs):
+        """
+        Args:
+            family_name:    Name of the element
+
+        Keyword Args:
+            MomentOrder (int):  Highest computed moment: 1 for the means
+              only, 2 for the means and standard deviations, 3 and 4 to
+              add the skewness and the excess kurtosis. Default: 2
+
+        Default PassMethod: ``BeamMomentsPass``
+        """
         kwargs.setdefault('PassMethod', 'BeamMomentsPass')
         self._stds = numpy.zeros((6, 1, 0), order='F')
         self._means = numpy.zeros((6, 1, 0), order='F')
+        self._skews = numpy.zeros((6, 1, 0), order='F')
+        self._kurts = numpy.zeros((6, 1, 0), order='F')
         super(BeamMoments, self).__init__(family_name, **kwargs)
 
     def set_buffers(self, nturns, nbunch):
+        order = getattr(self, 'MomentOrder', 2)
         self._stds = numpy.zeros((6, nbunch, nturns), order='F')
         self._means = numpy.zeros((6, nbunch, nturns), order='F')
-        
+        self._skews = numpy.zeros((6, nbunch, nturns if order >= 3 else 0),
+                                  order='F')
+        self._kurts = numpy.zeros((6, nbunch, nturns if order >= 4 else 0),
+                                  order='F')
+
     @property
     def stds(self):
         return self._stds
-        
+
     @property
     def means(self):
-        return self._means    
+        return self._means
+
+    @property
+    def skews(self):
+        """Skewness, with :code:`MomentOrder >= 3`"""
+        return self._skews
+
+    @property
+    def kurtosis(self):
+        """Excess kurtosis, with :code:`MomentOrder >= 4`"""
+        return self._kurts
 
 
 class Aperture(Element):
@@ -652,7 +706,8 @@ class Multipole(_Radiative, LongElement, ThinMultipole):
     """Multipole element"""
     _BUILD_ATTRIBUTES = LongElement._BUILD_ATTRIBUTES + ['PolynomA',
                                                          'PolynomB']
-    _conversions = dict(ThinMultipole._conversions, K=float, H=float)
+    _conversions = dict(ThinMultipole._conversions, K=float, H=float,
+                        IntegratorScheme=int)
 
     def __init__(self, family_name: str, length: float, poly_a, poly_b,
                  **kwargs):
@@ -668,6 +723,10 @@ class Multipole(_Radiative, LongElement, ThinMultipole):
               non-zero polynomial coefficients
             NumIntSteps: Number of integration steps (default: 10)
             KickAngle:  Correction deviation angles (H, V)
+            IntegratorScheme: Splitting scheme of ``StrMPoleSymplectic4Pass``:
+              4: 4th order Forest-Ruth (default), 6, 8: 6th, 8th order
+              Yoshida, 12-14: SABA\ :sub:`n` with n=2-4 kicks per step,
+              suited to weak multipoles
 
         Default PassMethod: ``StrMPoleSymplectic4Pass``
         """
@@ -16,6 +16,7 @@ class InsertionDeviceKickMap(Element):
     _BUILD_ATTRIBUTES = Element._BUILD_ATTRIBUTES + ['Nslice',
                                                      'Filename_in',
                                                      'Energy']
+    _conversions = dict(Element._conversions, InterpolationOrder=int)
 
     def readRadiaFieldMap(self, file_in_name):
         """
@@ -133,6 +134,12 @@ class InsertionDeviceKickMap(Element):
             Filename_in:    input filename
             Energy:         particle energy in GeV
 
+        Keyword Args:
+            InterpolationOrder (int):   1 for bilinear interpolation of the
+              kick maps, 3 for bicubic spline interpolation. The spline
+              coefficients are computed once when the lattice is cached.
+              Default: 1
+
         Default PassMethod: ``IdTablePass``
         """
         # 2023jan18 fix bug with element print
@@ -15,6 +15,7 @@ import sys
 import copy
 import numpy
 import math
+from operator import attrgetter
 from typing import Optional, Union, Tuple
 if sys.version_info.minor < 9:
     from typing import Callable, Iterable, Generator
@@ -36,6 +37,7 @@ from . import elements as elt
 from .elements import Element
 
 _TWO_PI_ERROR = 1.E-4
+_get_version = attrgetter('_version')
 Filter = Callable[..., Iterable[Element]]
 
 _DEFAULT_PASS = {
@@ -63,8 +65,8 @@ _DEFAULT_PASS = {
     )
 }
 
-__all__ = ['Lattice', 'type_filter', 'params_filter', 'lattice_filter',
-           'elem_generator', 'no_filter']
+__all__ = ['Lattice', 'LatticeColumns', 'type_filter', 'params_filter',
+           'lattice_filter', 'elem_generator', 'no_filter']
 
 # Don't warn on floating-pont errors
 numpy.seterr(divide='ignore', invalid='ignore')
@@ -473,17 +475,25 @@ class Lattice(list):
             reversed_list = list(reversed(self))
             self[:] = reversed_list
 
-    def develop(self) -> "Lattice":
+    def develop(self, copy: bool = True) -> "Lattice":
         """Develop a periodical lattice by repeating its elements
         *self.periodicity* times
 
-        The elements of the new lattice are deep copies ot the original
-        elements, so that they are all independent.
+        Parameters:
+            copy:   If :py:obj:`True`, the elements of the new lattice are
+              deep copies of the original elements, so that they are all
+              independent. Otherwise the cells share the original element
+              objects: modifying an element modifies it in all the cells,
+              and the tracking initialises each element only once.
 
         Returns:
             newlattice: The developed lattice
         """
-        elist = (el.deepcopy() for _ in range(self.periodicity) for el in self)
+        if copy:
+            elist = (el.deepcopy() for _ in range(self.periodicity)
+                     for el in self)
+        else:
+            elist = (el for _ in range(self.periodicity) for el in self)
         return Lattice(elem_generator, elist,
                        iterator=self.attrs_filter, periodicity=1,
                        harmonic_number=self.harmonic_number)
@@ -530,8 +540,8 @@ class Lattice(list):
         """Returns a deep copy of the lattice"""
         return copy.deepcopy(self)
 
-    def slice(self, size: Optional[float] = None, slices: Optional[int] = 1) \
-            -> "Lattice":
+    def slice(self, size: Optional[float] = None, slices: Optional[int] = 1,
+              share: bool = False) -> "Lattice":
         """Create a new lattice by slicing the range of interest into small
         elements
 
@@ -540,6 +550,12 @@ class Lattice(list):
               range and number of points: ``size = (s_max-s_min)/slices``.
             slices=1:       Number of slices in the specified range. Ignored if
               size is specified. Default: no slicing
+            share=False:    If :py:obj:`True`, the inner slices of an element,
+              which are identical, are a single element object repeated in
+              the new lattice. The memory and the initialisation of the
+              tracking then do not depend on the number of slices, but
+              modifying an inner slice modifies all of them. By default, all
+              the slices are distinct objects
 
         Returns:
             newring:    New Lattice object
@@ -550,8 +566,10 @@ class Lattice(list):
                 nslices = int(math.ceil(elem.Length / size))
                 if nslices > 1:
                     frac = numpy.ones(nslices) / nslices
-                    for el in elem.divide(frac):
-                        yield el
+                    parts = elem.divide(frac)
+                    if share and len(parts) > 2:
+                        parts[2:-1] = [parts[1]] * (len(parts) - 3)
+                    yield from parts
                 else:
                     yield elem
             yield from self[iend:]
@@ -580,6 +598,12 @@ class Lattice(list):
                 pass
         return elem_filter(params, *args)
 
+    @property
+    def columns(self) -> LatticeColumns:
+        """Columnar view of the element attributes, see
+        :py:class:`.LatticeColumns`"""
+        return LatticeColumns(self)
+
     @property
     def s_range(self) -> Union[None, tuple[float, float]]:
         """Range of interest: (s_min, s_max). :py:obj:`None` means
@@ -1310,6 +1334,113 @@ class Lattice(list):
         return Lattice(reduce_filter, self.select(kp | keep),
                        iterator=self.attrs_filter, **kwargs)
 
+    def compile(self, keep: Refpts = None, **kwargs) -> "Lattice":
+        """Build a lattice with the same tracking results but fewer elements
+
+        * zero-length elements with an ``IdentityPass`` PassMethod are
+          removed,
+        * consecutive ``DriftPass`` elements are merged into a single drift,
+        * consecutive zero-length ``AperturePass`` elements are merged into
+          a single :py:class:`.Aperture` with the intersection of their
+          limits,
+        * consecutive ``Matrix66Pass`` and ``IdentityPass`` elements are
+          fused into a single :py:class:`.M66` element. Their ``T1``, ``R1``,
+          ``R2`` and ``T2`` attributes are folded into the resulting transfer
+          matrix and exit translation.
+
+        Elements with apertures or misalignments are kept unchanged, except
+        ``Matrix66Pass`` elements which ignore apertures. Contrary to
+        :py:meth:`reduce`, drifts and magnets are not replaced by matrices
+        since their tracking is nonlinear in the momentum deviation. The
+        total length is preserved.
+
+        Parameters:
+            keep:   Elements kept unchanged and never merged with their
+              neighbours. Their entrance and exit are available as reference
+              points in the compiled lattice. Default: :py:obj:`None`
+        """
+        misalign = ('T1', 'T2', 'R1', 'R2')
+        apertures = ('RApertures', 'EApertures')
+
+        def kind(elem, kp):
+            if kp:
+                return None
+            pm = elem.PassMethod
+            if pm == 'Matrix66Pass':
+                return 'linear'
+            if any(hasattr(elem, a) for a in misalign + apertures):
+                return None
+            if pm == 'IdentityPass':
+                return 'linear' if elem.Length != 0.0 else 'skip'
+            if pm == 'DriftPass':
+                return 'drift'
+            if pm == 'AperturePass' and elem.Length == 0.0:
+                return 'aperture'
+            return None
+
+        def affine(elem):
+            # Matrix66Pass: r -> R2.M.R1.(r + T1) + T2
+            m = getattr(elem, 'M66', numpy.identity(6))
+            for rot in ('R1', 'R2'):
+                r = getattr(elem, rot, None)
+                if r is not None:
+                    m = m @ r if rot == 'R1' else r @ m
+            b = m @ getattr(elem, 'T1', numpy.zeros(6))
+            b = b + getattr(elem, 'T2', numpy.zeros(6))
+            return m, b
+
+        def fuse(knd, run):
+            if len(run) == 1:
+                return run[0]
+            length = sum(el.Length for el in run)
+            if knd == 'drift':
+                elem = run[0].copy()
+                elem.Length = length
+                return elem
+            if knd == 'aperture':
+                limits = numpy.stack([el.Limits for el in run])
+                elem = run[0].copy()
+                elem.Limits = numpy.concatenate(
+                    (numpy.max(limits[:, 0::2], axis=0),
+                     numpy.min(limits[:, 1::2], axis=0)))[[0, 2, 1, 3]]
+                return elem
+            if all(el.PassMethod == 'IdentityPass' for el in run):
+                elem = run[0].copy()
+                elem.Length = length
+                return elem
+            mat = numpy.identity(6)
+            vec = numpy.zeros(6)
+            for el in run:
+                m, b = affine(el)
+                mat = m @ mat
+                vec = m @ vec + b
+            elem = elt.M66(run[0].FamName, m66=mat, Length=length)
+            if numpy.any(vec != 0.0):
+                elem.T2 = vec
+            return elem
+
+        def compile_filter(_, itelem):
+            run = []
+            knd = None
+            for elem, kp in itelem:
+                k = kind(elem, kp)
+                if k == 'skip':
+                    continue
+                if run and k != knd:
+                    yield fuse(knd, run)
+                    run = []
+                if k is None:
+                    yield elem
+                else:
+                    run.append(elem)
+                knd = k
+            if run:
+                yield fuse(knd, run)
+
+        kp = get_bool_index(self, keep)
+        return Lattice(compile_filter, zip(self, kp),
+                       iterator=self.attrs_filter, **kwargs)
+
     def replace(self, refpts: Refpts, **kwargs) -> "Lattice":
         """Return a shallow copy of the lattice replacing the selected
         elements by a deep copy
@@ -1374,6 +1505,124 @@ class Lattice(list):
             return radiate
 
 
+class LatticeColumns(object):
+    """Columnar view of the element attributes of a :py:class:`.Lattice`
+
+    The attribute values of all the elements are gathered in numpy arrays,
+    which are cached and rebuilt only when the lattice changes. The change
+    detection relies on the modification stamps of the elements: setting or
+    deleting an attribute, replacing, inserting, removing or moving an
+    element invalidates the cached arrays. Modifying an array attribute in
+    place must be signalled by :py:meth:`.Element.touch`.
+
+    The returned arrays are read-only: use
+    :py:meth:`~.Lattice.set_value_refpts` to modify the elements.
+
+    Example:
+        >>> ring.columns.s_pos             # same as ring.get_s_pos(at.All)
+        >>> ring.columns.get('Length', 0.0)[refpts]
+        >>> names, codes = ring.columns.categories('PassMethod')
+    """
+    def __init__(self, ring: Lattice):
+        self._ring = ring
+
+    @property
+    def versions(self) -> numpy.ndarray:
+        """Modification stamps of the elements"""
+        return numpy.fromiter(map(_get_version, self._ring), dtype=numpy.int64,
+                              count=len(self._ring))
+
+    def _cached(self, key, func):
+        # noinspection PyProtectedMember
+        cache = self._ring.__dict__.setdefault('_column_cache', {})
+        versions = self.versions
+        if not numpy.array_equal(cache.get(None), versions):
+            cache.clear()
+            cache[None] = versions
+        try:
+            return cache[key]
+        except KeyError:
+            value = func()
+            for v in (value if isinstance(value, tuple) else (value,)):
+                if isinstance(v, numpy.ndarray):
+                    v.flags.writeable = False
+            cache[key] = value
+            return value
+
+    def mask(self, attrname: str) -> numpy.ndarray:
+        """(nelems,) boolean array: elements having the attribute"""
+        def build():
+            return numpy.fromiter((hasattr(el, attrname) for el in self._ring),
+                                  dtype=bool, count=len(self._ring))
+        return self._cached(('mask', attrname), build)
+
+    def instances(self, cls) -> numpy.ndarray:
+        """(nelems,) boolean array: elements of class *cls* or a subclass"""
+        def build():
+            return numpy.fromiter((isinstance(el, cls) for el in self._ring),
+                                  dtype=bool, count=len(self._ring))
+        return self._cached(('instances', cls), build)
+
+    def get(self, attrname: str, default: float = numpy.nan) \
+            -> numpy.ndarray:
+        """Values of a numeric attribute for all the elements
+
+        Parameters:
+            attrname:   Attribute name
+            default:    Value for the elements without this attribute. For
+              array attributes, it is also used for padding the shorter
+              arrays
+
+        Returns:
+            values (ndarray):   (nelems,) array for scalar attributes,
+              (nelems, n) array for vector attributes
+        """
+        def build():
+            values = [getattr(el, attrname, None) for el in self._ring]
+            sizes = [numpy.size(v) for v in values if v is not None]
+            if all(numpy.ndim(v) == 0 for v in values if v is not None):
+                return numpy.array([default if v is None else v
+                                    for v in values], dtype=float)
+            col = numpy.full((len(values), max(sizes)), default, dtype=float)
+            for i, v in enumerate(values):
+                if v is not None:
+                    v = numpy.ravel(v)
+                    col[i, :len(v)] = v
+            return col
+        return self._cached(('get', attrname, default), build)
+
+    def categories(self, attrname: str) -> Tuple[list, numpy.ndarray]:
+        """Coded values of a string attribute
+
+        Returns:
+            values (list):      Unique values of the attribute
+            codes (ndarray):    (nelems,) array of indices in *values*,
+              -1 for the elements without this attribute
+        """
+        def build():
+            table = {}
+            codes = numpy.fromiter(
+                (-1 if v is None else table.setdefault(v, len(table))
+                 for v in (getattr(el, attrname, None) for el in self._ring)),
+                dtype=numpy.int32, count=len(self._ring))
+            return list(table), codes
+        return self._cached(('categories', attrname), build)
+
+    @property
+    def s_pos(self) -> numpy.ndarray:
+        """(nelems+1,) array of positions at the entrance of each element
+        and at the end of the lattice"""
+        def build():
+            return numpy.concatenate(([0.0],
+                                      numpy.cumsum(self.get('Length', 0.0))))
+        return self._cached('s_pos', build)
+
+    @property
+    def passmethods(self) -> Tuple[list, numpy.ndarray]:
+        """Unique pass methods and pass method codes of the elements"""
+        return self.categories('PassMethod')
+
+
 def lattice_filter(params, lattice):
     """Copy lattice parameters and run through all lattice elements
 
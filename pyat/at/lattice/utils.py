@@ -799,6 +799,7 @@ def set_value_refpts(ring: Sequence[Element], refpts: Refpts,
     else:
         def setf(elem, value):
             getattr(elem, attrname)[index] = value
+            elem.touch()
 
     if increment:
         attrvalues += get_value_refpts(ring, refpts,
@@ -836,10 +837,14 @@ def get_s_pos(ring: Sequence[Element], refpts: Refpts = All) \
 
         Position at the end of the last element: length of the lattice
         """
-    # Positions at the end of each element.
-    s_pos = numpy.cumsum([getattr(el, 'Length', 0.0) for el in ring])
-    # Prepend position at the start of the first element.
-    s_pos = numpy.concatenate(([0.0], s_pos))
+    try:
+        # Cached positions of a Lattice
+        s_pos = ring.columns.s_pos
+    except AttributeError:
+        # Positions at the end of each element.
+        s_pos = numpy.cumsum([getattr(el, 'Length', 0.0) for el in ring])
+        # Prepend position at the start of the first element.
+        s_pos = numpy.concatenate(([0.0], s_pos))
     return s_pos[get_bool_index(ring, refpts)]
 
 
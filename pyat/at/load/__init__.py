@@ -2,9 +2,11 @@
 Import/export AT lattice from/to different formats:
 - .mat files
 - .m files
+- .atb binary files
 """
 from .allfiles import *
 from .matfile import *
 from .reprfile import *
+from .binfile import *
 from .tracy import *
 from .elegant import *
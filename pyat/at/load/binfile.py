@@ -0,0 +1,338 @@
+"""Compact binary format for python AT lattices
+
+The element attributes are stored by columns: all the values of an attribute
+sharing the same type and shape are packed in a single array, together with
+the indices of the elements holding them. Strings are stored as indices in a
+table of unique values. The file is memory-mapped when loading, and the
+elements are built without going through their constructor, so that large
+lattices load quickly.
+"""
+import json
+from collections.abc import Sequence
+from os.path import abspath
+import numpy
+from at.lattice import Lattice, Element, Particle, AtError
+from at.lattice import CLASS_MAP
+from at.load import register_format
+from at.load.utils import element_from_dict
+
+__all__ = ['load_bin', 'save_bin', 'BinFile']
+
+_MAGIC = b'PYATBIN1'
+_ALIGN = 64
+_VERSION = 1
+# Namespace for evaluating the attributes stored by their repr string
+_eval_globals = {'array': numpy.array, 'uint8': numpy.uint8, 'nan': numpy.nan,
+                 'inf': numpy.inf, 'numpy': numpy, 'np': numpy,
+                 'Particle': Particle}
+_scalar_types = {'bool': bool, 'int': int, 'float': float}
+
+
+def _padded(n):
+    return -(-n // _ALIGN) * _ALIGN
+
+
+def _kind(value):
+    """Storage kind, dtype and shape of an attribute value"""
+    if isinstance(value, (bool, numpy.bool_)):
+        return 'bool', numpy.dtype(bool), ()
+    elif isinstance(value, (int, numpy.integer)):
+        if -2**63 <= value < 2**63:
+            return 'int', numpy.dtype(numpy.int64), ()
+    elif isinstance(value, (float, numpy.floating)):
+        return 'float', numpy.dtype(numpy.float64), ()
+    elif isinstance(value, str):
+        return 'str', None, ()
+    elif isinstance(value, numpy.ndarray) and value.dtype.kind in 'biufc':
+        return 'array', value.dtype, value.shape
+    return 'repr', None, ()
+
+
+def _find_class(name):
+    def subclasses(cls):
+        for sub in cls.__subclasses__():
+            yield sub
+            yield from subclasses(sub)
+
+    cls = CLASS_MAP.get(name)
+    if cls is None:
+        cls = next((c for c in subclasses(Element) if c.__name__ == name),
+                   None)
+    return cls
+
+
+def _make_element(cls, cls_name, attrs):
+    """Build an element from its stored attributes, bypassing the
+    constructor: the attributes were already converted when saved"""
+    if cls is None:
+        return element_from_dict(dict(attrs, Class=cls_name), check=False,
+                                 quiet=True)
+    elem = cls.__new__(cls)
+    elem.__dict__.update(attrs)
+    elem.touch()
+    return elem
+
+
+def save_bin(ring: Lattice, filename: str) -> None:
+    """Save a :py:class:`.Lattice` as a binary file
+
+    Parameters:
+        ring:           Lattice description
+        filename:       Name of the '.atb' file
+
+    See Also:
+        :py:func:`.save_lattice` for a generic lattice-saving function.
+    """
+    classes = {}
+    class_codes = numpy.empty(len(ring), dtype=numpy.int32)
+    groups = {}
+    for i, elem in enumerate(ring):
+        class_codes[i] = classes.setdefault(type(elem).__name__, len(classes))
+        for key, value in vars(elem).items():
+            kind, dtype, shape = _kind(value)
+            grp = (key, kind, '' if dtype is None else dtype.str, shape)
+            index, values = groups.setdefault(grp, ([], []))
+            index.append(i)
+            values.append(value)
+
+    blocks = []
+    descr = []
+
+    def add_block(arr):
+        arr = numpy.ascontiguousarray(arr)
+        offset = _padded(blocks[-1][0] + blocks[-1][1].nbytes) if blocks \
+            else 0
+        blocks.append((offset, arr))
+        descr.append(dict(offset=offset, dtype=arr.dtype.str,
+                          shape=list(arr.shape)))
+        return len(descr) - 1
+
+    # Full precision for the attributes stored by their repr
+    opts = numpy.get_printoptions()
+    numpy.set_printoptions(formatter={'float_kind': repr})
+    try:
+        columns = []
+        for (key, kind, dtstr, shape), (index, values) in groups.items():
+            col = dict(name=key, kind=kind, shape=list(shape),
+                       index=add_block(numpy.array(index, dtype=numpy.int32)))
+            if kind in _scalar_types:
+                col['data'] = add_block(numpy.array(values, dtype=dtstr))
+            elif kind == 'array':
+                col['data'] = add_block(numpy.stack(
+                    [numpy.ravel(v, order='F') for v in values]))
+            elif kind == 'str':
+                strings, codes = numpy.unique(values, return_inverse=True)
+                col['values'] = strings.tolist()
+                col['data'] = add_block(codes.astype(numpy.int32))
+            else:
+                col['values'] = [repr(v) for v in values]
+            columns.append(col)
+        header = dict(version=_VERSION, attrs=repr(ring.attrs),
+                      nelems=len(ring), classes=list(classes),
+                      class_codes=add_block(class_codes),
+                      blocks=descr, columns=columns)
+    finally:
+        numpy.set_printoptions(**opts)
+
+    hbytes = json.dumps(header).encode()
+    start = _padded(len(_MAGIC) + 8 + len(hbytes))
+    with open(filename, 'wb') as f:
+        f.write(_MAGIC)
+        f.write(numpy.array(len(hbytes), dtype='<u8').tobytes())
+        f.write(hbytes)
+        for offset, arr in blocks:
+            f.write(b'\0' * (start + offset - f.tell()))
+            f.write(arr.tobytes())
+
+
+class BinFile(Sequence):
+    """Memory-mapped binary lattice file
+
+    The elements are built on first access, and are then kept. The
+    attribute values are views on the memory-mapped file, opened in
+    copy-on-write mode: modifying them does not modify the file.
+
+    Parameters:
+        filename:       Name of the '.atb' file
+
+    Example:
+        >>> bf = BinFile('machine.atb')
+        >>> lengths = bf.values('Length')   # No element built
+        >>> quad = bf[42]                   # Builds a single element
+        >>> ring = bf.lattice()             # Builds all the elements
+    """
+    def __init__(self, filename: str):
+        fmap = numpy.memmap(filename, dtype=numpy.uint8, mode='c')
+        if bytes(fmap[:len(_MAGIC)]) != _MAGIC:
+            raise AtError('{0} is not an AT binary lattice'.format(filename))
+        hstart = len(_MAGIC) + 8
+        hlen = int(fmap[len(_MAGIC):hstart].view('<u8')[0])
+        header = json.loads(bytes(fmap[hstart:hstart+hlen]))
+        if header['version'] > _VERSION:
+            raise AtError('{0}: unsupported file version {1}'.format(
+                filename, header['version']))
+        self.filename = filename
+        self._fmap = fmap
+        self._start = _padded(hstart + hlen)
+        self._blocks = header['blocks']
+        self._nelems = header['nelems']
+        self._attrs = header['attrs']
+        self._classes = [(name, _find_class(name))
+                         for name in header['classes']]
+        self._class_codes = self._block(header['class_codes'])
+        self._columns = header['columns']
+        self._elems = [None] * self._nelems
+        self._positions = None
+
+    def _block(self, iblock):
+        bl = self._blocks[iblock]
+        dtype = numpy.dtype(bl['dtype'])
+        start = self._start + bl['offset']
+        nbytes = dtype.itemsize * int(numpy.prod(bl['shape']))
+        data = self._fmap[start:start + nbytes].view(numpy.ndarray)
+        return data.view(dtype).reshape(bl['shape'])
+
+    def _column_values(self, col):
+        """List of the values in a column"""
+        kind = col['kind']
+        if kind in _scalar_types:
+            return self._block(col['data']).tolist()
+        elif kind == 'array':
+            shape = tuple(col['shape'])
+            return [row.reshape(shape, order='F')
+                    for row in self._block(col['data'])]
+        elif kind == 'str':
+            strings = col['values']
+            return [strings[c] for c in self._block(col['data']).tolist()]
+        else:
+            return [eval(v, _eval_globals) for v in col['values']]
+
+    def _column_value(self, col, pos):
+        kind = col['kind']
+        if kind == 'array':
+            row = self._block(col['data'])[pos]
+            return row.reshape(tuple(col['shape']), order='F')
+        elif kind == 'str':
+            return col['values'][int(self._block(col['data'])[pos])]
+        elif kind == 'repr':
+            return eval(col['values'][pos], _eval_globals)
+        else:
+            return _scalar_types[kind](self._block(col['data'])[pos])
+
+    def __len__(self):
+        return self._nelems
+
+    def __getitem__(self, index):
+        if isinstance(index, slice):
+            return [self[i] for i in range(*index.indices(self._nelems))]
+        index = range(self._nelems)[index]
+        elem = self._elems[index]
+        if elem is None:
+            if self._positions is None:
+                # Position of each element in each column
+                self._positions = []
+                for col in self._columns:
+                    pos = numpy.full(self._nelems, -1, dtype=numpy.int32)
+                    idx = self._block(col['index'])
+                    pos[idx] = numpy.arange(len(idx))
+                    self._positions.append(pos)
+            attrs = {}
+            for col, pos in zip(self._columns, self._positions):
+                p = int(pos[index])
+                if p >= 0:
+                    attrs[col['name']] = self._column_value(col, p)
+            elem = self._build(index, attrs)
+        return elem
+
+    def __iter__(self):
+        if any(elem is None for elem in self._elems):
+            # Sweep once over the columns instead of building elements
+            # one by one
+            attrs = [{} for _ in range(self._nelems)]
+            for col in self._columns:
+                name = col['name']
+                idx = self._block(col['index']).tolist()
+                for i, v in zip(idx, self._column_values(col)):
+                    attrs[i][name] = v
+            for index, elem in enumerate(self._elems):
+                if elem is None:
+                    self._build(index, attrs[index])
+        return iter(self._elems)
+
+    def _build(self, index, attrs):
+        cls_name, cls = self._classes[self._class_codes[index]]
+        elem = _make_element(cls, cls_name, attrs)
+        self._elems[index] = elem
+        return elem
+
+    @property
+    def attrs(self) -> dict:
+        """Dictionary of lattice attributes"""
+        return eval(self._attrs, _eval_globals)
+
+    def values(self, attrname: str, default=numpy.nan) -> numpy.ndarray:
+        """Values of a scalar attribute for all the elements, without
+        building the elements
+
+        Parameters:
+            attrname:   Attribute name
+            default:    Value for the elements without this attribute
+
+        Returns:
+            values (ndarray):   (nelems,) array of attribute values
+        """
+        values = numpy.full(self._nelems, default)
+        for col in self._columns:
+            if col['name'] == attrname:
+                if col['kind'] not in _scalar_types:
+                    raise AtError('{0} is not a scalar attribute'.format(
+                        attrname))
+                values[self._block(col['index'])] = self._block(col['data'])
+        return values
+
+    def lattice(self, **kwargs) -> Lattice:
+        """Build the :py:class:`.Lattice`
+
+        Keyword Args:
+            *:      Lattice attributes, overriding the stored ones
+
+        Returns:
+            lattice (Lattice):  New :py:class:`.Lattice` object
+        """
+        def elem_iterator(params, binfile):
+            for k, v in binfile.attrs.items():
+                params.setdefault(k, v)
+            return iter(binfile)
+
+        return Lattice(self, iterator=elem_iterator, **kwargs)
+
+
+def load_bin(filename: str, **kwargs) -> Lattice:
+    """Create a :py:class:`.Lattice` from a binary file
+
+    Parameters:
+        filename:           Name of a '.atb' file
+
+    Keyword Args:
+        name (str):         Name of the lattice. Default: taken from
+          the file
+        energy (float):     Energy of the lattice [eV]. Default: taken
+          from the file
+        periodicity(int):   Number of periods. Default: taken from the
+          file
+        *:                  All other keywords will be set as Lattice
+          attributes
+
+    Returns:
+        lattice (Lattice):  New :py:class:`.Lattice` object
+
+    See Also:
+        :py:class:`BinFile` for accessing the file without building all
+        the elements, :py:func:`.load_lattice` for a generic
+        lattice-loading function.
+    """
+    return BinFile(abspath(filename)).lattice(**kwargs)
+
+
+register_format('.atb', load_bin, save_bin,
+                descr='Binary memory-mapped python AT lattice')
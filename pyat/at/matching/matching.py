@@ -2,6 +2,7 @@
 Classes for matching variables and constraints
 """
 from itertools import chain
+import multiprocessing
 import numpy as np
 from typing import Optional, Sequence, Callable, Tuple, Union
 from scipy.optimize import least_squares
@@ -115,6 +116,7 @@ class ElementVariable(Variable):
         else:
             def setf(elem, attrname, value):
                 getattr(elem, attrname)[index] = value
+                elem.touch()
 
             def getf(elem, attrname):
                 return getattr(elem, attrname)[index]
@@ -634,11 +636,45 @@ class EnvelopeConstraints(ElementConstraints):
         return (em[ref[self.refpts]] for ref in self.refs), (beamdata,)
 
 
+# Worker processes: problem inherited or received at the pool creation
+_worker_problem = None
+
+
+def _residuals(ring, vals, variables, constraints):
+    """Set the variables and evaluate all the constraints"""
+    for value, variable in zip(vals, variables):
+        variable.set(ring, value)
+    c = [cons.evaluate(ring) for cons in constraints]
+    return np.concatenate(c, axis=None)
+
+
+def _init_worker(ring, variables, constraints):
+    global _worker_problem
+    _worker_problem = (ring, variables, constraints)
+
+
+def _worker_residuals(vals):
+    """Single job: residuals for one set of variable values"""
+    ring, variables, constraints = _worker_problem
+    return _residuals(ring, vals, variables, constraints)
+
+
+def _steps(x0, ubound, diff_step):
+    """Forward-difference steps, as in least_squares "2-point" scheme"""
+    sign = np.where(x0 >= 0, 1.0, -1.0)
+    h = diff_step * sign * np.maximum(1.0, np.abs(x0))
+    # Step backwards when the upper bound would be exceeded
+    h = np.where(x0 + h > ubound, -h, h)
+    # Exact representation of the step
+    return (x0 + h) - x0
+
+
 def match(ring: Lattice, variables: Sequence[Variable],
           constraints: Sequence[Constraints], verbose: int = 2,
           max_nfev: int = 1000,
           diff_step: float = 1.0e-10,
-          method=None, copy: bool = True):
+          method=None, copy: bool = True, workers: int = 1,
+          start_method: Optional[str] = None):
     """Perform matching of constraints by varying variables
 
     Parameters:
@@ -650,13 +686,33 @@ def match(ring: Lattice, variables: Sequence[Variable],
         diff_step:          Convergence threshold
         method:
         copy:
+        workers:            Number of processes evaluating the columns of
+          the Jacobian. With *workers* > 1, each process keeps its own copy
+          of the lattice and computes the constraints for a subset of the
+          variable steps, so that a Jacobian costs about
+          nvariables / workers evaluations instead of nvariables.
+          Default: 1: the Jacobian is computed serially by
+          :py:func:`~scipy.optimize.least_squares`
+        start_method:       python multiprocessing start method. With
+          ``'fork'``, the lattice, variables and constraints are inherited
+          by the worker processes, otherwise they must be picklable, which
+          excludes the constraints defined by local functions.
+          Default: ``'fork'`` if available, otherwise the python default
     """
     def fun(vals):
-        for value, variable in zip(vals, variables):
-            variable.set(ring1, value)
-
-        c = [cons.evaluate(ring1) for cons in constraints]
-        return np.concatenate(c, axis=None)
+        f = _residuals(ring1, vals, variables, constraints)
+        last[:] = [np.array(vals), f]
+        return f
+
+    def jac(vals):
+        x0 = np.array(vals)
+        if np.array_equal(x0, last[0]):
+            f0 = last[1]
+        else:
+            f0 = fun(x0)
+        h = _steps(x0, bounds[1], diff_step)
+        fs = pool.map(_worker_residuals, list(x0 + np.diag(h)))
+        return np.stack([(f - f0) / hi for f, hi in zip(fs, h)], axis=1)
 
     if copy:
         # Make a shallow copy of ring
@@ -688,8 +744,22 @@ def match(ring: Lattice, variables: Sequence[Variable],
         print('\n{} constraints, {} variables, using method {}\n'.
               format(ntargets, len(variables), method))
 
-    least_squares(fun, vini, bounds=bounds, verbose=verbose, max_nfev=max_nfev,
-                  method=method, diff_step=diff_step)
+    last = [None, None]
+    if workers > 1:
+        if start_method is None and \
+                'fork' in multiprocessing.get_all_start_methods():
+            start_method = 'fork'
+        ctx = multiprocessing.get_context(start_method)
+        with ctx.Pool(workers, initializer=_init_worker,
+                      initargs=(ring1, variables, constraints)) as pool:
+            result = least_squares(fun, vini, jac=jac, bounds=bounds,
+                                   verbose=verbose, max_nfev=max_nfev,
+                                   method=method)
+        # Leave the lattice at the solution
+        _residuals(ring1, result.x, variables, constraints)
+    else:
+        least_squares(fun, vini, bounds=bounds, verbose=verbose,
+                      max_nfev=max_nfev, method=method, diff_step=diff_step)
 
     if verbose >= 1:
         print(Constraints.header())
@@ -10,10 +10,14 @@ from .revolution import *
 from .harmonic_analysis import *
 from .orbit import *
 from .matrix import *
+from .response import *
 from .linear import *
-from .diffmatrix import find_mpole_raddiff_matrix
+from .diffmatrix import find_mpole_raddiff_matrix, find_cumul_raddiff_matrices
+from .nafflib import naff
+from .rdtelegant import drivingterms
 from .radiation import *
 from .ring_parameters import *
 from .nonlinear import *
 from .fastring import *
-from .frequency_maps import fmap_parallel_track
+from .longitudinal import *
+from .frequency_maps import fmap_parallel_track, fmap_adaptive_track
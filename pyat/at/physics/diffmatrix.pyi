@@ -1,9 +1,12 @@
 """Stub file for the 'diffmatrix' extension"""
 
 import numpy as np
-from typing import Optional
+from typing import Optional, Sequence
 from at.lattice import Element
 from . import Orbit
 
 def find_mpole_raddiff_matrix(element: Element, orbit: Orbit,
-                              energy: Optional[float] = None) -> np.ndarray: ...
\ No newline at end of file
+                              energy: Optional[float] = None) -> np.ndarray: ...
+def find_cumul_raddiff_matrices(line: Sequence[Element], orbits: np.ndarray,
+                                m66: np.ndarray,
+                                energy: float) -> np.ndarray: ...
@@ -6,6 +6,8 @@ and pyat parallel tracking (patpass)
 # orblancog
 # generates the frequency and diffusion map for a given ring
 # 2023jan16 tracking is parallel (patpass), frequency analysis is serial
+# the whole grid is tracked at once, frequency analysis is vectorised,
+#     fmap_adaptive_track refines the grid where needed
 # 2022jun07 serial version
 
 from at.tracking import patpass
@@ -15,7 +17,56 @@ import numpy
 # Jaime Coello de Portugal (JCdP) frequency analysis implementation
 from .harmonic_analysis import get_tunes_harmonic
 
-__all__ = ['fmap_parallel_track']
+__all__ = ['fmap_parallel_track', 'fmap_adaptive_track']
+
+
+def _fmap_points(ring, xy, tns, orbit, add_offset6D, ncpu, lossmap=False):
+    """Track the (npoints, 2) offsets xy [mm] over 2*tns turns in a single
+    parallel run, and compute the tunes in the first and last tns turns.
+
+    Returns a (2, 2, npoints) array of tunes [half, plane, point], NaN for
+    the lost particles
+    """
+    npoints = len(xy)
+    z0 = numpy.zeros((npoints, 6))  # transposed, and C-aligned
+    z0 = z0 + add_offset6D + orbit
+    # add 1 nm to tracking to avoid zeros in array for the ideal lattice
+    z0[:, 0] = z0[:, 0] + 1.0e-3*xy[:, 0] + 1e-9
+    z0[:, 2] = z0[:, 2] + 1.0e-3*xy[:, 1] + 1e-9
+    # z0.T is Fortran-aligned
+    if lossmap:
+        # patpass output changes when losses flag is true
+        zout, dictloss = patpass(ring, z0.T, 2*tns, pool_size=ncpu,
+                                 losses=True)
+    else:
+        zout = patpass(ring, z0.T, 2*tns, pool_size=ncpu)
+        dictloss = None
+    zout = zout[:, :, 0, :]
+    alive = ~numpy.any(numpy.isnan(zout), axis=(0, 2))
+    tunes = numpy.full((2, 2, npoints), numpy.nan)
+    if numpy.any(alive):
+        # [half, plane, particle, turn]
+        z1 = zout[[0, 2]][:, alive]
+        sig = numpy.stack((z1[..., :tns], z1[..., tns:2*tns]))
+        sig = sig - numpy.mean(sig, axis=-1, keepdims=True)
+        nutab = get_tunes_harmonic(sig.reshape(-1, tns), num_harmonics=1,
+                                   pool_size=ncpu)
+        tunes[..., alive] = nutab.reshape(2, 2, -1)
+    return tunes, dictloss
+
+
+def _fmap_results(xy, tunes, tns):
+    """Build the 7 columns [xcoor, ycoor, nux, ny, dnux, dnuy, nudiff] for
+    the points with defined frequencies"""
+    valid = numpy.all(numpy.isfinite(tunes), axis=(0, 1))
+    nux, nuy = tunes[0][:, valid]
+    xdiff, ydiff = tunes[1][:, valid] - tunes[0][:, valid]
+    # metric, limited to [-10, -2]
+    with numpy.errstate(divide='ignore'):
+        nudiff = 0.5*numpy.log10((xdiff*xdiff + ydiff*ydiff)/tns)
+    nudiff = numpy.clip(nudiff, -10, -2)
+    return numpy.stack((xy[valid, 0], xy[valid, 1], nux, nuy,
+                        xdiff, ydiff, nudiff), axis=1)
 
 
 def fmap_parallel_track(ring,
@@ -45,11 +96,9 @@ def fmap_parallel_track(ring,
     The transverse offsets are given inside a rectangular coordinate window
         coords=[xmin,xmax,ymin,ymax]
     in millimeters, where the window is divided in n steps=[xsteps,ysteps].
-    For each yoffset, particle tracking over the whole set of xoffsets is done
-    in parallel, therefore, a number of cpus (ncpu) above the number of xsteps
-    will not reduce the calculation time.
-
-    The frequency analysis uses a library that is not parallelized.
+    All the particles of the window are tracked in parallel in a single
+    run over 2*tns turns, and the frequency analysis of all the particles
+    is done at once, shared between ncpu threads.
 
     The closed orbit (orbit) is calculated and added to the
     initial particle offset of every particle, otherwise, one could set
@@ -57,7 +106,7 @@ def fmap_parallel_track(ring,
     Additionally, a numpy array (add_offset6D) with 6 values could be used to
     arbitrarily offset the initial coordinates of every particle.
 
-    A dictionary with particle losses is saved for every vertical offset.
+    A dictionary with particle losses is saved for the whole window.
     See the patpass documentation.
 
     Parameters :
@@ -79,7 +128,7 @@ def fmap_parallel_track(ring,
                         log10(sqrt(sum(dnu**2)/turns)) ]
         loss_map_array : experimental format.
                     if loss_map is True, it returns the losses dictionary
-                    provided by patpass per every vertical offset.
+                    provided by patpass for the whole window.
                     if loss_map is False, it returs a one-element list.
 
     WARNING : points with NaN tracking results or non-defined frequency
@@ -100,17 +149,11 @@ def fmap_parallel_track(ring,
 
     # tns is the variable used in the frequency analysis
     # turns is the input variable from user
-    # nturns is twice tns in order to get the tune in the first and second
-    #     part of the tracking
+    # the particles are tracked over 2*tns turns in order to get the tune
+    #     in the first and second part of the tracking
     tns = turns
-    nturns = 2*tns
-
-    # scale the inumpyut coordinates
-    xscale = 1e-3
-    yscale = 1e-3
 
     # returned array
-    xy_nuxy_lognudiff_array = numpy.empty([])
     loss_map_array = numpy.empty([])
 
     # verify steps
@@ -148,8 +191,6 @@ def fmap_parallel_track(ring,
         ystep = 1.0*(ymax - ymin)/ysteps
         ixarray = numpy.arange(xmin, xmax+1e-6, xstep)
         iyarray = numpy.arange(ymin, ymax+1e-6, ystep)
-    lenixarray = len(ixarray)
-    leniyarray = len(iyarray)
 
     print("Start tracking and frequency analysis")
 
@@ -158,119 +199,159 @@ def fmap_parallel_track(ring,
     # at.DConstant.patpass_poolsize = ncpu;
     print(f' Requested POOL size : {ncpu}')
 
-    # tracking in parallel multiple x coordinates with the same y coordinate
-    for iy, iy_index in zip(iyarray, range(leniyarray)):
-        print(f'Tracked particles {abs(-100.0*iy_index/leniyarray):.1f} %',
-              end='')
-        print(f', with a max. cpu POOL size of {ncpu}')
-        verboseprint("y =", iy)
-        z0 = numpy.zeros((lenixarray, 6))  # transposed, and C-aligned
-        z0 = z0 + add_offset6D + orbit
-        # add 1 nm to tracking to avoid zeros in array for the ideal lattice
-        z0[:, 0] = z0[:, 0] + xscale*ixarray + 1e-9
-        z0[:, 2] = z0[:, 2] + yscale*iy + 1e-9
-
-        verboseprint("tracking ...")
-        # z0.T is Fortran-aligned
-        if lossmap:
-            # patpass output changes when losses flag is true
-            zOUT, dictloss = \
-                patpass(ring, z0.T, nturns, pool_size=ncpu, losses=lossmap)
-            loss_map_array = numpy.append(loss_map_array, dictloss)
-        else:
-            zOUT = patpass(ring, z0.T, nturns, pool_size=ncpu)
-
-        # start of serial frequency analysis
-        for ix_index in range(lenixarray):  # cycle over the track results
-            # check if nan in arrays
-            array_sum = numpy.sum(zOUT[:, ix_index, 0])
-            array_has_nan = numpy.isnan(array_sum)
-            if array_has_nan:
-                verboseprint("array has nan")
-                continue
+    # the whole grid is tracked at once, x varying first
+    iyy, ixx = numpy.meshgrid(iyarray, ixarray, indexing='ij')
+    xy = numpy.stack((ixx.ravel(), iyy.ravel()), axis=1)
+    verboseprint(f'tracking {len(xy)} particles ...')
+    tunes, dictloss = _fmap_points(ring, xy, tns, orbit, add_offset6D, ncpu,
+                                   lossmap=lossmap)
+    if lossmap:
+        loss_map_array = numpy.append(loss_map_array, dictloss)
 
-            # get one valid particle
-            z1 = zOUT[:, ix_index, 0]
-
-            # remove mean values
-            # get the first turn in x
-            xfirst = z1[0, 0:tns]
-            xfirst = xfirst - numpy.mean(xfirst)
-            pxfirst = z1[1, 0:tns]
-            pxfirst = pxfirst - numpy.mean(pxfirst)
-            xfirstpart = xfirst + 1j*pxfirst
-            # get the last turns in x
-            xlast = z1[0, tns:2*tns]
-            xlast = xlast - numpy.mean(xlast)
-            pxlast = z1[1, tns:2*tns]
-            pxlast = pxlast - numpy.mean(pxlast)
-            xlastpart = xlast + 1j*pxlast
-
-            # get the first turn in y
-            yfirst = z1[2, 0:tns]
-            yfirst = yfirst - numpy.mean(yfirst)
-            pyfirst = z1[3, 0:tns]
-            pyfirst = pyfirst - numpy.mean(pyfirst)
-            yfirstpart = yfirst + 1j*pyfirst
-            # get the last turns in y
-            ylast = z1[2, tns:2*tns]
-            ylast = ylast - numpy.mean(ylast)
-            pylast = z1[3, tns:2*tns]
-            pylast = pylast - numpy.mean(pylast)
-            ylastpart = ylast + 1j*pylast
-
-            # calc frequency from array,
-            # jump the cycle is no frequency is found
-            xfreqfirst = get_tunes_harmonic(xfirst, num_harmonics=1)
-            if len(xfreqfirst) == 0:
-                verboseprint("  No frequency")
-                continue
-            # xfreqlast  = PyNAFF.naff(xlastpart,tns,1,0,False)
-            xfreqlast = get_tunes_harmonic(xlast, num_harmonics=1)
-            if len(xfreqlast) == 0:
-                verboseprint("  No frequency")
-                continue
-            # yfreqfirst = PyNAFF.naff(yfirstpart,tns,1,0,False)
-            yfreqfirst = get_tunes_harmonic(yfirst, num_harmonics=1)
-            if len(yfreqfirst) == 0:
-                verboseprint("  No frequency")
-                continue
-            # yfreqlast  = PyNAFF.naff(ylastpart,tns,1,0,False)
-            yfreqlast = get_tunes_harmonic(ylast, num_harmonics=1)
-            if len(yfreqlast) == 0:
-                verboseprint("  No frequency")
-                continue
-            verboseprint("NAFF results, (x,y)=",
-                         ixarray[ix_index],
-                         iy,
-                         "\nH freq. first part =\t", xfreqfirst[0],
-                         "\nH freq. last part =\t", xfreqlast[0],
-                         "\nV freq. first part =\t", yfreqfirst[0],
-                         "\nV freq. last part =\t", yfreqlast[0])
-
-            # metric
-            xdiff = xfreqlast[0] - xfreqfirst[0]
-            ydiff = yfreqlast[0] - yfreqfirst[0]
-            nudiff = 0.5*numpy.log10((xdiff*xdiff + ydiff*ydiff)/tns)
-            # min max diff
-            if nudiff > -2:
-                nudiff = -2
-            if nudiff < -10:
-                nudiff = -10
-            # save diff
-            xy_nuxy_lognudiff_array = numpy.append(xy_nuxy_lognudiff_array,
-                                                   [ixarray[ix_index],
-                                                    iy,
-                                                    xfreqfirst[0],
-                                                    yfreqfirst[0],
-                                                    xdiff,
-                                                    ydiff,
-                                                    nudiff])
-
-    # first element is garbage
-    xy_nuxy_lognudiff_array = numpy.delete(xy_nuxy_lognudiff_array, 0)
-    # reshape for plots and output files
-    xy_nuxy_lognudiff_array = xy_nuxy_lognudiff_array.reshape(-1, 7)
+    xy_nuxy_lognudiff_array = _fmap_results(xy, tunes, tns)
 
     return xy_nuxy_lognudiff_array, loss_map_array
+
+
+def _resonance_crossed(nux, nuy, order):
+    """True where the resonance lines m*nux + n*nuy = p, |m|+|n| <= order,
+    go between the corners of the cells. nux, nuy: (ncells, 4) arrays"""
+    crossed = numpy.zeros(nux.shape[0], dtype=bool)
+    for m in range(order+1):
+        for n in range(-order, order+1):
+            if (m == 0 and n <= 0) or abs(m) + abs(n) > order:
+                continue
+            k = numpy.floor(m*nux + n*nuy)
+            crossed |= numpy.amin(k, axis=1) != numpy.amax(k, axis=1)
+    return crossed
+
+
+def fmap_adaptive_track(ring,
+                        coords=[-10, 10, -10, 10],
+                        steps=[20, 20],
+                        turns=512,
+                        levels=3,
+                        ncpu=30,
+                        orbit=None,
+                        add_offset6D=numpy.zeros(6),
+                        nudiff_threshold=-5.0,
+                        resonance_order=3,
+                        verbose=False,
+                        ):
+    """
+    Frequency map with adaptive refinement of the grid.
+
+    The rectangular window coords=[xmin,xmax,ymin,ymax] in millimeters is
+    first divided in steps=[xsteps,ysteps] cells. Then, at each refinement
+    level, the cells are split in 4 where:
+
+    * some corners survive 2*turns turns and others not (border of the
+      dynamic aperture),
+    * the tune diffusion of one corner is above *nudiff_threshold*,
+    * a resonance line of order up to *resonance_order* goes between the
+      corners.
+
+    The new particles of each level are tracked together in a single
+    parallel run with patpass, and their frequency analysis is shared
+    between ncpu threads, as in fmap_parallel_track. The other cells are
+    not refined, so that the number of tracked particles is much smaller
+    than with a uniform grid of the same final resolution.
+
+    Parameters :
+        ring:     a valid pyat ring
+    Optional:
+        coords:   default [-10,10,-10,10] in mm
+        steps:    default [20,20], number of cells of the coarse grid
+        turns:    default 512
+        levels:   default 3, number of refinement levels. The final
+                  resolution is steps*2**levels
+        ncpu:     default 30; max. number of processors
+        orbit:    default None, the closed orbit is computed
+        add_offset6D: default numpy.zeros((6,1))
+        nudiff_threshold: default -5, log10 of the tune diffusion above
+                  which a cell is refined
+        resonance_order:  default 3, maximum order of the resonance
+                  lines. 0 disables the refinement on resonances
+        verbose:  prints additional info
+    Returns:
+        xy_nuxy_lognudiff_array: numpy array with columns
+                    [xcoor, ycoor, nux, ny, dnux, dnuy,
+                        log10(sqrt(sum(dnu**2)/turns)) ]
+                    for the surviving particles of all levels
+    """
+    if orbit is None:
+        orbit, _ = find_orbit(ring)
+        print(f'Closed orbit:\t{orbit}')
+
+    verboseprint = print if verbose else lambda *a, **k: None
+
+    if numpy.count_nonzero(steps) != 2:
+        raise ValueError('steps can not be zero')
+
+    tns = turns
+    xmin = numpy.minimum(coords[0], coords[1])
+    xmax = numpy.maximum(coords[0], coords[1])
+    ymin = numpy.minimum(coords[2], coords[3])
+    ymax = numpy.maximum(coords[2], coords[3])
+    # cells and points are indexed on the grid of the finest level
+    scale = 2**levels
+    dx = (xmax - xmin)/(steps[0]*scale)
+    dy = (ymax - ymin)/(steps[1]*scale)
+
+    index = {}
+    allij = numpy.empty((0, 2), dtype=int)
+    alltunes = numpy.empty((2, 2, 0))
+
+    def track(ij):
+        nonlocal allij, alltunes
+        ij = numpy.array([p for p in dict.fromkeys(map(tuple, ij))
+                          if p not in index], dtype=int).reshape(-1, 2)
+        verboseprint(f'tracking {len(ij)} particles ...')
+        if len(ij) > 0:
+            xy = numpy.stack((xmin + dx*ij[:, 0], ymin + dy*ij[:, 1]),
+                             axis=1)
+            tunes, _ = _fmap_points(ring, xy, tns, orbit, add_offset6D, ncpu)
+            index.update((p, i) for i, p in
+                         enumerate(map(tuple, ij), start=len(allij)))
+            allij = numpy.concatenate((allij, ij))
+            alltunes = numpy.concatenate((alltunes, tunes), axis=2)
+
+    corner = numpy.array([[0, 0], [1, 0], [0, 1], [1, 1]])
+    ci, cj = numpy.meshgrid(numpy.arange(steps[0]), numpy.arange(steps[1]),
+                            indexing='ij')
+    cells = scale*numpy.stack((ci.ravel(), cj.ravel()), axis=1)
+    step = scale
+    print("Start tracking and frequency analysis")
+    # coarse grid, in the order of fmap_parallel_track
+    gj, gi = numpy.meshgrid(scale*numpy.arange(steps[1]+1),
+                            scale*numpy.arange(steps[0]+1), indexing='ij')
+    track(numpy.stack((gi.ravel(), gj.ravel()), axis=1))
+
+    for level in range(levels):
+        # corner tunes [half, plane, cell, corner]
+        pts = (cells[:, numpy.newaxis, :] + step*corner).reshape(-1, 2)
+        idx = numpy.array([index[p] for p in map(tuple, pts)])
+        tunes = alltunes[:, :, idx].reshape(2, 2, -1, 4)
+        alive = numpy.all(numpy.isfinite(tunes), axis=(0, 1))
+        refine = numpy.any(alive, axis=1) & ~numpy.all(alive, axis=1)
+        ok = numpy.all(alive, axis=1)
+        t = tunes[:, :, ok]
+        xdiff, ydiff = t[1] - t[0]
+        with numpy.errstate(divide='ignore'):
+            nudiff = 0.5*numpy.log10((xdiff*xdiff + ydiff*ydiff)/tns)
+        chaotic = numpy.any(nudiff > nudiff_threshold, axis=1)
+        if resonance_order > 0:
+            chaotic |= _resonance_crossed(t[0, 0], t[0, 1], resonance_order)
+        refine[ok] = chaotic
+        verboseprint(f'level {level+1}: {numpy.count_nonzero(refine)} '
+                     f'of {len(cells)} cells refined')
+        if not numpy.any(refine):
+            break
+        step //= 2
+        cells = (cells[refine, numpy.newaxis, :] +
+                 step*corner).reshape(-1, 2)
+        track((cells[:, numpy.newaxis, :] + step*corner).reshape(-1, 2))
+
+    xy = numpy.stack((xmin + dx*allij[:, 0], ymin + dy*allij[:, 1]), axis=1)
+    return _fmap_results(xy, alltunes, tns)
 # the end
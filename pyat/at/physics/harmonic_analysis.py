@@ -10,6 +10,7 @@ Full code can be found at: https://github.com/pylhc/harpy
 """
 
 import numpy as np
+from concurrent.futures import ThreadPoolExecutor
 from typing import Optional, Tuple
 
 PI2I = 2 * np.pi * complex(0, 1)
@@ -19,46 +20,73 @@ HANN_DEF = False
 
 
 class HarmonicAnalysis(object):
+    """Harmonic analysis of one or several signals
+
+    The samples may be a (nsamples,) array or a (nsignals, nsamples) array,
+    in which case all the signals are analysed together, using vectorised
+    FFTs and scalar products.
+    """
 
     def __init__(self, samples, zero_pad=ZERO_PAD_DEF, hann=HANN_DEF):
-        self._samples = samples
+        self._samples = np.asarray(samples)
         self._compute_orbit()
         if zero_pad:
             self._pad_signal()
-        self._length = len(self._samples)
+        self._length = self._samples.shape[-1]
         self._int_range = np.arange(self._length)
         self._hann_window = None
         if hann:
             self._hann_window = np.hanning(self._length)
 
-    def laskar_method(self, num_harmonics):
-        samples = self._samples[:]  # Copy the samples array.
-        n = self._length
-        coefficients = []
-        frequencies = []
-        for _ in range(num_harmonics):
+    def laskar_method(self, num_harmonics, pool_size: Optional[int] = None):
+        """Laskar's method of frequency analysis
+
+        Parameters:
+            num_harmonics:  Number of harmonic components to compute
+            pool_size:      Number of threads sharing the signals. Default:
+              single thread
+
+        Returns:
+            frequencies:    (..., num_harmonics) array of frequencies
+            coefficients:   (..., num_harmonics) array of complex amplitudes,
+              sorted by decreasing modulus
+        """
+        shape = self._samples.shape[:-1] + (num_harmonics,)
+        samples = self._samples.reshape(-1, self._length)
+        nsignals = samples.shape[0]
+        if pool_size is None or pool_size <= 1 or nsignals < 2 * pool_size:
+            frequencies, coefficients = self._laskar(samples, num_harmonics)
+        else:
+            # numpy releases the GIL in FFTs and array operations
+            chunks = np.array_split(samples, pool_size)
+            with ThreadPoolExecutor(pool_size) as executor:
+                results = list(executor.map(
+                    lambda chunk: self._laskar(chunk, num_harmonics), chunks))
+            frequencies = np.concatenate([r[0] for r in results])
+            coefficients = np.concatenate([r[1] for r in results])
+        return frequencies.reshape(shape), coefficients.reshape(shape)
+
+    def _laskar(self, samples, num_harmonics):
+        nsignals, n = samples.shape
+        coefficients = np.empty((nsignals, num_harmonics), dtype=complex)
+        frequencies = np.empty((nsignals, num_harmonics))
+        for h in range(num_harmonics):
             # Compute this harmonic frequency and coefficient.
-            dft_data = HarmonicAnalysis._fft(samples)
+            dft_data = HarmonicAnalysis._fft(samples, axis=-1)
             frequency = self._jacobsen(dft_data)
-            coefficient = HarmonicAnalysis._compute_coef(
-                samples,
-                frequency * n
-            ) / n
+            exponents = HarmonicAnalysis._exponents(frequency, n)
+            coefficient = np.einsum('ij,ij->i', samples, exponents) / n
 
             # Store frequency and amplitude
-            coefficients.append(coefficient)
-            frequencies.append(frequency)
+            coefficients[:, h] = coefficient
+            frequencies[:, h] = frequency
 
             # Subtract the found pure tune from the signal
-            new_signal = coefficient * np.exp(PI2I
-                                              * frequency * self._int_range)
-            samples = samples - new_signal
-
-        coefficients, frequencies = zip(*sorted(zip(coefficients,
-                                                    frequencies),
-                                        key=lambda tuple: np.abs(tuple[0]),
-                                        reverse=True))
+            samples = samples - coefficient[:, np.newaxis] * exponents.conj()
 
+        order = np.argsort(-np.abs(coefficients), axis=-1, kind='stable')
+        coefficients = np.take_along_axis(coefficients, order, axis=-1)
+        frequencies = np.take_along_axis(frequencies, order, axis=-1)
         return frequencies, coefficients
 
     def get_signal(self):
@@ -68,20 +96,23 @@ class HarmonicAnalysis(object):
             return self._samples
 
     def get_coefficient_for_freq(self, freq):
-        return self._compute_coef(self._samples,
-                                  freq * self._length) / self._length
+        freq = np.broadcast_to(freq, self._samples.shape[:-1])
+        exponents = self._exponents(freq, self._length)
+        return np.einsum('...j,...j->...', self._samples,
+                         exponents) / self._length
 
     def _pad_signal(self):
         """
         Pads the signal with zeros to a "good" FFT size.
         """
-        length = len(self._samples)
+        length = self._samples.shape[-1]
         # TODO Think proper pad size
         pad_length = (1 << (length - 1).bit_length()) - length
         # pad_length = 6600 - length
+        pad = [(0, 0)] * (self._samples.ndim - 1) + [(0, pad_length)]
         self._samples = np.pad(
             self._samples,
-            (0, pad_length),
+            pad,
             'constant'
         )
         # self._samples = self._samples[:6000]
@@ -91,74 +122,36 @@ class HarmonicAnalysis(object):
         This method interpolates the real frequency of the
         signal using the three highest peaks in the FFT.
         """
-        k = np.argmax(np.abs(dft_values))
+        rows = np.arange(dft_values.shape[0])
+        k = np.argmax(np.abs(dft_values), axis=-1)
         n = self._length
         r = dft_values
         delta = np.tan(np.pi / n) / (np.pi / n)
         kp = (k + 1) % n
         km = (k - 1) % n
-        delta = delta * np.real((r[km] - r[kp]) / (2 * r[k] - r[km] - r[kp]))
+        rk, rkm, rkp = r[rows, k], r[rows, km], r[rows, kp]
+        delta = delta * np.real((rkm - rkp) / (2 * rk - rkm - rkp))
         return (k + delta) / n
 
     @staticmethod
-    def _compute_coef_simple(samples, kprime):
+    def _exponents(freq, n):
         """
-        Computes the coefficient of the Discrete Time Fourier
-        Transform corresponding to the given frequency (kprime).
+        Computes exp(-2i*pi*freq*j), j=0..n-1 for each frequency.
+        j is split into blocks of length nb, so that only
+        about 2*sqrt(n) complex exponentials are evaluated per frequency.
         """
-        n = len(samples)
-        freq = kprime / n
-        exponents = np.exp(-PI2I * freq * np.arange(n))
-        coef = np.sum(exponents * samples)
-        return coef
-
-    @staticmethod
-    def _compute_coef_goertzel(samples, kprime):
-        """
-        Computes the coefficient of the Discrete Time Fourier
-        Transform corresponding to the given frequency (kprime).
-        This function is faster than the previous one if compiled
-        with Numba.
-        """
-        n = len(samples)
-        a = 2 * np.pi * (kprime / n)
-        b = 2 * np.cos(a)
-        c = np.exp(-complex(0, 1) * a)
-        d = np.exp(-complex(0, 1) *
-                   ((2 * np.pi * kprime) / n) *
-                   (n - 1))
-        s0 = 0.
-        s1 = 0.
-        s2 = 0.
-        for i in range(n - 1):
-            s0 = samples[i] + b * s1 - s2
-            s2 = s1
-            s1 = s0
-        s0 = samples[n - 1] + b * s1 - s2
-        y = s0 - s1 * c
-        return y * d
+        freq = np.asarray(freq)[..., np.newaxis]
+        nb = int(np.ceil(np.sqrt(n)))
+        inner = np.exp(-PI2I * freq * np.arange(nb))
+        outer = np.exp(-PI2I * freq * np.arange(0, n, nb))
+        exponents = outer[..., :, np.newaxis] * inner[..., np.newaxis, :]
+        return exponents.reshape(freq.shape[:-1] + (-1,))[..., :n]
 
     def _compute_orbit(self):
-        self.closed_orbit = np.mean(self._samples)
-        self.closed_orbit_rms = np.std(self._samples)
-        self.peak_to_peak = np.max(self._samples) - np.min(self._samples)
-
-    @staticmethod
-    def _conditional_import_compute_coef():
-        """
-        Checks if Numba is installed.
-        If it is, it sets the compiled goertzel algorithm as the
-        coefficient function to use. If it isn't, it uses the
-        normal Numpy one.
-        """
-        try:
-            from numba import jit
-            # print("Using compiled Numba functions.")
-            return jit(HarmonicAnalysis._compute_coef_goertzel,
-                       nopython=True, nogil=True)
-        except ImportError:
-            # print("Numba not found, using numpy functions.")
-            return HarmonicAnalysis._compute_coef_simple
+        self.closed_orbit = np.mean(self._samples, axis=-1)
+        self.closed_orbit_rms = np.std(self._samples, axis=-1)
+        self.peak_to_peak = np.max(self._samples, axis=-1) - \
+            np.min(self._samples, axis=-1)
 
     @staticmethod
     def _conditional_import_fft():
@@ -184,8 +177,6 @@ class HarmonicAnalysis(object):
 
 # Set up conditional functions on load
 ##############################################
-HarmonicAnalysis._compute_coef = staticmethod(
-    HarmonicAnalysis._conditional_import_compute_coef())
 HarmonicAnalysis._fft, HarmonicAnalysis._fftfreq = \
     HarmonicAnalysis._conditional_import_fft()
 ##############################################
@@ -193,39 +184,47 @@ HarmonicAnalysis._fft, HarmonicAnalysis._fftfreq = \
 
 def get_spectrum_harmonic(cent, method: str = 'laskar',
                           num_harmonics: int = 20,
-                          hann: bool = False) -> Tuple[np.ndarray, np.ndarray]:
+                          hann: bool = False,
+                          pool_size: Optional[int] = None
+                          ) -> Tuple[np.ndarray, np.ndarray]:
     """Frequency analysis of beam motion
 
     Parameters:
-        cent:           Centroid motions of the particle
+        cent:           Centroid motions of the particle: (nturns,) array,
+          or (nparticles, nturns) array for analysing several particles at
+          once
         method:         ``'laskar'`` or ``'fft'``. Default: ``'laskar'``
         num_harmonics:  Number of harmonic components to compute (before mask
           applied)
         hann:           Turn on Hanning window. Default: :py:obj:`False`
+        pool_size:      Number of threads for the ``'laskar'`` method.
+          Default: single thread
 
     Returns:
-        frequency (ndarray): (num_harmonics,) array of frequencies
-        amplitude (ndarray): (num_harmonics,) array of amplitudes
+        frequency (ndarray): (..., num_harmonics) array of frequencies
+        amplitude (ndarray): (..., num_harmonics) array of amplitudes
     """
     ha = HarmonicAnalysis(cent, hann=hann)
 
     if method == 'laskar':
-        ha_tune, ha_amp = ha.laskar_method(num_harmonics=num_harmonics)
+        ha_tune, ha_amp = ha.laskar_method(num_harmonics=num_harmonics,
+                                           pool_size=pool_size)
     elif method == 'fft':
         signal = ha.get_signal()
-        fft = ha._fft(signal)
-        ha_tune, ha_amp = ha._fftfreq(len(fft)), np.abs(fft)
+        fft = ha._fft(signal, axis=-1)
+        ha_tune, ha_amp = ha._fftfreq(fft.shape[-1]), np.abs(fft)
     else:
         raise ValueError('The method ' + method + ' is undefined')
 
     ha_amp = np.abs(np.array(ha_amp))
-    ha_tune = np.array(ha_tune)
+    ha_tune = np.array(np.broadcast_to(ha_tune, ha_amp.shape))
     return ha_tune, ha_amp
 
 
 def get_tunes_harmonic(cents, method: str = 'laskar',
                        num_harmonics: int = 20, hann: bool = False,
-                       fmin: float = 0, fmax: float = 1) -> np.ndarray:
+                       fmin: float = 0, fmax: float = 1,
+                       pool_size: Optional[int] = None) -> np.ndarray:
     """Computes tunes from harmonic analysis
 
     Parameters:
@@ -236,34 +235,22 @@ def get_tunes_harmonic(cents, method: str = 'laskar',
         fmin:           Lower bound for tune
         fmax:           Upper bound for tune
         hann:           Turn on Hanning window. Default: :py:obj:`False`
+        pool_size:      Number of threads for the ``'laskar'`` method.
+          Default: single thread
 
     Returns:
         tunes (ndarray):    numpy array of length len(cents), max of the
           spectrum within [fmin fmax]
     """
-    def get_max_spectrum(freq, amp, fmin, fmax):
-        msk = np.logical_and(freq >= fmin, freq <= fmax)
-        amp = amp[msk]
-        freq = freq[msk]
-        tune = freq[np.argmax(amp)]
-        return tune
-
     cents = np.array(cents)
-    if cents.ndim > 1:
-        npart = cents.shape[0]
-    else:
-        cents = [cents]
-        npart = 1
-    tunes = np.zeros(npart)
-
-    for i in range(npart):
-        freq, amp = get_spectrum_harmonic(cents[i],
-                                          num_harmonics=num_harmonics,
-                                          method=method,
-                                          hann=hann)
-        try:                                 
-            tunes[i] = get_max_spectrum(freq, amp, fmin, fmax)
-        except ValueError:
-            tunes[i] = np.nan
-
+    if cents.ndim <= 1:
+        cents = cents.reshape(1, -1)
+    freq, amp = get_spectrum_harmonic(cents, num_harmonics=num_harmonics,
+                                      method=method, hann=hann,
+                                      pool_size=pool_size)
+    msk = np.logical_and(freq >= fmin, freq <= fmax)
+    amp = np.where(msk, amp, -np.inf)
+    imax = np.argmax(amp, axis=-1)[:, np.newaxis]
+    tunes = np.take_along_axis(freq, imax, axis=-1)[:, 0]
+    tunes[~np.any(msk, axis=-1)] = np.nan
     return tunes
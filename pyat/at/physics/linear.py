@@ -13,7 +13,7 @@ from ..lattice import AtWarning, Lattice, Orbit, check_6d, get_s_pos
 from ..lattice import frequency_control
 from ..tracking import lattice_pass
 from .orbit import find_orbit4, find_orbit6
-from .matrix import find_m44, find_m66
+from .matrix import find_m44, find_m66, find_tangent_m66
 from .amat import a_matrix, jmat, jmatswap
 from .harmonic_analysis import get_tunes_harmonic
 
@@ -281,7 +281,8 @@ def _linopt(ring: Lattice, analyze, refpts=None, dp=None, dct=None, df=None,
         """Compute the chromaticity and W-functions"""
         # noinspection PyShadowingNames
         def off_momentum(rng, orb0):
-            mt, ms = get_matrix(rng, refpts=refpts, orbit=orb0, **kwargs)
+            mt, ms = get_matrix(rng, refpts=refpts, orbit=orb0,
+                                tangent=tangent, **kwargs)
             vps, _, el0, els = analyze(mt, ms)
             tunes = numpy.mod(numpy.angle(vps)/2.0/pi, 1.0)
             return tunes, el0, els
@@ -313,8 +314,21 @@ def _linopt(ring: Lattice, analyze, refpts=None, dp=None, dct=None, df=None,
         jumps = dmu < -1.e-3
         mu += numpy.cumsum(jumps, axis=0) * 2.0 * numpy.pi
 
+    def tangent_matrix(orbit):
+        """Matrices and orbit in a single tangent pass, if possible"""
+        try:
+            mt, ms, orbs = find_tangent_m66(ring, orbit, refpts)
+        except NotImplementedError:
+            return None
+        if not ring.is_6d:
+            mt = mt[:4, :4]
+            ms = ms[:, :4, :4]
+        return mt, ms, orbs
+
     dp_step = kwargs.get('DPStep', DConstant.DPStep)
     addtype = kwargs.pop('addtype', [])
+    tangent = kwargs.pop('tangent', False)
+    tangent_data = None
 
     if ring.is_6d:
         get_matrix = find_m66
@@ -326,10 +340,16 @@ def _linopt(ring: Lattice, analyze, refpts=None, dp=None, dct=None, df=None,
     if twiss_in is None:        # Ring
         if orbit is None:
             orbit, _ = get_orbit(ring, dp=dp, dct=dct, df=df,
-                                 keep_lattice=keep_lattice, **kwargs)
+                                 keep_lattice=keep_lattice, tangent=tangent,
+                                 **kwargs)
             keep_lattice = True
         # Get 1-turn transfer matrix
-        mt, ms = get_matrix(ring, refpts=refpts, orbit=orbit, **kwargs)
+        if tangent:
+            tangent_data = tangent_matrix(orbit)
+        if tangent_data is None:
+            mt, ms = get_matrix(ring, refpts=refpts, orbit=orbit, **kwargs)
+        else:
+            mt, ms, _ = tangent_data
         mxx = mt
         o0up = None
         o0dn = None
@@ -342,7 +362,12 @@ def _linopt(ring: Lattice, analyze, refpts=None, dp=None, dct=None, df=None,
         orbit, sigma, d0 = build_sigma(twiss_in, orbit)
         dorbit = numpy.hstack((0.5*dp_step*d0, 0.5*dp_step, 0.0))
         # Get 1-turn transfer matrix
-        mt, ms = get_matrix(ring, refpts=refpts, orbit=orbit, **kwargs)
+        if tangent:
+            tangent_data = tangent_matrix(orbit)
+        if tangent_data is None:
+            mt, ms = get_matrix(ring, refpts=refpts, orbit=orbit, **kwargs)
+        else:
+            mt, ms, _ = tangent_data
         mxx = sigma @ jmat(sigma.shape[0] // 2)
         o0up = orbit+dorbit
         o0dn = orbit-dorbit
@@ -355,8 +380,11 @@ def _linopt(ring: Lattice, analyze, refpts=None, dp=None, dct=None, df=None,
         tunes = numpy.NaN
 
     # Propagate the closed orbit
-    orb0, orbs = get_orbit(ring, refpts=refpts, orbit=orbit,
-                           keep_lattice=keep_lattice)
+    if tangent_data is None:
+        orb0, orbs = get_orbit(ring, refpts=refpts, orbit=orbit,
+                               keep_lattice=keep_lattice)
+    else:
+        orb0, orbs = orbit, tangent_data[2]
     spos = ring.get_s_pos(refpts)
 
     nrefs = orbs.shape[0]
@@ -468,6 +496,10 @@ def linopt2(ring: Lattice, *args, **kwargs):
           deviations around the central one.
         keep_lattice (bool):    Assume no lattice change since the
           previous tracking. Defaults to :py:obj:`False`
+        tangent (bool):         Get the transfer matrices and the orbit at
+          *refpts* in a single tangent pass (see
+          :py:func:`.find_tangent_m66`), if all the elements support it.
+          Defaults to :py:obj:`False`
         XYStep (float):         Step size.
           Default: :py:data:`DConstant.XYStep <.DConstant>`
         DPStep (float):         Momentum step size.
@@ -566,6 +598,10 @@ def linopt4(ring: Lattice, *args, **kwargs):
           deviations around the central one.
         keep_lattice (bool):    Assume no lattice change since the
           previous tracking. Defaults to :py:obj:`False`
+        tangent (bool):         Get the transfer matrices and the orbit at
+          *refpts* in a single tangent pass (see
+          :py:func:`.find_tangent_m66`), if all the elements support it.
+          Defaults to :py:obj:`False`
         XYStep (float):         Step size.
           Default: :py:data:`DConstant.XYStep <.DConstant>`
         DPStep (float):         Momentum step size.
@@ -675,6 +711,10 @@ def linopt6(ring: Lattice, *args, **kwargs):
           deviations around the central one.
         keep_lattice (bool):    Assume no lattice change since the
           previous tracking. Defaults to :py:obj:`False`
+        tangent (bool):         Get the transfer matrices and the orbit at
+          *refpts* in a single tangent pass (see
+          :py:func:`.find_tangent_m66`), if all the elements support it.
+          Defaults to :py:obj:`False`
         XYStep (float):         Step size.
           Default: :py:data:`DConstant.XYStep <.DConstant>`
         DPStep (float):         Momentum step size.
@@ -815,6 +855,10 @@ def get_optics(ring: Lattice, refpts: Refpts = None,
           deviations around the central one.
         keep_lattice (bool):    Assume no lattice change since the
           previous tracking. Defaults to :py:obj:`False`
+        tangent (bool):         Get the transfer matrices and the orbit at
+          *refpts* in a single tangent pass (see
+          :py:func:`.find_tangent_m66`), if all the elements support it.
+          Defaults to :py:obj:`False`
         XYStep (float):         Step size.
           Default: :py:data:`DConstant.XYStep <.DConstant>`
         DPStep (float):         Momentum step size.
@@ -966,6 +1010,10 @@ def avlinopt(ring: Lattice, dp: float = None, refpts: Refpts = None, **kwargs):
           deviations around the central one.
         keep_lattice (bool):    Assume no lattice change since the
           previous tracking. Defaults to :py:obj:`False`
+        tangent (bool):         Get the transfer matrices and the orbit at
+          *refpts* in a single tangent pass (see
+          :py:func:`.find_tangent_m66`), if all the elements support it.
+          Defaults to :py:obj:`False`
         XYStep (float):         Step size.
           Default: :py:data:`DConstant.XYStep <.DConstant>`
         DPStep (float):         Momentum step size.
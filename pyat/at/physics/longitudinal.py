@@ -0,0 +1,190 @@
+"""
+Longitudinal-only tracking
+"""
+from math import pi, sqrt
+import numpy
+from numpy.polynomial import polynomial
+from typing import Optional
+from ..constants import clight
+from ..lattice import Lattice, RFCavity, AtError, checktype, random
+from ..tracking import lattice_pass
+from .orbit import find_orbit4
+from .ring_parameters import radiation_parameters
+
+__all__ = ['LongitudinalMap']
+
+
+class LongitudinalMap(object):
+    r"""One-turn longitudinal map of a ring
+
+    The particles are described by their (:math:`\delta`, :math:`c\tau`)
+    coordinates, stored in a (2, N) C-contiguous array so that each
+    coordinate is contiguous for all the particles. A turn consists of:
+
+    * the kicks of all the RF cavities, lumped at the same location,
+    * the energy loss, radiation damping and quantum diffusion, if the
+      radiation is enabled,
+    * the path lengthening
+      :math:`c\tau \mathrel{+}= C\sum_k\alpha_k\delta^k`, where
+      :math:`\alpha_1` is the momentum compaction factor and the higher
+      orders are its nonlinear terms.
+
+    The RF kick is the same as in ``RFCavityPass``.
+
+    Parameters:
+        circumference:  Ring circumference [m]
+        energy:         Nominal energy [eV]
+        voltage:        (ncav,) cavity voltages [V]
+        frequency:      (ncav,) cavity frequencies [Hz]
+        alphas:         Momentum compaction coefficients
+          :math:`[\alpha_1, \alpha_2, ...]`
+        timelag:        (ncav,) cavity time lags [m]. Default: 0
+        harmonic_number: Harmonic number. Default: computed from the
+          first cavity frequency
+        beta:           Relativistic :math:`\beta` of the particles.
+          Default: 1
+        u0:             Energy loss per turn [eV]. Default: 0
+        damping_time:   Longitudinal damping time [s]. Default: no damping
+        sigma_e:        Equilibrium energy spread. Default: 0
+
+    Example:
+        >>> lmap = LongitudinalMap.from_ring(ring, radiation=True)
+        >>> particles = numpy.zeros((2, 10000000))
+        >>> particles[0] = 1.e-3 * numpy.random.standard_normal(10000000)
+        >>> lmap.track(particles, nturns=1000)
+    """
+    #: Number of particles tracked together over all the turns
+    chunk_size = 1 << 15
+
+    def __init__(self, circumference: float, energy: float, voltage,
+                 frequency, alphas, timelag=0.0,
+                 harmonic_number: Optional[float] = None,
+                 beta: float = 1.0, u0: float = 0.0,
+                 damping_time: Optional[float] = None,
+                 sigma_e: float = 0.0):
+        voltage, frequency, timelag = numpy.broadcast_arrays(
+            numpy.atleast_1d(voltage), frequency, timelag)
+        self.circumference = circumference
+        self.energy = energy
+        self.voltage = numpy.array(voltage, dtype=float)
+        self.frequency = numpy.array(frequency, dtype=float)
+        self.timelag = numpy.array(timelag, dtype=float)
+        self.alphas = numpy.atleast_1d(numpy.array(alphas, dtype=float))
+        self.T0 = circumference / beta / clight
+        if harmonic_number is None:
+            harmonic_number = round(self.frequency[0] * self.T0)
+        self.harmonic_number = harmonic_number
+        self.u0 = u0
+        if damping_time is None:
+            self.damping = 0.0
+        else:
+            self.damping = 2.0 * self.T0 / damping_time
+        self.sigma_e = sigma_e
+        self.turn = 0
+
+    @classmethod
+    def from_ring(cls, ring: Lattice, order: int = 2,
+                  radiation: bool = False, dpmax: float = 0.01,
+                  **kwargs) -> "LongitudinalMap":
+        r"""Build the longitudinal map of a ring
+
+        The momentum compaction coefficients are fitted on the path
+        lengthening of off-momentum closed orbits.
+
+        Parameters:
+            ring:       Lattice description
+            order:      Order of the momentum compaction polynomial.
+              Default: 2
+            radiation:  Include the energy loss, damping and diffusion.
+              Default: :py:obj:`False`
+            dpmax:      Momentum range for the fit. Default: 0.01
+
+        Keyword Args:
+            *:          Attributes of the map, overriding the values
+              computed from the ring
+
+        Returns:
+            lmap (LongitudinalMap): Longitudinal map of the ring
+        """
+        cavities = ring.get_elements(checktype(RFCavity))
+        if not cavities:
+            raise AtError('No cavity found in the lattice')
+        ring4 = ring.disable_6d(copy=True)
+        dps = numpy.linspace(-dpmax, dpmax, 2*order + 1)
+        orbits = numpy.stack([find_orbit4(ring4, dp=dp)[0] for dp in dps],
+                             axis=1)
+        rout = lattice_pass(ring4, numpy.asfortranarray(orbits),
+                            keep_lattice=True)
+        dct = (rout[5, :, 0, 0] - orbits[5]) * ring.periodicity
+        coefs = polynomial.polyfit(dps, dct / ring.circumference, order)
+        kwargs.setdefault('alphas', coefs[1:])
+        kwargs.setdefault('timelag', [c.TimeLag for c in cavities])
+        kwargs.setdefault('beta', ring.beta)
+        kwargs.setdefault('harmonic_number', ring.harmonic_number)
+        if radiation:
+            rp = radiation_parameters(ring4)
+            kwargs.setdefault('u0', rp.U0)
+            kwargs.setdefault('damping_time', rp.Tau[2])
+            kwargs.setdefault('sigma_e', rp.sigma_e)
+        voltage = [c.Voltage * ring.periodicity for c in cavities]
+        return cls(ring.circumference, ring.energy, voltage,
+                   [c.Frequency for c in cavities], **kwargs)
+
+    def track(self, particles: numpy.ndarray, nturns: int = 1,
+              rng: Optional[numpy.random.Generator] = None
+              ) -> numpy.ndarray:
+        r"""Track particles in place
+
+        The particles are processed in chunks of :py:attr:`chunk_size`
+        over all the turns, so that their coordinates stay in cache.
+
+        Parameters:
+            particles:  (2, N) C-contiguous array of
+              (:math:`\delta`, :math:`c\tau`) coordinates, modified in place
+            nturns:     Number of turns. Default: 1
+            rng:        Random generator for quantum diffusion. Default:
+              :py:data:`at.random.thread <.random>`
+
+        Returns:
+            particles:  The input array
+        """
+        if not (particles.ndim == 2 and particles.shape[0] == 2 and
+                particles.flags.c_contiguous):
+            raise AtError('particles must be a (2, N) C-contiguous array')
+        if rng is None:
+            rng = random.thread
+        nv = self.voltage / self.energy
+        wavenum = 2.0 * pi * self.frequency / clight
+        delays = self.harmonic_number / self.frequency - self.T0
+        phases = [wavenum * (self.timelag + clight * delays * turn)
+                  for turn in range(self.turn, self.turn + nturns)]
+        decay = 1.0 - self.damping
+        kick = self.sigma_e * sqrt(max(1.0 - decay * decay, 0.0))
+        dpc = self.u0 / self.energy
+        alphas = self.circumference * self.alphas
+        npart = particles.shape[1]
+        tmp = numpy.empty(min(npart, self.chunk_size))
+        for first in range(0, npart, self.chunk_size):
+            dp = particles[0, first:first + self.chunk_size]
+            ct = particles[1, first:first + self.chunk_size]
+            t = tmp[:dp.size]
+            for phase in phases:
+                for v, k, ph in zip(nv, wavenum, phase):
+                    numpy.multiply(ct, k, out=t)
+                    t -= ph
+                    numpy.sin(t, out=t)
+                    t *= v
+                    dp -= t
+                if self.damping != 0.0 or dpc != 0.0:
+                    dp -= dpc
+                    dp *= decay
+                if kick != 0.0:
+                    dp += kick * rng.normal(size=dp.size)
+                # Horner evaluation of the path lengthening
+                numpy.multiply(dp, alphas[-1], out=t)
+                for a in alphas[-2::-1]:
+                    t += a
+                    t *= dp
+                ct += t
+        self.turn += nturns
+        return particles
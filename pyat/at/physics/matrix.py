@@ -7,18 +7,54 @@ import numpy
 from ..lattice import Lattice, Element, DConstant, Refpts, Orbit
 from ..lattice import frequency_control, get_uint32_index
 from ..lattice.elements import Dipole, M66
-from ..tracking import lattice_pass, element_pass
+from ..tracking import lattice_pass, lattice_tangent_pass, element_pass
 from .orbit import find_orbit4, find_orbit6
 from .amat import jmat, symplectify
 
-__all__ = ['find_m44', 'find_m66', 'find_elem_m66', 'gen_m66_elem']
+__all__ = ['find_m44', 'find_m66', 'find_tangent_m66', 'find_elem_m66',
+           'gen_m66_elem']
 
 _jmt = jmat(2)
 
 
+def find_tangent_m66(ring: Lattice, orbit: Orbit, refpts: Refpts = None):
+    """One-turn 6x6 transfer matrix, transfer matrices and orbit in one pass
+
+    :py:func:`find_tangent_m66` tracks a single tangent particle starting
+    from *orbit* with :py:func:`.lattice_tangent_pass`. The matrices
+    are exact derivatives of the tracking, and the orbit at the
+    observation points comes out of the same pass.
+
+    Parameters:
+        ring:           Lattice description
+        orbit:          Initial orbit ((6,) array), usually the closed orbit
+        refpts:         Observation points
+
+    Returns:
+        m66:    full one-turn matrix at the entrance of the first element
+        ms:     6x6 transfer matrices between the entrance of the first
+          element and each element indexed by refpts: (Nrefs, 6, 6) array
+        orbs:   orbit at each element indexed by refpts: (Nrefs, 6) array
+
+    Raises:
+        NotImplementedError: if a *PassMethod* has no tangent map
+    """
+    refs = get_uint32_index(ring, refpts)
+    nrefs = len(refs)
+    nelems = len(ring)
+    if nrefs > 0 and refs[-1] == nelems:
+        allrefs = refs
+    else:
+        allrefs = numpy.append(refs, numpy.uint32(nelems))
+    r_in = numpy.asfortranarray(orbit.reshape(6, 1))
+    rout, ms = lattice_tangent_pass(ring, r_in, refpts=allrefs)
+    return ms[0, -1], ms[0, :nrefs], rout[:, 0, :nrefs].T
+
+
 def find_m44(ring: Lattice, dp: float = None, refpts: Refpts = None,
              dct: float = None, df: float = None,
-             orbit: Orbit = None, keep_lattice: bool = False, **kwargs):
+             orbit: Orbit = None, keep_lattice: bool = False,
+             tangent: bool = False, **kwargs):
     """One turn 4x4 transfer matrix
 
     :py:func:`find_m44` finds the 4x4 transfer matrix of an accelerator
@@ -45,6 +81,9 @@ def find_m44(ring: Lattice, dp: float = None, refpts: Refpts = None,
           already known ((6,) array).
         keep_lattice:   Assume no lattice change since the previous tracking.
           Default: :py:obj:`False`
+        tangent:        If :py:obj:`True`, compute the matrices in a single
+          pass with :py:func:`.lattice_tangent_pass` instead of finite
+          differences, if all the elements support it. Default: :py:obj:`False`
 
     Keyword Args:
         full (bool):    If :py:obj:`True`, matrices are full 1-turn matrices
@@ -71,8 +110,21 @@ def find_m44(ring: Lattice, dp: float = None, refpts: Refpts = None,
     full = kwargs.pop('full', False)
     if orbit is None:
         orbit, _ = find_orbit4(ring, dp=dp, dct=dct, df=df,
-                               keep_lattice=keep_lattice, XYStep=xy_step)
+                               keep_lattice=keep_lattice, XYStep=xy_step,
+                               tangent=tangent)
         keep_lattice = True
+    refs = get_uint32_index(ring, refpts)
+    if tangent:
+        try:
+            m66, ms66, _ = find_tangent_m66(ring, orbit, refs)
+        except NotImplementedError:
+            pass
+        else:
+            m44 = m66[:4, :4]
+            mstack = ms66[:, :4, :4]
+            if full:
+                mstack = numpy.stack([mrotate(mat) for mat in mstack], axis=0)
+            return m44, mstack
     # Construct matrix of plus and minus deltas
     # scaling = 2*xy_step*numpy.array([1.0, 0.1, 1.0, 0.1])
     scaling = xy_step * numpy.array([1.0, 1.0, 1.0, 1.0])
@@ -82,7 +134,6 @@ def find_m44(ring: Lattice, dp: float = None, refpts: Refpts = None,
     # Add the deltas to multiple copies of the closed orbit
     in_mat = orbit.reshape(6, 1) + dmat
 
-    refs = get_uint32_index(ring, refpts)
     out_mat = numpy.rollaxis(
         numpy.squeeze(lattice_pass(ring, in_mat, refpts=refs,
                                    keep_lattice=keep_lattice), axis=3), -1
@@ -103,7 +154,8 @@ def find_m44(ring: Lattice, dp: float = None, refpts: Refpts = None,
 
 @frequency_control
 def find_m66(ring: Lattice, refpts: Refpts = None,
-             orbit: Orbit = None, keep_lattice: bool = False, **kwargs):
+             orbit: Orbit = None, keep_lattice: bool = False,
+             tangent: bool = False, **kwargs):
     """One-turn 6x6 transfer matrix
 
     :py:func:`find_m66` finds the 6x6 transfer matrix of an accelerator
@@ -120,6 +172,9 @@ def find_m66(ring: Lattice, refpts: Refpts = None,
           already known ((6,) array).
         keep_lattice:   Assume no lattice change since the previous tracking.
           Default: :py:obj:`False`
+        tangent:        If :py:obj:`True`, compute the matrices in a single
+          pass with :py:func:`.lattice_tangent_pass` instead of finite
+          differences, if all the elements support it. Default: :py:obj:`False`
 
     Keyword Args:
         XYStep (float)  Step size.
@@ -140,12 +195,21 @@ def find_m66(ring: Lattice, refpts: Refpts = None,
     if orbit is None:
         if ring.radiation:
             orbit, _ = find_orbit6(ring, keep_lattice=keep_lattice,
-                                   XYStep=xy_step, DPStep=dp_step, **kwargs)
+                                   XYStep=xy_step, DPStep=dp_step,
+                                   tangent=tangent, **kwargs)
         else:
             orbit, _ = find_orbit4(ring, keep_lattice=keep_lattice,
-                                   XYStep=xy_step, **kwargs)
+                                   XYStep=xy_step, tangent=tangent, **kwargs)
         keep_lattice = True
 
+    refs = get_uint32_index(ring, refpts)
+    if tangent:
+        try:
+            m66, mstack, _ = find_tangent_m66(ring, orbit, refs)
+            return m66, mstack
+        except NotImplementedError:
+            pass
+
     # Construct matrix of plus and minus deltas
     # scaling = 2*xy_step*numpy.array([1.0, 0.1, 1.0, 0.1, 1.0, 1.0])
     scaling = xy_step * numpy.array([1.0, 1.0, 1.0, 1.0, 0.0, 0.0]) + \
@@ -155,7 +219,6 @@ def find_m66(ring: Lattice, refpts: Refpts = None,
 
     in_mat = orbit.reshape(6, 1) + dmat
 
-    refs = get_uint32_index(ring, refpts)
     out_mat = numpy.rollaxis(
         numpy.squeeze(lattice_pass(ring, in_mat, refpts=refs,
                                    keep_lattice=keep_lattice), axis=3), -1
@@ -0,0 +1,7 @@
+"""Stub file for the 'nafflib' extension"""
+
+import numpy as np
+from typing import Tuple
+
+def naff(y: np.ndarray, yp: np.ndarray, window: int = 0,
+         nfreq: int = 10) -> Tuple[np.ndarray, np.ndarray, np.ndarray]: ...
@@ -6,12 +6,32 @@ from at.constants import clight
 from at.lattice import AtError, AtWarning, check_6d, DConstant, Orbit
 from at.lattice import Lattice, get_s_pos, Refpts, frequency_control
 from at.tracking import lattice_pass
+from at.tracking.atpass import closedorbit as _closedorbit
 from .energy_loss import ELossMethod, get_timelag_fromU0
 import warnings
 
 __all__ = ['find_orbit4', 'find_sync_orbit', 'find_orbit6', 'find_orbit']
 
 
+def _native_orbit(ring: Lattice, ref_in, rows, cols, theta,
+                  convergence, max_iterations):
+    """Newton search in C with the tangent-map Jacobian
+
+    Returns :py:obj:`None` if an element has no tangent map
+    """
+    try:
+        orbit, itercount = _closedorbit(
+            ring, ref_in, numpy.array(rows, dtype=numpy.uint32),
+            numpy.array(cols, dtype=numpy.uint32), theta,
+            convergence=convergence, max_iterations=max_iterations)
+    except NotImplementedError:
+        return None
+    if itercount == max_iterations:
+        warnings.warn(AtWarning('Maximum number of iterations reached. '
+                                'Possible non-convergence'))
+    return orbit
+
+
 @check_6d(False)
 def _orbit_dp(ring: Lattice, dp: float = None, guess: Orbit = None, **kwargs):
     """Solver for fixed energy deviation"""
@@ -31,6 +51,7 @@ def _orbit_dp(ring: Lattice, dp: float = None, guess: Orbit = None, **kwargs):
     convergence = kwargs.pop('convergence', DConstant.OrbConvergence)
     max_iterations = kwargs.pop('max_iterations', DConstant.OrbMaxIter)
     xy_step = kwargs.pop('XYStep', DConstant.XYStep)
+    tangent = kwargs.pop('tangent', False)
     rem = kwargs.keys()
     if len(rem) > 0:
         raise AtError(f'Unexpected keywords for orbit_dp: {", ".join(rem)}')
@@ -38,6 +59,12 @@ def _orbit_dp(ring: Lattice, dp: float = None, guess: Orbit = None, **kwargs):
     ref_in = numpy.zeros((6,)) if guess is None else numpy.copy(guess)
     ref_in[4] = 0.0 if dp is None else dp
 
+    if tangent:
+        orbit = _native_orbit(ring, ref_in, range(4), range(4),
+                              numpy.zeros((6,)), convergence, max_iterations)
+        if orbit is not None:
+            return orbit
+
     scaling = xy_step * numpy.array([1.0, 1.0, 1.0, 1.0])
     delta_matrix = numpy.zeros((6, 5), order='F')
     for i in range(4):
@@ -76,12 +103,21 @@ def _orbit_dct(ring: Lattice, dct: float = None, guess: Orbit = None, **kwargs):
     convergence = kwargs.pop('convergence', DConstant.OrbConvergence)
     max_iterations = kwargs.pop('max_iterations', DConstant.OrbMaxIter)
     xy_step = kwargs.pop('XYStep', DConstant.XYStep)
+    tangent = kwargs.pop('tangent', False)
     rem = kwargs.keys()
     if len(rem) > 0:
         raise AtError(f'Unexpected keywords for orbit_dct: {", ".join(rem)}')
 
     ref_in = numpy.zeros((6,)) if guess is None else numpy.copy(guess)
 
+    if tangent:
+        theta = numpy.zeros((6,))
+        theta[5] = 0.0 if dct is None else dct
+        orbit = _native_orbit(ring, ref_in, [0, 1, 2, 3, 5], range(5),
+                              theta, convergence, max_iterations)
+        if orbit is not None:
+            return orbit
+
     scaling = xy_step * numpy.array([1.0, 1.0, 1.0, 1.0, 1.0])
     delta_matrix = numpy.zeros((6, 6), order='F')
     for i in range(5):
@@ -176,6 +212,9 @@ def find_orbit4(ring: Lattice, dp: float = None, refpts: Refpts = None, *,
           Default: :py:data:`DConstant.OrbMaxIter <.DConstant>`
         XYStep (float):          Step size.
           Default: :py:data:`DConstant.XYStep <.DConstant>`
+        tangent (bool):         Use the Newton solver of the C extension,
+          with the exact Jacobian given by tangent tracking, if all the
+          elements support it. Default: :py:obj:`False`
 
     Returns:
         orbit0:         (6,) closed orbit vector at the entrance of the
@@ -268,6 +307,9 @@ def find_sync_orbit(ring: Lattice, dct: float = None, refpts: Refpts = None, *,
           Default: :py:data:`DConstant.OrbMaxIter <.DConstant>`
         XYStep (float):         Step size.
           Default: :py:data:`DConstant.XYStep <.DConstant>`
+        tangent (bool):         Use the Newton solver of the C extension,
+          with the exact Jacobian given by tangent tracking, if all the
+          elements support it. Default: :py:obj:`False`
 
     Returns:
         orbit0:         (6,) closed orbit vector at the entrance of the
@@ -310,6 +352,7 @@ def _orbit6(ring: Lattice, cavpts=None, guess=None, keep_lattice=False,
     xy_step = kwargs.pop('XYStep', DConstant.XYStep)
     dp_step = kwargs.pop('DPStep', DConstant.DPStep)
     method = kwargs.pop('method', ELossMethod.TRACKING)
+    tangent = kwargs.pop('tangent', False)
     rem = kwargs.keys()
     if len(rem) > 0:
         raise AtError(f'Unexpected keywords for orbit6: {", ".join(rem)}')
@@ -332,6 +375,12 @@ def _orbit6(ring: Lattice, cavpts=None, guess=None, keep_lattice=False,
     theta = numpy.zeros((6,))
     theta[5] = ring.beta * clight * harm_number / f_rf - l0
 
+    if tangent:
+        orbit = _native_orbit(ring, ref_in, range(6), range(6),
+                              theta, convergence, max_iterations)
+        if orbit is not None:
+            return orbit
+
     scaling = xy_step * numpy.array([1.0, 1.0, 1.0, 1.0, 0.0, 0.0]) + \
         dp_step * numpy.array([0.0, 0.0, 0.0, 0.0, 1.0, 1.0])
     delta_matrix = numpy.asfortranarray(
@@ -428,6 +477,9 @@ def find_orbit6(ring: Lattice, refpts: Refpts = None, *,
           Default: :py:data:`DConstant.XYStep <.DConstant>`
         DPStep (float):       Momentum step size.
           Default: :py:data:`DConstant.DPStep <.DConstant>`
+        tangent (bool):       Use the Newton solver of the C extension,
+          with the exact Jacobian given by tangent tracking, if all the
+          elements support it. Default: :py:obj:`False`
         method (ELossMethod): Method for energy loss computation.
           See :py:class:`.ELossMethod`.
         cavpts (Refpts):      Cavity location. If :py:obj:`None`, use all
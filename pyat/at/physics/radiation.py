@@ -1,7 +1,7 @@
 """
 Radiation and equilibrium emittances
 """
-from math import sin, cos, tan, sqrt, sinh, cosh, pi
+from math import pi
 import numpy
 from typing import Tuple
 from scipy.linalg import inv, det, solve_sylvester
@@ -9,13 +9,15 @@ from at.lattice import Lattice, check_radiation, Refpts
 from at.lattice import Dipole, Wiggler, DConstant, Multipole, QuantumDiffusion
 from at.lattice import get_refpts, get_value_refpts
 from at.lattice import uint32_refpts, set_value_refpts
-from at.tracking import lattice_pass
-from at.physics import find_orbit6, find_m66, find_elem_m66, Orbit
-from at.physics import find_mpole_raddiff_matrix, get_tunes_damp
+from at.tracking import lattice_pass, beam
+from at.tracking.atpass import variantpass
+from at.physics import find_orbit, find_orbit6, find_m66, find_elem_m66
+from at.physics import Orbit
+from at.physics import find_cumul_raddiff_matrices, get_tunes_damp
 from at.physics import ELossMethod
 
-__all__ = ['ohmi_envelope', 'get_radiation_integrals', 'quantdiffmat',
-           'gen_quantdiff_elem', 'tapering']
+__all__ = ['ohmi_envelope', 'envelope_track', 'get_radiation_integrals',
+           'quantdiffmat', 'gen_quantdiff_elem', 'tapering']
 
 _NSTEP = 60  # nb slices in a wiggler period
 
@@ -30,14 +32,24 @@ ENVELOPE_DTYPE = [('r66', numpy.float64, (6, 6)),
                   ('emitXYZ', numpy.float64, (3,))]
 
 
-def _cumulb(it):
-    """accumulate diffusion matrices"""
-    cumul = numpy.zeros((6, 6))
-    yield cumul
-    for el, orbin, b in it:
-        m = find_elem_m66(el, orbin)
-        cumul = m.dot(cumul).dot(m.T) + b
-        yield cumul
+def _elem_m66s(ring: Lattice, orbs: numpy.ndarray) -> numpy.ndarray:
+    """
+    transfer matrices of all the elements, tracked in parallel as
+    one-element lattice variants
+    """
+    xy_step = DConstant.XYStep
+    dg = 0.5 * xy_step * numpy.eye(6)
+    dmat = numpy.concatenate((dg, -dg), axis=1)
+    rin = numpy.asfortranarray(orbs.T[:, numpy.newaxis, :] +
+                               dmat[:, :, numpy.newaxis])
+    try:
+        variantpass([[elem] for elem in ring], rin, 1,
+                    energy=ring.energy, particle=ring.particle)
+    except ValueError:
+        # Collective or python PassMethods: element by element
+        return numpy.stack([find_elem_m66(elem, orb)
+                            for elem, orb in zip(ring, orbs)], axis=0)
+    return ((rin[:, :6] - rin[:, 6:]) / xy_step).transpose(2, 0, 1)
 
 
 def _dmatr(ring: Lattice, orbit: Orbit = None, keep_lattice: bool = False):
@@ -56,11 +68,8 @@ def _dmatr(ring: Lattice, orbit: Orbit = None, keep_lattice: bool = False):
     orbs = numpy.squeeze(
         lattice_pass(ring, orbit.copy(order='K'), refpts=allrefs,
                      keep_lattice=keep_lattice), axis=(1, 3)).T
-    b0 = numpy.zeros((6, 6))
-    bb = [find_mpole_raddiff_matrix(elem, elemorb, energy)
-          if elem.PassMethod.endswith('RadPass') else b0
-          for elem, elemorb in zip(ring, orbs)]
-    bbcum = numpy.stack(list(_cumulb(zip(ring, orbs, bb))), axis=0)
+    ms = _elem_m66s(ring, orbs[:nelems])
+    bbcum = find_cumul_raddiff_matrices(ring, orbs, ms, energy)
     return bbcum, orbs
 
 
@@ -225,62 +234,6 @@ def get_radiation_integrals(ring, dp: float = None, twiss=None, **kwargs)\
         i5 (float): :math:`I_5 \quad [m^{-1}]`
     """
 
-    def dipole_radiation(elem: Dipole, vini, vend):
-        """Analytically compute the radiation integrals in dipoles"""
-        beta0 = vini.beta[0]
-        alpha0 = vini.alpha[0]
-        eta0 = vini.dispersion[0]
-        etap0 = vini.dispersion[1]
-
-        ll = elem.Length
-        theta = elem.BendingAngle
-        rho = ll / theta
-        rho2 = rho * rho
-        k2 = elem.K + 1.0 / rho2
-        eps1 = tan(elem.EntranceAngle) / rho
-        eps2 = tan(elem.ExitAngle) / rho
-
-        eta3 = vend.dispersion[0]
-        alpha1 = alpha0 - beta0 * eps1
-        gamma1 = (1.0 + alpha1 * alpha1) / beta0
-        etap1 = etap0 + eta0 * eps1
-        etap2 = vend.dispersion[1] - eta3 * eps2
-
-        h0 = gamma1*eta0*eta0 + 2.0*alpha1*eta0*etap1 + beta0*etap1*etap1
-
-        if k2 != 0.0:
-            if k2 > 0.0:  # Focusing
-                kl = ll * sqrt(k2)
-                ss = sin(kl) / kl
-                cc = cos(kl)
-            else:  # Defocusing
-                kl = ll * sqrt(-k2)
-                ss = sinh(kl) / kl
-                cc = cosh(kl)
-            eta_ave = (theta - (etap2 - etap1)) / k2 / ll
-            bb = 2.0 * (alpha1 * eta0 + beta0 * etap1) * rho
-            aa = -2.0 * (alpha1 * etap1 + gamma1 * eta0) * rho
-            h_ave = h0 + (aa * (1.0 - ss) + bb * (1.0 - cc) / ll
-                          + gamma1 * (3.0 - 4.0 * ss + ss * cc) / 2.0 / k2
-                          - alpha1 * (1.0 - cc) ** 2 / k2 / ll
-                          + beta0 * (1.0 - ss * cc) / 2.0
-                          ) / k2 / rho2
-        else:
-            eta_ave = 0.5 * (eta0 + eta3) - ll * ll / 12.0 / rho
-            hp0 = 2.0 * (alpha1 * eta0 + beta0 * etap1) / rho
-            h2p0 = 2.0 * (-alpha1 * etap1 + beta0 / rho - gamma1 * eta0) / rho
-            h_ave = h0 + hp0 * ll / 2.0 + h2p0 * ll * ll / 6.0 \
-                - alpha1 * ll ** 3 / 4.0 / rho2 \
-                + gamma1 * ll ** 4 / 20.0 / rho2
-
-        di1 = eta_ave * ll / rho
-        di2 = ll / rho2
-        di3 = ll / abs(rho) / rho2
-        di4 = eta_ave * ll * (2.0 * elem.K + 1.0 / rho2) / rho \
-            - (eta0 * eps1 + eta3 * eps2) / rho
-        di5 = h_ave * ll / abs(rho) / rho2
-        return numpy.array([di1, di2, di3, di4, di5])
-
     def wiggler_radiation(elem: Wiggler, dini):
         """Compute the radiation integrals in wigglers with the following
         approximations:
@@ -348,14 +301,173 @@ def get_radiation_integrals(ring, dp: float = None, twiss=None, **kwargs)\
     elif len(twiss) != len(ring) + 1:
         raise ValueError('length of Twiss data should be {0}'
                          .format(len(ring) + 1))
-    for (el, vini, vend) in zip(ring, twiss[:-1], twiss[1:]):
-        if isinstance(el, Dipole) and el.BendingAngle != 0.0:
-            integrals += dipole_radiation(el, vini, vend)
-        elif isinstance(el, Wiggler) and el.PassMethod != 'DriftPass':
-            integrals += wiggler_radiation(el, vini)
+    # The strengths are read from the elements, which may have been
+    # modified in place
+    dipidx = numpy.array([i for i, el in enumerate(ring) if
+                          isinstance(el, Dipole) and el.BendingAngle != 0.0],
+                         dtype=numpy.intp)
+    if len(dipidx) > 0:
+        dipoles = [ring[i] for i in dipidx]
+        integrals += numpy.sum(_dipole_radiation(
+            *(numpy.array([getattr(el, attr, 0.0) for el in dipoles])
+              for attr in _DIPOLE_ATTRS),
+            twiss[dipidx], twiss[dipidx+1]), axis=1)
+    cols = ring.columns
+    names, codes = cols.passmethods
+    drift = names.index('DriftPass') if 'DriftPass' in names else -1
+    wigglers = cols.instances(Wiggler) & (codes != drift)
+    for iw in numpy.flatnonzero(wigglers):
+        integrals += wiggler_radiation(ring[iw], twiss[iw])
     return tuple(integrals)
 
 
+def envelope_track(ring: Lattice, sigma0, nturns: int = 1,
+                   centroid: Orbit = None, *, orbit: Orbit = None,
+                   particles: int = 0, keep_lattice: bool = False):
+    r"""Turn-by-turn tracking of the beam envelope
+
+    :py:func:`envelope_track` propagates the centroid and the second
+    moments of a beam over *nturns* turns with the linear one-turn map
+    around the closed orbit and, if radiation is ON, the diffusion matrix
+    of the ring [1]_:
+
+    .. math::
+
+       \Sigma_{n+1} = M\Sigma_nM^T + B, \quad
+       ar{z}_{n+1} - z_0 = M(ar{z}_n - z_0)
+
+    where :math:`M` is the one-turn matrix, :math:`B` is the cumulative
+    diffusion matrix computed by :py:func:`.find_cumul_raddiff_matrices`,
+    and :math:`z_0` is the closed orbit. This is much faster than tracking
+    macro-particles and reducing their moments, and exact for a linear
+    lattice. It may be used for emittance transients, injection matching
+    or radiation damping. With *particles* > 0, macro-particles generated
+    from the initial moments are tracked instead, to include the
+    nonlinear effects, and their moments are returned.
+
+    Parameters:
+        ring:           Lattice description
+        sigma0:         (6, 6) initial :math:`\Sigma`-matrix, around the
+          centroid (see :py:func:`.sigma_matrix`)
+        nturns:         Number of turns
+        centroid:       (6,) initial centroid. Default: the closed orbit
+        orbit:          Avoids looking for the closed orbit if it is
+          already known ((6,) array)
+        particles:      If > 0, number of tracked macro-particles.
+          Default: 0, envelope tracking
+        keep_lattice:   Assume no lattice change since the previous tracking.
+          Default: False
+
+    Returns:
+        sigma (ndarray):    (nturns+1, 6, 6) :math:`\Sigma`-matrix at the
+          start of the ring, from the initial one to the one after
+          *nturns* turns
+        centroid (ndarray): (nturns+1, 6) centroid
+
+    References:
+        .. [1] K.Ohmi et al. Phys.Rev.E. Vol.49. (1994)
+    """
+    sigma0 = numpy.asarray(sigma0, dtype=float)
+    if orbit is None:
+        orbit, _ = find_orbit(ring, keep_lattice=keep_lattice)
+        keep_lattice = True
+    if centroid is None:
+        centroid = orbit
+    sigma = numpy.empty((nturns + 1, 6, 6))
+    cent = numpy.empty((nturns + 1, 6))
+    sigma[0] = sigma0
+    cent[0] = centroid
+
+    if particles > 0:
+        rin = numpy.asfortranarray(beam(particles, sigma0, orbit=centroid))
+        rout = lattice_pass(ring, rin, nturns, keep_lattice=keep_lattice)
+        rout = rout[:, :, 0, :]
+        alive = numpy.isfinite(rout[0])
+        for turn in range(nturns):
+            z = rout[:, alive[:, turn], turn]
+            cent[turn+1] = numpy.mean(z, axis=1)
+            sigma[turn+1] = numpy.cov(z, bias=True)
+        return sigma, cent
+
+    if ring.is_6d and ring.radiation:
+        bbcum, orbs = _dmatr(ring, orbit=orbit, keep_lattice=keep_lattice)
+        bcum = bbcum[-1]
+        keep_lattice = True
+    else:
+        bcum = numpy.zeros((6, 6))
+    mring, _ = find_m66(ring, orbit=orbit, keep_lattice=keep_lattice)
+    for turn in range(nturns):
+        sigma[turn+1] = mring @ sigma[turn] @ mring.T + bcum
+        cent[turn+1] = orbit + mring @ (cent[turn] - orbit)
+    return sigma, cent
+
+
+_DIPOLE_ATTRS = ('Length', 'BendingAngle', 'K', 'EntranceAngle',
+                 'ExitAngle')
+
+
+def _dipole_radiation(ll, theta, kquad, entrance_angle, exit_angle,
+                      vini, vend):
+    """Analytically compute the radiation integrals in dipoles
+
+    All the arguments are arrays over the selected dipoles. Returns a
+    (5, ndipoles) array of the contributions to I1..I5
+    """
+    beta0 = vini.beta[:, 0]
+    alpha0 = vini.alpha[:, 0]
+    eta0 = vini.dispersion[:, 0]
+    etap0 = vini.dispersion[:, 1]
+
+    rho = ll / theta
+    rho2 = rho * rho
+    k2 = kquad + 1.0 / rho2
+    eps1 = numpy.tan(entrance_angle) / rho
+    eps2 = numpy.tan(exit_angle) / rho
+
+    eta3 = vend.dispersion[:, 0]
+    alpha1 = alpha0 - beta0 * eps1
+    gamma1 = (1.0 + alpha1 * alpha1) / beta0
+    etap1 = etap0 + eta0 * eps1
+    etap2 = vend.dispersion[:, 1] - eta3 * eps2
+
+    h0 = gamma1*eta0*eta0 + 2.0*alpha1*eta0*etap1 + beta0*etap1*etap1
+
+    # Without gradient
+    eta_ave = 0.5 * (eta0 + eta3) - ll * ll / 12.0 / rho
+    hp0 = 2.0 * (alpha1 * eta0 + beta0 * etap1) / rho
+    h2p0 = 2.0 * (-alpha1 * etap1 + beta0 / rho - gamma1 * eta0) / rho
+    h_ave = h0 + hp0 * ll / 2.0 + h2p0 * ll * ll / 6.0 \
+        - alpha1 * ll ** 3 / 4.0 / rho2 \
+        + gamma1 * ll ** 4 / 20.0 / rho2
+
+    # With gradient: focusing (k2 > 0) or defocusing (k2 < 0)
+    grad = (k2 != 0.0)
+    if numpy.any(grad):
+        kg, lg, rg, r2g = k2[grad], ll[grad], rho[grad], rho2[grad]
+        a1g, b0g, g1g = alpha1[grad], beta0[grad], gamma1[grad]
+        e0g, ep1g = eta0[grad], etap1[grad]
+        kl = lg * numpy.sqrt(numpy.abs(kg))
+        foc = (kg > 0.0)
+        ss = numpy.where(foc, numpy.sin(kl), numpy.sinh(kl)) / kl
+        cc = numpy.where(foc, numpy.cos(kl), numpy.cosh(kl))
+        eta_ave[grad] = (theta[grad] - (etap2[grad] - ep1g)) / kg / lg
+        bb = 2.0 * (a1g * e0g + b0g * ep1g) * rg
+        aa = -2.0 * (a1g * ep1g + g1g * e0g) * rg
+        h_ave[grad] = h0[grad] + (aa * (1.0 - ss) + bb * (1.0 - cc) / lg
+                                  + g1g * (3.0 - 4.0 * ss + ss * cc) / 2.0 / kg
+                                  - a1g * (1.0 - cc) ** 2 / kg / lg
+                                  + b0g * (1.0 - ss * cc) / 2.0
+                                  ) / kg / r2g
+
+    di1 = eta_ave * ll / rho
+    di2 = ll / rho2
+    di3 = ll / numpy.abs(rho) / rho2
+    di4 = eta_ave * ll * (2.0 * kquad + 1.0 / rho2) / rho \
+        - (eta0 * eps1 + eta3 * eps2) / rho
+    di5 = h_ave * ll / numpy.abs(rho) / rho2
+    return numpy.stack((di1, di2, di3, di4, di5))
+
+
 @check_radiation(True)
 def quantdiffmat(ring: Lattice, orbit: Orbit = None) -> numpy.ndarray:
     """Computes the diffusion matrix of the whole ring
@@ -449,5 +561,6 @@ def tapering(ring: Lattice, multipoles: bool = True,
 
 
 Lattice.ohmi_envelope = ohmi_envelope
+Lattice.envelope_track = envelope_track
 Lattice.get_radiation_integrals = get_radiation_integrals
 Lattice.tapering = tapering
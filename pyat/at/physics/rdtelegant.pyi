@@ -0,0 +1,15 @@
+"""Stub file for the 'rdtelegant' extension"""
+
+import numpy as np
+from typing import Dict, Optional, Sequence, Tuple, Union
+
+def drivingterms(s: np.ndarray, betax: np.ndarray, betay: np.ndarray,
+                 etax: np.ndarray, phix: np.ndarray, phiy: np.ndarray,
+                 a2l: np.ndarray, b2l: np.ndarray, b3l: np.ndarray,
+                 b4l: np.ndarray, tunes: Sequence[float],
+                 chromatic: bool = True, coupling: bool = True,
+                 geometric1: bool = True, geometric2: bool = True,
+                 tuneshifts: bool = True, nperiods: int = 1, *,
+                 b3l_ref: Optional[np.ndarray] = None,
+                 pairs_ref: Optional[np.ndarray] = None
+                 ) -> Tuple[Dict[str, Union[complex, float]], np.ndarray]: ...
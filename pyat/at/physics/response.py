@@ -0,0 +1,151 @@
+"""
+Orbit response matrices
+"""
+import numpy
+from ..lattice import Lattice, Refpts, Orbit, DConstant, AtError
+from ..lattice import get_uint32_index
+from .orbit import find_orbit
+from .matrix import find_m44, find_m66
+from .revolution import get_slip_factor
+
+__all__ = ['find_orbit_response']
+
+
+def _kick_response(mt, tb, tin, tout, bpms, correctors):
+    """Closed orbit shifts at the BPMs for unit kicks at the correctors
+
+    For a kick e at a location where the transfer matrix from the origin is
+    T, the closed orbit at the origin is (I - M)^-1.T^-1.e. The orbit at a
+    BPM is obtained by the transfer matrix from the origin, with one more
+    turn for the BPMs upstream of the corrector. The kicks of thick
+    correctors are averaged between their entrance and exit.
+    """
+    nd = mt.shape[0]
+    e = numpy.zeros((len(correctors), nd, 2))
+    e[:, 1, 0] = 1.0
+    e[:, 3, 1] = 1.0
+    # Kicks propagated back to the origin: (ncor, nd, 2)
+    u = 0.5 * (numpy.linalg.solve(tin, e) + numpy.linalg.solve(tout, e))
+    p = numpy.linalg.solve(numpy.identity(nd) - mt, u)
+    zdown = numpy.einsum('bij,cjk->bcik', tb[:, [0, 2], :], p)
+    zup = zdown - numpy.einsum('bij,cjk->bcik', tb[:, [0, 2], :], u)
+    upstream = bpms[:, numpy.newaxis] <= correctors[numpy.newaxis, :]
+    z = numpy.where(upstream[:, :, numpy.newaxis, numpy.newaxis], zup, zdown)
+    # (nbpm, ncor, plane, kick) -> (plane, nbpm, kick, ncor)
+    return numpy.moveaxis(z, (0, 1, 2, 3), (1, 3, 0, 2))
+
+
+def find_orbit_response(ring: Lattice, bpms: Refpts, correctors: Refpts, *,
+                        dp: float = None, dct: float = None, df: float = None,
+                        orbit: Orbit = None, dispersion: bool = False,
+                        frequency: bool = False, keep_lattice: bool = False,
+                        **kwargs):
+    r"""Orbit response matrix
+
+    :py:func:`find_orbit_response` computes the closed orbit shifts at the
+    BPMs for kicks of all the correctors together, from the one-turn matrix
+    and the transfer matrices to the BPMs and correctors. The lattice is
+    tracked only for the closed orbit and the transfer matrices, whatever the
+    number of correctors, instead of one orbit search per corrector.
+
+    For a kick :math:`\theta` of a corrector at a location where the
+    transfer matrix from the origin is :math:`T_c`, the closed orbit change
+    at a BPM is
+
+    .. math:: \Delta z_b = T_b\left[(I-M)^{-1} - \epsilon I\right]
+       T_c^{-1}\theta
+
+    where :math:`M` is the one-turn matrix at the origin and
+    :math:`\epsilon` is 1 for BPMs upstream of the corrector, 0 otherwise.
+    This is the linear response: it is exact for small kicks.
+
+    If :py:attr:`~.Lattice.is_6d` is :py:obj:`True`, the 6x6 matrices are
+    used and the response includes the momentum shift imposed by the RF
+    synchronism, otherwise the momentum deviation is constant.
+
+    Parameters:
+        ring:           Lattice description
+        bpms:           Observation points.
+          See ":ref:`Selecting elements in a lattice <refpts>`"
+        correctors:     Kicked elements. The kick of a thick element is
+          assumed uniformly distributed along the element, as given by its
+          ``KickAngle`` attribute
+        dp:             Momentum deviation. Defaults to :py:obj:`None`
+        dct:            Path lengthening. Defaults to :py:obj:`None`
+        df:             Deviation of RF frequency. Defaults to
+          :py:obj:`None`
+        orbit:          Avoids looking for the closed orbit if it is
+          already known ((6,) array)
+        dispersion:     If :py:obj:`True`, append the orbit response to the
+          momentum deviation [m]
+        frequency:      If :py:obj:`True`, append the orbit response to the
+          RF frequency [m/Hz], deduced from the dispersion column with the
+          slip factor
+        keep_lattice:   Assume no lattice change since the previous tracking.
+          Default: :py:obj:`False`
+
+    Keyword Args:
+        tangent (bool): Compute the transfer matrices in a single pass with
+          :py:func:`.lattice_tangent_pass`. Default: :py:obj:`False`
+        XYStep (float): Step size.
+          Default: :py:data:`DConstant.XYStep <.DConstant>`
+        DPStep (float): Momentum step size.
+          Default: :py:data:`DConstant.DPStep <.DConstant>`
+
+    Returns:
+        orm:    (2*Nbpms, 2*Ncorrectors [+1] [+1]) response matrix [m/rad].
+          The rows are the horizontal positions at all the BPMs followed by
+          the vertical ones. The columns are the horizontal kicks of all the
+          correctors followed by the vertical kicks, then the dispersion and
+          frequency columns if requested
+
+    See also:
+        :py:func:`.find_orbit`, :py:func:`.find_m44`, :py:func:`.find_m66`
+    """
+    dp_step = kwargs.pop('DPStep', DConstant.DPStep)
+    if ring.is_6d:
+        kwargs['DPStep'] = dp_step
+    brefs = get_uint32_index(ring, bpms)
+    crefs = get_uint32_index(ring, correctors)
+    if len(crefs) == 0:
+        raise AtError('No corrector selected')
+    if orbit is None:
+        orbit, _ = find_orbit(ring, dp=dp, dct=dct, df=df,
+                              keep_lattice=keep_lattice, **kwargs)
+        keep_lattice = True
+
+    # One pass through the lattice for all the transfer matrices
+    allrefs, inv = numpy.unique(numpy.concatenate((brefs, crefs, crefs+1)),
+                                return_inverse=True)
+    nb, nc = len(brefs), len(crefs)
+    if ring.is_6d:
+        mt, ms = find_m66(ring, refpts=allrefs, orbit=orbit,
+                          keep_lattice=keep_lattice, dp=dp, dct=dct, df=df,
+                          **kwargs)
+    else:
+        mt, ms = find_m44(ring, dp=dp, refpts=allrefs, orbit=orbit,
+                          keep_lattice=keep_lattice, **kwargs)
+    tb = ms[inv[:nb]]
+    tin = ms[inv[nb:nb+nc]]
+    tout = ms[inv[nb+nc:]]
+    resp = _kick_response(mt, tb, tin, tout, brefs, crefs)
+    columns = [resp.reshape(2*nb, 2*nc)]
+
+    if dispersion or frequency:
+        dp0 = orbit[4]
+        _, op = find_orbit(ring, refpts=brefs, dp=dp0 + 0.5*dp_step,
+                           **kwargs)
+        _, om = find_orbit(ring, refpts=brefs, dp=dp0 - 0.5*dp_step,
+                           **kwargs)
+        disp = ((op[:, [0, 2]] - om[:, [0, 2]]) / dp_step).T.reshape(-1, 1)
+        if dispersion:
+            columns.append(disp)
+        if frequency:
+            rg = ring.disable_6d(copy=True) if ring.is_6d else ring
+            etac = get_slip_factor(rg, dp=dp0)
+            frf = ring.get_rf_frequency()
+            columns.append(-disp / (frf * etac))
+    return numpy.concatenate(columns, axis=1)
+
+
+Lattice.find_orbit_response = find_orbit_response
@@ -3,7 +3,9 @@ Tracking functions
 """
 from ..lattice import DConstant
 from .atpass import reset_rng, common_rng, thread_rng
+from .atpass import new_context, free_context
 from .patpass import patpass
+from .gpupass import gpupass
 from .track import *
 from .particles import *
 from .utils import *
@@ -1,7 +1,7 @@
 """Stub file for the 'atpass' extension"""
 
 import numpy as np
-from typing import List, Optional
+from typing import List, Optional, Tuple
 from at.lattice import Element, Particle
 
 def atpass(line: List[Element], r_in: np.ndarray, nturns: int,
@@ -13,13 +13,52 @@ def atpass(line: List[Element], r_in: np.ndarray, nturns: int,
            reuse: bool = False,
            omp_num_thread: int = 0,
            losses: bool = False,
-           bunch_spos = None, bunch_current = None): ...
+           bunch_spos = None, bunch_current = None,
+           soa: bool = False,
+           context: Optional[object] = None,
+           omp_persistent: bool = False,
+           compact_turns: int = 0,
+           update: bool = False,
+           profile: bool = False,
+           record_stride: int = 1,
+           record_window: int = 0,
+           record_trigger: Optional[np.ndarray] = None,
+           float32: bool = False): ...
 
 def elempass(element: Element, r_in,
              energy: Optional[float] = None,
              particle: Optional[Particle] = None,
              ): ...
 
+def tangentpass(line: List[Element], r_in: np.ndarray,
+                refpts: Optional[np.ndarray] = None,
+                turn: int = 0,
+                energy: Optional[float] = None,
+                particle: Optional[Particle] = None,
+                ) -> np.ndarray: ...
+
+def closedorbit(line: List[Element], r_in: np.ndarray,
+                rows: np.ndarray, cols: np.ndarray, theta: np.ndarray,
+                convergence: float = 1.e-12,
+                max_iterations: int = 20,
+                turn: int = 0,
+                energy: Optional[float] = None,
+                particle: Optional[Particle] = None,
+                ) -> Tuple[np.ndarray, int]: ...
+
+def variantpass(lines: List[List[Element]], r_in: np.ndarray, nturns: int,
+                refpts: Optional[np.ndarray] = None,
+                turn: int = 0,
+                energy: Optional[float] = None,
+                particle: Optional[Particle] = None,
+                omp_num_threads: int = 0,
+                ) -> np.ndarray: ...
+
+def new_context(*, seed: Optional[int] = None) -> object: ...
+def free_context(context: object) -> None: ...
 def reset_rng(rank: int = 0, seed: Optional[int] = None) -> None: ...
 def common_rng() -> float: ...
 def thread_rng() -> float: ...
+def get_rng_state(*, context: Optional[object] = None) -> bytes: ...
+def set_rng_state(state: bytes, *,
+                  context: Optional[object] = None) -> None: ...
@@ -0,0 +1,804 @@
+"""
+Tracking on a CUDA or ROCm GPU with CuPy.
+
+The particle coordinates stay on the device for all the turns, in the
+structure-of-arrays layout (x[], px[], y[], ...), and each element is tracked
+by a GPU kernel, one thread per particle. The coordinates are copied back to
+the host only at the reference points and at the end of the tracking, with
+the loss data.
+
+The kernels are the double-precision equivalents of the C integrators
+``IdentityPass``, ``DriftPass``, ``StrMPoleSymplectic4Pass``,
+``BndMPoleSymplectic4Pass``, ``BndMPoleSymplectic4E2Pass``,
+``RFCavityPass``, ``CorrectorPass``, ``AperturePass`` and ``EAperturePass``.
+Lattices using other PassMethods or options fall back to the CPU tracking
+of :py:func:`.lattice_pass`.
+"""
+import math
+from warnings import warn
+import numpy as np
+from ..constants import clight
+from ..lattice import AtWarning, Element, Refpts, End, get_uint32_index
+from .track import fortran_align, lattice_pass
+from typing import Iterable, Optional
+
+__all__ = ['gpupass']
+
+_BLOCK_SIZE = 128
+
+# Keywords of lattice_pass handled on the GPU
+_GPU_KWARGS = {'turn', 'losses', 'energy', 'particle', 'keep_lattice',
+               'unfold_beam', 'omp_num_threads'}
+
+# Optional misalignment and aperture fields: name, offset in the geometry
+# array of the element, size and flag
+_GEOMETRY = (('T1', 0, 6, 1), ('T2', 6, 6, 2), ('R1', 12, 36, 4),
+             ('R2', 48, 36, 8), ('RApertures', 84, 4, 16),
+             ('EApertures', 88, 2, 32))
+
+_KERNELS = r"""
+extern "C" {
+
+#define DRIFT1    0.6756035959798286638
+#define DRIFT2   -0.1756035959798286639
+#define KICK1     1.351207191959657328
+#define KICK2    -1.702414383919314656
+#define TWOPI     6.28318530717959
+#define C0        2.99792458e8
+#define LIMIT_AMPLITUDE 1.0
+
+/* Optional fields stored in the geometry array g of an element */
+#define USE_T1  1
+#define USE_T2  2
+#define USE_R1  4
+#define USE_R2  8
+#define USE_RAP 16
+#define USE_EAP 32
+#define G_T1  0
+#define G_T2  6
+#define G_R1  12
+#define G_R2  48
+#define G_RAP 84
+#define G_EAP 88
+
+/* Loss recording, common to all the kernels */
+#define LOSS_ARGS bool *lost, unsigned int *lturn, unsigned int *lelem, \
+    double *lcoord, int elem, int turn
+#define LOSS_CALL lost, lturn, lelem, lcoord, elem, turn
+
+__device__ static double inf_value(void)
+{
+    return __longlong_as_double(0x7ff0000000000000LL);
+}
+
+__device__ static double nan_value(void)
+{
+    return __longlong_as_double(0x7ff8000000000000LL);
+}
+
+__device__ static bool load(double *p, const double *r, int np, int c,
+        const bool *lost)
+/* Coordinates of particle c, false for lost particles */
+{
+    int k;
+    if (c >= np || lost[c]) return false;
+    for (k=0; k<6; k++) p[k] = r[k*np+c];
+    return true;
+}
+
+__device__ static void store(double *r, int np, int c, const double *p,
+        LOSS_ARGS)
+/* Store the coordinates of particle c, or mark it as lost as checkiflost
+   in at.c */
+{
+    int k;
+    for (k=0; k<6; k++) {
+        if (!isfinite(p[k]) || ((fabs(p[k])>LIMIT_AMPLITUDE) && k<5)) {
+            lost[c] = true;
+            lturn[c] = turn;
+            lelem[c] = elem;
+            for (k=0; k<6; k++) {
+                lcoord[6*c+k] = p[k];
+                r[k*np+c] = 0.0;
+            }
+            r[c] = nan_value();
+            return;
+        }
+    }
+    for (k=0; k<6; k++) r[k*np+c] = p[k];
+}
+
+__device__ static void addvv(double *r, const double *dr)
+{
+    int i;
+    for (i=0; i<6; i++) r[i] += dr[i];
+}
+
+__device__ static void multmv(double *r, const double *A)
+{
+    int i, j;
+    double temp[6];
+    for (i=0; i<6; i++) {
+        temp[i] = 0;
+        for (j=0; j<6; j++) temp[i] += A[i+j*6]*r[j];
+    }
+    for (i=0; i<6; i++) r[i] = temp[i];
+}
+
+__device__ static void misalign_in(double *r, int flags, const double *g)
+{
+    if (flags & USE_T1) addvv(r, g+G_T1);
+    if (flags & USE_R1) multmv(r, g+G_R1);
+}
+
+__device__ static void misalign_out(double *r, int flags, const double *g)
+{
+    if (flags & USE_R2) multmv(r, g+G_R2);
+    if (flags & USE_T2) addvv(r, g+G_T2);
+}
+
+__device__ static void apertures(double *r, int flags, const double *g)
+/* Same as checkiflostAperture */
+{
+    bool out = false;
+    if (flags & USE_RAP) {
+        const double *limits = g+G_RAP;
+        out = (r[0]<limits[0]) | (r[0]>limits[1]) |
+              (r[2]<limits[2]) | (r[2]>limits[3]);
+    }
+    if (flags & USE_EAP) {
+        double xnorm = r[0]/g[G_EAP];
+        double znorm = r[2]/g[G_EAP+1];
+        out |= ((xnorm*xnorm + znorm*znorm) >= 1);
+    }
+    if (out) r[5] = inf_value();
+}
+
+__device__ static void drift6(double *r, double L)
+{
+    double p_norm = 1/(1+r[4]);
+    double NormL = L*p_norm;
+    r[0] += NormL*r[1];
+    r[2] += NormL*r[3];
+    r[5] += NormL*p_norm*(r[1]*r[1]+r[3]*r[3])/2;
+}
+
+__device__ static void fastdrift(double *r, double NormL)
+{
+    r[0] += NormL*r[1];
+    r[2] += NormL*r[3];
+    r[5] += NormL*(r[1]*r[1]+r[3]*r[3])/(2*(1+r[4]));
+}
+
+__device__ static void strthinkick(double *r, const double *A,
+        const double *B, double L, int max_order)
+{
+    int i;
+    double ReSum = B[max_order];
+    double ImSum = A[max_order];
+    double ReSumTemp;
+    for (i=max_order-1; i>=0; i--) {
+        ReSumTemp = ReSum*r[0] - ImSum*r[2] + B[i];
+        ImSum = ImSum*r[0] + ReSum*r[2] + A[i];
+        ReSum = ReSumTemp;
+    }
+    r[1] -= L*ReSum;
+    r[3] += L*ImSum;
+}
+
+__device__ static void bndthinkick(double *r, const double *A,
+        const double *B, double L, double irho, int max_order)
+{
+    int i;
+    double ReSum = B[max_order];
+    double ImSum = A[max_order];
+    double ReSumTemp;
+    for (i=max_order-1; i>=0; i--) {
+        ReSumTemp = ReSum*r[0] - ImSum*r[2] + B[i];
+        ImSum = ImSum*r[0] + ReSum*r[2] + A[i];
+        ReSum = ReSumTemp;
+    }
+    r[1] -= L*(ReSum-(r[4]-r[0]*irho)*irho);
+    r[3] += L*ImSum;
+    r[5] += L*irho*r[0];
+}
+
+__device__ static void edge_fringe(double *r, double inv_rho,
+        double edge_angle, double fint, double gap, int method, bool is_exit)
+/* Same as edge_fringe_entrance and edge_fringe_exit */
+{
+    double fringecorr, fx, fy;
+    if ((fint==0.0) || (gap==0.0) || (method==0))
+        fringecorr = 0.0;
+    else {
+        double sedge = sin(edge_angle);
+        double cedge = cos(edge_angle);
+        fringecorr = inv_rho*gap*fint*(1+sedge*sedge)/cedge;
+    }
+    fx = inv_rho*tan(edge_angle);
+    if (method==2)
+        fy = inv_rho*tan(edge_angle-fringecorr/(1+r[4]))/(1+r[4]);
+    else if (method==3)
+        fy = is_exit ? inv_rho*tan(edge_angle-fringecorr-r[1]/(1+r[4])) :
+                    inv_rho*tan(edge_angle-fringecorr+r[1]/(1+r[4]));
+    else
+        fy = inv_rho*tan(edge_angle-fringecorr/(1+r[4]));
+    r[1] += r[0]*fx;
+    r[3] -= r[2]*fy;
+}
+
+__device__ static void edge_fringe2(double *r, double inv_rho,
+        double edge_angle, double fint, double gap, double h, double K1,
+        bool is_exit)
+/* Same as edge_fringe2A (entrance) and edge_fringe2B (exit) */
+{
+    double fx = inv_rho*tan(edge_angle);
+    double dpsi = inv_rho*gap*fint*(1+sin(edge_angle)*sin(edge_angle))/
+                  cos(edge_angle);
+    double psi_bar = edge_angle-dpsi;
+    double fy = inv_rho*tan(psi_bar);
+    double hr = inv_rho;
+    double tpsi = tan(edge_angle), tpsib = tan(psi_bar);
+    double spsi = 1.0/cos(edge_angle);
+    double T111, T234, T414, T212, T313, T133, T423, T211, T233, T413;
+    double r0 = r[0], r2 = r[2], r1 = r[1];
+    if (is_exit) {
+        T111 = 0.5*hr*tpsi*tpsi;
+        T234 = 0.5*hr*tpsi*tpsi;
+        T133 = -0.5*hr*spsi*spsi;
+        T211 = 0.5*hr*h*spsi*spsi*spsi + K1*tpsi -
+               0.5*hr*hr*tpsi*tpsi*tpsi;
+        T233 = -0.5*hr*h*spsi*spsi*spsi - K1*tpsi -
+               0.5*hr*hr*tpsi*tpsib*tpsib;
+        T413 = -0.5*hr*h*spsi*spsi*spsi - K1*tpsi +
+               0.5*hr*hr*tpsi*(spsi*spsi);
+    }
+    else {
+        T111 = -0.5*hr*tpsi*tpsi;
+        T234 = -0.5*hr*tpsi*tpsi;
+        T133 = 0.5*hr*spsi*spsi;
+        T211 = 0.5*hr*h*spsi*spsi*spsi + K1*tpsi;
+        T233 = -0.5*hr*h*spsi*spsi*spsi - K1*tpsi +
+               0.5*hr*hr*tpsi*(tpsib*tpsib+spsi*spsi);
+        T413 = -0.5*hr*h*spsi*spsi*spsi - K1*tpsi;
+    }
+    T414 = T234;
+    T212 = -T111;
+    T313 = -T234;
+    T423 = -T133;
+    r[0] += T111*r[0]*r[0]+T133*r[2]*r[2];
+    r[1] += r0*fx + 2*T212*r0*r[1]+2*T234*r[2]*r[3]+T211*r0*r0+
+            T233*r[2]*r[2];
+    r[2] += 2*T313*r0*r[2];
+    r[3] += -r2*fy + 2*T414*r0*r[3]+2*T413*r0*r2+2*T423*r1*r2;
+}
+
+__device__ static void bendhxdrift6(double *r, double L, double h)
+{
+    double hs = h*L;
+    double i1pd = 1.0/(1+r[4]);
+    double x = r[0], px = r[1], py = r[3];
+    r[0] += (1+h*x)*px*i1pd*L+1/4.*hs*L*(px*px-py*py)*i1pd*i1pd;
+    r[1] -= hs*(px*px+py*py)*i1pd/2.0;
+    r[2] += (1.0+h*x)*i1pd*py*L*(1.+px*hs/2.0);
+    r[5] += (1.0+h*x)*i1pd*i1pd*L/2.0*(px*px+py*py);
+}
+
+__device__ static void bndthinkick_e2(double *r, const double *B, double L,
+        double h, int max_order)
+/* Kick of BndMPoleSymplectic4E2Pass: PolynomA is neglected */
+{
+    int i;
+    double ReSum = B[max_order];
+    double ImSum = 0;
+    double ReSumTemp;
+    double K1 = B[1];
+    double K2 = (max_order>=2) ? B[2] : 0;
+    for (i=max_order-1; i>=0; i--) {
+        ReSumTemp = ReSum*r[0] - ImSum*r[2] + B[i];
+        ImSum = ImSum*r[0] + ReSum*r[2];
+        ReSum = ReSumTemp;
+    }
+    r[1] -= L*(-h*r[4] + ReSum + h*(h*r[0]+K1*(r[0]*r[0]-0.5*r[2]*r[2])+
+            K2*(r[0]*r[0]*r[0]-4.0/3.0*r[0]*r[2]*r[2])));
+    r[3] += L*(ImSum+h*(K1*r[0]*r[2]+4.0/3.0*K2*r[0]*r[0]*r[2]+
+            (h/6.0*K1-K2/3.0)*r[2]*r[2]*r[2]));
+    r[5] += L*h*r[0];
+}
+
+__global__ void identity(double *r, int np, const double *g, int flags,
+        LOSS_ARGS)
+/* IdentityPass, AperturePass, EAperturePass */
+{
+    int c = blockDim.x*blockIdx.x + threadIdx.x;
+    double p[6];
+    if (!load(p, r, np, c, lost)) return;
+    if (!isnan(p[0])) {
+        misalign_in(p, flags, g);
+        apertures(p, flags, g);
+        misalign_out(p, flags, g);
+    }
+    store(r, np, c, p, LOSS_CALL);
+}
+
+__global__ void drift(double *r, int np, const double *g, int flags,
+        double le, LOSS_ARGS)
+/* DriftPass */
+{
+    int c = blockDim.x*blockIdx.x + threadIdx.x;
+    double p[6];
+    if (!load(p, r, np, c, lost)) return;
+    if (!isnan(p[0])) {
+        misalign_in(p, flags, g);
+        apertures(p, flags, g);
+        drift6(p, le);
+        apertures(p, flags, g);
+        misalign_out(p, flags, g);
+    }
+    store(r, np, c, p, LOSS_CALL);
+}
+
+__global__ void strmpole(double *r, int np, const double *g, int flags,
+        double le, const double *A, const double *B, int max_order,
+        int num_int_steps, LOSS_ARGS)
+/* StrMPoleSymplectic4Pass */
+{
+    int c = blockDim.x*blockIdx.x + threadIdx.x;
+    double p[6];
+    if (!load(p, r, np, c, lost)) return;
+    if (!isnan(p[0])) {
+        int m;
+        double SL = le/num_int_steps;
+        double K1 = SL*KICK1;
+        double K2 = SL*KICK2;
+        double norm = 1.0/(1.0+p[4]);
+        double NormL1 = SL*DRIFT1*norm;
+        double NormL2 = SL*DRIFT2*norm;
+        misalign_in(p, flags, g);
+        apertures(p, flags, g);
+        for (m=0; m<num_int_steps; m++) {
+            fastdrift(p, NormL1);
+            strthinkick(p, A, B, K1, max_order);
+            fastdrift(p, NormL2);
+            strthinkick(p, A, B, K2, max_order);
+            fastdrift(p, NormL2);
+            strthinkick(p, A, B, K1, max_order);
+            fastdrift(p, NormL1);
+        }
+        apertures(p, flags, g);
+        misalign_out(p, flags, g);
+    }
+    store(r, np, c, p, LOSS_CALL);
+}
+
+__global__ void bndmpole(double *r, int np, const double *g, int flags,
+        double le, const double *A, const double *B, int max_order,
+        int num_int_steps, double irho, const double *edge,
+        int fringe_entrance, int fringe_exit, LOSS_ARGS)
+/* BndMPoleSymplectic4Pass. edge: entrance angle, exit angle, FringeInt1,
+   FringeInt2, FullGap */
+{
+    int c = blockDim.x*blockIdx.x + threadIdx.x;
+    double p[6];
+    if (!load(p, r, np, c, lost)) return;
+    if (!isnan(p[0])) {
+        int m;
+        double SL = le/num_int_steps;
+        double K1 = SL*KICK1;
+        double K2 = SL*KICK2;
+        double p_norm = 1.0/(1.0+p[4]);
+        double NormL1 = SL*DRIFT1*p_norm;
+        double NormL2 = SL*DRIFT2*p_norm;
+        misalign_in(p, flags, g);
+        apertures(p, flags, g);
+        edge_fringe(p, irho, edge[0], edge[2], edge[4], fringe_entrance,
+                    false);
+        for (m=0; m<num_int_steps; m++) {
+            fastdrift(p, NormL1);
+            bndthinkick(p, A, B, K1, irho, max_order);
+            fastdrift(p, NormL2);
+            bndthinkick(p, A, B, K2, irho, max_order);
+            fastdrift(p, NormL2);
+            bndthinkick(p, A, B, K1, irho, max_order);
+            fastdrift(p, NormL1);
+        }
+        edge_fringe(p, irho, edge[1], edge[3], edge[4], fringe_exit, true);
+        apertures(p, flags, g);
+        misalign_out(p, flags, g);
+    }
+    store(r, np, c, p, LOSS_CALL);
+}
+
+__global__ void bndmpole_e2(double *r, int np, const double *g, int flags,
+        double le, const double *B, int max_order, int num_int_steps,
+        double irho, const double *edge, LOSS_ARGS)
+/* BndMPoleSymplectic4E2Pass. edge: entrance angle, exit angle, FringeInt1,
+   FringeInt2, FullGap, H1, H2 */
+{
+    int c = blockDim.x*blockIdx.x + threadIdx.x;
+    double p[6];
+    if (!load(p, r, np, c, lost)) return;
+    if (!isnan(p[0])) {
+        int m;
+        double SL = le/num_int_steps;
+        double L1 = SL*DRIFT1;
+        double L2 = SL*DRIFT2;
+        double K1 = SL*KICK1;
+        double K2 = SL*KICK2;
+        bool fringe1 = (edge[2] != 0) && (edge[4] != 0);
+        bool fringe2 = (edge[3] != 0) && (edge[4] != 0);
+        misalign_in(p, flags, g);
+        apertures(p, flags, g);
+        edge_fringe2(p, irho, edge[0], fringe1 ? edge[2] : 0,
+                     fringe1 ? edge[4] : 0, edge[5], B[1], false);
+        for (m=0; m<num_int_steps; m++) {
+            bendhxdrift6(p, L1, irho);
+            bndthinkick_e2(p, B, K1, irho, max_order);
+            bendhxdrift6(p, L2, irho);
+            bndthinkick_e2(p, B, K2, irho, max_order);
+            bendhxdrift6(p, L2, irho);
+            bndthinkick_e2(p, B, K1, irho, max_order);
+            bendhxdrift6(p, L1, irho);
+        }
+        edge_fringe2(p, irho, edge[1], fringe2 ? edge[3] : 0,
+                     fringe2 ? edge[4] : 0, edge[6], B[1], true);
+        apertures(p, flags, g);
+        misalign_out(p, flags, g);
+    }
+    store(r, np, c, p, LOSS_CALL);
+}
+
+__global__ void rfcavity(double *r, int np, double le, double nv,
+        double freq, double h, double lag, double philag, double T0,
+        LOSS_ARGS)
+/* RFCavityPass */
+{
+    int c = blockDim.x*blockIdx.x + threadIdx.x;
+    double p[6];
+    if (!load(p, r, np, c, lost)) return;
+    if (!isnan(p[0])) {
+        if (le == 0)
+            p[4] += -nv*sin(TWOPI*freq*((p[5]-lag)/C0 -
+                            (h/freq-T0)*turn) - philag);
+        else {
+            drift6(p, le/2);
+            p[4] += -nv*sin(TWOPI*freq*((p[5]-lag)/C0 -
+                            (h/freq-T0)*turn) - philag);
+            drift6(p, le/2);
+        }
+    }
+    store(r, np, c, p, LOSS_CALL);
+}
+
+__global__ void corrector(double *r, int np, double xkick, double ykick,
+        double len, LOSS_ARGS)
+/* CorrectorPass */
+{
+    int c = blockDim.x*blockIdx.x + threadIdx.x;
+    double p[6];
+    if (!load(p, r, np, c, lost)) return;
+    if (!isnan(p[0])) {
+        if (len == 0) {
+            p[1] += xkick;
+            p[3] += ykick;
+        }
+        else {
+            double p_norm = 1/(1+p[4]);
+            double NormL = len*p_norm;
+            p[5] += NormL*p_norm*(xkick*xkick/3 + ykick*ykick/3 +
+                    p[1]*p[1] + p[3]*p[3] + p[1]*xkick + p[3]*ykick)/2;
+            p[0] += NormL*(p[1]+xkick/2);
+            p[1] += xkick;
+            p[2] += NormL*(p[3]+ykick/2);
+            p[3] += ykick;
+        }
+    }
+    store(r, np, c, p, LOSS_CALL);
+}
+
+}
+"""
+
+_cupy = None
+_module = None
+
+
+def _get_cupy():
+    """CuPy module if a GPU is available, otherwise :py:obj:`None`"""
+    global _cupy
+    if _cupy is None:
+        try:
+            import cupy
+            if cupy.cuda.runtime.getDeviceCount() > 0:
+                _cupy = cupy
+            else:
+                _cupy = False
+        except Exception:
+            _cupy = False
+    return _cupy or None
+
+
+def _get_kernels(cp):
+    """Compiled kernels, built on first use"""
+    global _module
+    if _module is None:
+        _module = cp.RawModule(code=_KERNELS)
+    return _module
+
+
+def _geometry(cp, **fields):
+    """Device array of the misalignments and apertures, and their flags"""
+    geom = np.zeros(90)
+    flags = 0
+    for name, offset, size, flag in _GEOMETRY:
+        value = fields.get(name)
+        if value is not None:
+            geom[offset:offset+size] = np.ravel(value, order='F')
+            flags |= flag
+    return cp.asarray(geom), np.int32(flags)
+
+
+def _misalignments(cp, elem: Element):
+    """Geometry of an element with optional misalignments and apertures"""
+    return _geometry(cp, **{name: getattr(elem, name, None)
+                            for name, *_ in _GEOMETRY})
+
+
+def _polynoms(cp, elem: Element):
+    """Device copies of PolynomA and PolynomB including KickAngle"""
+    max_order = int(elem.MaxOrder)
+    a = np.zeros(max_order + 1)
+    b = np.zeros(max_order + 1)
+    pola = np.ravel(elem.PolynomA)[:max_order+1]
+    polb = np.ravel(elem.PolynomB)[:max_order+1]
+    a[:len(pola)] = pola
+    b[:len(polb)] = polb
+    kick = getattr(elem, 'KickAngle', None)
+    if kick is not None:
+        # Same as atKickPolynom
+        b[0] -= np.sin(kick[0]) / np.float64(elem.Length)
+        a[0] += np.sin(kick[1]) / np.float64(elem.Length)
+    return cp.asarray(a), cp.asarray(b), np.int32(max_order)
+
+
+def _quad_fringe(elem: Element) -> bool:
+    return bool(getattr(elem, 'FringeQuadEntrance', 0) or
+                getattr(elem, 'FringeQuadExit', 0))
+
+
+def _identity(cp, elem, params):
+    return 'identity', _misalignments(cp, elem)
+
+
+def _aperture(cp, elem, params):
+    return 'identity', _geometry(cp, RApertures=elem.Limits)
+
+
+def _eaperture(cp, elem, params):
+    return 'identity', _geometry(cp, EApertures=elem.Axes)
+
+
+def _drift(cp, elem, params):
+    return 'drift', _misalignments(cp, elem) + (np.float64(elem.Length),)
+
+
+def _strmpole(cp, elem, params):
+    if _quad_fringe(elem) or getattr(elem, 'IntegratorScheme', 0):
+        return None
+    return 'strmpole', (_misalignments(cp, elem) + (np.float64(elem.Length),) +
+                        _polynoms(cp, elem) +
+                        (np.int32(elem.NumIntSteps),))
+
+
+def _bndmpole(cp, elem, params):
+    if _quad_fringe(elem):
+        return None
+    edge = np.array([elem.EntranceAngle, elem.ExitAngle,
+                     getattr(elem, 'FringeInt1', 0.0),
+                     getattr(elem, 'FringeInt2', 0.0),
+                     getattr(elem, 'FullGap', 0.0)], dtype=float)
+    return 'bndmpole', (_misalignments(cp, elem) + (np.float64(elem.Length),) +
+                        _polynoms(cp, elem) +
+                        (np.int32(elem.NumIntSteps),
+                         np.float64(elem.BendingAngle / elem.Length),
+                         cp.asarray(edge),
+                         np.int32(getattr(elem, 'FringeBendEntrance', 1)),
+                         np.int32(getattr(elem, 'FringeBendExit', 1))))
+
+
+def _bndmpole_e2(cp, elem, params):
+    edge = np.array([elem.EntranceAngle, elem.ExitAngle,
+                     getattr(elem, 'FringeInt1', 0.0),
+                     getattr(elem, 'FringeInt2', 0.0),
+                     getattr(elem, 'FullGap', 0.0),
+                     getattr(elem, 'H1', 0.0),
+                     getattr(elem, 'H2', 0.0)], dtype=float)
+    _, b, max_order = _polynoms(cp, elem)
+    return 'bndmpole_e2', (_misalignments(cp, elem) + (np.float64(elem.Length),
+                                                  b, max_order,
+                                                  np.int32(elem.NumIntSteps),
+                                                  np.float64(elem.BendingAngle
+                                                             / elem.Length),
+                                                  cp.asarray(edge)))
+
+
+def _rfcavity(cp, elem, params):
+    t0 = params['T0']
+    # Same as round() in RFCavityPass
+    harm = math.floor(elem.Frequency * t0 + 0.5)
+    return 'rfcavity', (np.float64(elem.Length),
+                        np.float64(elem.Voltage / elem.Energy),
+                        np.float64(elem.Frequency), np.float64(harm),
+                        np.float64(getattr(elem, 'TimeLag', 0.0)),
+                        np.float64(getattr(elem, 'PhaseLag', 0.0)),
+                        np.float64(t0))
+
+
+def _corrector(cp, elem, params):
+    return 'corrector', (np.float64(elem.KickAngle[0]),
+                         np.float64(elem.KickAngle[1]),
+                         np.float64(elem.Length))
+
+
+_PASSMETHODS = {
+    'IdentityPass': _identity,
+    'AperturePass': _aperture,
+    'EAperturePass': _eaperture,
+    'DriftPass': _drift,
+    'StrMPoleSymplectic4Pass': _strmpole,
+    'BndMPoleSymplectic4Pass': _bndmpole,
+    'BndMPoleSymplectic4E2Pass': _bndmpole_e2,
+    'RFCavityPass': _rfcavity,
+    'CorrectorPass': _corrector,
+}
+
+
+def _revolution_time(lattice, **kwargs) -> float:
+    """T0 as computed in at.c"""
+    length = sum(getattr(elem, 'Length', 0.0) for elem in lattice)
+    energy = kwargs.get('energy', getattr(lattice, 'energy', None))
+    particle = kwargs.get('particle', getattr(lattice, 'particle', None))
+    rest_energy = 0.0
+    if energy is not None and particle is not None:
+        rest_energy = particle.rest_energy
+    if rest_energy == 0.0:
+        return length / clight
+    else:
+        gamma0 = energy / rest_energy
+        beta0 = math.sqrt(gamma0 * gamma0 - 1.0) / gamma0
+        return length / beta0 / clight
+
+
+def _gpu_elements(cp, lattice, **kwargs):
+    """Kernels and arguments of the elements, or the reason for using the
+    CPU"""
+    params = dict(T0=_revolution_time(lattice, **kwargs))
+    kernels = _get_kernels(cp)
+    gpuelems = []
+    for elem in lattice:
+        passmethod = getattr(elem, 'PassMethod', None)
+        build = _PASSMETHODS.get(passmethod)
+        desc = None if build is None else build(cp, elem, params)
+        if desc is None:
+            return None, '{0}: {1} not available on the GPU'.format(
+                elem.FamName, passmethod)
+        name, args = desc
+        gpuelems.append((kernels.get_function(name), args))
+    return gpuelems, None
+
+
+def _gpu_pass(cp, gpuelems, r_in, nturns, refpts, turn=0, losses=False):
+    npart = r_in.shape[1]
+    nelems = len(gpuelems)
+    rout = np.zeros((6, npart, len(refpts), nturns), order='F')
+    rdev = cp.asarray(np.ascontiguousarray(r_in))
+    lost = cp.zeros(npart, dtype=bool)
+    lturn = cp.zeros(npart, dtype=np.uint32)
+    lelem = cp.zeros(npart, dtype=np.uint32)
+    lcoord = cp.zeros((npart, 6))
+    rargs = (rdev, np.int32(npart))
+    largs = (lost, lturn, lelem, lcoord)
+    grid = ((npart + _BLOCK_SIZE - 1) // _BLOCK_SIZE,)
+    block = (_BLOCK_SIZE,)
+    for t in range(nturns):
+        iref = 0
+        tn = np.int32(turn + t)
+        for ielem, (kernel, args) in enumerate(gpuelems):
+            while iref < len(refpts) and refpts[iref] == ielem:
+                rout[:, :, iref, t] = rdev.get()
+                iref += 1
+            kernel(grid, block, rargs + args + largs + (np.int32(ielem), tn))
+        while iref < len(refpts) and refpts[iref] == nelems:
+            rout[:, :, iref, t] = rdev.get()
+            iref += 1
+    r_in[:] = rdev.get()
+    if losses:
+        lossdict = dict(islost=lost.get(), turn=lturn.get(),
+                        elem=lelem.get(), coord=np.asfortranarray(
+                            lcoord.get().T))
+        return rout, lossdict
+    else:
+        return rout
+
+
+@fortran_align
+def gpupass(lattice: Iterable[Element], r_in, nturns: int = 1,
+            refpts: Refpts = End, **kwargs):
+    """
+    Implementation of :py:func:`.lattice_pass` on a GPU.
+
+    The particles are tracked on a CUDA or ROCm device using
+    :py:mod:`cupy`, and stay on the device for all the turns. The lattice
+    must use only the following PassMethods: ``IdentityPass``,
+    ``DriftPass``, ``StrMPoleSymplectic4Pass``, ``BndMPoleSymplectic4Pass``,
+    ``BndMPoleSymplectic4E2Pass``, ``RFCavityPass``, ``CorrectorPass``,
+    ``AperturePass`` and ``EAperturePass``, without quadrupole fringe fields
+    or non-default *IntegratorScheme*. Otherwise, or if no GPU is available,
+    the tracking is done on the CPU by :py:func:`.lattice_pass`.
+
+    The results agree with :py:func:`.lattice_pass` up to the rounding
+    errors due to the contraction of multiply-adds on the device.
+
+    Parameters:
+        lattice:                list of elements
+        r_in:                   (6, N) array: input coordinates of N particles.
+          *r_in* is modified in-place and reports the coordinates at
+          the end of the element. For the best efficiency, *r_in*
+          should be given as F_CONTIGUOUS numpy array.
+        nturns:                 number of turns to be tracked
+        refpts:                 Selects the location of coordinates output.
+          See ":ref:`Selecting elements in a lattice <refpts>`"
+
+    Keyword arguments:
+        turn (int):             Starting turn number. The turn number is
+          necessary to compute the absolute path length used in
+          RFCavityPass.
+        losses (bool):          Boolean to activate loss maps output
+
+    The following keyword arguments overload the Lattice values
+
+    Keyword arguments:
+        particle (Particle):    circulating particle.
+          Default: *lattice.particle* if existing,
+          otherwise *Particle('relativistic')*
+        energy (float):         lattice energy. Default 0.
+
+    The other keyword arguments of :py:func:`.lattice_pass` select the
+    tracking on the CPU.
+
+    Returns:
+        r_out: (6, N, R, T) array containing output coordinates of N particles
+          at R reference points for T turns.
+        loss_map: If *losses* is :py:obj:`True`: dictionary with the
+          keys **islost**, **turn**, **elem** and **coord** described in
+          :py:func:`.lattice_pass`
+
+    .. note::
+
+       * The coordinates are copied from the device at each reference
+         point of each turn: use :pycode:`refpts=None` to copy them only at
+         the end of the tracking, in *r_in*.
+       * The double-precision performance of the consumer GPUs is much lower
+         than their single-precision performance.
+    """
+    if not isinstance(lattice, list):
+        lattice = list(lattice)
+    cp = _get_cupy()
+    reason: Optional[str] = None
+    others = set(kwargs) - _GPU_KWARGS
+    if cp is None:
+        reason = 'no GPU available'
+    elif r_in.dtype != np.float64:
+        reason = 'single precision not available on the GPU'
+    elif others:
+        reason = '{0} not available on the GPU'.format(', '.join(
+            sorted(others)))
+    else:
+        gpuelems, reason = _gpu_elements(cp, lattice, **kwargs)
+    if reason is not None:
+        warn(AtWarning('{0}: use the CPU'.format(reason)))
+        return lattice_pass(lattice, r_in, nturns, refpts, **kwargs)
+    refs = get_uint32_index(lattice, refpts)
+    return _gpu_pass(cp, gpuelems, r_in, nturns, refs,
+                     turn=kwargs.get('turn', 0),
+                     losses=kwargs.get('losses', False))
@@ -8,6 +8,9 @@ from ..lattice import AtError, AtWarning, Lattice, Orbit, random
 
 __all__ = ['beam', 'sigma_matrix']
 
+# Number of particles processed at once
+_CHUNK_SIZE = 100000
+
 
 # noinspection PyPep8Naming
 def sigma_matrix(ring: Lattice = None, **kwargs):
@@ -118,8 +121,15 @@ def sigma_matrix(ring: Lattice = None, **kwargs):
         orbit = kwargs.pop('orbit', None)
         if orbit is None:
             orbit = np.mean(beam, axis=1)
-        beam -= orbit.reshape((6, 1))
-        sigmat = (beam @ beam.T) / beam.shape[1]
+        # Second moments around the orbit, accumulated by chunks
+        # without modifying the beam
+        orbit = np.reshape(orbit, (6, 1))
+        nparts = beam.shape[1]
+        sigmat = np.zeros((6, 6))
+        for i1 in range(0, nparts, _CHUNK_SIZE):
+            dv = beam[:, i1:i1 + _CHUNK_SIZE] - orbit
+            sigmat += dv @ dv.T
+        sigmat /= nparts
 
     elif 'twiss_in' in kwargs:
         twin = kwargs.pop('twiss_in')
@@ -161,17 +171,27 @@ def sigma_matrix(ring: Lattice = None, **kwargs):
     return sigmat
 
 
-def beam(nparts: int, sigma, orbit: Orbit = None):
+def beam(nparts: int, sigma, orbit: Orbit = None, *,
+         out: np.ndarray = None, chunk_size: int = _CHUNK_SIZE):
     r"""
     Generates an array of random particles according to the given
     :math:`\Sigma`-matrix
 
+    The particles are generated by chunks of *chunk_size* directly
+    in the output array, so that no temporary array of the full size is
+    needed.
+
     Parameters:
         nparts:         Number of particles
         sigma:          :math:`\Sigma`-matrix as calculated by
           :py:func:`sigma_matrix`
         orbit:          An orbit can be provided to give a center of
-          mass offset to the distribution
+          mass offset to the distribution. If *orbit* is a (6, nbunch)
+          array, particle *i* is centred on ``orbit[:, i % nbunch]``, the
+          bunch order used for multi-bunch tracking
+        out:            (6, *nparts*) Fortran-ordered array filled in place.
+          Default: a new array is allocated
+        chunk_size:     Number of particles generated at once
 
     Returns:
         particle_dist:  a (6, *nparts*) matrix of coordinates
@@ -182,8 +202,6 @@ def beam(nparts: int, sigma, orbit: Orbit = None):
         except LinAlgError:
             return np.zeros((2, 2))
 
-    v = random.thread.normal(size=(sigma.shape[1], nparts))
-
     try:
         # Try full 6x6 matrix
         lmat = cholesky(sigma)
@@ -212,9 +230,22 @@ def beam(nparts: int, sigma, orbit: Orbit = None):
                 lmat[4:, 4:] = _get_single_plane(slice(4, 6))
                 print("uncoupled")
 
-    particle_dist = np.asfortranarray(lmat @ v)
-
+    if out is None:
+        out = np.empty((6, nparts), order='F')
+    elif out.shape != (6, nparts):
+        raise AtError('out must have the shape (6, {0})'.format(nparts))
     if orbit is not None:
-        particle_dist += orbit.reshape((6, 1))
-
-    return particle_dist
+        orbit = np.reshape(orbit, (6, -1))
+    rng = random.thread
+    v = np.empty((min(chunk_size, nparts), 6))
+    for i1 in range(0, nparts, chunk_size):
+        i2 = min(i1 + chunk_size, nparts)
+        vc = v[:i2 - i1]
+        rng.standard_normal(out=vc)
+        # The coordinates of each particle are consecutive random numbers,
+        # so the distribution does not depend on chunk_size
+        np.matmul(lmat, vc.T, out=out[:, i1:i2])
+        if orbit is not None:
+            out[:, i1:i2] += orbit[:, np.arange(i1, i2) % orbit.shape[1]]
+
+    return out
@@ -1,15 +1,22 @@
 """
 Simple parallelisation of atpass() using multiprocessing.
+
+The particle coordinates and the tracking output are exchanged with the
+worker processes through shared memory, each worker tracking a slice of the
+particles in place. The workers are kept alive between calls and keep their
+copy of the lattice, which is transmitted only when it changes.
 """
-from functools import partial
+import atexit
 import multiprocessing
+import pickle
+from multiprocessing import shared_memory
 # noinspection PyProtectedMember
 from ..lattice.utils import get_uint32_index
 from ..lattice import AtWarning, Element, DConstant, random
 from ..lattice import Refpts, End
 from warnings import warn
 from .atpass import reset_rng, atpass as _atpass
-from .track import fortran_align
+from .track import fortran_align, _sink_chunk_turns, _reduce_output
 from typing import Iterable, Optional, List
 import numpy as np
 
@@ -17,55 +24,145 @@ __all__ = ['patpass']
 
 _imax = np.iinfo(int).max
 
-_globring: Optional[List[Element]] = None
+# Parent process: persistent pool and pickled lattice in shared memory
+_pool = None
+_pool_key = None
+_ring_shm: Optional[shared_memory.SharedMemory] = None
+_ring_size = 0
+_ring_version = 0
 
+# Worker processes: cached lattice
+_worker_version = -1
+_worker_ring: Optional[List[Element]] = None
 
-def format_results(results, r_in, losses):
-    lin, lout = zip(*results)
-    # Update r_in with values at the end of tracking
-    np.concatenate(lin, out=r_in, axis=1)
-    if losses:
-        lout, ldic = zip(*lout)
-        keys = ldic[0].keys()
-        dicout = dict(((k, np.hstack([li[k] for li in ldic])) for k in keys))
-        return np.concatenate(lout, axis=1), dicout
-    else:
-        return np.concatenate(lout, axis=1)
 
+def _shared_array(shm, shape):
+    """Fortran-ordered array on a shared memory block"""
+    return np.ndarray(shape, dtype=np.float64, buffer=shm.buf, order='F')
 
-def _atpass_fork(seed, rank, rin, **kwargs):
-    """Single forked job"""
-    reset_rng(rank, seed=seed)
-    result = _atpass(_globring, rin, **kwargs)
-    return rin, result
 
+def _new_shm(nbytes):
+    return shared_memory.SharedMemory(create=True, size=max(nbytes, 1))
 
-def _atpass_spawn(ring, seed, rank, rin, **kwargs):
-    """Single spawned job"""
+
+def _atpass_shared(ring_desc, rin_desc, rout_desc, seed, rank, islice,
+                   **kwargs):
+    """Single job: track a slice of the shared particle array"""
+    global _worker_version, _worker_ring
+    ring_name, ring_size, version = ring_desc
+    if version != _worker_version:
+        shm = shared_memory.SharedMemory(name=ring_name)
+        try:
+            _worker_ring = pickle.loads(shm.buf[:ring_size])
+        finally:
+            shm.close()
+        _worker_version = version
+        kwargs['reuse'] = False
     reset_rng(rank, seed=seed)
-    result = _atpass(ring, rin, **kwargs)
-    return rin, result
+    rin_shm = shared_memory.SharedMemory(name=rin_desc[0])
+    rout_shm = shared_memory.SharedMemory(name=rout_desc[0])
+    try:
+        r_in = _shared_array(rin_shm, rin_desc[1])
+        r_out = _shared_array(rout_shm, rout_desc[1])
+        # a slice of columns of a Fortran array is contiguous
+        result = _atpass(_worker_ring, r_in[:, islice], **kwargs)
+        if kwargs.get('losses', False):
+            result, lossdict = result
+        else:
+            lossdict = None
+        r_out[:, islice] = result
+        del r_in, r_out, result
+    finally:
+        rin_shm.close()
+        rout_shm.close()
+    return lossdict
+
+
+def _shutdown():
+    """Stop the worker processes and release the shared lattice"""
+    global _pool, _pool_key, _ring_shm
+    if _pool is not None:
+        _pool.terminate()
+        _pool = None
+        _pool_key = None
+    if _ring_shm is not None:
+        _ring_shm.close()
+        _ring_shm.unlink()
+        _ring_shm = None
 
 
-def _pass(ring, r_in, pool_size, start_method, **kwargs):
+atexit.register(_shutdown)
+
+
+def _get_pool(pool_size, start_method):
+    """Persistent pool of worker processes"""
+    global _pool, _pool_key
     ctx = multiprocessing.get_context(start_method)
-    # Split input in as many slices as processes
-    args = enumerate(np.array_split(r_in, pool_size, axis=1))
-    # Generate a new starting point for C RNGs
-    seed = random.common.integers(0, high=_imax, dtype=int)
-    global _globring
-    _globring = ring
-    if ctx.get_start_method() == 'fork':
-        passfunc = partial(_atpass_fork, seed, **kwargs)
+    key = (pool_size, ctx.get_start_method())
+    if _pool is None or key != _pool_key:
+        if _pool is not None:
+            _pool.terminate()
+        _pool = ctx.Pool(pool_size)
+        _pool_key = key
+    return _pool
+
+
+def _share_ring(ring, keep_lattice):
+    """Store the pickled lattice in shared memory, unless unchanged"""
+    global _ring_shm, _ring_size, _ring_version
+    if _ring_shm is None or not keep_lattice:
+        blob = pickle.dumps(ring, protocol=pickle.HIGHEST_PROTOCOL)
+        if _ring_shm is not None:
+            _ring_shm.close()
+            _ring_shm.unlink()
+        _ring_shm = _new_shm(len(blob))
+        _ring_shm.buf[:len(blob)] = blob
+        _ring_size = len(blob)
+        _ring_version += 1
+    return _ring_shm.name, _ring_size, _ring_version
+
+
+def _pass(ring, r_in, pool_size, start_method, nturns=1, refpts=None,
+          **kwargs):
+    losses = kwargs.get('losses', False)
+    keep_lattice = kwargs.pop('reuse', False)
+    npart = r_in.shape[1]
+    nref = 0 if refpts is None else len(refpts)
+    rout_shape = (6, npart, nref, nturns)
+    ring_desc = _share_ring(ring, keep_lattice)
+    rin_shm = _new_shm(r_in.nbytes)
+    rout_shm = _new_shm(8 * int(np.prod(rout_shape)))
+    try:
+        r_sh = _shared_array(rin_shm, r_in.shape)
+        r_sh[:] = r_in
+        # Split input in as many slices as processes
+        bounds = np.linspace(0, npart, pool_size + 1).astype(int)
+        slices = [slice(i0, i1) for i0, i1 in zip(bounds[:-1], bounds[1:])]
+        # Generate a new starting point for C RNGs
+        seed = random.common.integers(0, high=_imax, dtype=int)
+        pool = _get_pool(pool_size, start_method)
+        jobs = [pool.apply_async(_atpass_shared,
+                                 (ring_desc, (rin_shm.name, r_in.shape),
+                                  (rout_shm.name, rout_shape), seed, rank,
+                                  islice),
+                                 dict(kwargs, nturns=nturns, refpts=refpts,
+                                      reuse=keep_lattice))
+                for rank, islice in enumerate(slices)]
+        ldics = [job.get() for job in jobs]
+        # Gather the results
+        r_in[:] = r_sh
+        r_out = np.array(_shared_array(rout_shm, rout_shape), order='F')
+        del r_sh
+    finally:
+        for shm in (rin_shm, rout_shm):
+            shm.close()
+            shm.unlink()
+    if losses:
+        keys = ldics[0].keys()
+        dicout = dict(((k, np.hstack([li[k] for li in ldics])) for k in keys))
+        return r_out, dicout
     else:
-        passfunc = partial(_atpass_spawn, ring, seed, **kwargs)
-    # Start the parallel jobs
-    with ctx.Pool(pool_size) as pool:
-        results = pool.starmap(passfunc, args)
-    _globring = None
-    # Gather the results
-    losses = kwargs.pop('losses', False)
-    return format_results(results, r_in, losses)
+        return r_out
 
 
 @fortran_align
@@ -104,7 +201,9 @@ def patpass(lattice: Iterable[Element], r_in, nturns: int = 1,
     Keyword arguments:
         keep_lattice (bool):    Use elements persisted from a previous
           call. If :py:obj:`True`, assume that the lattice has not changed
-          since the previous call.
+          since the previous call. The worker processes are kept alive
+          between calls: with *keep_lattice*, the lattice is not sent again
+          to them.
         keep_counter (bool):    Keep the turn number from the previous
           call.
         turn (int):             Starting turn number. Ignored if
@@ -113,6 +212,13 @@ def patpass(lattice: Iterable[Element], r_in, nturns: int = 1,
         losses (bool):          Boolean to activate loss maps output
         omp_num_threads (int):  Number of OpenMP threads
           (default: automatic)
+        out:                    Output sink receiving the tracking results
+          by chunks of turns: numpy memory-mapped array, HDF5 dataset,
+          ``zarr`` array… See :py:func:`.lattice_pass`. *keep_counter* and
+          *losses* are not available in this mode. Default: :py:obj:`None`
+        chunk_turns (int):      Number of turns per chunk written in *out*.
+          Default: the last chunk dimension of *out* if available,
+          otherwise 100
 
     The following keyword arguments overload the Lattice values
 
@@ -165,6 +271,21 @@ def patpass(lattice: Iterable[Element], r_in, nturns: int = 1,
 
     if not isinstance(lattice, list):
         lattice = list(lattice)
+    out = kwargs.pop('out', None)
+    if out is not None:
+        # The processes are restarted for each chunk: set the turn explicitly
+        if kwargs.pop('losses', False) or kwargs.pop('keep_counter', False):
+            raise ValueError('losses and keep_counter are not available '
+                             'with an output sink')
+        chunk_turns = _sink_chunk_turns(out, kwargs.pop('chunk_turns', None))
+        reduce = kwargs.pop('reduce', None)
+        turn = kwargs.pop('turn', 0)
+        for first in range(0, nturns, chunk_turns):
+            nt = min(chunk_turns, nturns - first)
+            chunk = patpass(lattice, r_in, nt, refpts, pool_size,
+                            start_method, turn=turn + first, **kwargs)
+            out[..., first:first + nt] = _reduce_output(chunk, reduce)
+        return out
     refpts = get_uint32_index(lattice, refpts)
     bunch_currents = getattr(lattice, 'bunch_currents', np.zeros(1))
     bunch_spos = getattr(lattice, 'bunch_spos', np.zeros(1))
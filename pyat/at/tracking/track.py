@@ -1,17 +1,33 @@
 import numpy
 import functools
+import os
+from concurrent.futures import Executor, Future, ThreadPoolExecutor
+import pickle
+import warnings
 from warnings import warn
+from numpy.lib.format import open_memmap
 from .atpass import atpass as _atpass, elempass as _elempass
-from ..lattice import Lattice, Element, Particle, Refpts, End
+from .atpass import tangentpass as _tangentpass
+from .atpass import variantpass as _variantpass
+from .atpass import get_rng_state, set_rng_state
+from .atpass import new_context
+from ..lattice import Lattice, Element, Particle, Refpts, End, AtError
+from ..lattice import random
 from ..lattice import elements, refpts_iterator, get_uint32_index
-from typing import List, Iterable
+from typing import List, Iterable, Iterator, Optional, Sequence, Mapping
+from typing import Any, Callable
 
 
-__all__ = ['fortran_align', 'lattice_pass', 'element_pass', 'atpass',
-           'elempass']
+__all__ = ['fortran_align', 'lattice_pass', 'lattice_pass_iter',
+           'lattice_pass_file', 'lattice_pass_async', 'lattice_tangent_pass',
+           'lattice_variants_pass', 'element_pass',
+           'atpass', 'elempass']
 
 DIMENSION_ERROR = 'Input to lattice_pass() must be a 6xN array.'
 
+# Default executor of lattice_pass_async, created on first use
+_async_executor: Optional[Executor] = None
+
 
 def _set_beam_monitors(ring: List[Element], nbunch: int, nturns: int):
     monitors = list(refpts_iterator(ring, elements.BeamMoments))
@@ -62,7 +78,16 @@ def lattice_pass(lattice: Iterable[Element], r_in, nturns: int = 1,
         r_in:                   (6, N) array: input coordinates of N particles.
           *r_in* is modified in-place and reports the coordinates at
           the end of the element. For the best efficiency, *r_in*
-          should be given as F_CONTIGUOUS numpy array.
+          should be given as F_CONTIGUOUS numpy array. A
+          :py:obj:`numpy.float32` array selects the single-precision
+          tracking, halving the memory of the particles and of *r_out*.
+          The elements providing a single-precision integrator
+          (``DriftPass``, ``StrMPoleSymplectic4Pass``) compute the
+          transverse motion in float, with a compensated accumulation of
+          :math:`\delta` and :math:`c\tau`. The other elements, and those
+          with a ``DoublePrecision`` attribute set to :py:obj:`True`, are
+          tracked in double precision. Not available with *comm*,
+          *profile*, *record_trigger* or Python PassMethods.
         nturns:                 number of turns to be tracked
         refpts:                 Selects the location of coordinates output.
           See ":ref:`Selecting elements in a lattice <refpts>`"
@@ -71,6 +96,11 @@ def lattice_pass(lattice: Iterable[Element], r_in, nturns: int = 1,
         keep_lattice (bool):    Use elements persisted from a previous
           call. If :py:obj:`True`, assume that the lattice has not changed
           since the previous call.
+        update (bool):          With *keep_lattice*, initialise again only
+          the elements which were modified (see :py:meth:`.Element.touch`)
+          or replaced since the previous call, and keep the others cached.
+          A change in the number of elements forces a full rebuild.
+          Default: :py:obj:`False`
         keep_counter (bool):    Keep the turn number from the previous
           call.
         turn (int):             Starting turn number. Ignored if
@@ -79,6 +109,81 @@ def lattice_pass(lattice: Iterable[Element], r_in, nturns: int = 1,
         losses (bool):          Boolean to activate loss maps output
         omp_num_threads (int):  Number of OpenMP threads
           (default: automatic)
+        omp_persistent (bool):  Track all the turns in a single OpenMP
+          parallel region, each thread keeping a fixed chunk of particles.
+          The threads synchronise only at collective elements (wakes, beam
+          loading, beam moments…). Reduces the fork/join overhead for
+          long lattices and moderate numbers of particles. Ignored if
+          *soa* is :py:obj:`True` or if a PassMethod is implemented in
+          Python. Default: :py:obj:`False`
+        profile (bool):         Record the wall time, number of calls,
+          number of tracked particles and number of new losses of each
+          element, returned in an additional *profile* output. Disables
+          *omp_persistent*. Not available with *out* or *comm*.
+          Default: :py:obj:`False`
+        soa (bool):             Track in the structure-of-arrays layout
+          (x[], px[], y[], ...) allowing the vectorization over particles.
+          Used only if all the elements support it, otherwise ignored.
+          Default: :py:obj:`False`
+        compact_turns (int):    Every *compact_turns* turns, move the lost
+          particles after the surviving ones so that the integrators loop
+          only on the survivors. The output keeps the original particle
+          order. Ignored if *soa* or *omp_persistent* is :py:obj:`True`, for
+          multi-bunch beams and for lattices with collective elements or
+          PassMethods implemented in Python. Default: 0 (no compaction)
+        record_stride (int):    Record the coordinates at *refpts* only
+          every *record_stride* turns, counted backwards from the last
+          turn, so that the last turn is always recorded. The output
+          contains only the recorded turns. The recording options are not
+          available with *out*, *comm* or *checkpoint*. Default: 1
+        record_window (int):    Record only the last *record_window*
+          turns. Default: 0 (all turns)
+        record_trigger:         (6,) limits of the absolute coordinates.
+          Among the turns selected by *record_stride* and *record_window*,
+          keep only those where a coordinate exceeds its limit at any of
+          the *refpts*, for instance to catch particles approaching the
+          aperture. Use :py:obj:`numpy.inf` to ignore a coordinate. The
+          recorded turn numbers are returned in an additional *turns*
+          output. Default: :py:obj:`None`
+        out:                    Output sink receiving the tracking results
+          by chunks of turns instead of allocating the full output. Any
+          writable array with the shape of *r_out* is accepted: numpy
+          memory-mapped array, HDF5 dataset (``h5py``), ``zarr`` array…
+          *losses* is not available in this mode. Default: :py:obj:`None`
+        chunk_turns (int):      Number of turns per chunk written in *out*.
+          Default: the last chunk dimension of *out* if available,
+          otherwise 100
+        comm:                   MPI communicator (:py:mod:`mpi4py`). The
+          particles given on rank 0 are distributed over the ranks of
+          *comm*, each rank tracking its share with its own cached lattice,
+          and the output and loss data are gathered on rank 0. The call must
+          be made on all the ranks. *r_in* is ignored on the other ranks,
+          which return :py:obj:`None`. With :py:class:`.Collective`
+          elements, *comm* must be ``MPI.COMM_WORLD``, used by the
+          integrators for their reductions. Default: :py:obj:`None`
+        checkpoint (str):       Name of a checkpoint file. Every
+          *checkpoint_turns* turns, the particles, the turn number, the
+          random generators, the dynamic state of all the elements (wake
+          history, beam loading phasors, beam moments…) and the output
+          accumulated so far are saved in this file. If the file exists
+          when starting, the tracking resumes from the saved state and gives
+          the same results as an uninterrupted run. The file is removed at
+          the end of the tracking. Not available with *out*, *comm*,
+          *profile* or *keep_counter*, and the state must be restored with
+          the same installation and number of threads. Default:
+          :py:obj:`None`
+        checkpoint_turns (int): Number of turns between checkpoints.
+          Default: 1000
+        context:                Tracking context created by
+          :py:func:`.new_context`. Each context keeps its own cached lattice
+          for *keep_lattice* and its own turn counter for *keep_counter*, so
+          that several lattices may be tracked independently. Default: the
+          global context. When all the elements use C integrators, the GIL
+          is released while tracking, so that distinct contexts can be
+          tracked concurrently from Python threads. Threads using the
+          global context wait for each other. Each context has its own
+          random generators, so that the results of concurrent trackings
+          are reproducible.
 
     The following keyword arguments overload the Lattice values
 
@@ -113,6 +218,23 @@ def lattice_pass(lattice: Iterable[Element], r_in, nturns: int = 1,
                             particles)
           ==============    ===================================================
 
+        profile: If *profile* is :py:obj:`True`: dictionary with the
+          following keys:
+
+          ==============    ===================================================
+          **time**          (nelems,) wall time spent in each element [s]
+          **calls**         (nelems,) number of calls of each element
+          **particles**     (nelems,) total number of particles entering each
+                            element, summed over the turns
+          **lost**          (nelems,) number of particles lost in each element
+          **passmethods**   dictionary giving for each PassMethod a
+                            dictionary with the same keys, summed over the
+                            elements using it
+          ==============    ===================================================
+
+        turns: If *record_trigger* is given: (T,) array of the turn numbers
+          recorded in *r_out*
+
     .. note::
 
        * :pycode:`lattice_pass(lattice, r_in, refpts=len(line))` is the same as
@@ -136,6 +258,41 @@ def lattice_pass(lattice: Iterable[Element], r_in, nturns: int = 1,
     """
     if not isinstance(lattice, list):
         lattice = list(lattice)
+    if r_in.dtype == numpy.float32:
+        if kwargs.get('comm') is not None:
+            raise ValueError('single-precision tracking is not available '
+                             'with comm')
+        kwargs['float32'] = True
+    out = kwargs.pop('out', None)
+    profile = kwargs.get('profile', False)
+    if profile and (out is not None or kwargs.get('comm') is not None):
+        raise ValueError('profile is not available with out or comm')
+    checkpoint = kwargs.pop('checkpoint', None)
+    checkpoint_turns = kwargs.pop('checkpoint_turns', 1000)
+    trigger = kwargs.pop('record_trigger', None)
+    if trigger is not None or 'record_stride' in kwargs or \
+            'record_window' in kwargs:
+        if out is not None or checkpoint is not None or \
+                kwargs.get('comm') is not None:
+            raise ValueError('record_stride, record_window and '
+                             'record_trigger are not available with out, '
+                             'comm or checkpoint')
+        if trigger is not None:
+            kwargs['record_trigger'] = numpy.ascontiguousarray(
+                numpy.broadcast_to(numpy.asarray(trigger, dtype=float),
+                                   (6,)))
+    if checkpoint is not None:
+        if (out is not None or profile or kwargs.get('comm') is not None or
+                kwargs.get('keep_counter', False)):
+            raise ValueError('checkpoint is not available with out, comm, '
+                             'profile or keep_counter')
+        return _checkpoint_pass(lattice, r_in, nturns, refpts, checkpoint,
+                                checkpoint_turns, **kwargs)
+    if out is not None:
+        chunk_turns = _sink_chunk_turns(out, kwargs.pop('chunk_turns', None))
+        return _write_sink(out, lattice_pass_iter(lattice, r_in, nturns,
+                                                  refpts, chunk_turns,
+                                                  **kwargs))
     refs = get_uint32_index(lattice, refpts)
     # define properties if lattice is not a Lattice object
     nbunch = getattr(lattice, 'nbunch', 1)
@@ -148,11 +305,544 @@ def lattice_pass(lattice: Iterable[Element], r_in, nturns: int = 1,
     kwargs.update(bunch_currents=bunch_currents, bunch_spos=bunch_spos)
     no_bm = _set_beam_monitors(lattice, nbunch, nturns)
     kwargs['reuse'] = kwargs.pop('keep_lattice', False) and no_bm
+    comm = kwargs.pop('comm', None)
+    if comm is not None:
+        return _mpi_pass(lattice, r_in, nturns, refs, comm, nbunch, **kwargs)
     # atpass returns 6xNxRxT array
     # * N is number of particles;
     # * R is number of refpts
     # * T is the number of turns
-    return _atpass(lattice, r_in, nturns, refpts=refs, **kwargs)
+    result = _atpass(lattice, r_in, nturns, refpts=refs, **kwargs)
+    if profile:
+        prof = result[1 + bool(kwargs.get('losses', False))]
+        prof['passmethods'] = _passmethod_profile(lattice, prof)
+    return result
+
+
+_MOMENTS = ('_means', '_stds', '_skews', '_kurts')
+
+
+def _checkpoint_pass(lattice, r_in, nturns, refpts, filename, interval,
+                     **kwargs):
+    """Tracking by chunks of turns, saving the state after each chunk"""
+    assert r_in.shape[0] == 6 and r_in.ndim in (1, 2), DIMENSION_ERROR
+    r_fin = r_in if r_in.flags.f_contiguous else numpy.asfortranarray(r_in)
+    r_2d = r_fin.reshape((6, -1), order='F')
+    npart = r_2d.shape[1]
+    refs = get_uint32_index(lattice, refpts)
+    losses = kwargs.get('losses', False)
+    turn0 = kwargs.pop('turn', 0)
+    keep_lattice = kwargs.pop('keep_lattice', False)
+    monitors = [i for i, e in enumerate(lattice)
+                if isinstance(e, elements.BeamMoments)]
+
+    try:
+        with open(filename, 'rb') as f:
+            state = pickle.load(f)
+    except FileNotFoundError:
+        done = 0
+        rout = numpy.zeros((6, npart, len(refs), nturns), order='F')
+        lossmap = dict(islost=numpy.zeros(npart, dtype=bool),
+                       turn=numpy.zeros(npart, dtype=numpy.uint32),
+                       elem=numpy.zeros(npart, dtype=numpy.uint32),
+                       coord=numpy.zeros((6, npart), order='F'))
+        moments = {}
+    else:
+        if (state['nturns'] != nturns or state['turn'] != turn0 or
+                state['r'].shape != r_2d.shape or
+                len(state['elements']) != len(lattice)):
+            raise AtError('{0} does not match this tracking'.format(filename))
+        for elem, saved in zip(lattice, state['elements']):
+            if type(elem) is not type(saved) or \
+                    elem.FamName != saved.FamName:
+                raise AtError('{0} does not match this lattice'.format(
+                    filename))
+            vars(elem).clear()
+            vars(elem).update(vars(saved))
+            elem.touch()
+        set_rng_state(state['rng'], context=kwargs.get('context'))
+        random.common, random.thread = state['random']
+        r_2d[:] = state['r']
+        done = state['done']
+        rout = state['rout']
+        lossmap = state['losses']
+        moments = state['moments']
+        keep_lattice = False
+
+    while done < nturns:
+        nt = min(interval, nturns - done)
+        result = lattice_pass(lattice, r_fin, nt, refpts=refs,
+                              turn=turn0 + done, keep_lattice=keep_lattice,
+                              **kwargs)
+        if losses:
+            chunk, chunk_losses = result
+            new = chunk_losses['islost'] & ~lossmap['islost']
+            for key in ('islost', 'turn', 'elem'):
+                lossmap[key][new] = chunk_losses[key][new]
+            lossmap['coord'][:, new] = chunk_losses['coord'][:, new]
+        else:
+            chunk = result
+        rout[..., done:done + nt] = chunk
+        for i in monitors:
+            for attr in _MOMENTS:
+                value = getattr(lattice[i], attr)
+                if value.shape[-1] == 0:
+                    continue
+                full = moments.setdefault(
+                    (i, attr), numpy.zeros(value.shape[:-1] + (nturns,),
+                                           order='F'))
+                full[..., done:done + nt] = value
+        done += nt
+        keep_lattice = True
+        if done < nturns:
+            state = dict(nturns=nturns, turn=turn0, done=done, r=r_2d,
+                         elements=lattice,
+                         rng=get_rng_state(context=kwargs.get('context')),
+                         random=(random.common, random.thread), rout=rout,
+                         losses=lossmap, moments=moments)
+            tmpname = filename + '.tmp'
+            with open(tmpname, 'wb') as f:
+                pickle.dump(state, f, protocol=pickle.HIGHEST_PROTOCOL)
+            os.replace(tmpname, filename)
+
+    for (i, attr), value in moments.items():
+        setattr(lattice[i], attr, value)
+    if r_fin is not r_in:
+        r_in[:] = r_fin[:]
+    if os.path.exists(filename):
+        os.remove(filename)
+    return (rout, lossmap) if losses else rout
+
+
+def _passmethod_profile(lattice, prof):
+    """Sum the element profiles by PassMethod"""
+    methods, index = numpy.unique([elem.PassMethod for elem in lattice],
+                                  return_inverse=True)
+    sums = {key: numpy.bincount(index, weights=prof[key],
+                                minlength=len(methods))
+            for key in ('time', 'calls', 'particles', 'lost')}
+    return {pm: {key: (float(v[i]) if key == 'time' else int(v[i]))
+                 for key, v in sums.items()}
+            for i, pm in enumerate(methods)}
+
+
+def _mpi_pass(lattice, r_in, nturns, refpts, comm, nbunch, **kwargs):
+    """Track the particles of rank 0 distributed over the ranks of comm"""
+    from mpi4py import MPI
+    rank = comm.Get_rank()
+    size = comm.Get_size()
+    root = rank == 0
+    r_flat = r_in.reshape(-1, order='F') if root else None
+    npart = comm.bcast(r_flat.size // 6 if root else None, root=0)
+    # Each rank gets whole groups of nbunch particles to keep the bunch of
+    # each particle unchanged
+    ngroups = -(-npart // nbunch)
+    bounds = numpy.minimum(
+        nbunch * (numpy.arange(size+1) * ngroups // size), npart)
+    counts = [int(n) for n in numpy.diff(bounds)]
+    displs = [int(n) for n in bounds[:-1]]
+    nloc = counts[rank]
+    r_loc = numpy.empty((6, nloc), order='F')
+
+    def spec(buf, factor):
+        if root:
+            return [buf, [factor*n for n in counts], [factor*n for n in displs],
+                    MPI.DOUBLE]
+        else:
+            return None
+
+    comm.Scatterv(spec(r_flat, 6), r_loc, root=0)
+    result = _atpass(lattice, r_loc, nturns, refpts=refpts, **kwargs)
+    losses = kwargs.get('losses', False)
+    r_out, lossdict = result if losses else (result, None)
+    nout = len(refpts) * nturns
+    recv = numpy.empty(6 * npart * nout) if root else None
+    comm.Gatherv(r_out.reshape(-1, order='F'), spec(recv, 6 * nout), root=0)
+    comm.Gatherv(r_loc.reshape(-1, order='F'), spec(r_flat, 6), root=0)
+    lossdicts = comm.gather(lossdict, root=0)
+    if not root:
+        return None
+    blocks = [recv[6*nout*i0:6*nout*(i0+n)].reshape(
+              (6, n, len(refpts), nturns), order='F')
+              for i0, n in zip(displs, counts)]
+    r_out = numpy.asfortranarray(numpy.concatenate(blocks, axis=1))
+    if losses:
+        keys = lossdicts[0].keys()
+        return r_out, dict((k, numpy.hstack([ld[k] for ld in lossdicts]))
+                           for k in keys)
+    else:
+        return r_out
+
+
+def _reduce_output(rout, reduce: Optional[str]):
+    """Reduce the (6, N, R, T) output to the beam centroid or moments"""
+    if reduce is None or rout is None:
+        return rout
+    valid = numpy.isfinite(rout[0])
+    count = numpy.sum(valid, axis=0)
+    with warnings.catch_warnings():
+        warnings.simplefilter('ignore', RuntimeWarning)
+        centroid = numpy.nanmean(rout, axis=1)
+        if reduce == 'centroid':
+            return centroid
+        elif reduce == 'moments':
+            dev = numpy.where(valid, rout - centroid[:, None], 0.0)
+            moments = numpy.einsum('inrt,jnrt->ijrt', dev, dev) / count
+            return centroid, moments
+    raise ValueError("reduce must be None, 'centroid' or 'moments'")
+
+
+def _sink_chunk_turns(out, chunk_turns: Optional[int] = None) -> int:
+    """Number of turns per chunk, aligned on the chunks of the sink"""
+    if chunk_turns is None:
+        chunks = getattr(out, 'chunks', None)
+        chunk_turns = chunks[-1] if chunks else 100
+    return chunk_turns
+
+
+def _write_sink(out, chunks):
+    """Write the chunks of tracking output in the sink"""
+    for first, chunk in chunks:
+        if chunk is not None:       # MPI ranks other than 0
+            out[..., first:first + chunk.shape[-1]] = chunk
+    return out
+
+
+def lattice_pass_iter(lattice: Iterable[Element], r_in, nturns: int = 1,
+                      refpts: Refpts = End, chunk_turns: int = 100,
+                      reduce: Optional[str] = None, **kwargs) -> Iterator:
+    """Tracking yielding the output by chunks of turns
+
+    :py:func:`lattice_pass_iter` tracks the particles like
+    :py:func:`lattice_pass`, but only keeps the output of *chunk_turns*
+    turns in memory. It may be used to process turn-by-turn data over a
+    large number of turns, or with :py:func:`lattice_pass_file`, to store
+    them in a file.
+
+    Parameters:
+        lattice:        list of elements
+        r_in:           (6, N) array: input coordinates of N particles.
+          *r_in* is modified in-place and reports the coordinates at the end
+          of the tracking
+        nturns:         number of turns to be tracked
+        refpts:         Selects the location of coordinates output.
+          See ":ref:`Selecting elements in a lattice <refpts>`"
+        chunk_turns:    number of turns per chunk
+        reduce:         Output reduction at each reference point:
+
+          * :py:obj:`None`: particle coordinates, (6, N, R, T) array,
+          * ``'centroid'``: mean of the surviving particles, (6, R, T) array,
+          * ``'moments'``: tuple of the centroid and of the (6, 6, R, T)
+            array of second moments around the centroid.
+
+    Keyword arguments:
+        **kwargs:       Keyword arguments of :py:func:`lattice_pass`, except
+          *losses*
+
+    Yields:
+        first_turn (int):   index of the first turn of the chunk in the
+          requested *nturns*
+        r_out:              output of the chunk, with T <= *chunk_turns*
+          turns, reduced as specified by *reduce*
+
+    Example:
+
+        >>> for turn, centroid in lattice_pass_iter(
+        ...         ring, r_in, 10000, refpts=at.Monitor, reduce='centroid'):
+        ...     process(turn, centroid)
+    """
+    if kwargs.pop('losses', False):
+        raise ValueError('losses are not available in lattice_pass_iter')
+    assert r_in.shape[0] == 6 and r_in.ndim in (1, 2), DIMENSION_ERROR
+    if not isinstance(lattice, list):
+        lattice = list(lattice)
+    r_fin = r_in if r_in.flags.f_contiguous else numpy.asfortranarray(r_in)
+    keep_counter = kwargs.pop('keep_counter', False)
+    keep_lattice = kwargs.pop('keep_lattice', False)
+    done = 0
+    try:
+        while done < nturns:
+            nt = min(chunk_turns, nturns - done)
+            rout = lattice_pass(lattice, r_fin, nt, refpts=refpts,
+                                keep_counter=keep_counter or done > 0,
+                                keep_lattice=keep_lattice or done > 0,
+                                **kwargs)
+            yield done, _reduce_output(rout, reduce)
+            done += nt
+    finally:
+        if r_fin is not r_in:
+            r_in[:] = r_fin[:]
+
+
+def lattice_pass_file(lattice: Iterable[Element], r_in, filename: str,
+                      nturns: int = 1, refpts: Refpts = End,
+                      chunk_turns: int = 100, reduce: Optional[str] = None,
+                      **kwargs) -> numpy.memmap:
+    """Tracking with the output written to a file
+
+    The output of :py:func:`lattice_pass` is written chunk by chunk in a
+    ``.npy`` file, so that it may exceed the available memory.
+
+    Parameters:
+        lattice:        list of elements
+        r_in:           (6, N) array: input coordinates of N particles.
+          *r_in* is modified in-place and reports the coordinates at the end
+          of the tracking
+        filename:       name of the output ``.npy`` file
+        nturns:         number of turns to be tracked
+        refpts:         Selects the location of coordinates output.
+          See ":ref:`Selecting elements in a lattice <refpts>`"
+        chunk_turns:    number of turns kept in memory
+        reduce:         :py:obj:`None` for the particle coordinates, or
+          ``'centroid'`` for the mean of the surviving particles
+
+    Keyword arguments:
+        **kwargs:       Keyword arguments of :py:func:`lattice_pass`, except
+          *losses*
+
+    Returns:
+        r_out:  memory-mapped (6, N, R, T) array, or (6, R, T) array of
+          centroids, which can be read later with
+          :pycode:`numpy.load(filename, mmap_mode='r')`
+    """
+    if reduce not in (None, 'centroid'):
+        raise ValueError("reduce must be None or 'centroid'")
+    if not isinstance(lattice, list):
+        lattice = list(lattice)
+    nref = len(get_uint32_index(lattice, refpts))
+    if reduce is None:
+        npart = 1 if r_in.ndim == 1 else r_in.shape[1]
+        shape = (6, npart, nref, nturns)
+    else:
+        shape = (6, nref, nturns)
+    rout = open_memmap(filename, mode='w+', dtype=numpy.float64,
+                       shape=shape, fortran_order=True)
+    lattice_pass(lattice, r_in, nturns, refpts=refpts, out=rout,
+                 chunk_turns=chunk_turns, reduce=reduce, **kwargs)
+    rout.flush()
+    return rout
+
+
+def _async_pass(lattice, r_in, nturns, refpts, callback, chunk_turns,
+                **kwargs):
+    """Body of the lattice_pass_async jobs"""
+    if callback is None:
+        return lattice_pass(lattice, r_in, nturns, refpts=refpts, **kwargs)
+    chunks = []
+    for first_turn, rout in lattice_pass_iter(lattice, r_in, nturns,
+                                              refpts=refpts,
+                                              chunk_turns=chunk_turns,
+                                              **kwargs):
+        callback(first_turn, rout)
+        chunks.append(rout)
+    return numpy.concatenate(chunks, axis=-1)
+
+
+def lattice_pass_async(lattice: Iterable[Element], r_in, nturns: int = 1,
+                       refpts: Refpts = End, *,
+                       callback: Optional[Callable[[int, numpy.ndarray],
+                                                   Any]] = None,
+                       chunk_turns: int = 100,
+                       executor: Optional[Executor] = None,
+                       **kwargs) -> Future:
+    """Tracking in a background thread
+
+    :py:func:`lattice_pass_async` starts the tracking of
+    :py:func:`lattice_pass` in a background thread and returns immediately,
+    so that the analysis of a previous batch of particles may proceed while
+    the next one is tracked. Unless given, the tracking uses its own
+    context (see :py:func:`.new_context`). When all the elements use C
+    integrators, the GIL is released while tracking, and the Python
+    thread runs concurrently with the tracking. Otherwise the tracking is
+    correct but does not overlap with the Python code.
+
+    *r_in* is modified in the background: it must not be used before the
+    completion of the tracking.
+
+    Parameters:
+        lattice:        list of elements
+        r_in:           (6, N) array: input coordinates of N particles
+        nturns:         number of turns to be tracked
+        refpts:         Selects the location of coordinates output.
+          See ":ref:`Selecting elements in a lattice <refpts>`"
+        callback:       Function called in the tracking thread after each
+          chunk of *chunk_turns* turns, as :pycode:`callback(first_turn,
+          r_out)`, where *r_out* is the output of the chunk. It may be used
+          to report the progress. With a callback, *losses* is not
+          available. Default: :py:obj:`None`, the tracking is made in a
+          single call
+        chunk_turns:    number of turns per chunk when *callback* is given
+        executor:       :py:class:`~concurrent.futures.Executor` running the
+          tracking. Default: a module-wide single-thread executor, so that
+          the successive calls are tracked in order
+
+    Keyword arguments:
+        **kwargs:       Keyword arguments of :py:func:`lattice_pass`, except
+          *out*, *comm* and *checkpoint*
+
+    Returns:
+        future (Future):  :py:class:`~concurrent.futures.Future` whose
+          result is the output of :py:func:`lattice_pass`. It may be awaited
+          in a coroutine with :pycode:`await asyncio.wrap_future(future)`
+
+    Example:
+
+        >>> future = lattice_pass_async(ring, batch[0], 1000)
+        >>> for n in range(1, nbatch):
+        ...     rout = future.result()
+        ...     future = lattice_pass_async(ring, batch[n], 1000)
+        ...     analyse(rout)
+        >>> analyse(future.result())
+    """
+    global _async_executor
+    for key in ('out', 'comm', 'checkpoint'):
+        if kwargs.get(key) is not None:
+            raise ValueError('{0} is not available in lattice_pass_async'
+                             .format(key))
+    if callback is not None and kwargs.get('losses', False):
+        raise ValueError('losses are not available with a callback')
+    assert r_in.shape[0] == 6 and r_in.ndim in (1, 2), DIMENSION_ERROR
+    if not isinstance(lattice, list):
+        lattice = list(lattice)
+    if kwargs.get('context') is None:
+        kwargs['context'] = new_context()
+        kwargs['keep_lattice'] = False
+    if executor is None:
+        if _async_executor is None:
+            _async_executor = ThreadPoolExecutor(
+                max_workers=1, thread_name_prefix='lattice_pass_async')
+        executor = _async_executor
+    return executor.submit(_async_pass, lattice, r_in, nturns, refpts,
+                           callback, chunk_turns, **kwargs)
+
+
+@fortran_align
+def lattice_tangent_pass(lattice: Iterable[Element], r_in,
+                         refpts: Refpts = End, **kwargs):
+    """Tracks particles with their transfer matrices in a single pass
+
+    Each coordinate is tracked together with its derivatives with respect to
+    the initial coordinates, so that the transfer matrices from the entrance
+    of the lattice to each reference point are obtained exactly, without
+    finite differences.
+
+    Parameters:
+        lattice:                list of elements
+        r_in:                   (6, N) array: input coordinates of N particles.
+          *r_in* is modified in-place and reports the coordinates at
+          the end of the lattice.
+        refpts:                 Selects the location of coordinates output.
+          See ":ref:`Selecting elements in a lattice <refpts>`"
+
+    Keyword arguments:
+        turn (int):             Turn number seen by time-dependent elements.
+          Default: 0
+        particle (Particle):    circulating particle.
+          Default: :code:`lattice.particle` if existing,
+          otherwise :code:`Particle('relativistic')`
+        energy (float):         lattice energy. Default 0.
+
+    Returns:
+        r_out:  (6, N, R) array containing the coordinates of the particles
+          at each reference point
+        ms:     (N, R, 6, 6) array of transfer matrices between the entrance
+          of the lattice and each reference point
+
+    Raises:
+        NotImplementedError: if a *PassMethod* has no tangent map. The
+          supported methods are ``IdentityPass``, ``DriftPass``,
+          ``Matrix66Pass``, ``StrMPoleSymplectic4Pass`` and
+          ``BndMPoleSymplectic4Pass`` without quadrupole fringe fields,
+          and ``RFCavityPass``.
+    """
+    if not isinstance(lattice, list):
+        lattice = list(lattice)
+    refs = get_uint32_index(lattice, refpts)
+    rout = _tangentpass(lattice, r_in, refpts=refs, **kwargs)
+    # rout[1+j, i] = d(x_i)/d(x0_j)
+    return rout[0], rout[1:].transpose(2, 3, 1, 0)
+
+
+def _variant_line(lattice: List[Element],
+                  changes: Mapping[int, Mapping[str, Any]]) -> List[Element]:
+    # Only the modified elements are copied, the others are shared. Deep
+    # copies since attributes like K modify the arrays in place
+    line = list(lattice)
+    for index, attrs in changes.items():
+        elem = line[index].deepcopy()
+        elem.update(attrs)
+        line[index] = elem
+    return line
+
+
+def lattice_variants_pass(lattice: Iterable[Element], r_in,
+                          variants: Sequence[Mapping[int, Mapping[str, Any]]],
+                          nturns: int = 1, refpts: Refpts = End, **kwargs):
+    """Tracks particles through several variants of a lattice in parallel
+
+    Each variant (for instance an error seed) is described by the changes
+    of element attributes (misalignments *T1*, *T2*, *R1*, *R2*, strengths…)
+    with respect to the base lattice. The unmodified elements are shared by
+    all the variants and initialised only once, and the variants are tracked
+    in parallel in C, without the GIL.
+
+    Parameters:
+        lattice:                base lattice
+        r_in:                   (6, N) array: input coordinates of N
+          particles, used for all the variants, or (6, N, V) array:
+          input coordinates for each of the V variants. A (6, N, V) array
+          is modified in-place and reports the coordinates at the end of
+          the lattice.
+        variants:               Sequence of V mappings
+          ``{element index: {attribute name: value}}``. An empty mapping
+          stands for the base lattice.
+        nturns:                 number of turns to be tracked
+        refpts:                 Selects the location of coordinates output.
+          See ":ref:`Selecting elements in a lattice <refpts>`"
+
+    Keyword arguments:
+        turn (int):             Starting turn number. Default: 0
+        omp_num_threads (int):  Number of OpenMP threads
+          (default: automatic)
+        particle (Optional[Particle]):  circulating particle.
+          Default: :code:`lattice.particle` if existing,
+          otherwise :code:`Particle('relativistic')`
+        energy (Optional[float]):        lattice energy. Default 0.
+
+    Returns:
+        r_out: (6, N, V, R, T) array containing output coordinates of N
+          particles for V variants at R reference points for T turns.
+
+    Raises:
+        ValueError: if the lattice contains collective elements or
+          PassMethods implemented in Python. Such lattices must be tracked
+          with :py:func:`lattice_pass`.
+
+    Example:
+
+        >>> seeds = [{i: {"T1": dx, "T2": -dx}} for dx in rng.normal(size=100)]
+        >>> rout = lattice_variants_pass(ring, r_in, seeds, refpts=End)
+    """
+    if not isinstance(lattice, list):
+        lattice = list(lattice)
+    for attrname in ('energy', 'particle'):
+        if attrname not in kwargs and hasattr(lattice, attrname):
+            kwargs[attrname] = getattr(lattice, attrname)
+    lines = [_variant_line(lattice, changes) for changes in variants]
+    refs = get_uint32_index(lattice, refpts)
+    assert r_in.shape[0] == 6 and r_in.ndim in (2, 3), \
+        'Input to lattice_variants_pass() must be a 6xN or a 6xNxV array.'
+    if r_in.ndim == 2:
+        r_var = numpy.repeat(r_in[:, :, numpy.newaxis], len(lines), axis=2)
+        return _variantpass(lines, numpy.asfortranarray(r_var), nturns,
+                            refpts=refs, **kwargs)
+    elif r_in.flags.f_contiguous:
+        return _variantpass(lines, r_in, nturns, refpts=refs, **kwargs)
+    else:
+        r_fin = numpy.asfortranarray(r_in)
+        r_out = _variantpass(lines, r_fin, nturns, refpts=refs, **kwargs)
+        r_in[:] = r_fin[:]
+        return r_out
 
 
 @fortran_align
@@ -2,11 +2,17 @@
 Utility functions for tracking simulations
 """
 import numpy
-from at.lattice import Lattice, DConstant
-from typing import Optional
+from warnings import warn
+from at.lattice import Lattice, DConstant, Refpts, AtWarning, AtError
+from at.lattice import refpts_iterator
+from typing import Optional, Sequence
+from .track import element_pass, lattice_pass
 
 
-__all__ = ['get_bunches', 'get_bunches_std_mean', 'unfold_beam']
+__all__ = ['get_bunches', 'get_bunches_std_mean', 'unfold_beam',
+           'set_integration_steps']
+
+_SCHEME_PASSMETHODS = {'StrMPoleSymplectic4Pass'}
 
 
 def get_bunches(r_in: numpy.ndarray, nbunch: int,
@@ -46,13 +52,23 @@ def get_bunches_std_mean(r_in: numpy.ndarray, nbunch: int,
       Lists of ndarray containing the 6D standard deviation
       and center of mass (std, mean)
     """
-    bunches = get_bunches(r_in, nbunch, selected_bunches)
-    std = [numpy.nanstd(b, axis=1) for b in bunches]
-    mean = [numpy.nanmean(b, axis=1) for b in bunches]
+    npart = r_in.shape[1]
+    if npart % nbunch == 0:
+        # Particle i of bunch b is r_in[:, i*nbunch + b]: all the bunches
+        # are processed at once in a (6, npart/nbunch, nbunch) view
+        rb = numpy.reshape(r_in, (6, npart // nbunch, nbunch), order='F')
+        if selected_bunches is not None:
+            rb = rb[:, :, numpy.atleast_1d(selected_bunches)]
+        std = list(numpy.nanstd(rb, axis=1).T)
+        mean = list(numpy.nanmean(rb, axis=1).T)
+    else:
+        bunches = get_bunches(r_in, nbunch, selected_bunches)
+        std = [numpy.nanstd(b, axis=1) for b in bunches]
+        mean = [numpy.nanmean(b, axis=1) for b in bunches]
     return std, mean
 
 
-def unfold_beam(ring: Lattice, beam: numpy.ndarray,
+def unfold_beam(ring: Lattice, beam: numpy.ndarray, copy: bool = True,
                 **kwargs) -> numpy.ndarray:
     """Function to unfold the beam based on the ring fill pattern.
     The input particle distribution has to be in on bucket 0.
@@ -62,9 +78,15 @@ def unfold_beam(ring: Lattice, beam: numpy.ndarray,
     closed orbit search, this closed orbit is added to the input
     particles.
 
+    The closed orbit is searched once: the orbits of the other bunches
+    are deduced by shifting ``ct`` by the bunch positions and checked
+    together by tracking all of them for one turn. Only the bunches found
+    not closed, if any, need their own orbit search.
+
     Parameters:
         ring: Lattice description
         beam: array with shape(6, nparticles)
+        copy: If :py:obj:`False`, the beam is unfolded in place
 
     Keyword Arguments:
         convergence (float):    Convergence criterion for 6D orbit
@@ -77,12 +99,106 @@ def unfold_beam(ring: Lattice, beam: numpy.ndarray,
     """
     conv = kwargs.pop('convergence', DConstant.OrbConvergence)
     maxiter = kwargs.pop('max_iterations', DConstant.OrbMaxIter)
+    nbunch = ring.nbunch
     o60, _ = ring.find_orbit(max_iterations=maxiter, convergence=conv)
-    unfolded_beam = numpy.zeros(beam.shape)
-    for i, spos in enumerate(ring.bunch_spos[::-1]):
-        guess = o60.copy()
-        guess[5] -= spos
-        o6, _ = ring.find_orbit(guess=guess, max_iterations=maxiter,
-                                convergence=conv)
-        unfolded_beam[:, i::ring.nbunch] = (beam[:, i::ring.nbunch].T + o6).T
+    orbits = numpy.zeros((6, nbunch+1), order='F')
+    orbits[:] = o60.reshape((6, 1))
+    orbits[5, :nbunch] -= ring.bunch_spos[::-1]
+    if ring.is_collective:
+        notclosed = range(nbunch)
+    else:
+        # One turn for all the bunches, compared with the reference orbit
+        rout = orbits.copy(order='F')
+        lattice_pass(ring, rout, refpts=None)
+        resid = numpy.max(numpy.abs(rout - orbits), axis=0)
+        tol = max(conv, 10.0 * resid[-1])
+        notclosed = numpy.flatnonzero(resid[:nbunch] > tol)
+    for i in notclosed:
+        orbits[:, i], _ = ring.find_orbit(guess=orbits[:, i],
+                                          max_iterations=maxiter,
+                                          convergence=conv)
+    unfolded_beam = beam.copy(order='K') if copy else beam
+    for i in range(nbunch):
+        unfolded_beam[:, i::nbunch] += orbits[:, i:i+1]
     return unfolded_beam
+
+
+def _integration_key(elem):
+    """Key identifying the elements integrated identically"""
+    def value(v):
+        return v.tobytes() if isinstance(v, numpy.ndarray) else repr(v)
+    return (type(elem).__name__,) + tuple(
+        (k, value(v)) for k, v in sorted(vars(elem).items())
+        if k not in ('FamName', 'NumIntSteps'))
+
+
+def set_integration_steps(ring: Lattice, tol: float = 1.0e-10,
+                          refpts: Refpts = None,
+                          scheme: Optional[int] = None,
+                          nmax: int = 100,
+                          amplitude: Sequence[float] = (1.e-3, 1.e-3,
+                                                        1.e-2)
+                          ) -> numpy.ndarray:
+    r"""Set the minimum number of integration steps for a given accuracy
+
+    For each selected element, test particles are tracked with an increasing
+    number of steps and compared with a reference tracked with *4\*nmax*
+    steps. *NumIntSteps* is set to the first number of steps giving a
+    deviation smaller than *tol*. Identical elements are tested only once.
+
+    Parameters:
+        ring:       Lattice description. Modified in place
+        tol:        Absolute tolerance on the output coordinates
+        refpts:     Selected elements. Default: all the elements with a
+          *NumIntSteps* attribute
+        scheme:     If given, set the *IntegratorScheme* of the elements
+          integrated with ``StrMPoleSymplectic4Pass`` before testing them:
+          4: 4th order, 6: 6th order, 8: 8th order Yoshida schemes,
+          12-14: SABA\ :sub:`2`-SABA\ :sub:`4` schemes
+        nmax:       Maximum number of steps
+        amplitude:  Horizontal and vertical amplitudes and momentum
+          deviation of the test particles
+
+    Returns:
+        steps:      Number of steps of the selected elements
+
+    Example:
+        >>> steps = set_integration_steps(ring, 1.e-10, scheme=6)
+    """
+    ax, ay, dp = amplitude
+    rtest = numpy.array([[ax, 0.0, 0.0, 0.0, 0.0, 0.0],
+                         [0.0, 0.0, ay, 0.0, 0.0, 0.0],
+                         [ax, 0.0, ay, 0.0, dp, 0.0],
+                         [-ax, 0.0, -ay, 0.0, -dp, 0.0]]).T
+    kwargs = dict(energy=ring.energy, particle=ring.particle)
+
+    def track(elem, nsteps):
+        e = elem.copy()
+        e.NumIntSteps = nsteps
+        return element_pass(e, numpy.asfortranarray(rtest), **kwargs)
+
+    if refpts is None:
+        elems = [e for e in ring if hasattr(e, 'NumIntSteps')]
+    else:
+        elems = list(refpts_iterator(ring, refpts))
+    found = {}
+    steps = []
+    for elem in elems:
+        if scheme is not None and elem.PassMethod in _SCHEME_PASSMETHODS:
+            elem.IntegratorScheme = scheme
+        key = _integration_key(elem)
+        nsteps = found.get(key)
+        if nsteps is None:
+            if not hasattr(elem, 'NumIntSteps'):
+                raise AtError('{0} has no NumIntSteps'.format(elem.FamName))
+            rref = track(elem, 4 * nmax)
+            for nsteps in range(1, nmax + 1):
+                if numpy.max(numpy.abs(track(elem, nsteps) - rref)) < tol:
+                    break
+            else:
+                warn(AtWarning('{0}: tolerance not reached with {1} steps'
+                               .format(elem.FamName, nmax)))
+            found[key] = nsteps
+        elem.NumIntSteps = nsteps
+        steps.append(nsteps)
+    return numpy.array(steps, dtype=int)
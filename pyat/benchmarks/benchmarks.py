@@ -0,0 +1,257 @@
+"""Performance benchmarks of pyAT
+
+The benchmarks track particles through the standard lattices of
+``machine_data``, and time the main optics, radiation, collective and
+frequency analysis functions. Run for instance:
+
+python benchmarks.py -o results.json
+
+and, after modifying the code:
+
+python benchmarks.py -o new.json -c results.json
+
+which prints the ratio of the new times to the reference ones. Each
+benchmark is repeated and the best time is kept. The random particle
+distributions are seeded, so that the same work is done for each run.
+"""
+import argparse
+import json
+import os
+import platform
+import subprocess
+import sys
+import time
+import numpy as np
+import at
+from at.collective import LongResonatorElement
+
+_datadir = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                        '..', 'machine_data')
+
+
+def _lattices():
+    hmba = at.load_lattice(os.path.join(_datadir, 'hmba.mat'))
+    esrf = at.load_lattice(os.path.join(_datadir, 'esrf.m'))
+    return {'hmba': hmba, 'esrf': esrf}
+
+
+def _beam(npart, seed=12345):
+    rng = np.random.default_rng(seed)
+    sigma = np.array([3.e-5, 3.e-6, 3.e-6, 3.e-6, 1.e-3, 3.e-3])
+    return np.asfortranarray(sigma[:, np.newaxis] *
+                             rng.standard_normal((6, npart)))
+
+
+def _timeit(func, repeat):
+    """Best elapsed time of repeat calls of func"""
+    best = np.inf
+    for _ in range(repeat):
+        t0 = time.perf_counter()
+        func()
+        best = min(best, time.perf_counter() - t0)
+    return best
+
+
+def _commit():
+    try:
+        return subprocess.run(['git', 'rev-parse', 'HEAD'], cwd=_datadir,
+                              capture_output=True, text=True,
+                              check=True).stdout.strip()
+    except (OSError, subprocess.CalledProcessError):
+        return None
+
+
+def tracking(rings, quick=False):
+    """Tracking rate for increasing numbers of particles"""
+    nparts = (1, 1000, 100000) if quick else (1, 1000, 100000, 1000000)
+    work = 1.e5 if quick else 1.e6        # particles.turns per benchmark
+    for name, ring in rings.items():
+        ring6 = ring.enable_6d(copy=True)
+        for npart in nparts:
+            nturns = max(int(work // npart), 1)
+            rin = _beam(npart)
+            ring6.lattice_pass(rin.copy(order='F'), 1, refpts=None)
+
+            def run():
+                ring6.lattice_pass(rin.copy(order='F'), nturns,
+                                   refpts=None, keep_lattice=True)
+
+            yield dict(name='track_{0}_{1}'.format(name, npart),
+                       particles=npart, turns=nturns, work=npart*nturns,
+                       func=run)
+
+
+def threads(rings, quick=False):
+    """Thread scaling of the tracking"""
+    ring6 = rings['hmba'].enable_6d(copy=True)
+    npart = 10000 if quick else 100000
+    nturns = 10
+    rin = _beam(npart)
+    ring6.lattice_pass(rin.copy(order='F'), 1, refpts=None)
+    nthreads = 1
+    while nthreads <= (os.cpu_count() or 1):
+        def run(n=nthreads):
+            ring6.lattice_pass(rin.copy(order='F'), nturns, refpts=None,
+                               keep_lattice=True, omp_num_threads=n)
+
+        yield dict(name='threads_hmba_{0}'.format(nthreads),
+                   particles=npart, turns=nturns, work=npart*nturns,
+                   threads=nthreads, func=run)
+        nthreads *= 2
+
+
+def float32(rings, quick=False):
+    """Single-precision tracking, validated against double precision
+
+    The *error* of each benchmark is the largest deviation of the
+    single-precision coordinates from the double-precision ones, relative
+    to the r.m.s. beam size in each plane.
+    """
+    npart = 10000 if quick else 100000
+    nturns = 10 if quick else 100
+    for name, ring in rings.items():
+        ring6 = ring.enable_6d(copy=True)
+        rin = _beam(npart)
+        r64 = rin.copy(order='F')
+        ring6.lattice_pass(r64, nturns, refpts=None)
+        r32 = rin.astype(np.float32, order='F')
+        ring6.lattice_pass(r32, nturns, refpts=None)
+        ok = np.isfinite(r64[0]) & np.isfinite(r32[0])
+        scale = np.std(r64[:, ok], axis=1)
+        error = np.max(np.abs(r32[:, ok] - r64[:, ok]), axis=1) / scale
+        for dtype in (np.float64, np.float32):
+            def run(dt=dtype):
+                ring6.lattice_pass(rin.astype(dt, order='F'), nturns,
+                                   refpts=None, keep_lattice=True)
+
+            bench = dict(name='{0}_{1}_{2}'.format(np.dtype(dtype).name,
+                                                   name, npart),
+                         particles=npart, turns=nturns, work=npart*nturns,
+                         func=run)
+            if dtype is np.float32:
+                bench['error'] = error.tolist()
+            yield bench
+
+
+def optics(rings, quick=False):
+    """Optics and radiation computations"""
+    for name, ring in rings.items():
+        ring6 = ring.enable_6d(copy=True)
+        refpts = at.All
+        yield dict(name='linopt6_{0}'.format(name),
+                   func=lambda r=ring6: at.linopt6(r, refpts=refpts))
+        yield dict(name='find_orbit6_{0}'.format(name),
+                   func=lambda r=ring6: at.find_orbit6(r))
+        yield dict(name='ohmi_envelope_{0}'.format(name),
+                   func=lambda r=ring6: at.ohmi_envelope(r, refpts=refpts))
+
+
+def wakes(rings, quick=False):
+    """Tracking through a longitudinal resonator wake"""
+    ring = rings['hmba'].enable_6d(copy=True)
+    npart = 10000 if quick else 100000
+    nturns = 10
+    srange = at.Wake.build_srange(0., 1.e-3, 1.e-5, 1.e-2, 0.1, 1.0)
+    wake = LongResonatorElement('wake', ring, srange, 1.e9, 10., 1.e4,
+                                Nslice=101, Nturns=2)
+    ring.append(wake)
+    ring.beam_current = 0.1
+    rin = _beam(npart)
+
+    def run():
+        wake.clear_history()
+        ring.lattice_pass(rin.copy(order='F'), nturns, refpts=None)
+
+    yield dict(name='wake_hmba_{0}'.format(npart), particles=npart,
+               turns=nturns, work=npart*nturns, func=run)
+
+
+def naff(rings, quick=False):
+    """Frequency analysis of turn-by-turn data"""
+    nsignals = 100 if quick else 1000
+    nturns = 1024
+    rng = np.random.default_rng(1)
+    tunes = rng.uniform(0.1, 0.4, (nsignals, 1))
+    phi = 2.0 * np.pi * tunes * np.arange(nturns)
+    y, yp = np.cos(phi), np.sin(phi)
+    yield dict(name='naff_{0}x{1}'.format(nsignals, nturns),
+               func=lambda: at.physics.naff(y, yp, window=1, nfreq=3))
+    yield dict(name='harmonic_{0}x{1}'.format(nsignals, nturns),
+               func=lambda: at.get_tunes_harmonic(y, num_harmonics=3))
+
+
+_suites = dict(tracking=tracking, threads=threads, float32=float32,
+               optics=optics, wakes=wakes, naff=naff)
+
+
+def run(suites=None, repeat=3, quick=False):
+    """Run the benchmarks
+
+    Parameters:
+        suites:     Names of the benchmark suites. Default: all
+        repeat:     Number of repetitions of each benchmark
+        quick:      Reduce the sizes for a fast check
+
+    Returns:
+        results:    Dictionary of results
+    """
+    rings = _lattices()
+    results = []
+    for suite in (suites or _suites):
+        for bench in _suites[suite](rings, quick=quick):
+            func = bench.pop('func')
+            bench['suite'] = suite
+            bench['time'] = _timeit(func, repeat)
+            if 'work' in bench:
+                bench['rate'] = bench['work'] / bench['time']
+            results.append(bench)
+            print('{0:30s} {1:12.6f} s{2}{3}'.format(
+                bench['name'], bench['time'],
+                '  {0:.3e} particles.turns/s'.format(bench['rate'])
+                if 'rate' in bench else '',
+                '  max. error {0:.1e}'.format(max(bench['error']))
+                if 'error' in bench else ''), flush=True)
+    return dict(version=at.__version__, commit=_commit(),
+                python=sys.version.split()[0], numpy=np.__version__,
+                platform=platform.platform(),
+                processor=platform.processor(), cpu_count=os.cpu_count(),
+                openmp=at.DConstant.openmp, mpi=at.DConstant.mpi,
+                quick=quick, repeat=repeat, results=results)
+
+
+def compare(new, ref):
+    """Print the ratio of the new times to the reference ones"""
+    reftimes = {r['name']: r['time'] for r in ref['results']}
+    print('\nRatio to {0}:'.format(ref.get('commit') or 'reference'))
+    for r in new['results']:
+        told = reftimes.get(r['name'])
+        if told is not None:
+            print('{0:30s} {1:8.3f}'.format(r['name'], r['time'] / told))
+
+
+def main():
+    parser = argparse.ArgumentParser(description='pyAT benchmarks')
+    parser.add_argument('suites', nargs='*', metavar='suite',
+                        help='benchmark suites among {0} (default: all)'
+                        .format(', '.join(_suites)))
+    parser.add_argument('-o', '--output', help='JSON result file')
+    parser.add_argument('-c', '--compare', help='reference JSON file')
+    parser.add_argument('-r', '--repeat', type=int, default=3,
+                        help='number of repetitions (default: 3)')
+    parser.add_argument('-q', '--quick', action='store_true',
+                        help='reduced sizes for a fast check')
+    args = parser.parse_args()
+    for suite in args.suites:
+        if suite not in _suites:
+            parser.error('unknown suite: {0}'.format(suite))
+    results = run(args.suites, repeat=args.repeat, quick=args.quick)
+    if args.output:
+        with open(args.output, 'w') as f:
+            json.dump(results, f, indent=2)
+    if args.compare:
+        with open(args.compare) as f:
+            compare(results, json.load(f))
+
+
+if __name__ == '__main__':
+    main()
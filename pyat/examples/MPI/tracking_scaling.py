@@ -0,0 +1,47 @@
+"""Strong scaling of the MPI tracking driver
+
+The same beam is tracked with lattice_pass(..., comm=MPI.COMM_WORLD) for
+increasing numbers of ranks. Run for instance:
+
+for n in 1 2 4 8 16 32; do mpirun -n $n python tracking_scaling.py; done
+
+and compare the elapsed times printed by rank 0. On several nodes, use the
+host file or the scheduler options of your MPI installation.
+"""
+import sys
+import time
+import numpy as np
+import at
+from mpi4py import MPI
+
+
+def launch(npart=100000, nturns=100):
+    comm = MPI.COMM_WORLD
+    rank = comm.Get_rank()
+
+    ring = at.load_m('../../../machine_data/esrf.m')
+    ring.disable_6d()
+
+    if rank == 0:
+        rng = np.random.default_rng(12345)
+        r_in = np.asfortranarray(rng.normal(scale=1e-5, size=(6, npart)))
+    else:
+        r_in = np.zeros(6)
+
+    # First call to load and cache the lattice on each rank
+    ring.lattice_pass(r_in.copy(order='F'), 1, refpts=None, comm=comm)
+
+    comm.Barrier()
+    t0 = time.perf_counter()
+    ring.lattice_pass(r_in, nturns, refpts=None, keep_lattice=True,
+                      comm=comm)
+    comm.Barrier()
+    elapsed = time.perf_counter() - t0
+
+    if rank == 0:
+        print('{0} ranks, {1} particles, {2} turns: {3:.3f} s'.format(
+            comm.Get_size(), npart, nturns, elapsed))
+
+
+if __name__ == '__main__':
+    launch(*(int(a) for a in sys.argv[1:]))
@@ -26,3 +26,49 @@ def test_2d_acceptance(hmba_lattice):
     expected = numpy.array([[-0.01125, -0.0053033, 0., 0.00574524, 0.010625],
                             [0., 0.0053033, 0.006875, 0.00574524, 0.]])
     assert_allclose(acceptance, expected, atol=1e-6, rtol=1.0e-4)
+
+
+def test_bisection_acceptance(hmba_lattice):
+    hmba_lattice = hmba_lattice.radiation_off(copy=True)
+    acceptance, survived, tracked = hmba_lattice.get_horizontal_acceptance(
+        1e-3, 1.0e-3, grid_mode=at.GridMode.BISECTION)
+    expected = numpy.array([-0.011, 0.011])
+    assert_allclose(acceptance, expected, atol=1e-6)
+    assert survived.shape[1] < tracked.shape[1]
+
+
+def test_bisection_acceptance_refpts(hmba_lattice):
+    hmba_lattice = hmba_lattice.radiation_off(copy=True)
+    acc, _, _ = hmba_lattice.get_horizontal_acceptance(
+        1e-3, 1.0e-3, refpts=[0, 10], grid_mode=at.GridMode.BISECTION)
+    ref, _, _ = hmba_lattice.get_horizontal_acceptance(1e-3, 1.0e-3,
+                                                       refpts=[0, 10])
+    assert_allclose(acc, ref, atol=1e-6)
+
+
+def test_bisection_momentum_acceptance(hmba_lattice):
+    hmba_lattice = hmba_lattice.radiation_off(copy=True)
+    refpts = [0, 5, 10]
+    batch, _, _ = hmba_lattice.get_momentum_acceptance(
+        1e-3, 1.0e-2, refpts=refpts, nturns=256,
+        grid_mode=at.GridMode.BISECTION)
+    for r, b in zip(refpts, batch):
+        single, _, _ = hmba_lattice.get_momentum_acceptance(
+            1e-3, 1.0e-2, refpts=r, nturns=256,
+            grid_mode=at.GridMode.BISECTION)
+        # equal within the resolution
+        assert_allclose(b, single, atol=1.0e-3)
+
+
+def test_int_piwinski_refpts():
+    from scipy import integrate
+    from at.acceptance.touschek import int_piwinski, _int_piwinski_refpts
+    km = numpy.array([0.02, 0.03, 0.05])
+    b1 = numpy.array([50.0, 200.0, 1000.0])
+    b2 = numpy.array([10.0, 150.0, 990.0])
+    val = _int_piwinski_refpts(km, b1, b2, 1.0e-16, 1.0e-12)
+    for v, args in zip(val, zip(km, b1, b2)):
+        expected, _ = integrate.quad(int_piwinski, args[0], numpy.pi/2,
+                                     args=args, epsabs=1.0e-16,
+                                     epsrel=1.0e-12)
+        assert_allclose(v, expected, rtol=1e-8)
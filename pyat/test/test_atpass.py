@@ -1,6 +1,6 @@
 import pytest
 import numpy
-from at.tracking.atpass import atpass
+from at.tracking.atpass import atpass, new_context, reset_rng
 from at import elements, uint32_refpts
 
 
@@ -97,6 +97,26 @@ def test_reuse_attributes(rin, reuse):
             numpy.testing.assert_equal(rin, rin_copy)
 
 
+def test_reuse_update_modified_elements(rin):
+    lat = [elements.Drift('d1', 1.0), elements.Drift('d2', 1.0)]
+    rin[1, 0] = 1e-6
+    r1 = numpy.copy(rin)
+    r2 = numpy.copy(rin)
+    atpass(lat, r1, 1)
+    # modified element
+    lat[1].Length = 2.0
+    atpass(lat, r1, 1, reuse=True, update=True)
+    atpass([elements.Drift('d', 5.0)], r2, 1)
+    numpy.testing.assert_allclose(r1, r2, rtol=1e-15)
+    # replaced element
+    lat[0] = elements.Drift('d3', 3.0)
+    r1 = numpy.copy(rin)
+    r2 = numpy.copy(rin)
+    atpass(lat, r1, 1, reuse=True, update=True)
+    atpass([elements.Drift('d', 5.0)], r2, 1)
+    numpy.testing.assert_allclose(r1, r2, rtol=1e-15)
+
+
 def test_two_particles_for_two_turns():
     rin = numpy.asfortranarray(numpy.zeros((6, 2)))
     lat = [elements.Drift('drift', 1.0)]
@@ -145,3 +165,317 @@ def test_1d_particle():
     rout_expected = numpy.array([1e-6, 1e-6, 0, 0, 0, 5e-13])
     # rin is changed in place
     numpy.testing.assert_equal(rin, rout_expected)
+
+
+@pytest.mark.parametrize("losses", (True, False))
+def test_soa_gives_same_result(losses):
+    lat = [elements.Drift('d1', 1.0, T1=numpy.array([1e-5, 0, 0, 0, 0, 0])),
+           elements.Quadrupole('qf', 0.5, 1.2, KickAngle=[1e-4, -1e-4]),
+           elements.Marker('m1'),
+           elements.Sextupole('sf', 0.2, 30.0),
+           elements.Dipole('b1', 1.0, 0.1, 0.2,
+                           RApertures=[-0.01, 0.01, -0.01, 0.01]),
+           elements.Drift('d2', 1.0)]
+    rin = numpy.asfortranarray(numpy.random.default_rng(1).normal(
+        scale=2e-3, size=(6, 200)))
+    rin[0, 5] = 0.02
+    rin_soa = rin.copy(order='F')
+    refs = uint32_refpts(range(len(lat)+1), len(lat))
+    out = atpass(lat, rin, 3, refpts=refs, losses=losses)
+    out_soa = atpass(lat, rin_soa, 3, refpts=refs, losses=losses, soa=True)
+    numpy.testing.assert_equal(rin_soa, rin)
+    if losses:
+        numpy.testing.assert_equal(out_soa[0], out[0])
+        for key in out[1]:
+            numpy.testing.assert_equal(out_soa[1][key], out[1][key])
+    else:
+        numpy.testing.assert_equal(out_soa, out)
+
+
+def test_contexts_are_independent():
+    lat1 = [elements.Drift('d1', 1.0)]
+    lat2 = [elements.Quadrupole('qf', 0.5, 1.2)]
+    ctx1 = new_context()
+    ctx2 = new_context()
+    r0 = numpy.asfortranarray(numpy.full((6, 2), 1.e-3))
+    r1 = r0.copy(order='F')
+    r2 = r0.copy(order='F')
+    atpass(lat1, r1, 1, context=ctx1)
+    atpass(lat2, r2, 1, context=ctx2)
+    # Reuse each cached lattice: the lattice argument is ignored
+    r1b = r0.copy(order='F')
+    r2b = r0.copy(order='F')
+    atpass(lat2, r1b, 1, reuse=True, context=ctx1)
+    atpass(lat1, r2b, 1, reuse=True, context=ctx2)
+    numpy.testing.assert_equal(r1b, r1)
+    numpy.testing.assert_equal(r2b, r2)
+
+
+def test_threads_with_separate_contexts(hmba_lattice):
+    from concurrent.futures import ThreadPoolExecutor
+    lat = list(hmba_lattice)
+    r0 = numpy.asfortranarray(numpy.full((6, 4), 1.e-5))
+    rref = r0.copy(order='F')
+    atpass(lat, rref, 5)
+
+    def track(_):
+        r = r0.copy(order='F')
+        atpass(lat, r, 5, context=new_context())
+        return r
+
+    with ThreadPoolExecutor(max_workers=4) as pool:
+        for r in pool.map(track, range(8)):
+            numpy.testing.assert_equal(r, rref)
+
+
+def test_threads_share_the_default_context(hmba_lattice):
+    # Concurrent calls with the default context wait for each other
+    from concurrent.futures import ThreadPoolExecutor
+    lat = list(hmba_lattice)
+    r0 = numpy.asfortranarray(numpy.full((6, 4), 1.e-5))
+    rref = r0.copy(order='F')
+    atpass(lat, rref, 5)
+
+    def track(_):
+        r = r0.copy(order='F')
+        atpass(lat, r, 5)
+        return r
+
+    with ThreadPoolExecutor(max_workers=4) as pool:
+        for r in pool.map(track, range(8)):
+            numpy.testing.assert_equal(r, rref)
+
+
+@pytest.mark.parametrize('losses', [False, True])
+def test_omp_persistent_gives_same_result(hmba_lattice, losses):
+    lat = list(hmba_lattice)
+    rin = numpy.asfortranarray(numpy.random.default_rng(2).normal(
+        scale=1e-3, size=(6, 100)))
+    rin[0, 3] = 0.05
+    rin_p = rin.copy(order='F')
+    refs = uint32_refpts([0, 10, len(lat)], len(lat))
+    out = atpass(lat, rin, 4, refpts=refs, losses=losses)
+    out_p = atpass(lat, rin_p, 4, refpts=refs, losses=losses,
+                   omp_persistent=True)
+    numpy.testing.assert_equal(rin_p, rin)
+    if losses:
+        numpy.testing.assert_equal(out_p[0], out[0])
+        for key in out[1]:
+            numpy.testing.assert_equal(out_p[1][key], out[1][key])
+    else:
+        numpy.testing.assert_equal(out_p, out)
+
+
+@pytest.mark.parametrize('losses', [False, True])
+def test_compact_turns_gives_same_result(losses):
+    lat = [elements.Drift('d1', 1.0),
+           elements.Quadrupole('qf', 0.5, 1.2),
+           elements.Sextupole('sf', 0.2, 300.0),
+           elements.Dipole('b1', 1.0, 0.1, 0.2,
+                           RApertures=[-0.01, 0.01, -0.01, 0.01]),
+           elements.Quadrupole('qd', 0.5, -1.2),
+           elements.Drift('d2', 1.0)]
+    rin = numpy.asfortranarray(numpy.random.default_rng(3).normal(
+        scale=4e-3, size=(6, 200)))
+    rin_c = rin.copy(order='F')
+    refs = uint32_refpts([0, 3, len(lat)], len(lat))
+    out = atpass(lat, rin, 12, refpts=refs, losses=losses)
+    out_c = atpass(lat, rin_c, 12, refpts=refs, losses=losses,
+                   compact_turns=2)
+    numpy.testing.assert_equal(rin_c, rin)
+    if losses:
+        assert numpy.any(out[1]['islost'])
+        numpy.testing.assert_equal(out_c[0], out[0])
+        for key in out[1]:
+            numpy.testing.assert_equal(out_c[1][key], out[1][key])
+    else:
+        numpy.testing.assert_equal(out_c, out)
+
+
+@pytest.mark.parametrize('options', [{}, {'soa': True},
+                                     {'compact_turns': 2}])
+def test_loss_records(options):
+    # Aperture losses at element 1, amplitude losses at element 0
+    lat = [elements.Drift('d1', 1.0),
+           elements.Drift('ap', 0.0,
+                          RApertures=[-5.5e-3, 5.5e-3, -10.0, 10.0])]
+    k = numpy.arange(10)
+    rin = numpy.zeros((6, 11), order='F')
+    rin[1, :10] = 1.e-3 * k
+    rin[3, 10] = 0.6
+    _, loss = atpass(lat, rin, 8, losses=True, **options)
+    turn = numpy.ceil(5.5 / numpy.maximum(k, 1)).astype(int) - 1
+    numpy.testing.assert_equal(loss['islost'], [False] + 10*[True])
+    numpy.testing.assert_equal(loss['turn'][1:10], turn[1:])
+    numpy.testing.assert_equal(loss['elem'][1:10], 1)
+    xlost = 1.e-3 * k[1:] * (turn[1:] + 1)
+    numpy.testing.assert_allclose(loss['coord'][0, 1:10], xlost, rtol=1e-12)
+    numpy.testing.assert_allclose(loss['coord'][1, 1:10], 1.e-3 * k[1:],
+                                  rtol=1e-12)
+    numpy.testing.assert_equal(loss['coord'][2:5, 1:10], 0.0)
+    assert numpy.all(numpy.isinf(loss['coord'][5, 1:10]))
+    assert loss['turn'][10] == 1 and loss['elem'][10] == 0
+    numpy.testing.assert_allclose(loss['coord'][:5, 10],
+                                  [0.0, 0.0, 1.2, 0.6, 0.0], rtol=1e-12)
+    assert numpy.isfinite(loss['coord'][5, 10])
+    assert numpy.isnan(rin[0, 1:]).all()
+    numpy.testing.assert_allclose(rin[0, 0], 0.0)
+
+
+def test_profile():
+    from at import lattice_pass
+    lat = [elements.Drift('d1', 1.0),
+           elements.Quadrupole('qf', 0.5, 1.2),
+           elements.Drift('d2', 1.0,
+                          RApertures=[-0.004, 0.004, -0.004, 0.004]),
+           elements.Quadrupole('qd', 0.5, -1.2),
+           elements.Drift('d3', 1.0)]
+    rin = numpy.asfortranarray(numpy.random.default_rng(5).normal(
+        scale=4e-3, size=(6, 100)))
+    rout, lossdict, prof = lattice_pass(lat, rin, 4, losses=True,
+                                        profile=True)
+    numpy.testing.assert_equal(prof['calls'], 4)
+    assert numpy.all(prof['time'] >= 0.0)
+    assert prof['particles'][0] <= 400
+    # The particles lost in an element do not enter the next one
+    numpy.testing.assert_equal(-numpy.diff(prof['particles']),
+                               prof['lost'][:-1])
+    assert prof['lost'].sum() == lossdict['islost'].sum()
+    numpy.testing.assert_equal(prof['lost'], numpy.bincount(
+        lossdict['elem'][lossdict['islost']], minlength=len(lat)))
+    drift = prof['passmethods']['DriftPass']
+    assert drift['calls'] == 12
+    assert drift['lost'] == prof['lost'][[0, 2, 4]].sum()
+    assert list(prof['passmethods']) == ['DriftPass',
+                                         'StrMPoleSymplectic4Pass']
+
+
+def test_thread_rngs_are_reproducible():
+    lmat = numpy.diag([1.e-6, 1.e-7, 1.e-6, 1.e-7, 1.e-5, 1.e-6])
+    lat = [elements.QuantumDiffusion('qd', lmat)]
+    r0 = numpy.asfortranarray(numpy.zeros((6, 100)))
+    r1 = r0.copy(order='F')
+    r2 = r0.copy(order='F')
+    reset_rng(seed=42)
+    atpass(lat, r1, 3, omp_num_threads=2)
+    reset_rng(seed=42)
+    atpass(lat, r2, 3, omp_num_threads=2)
+    numpy.testing.assert_equal(r1, r2)
+    # Independent values for all particles and coordinates
+    assert len(numpy.unique(r1)) == r1.size
+    reset_rng()
+
+
+def test_context_rngs_are_reproducible():
+    # Contexts tracked concurrently draw from their own generators
+    from concurrent.futures import ThreadPoolExecutor
+    lmat = numpy.diag([1.e-6, 1.e-7, 1.e-6, 1.e-7, 1.e-5, 1.e-6])
+    lat = [elements.QuantumDiffusion('qd', lmat)]
+    r0 = numpy.asfortranarray(numpy.zeros((6, 100)))
+    rref = r0.copy(order='F')
+    atpass(lat, rref, 20, context=new_context(seed=7))
+
+    def track(_):
+        r = r0.copy(order='F')
+        atpass(lat, r, 20, context=new_context(seed=7))
+        return r
+
+    with ThreadPoolExecutor(max_workers=4) as pool:
+        for r in pool.map(track, range(8)):
+            numpy.testing.assert_equal(r, rref)
+    # By default, the context generators are seeded from the common one
+    reset_rng(seed=42)
+    r1 = r0.copy(order='F')
+    atpass(lat, r1, 3, context=new_context())
+    reset_rng(seed=42)
+    r2 = r0.copy(order='F')
+    atpass(lat, r2, 3, context=new_context())
+    numpy.testing.assert_equal(r1, r2)
+    reset_rng()
+
+
+def test_checkpoint_resumes_tracking(tmp_path, monkeypatch):
+    from at import lattice_pass
+    from at.tracking import track
+    lmat = numpy.diag([1.e-6, 1.e-7, 1.e-6, 1.e-7, 1.e-5, 1.e-6])
+    lat = [elements.Drift('d1', 1.0),
+           elements.Quadrupole('qf', 0.5, 1.2),
+           elements.QuantumDiffusion('qd', lmat),
+           elements.Drift('d2', 1.0)]
+    r0 = numpy.zeros((6, 10), order='F')
+    reset_rng(seed=42)
+    rout = lattice_pass(lat, r0.copy(order='F'), 10, refpts=[2, 4])
+    ckpt = str(tmp_path / 'track.ckpt')
+
+    calls = []
+    original = track.lattice_pass
+
+    def interrupted(*args, **kwargs):
+        calls.append(kwargs['turn'])
+        if len(calls) > 2:
+            raise KeyboardInterrupt
+        return original(*args, **kwargs)
+
+    reset_rng(seed=42)
+    monkeypatch.setattr(track, 'lattice_pass', interrupted)
+    with pytest.raises(KeyboardInterrupt):
+        lattice_pass(lat, r0.copy(order='F'), 10, refpts=[2, 4],
+                     checkpoint=ckpt, checkpoint_turns=3)
+    monkeypatch.undo()
+    assert calls == [0, 3, 6]
+    reset_rng(seed=1)
+    r1 = r0.copy(order='F')
+    rout1 = lattice_pass(lat, r1, 10, refpts=[2, 4], checkpoint=ckpt,
+                         checkpoint_turns=3)
+    numpy.testing.assert_equal(rout1, rout)
+    numpy.testing.assert_equal(r1, rout[:, :, -1, -1])
+    assert not (tmp_path / 'track.ckpt').exists()
+    reset_rng()
+
+
+@pytest.mark.parametrize('omp_persistent', [False, True])
+def test_record_schedule(hmba_lattice, omp_persistent):
+    from at import lattice_pass
+    ring = hmba_lattice.enable_6d(copy=True)
+    rin = numpy.asfortranarray(numpy.random.default_rng(3).normal(
+        scale=1e-5, size=(6, 200)))
+    refpts = [0, 10, len(ring)]
+    rall = lattice_pass(ring, rin.copy(order='F'), 20, refpts=refpts)
+    rout = lattice_pass(ring, rin.copy(order='F'), 20, refpts=refpts,
+                        record_stride=3, record_window=10,
+                        omp_persistent=omp_persistent)
+    numpy.testing.assert_equal(rout, rall[..., [10, 13, 16, 19]])
+
+
+def test_record_trigger():
+    from at import lattice_pass
+    lat = [elements.Drift('d1', 1.0)]
+    rin = numpy.zeros((6, 2), order='F')
+    rin[1, 0] = 1.e-3
+    rout, turns = lattice_pass(lat, rin, 10, turn=100,
+                               record_trigger=[5.5e-3, numpy.inf, 1.0,
+                                               1.0, 1.0, 1.0])
+    numpy.testing.assert_equal(turns, numpy.arange(105, 110))
+    assert rout.shape == (6, 2, 1, 5)
+    numpy.testing.assert_allclose(rout[0, 0, 0], 1.e-3*numpy.arange(6, 11))
+
+
+@pytest.mark.parametrize('force_double', [False, True])
+def test_float32_tracking(hmba_lattice, force_double):
+    from at import lattice_pass
+    ring = hmba_lattice.enable_6d(copy=True)
+    if force_double:
+        for elem in ring:
+            elem.DoublePrecision = True
+    rin = numpy.asfortranarray(numpy.random.default_rng(11).normal(
+        scale=[[1e-5], [1e-6], [1e-6], [1e-7], [1e-4], [1e-3]],
+        size=(6, 100)))
+    r64 = rin.copy(order='F')
+    r32 = rin.astype(numpy.float32, order='F')
+    rout64 = lattice_pass(ring, r64, 10, refpts=[0, len(ring)])
+    rout32 = lattice_pass(ring, r32, 10, refpts=[0, len(ring)])
+    assert rout32.dtype == numpy.float32
+    assert r32.dtype == numpy.float32
+    numpy.testing.assert_equal(rout32[:, :, 1, -1], r32)
+    scale = numpy.std(rout64, axis=(1, 2, 3))[:, numpy.newaxis]
+    numpy.testing.assert_allclose(r32 / scale, r64 / scale, atol=1e-4)
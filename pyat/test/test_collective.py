@@ -6,6 +6,7 @@ from numpy.testing import assert_equal
 from at.collective import Wake, WakeElement, ResonatorElement
 from at.collective import WakeComponent, ResWallElement
 from at.collective import add_beamloading, remove_beamloading, BLMode
+from at.constants import clight
 
 
 _issorted = lambda a: numpy.all(a[:-1] <= a[1:])
@@ -134,3 +135,287 @@ def test_track_beamloading(hmba_lattice):
                                         -1.313306e-05, -1.443748e-08]
                                         ), atol=1e-10)
     
+
+
+
+def _longres_direct_sum(bl, rl, psi):
+    """Bunch phasors of the resonator wake as a sum over the pairs of
+    slices of the history"""
+    nslice, nturns, nbunch = bl._nslice, bl._nturns, bl._vbunch.shape[0]
+    ns = nslice * nbunch
+    head = int(bl._historyhead[0])
+    slot = numpy.arange(ns * nturns) // ns
+    z = bl._turnhistory[:, 2] - rl * ((head - slot + nturns) % nturns)
+    w = bl._turnhistory[:, 3]
+    omega = 2 * numpy.pi * bl.Frequency / (1 - numpy.tan(psi)/(2*bl.Qfactor))
+    alpha = omega / (2 * bl.Qfactor)
+    omegabar = numpy.sqrt(abs(omega**2 - alpha**2))
+    src = w > 0.0
+    vbunch = numpy.zeros(nbunch, dtype=complex)
+    for i in range(head * ns, (head+1) * ns):
+        if not src[i]:
+            continue
+        dt = (z[src] - z[i]) / (bl._beta * clight)
+        ws = w[src]
+        ahead = dt < 0.0
+        dt, ws = dt[ahead], ws[ahead]
+        if bl.Qfactor > 0.5:
+            wz = ws * numpy.exp(alpha*dt + 1j*omegabar*dt)
+            wz = 2 * (wz.real.sum() + alpha/omegabar*wz.imag.sum()) + \
+                2j * (wz.imag.sum() - alpha/omegabar*wz.real.sum())
+        elif bl.Qfactor == 0.5:
+            wz = 2 * numpy.sum(ws * numpy.exp(alpha*dt) * (1 + alpha*dt))
+        else:
+            # cosh and sinh written as exponentials to avoid inf*0
+            r = alpha / omegabar
+            e1 = numpy.sum(ws * numpy.exp((alpha+omegabar)*dt))
+            e2 = numpy.sum(ws * numpy.exp((alpha-omegabar)*dt))
+            wz = (1+r)*e1 + (1-r)*e2 + 1j*((1-r)*e1 - (1+r)*e2)
+        wz += numpy.sum(w[src][z[src] == z[i]])
+        wz *= bl.Rshunt * alpha * bl.NormFact * bl._wakefact * bl.Energy
+        vbunch[(i - head*ns) // nslice] += wz.real - 1j*wz.imag
+    return vbunch
+
+
+@pytest.mark.parametrize('qfactor', [44.e3, 0.5, 1.e-3])
+def test_beamloading_wake_direct_sum(hmba_lattice, qfactor):
+    # Under-damped, critical and over-damped resonators: the recursive
+    # sweep must match the sum over all the pairs of slices
+    ring = hmba_lattice.radiation_on(copy=True)
+    ring.set_fillpattern(4)
+    ring.beam_current = 0.2
+    add_beamloading(ring, qfactor, 400, mode=BLMode.WAKE, Nslice=5,
+                    Nturns=3)
+    bl = ring.get_elements(at.RFCavity)[0]
+    rl = sum(elem.Length for elem in ring)
+    rng = numpy.random.default_rng(5)
+    rin = numpy.asfortranarray(rng.normal(scale=1.e-4, size=(6, 400)))
+    rin[5] *= 30.0
+    for _ in range(5):
+        psi = bl.Vgen[1]
+        at.lattice_pass(ring, rin, refpts=[])
+    assert numpy.count_nonzero(bl._turnhistory[:, 3]) > 40
+    vbunch = bl.Vbunch[:, 0] * numpy.exp(1j * bl.Vbunch[:, 1])
+    assert_close(vbunch, _longres_direct_sum(bl, rl, psi), rtol=1.e-8)
+
+
+def test_wake_fft_convolution(hmba_lattice):
+    ring = hmba_lattice.radiation_on(copy=True)
+    ring.beam_current = 0.2
+    srange = Wake.build_srange(0.0, 0.1, 1.0e-4, 1.0e-2, 844, 0.1)
+    long_res = Wake.long_resonator(srange, 1.0e9, 5.0, 1.0e3, 1.0)
+    rng = numpy.random.default_rng(3)
+    rin = numpy.asfortranarray(rng.normal(scale=1.e-4, size=(6, 2000)))
+    rin[5] *= 30.0
+    r0 = rin.copy(order='F')
+    at.lattice_pass(ring, r0, refpts=[])
+    kicks = []
+    for fftconv in (False, True):
+        lat = ring.copy()
+        lat.append(WakeElement('WELEM', ring, long_res, Nslice=200,
+                               FFTConvolution=fftconv))
+        r = rin.copy(order='F')
+        at.lattice_pass(lat, r, refpts=[])
+        kicks.append(r[4] - r0[4])
+    assert numpy.amax(abs(kicks[0])) > 0.0
+    assert_close(kicks[1], kicks[0], rtol=0,
+                 atol=1.e-2*numpy.amax(abs(kicks[0])))
+
+
+def test_wake_ring_history(hmba_lattice):
+    ring = hmba_lattice.radiation_on(copy=True)
+    ring.beam_current = 0.2
+    srange = Wake.build_srange(0.0, 0.1, 1.0e-4, 1.0e-2,
+                               3*ring.circumference, 0.1)
+    long_res = Wake.long_resonator(srange, 1.0e9, 2.0e3, 1.0e3, 1.0)
+    rng = numpy.random.default_rng(5)
+    rin = numpy.asfortranarray(rng.normal(scale=1.e-4, size=(6, 500)))
+    results = []
+    welems = []
+    for ringbuffer in (True, False):
+        lat = ring.copy()
+        welem = WakeElement('WELEM', ring, long_res, Nslice=20, Nturns=3)
+        lat.append(welem)
+        if not ringbuffer:
+            # Without head, the history is shifted at each turn
+            del welem._historyhead
+        r = rin.copy(order='F')
+        at.lattice_pass(lat, r, nturns=5, refpts=[])
+        results.append(r)
+        welems.append(welem)
+    assert int(welems[0]._historyhead[0]) == 5 % 3
+    assert_close(welems[0].TurnHistory, welems[1].TurnHistory,
+                 rtol=0, atol=1.e-12)
+    assert_close(welems[1].TurnHistory, welems[1]._turnhistory,
+                 rtol=0, atol=0)
+    assert_close(results[0], results[1], rtol=0, atol=1.e-12)
+
+
+def test_wake_slicing_threads(hmba_lattice):
+    ring = hmba_lattice.radiation_on(copy=True)
+    ring.set_fillpattern(4)
+    ring.beam_current = 0.2
+    srange = Wake.build_srange(0.0, 0.1, 1.0e-4, 1.0e-2, 844, 0.1)
+    long_res = Wake.long_resonator(srange, 1.0e9, 5.0, 1.0e3, 1.0)
+    ring.append(WakeElement('WELEM', ring, long_res, Nslice=50))
+    rng = numpy.random.default_rng(7)
+    rin = numpy.asfortranarray(rng.normal(scale=1.e-4, size=(6, 4000)))
+    results = []
+    for nthreads in (1, 4, 4):
+        ring.set_wake_turnhistory()
+        r = rin.copy(order='F')
+        at.lattice_pass(ring, r, nturns=2, refpts=[],
+                        omp_num_threads=nthreads)
+        results.append(r)
+    # The partial sums depend on the number of threads only
+    assert_close(results[1], results[0], rtol=0, atol=1.e-12)
+    assert_equal(results[2], results[1])
+
+
+def test_uniform_wake_table(hmba_lattice):
+    ring = hmba_lattice.radiation_on(copy=True)
+    ring.beam_current = 0.2
+    srange = Wake.build_uniform_srange(0.0, 0.1, 1.0e-4)
+    long_res = Wake.long_resonator(srange, 1.0e9, 5.0, 1.0e3, 1.0)
+    assert_close(long_res.step, 1.0e-4)
+    assert long_res.srange.shape == srange.shape
+    # The tables are cached, but not shared
+    long_res2 = Wake.long_resonator(srange, 1.0e9, 5.0, 1.0e3, 1.0)
+    assert_equal(long_res2.Z, long_res.Z)
+    long_res2.Z[:] = 0.0
+    assert numpy.amax(abs(long_res.Z)) > 0.0
+    rng = numpy.random.default_rng(13)
+    rin = numpy.asfortranarray(rng.normal(scale=1.e-4, size=(6, 1000)))
+    rin[5] *= 30.0
+    results = []
+    for uniform in (True, False):
+        lat = ring.copy()
+        welem = WakeElement('WELEM', ring, long_res, Nslice=50)
+        assert_close(welem._wakeStep, 1.0e-4)
+        if not uniform:
+            # Fall back to the binary search in the table
+            del welem._wakeStep
+        lat.append(welem)
+        r = rin.copy(order='F')
+        at.lattice_pass(lat, r, refpts=[])
+        results.append(r)
+    assert_close(results[0], results[1], rtol=0, atol=1.e-15)
+
+
+def test_wake_bunch_point_charge(hmba_lattice):
+    ring = hmba_lattice.radiation_on(copy=True)
+    ring.set_fillpattern(4)
+    ring.beam_current = 0.2
+    srange = Wake.build_srange(0.0, 0.1, 1.0e-4, 1.0e-2,
+                               2*ring.circumference, 0.1)
+    # Long-range wake, nearly constant over the bunch length
+    long_res = Wake.long_resonator(srange, 1.0e7, 1.0e3, 1.0e3, 1.0)
+    rng = numpy.random.default_rng(9)
+    rin = numpy.asfortranarray(rng.normal(scale=1.e-4, size=(6, 2000)))
+    r0 = rin.copy(order='F')
+    at.lattice_pass(ring, r0, nturns=2, refpts=[])
+    kicks = []
+    for bunchpc in (False, True):
+        lat = ring.copy()
+        lat.append(WakeElement('WELEM', ring, long_res, Nslice=20, Nturns=2,
+                               BunchPointCharge=bunchpc))
+        lat.set_wake_turnhistory()
+        r = rin.copy(order='F')
+        at.lattice_pass(lat, r, nturns=2, refpts=[])
+        kicks.append(r[4] - r0[4])
+    assert numpy.amax(abs(kicks[0])) > 0.0
+    assert_close(kicks[1], kicks[0], rtol=0,
+                 atol=1.e-3*numpy.amax(abs(kicks[0])))
+
+
+def test_haissinski_jacobian(hmba_lattice):
+    from at.collective.haissinski import Haissinski
+    ring = hmba_lattice.radiation_on(copy=True)
+    srange = numpy.arange(0.0, 0.05, 5.0e-5)
+    wobj = Wake.long_resonator(srange, 10.0e9, 1.0, 1.0e4, ring.beta)
+    ha = Haissinski(wobj, ring, m=10, kmax=4, current=5.0e-4)
+    phi0 = ha.phi.copy()
+    ha.dFi_dphij()
+    jac = ha.alldFi_dphij.copy()
+    num = numpy.zeros_like(jac)
+    dphi = 1.0e-6*numpy.amax(numpy.abs(phi0))
+    for j in range(ha.npoints):
+        ha.phi = phi0.copy()
+        ha.phi[j] += dphi
+        ha.Fi()
+        fp = ha.allFi.copy()
+        ha.phi[j] -= 2*dphi
+        ha.Fi()
+        num[:, j] = (fp - ha.allFi)/(2*dphi)
+    assert_close(jac, num, rtol=0, atol=1.e-6*numpy.amax(numpy.abs(jac)))
+    # Current scan with warm start
+    ha.solve_steps([2.0e-4, 5.0e-4])
+    assert ha.conv < 1.0e-8
+
+
+@pytest.mark.parametrize('order', [1, 2, 4])
+def test_beam_moments(order):
+    from scipy.stats import skew, kurtosis
+    bm = at.BeamMoments('bm', MomentOrder=order)
+    rng = numpy.random.default_rng(3)
+    rin = numpy.asfortranarray(1.e-3 + rng.normal(scale=1.e-4,
+                                                  size=(6, 20000)))
+    rin[:, 7] = numpy.nan
+    ref = rin[:, ~numpy.isnan(rin[0])]
+    at.lattice_pass([bm], rin, nturns=1, refpts=[])
+    assert_close(bm.means[:, 0, 0], numpy.mean(ref, axis=1),
+                 rtol=1.e-12, atol=0)
+    if order >= 2:
+        assert_close(bm.stds[:, 0, 0], numpy.std(ref, axis=1),
+                     rtol=1.e-10, atol=0)
+    if order >= 4:
+        assert_close(bm.skews[:, 0, 0], skew(ref, axis=1),
+                     rtol=1.e-8, atol=1.e-10)
+        assert_close(bm.kurtosis[:, 0, 0], kurtosis(ref, axis=1),
+                     rtol=1.e-8, atol=1.e-10)
+
+
+def test_impedance_table_fft():
+    # Transverse and longitudinal resonators given as wake tables and as
+    # impedance tables must give the same kicks
+    from at.constants import clight
+    fr, q, rs = 2.0e9, 1.0, 1.0e6
+    wr = 2.0 * numpy.pi * fr
+    alpha = wr / (2.0 * q)
+    wbar = numpy.sqrt(wr**2 - alpha**2)
+    ampl = rs * wr**2 / (q * wbar)
+    s = numpy.linspace(-0.2, 0.2, 20001)
+    t = numpy.maximum(s, 0.0) / clight
+    wdx = numpy.where(s > 0, ampl * numpy.exp(-alpha*t) * numpy.sin(wbar*t),
+                      0.0)
+    wz = numpy.where(s > 0, 2.0 * alpha * rs * numpy.exp(-alpha*t) *
+                     (numpy.cos(wbar*t) - alpha/wbar*numpy.sin(wbar*t)), 0.0)
+    wz[s == 0] = alpha * rs
+    f = numpy.arange(200001) * 5.0e6
+    w = 2.0 * numpy.pi * f
+    zdx = 1j * ampl * wbar / ((alpha + 1j*w)**2 + wbar**2)
+    zz = numpy.zeros(f.shape, dtype=complex)
+    zz[1:] = rs / (1.0 + 1j*q*(w[1:]/wr - wr/w[1:]))
+    common = dict(PassMethod='ImpedanceTablePass', Nslice=101, Intensity=1.0,
+                  Wakefact=1.0e-30, Normfactx=1.0, Normfacty=1.0, On_x=1.0,
+                  On_y=0.0, On_qx=0.0, On_qy=0.0, On_z=1.0)
+    zero = numpy.zeros(s.shape)
+    wake_elem = at.Element('WAKE', Nelem=len(s), WakeT=s, WakeDX=wdx,
+                           WakeDY=zero, WakeQX=zero, WakeQY=zero, WakeZ=wz,
+                           **common)
+    imp_elem = at.Element('IMP', ImpedanceF=f, ImpedanceDXRe=zdx.real,
+                          ImpedanceDXIm=zdx.imag, ImpedanceZRe=zz.real,
+                          ImpedanceZIm=zz.imag, **common)
+    rng = numpy.random.default_rng(2)
+    rin = numpy.zeros((6, 20000), order='F')
+    rin[0] = 1.0e-3
+    rin[5] = rng.normal(scale=0.01, size=20000)
+    kicks = []
+    for elem in (wake_elem, imp_elem):
+        r = rin.copy(order='F')
+        at.element_pass(elem, r)
+        kicks.append(r - rin)
+    for i in (1, 4):
+        assert numpy.amax(abs(kicks[0][i])) > 0.0
+        assert_close(kicks[1][i], kicks[0][i], rtol=0,
+                     atol=1.e-2*numpy.amax(abs(kicks[0][i])))
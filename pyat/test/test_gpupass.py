@@ -0,0 +1,80 @@
+import numpy
+import pytest
+from at import elements, lattice_pass, gpupass, AtWarning, Lattice
+from at.tracking.gpupass import _get_cupy
+
+
+def _gpu_ring():
+    rot = numpy.identity(6)
+    rot[0, 0] = rot[1, 1] = rot[2, 2] = rot[3, 3] = numpy.cos(0.01)
+    rot[0, 2] = rot[1, 3] = numpy.sin(0.01)
+    rot[2, 0] = rot[3, 1] = -numpy.sin(0.01)
+    shift = numpy.array([1.e-4, 0.0, -2.e-4, 0.0, 0.0, 0.0])
+    ea = elements.Marker('EAP', PassMethod='EAperturePass',
+                         Axes=numpy.array([0.03, 0.0125]))
+    ring = [elements.Marker('START'),
+            elements.Aperture('AP', [-0.02, 0.025, -0.01, 0.012]), ea,
+            elements.Drift('DR1', 0.5, T1=shift, T2=-shift),
+            elements.Quadrupole('QF', 0.5, 1.2, T1=shift, T2=-shift,
+                                R1=rot, R2=rot.T, KickAngle=[1.e-4, 0.0]),
+            elements.Drift('DR2', 0.3),
+            elements.Sextupole('SF', 0.2, 40.0, KickAngle=[0.0, -2e-4]),
+            elements.Dipole('BEND1', 1.0, 0.05, -0.3, EntranceAngle=0.025,
+                            ExitAngle=0.025, FullGap=0.04, FringeInt1=0.5,
+                            FringeInt2=0.5),
+            elements.Corrector('CH', 0.1, [2.e-5, -1.e-5]),
+            elements.Quadrupole('QD', 0.5, -1.1),
+            elements.Dipole('BEND2', 1.0, 0.05, -0.3,
+                            PassMethod='BndMPoleSymplectic4E2Pass',
+                            EntranceAngle=0.025, ExitAngle=0.025,
+                            FullGap=0.04, FringeInt1=0.5, FringeInt2=0.5,
+                            H1=0.3, H2=-0.2),
+            elements.Drift('DR3', 0.5),
+            elements.RFCavity('RF', 0.0, 1.e6, 3.e8, 1, 3.e9),
+            elements.Marker('END')]
+    lat = Lattice(ring, name='gpu', energy=3.e9)
+    lat.RF.Frequency = 20 * lat.revolution_frequency
+    lat.RF.HarmNumber = 20
+    return lat
+
+
+def test_gpupass_fallback():
+    lat = Lattice([elements.Drift('DR', 1.0),
+                   elements.ThinMultipole('TM', [0.0, 0.0], [0.0, 0.0, 1.0]),
+                   elements.Drift('DR', 1.0)], energy=3.e9)
+    rin = numpy.zeros((6, 3), order='F')
+    rin[0, :] = [1e-3, -1e-3, 2e-3]
+    rin[3, :] = [-1e-4, 2e-4, 0.0]
+    r1 = rin.copy(order='F')
+    with pytest.warns(AtWarning):
+        rout = gpupass(lat, rin, 2, refpts=[1, 3])
+    expected = lattice_pass(lat, r1, 2, refpts=[1, 3])
+    numpy.testing.assert_equal(rout, expected)
+    numpy.testing.assert_equal(rin, r1)
+
+
+def test_gpupass_lattice_pass():
+    pytest.importorskip('cupy')
+    if _get_cupy() is None:
+        pytest.skip('no GPU available')
+    lat = _gpu_ring()
+    rin = numpy.zeros((6, 12), order='F')
+    rin[0, :] = numpy.linspace(-2e-3, 2e-3, 12)
+    rin[1, :] = numpy.linspace(1e-4, -1e-4, 12)
+    rin[2, :] = numpy.linspace(-1e-3, 1e-3, 12)
+    rin[4, :] = numpy.linspace(-5e-3, 5e-3, 12)
+    rin[5, :] = numpy.linspace(-1e-3, 1e-3, 12)
+    # particle 7 is lost on the first aperture
+    rin[0, 7] = 0.03
+    r1 = rin.copy(order='F')
+    refpts = [0, 5, len(lat)]
+    rout, lgpu = gpupass(lat, rin, 5, refpts=refpts, losses=True)
+    expected, lcpu = lattice_pass(lat, r1, 5, refpts=refpts, losses=True)
+    assert lcpu['islost'].any()
+    numpy.testing.assert_allclose(rout, expected, rtol=0, atol=1e-12)
+    numpy.testing.assert_allclose(rin, r1, rtol=0, atol=1e-12)
+    numpy.testing.assert_equal(lgpu['islost'], lcpu['islost'])
+    numpy.testing.assert_equal(lgpu['turn'], lcpu['turn'])
+    numpy.testing.assert_equal(lgpu['elem'], lcpu['elem'])
+    numpy.testing.assert_allclose(lgpu['coord'], lcpu['coord'],
+                                  rtol=0, atol=1e-12)
@@ -3,9 +3,12 @@ import numpy
 import pytest
 
 # noinspection PyUnresolvedReferences,PyProtectedMember
-from at.tracking import lattice_pass, element_pass
-from at.lattice import Element, elements
+from at.tracking import lattice_pass, element_pass, set_integration_steps
+from at.tracking import reset_rng
+from at.lattice import Element, Lattice, elements, VariableMultipole
 from at import shift_elem, tilt_elem
+from at.physics import get_energy_loss, ELossMethod
+from at.constants import clight
 
 
 def test_exact_hamiltonian_pass(rin):
@@ -31,6 +34,106 @@ def test_exact_hamiltonian_pass_with_dls_dipole(rin):
     numpy.testing.assert_allclose(rin, expected, rtol=1e-5, atol=1e-6)
 
 
+def test_exact_drift_pass():
+    drift = elements.Drift('d', 2.0, PassMethod='ExactDriftPass')
+    r_in = numpy.zeros((6, 10), order='F')
+    r_in[1] = numpy.linspace(-0.1, 0.1, 10)
+    r_in[3] = 0.02
+    r_in[4] = numpy.linspace(-0.05, 0.05, 10)
+    xp0, yp0, dp0 = r_in[1].copy(), r_in[3].copy(), r_in[4].copy()
+    lattice_pass([drift], r_in)
+    pz = numpy.sqrt((1 + dp0) ** 2 - xp0 ** 2 - yp0 ** 2)
+    numpy.testing.assert_allclose(r_in[0], 2.0 * xp0 / pz, rtol=0, atol=1e-15)
+    numpy.testing.assert_allclose(r_in[2], 2.0 * yp0 / pz, rtol=0, atol=1e-15)
+    numpy.testing.assert_allclose(r_in[5], 2.0 * (1 + dp0) / pz - 2.0,
+                                  rtol=0, atol=1e-15)
+
+
+@pytest.mark.parametrize('exact, paraxial',
+                         (('ExactMultipolePass', 'StrMPoleSymplectic4Pass'),
+                          ('ExactSectorBendPass', 'BndMPoleSymplectic4Pass')))
+def test_exact_passes_paraxial_limit(exact, paraxial):
+    # Close to the axis, the exact integrators agree with the paraxial ones
+    bend = elements.Dipole('b', 1.2, 0.15, -0.5, EntranceAngle=0.05,
+                           ExitAngle=0.08, FullGap=0.04, FringeInt1=0.5,
+                           FringeInt2=0.5)
+    bend.PolynomB[2] = 3.0
+    if exact == 'ExactMultipolePass':
+        bend.BendingAngle = 0.0
+    r1 = numpy.zeros((6, 6), order='F')
+    r1[:5, 1:] = 1.e-6 * numpy.eye(5)
+    r2 = r1.copy(order='F')
+    bend.PassMethod = exact
+    lattice_pass([bend], r1)
+    bend.PassMethod = paraxial
+    lattice_pass([bend], r2)
+    numpy.testing.assert_allclose(r1, r2, rtol=0, atol=1.e-10)
+
+
+
+def test_exact_multipole_pass_large_amplitude():
+    # Far from the axis, ExactMultipolePass agrees with ExactHamiltonianPass
+    mult = elements.Multipole('m', 0.5, [0, 0, 0, 0], [0, 2.0, 20.0, 0],
+                              MaxOrder=3, NumIntSteps=20)
+    r1 = numpy.zeros((6, 5), order='F')
+    r1[0] = numpy.linspace(-0.01, 0.01, 5)
+    r1[1] = numpy.linspace(0.1, -0.1, 5)
+    r1[2] = 0.005
+    r1[3] = numpy.linspace(-0.05, 0.05, 5)
+    r1[4] = numpy.linspace(-0.03, 0.03, 5)
+    r2 = r1.copy(order='F')
+    r3 = r1.copy(order='F')
+    mult.PassMethod = 'ExactMultipolePass'
+    lattice_pass([mult], r1)
+    # ExactHamiltonianPass uses the MaxOrder first coefficients
+    mult.PassMethod = 'ExactHamiltonianPass'
+    mult.Type = 2
+    lattice_pass([mult], r2)
+    numpy.testing.assert_allclose(r1, r2, rtol=0, atol=1.e-12)
+    # The amplitudes are beyond the paraxial approximation
+    mult.PassMethod = 'StrMPoleSymplectic4Pass'
+    lattice_pass([mult], r3)
+    assert numpy.amax(abs(r3 - r1)) > 1.e-5
+
+
+def _exact_sector_bend(r, length, angle):
+    """Horizontal motion in a sector dipole, from the intersection of the
+    particle circle with the exit face"""
+    rho = length / angle
+    rout = r.copy(order='F')
+    er = numpy.array([numpy.cos(angle), numpy.sin(angle)])
+    for r6 in rout.T:
+        x, px, _, _, dp, _ = r6
+        pz = numpy.sqrt((1 + dp)**2 - px**2)
+        radius = rho * (1 + dp)
+        p0 = numpy.array([rho + x, 0.0])
+        centre = p0 + rho * numpy.array([-pz, px])
+        b = er @ centre
+        t = b + numpy.array([-1, 1]) * numpy.sqrt(
+            b**2 - centre @ centre + radius**2)
+        a0 = p0 - centre
+        turns = [numpy.arctan2(a0[0]*a[1] - a0[1]*a[0], a0 @ a) % (2*numpy.pi)
+                 for a in (ti*er - centre for ti in t)]
+        k = numpy.argmin(turns)
+        a = t[k]*er - centre
+        r6[0] = t[k] - rho
+        r6[1] = (1 + dp) * (er @ numpy.array([-a[1], a[0]])) / radius
+        r6[5] += rho * (1 + dp) * turns[k] - length
+    return rout
+
+
+def test_exact_sector_bend_large_amplitude():
+    # Far from the axis, ExactSectorBendPass follows the exact circle
+    bend = elements.Dipole('b', 1.0, 0.3, PassMethod='ExactSectorBendPass')
+    r_in = numpy.zeros((6, 5), order='F')
+    r_in[0] = numpy.linspace(-0.01, 0.01, 5)
+    r_in[1] = numpy.linspace(0.1, -0.1, 5)
+    r_in[4] = numpy.linspace(-0.05, 0.05, 5)
+    expected = _exact_sector_bend(r_in, 1.0, 0.3)
+    lattice_pass([bend], r_in)
+    numpy.testing.assert_allclose(r_in, expected, rtol=0, atol=1.e-12)
+
+
 @pytest.mark.parametrize('passmethod',
                          ('GWigSymplecticPass', 'GWigSymplecticRadPass'))
 def test_gwig_symplectic_pass(rin, passmethod):
@@ -40,12 +143,147 @@ def test_gwig_symplectic_pass(rin, passmethod):
     element_pass(wiggler, rin)
 
 
+@pytest.mark.parametrize('passmethod, ref0', (
+    ('GWigSymplecticPass',
+     [1.8833245282058055e-04, 7.9956052439038143e-05,
+      -1.6026269233232303e-04, -9.9607206249027036e-05,
+      -4.0000000000000001e-03, 1.0013189052272008e-04]),
+    ('GWigSymplecticRadPass',
+     [1.8833246090983405e-04, 7.9955929618161586e-05,
+      -1.6026269014678528e-04, -9.9607052628515556e-05,
+      -4.0015351743096983e-03, 1.0013189071245184e-04])))
+def test_gwig_particles_independent(passmethod, ref0):
+    # Two horizontal and one vertical harmonics. The first particle is
+    # compared with the particle-by-particle integrators, before their
+    # vectorisation: they shifted the longitudinal position of the
+    # following particles, so only the first one is a reference
+    by = numpy.array([[1, 1, 0, 1, 1, 0], [3, 0.2, 0, 3, 3, 0]]).T
+    bx = numpy.array([[1, 0.3, 1, 0, 1, 0]]).T
+    wiggler = elements.Wiggler('w', 1.15, 0.05, 0.8, 3e9, By=by, Bx=bx,
+                               PassMethod=passmethod)
+    s = numpy.arange(1, 11) / 10
+    rin = numpy.asfortranarray(numpy.stack((
+        1.e-3 * s * numpy.where(numpy.arange(10) % 2, -1, 1),
+        2.e-4 * (0.5 - s),
+        -5.e-4 * s,
+        1.e-4 * (numpy.arange(10) % 3 - 1),
+        1.e-2 * (s - 0.5),
+        1.e-3 * s)))
+    rout = rin.copy(order='F')
+    lattice_pass([wiggler], rout)
+    numpy.testing.assert_allclose(rout[:, 0], ref0, rtol=0, atol=1.e-15)
+    # Each particle tracked alone gives the same result
+    for i in range(rin.shape[1]):
+        r1 = rin[:, i:i+1].copy(order='F')
+        lattice_pass([wiggler], r1)
+        numpy.testing.assert_allclose(r1[:, 0], rout[:, i],
+                                      rtol=0, atol=1.e-15)
+    # The result does not depend on the order of the particles
+    perm = numpy.array([7, 2, 9, 0, 5, 1, 8, 3, 6, 4])
+    rperm = rin[:, perm].copy(order='F')
+    lattice_pass([wiggler], rperm)
+    numpy.testing.assert_allclose(rperm, rout[:, perm], rtol=0, atol=1.e-15)
+
+
+def test_matrix_tijk_pass():
+    rng = numpy.random.default_rng(1)
+    m66 = numpy.eye(6)
+    m66[0, 1] = 2.0
+    tijk = rng.normal(size=(6, 6, 6))
+    tijk[rng.random((6, 6, 6)) > 0.2] = 0.0
+    elem = Element('t', PassMethod='MatrixTijkPass',
+                   M66=numpy.asfortranarray(m66),
+                   Tijk=numpy.asfortranarray(tijk))
+    r_in = numpy.asfortranarray(1.e-3 * rng.normal(size=(6, 20)))
+    r1 = m66 @ r_in
+    expected = r1 + numpy.einsum('ijk,jc,kc->ic', tijk, r1, r1)
+    lattice_pass([elem], r_in)
+    numpy.testing.assert_allclose(r_in, expected, rtol=0, atol=1e-15)
+
+
 def test_bndstrmpole_symplectic_4_pass(rin):
     bend = elements.Dipole('b', 1.0)
     bend.PassMethod = 'BndStrMPoleSymplectic4Pass'
     element_pass(bend, rin)
 
 
+@pytest.mark.parametrize('soa', [False, True])
+def test_multipole_passes_reference(soa):
+    # Results of the particle-by-particle integrators, before their
+    # vectorisation. The misalignment has T1[4] != 0: 1/(1+delta) is taken
+    # before the entrance misalignment
+    t1 = numpy.array([1.e-3, -2.e-4, 5.e-4, 1.e-4, 2.e-3, 0.0])
+    quad = elements.Multipole('q', 0.5, [0.0, 0.0, 0.0], [0.0, 1.2, 20.0],
+                              T1=t1, T2=-t1)
+    bend = elements.Dipole('b', 1.0, 0.05, -0.3, EntranceAngle=0.025,
+                           ExitAngle=0.025, FullGap=0.04, FringeInt1=0.5,
+                           FringeInt2=0.5, T1=t1, T2=-t1)
+    rin = numpy.asfortranarray(numpy.array([
+        [1.e-3, 0.0, 0.0, 0.0, 0.0, 0.0],
+        [-2.e-3, 1.e-4, 1.e-3, -2.e-4, 1.e-2, 0.0],
+        [5.e-4, -3.e-4, -1.5e-3, 1.e-4, -1.e-2, 1.e-3],
+        [3.e-3, 2.e-4, 2.e-3, 3.e-4, 2.e-2, -1.e-3]]).T)
+    quad_ref = numpy.array([
+        [0.0006040816177591238, -0.0011411907079085545,
+         0.00013462914852680526, 0.0003519887578979457,
+         0.0, 2.0446864145564605e-07],
+        [-0.0018990076495050527, 0.0006990658896547817,
+         0.0011687092790388727, 0.0006983622414675456,
+         0.01, 6.225863703711109e-08],
+        [3.61730966329586e-05, -0.0010879338653925201,
+         -0.0015562834326057191, -0.0005271564673180639,
+         -0.01, 0.0010002394658312549],
+        [0.002406363069515916, -0.0021489998860955116,
+         0.0026341319055937975, 0.00215274329409872,
+         0.019999999999999997, -0.0009990673016387855]]).T
+    bend_ref = numpy.array([
+        [0.0011487617652604564, 0.0007050493770643843,
+         2.136030187948289e-05, -0.00015837841645926766,
+         0.0, 0.000100849679518731],
+        [-0.001951777716234299, 0.000399848690473261,
+         0.0006868107934090435, -0.0006165287632223944,
+         0.01, -4.997464033299163e-05],
+        [-4.78813137404807e-06, -0.00032501645999011785,
+         -0.0011591505071155933, 0.00035734406846978415,
+         -0.01, 0.0010626861019633876],
+        [0.004155243341348475, 0.002615145572721861,
+         0.0020116885132282665, -0.00047675677835855784,
+         0.019999999999999997, -0.0007799720573488921]]).T
+    for elem, ref in ((quad, quad_ref), (bend, bend_ref)):
+        rout = rin.copy(order='F')
+        lattice_pass([elem], rout, soa=soa)
+        # Contracted multiply-adds may change the last bits
+        numpy.testing.assert_allclose(rout, ref, rtol=0, atol=1.e-15)
+
+
+@pytest.mark.parametrize('passmethod',
+                         ('StrMPoleSymplectic4Pass', 'BndMPoleSymplectic4Pass',
+                          'StrMPoleSymplectic4QuantPass',
+                          'BndMPoleSymplectic4QuantPass'))
+def test_kickangle_leaves_polynoms_unchanged(rin, passmethod):
+    kick = numpy.array([1.e-4, -2.e-4])
+    quad = elements.Quadrupole('q', 0.5, 1.2, PassMethod=passmethod,
+                               KickAngle=kick, BendingAngle=0.0,
+                               EntranceAngle=0.0, ExitAngle=0.0,
+                               Energy=6.e9)
+    ref = quad.deepcopy()
+    del ref.KickAngle
+    ref.PolynomB[0] -= numpy.sin(kick[0]) / ref.Length
+    ref.PolynomA[0] += numpy.sin(kick[1]) / ref.Length
+    polya, polyb = quad.PolynomA.copy(), quad.PolynomB.copy()
+    r1 = rin.copy(order='F')
+    r1[0, 0] = 1.e-3
+    r2 = r1.copy(order='F')
+    # Same random photons for the quantum passes
+    reset_rng(seed=3)
+    lattice_pass([quad], r1, nturns=3)
+    reset_rng(seed=3)
+    lattice_pass([ref], r2, nturns=3)
+    numpy.testing.assert_equal(quad.PolynomA, polya)
+    numpy.testing.assert_equal(quad.PolynomB, polyb)
+    numpy.testing.assert_allclose(r1, r2, rtol=0, atol=1e-15)
+
+
 def test_pydrift():
     pydrift = elements.Drift('drift', 1.0, PassMethod='pyDriftPass')
     cdrift = elements.Drift('drift', 1.0, PassMethod='DriftPass')
@@ -71,6 +309,94 @@ def test_pydrift():
     numpy.testing.assert_equal(pyout, cout)
 
 
+def test_compiled_pyintegrator(monkeypatch):
+    # A module giving the address of a compiled track function is used as
+    # a C integrator. Here, the address of the DriftPass trackFunction.
+    import ctypes
+    import os
+    import sys
+    import sysconfig
+    import types
+    import at.integrators
+    suffix = sysconfig.get_config_var('EXT_SUFFIX')
+    libname = os.path.join(os.path.dirname(at.integrators.__file__),
+                           'DriftPass' + suffix)
+    lib = ctypes.CDLL(libname)
+    module = types.ModuleType('pyCompiledDriftPass')
+    module.trackFunctionAddress = ctypes.cast(lib.trackFunction,
+                                              ctypes.c_void_p).value
+    monkeypatch.setitem(sys.modules, 'pyCompiledDriftPass', module)
+    hook = elements.Drift('drift', 1.0, PassMethod='pyCompiledDriftPass')
+    cdrift = elements.Drift('drift', 1.0, PassMethod='DriftPass')
+    rin = numpy.asfortranarray(1.e-4 * numpy.arange(24.0).reshape(6, 4))
+    out1 = lattice_pass([hook], rin.copy(order='F'), nturns=2)
+    out2 = lattice_pass([cdrift], rin.copy(order='F'), nturns=2)
+    numpy.testing.assert_equal(out1, out2)
+
+
+@pytest.mark.parametrize('scheme', [6, 8, 13])
+def test_integrator_scheme(scheme):
+    def track(nsteps, **kwargs):
+        mult = elements.Multipole('m', 0.5, [0, 0, 0], [0, 2.5, 30.0],
+                                  NumIntSteps=nsteps, **kwargs)
+        return element_pass(mult, rin.copy(order='F'))
+
+    rin = numpy.asfortranarray(1.e-3 * numpy.array(
+        [[1.0, 0.1, -0.5, 0.1, 1.0, 0.0], [-2.0, 0.0, 1.0, -0.2, -5.0, 0.0]]
+    ).T)
+    rref = track(400)
+    # Scheme 4 is the default one
+    numpy.testing.assert_allclose(track(4, IntegratorScheme=4), track(4),
+                                  rtol=0, atol=1.e-17)
+    err = numpy.max(numpy.abs(track(4, IntegratorScheme=scheme) - rref))
+    if scheme < 10:
+        # Higher order schemes are more accurate with the same steps
+        assert err < numpy.max(numpy.abs(track(4) - rref))
+    assert err < 1.e-5
+
+
+def test_quantum_energy_loss():
+    # The mean energy loss of the photon emission is the classical one
+    bend = elements.Dipole('b', 1.0, 0.1,
+                           PassMethod='BndMPoleSymplectic4QuantPass')
+    rad = bend.copy()
+    rad.PassMethod = 'BndMPoleSymplectic4RadPass'
+    rin = numpy.zeros((6, 20000), order='F')
+    reset_rng(seed=11)
+    rq = element_pass(bend, rin, energy=6.e9)
+    rr = element_pass(rad, numpy.zeros((6, 1), order='F'), energy=6.e9)
+    numpy.testing.assert_allclose(numpy.mean(rq[4]), rr[4, 0], rtol=0.02)
+
+
+def test_radiation_kick_energy_loss(hmba_lattice):
+    # The energy loss of the radiating integrators is the analytic one
+    ring = hmba_lattice.enable_6d(copy=True)
+    eloss = get_energy_loss(ring, method=ELossMethod.TRACKING)
+    eref = get_energy_loss(ring, method=ELossMethod.INTEGRAL)
+    numpy.testing.assert_allclose(eloss, eref, rtol=1.e-4)
+    # Same result with the curvilinear integrator
+    for dip in ring:
+        if isinstance(dip, elements.Dipole):
+            dip.PassMethod = 'BndMPoleSymplectic4E2RadPass'
+            dip.Energy = ring.energy
+    eloss2 = get_energy_loss(ring, method=ELossMethod.TRACKING)
+    numpy.testing.assert_allclose(eloss2, eref, rtol=1.e-4)
+
+
+def test_set_integration_steps():
+    sext = elements.Sextupole('sf', 0.2, 50.0, NumIntSteps=10)
+    quad = elements.Quadrupole('qf', 0.5, 2.5, NumIntSteps=10)
+    ring = Lattice([quad, elements.Drift('d', 1.0), sext, quad.copy()],
+                   energy=6.e9)
+    steps4 = set_integration_steps(ring, tol=1.e-10)
+    assert len(steps4) == 3
+    assert steps4[0] == steps4[2]
+    steps6 = set_integration_steps(ring, tol=1.e-10, scheme=6)
+    assert ring[0].IntegratorScheme == 6
+    assert numpy.all(steps6 <= steps4)
+    assert ring[0].NumIntSteps == steps6[0]
+
+
 def test_pyintegrator(hmba_lattice):
     params = {'Length': 0,
               'PassMethod': 'pyIdentityPass',
@@ -81,3 +407,103 @@ def test_pyintegrator(hmba_lattice):
     hmba_lattice = hmba_lattice + [id_elem]
     pout2 = lattice_pass(hmba_lattice, pin.copy(), nturns=1)
     numpy.testing.assert_equal(pout1, pout2)
+
+
+@pytest.mark.parametrize('order', [1, 3])
+@pytest.mark.parametrize('nonuniform', [False, True])
+def test_idtable_pass(nonuniform, order):
+    # A linear kick map must be interpolated exactly
+    xtable = numpy.linspace(-0.02, 0.02, 41)
+    ytable = numpy.linspace(-0.005, 0.005, 11)
+    if nonuniform:
+        xtable[1:-1] += 1.0e-4*numpy.sin(numpy.arange(1, 40))
+    ax, bx, ay, by = 1.0e-3, 2.0e-3, -3.0e-3, 4.0e-3
+    yy, xx = numpy.meshgrid(ytable, xtable, indexing='ij')
+    xkick = numpy.asfortranarray(ax*xx + bx*yy)
+    ykick = numpy.asfortranarray(ay*xx + by*yy)
+    idelem = Element('ID', PassMethod='IdTablePass', Length=0.0, Nslice=1,
+                     xkick=xkick, ykick=ykick, xtable=xtable, ytable=ytable,
+                     InterpolationOrder=order)
+    rng = numpy.random.default_rng(11)
+    rin = numpy.zeros((6, 200), order='F')
+    rin[0] = rng.uniform(-0.019, 0.019, 200)
+    rin[2] = rng.uniform(-0.0049, 0.0049, 200)
+    rin[4] = rng.uniform(-0.01, 0.01, 200)
+    rout = rin.copy(order='F')
+    element_pass(idelem, rout)
+    numpy.testing.assert_allclose(rout[1], (ax*rin[0]+bx*rin[2])/(1.0+rin[4]),
+                                  rtol=0, atol=1.0e-14)
+    numpy.testing.assert_allclose(rout[3], (ay*rin[0]+by*rin[2])/(1.0+rin[4]),
+                                  rtol=0, atol=1.0e-14)
+
+
+def test_variable_multipole_sine():
+    # The phase of the kick depends on the time of flight of each particle
+    freq, phase, amp = 3.52e8, 0.3, 1.0e-5
+    elem = VariableMultipole('ACM', AmplitudeB=amp, FrequencyB=freq,
+                             PhaseB=phase)
+    rin = numpy.zeros((6, 5), order='F')
+    rin[5] = numpy.linspace(-0.1, 0.1, 5)
+    rout = rin.copy(order='F')
+    element_pass(elem, rout)
+    expected = -amp*numpy.sin(2*numpy.pi*freq*rin[5]/clight + phase)
+    numpy.testing.assert_allclose(rout[1], expected, rtol=0, atol=1.0e-18)
+
+
+def _quad_fringe_reference(r, b2, fm0, fp0):
+    # Per-particle linear fringe matrices of the elegant model
+    def partial(r, inf, f, part):
+        k = b2/(1.0+r[4])
+        if part == 1:
+            j1x = inf*(k*f[1] - 2*k*k*f[3]/3.)
+            j1y = inf*(-k*f[1] - 2*k*k*f[3]/3.)
+            j3x = inf*(k*k*(f[2] + f[4]))
+        else:
+            j1x = inf*(k*f[1] + k*k*f[0]*f[2]/2)
+            j1y = inf*(-k*f[1] + k*k*f[0]*f[2])
+            j3x = inf*(k*k*(f[4] - f[0]*f[1]))
+        j2x = inf*k*f[2]
+        ex, ey = numpy.exp(j1x), numpy.exp(j1y)
+        r[0] = ex*r[0] + j2x/ex*r[1]
+        r[1] = ex*j3x*r[0] + (1 + j2x*j3x)/ex*r[1]
+        r[2] = ey*r[2] - j2x/ey*r[3]
+        r[3] = ey*j3x*r[2] + (1 - j2x*j3x)/ey*r[3]
+
+    def nonlinear(r, sign):
+        u = b2/(12.0*(1.0+r[4]))
+        x2, z2, xz = r[0]*r[0], r[2]*r[2], r[0]*r[2]
+        gx = u*(x2+3*z2)*r[0]
+        gz = u*(z2+3*x2)*r[2]
+        r1 = 3*u*(2*xz*r[3]-(x2+z2)*r[1])
+        r3 = 3*u*(2*xz*r[1]-(x2+z2)*r[3])
+        r[0] += sign*gx
+        r[2] -= sign*gz
+        r[5] -= sign*(gz*r[3] - gx*r[1])/(1+r[4])
+        r[1] += sign*r1
+        r[3] -= sign*r3
+
+    partial(r, -1.0, fp0, 1)
+    nonlinear(r, 1.0)
+    partial(r, -1.0, fm0, 2)
+    partial(r, 1.0, fm0, 1)
+    nonlinear(r, -1.0)
+    partial(r, 1.0, fp0, 2)
+
+
+@pytest.mark.parametrize('soa', [False, True])
+def test_linear_quad_fringe(soa):
+    # Validate the cached fringe coefficients against the matrices
+    # computed for each particle
+    b2 = 2.0
+    fm0 = numpy.array([0.05, 0.02, -0.03, 0.01, 0.04])
+    fp0 = numpy.array([-0.04, 0.03, 0.02, -0.01, 0.05])
+    quad = elements.Quadrupole('QF', 0.0, b2, FringeQuadEntrance=2,
+                               FringeQuadExit=2,
+                               fringeIntM0=fm0, fringeIntP0=fp0)
+    rng = numpy.random.default_rng(3)
+    rin = numpy.asfortranarray(rng.uniform(-1.e-3, 1.e-3, (6, 50)))
+    rin[4] = rng.uniform(-0.05, 0.05, 50)
+    rout = rin.copy(order='F')
+    lattice_pass([quad], rout, soa=soa)
+    _quad_fringe_reference(rin, b2, fm0, fp0)
+    numpy.testing.assert_allclose(rout, rin, rtol=0, atol=1.e-15)
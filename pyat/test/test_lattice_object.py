@@ -124,6 +124,32 @@ def test_deepcopy(hmba_lattice):
     assert id(hmba_lattice.deepcopy()[0]) != id(hmba_lattice[0])
 
 
+def test_lattice_columns(hmba_lattice):
+    ring = hmba_lattice.deepcopy()
+    lengths = numpy.array([elem.Length for elem in ring])
+    assert_equal(ring.columns.get('Length'), lengths)
+    assert_allclose(ring.columns.s_pos,
+                    numpy.concatenate(([0.0], numpy.cumsum(lengths))))
+    names, codes = ring.columns.passmethods
+    assert [names[c] for c in codes] == [elem.PassMethod for elem in ring]
+    iq = ring.get_uint32_index(elements.Quadrupole)
+    kcol = ring.columns.get('PolynomB', 0.0)
+    assert_equal(kcol[iq, 1], [ring[i].PolynomB[1] for i in iq])
+    assert ring.columns.get('Length') is ring.columns.get('Length')
+    # Setting an attribute invalidates the cache
+    ring[iq[0]].Length += 1.0
+    assert ring.columns.get('Length')[iq[0]] == lengths[iq[0]] + 1.0
+    assert_allclose(ring.get_s_pos(len(ring)), [numpy.sum(lengths) + 1.0])
+    # In-place modifications need touch()
+    ring[iq[0]].PolynomB[1] = 0.5
+    ring[iq[0]].touch()
+    assert ring.columns.get('PolynomB', 0.0)[iq[0], 1] == 0.5
+    # So does the lattice structure
+    ring.insert(0, elements.Drift('d', 2.0))
+    assert ring.columns.get('Length')[0] == 2.0
+    assert not ring.columns.mask('PolynomB')[0]
+
+
 def test_property_values_against_known(hmba_lattice):
     assert hmba_lattice.rf_voltage == 6000000
     assert hmba_lattice.harmonic_number == 992
@@ -186,6 +212,30 @@ def test_develop(ring):
     assert_allclose(rp1.fulltunes, rp2.fulltunes)
     assert_allclose(rp1.U0, rp2.U0)
 
+def test_slice_shares_inner_slices(hmba_lattice):
+    ring = hmba_lattice.disable_6d(copy=True)
+    shared = ring.slice(size=0.05, share=True)
+    independent = ring.slice(size=0.05)
+    assert len(shared) == len(independent)
+    assert len(set(map(id, shared))) < len(set(map(id, independent)))
+    assert_allclose(shared.get_s_pos(len(shared)),
+                    ring.get_s_pos(len(ring)))
+    rin = numpy.full((6, 2), 1.e-4)
+    r1 = shared.lattice_pass(rin.copy(order='F'), 3)
+    r2 = independent.lattice_pass(rin.copy(order='F'), 3)
+    assert_allclose(r1, r2, rtol=0, atol=1e-15)
+    # The cached element data is shared between the inner slices
+    r3 = shared.lattice_pass(rin.copy(order='F'), 3, keep_lattice=True)
+    assert_equal(r3, r1)
+    # By default, the slices are distinct objects
+    quad = Lattice([elements.Quadrupole('q', 1.0, 0.5)], energy=3.e9)
+    parts = quad.slice(slices=10)
+    assert len(set(map(id, parts))) == 10
+    parts[4].T1 = numpy.full(6, 1.e-3)
+    assert not hasattr(parts[5], 'T1')
+    shared = quad.slice(slices=10, share=True)
+    assert shared[4] is shared[5]
+
 @pytest.mark.parametrize('ring',
                          [pytest.lazy_fixture('hmba_lattice')])
 def test_operators(ring):
@@ -205,3 +255,41 @@ def test_operators(ring):
     newring1 = ring.reverse(copy=True)
     assert_equal(newring1[-1].FamName, ring[0].FamName)
 
+
+
+def test_compile():
+    rng = numpy.random.default_rng(1)
+    m1 = numpy.identity(6) + 0.01 * rng.standard_normal((6, 6))
+    m2 = numpy.identity(6) + 0.01 * rng.standard_normal((6, 6))
+    rot = numpy.identity(6)
+    rot[0, 2] = rot[2, 0] = 0.001
+    ring = Lattice([
+        elements.Drift('d1', 0.5),
+        elements.Marker('m1'),
+        elements.Drift('d2', 0.3),
+        elements.M66('mat1', m1, T1=numpy.arange(6) * 1.e-4, R2=rot),
+        elements.Monitor('bpm'),
+        elements.M66('mat2', m2, T2=numpy.ones(6) * 1.e-5),
+        elements.Quadrupole('qf', 0.2, 1.0),
+        elements.Monitor('bpm2'),
+    ], energy=3.e9)
+    compiled = ring.compile(keep='bpm2')
+    assert_equal([e.FamName for e in compiled], ['d1', 'mat1', 'qf', 'bpm2'])
+    assert_allclose(compiled.circumference, ring.circumference)
+    rin = 1.e-4 * rng.standard_normal((6, 5))
+    r1 = ring.lattice_pass(rin.copy())
+    r2 = compiled.lattice_pass(rin.copy())
+    assert_allclose(r2, r1, rtol=0, atol=1.e-15)
+
+
+def test_compile_apertures():
+    ring = Lattice([
+        elements.Drift('d1', 0.5),
+        elements.Aperture('ap1', [-0.02, 0.03, -0.01, 0.01]),
+        elements.Aperture('ap2', [-0.03, 0.02, -0.005, 0.02]),
+        elements.Drift('d2', 0.5),
+    ], energy=3.e9)
+    compiled = ring.compile()
+    assert_equal([e.FamName for e in compiled], ['d1', 'ap1', 'd2'])
+    assert_equal(compiled[1].Limits, [-0.02, 0.02, -0.005, 0.01])
+    assert_equal(ring[1].Limits, [-0.02, 0.03, -0.01, 0.01])
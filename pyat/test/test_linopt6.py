@@ -59,3 +59,17 @@ def test_linopt6_line(lattice, dp, method):
                      rtol=0, err_msg=field)
         assert_close(ld4[field], tr4[field], atol=1.e-8,
                      rtol=0, err_msg=field)
+
+
+@pytest.mark.parametrize('lattice',
+                         [pytest.lazy_fixture('dba_lattice'),
+                          pytest.lazy_fixture('hmba_lattice')])
+@pytest.mark.parametrize('method', [linopt2, linopt6])
+def test_linopt6_tangent(lattice, method):
+    """Compare the tangent matrices with finite differences"""
+    refpts = range(len(lattice) + 1)
+    ld0, rd, ld = get_optics(lattice, refpts, method=method)
+    ld0t, rdt, ldt = get_optics(lattice, refpts, method=method, tangent=True)
+    assert_close(rd.tune, rdt.tune, atol=1e-9, rtol=0)
+    for field in ['closed_orbit', 'alpha', 'beta', 'mu']:
+        assert_close(ld[field], ldt[field], atol=1e-7, rtol=0, err_msg=field)
@@ -255,3 +255,35 @@ def test_sanitise_class_error(elem_kwargs):
 )
 def test_split_ignoring_parentheses(string, delimiter, target):
     assert split_ignoring_parentheses(string, delimiter) == target
+
+
+def test_binfile_round_trip(hmba_lattice, tmp_path):
+    from at.load import BinFile
+    ring = hmba_lattice.deepcopy()
+    ring[3].CustomDict = {'a': 1.0, 'b': 'x'}
+    fname = str(tmp_path / 'hmba.atb')
+    ring.save(fname)
+    bf = BinFile(fname)
+    assert len(bf) == len(ring)
+    lengths = bf.values('Length', default=0.0)
+    numpy.testing.assert_equal(lengths, [elem.Length for elem in ring])
+    # Lazy access to a single element
+    assert bf[-1].equals(ring[-1])
+    assert bf[3].CustomDict == ring[3].CustomDict
+    newring = at.load_lattice(fname)
+    assert newring.attrs.keys() == ring.attrs.keys()
+    assert newring.energy == ring.energy
+    for e1, e2 in zip(newring, ring):
+        assert type(e1) is type(e2)
+        assert e1.equals(e2)
+    # Copy-on-write: the file is not modified
+    iq = next(i for i, e in enumerate(ring) if hasattr(e, 'PolynomB'))
+    newring[iq].PolynomB[0] += 1.0
+    assert BinFile(fname)[iq].equals(ring[iq])
+    # Round trip of a lattice loaded from a mat-file
+    matname = str(tmp_path / 'hmba.mat')
+    newring.save(matname)
+    matring = at.load_lattice(matname)
+    matring.save(fname)
+    for e1, e2 in zip(at.load_lattice(fname), matring):
+        assert e1.equals(e2)
@@ -64,6 +64,19 @@ def test_linopt_matching(test_ring):
     assert_close(cst1.evaluate(newring), 0, rtol=0.0, atol=1e-4)
 
 
+def test_parallel_matching(test_ring):
+    names = ['QF1*', 'QD2*']
+    variables = [at.ElementVariable(at.get_refpts(test_ring, nm), 'PolynomB',
+                                    index=1, name=nm) for nm in names]
+    cst1 = at.LinoptConstraints(test_ring, method=at.linopt2)
+    cst1.add('tunes', [0.38, 0.85], name='tunes')
+    newring = at.match(test_ring, variables, (cst1,), verbose=0)
+    parring = at.match(test_ring, variables, (cst1,), verbose=0, workers=2)
+    assert_close(cst1.evaluate(parring), 0, rtol=0.0, atol=1e-8)
+    assert_close([var.get(parring) for var in variables],
+                 [var.get(newring) for var in variables], rtol=1e-6)
+
+
 def test_envelope_matching(test_ring):
     # Define the variables
     test_ring = test_ring.radiation_on(copy=True)
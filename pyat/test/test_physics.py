@@ -119,6 +119,32 @@ def test_find_elem_m66(hmba_lattice, index):
     assert_close(m66, expected, rtol=1e-5, atol=1e-7)
 
 
+@pytest.mark.parametrize('is6d', (False, True))
+def test_find_orbit_response(hmba_lattice, is6d):
+    ring = hmba_lattice.enable_6d(copy=True) if is6d \
+        else hmba_lattice.disable_6d(copy=True)
+    bpms = ring.get_uint32_index(at.Quadrupole)
+    cors = ring.get_uint32_index(at.Sextupole)[[0, 3, 5]]
+    orm = physics.find_orbit_response(ring, bpms, cors, dispersion=True)
+    assert orm.shape == (2*len(bpms), 2*len(cors)+1)
+    _, orb0 = physics.find_orbit(ring, bpms)
+    kick = 1.e-6
+    for ic, c in enumerate(cors):
+        for plane in (0, 1):
+            rg = ring.deepcopy()
+            kickangle = numpy.zeros(2)
+            kickangle[plane] = kick
+            rg[c].KickAngle = kickangle
+            _, orb = physics.find_orbit(rg, bpms)
+            resp = ((orb - orb0)[:, [0, 2]] / kick).T.reshape(-1)
+            assert_close(orm[:, plane*len(cors)+ic], resp, rtol=0,
+                         atol=1.e-3*numpy.amax(abs(resp)))
+    if not is6d:
+        _, _, ld = physics.linopt4(ring, refpts=bpms)
+        assert_close(orm[:len(bpms), -1], ld.dispersion[:, 0], rtol=0,
+                     atol=1.e-6)
+
+
 def test_find_sync_orbit(dba_lattice):
     expected = numpy.array([[1.030844e-5, 1.390795e-5, -2.439041e-30,
                              4.701621e-30, 1.265181e-5, 3.749859e-6],
@@ -140,6 +166,23 @@ def test_find_orbit6(hmba_lattice):
     assert_close(orbit6, orbit6_MATLAB, rtol=0, atol=1e-12)
 
 
+@pytest.mark.parametrize('dp', (0.0, 1e-3))
+def test_find_orbit4_tangent(dba_lattice, dp):
+    orbit4, _ = physics.find_orbit4(dba_lattice, dp)
+    orbit4t, _ = physics.find_orbit4(dba_lattice, dp, tangent=True)
+    assert_close(orbit4t, orbit4, rtol=0, atol=1e-12)
+    orbit4, _ = physics.find_orbit4(dba_lattice, dct=1e-5)
+    orbit4t, _ = physics.find_orbit4(dba_lattice, dct=1e-5, tangent=True)
+    assert_close(orbit4t, orbit4, rtol=0, atol=1e-12)
+
+
+def test_find_orbit6_tangent(hmba_lattice):
+    hmba_lattice = hmba_lattice.radiation_on(dipole_pass=None, copy=True)
+    orbit6, _ = physics.find_orbit6(hmba_lattice)
+    orbit6t, _ = physics.find_orbit6(hmba_lattice, tangent=True)
+    assert_close(orbit6t, orbit6, rtol=0, atol=1e-12)
+
+
 def test_find_orbit6_produces_same_result_with_keep_lattice_True(hmba_lattice):
     hmba_lattice = hmba_lattice.radiation_on(quadrupole_pass=None, copy=True)
     orbit0, _ = physics.find_orbit6(hmba_lattice)
@@ -169,6 +212,26 @@ def test_find_m44_no_refpts(dba_lattice):
     assert_close(m44, expected, rtol=1e-5, atol=1e-7)
 
 
+@pytest.mark.parametrize('refpts', ([145], [1, 2, 3]))
+def test_find_m44_tangent(hmba_lattice, refpts):
+    m44, ms = physics.find_m44(hmba_lattice, refpts=refpts)
+    m44t, mst = physics.find_m44(hmba_lattice, refpts=refpts, tangent=True)
+    assert_close(m44t, m44, rtol=1e-5, atol=1e-7)
+    assert_close(mst, ms, rtol=1e-5, atol=1e-7)
+
+
+def test_lattice_tangent_pass(hmba_lattice):
+    r_in = numpy.asfortranarray(numpy.array([[1e-4, 0, 1e-4, 0, 1e-3, 0]]).T)
+    r_fd = numpy.asfortranarray(r_in + 0.5e-8 * numpy.hstack(
+        (numpy.eye(6), -numpy.eye(6))))
+    lattice_pass(hmba_lattice, r_fd)
+    m_fd = (r_fd[:, :6] - r_fd[:, 6:]) / 1e-8
+    r_out, ms = at.lattice_tangent_pass(hmba_lattice, r_in)
+    assert ms.shape == (1, 1, 6, 6)
+    assert_close(r_out[:, 0, 0], r_in[:, 0], rtol=0, atol=1e-15)
+    assert_close(ms[0, 0], m_fd, rtol=1e-5, atol=1e-6)
+
+
 @pytest.mark.parametrize('refpts', ([145], [1, 2, 3, 145]))
 def test_linopt(dba_lattice, refpts):
     """Compare with Matlab results"""
@@ -253,6 +316,57 @@ def test_linopt_line(hmba_lattice, refpts):
     assert_close(ld['dispersion'], ltd['dispersion'], rtol=1e-7, atol=1e-12)
 
 
+def test_radiation_integrals(hmba_lattice):
+    ring = hmba_lattice.disable_6d(copy=True)
+    i1, i2, i3, i4, i5 = ring.get_radiation_integrals()
+    theta = ring.get_value_refpts(at.Dipole, 'BendingAngle')
+    lg = ring.get_value_refpts(at.Dipole, 'Length')
+    assert_close(i2, numpy.sum(theta * theta / lg), rtol=1e-12)
+    assert_close(i3, numpy.sum(numpy.abs(theta) ** 3 / lg / lg), rtol=1e-12)
+    assert_close(i1 / ring.get_s_pos(at.End)[0], physics.get_mcf(ring),
+                 rtol=1e-3)
+    assert i5 > 0.0
+
+
+def test_avlinopt(hmba_lattice):
+    ring = hmba_lattice.disable_6d(copy=True)
+    refpts = range(len(ring))
+    ld, avebeta, avemu, avedisp, aves, tune, chrom = ring.avlinopt(
+        refpts=refpts)
+    short = ring.get_value_refpts(refpts, 'Length') == 0.0
+    assert_close(avebeta[short], ld.beta[short], rtol=1e-12)
+    assert_close(aves, ld.s_pos + 0.5 * ring.get_value_refpts(refpts,
+                                                              'Length'),
+                 rtol=1e-12)
+    assert numpy.all(avebeta > 0.0)
+
+
+def test_in_place_strengths_refresh_columns(hmba_lattice):
+    # In-place modifications through set_value_refpts invalidate the
+    # cached attribute columns
+    ring = hmba_lattice.disable_6d(copy=True)
+    ref = ring.deepcopy()
+    refpts = range(len(ring))
+    ring.avlinopt(refpts=refpts)
+    ring.get_radiation_integrals()
+    mask = ring.get_bool_index(at.Quadrupole) | ring.get_bool_index(at.Dipole)
+    k = 1.01 * ring.get_value_refpts(mask, 'PolynomB', index=1)
+    ring.set_value_refpts(mask, 'PolynomB', k, index=1)
+    for elem, kv in zip(ref.select(mask), k):
+        polb = elem.PolynomB.copy()
+        polb[1] = kv
+        elem.PolynomB = polb
+    assert_close(ring.columns.get('PolynomB', 0.0)[mask, 1], k, rtol=0)
+    ld, avebeta, avemu, avedisp, aves, tune, chrom = ring.avlinopt(
+        refpts=refpts)
+    ld0, avebeta0, avemu0, avedisp0, aves0, tune0, chrom0 = ref.avlinopt(
+        refpts=refpts)
+    assert_close(avebeta, avebeta0, rtol=1e-12)
+    assert_close(avedisp, avedisp0, rtol=1e-12, atol=1e-15)
+    assert_close(ring.get_radiation_integrals(),
+                 ref.get_radiation_integrals(), rtol=1e-12)
+
+
 def test_get_tune_chrom(hmba_lattice):
     qlin = hmba_lattice.get_tune()
     qplin = hmba_lattice.get_chrom()
@@ -410,3 +524,132 @@ def test_ohmi_envelope(hmba_lattice, refpts):
     assert_close(obs['emitXY'], [1.320388935445164e-10, 0.0], atol=3e-12)
     assert_close(obs['emitXYZ'], [1.322274374826649e-10, 0.0,
                                   2.858473194929233e-06], atol=3e-12)
+
+
+@pytest.mark.parametrize('nturns', [1026, 5003])
+def test_naff_batch(nturns):
+    tunes = numpy.array([0.1, 0.17, 0.23, 0.31])
+    turns = numpy.arange(nturns)
+    phi = 2.0 * numpy.pi * tunes[:, numpy.newaxis] * turns
+    y = numpy.cos(phi) + 0.01 * numpy.cos(2.0 * numpy.pi * 0.37 * turns)
+    yp = numpy.sin(phi)
+    freq, ampl, phase = physics.naff(y, yp, window=1, nfreq=3)
+    assert freq.shape == (4, 3)
+    assert_close(freq[:, 0] / (2.0 * numpy.pi), tunes, rtol=0, atol=1e-8)
+    assert_close(ampl[:, 0], 1.0, rtol=0, atol=1e-8)
+    # Each signal gives the same result as a separate analysis
+    freq1, ampl1, phase1 = physics.naff(y[2], yp[2], window=1, nfreq=3)
+    numpy.testing.assert_equal(freq1, freq[2])
+    numpy.testing.assert_equal(ampl1, ampl[2])
+
+
+@pytest.mark.parametrize('pool_size', [None, 2])
+def test_harmonic_analysis_batch(pool_size):
+    tunes = numpy.linspace(0.11, 0.39, 8)
+    turns = numpy.arange(512)
+    cents = numpy.cos(2.0 * numpy.pi * tunes[:, numpy.newaxis] * turns)
+    cents += 0.1 * numpy.cos(2.0 * numpy.pi * 0.03 * turns)
+    qbatch = physics.get_tunes_harmonic(cents, num_harmonics=3, fmax=0.5,
+                                        pool_size=pool_size)
+    assert_close(qbatch, tunes, rtol=0, atol=1e-6)
+    # The batch gives the same result as separate analyses
+    freq, amp = physics.get_spectrum_harmonic(cents, num_harmonics=3,
+                                              pool_size=pool_size)
+    for i in range(len(tunes)):
+        f1, a1 = physics.get_spectrum_harmonic(cents[i], num_harmonics=3)
+        assert_close(f1, freq[i], rtol=0, atol=1e-12)
+        assert_close(a1, amp[i], rtol=0, atol=1e-12)
+
+
+def test_drivingterms_incremental():
+    rng = numpy.random.default_rng(5)
+    n = 60
+    s = 0.5 * numpy.arange(n)
+    betax = rng.uniform(2.0, 20.0, n)
+    betay = rng.uniform(2.0, 20.0, n)
+    etax = rng.uniform(0.0, 0.2, n)
+    phix = numpy.cumsum(rng.uniform(0.0, 0.1, n))
+    phiy = numpy.cumsum(rng.uniform(0.0, 0.1, n))
+    zero = numpy.zeros(n)
+    b3l = numpy.where(numpy.arange(n) % 2 == 0, rng.normal(size=n), 0.0)
+    optics = (s, betax, betay, etax, phix, phiy, zero, zero)
+    tunes = (0.23, 0.31)
+    terms, pairs = physics.drivingterms(*optics, b3l, zero, tunes)
+    h21000 = numpy.sum(b3l * betax**1.5 / 8 * numpy.exp(1j * phix))
+    assert_close(terms['h21000'], h21000, rtol=1e-12)
+    # Updating the pair sums gives the same result as a full evaluation
+    b3new = b3l.copy()
+    b3new[[4, 10, 11]] = [0.0, 2.0, 0.5]
+    full, _ = physics.drivingterms(*optics, b3new, zero, tunes)
+    incr, _ = physics.drivingterms(*optics, b3new, zero, tunes,
+                                   b3l_ref=b3l, pairs_ref=pairs)
+    assert full.keys() == incr.keys()
+    for key, value in full.items():
+        assert_close(incr[key], value, rtol=1e-10, atol=1e-9)
+
+
+def test_envelope_track(hmba_lattice):
+    ring = hmba_lattice.radiation_on(copy=True)
+    emit0, beamdata, _ = ring.ohmi_envelope()
+    orbit = emit0.orbit6
+    # The equilibrium envelope is invariant
+    kick = numpy.array([1.e-5, 0.0, 0.0, 0.0, 0.0, 0.0])
+    sigma, cent = ring.envelope_track(emit0.r66, 20, centroid=orbit + kick,
+                                      orbit=orbit)
+    assert sigma.shape == (21, 6, 6)
+    assert_close(sigma[-1], emit0.r66, rtol=0, atol=1e-6*numpy.abs(
+        emit0.r66).max())
+    assert_close(cent[0], orbit + kick, rtol=0, atol=1e-18)
+    # Without radiation, the envelope follows the one-turn matrix
+    ring4 = hmba_lattice.disable_6d(copy=True)
+    m66, _ = ring4.find_m66()
+    sig4, _ = ring4.envelope_track(emit0.r66, 1)
+    assert_close(sig4[1], m66 @ emit0.r66 @ m66.T, rtol=1e-10, atol=1e-30)
+
+
+def test_cumul_raddiff_matrices(hmba_lattice):
+    ring = hmba_lattice.radiation_on(copy=True)
+    bbcum, orbs = physics.radiation._dmatr(ring)
+    # Element by element accumulation
+    cumul = numpy.zeros((6, 6))
+    for elem, orbit, bref in zip(ring, orbs, bbcum):
+        assert_close(bref, cumul, rtol=1e-8, atol=1e-24)
+        m = physics.find_elem_m66(elem, orbit)
+        cumul = m @ cumul @ m.T
+        if elem.PassMethod.endswith('RadPass'):
+            cumul += physics.find_mpole_raddiff_matrix(elem, orbit,
+                                                       ring.energy)
+    assert_close(bbcum[-1], cumul, rtol=1e-8, atol=1e-24)
+
+
+def test_fmap_adaptive_track(hmba_lattice):
+    ring = hmba_lattice.radiation_off(copy=True)
+    orbit = numpy.zeros(6)
+    coarse, _ = physics.fmap_parallel_track(ring, coords=[-4, 4, 0, 2],
+                                            steps=[2, 2], turns=64, ncpu=2,
+                                            orbit=orbit)
+    fmap = physics.fmap_adaptive_track(ring, coords=[-4, 4, 0, 2],
+                                       steps=[2, 2], turns=64, levels=1,
+                                       ncpu=2, orbit=orbit,
+                                       nudiff_threshold=-10)
+    # The coarse grid is part of the adaptive map, with the same results
+    assert_close(fmap[:len(coarse)], coarse, rtol=1e-6, atol=1e-12)
+    # At most all the cells are refined
+    assert len(fmap) <= 25
+    assert len(fmap) > len(coarse)
+
+
+def test_longitudinal_map(hmba_lattice):
+    ring = hmba_lattice.radiation_on(copy=True)
+    lmap = physics.LongitudinalMap.from_ring(ring, radiation=True)
+    ring4 = ring.disable_6d(copy=True)
+    assert_close(lmap.alphas[0], physics.get_mcf(ring4), rtol=1e-3)
+    particles = numpy.zeros((2, 3))
+    particles[0] = [1.e-4, -1.e-4, 2.e-4]
+    cent = numpy.empty((512, 3))
+    for turn in range(512):
+        lmap.track(particles)
+        cent[turn] = particles[0]
+    assert lmap.turn == 512
+    tunes = physics.get_tunes_harmonic(cent.T, fmin=1.e-3, fmax=0.5)
+    assert_close(tunes, ring.get_tune()[2], rtol=2e-2)
@@ -1,4 +1,10 @@
 from at import elements, lattice_pass
+from at.tracking import lattice_pass_iter, lattice_pass_file
+from at.tracking import lattice_pass_async
+from at.tracking import lattice_variants_pass
+from at.tracking import beam, sigma_matrix
+from at.tracking import get_bunches_std_mean, unfold_beam
+from at.lattice import random
 import numpy
 import pytest
 
@@ -32,3 +38,156 @@ def test_lattice_convert_to_list_if_incorrect_type():
     r_original = numpy.copy(rin)
     r_out = lattice_pass(lattice, rin, 1)
     numpy.testing.assert_equal(r_original, r_out.reshape(6, 2))
+
+
+@pytest.mark.parametrize('reduce', [None, 'centroid'])
+def test_lattice_pass_file(hmba_lattice, tmp_path, reduce):
+    lattice = list(hmba_lattice)
+    rin = numpy.asfortranarray(numpy.random.default_rng(1).normal(
+        scale=1e-5, size=(6, 10)))
+    rin2 = rin.copy(order='F')
+    refpts = [0, 5, len(lattice)]
+    r_out = lattice_pass(lattice, rin, nturns=7, refpts=refpts)
+    fname = str(tmp_path / 'tbt.npy')
+    r_file = lattice_pass_file(lattice, rin2, fname, nturns=7, refpts=refpts,
+                               chunk_turns=3, reduce=reduce)
+    numpy.testing.assert_equal(rin2, rin)
+    if reduce == 'centroid':
+        r_out = numpy.mean(r_out, axis=1)
+    numpy.testing.assert_allclose(numpy.load(fname), r_out, rtol=0,
+                                  atol=1.e-18)
+    numpy.testing.assert_allclose(r_file, r_out, rtol=0, atol=1.e-18)
+
+
+def test_lattice_pass_iter_moments(hmba_lattice):
+    lattice = list(hmba_lattice)
+    rin = numpy.asfortranarray(numpy.random.default_rng(2).normal(
+        scale=1e-5, size=(6, 50)))
+    r_out = lattice_pass(lattice, rin.copy(order='F'), nturns=4)
+    chunks = list(lattice_pass_iter(lattice, rin, nturns=4, chunk_turns=3,
+                                    reduce='moments'))
+    assert [c[0] for c in chunks] == [0, 3]
+    centroid = numpy.concatenate([c[1][0] for c in chunks], axis=-1)
+    moments = numpy.concatenate([c[1][1] for c in chunks], axis=-1)
+    dev = r_out - numpy.mean(r_out, axis=1, keepdims=True)
+    expected = numpy.einsum('inrt,jnrt->ijrt', dev, dev) / 50
+    numpy.testing.assert_allclose(centroid, numpy.mean(r_out, axis=1),
+                                  rtol=0, atol=1.e-18)
+    numpy.testing.assert_allclose(moments, expected, rtol=1.e-10, atol=0)
+
+
+def test_lattice_pass_out_sink(hmba_lattice):
+    lattice = list(hmba_lattice)
+    rin = numpy.asfortranarray(numpy.random.default_rng(3).normal(
+        scale=1e-5, size=(6, 8)))
+    r_out = lattice_pass(lattice, rin.copy(order='F'), nturns=5,
+                         refpts=[0, 10])
+    sink = numpy.zeros((6, 8, 2, 5))
+    res = lattice_pass(lattice, rin, nturns=5, refpts=[0, 10], out=sink,
+                       chunk_turns=2)
+    assert res is sink
+    numpy.testing.assert_equal(sink, r_out)
+
+
+def test_lattice_pass_async(hmba_lattice):
+    lattice = list(hmba_lattice)
+    rin = numpy.asfortranarray(numpy.random.default_rng(4).normal(
+        scale=1e-5, size=(6, 8)))
+    r_out = lattice_pass(lattice, rin.copy(order='F'), nturns=5,
+                         refpts=[0, 10])
+    r1 = rin.copy(order='F')
+    r2 = rin.copy(order='F')
+    first_turns = []
+    fut1 = lattice_pass_async(lattice, r1, 5, refpts=[0, 10])
+    fut2 = lattice_pass_async(lattice, r2, 5, refpts=[0, 10],
+                              chunk_turns=2,
+                              callback=lambda t, r: first_turns.append(t))
+    numpy.testing.assert_equal(fut1.result(), r_out)
+    numpy.testing.assert_equal(fut2.result(), r_out)
+    numpy.testing.assert_equal(r2, r1)
+    assert first_turns == [0, 2, 4]
+
+
+def test_patpass_gives_same_result(hmba_lattice):
+    from at.tracking import patpass
+    lattice = list(hmba_lattice)
+    rin = numpy.asfortranarray(numpy.random.default_rng(4).normal(
+        scale=1e-5, size=(6, 10)))
+    rin2 = rin.copy(order='F')
+    refpts = [0, 10, len(lattice)]
+    r_out = lattice_pass(lattice, rin, nturns=3, refpts=refpts)
+    r_par = patpass(lattice, rin2, nturns=3, refpts=refpts, pool_size=2)
+    numpy.testing.assert_equal(rin2, rin)
+    numpy.testing.assert_equal(r_par, r_out)
+    # The workers reuse their cached lattice
+    r_par = patpass(lattice, rin2, nturns=3, refpts=refpts, pool_size=2,
+                    keep_lattice=True)
+    r_out = lattice_pass(lattice, rin, nturns=3, refpts=refpts)
+    numpy.testing.assert_equal(r_par, r_out)
+
+
+@pytest.mark.parametrize('losses', [False, True])
+def test_lattice_pass_comm(hmba_lattice, losses):
+    pytest.importorskip('mpi4py')
+    from mpi4py import MPI
+    lattice = list(hmba_lattice)
+    rin = numpy.asfortranarray(numpy.random.default_rng(5).normal(
+        scale=1e-5, size=(6, 7)))
+    rin2 = rin.copy(order='F')
+    r_out = lattice_pass(lattice, rin, nturns=2, refpts=[0, 10],
+                         losses=losses)
+    r_mpi = lattice_pass(lattice, rin2, nturns=2, refpts=[0, 10],
+                         losses=losses, comm=MPI.COMM_SELF)
+    numpy.testing.assert_equal(rin2, rin)
+    if losses:
+        numpy.testing.assert_equal(r_mpi[0], r_out[0])
+        for key in r_out[1]:
+            numpy.testing.assert_equal(r_mpi[1][key], r_out[1][key])
+    else:
+        numpy.testing.assert_equal(r_mpi, r_out)
+
+
+def test_lattice_variants_pass(hmba_lattice):
+    lattice = hmba_lattice.deepcopy()
+    quads = lattice.get_uint32_index(elements.Quadrupole)[:2]
+    variants = [{}, {quads[0]: {'T1': numpy.array([1e-4, 0, 0, 0, 0, 0])}},
+                {quads[1]: {'K': 1.01 * lattice[quads[1]].K}}]
+    rin = numpy.asfortranarray(numpy.random.default_rng(3).normal(
+        scale=1e-5, size=(6, 4)))
+    r_var = lattice_variants_pass(lattice, rin, variants, nturns=2,
+                                  refpts=[0, 10])
+    assert r_var.shape == (6, 4, 3, 2, 2)
+    for iv, changes in enumerate(variants):
+        line = lattice.deepcopy()
+        for index, attrs in changes.items():
+            line[index].update(attrs)
+        r_out = lattice_pass(line, rin.copy(order='F'), nturns=2,
+                             refpts=[0, 10])
+        numpy.testing.assert_equal(r_var[:, :, iv], r_out)
+
+
+def test_multibunch_beam(hmba_lattice):
+    ring = hmba_lattice.enable_6d(copy=True)
+    ring.set_fillpattern(4)
+    sigma = numpy.diag([1.e-10, 1.e-11, 1.e-12, 1.e-12, 1.e-6, 1.e-6])
+    orbits = 1.e-3 * numpy.arange(24.0).reshape(6, 4)
+    random.reset(1)
+    r1 = beam(40000, sigma, orbit=orbits)
+    random.reset(1)
+    r2 = beam(40000, sigma, orbit=orbits, chunk_size=3000)
+    # The distribution does not depend on the chunk size
+    numpy.testing.assert_equal(r1, r2)
+    assert r2.flags.f_contiguous
+    std, mean = get_bunches_std_mean(r2, 4)
+    numpy.testing.assert_allclose(numpy.array(mean).T, orbits, atol=1.e-4)
+    numpy.testing.assert_allclose(sigma_matrix(beam=r2[:, ::4]), sigma,
+                                  rtol=0.05, atol=1.e-7)
+    # Single-pass unfolding, compared with one orbit search per bunch
+    o60, _ = ring.find_orbit()
+    unfolded = unfold_beam(ring, numpy.zeros((6, 8), order='F'))
+    for i, spos in enumerate(ring.bunch_spos[::-1]):
+        guess = o60.copy()
+        guess[5] -= spos
+        o6, _ = ring.find_orbit(guess=guess)
+        numpy.testing.assert_allclose(unfolded[:, i::4].T, [o6, o6],
+                                      rtol=0, atol=1.e-9)
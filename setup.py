@@ -1,5 +1,6 @@
 import glob
 import os
+import re
 from os.path import basename, exists, join, splitext
 import sys
 from setuptools import setup, Extension
@@ -27,6 +28,7 @@ def select_omp():
 print("** Entering setup.py:", str(sys.argv))
 print("** MPI:", os.environ.get('MPI', None))
 print("** OPENMP:", os.environ.get('OPENMP', None))
+print("** STATIC_PASSMETHODS:", os.environ.get('STATIC_PASSMETHODS', None))
 macros = [('PYAT', None)]
 with_openMP = False
 
@@ -91,10 +93,15 @@ if not sys.platform.startswith('win32'):
 # sufficient.
 integrator_src_orig = 'atintegrators'
 diffmatrix_orig = join('atmat', 'atphysics', 'Radiation')
+nafflib_orig = join('atmat', 'atphysics', 'nafflib')
+rdt_orig = join('atmat', 'atphysics', 'NonLinearDynamics')
 
 c_pass_methods = glob.glob(join(integrator_src_orig, '*Pass.c'))
 cpp_pass_methods = glob.glob(join(integrator_src_orig, '*Pass.cc'))
 diffmatrix_source = join(diffmatrix_orig, 'findmpoleraddiffmatrix.c')
+nafflib_sources = [join(nafflib_orig, f) for f in
+                   ('nafflib.c', 'modnaff.c', 'complexe.c')]
+rdt_source = join(rdt_orig, 'RDTelegantAT.cpp')
 at_source = join('pyat', 'at.c')
 
 
@@ -124,11 +131,81 @@ def cpp_integrator_ext(pass_method):
     )
 
 
+
+
+def static_passmethods(pass_methods, build_dir):
+    """Generate the sources linking the C passmethods into atpass
+
+    Each integrator is compiled in a wrapper renaming its entry points.
+    static_passmethods.h declares them and defines the dispatch table
+    searched by at.c before loading a passmethod dynamically.
+    """
+    def has(pattern, source):
+        return re.search(pattern, source, re.MULTILINE) is not None
+
+    os.makedirs(build_dir, exist_ok=True)
+    sources = []
+    decls = []
+    table = []
+    for pass_method in sorted(pass_methods, key=basename):
+        name, _ = splitext(basename(pass_method))
+        with open(pass_method) as f:
+            source = f.read()
+        entries = []
+        for func, ctype in (('trackFunction', 'double'),
+                            ('trackFunctionSoA', 'double'),
+                            ('trackFunctionTangent', 'double'),
+                            ('trackFunctionFloat', 'float')):
+            ptrn = r'^\s*ExportMode\s+struct\s+elem\s*\*\s*{0}\s*\('
+            if has(ptrn.format(func), source):
+                decls.append('struct elem *{0}_{1}(const PyObject *, '
+                             'struct elem *, {2} *, int, '
+                             'struct parameters *);'.format(name, func,
+                                                            ctype))
+                entries.append('{0}_{1}'.format(name, func))
+            else:
+                entries.append('NULL')
+        collective = has(r'^\s*COLLECTIVE_PASSMETHOD', source)
+        table.append('    {{"{0}", {1}, {2}, {3}, {4}, {5}}},'.format(
+            name, *entries, 'true' if collective else 'false'))
+        wrapper = join(build_dir, name + '_static.c')
+        with open(wrapper, 'w') as f:
+            f.write('/* Generated by setup.py */\n')
+            for func in ('trackFunction', 'trackFunctionSoA',
+                         'trackFunctionTangent', 'trackFunctionFloat',
+                         'atCollective'):
+                f.write('#define {0} {1}_{0}\n'.format(func, name))
+            f.write('#include "{0}"\n'.format(basename(pass_method)))
+        sources.append(wrapper)
+    with open(join(build_dir, 'static_passmethods.h'), 'w') as f:
+        f.write('/* Generated by setup.py */\n')
+        f.write('\n'.join(decls))
+        f.write('\n\nstatic const struct static_passmethod '
+                'static_passmethods[] = {\n')
+        f.write('\n'.join(table))
+        f.write('\n};\n')
+    return sources
+
+
+# Optionally link the C passmethods into atpass, avoiding to load a
+# shared library for each of them. The separate passmethod extensions
+# are still built, and the other passmethods are still loaded dynamically
+static = eval(os.environ.get('STATIC_PASSMETHODS', 'None'))
+if static:
+    static_dir = join('build', 'static_passmethods')
+    at_sources = [at_source] + static_passmethods(c_pass_methods, static_dir)
+    at_macros = [('AT_STATIC_PASSMETHODS', None)]
+    at_includes = [static_dir] + ([mpi_includes] if mpi_includes else [])
+else:
+    at_sources = [at_source]
+    at_macros = []
+    at_includes = []
+
 at = Extension(
     'at.tracking.atpass',
-    sources=[at_source],
-    define_macros=macros + omp_macros + mpi_macros,
-    include_dirs=[numpy.get_include(), integrator_src_orig],
+    sources=at_sources,
+    define_macros=macros + omp_macros + mpi_macros + at_macros,
+    include_dirs=[numpy.get_include(), integrator_src_orig] + at_includes,
     extra_compile_args=cflags + omp_cflags,
     extra_link_args=omp_lflags
 )
@@ -144,12 +221,31 @@ diffmatrix = Extension(
     name='at.physics.diffmatrix',
     sources=[diffmatrix_source],
     include_dirs=[numpy.get_include(), integrator_src_orig],
-    define_macros=macros,
-    extra_compile_args=cflags
+    define_macros=macros + omp_macros,
+    extra_compile_args=cflags + omp_cflags,
+    extra_link_args=omp_lflags
+)
+
+nafflib = Extension(
+    name='at.physics.nafflib',
+    sources=nafflib_sources,
+    include_dirs=[numpy.get_include(), integrator_src_orig, nafflib_orig],
+    define_macros=macros + omp_macros,
+    extra_compile_args=cflags + omp_cflags,
+    extra_link_args=omp_lflags
+)
+
+rdtelegant = Extension(
+    name='at.physics.rdtelegant',
+    sources=[rdt_source],
+    include_dirs=[numpy.get_include(), integrator_src_orig],
+    define_macros=macros + omp_macros,
+    extra_compile_args=cppflags + omp_cflags,
+    extra_link_args=omp_lflags
 )
 
 setup(
-    ext_modules=[at, cconfig, diffmatrix] +
+    ext_modules=[at, cconfig, diffmatrix, nafflib, rdtelegant] +
                 [c_integrator_ext(pm) for pm in c_pass_methods] +
                 [cpp_integrator_ext(pm) for pm in cpp_pass_methods],
 )